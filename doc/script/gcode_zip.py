@@ -0,0 +1,144 @@
+#!/usr/bin/env python
+"""\
+Compressed input encoder
+
+Encodes g-code for the compressed input mode of grblHAL, enabled by
+ENABLE_STREAM_COMPRESSION and the $ZIP=1 command. Each line is encoded
+against the last 62 characters sent, line ends excluded: a match is a
+match character followed by a distance character and copies 3 to 28
+characters, all other characters are literals.
+
+  match character    : 'a' to 'z' for lengths 3 to 28
+  distance character : '@' to '}' for distances 1 to 62
+  escape character   : '`', the next character is a literal
+
+Only printable characters are used since the controller filters control
+characters from the input stream as real-time commands. Lowercase letters
+and '`' are sent escaped. Lines are sent with LF line ends, CR and other
+control characters, and characters outside the ASCII range, are removed.
+
+The controller decodes from the first line sent after the response to
+$ZIP=1, a sender must wait for it before sending compressed lines. A
+soft reset disables compressed input and the encoder has to be reset.
+
+Usage: gcode_zip.py <file> [options]
+
+  -o <file>  : write the compressed stream to file.
+  -v         : decode the compressed stream and verify it.
+
+Prints the size before and after compression. Encoder can also be used
+from other scripts, see stream_bench.py -z:
+
+  encoder = Encoder()
+  data = encoder.encode('G1X10.125Y5.05')
+"""
+
+import argparse
+import sys
+
+MATCH_CHAR = ord('a')
+MIN_LENGTH = 3
+MAX_LENGTH = MIN_LENGTH + 25
+WINDOW = 62
+DISTANCE_CHAR = ord('@')
+ESCAPE_CHAR = ord('`')
+
+def clean (line):
+    return bytearray(c for c in bytearray(line.rstrip('\r\n').encode('ascii', 'ignore')) if 0x20 <= c < 0x7F)
+
+class Encoder:
+
+    def __init__ (self):
+        self.reset()
+
+    def reset (self):
+        self.history = bytearray()
+
+    # Returns the compressed bytes for line, a LF line end is added.
+    def encode (self, line):
+        buf = self.history + clean(line)
+        out = bytearray()
+        pos = len(self.history)
+        while pos < len(buf):
+            best, distance = 0, 0
+            for d in range(1, min(WINDOW, pos) + 1):
+                length = 0
+                while length < MAX_LENGTH and pos + length < len(buf) and buf[pos - d + length] == buf[pos + length]:
+                    length += 1
+                if length > best:
+                    best, distance = length, d
+            if best >= MIN_LENGTH:
+                out.append(MATCH_CHAR + best - MIN_LENGTH)
+                out.append(DISTANCE_CHAR + distance - 1)
+                pos += best
+            else:
+                if buf[pos] == ESCAPE_CHAR or ord('a') <= buf[pos] <= ord('z'):
+                    out.append(ESCAPE_CHAR)
+                out.append(buf[pos])
+                pos += 1
+        self.history = buf[-WINDOW:]
+        return bytes(out + b'\n')
+
+class Decoder:
+
+    def __init__ (self):
+        self.history = bytearray()
+
+    # Returns the decoded bytes, raises ValueError on an invalid match.
+    def decode (self, data):
+        data = bytearray(data)
+        out = bytearray()
+        idx = 0
+        while idx < len(data):
+            c = data[idx]
+            idx += 1
+            if c == ESCAPE_CHAR and idx < len(data):
+                c = data[idx]
+                idx += 1
+            elif ord('a') <= c <= ord('z'):
+                distance = data[idx] - DISTANCE_CHAR + 1 if idx < len(data) else 0
+                idx += 1
+                if distance < 1 or distance > min(WINDOW, len(self.history)):
+                    raise ValueError('invalid match at offset %d' % (idx - 2))
+                for i in range(c - MATCH_CHAR + MIN_LENGTH):
+                    self.history.append(self.history[-distance])
+                    out.append(self.history[-1])
+                continue
+            if c not in (0x0A, 0x0D):
+                self.history.append(c)
+            out.append(c)
+            self.history = self.history[-WINDOW:]
+        return bytes(out)
+
+def main ():
+    parser = argparse.ArgumentParser(description='Compress g-code for the grblHAL compressed input mode.')
+    parser.add_argument('file', help='g-code file')
+    parser.add_argument('-o', dest='output', help='compressed output file')
+    parser.add_argument('-v', dest='verify', action='store_true', help='decode and verify')
+    args = parser.parse_args()
+
+    encoder = Encoder()
+    plain = bytearray()
+    packed = bytearray()
+    with open(args.file) as f:
+        for line in f:
+            plain += clean(line) + b'\n'
+            packed += encoder.encode(line)
+
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(packed)
+
+    print('input       %d bytes' % len(plain))
+    print('compressed  %d bytes, ratio %.2f' % (len(packed), len(plain) / float(len(packed)) if packed else 0.0))
+
+    if args.verify:
+        if Decoder().decode(packed) != bytes(plain):
+            print('verify      FAILED')
+            return 1
+        print('verify      ok')
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
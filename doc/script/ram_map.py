@@ -0,0 +1,159 @@
+#!/usr/bin/env python
+"""\
+RAM usage summary from a GNU ld map file
+
+Reads the map file generated by the linker for a grblHAL build
+(add -Wl,-Map=<file> to the linker flags) and outputs the size of the
+RAM region(s), the static RAM used by each subsystem and the head-room
+left for heap and stack.
+
+Input sections of .data and .bss (and .noinit, COMMON) are grouped into
+subsystems by the object file they are from: core modules by name,
+plugins by directory and everything else as driver or library code.
+
+Usage: ram_map.py <map file> [-r <region>] [-v]
+
+  -r <region> : name of the RAM region, by default all regions with
+                names starting with RAM, SRAM or DRAM.
+  -v          : list the size of each object file as well.
+
+Compare with the output of the $MEM command when ENABLE_MEMORY_REPORT
+is enabled, the latter reports run time allocated buffers as well.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+RAM_SECTIONS = ('.data', '.bss', '.noinit', 'COMMON', '.dram0.data', '.dram0.bss')
+
+# Core modules grouped by subsystem, modules not listed are reported by name.
+CORE = {
+    'planner': 'PLANNER',
+    'stepper': 'STEPPER',
+    'protocol': 'PROTOCOL',
+    'gcode': 'PARSER',
+    'ngc_params': 'PARSER',
+    'ngc_expr': 'PARSER',
+    'ngc_flowctrl': 'PARSER',
+    'settings': 'SETTINGS',
+    'nvs_buffer': 'NVS',
+    'system': 'SYSTEM',
+    'report': 'REPORT',
+    'stream': 'STREAM',
+}
+
+MEMORY_RE = re.compile(r'^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(\s+\S+)?\s*$')
+SECTION_RE = re.compile(r'^\s*(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+)\s*$')
+NAME_RE = re.compile(r'^\s*(\S+)\s*$')
+ADDR_RE = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+)\s*$')
+
+def subsystem (path):
+    path = path.replace('\\', '/')
+    member = re.search(r'\(([^)]+)\)$', path)
+    name = os.path.splitext(os.path.basename(member.group(1) if member else path))[0]
+    parts = path.split('/')
+
+    if not member and name in CORE:
+        return CORE[name]
+
+    if 'grbl' in parts and not member:
+        return name.upper()
+
+    for plugin in ('networking', 'sdcard', 'keypad', 'odometer', 'spindle', 'laser', 'eeprom', 'trinamic', 'motors', 'bluetooth'):
+        if plugin in parts:
+            return plugin.upper()
+
+    return 'LIBRARY' if member or path.endswith('.a') else 'DRIVER'
+
+def parse (lines):
+    regions = []
+    sections = []
+    in_memory = False
+    pending = None
+
+    for line in lines:
+        if line.startswith('Memory Configuration'):
+            in_memory = True
+            continue
+
+        if in_memory:
+            if line.startswith('Linker script and memory map'):
+                in_memory = False
+            else:
+                match = MEMORY_RE.match(line)
+                if match and match.group(1) != 'Name':
+                    regions.append((match.group(1), int(match.group(2), 16), int(match.group(3), 16)))
+            continue
+
+        # Input sections with long names are split over two lines.
+        if pending:
+            match = ADDR_RE.match(line)
+            if match:
+                sections.append((pending, int(match.group(1), 16), int(match.group(2), 16), match.group(3)))
+            pending = None
+            continue
+
+        match = SECTION_RE.match(line)
+        if match:
+            sections.append((match.group(1), int(match.group(2), 16), int(match.group(3), 16), match.group(4)))
+            continue
+
+        match = NAME_RE.match(line)
+        if match and line.startswith(' ') and match.group(1).startswith(RAM_SECTIONS):
+            pending = match.group(1)
+
+    return regions, sections
+
+def main ():
+    parser = argparse.ArgumentParser(description='RAM usage summary from a GNU ld map file.')
+    parser.add_argument('map_file')
+    parser.add_argument('-r', '--region', help='name of the RAM region')
+    parser.add_argument('-v', '--verbose', action='store_true', help='list object files')
+    args = parser.parse_args()
+
+    with open(args.map_file) as f:
+        regions, sections = parse(f)
+
+    if args.region:
+        ram = [r for r in regions if r[0] == args.region]
+    else:
+        ram = [r for r in regions if r[0].upper().startswith(('RAM', 'SRAM', 'DRAM'))]
+
+    if not ram:
+        sys.exit('No RAM region found, available regions: ' + ', '.join(r[0] for r in regions))
+
+    used = {}
+    objects = {}
+
+    for name, address, size, path in sections:
+        if size == 0 or not name.startswith(RAM_SECTIONS):
+            continue
+        if not any(origin <= address < origin + length for _, origin, length in ram):
+            continue
+        key = subsystem(path)
+        used[key] = used.get(key, 0) + size
+        objects[path] = objects.get(path, 0) + size
+
+    region_size = sum(r[2] for r in ram)
+    total = sum(used.values())
+
+    for name, origin, length in ram:
+        print('%-12s 0x%08x %8d' % (name, origin, length))
+    print('')
+
+    for key in sorted(used, key=used.get, reverse=True):
+        print('%-12s %8d' % (key, used[key]))
+
+    if args.verbose:
+        print('')
+        for path in sorted(objects, key=objects.get, reverse=True):
+            print('%8d %s' % (objects[path], path))
+
+    print('')
+    print('%-12s %8d' % ('TOTAL', total))
+    print('%-12s %8d (%d%%)' % ('HEADROOM', region_size - total, (region_size - total) * 100 // region_size if region_size else 0))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,457 @@
+#!/usr/bin/env python
+"""\
+Streaming soak and latency benchmark
+
+Streams one or more g-code files to a grblHAL controller and measures
+how the connection performs under sustained load:
+
+  - per line ack latency, time from sending a line to its ok/error
+  - sustained lines per second
+  - status report round trip time under load, '?' to report
+  - planner and input buffer fill, sampled from the Bf: report field
+
+The controller is addressed by URL:
+
+  serial:///dev/ttyACM0   or just /dev/ttyACM0, COM3 - UART or USB CDC (pySerial)
+  telnet://<host>[:port]  - TCPStream, default port 23
+  ws://<host>[:port][/path] - WsStream, default port 80
+
+Lines are streamed with the character counting protocol (see stream.py)
+and the size of the controller input buffer, by default 1024 bytes.
+With -p lines are sent one at a time waiting for each response, the ack
+latency is then the round trip time of the connection plus parse time.
+
+Additional clients can be connected with -m while streaming, only one
+client can be the streaming client so these receive output only:
+
+  telnet://<host>[:port]  - monitor session, requires TELNET_MONITOR_SESSIONS
+  ws://<host>[:port]      - status push client, requires WEBSOCKET_STATUS_PUSH
+
+For each the number and interval of status reports received during the
+run is reported, which shows how additional clients affect the stream.
+
+Usage: stream_bench.py <url> <file> [<file> ...] [options]
+
+  -B <baud>       : serial baud rate, default 115200. Ignored for USB CDC.
+  -b <size>       : controller input buffer size, default 1024.
+  -p              : send-response streaming instead of character counting.
+  -r <n>          : stream the files n times, default 1 (soak test).
+  -i <ms>         : status report request interval, default 200. 0 disables.
+  -c              : run in check mode ($C), no motion is executed.
+  -z              : stream compressed ($ZIP=1), requires ENABLE_STREAM_COMPRESSION.
+  -m <url>        : additional client, may be repeated.
+  --planner <n>   : planner buffer size, reports fill instead of free blocks.
+  --csv <file>    : write per line results to file.
+
+Buffer fill is only sampled if the Bf: field is enabled in status reports
+by the $10 setting.
+"""
+
+import argparse
+import base64
+import gcode_zip
+import os
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+
+try:
+    import queue
+except ImportError:
+    import Queue as queue
+
+BF_RE = re.compile(r'\|Bf:(\d+),(\d+)')
+STATE_RE = re.compile(r'^<([A-Za-z]+)')
+
+# Transports, read() returns bytes received or b'' on timeout.
+
+class SerialTransport:
+
+    def __init__ (self, device, baud):
+        import serial
+        self.port = serial.Serial(device, baud, timeout=0.05)
+
+    def write (self, data):
+        self.port.write(data)
+
+    def read (self):
+        return self.port.read(self.port.in_waiting or 1)
+
+    def close (self):
+        self.port.close()
+
+class TelnetTransport:
+
+    def __init__ (self, host, port):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock.settimeout(0.05)
+
+    def write (self, data):
+        self.sock.sendall(data)
+
+    def read (self):
+        try:
+            data = self.sock.recv(4096)
+        except socket.timeout:
+            return b''
+        if not data:
+            raise EOFError('connection closed')
+        return data
+
+    def close (self):
+        self.sock.close()
+
+class WebSocketTransport (TelnetTransport):
+
+    def __init__ (self, host, port, path, protocol=None):
+        TelnetTransport.__init__(self, host, port)
+        self.sock.settimeout(5)
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = 'GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n' \
+                  'Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n' % (path, host, port, key)
+        if protocol:
+            request += 'Sec-WebSocket-Protocol: %s\r\n' % protocol
+        self.sock.sendall((request + '\r\n').encode())
+        response = b''
+        while b'\r\n\r\n' not in response:
+            data = self.sock.recv(1024)
+            if not data:
+                raise EOFError('connection closed during handshake')
+            response += data
+        header, self.pending = response.split(b'\r\n\r\n', 1)
+        if b' 101 ' not in header.split(b'\r\n')[0]:
+            raise IOError('websocket handshake failed: %s' % header.split(b'\r\n')[0].decode())
+        self.sock.settimeout(0.05)
+        self.frames = 0
+
+    def write (self, data, opcode=0x01):
+        mask = os.urandom(4)
+        length = len(data)
+        if length < 126:
+            header = struct.pack('!BB', 0x80 | opcode, 0x80 | length)
+        elif length < 65536:
+            header = struct.pack('!BBH', 0x80 | opcode, 0x80 | 126, length)
+        else:
+            header = struct.pack('!BBQ', 0x80 | opcode, 0x80 | 127, length)
+        payload = bytes(bytearray(b ^ bytearray(mask)[i & 3] for i, b in enumerate(bytearray(data))))
+        self.sock.sendall(header + mask + payload)
+
+    def read (self):
+        data = TelnetTransport.read(self)
+        self.pending += data
+        out = b''
+        while True:
+            buf = bytearray(self.pending)
+            if len(buf) < 2:
+                break
+            opcode, length, idx = buf[0] & 0x0F, buf[1] & 0x7F, 2
+            if length == 126:
+                if len(buf) < 4:
+                    break
+                length, idx = struct.unpack('!H', self.pending[2:4])[0], 4
+            elif length == 127:
+                if len(buf) < 10:
+                    break
+                length, idx = struct.unpack('!Q', self.pending[2:10])[0], 10
+            if len(buf) < idx + length:
+                break
+            payload, self.pending = self.pending[idx:idx + length], self.pending[idx + length:]
+            if opcode in (0x00, 0x01, 0x02):
+                out += payload
+                self.frames += 1
+            elif opcode == 0x09:
+                self.write(payload, 0x0A)   # Pong
+            elif opcode == 0x08:
+                raise EOFError('connection closed')
+        return out
+
+def connect (url, baud, protocol=None):
+    m = re.match(r'^(serial|telnet|ws)://([^:/]*)(?::(\d+))?(/.*)?$', url)
+    if not m or m.group(1) == 'serial':
+        return SerialTransport(url[9:] if url.startswith('serial://') else url, baud)
+    if m.group(1) == 'telnet':
+        return TelnetTransport(m.group(2), int(m.group(3) or 23))
+    return WebSocketTransport(m.group(2), int(m.group(3) or 80), m.group(4) or '/', protocol)
+
+# Receives data in a separate thread, complete lines are queued with a timestamp.
+
+class Reader (threading.Thread):
+
+    def __init__ (self, transport):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.transport = transport
+        self.lines = queue.Queue()
+        self.running = True
+        self.error = None
+
+    def run (self):
+        buf = b''
+        while self.running and not self.error:
+            try:
+                data = self.transport.read()
+            except Exception as e:
+                self.error = e
+                break
+            if data:
+                now = time.time()
+                buf += data
+                while b'\n' in buf:
+                    line, buf = buf.split(b'\n', 1)
+                    line = line.strip().decode('ascii', 'replace')
+                    if line:
+                        self.lines.put((now, line))
+
+    def stop (self):
+        self.running = False
+        self.join(1)
+
+# Output only client, counts status reports received.
+
+class Monitor (Reader):
+
+    def __init__ (self, url, baud):
+        self.url = url
+        ws = url.startswith('ws://')
+        Reader.__init__(self, connect(url, baud, 'grblHAL.status' if ws else None))
+        self.binary = ws
+        self.reports = []
+
+    def run (self):
+        if not self.binary:
+            Reader.run(self)
+            return
+        while self.running and not self.error:   # Status push frames are binary, count them
+            try:
+                frames = self.transport.frames
+                self.transport.read()
+                if self.transport.frames > frames:
+                    self.reports.append(time.time())
+            except Exception as e:
+                self.error = e
+
+    def collect (self):
+        while not self.lines.empty():
+            t, line = self.lines.get()
+            if line.startswith('<'):
+                self.reports.append(t)
+
+def percentiles (values):
+    if not values:
+        return 'n 0'
+    v = sorted(values)
+    pick = lambda p: v[min(len(v) - 1, int(p * len(v)))]
+    return 'n %d  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f' % (len(v), pick(0.5), pick(0.9), pick(0.99), v[-1])
+
+class Bench:
+
+    def __init__ (self, args):
+        self.args = args
+        self.transport = connect(args.url, args.baud)
+        self.reader = Reader(self.transport)
+        self.pending = []           # (line number, length, send time) awaiting response
+        self.results = []           # (line number, send time, ack time, response)
+        self.status_rtt = []
+        self.planner_free = []
+        self.rx_free = []
+        self.status_sent = None
+        self.next_status = 0
+        self.state = ''
+        self.messages = 0
+        self.encoder = None
+        self.bytes_in = 0           # Line bytes before compression
+        self.bytes_out = 0          # Line bytes sent
+
+    def write (self, data):
+        self.transport.write(data if isinstance(data, bytes) else data.encode())
+
+    def poll_status (self, now):
+        if self.args.interval and self.status_sent is None and now >= self.next_status:
+            self.status_sent = now
+            self.next_status = now + self.args.interval / 1000.0
+            self.write('?')
+
+    def process (self, timeout):
+        try:
+            t, line = self.reader.lines.get(timeout=timeout)
+        except queue.Empty:
+            if self.reader.error:
+                raise self.reader.error
+            return False
+        if line.startswith('ok') or line.startswith('error'):
+            if self.pending:
+                n, length, sent = self.pending.pop(0)
+                self.results.append((n, sent, t, line))
+        elif line.startswith('<'):
+            m = STATE_RE.match(line)
+            if m:
+                self.state = m.group(1)
+            m = BF_RE.search(line)
+            if m:
+                self.planner_free.append(int(m.group(1)))
+                self.rx_free.append(int(m.group(2)))
+            if self.status_sent is not None:
+                self.status_rtt.append((t - self.status_sent) * 1000.0)
+                self.status_sent = None
+        else:
+            self.messages += 1
+        return True
+
+    def drain (self, timeout):
+        end = time.time() + timeout
+        while time.time() < end:
+            self.process(0.05)
+
+    def command (self, cmd):
+        self.pending.append((0, len(cmd) + 1, time.time()))
+        self.write(cmd + '\n')
+        end = time.time() + 5.0
+        while self.pending and time.time() < end:
+            self.process(0.05)
+
+    def wait_idle (self):
+        self.state = ''
+        while True:
+            self.status_sent, self.next_status = None, 0
+            self.poll_status(time.time())
+            self.drain(0.25)
+            if self.state in ('Idle', 'Check', 'Alarm'):
+                break
+
+    def stream (self, lines):
+        buffered = 0
+        n = 0
+        for line in lines:
+            n += 1
+            data = self.encoder.encode(line) if self.encoder else (line + '\n').encode()
+            self.bytes_in += len(line) + 1
+            self.bytes_out += len(data)
+            while self.pending and (self.args.ping_pong or buffered + len(data) >= self.args.buffer):
+                if self.process(0.01):
+                    buffered = sum(p[1] for p in self.pending)
+                self.poll_status(time.time())
+            self.poll_status(time.time())
+            self.pending.append((n, len(data), time.time()))
+            buffered += len(data)
+            self.write(data)
+            while self.process(0):
+                buffered = sum(p[1] for p in self.pending)
+        while self.pending:
+            if not self.process(0.01) and self.reader.error:
+                break
+            self.poll_status(time.time())
+
+def corpus (files, repeat):
+    for i in range(repeat):
+        for name in files:
+            with open(name) as f:
+                for line in f:
+                    line = line.strip()
+                    if line:
+                        yield line
+
+def report (bench, monitors, start, end, args):
+    results = [r for r in bench.results if r[0]]
+    errors = sum(1 for r in results if r[3].startswith('error'))
+    duration = end - start
+    print('transport        %s' % args.url)
+    print('lines            %d (%d errors, %d other messages)' % (len(results), errors, bench.messages))
+    print('duration         %.1f s' % duration)
+    print('lines/s          %.0f' % (len(results) / duration if duration > 0 else 0))
+    if bench.encoder and bench.bytes_out:
+        print('compression      %d to %d bytes, ratio %.2f' % (bench.bytes_in, bench.bytes_out, bench.bytes_in / float(bench.bytes_out)))
+    print('ack latency ms   %s' % percentiles([(a - s) * 1000.0 for n, s, a, r in results]))
+    print('status rtt ms    %s' % percentiles(bench.status_rtt))
+    if bench.planner_free:
+        if args.planner:
+            fill = [args.planner - f for f in bench.planner_free]
+            print('planner fill     min %d  mean %.1f  max %d' % (min(fill), sum(fill) / float(len(fill)), max(fill)))
+        else:
+            print('planner free     min %d  mean %.1f  max %d' % (min(bench.planner_free), sum(bench.planner_free) / float(len(bench.planner_free)), max(bench.planner_free)))
+        print('input free       min %d  mean %.1f' % (min(bench.rx_free), sum(bench.rx_free) / float(len(bench.rx_free))))
+    for idx, m in enumerate(monitors):
+        m.collect()
+        reports = [t for t in m.reports if start <= t <= end]
+        intervals = [(b - a) * 1000.0 for a, b in zip(reports, reports[1:])]
+        print('client %d         %s: %sreports %d, interval ms %s' % (idx + 1, m.url, 'ERROR %s, ' % m.error if m.error else '',
+                                                               len(reports), percentiles(intervals)))
+    if args.csv:
+        with open(args.csv, 'w') as f:
+            f.write('line,sent,ack,latency_ms,response\n')
+            for n, s, a, r in results:
+                f.write('%d,%.6f,%.6f,%.3f,%s\n' % (n, s - start, a - start, (a - s) * 1000.0, r))
+
+def main ():
+    parser = argparse.ArgumentParser(description='Stream g-code files to grblHAL and measure ack latency, throughput and status report round trip time.')
+    parser.add_argument('url', help='controller URL, serial device, telnet://host[:port] or ws://host[:port]')
+    parser.add_argument('files', nargs='+', help='g-code files to stream')
+    parser.add_argument('-B', dest='baud', type=int, default=115200, help='serial baud rate')
+    parser.add_argument('-b', dest='buffer', type=int, default=1024, help='controller input buffer size')
+    parser.add_argument('-p', dest='ping_pong', action='store_true', help='send-response streaming')
+    parser.add_argument('-r', dest='repeat', type=int, default=1, help='number of times to stream the files')
+    parser.add_argument('-i', dest='interval', type=int, default=200, help='status report request interval in ms, 0 to disable')
+    parser.add_argument('-c', dest='check', action='store_true', help='run in check mode')
+    parser.add_argument('-z', dest='compress', action='store_true', help='stream compressed')
+    parser.add_argument('-m', dest='monitors', action='append', default=[], help='additional output only client URL')
+    parser.add_argument('--planner', type=int, default=0, help='planner buffer size')
+    parser.add_argument('--csv', help='per line results file')
+    args = parser.parse_args()
+
+    bench = Bench(args)
+    bench.reader.start()
+
+    bench.write('\r\n\r\n')         # Wake up and flush startup text
+    bench.drain(2.0)
+    bench.pending = []
+
+    if args.check:
+        bench.command('$C')
+
+    if args.compress:
+        bench.command('$ZIP=1')     # Compressed input starts after the response
+        bench.encoder = gcode_zip.Encoder()
+
+    monitors = []
+    for url in args.monitors:
+        try:
+            m = Monitor(url, args.baud)
+            m.start()
+            monitors.append(m)
+        except Exception as e:
+            print('client %s: %s' % (url, e))
+
+    start = time.time()
+    try:
+        bench.stream(corpus(args.files, args.repeat))
+        if not args.check:
+            bench.wait_idle()
+    except KeyboardInterrupt:
+        bench.write('\x18')         # Soft reset
+        print('Aborted')
+    end = time.time()
+
+    if args.compress:
+        bench.write(bench.encoder.encode('$ZIP=0'))
+        bench.drain(0.5)
+
+    if args.check:
+        bench.command('$C')
+
+    for m in monitors:
+        m.stop()
+    bench.reader.stop()
+
+    report(bench, monitors, start, end, args)
+
+    for m in monitors:
+        m.transport.close()
+    bench.transport.close()
+
+    return 1 if bench.reader.error else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -50,6 +50,8 @@
 #define SPP_DISCONNECTED (1 << 3)
 #define BT_TX_QUEUE_ENTRIES 32
 #define BT_TX_BUFFER_SIZE 250
+#define BT_TX_MTU ESP_SPP_MAX_MTU   // Max number of queued lines sent in one write.
+#define BT_TX_POLL_TIMEOUT 20       // ms, max time between checks for queued lines when not notified.
 
 #define USE_BT_MUTEX 0
 
@@ -140,7 +142,8 @@ static inline bool enqueue_tx_chunk (uint16_t length, uint8_t *data)
         if (xQueueSendToBack(tx_queue, &chunk, portMAX_DELAY) != pdPASS) {
             free(chunk);
             chunk = NULL;
-        }
+        } else
+            xTaskNotifyGive(polltask);
     }
 
     return chunk != NULL;
@@ -149,10 +152,9 @@ static inline bool enqueue_tx_chunk (uint16_t length, uint8_t *data)
 // Since grbl always sends cr/lf terminated strings we can send complete strings to improve throughput
 bool BTStreamPutC (const char c)
 {
-    if(txbuffer.head < BT_TX_BUFFER_SIZE)
-        txbuffer.data[txbuffer.head++] = c;
+    txbuffer.data[txbuffer.head++] = c;
 
-    if(c == '\n') {
+    if(c == '\n' || txbuffer.head == BT_TX_BUFFER_SIZE) {
         enqueue_tx_chunk(txbuffer.head, (uint8_t *)txbuffer.data);
         txbuffer.head = 0;
     }
@@ -293,42 +295,46 @@ static void esp_spp_cb (esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
             break;
 
         case ESP_SPP_DATA_IND_EVT:;
+            // The received data is added to the input buffer in one go, the head pointer is updated when done.
             char c;
-            uint16_t len = param->data_ind.len;
+            uint16_t len = param->data_ind.len, head = rxbuffer.head, bptr;
             uint8_t *data = param->data_ind.data;
 
-            while(len--) {
+            // discard input if MPG has taken over...
+            if(hal.stream.type != StreamType_MPG) while(len--) {
+
                 c = (char)*data++;
-                // discard input if MPG has taken over...
-                if(hal.stream.type != StreamType_MPG) {
 
-                    if(c == CMD_TOOL_ACK && !rxbuffer.backup) {
+                if(c == CMD_TOOL_ACK && !rxbuffer.backup) {
 
-                        memcpy(&rxbackup, &rxbuffer, sizeof(stream_rx_buffer_t));
-                        rxbuffer.backup = true;
-                        rxbuffer.tail = rxbuffer.head;
-                        hal.stream.read = BTStreamGetC; // restore normal input
+                    rxbuffer.head = head;
+                    memcpy(&rxbackup, &rxbuffer, sizeof(stream_rx_buffer_t));
+                    rxbuffer.backup = true;
+                    rxbuffer.tail = head;
+                    hal.stream.read = BTStreamGetC; // restore normal input
 
-                    } else if(!hal.stream.enqueue_realtime_command(c)) {
+                } else if(!hal.stream.enqueue_realtime_command(c)) {
 
-                        uint32_t bptr = (rxbuffer.head + 1) & (RX_BUFFER_SIZE - 1);  // Get next head pointer
+                    bptr = (head + 1) & (RX_BUFFER_SIZE - 1);   // Get next head pointer
 
-                        if(bptr == rxbuffer.tail)               // If buffer full
-                            rxbuffer.overflow = 1;              // flag overflow,
-                        else {
-                            rxbuffer.data[rxbuffer.head] = c;   // else add data to buffer
-                            rxbuffer.head = bptr;               // and update pointer
-                        }
+                    if(bptr == rxbuffer.tail)                   // If buffer full
+                        rxbuffer.overflow = 1;                  // flag overflow,
+                    else {
+                        rxbuffer.data[head] = c;                // else add data to buffer
+                        head = bptr;                            // and update pointer
                     }
                 }
             }
+            rxbuffer.head = head;
             break;
 
         case ESP_SPP_CONG_EVT:
             if(param->cong.cong)
                 xEventGroupClearBits(event_group, SPP_CONGESTED);
-            else
+            else {
                 xEventGroupSetBits(event_group, SPP_CONGESTED);
+                xTaskNotifyGive(polltask);
+            }
             ESP_LOGI(SPP_TAG, "ESP_SPP_CONG_EVT");
             break;
 
@@ -336,6 +342,7 @@ static void esp_spp_cb (esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
             if(param->write.cong)
                 xEventGroupClearBits(event_group, SPP_CONGESTED);
             xSemaphoreGive(tx_busy);
+            xTaskNotifyGive(polltask);
             break;
 
         default:
@@ -388,14 +395,15 @@ static void pollTX (void * arg)
 {
     tx_chunk_t *chunk = NULL;
     bool data_sent = false;
-    uint8_t buffer[256], *ptr;
+    static uint8_t buffer[BT_TX_MTU];
+    uint8_t *ptr;
     size_t remaining;
 
     while(true) {
 
         if(connection &&
             xEventGroupWaitBits(event_group, SPP_CONGESTED, pdFALSE, pdTRUE, 0) &&
-             uxQueueMessagesWaiting(tx_queue) &&
+             (chunk || uxQueueMessagesWaiting(tx_queue)) &&
               xSemaphoreTake(tx_busy, (TickType_t)0)) {
 
             data_sent = false;
@@ -428,8 +436,10 @@ static void pollTX (void * arg)
                xSemaphoreGive(tx_busy);
         }
 
+        // Lines queued while a write is in progress are sent together when it completes,
+        // the task is notified when lines are queued, a write completes or congestion ends.
         if(connection)
-            vTaskDelay(pdMS_TO_TICKS(10));
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_TX_POLL_TIMEOUT));
         else
             vTaskSuspend(NULL);
     }
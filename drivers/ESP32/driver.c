@@ -34,9 +34,16 @@
 #include "nvs.h"
 #include "grbl/protocol.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "soc/cpu.h"
+#include "esp_timer.h"
+#include "esp32/clk.h"
 
 #ifdef USE_I2S_OUT
 #include "i2s_out.h"
+#ifndef I2S_OUT_JOG_LATENCY
+#define I2S_OUT_JOG_LATENCY 2000 // I2S bitstream latency in usec when jogging
+#endif
 #endif
 
 #if WIFI_ENABLE
@@ -94,6 +101,7 @@ static spindle_pwm_t spindle_pwm;
 
 // prescale step counter to 20Mhz
 #define STEPPER_DRIVER_PRESCALER 4
+#define RMT_CLOCK_DIVIDER 20 // RMT clock is 4 MHz
 
 #if PWM_RAMPED
 
@@ -169,7 +177,7 @@ void tcpStreamWriteS (const char *data)
 {
 #if TELNET_ENABLE
     if(services.telnet)
-        TCPStreamWriteS(data);
+        TCPStreamWriteAllS(data);
 #endif
 #if WEBSOCKET_ENABLE
     if(services.websocket)
@@ -327,8 +335,47 @@ static TimerHandle_t xModBusTimer = NULL;
 static void gpio_isr (void *arg);
 static void stepper_driver_isr (void *arg);
 
+#ifdef ENABLE_IRQ_STATS
+static irq_stats_t irq_stepper = { .name = "STEPPER", .priority = IRQ_PRIORITY_STEPPER, .step_timing = true };
+static irq_stats_t irq_inputs = { .name = "INPUTS", .priority = IRQ_PRIORITY_INPUTS };
+#endif
+
 static TimerHandle_t xDelayTimer = NULL, debounceTimer = NULL;
 
+#ifndef USE_I2S_OUT
+static bool rmt_burst = false;              // RMT memory holds a step burst pulse train
+static uint32_t rmt_pulse_ticks;            // Step pulse delay + length in RMT clock ticks
+static uint32_t step_cycles_per_tick;       // Current stepper interrupt period, used for spacing burst mode step pulses
+static rmt_item32_t rmt_pulse[N_AXIS];      // Step pulse item per channel
+#endif
+
+#if PREP_TASK_ENABLE && !defined(USE_I2S_OUT)
+
+static TaskHandle_t prepTaskHandle = NULL;
+
+// Step segment preparation task. It runs on the same core as the grbl task and at a higher priority,
+// so it may preempt the grbl task but never the other way around, as required by st_prep_buffer().
+static void prepTask (void *arg)
+{
+    while(true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        hal.stepper.prep_callback();
+    }
+}
+
+// Requests step segment preparation, called from the stepper ISR
+IRAM_ATTR static void stepperPrepRequest (void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(prepTaskHandle, &xHigherPriorityTaskWoken);
+
+    if(xHigherPriorityTaskWoken)
+        portYIELD_FROM_ISR();
+}
+
+#endif
+
 static void activateStream (const io_stream_t *stream)
 {
 #if MPG_MODE_ENABLE
@@ -393,7 +440,7 @@ void initRMT (settings_t *settings)
 
     rmt_config_t rmtConfig = {
         .rmt_mode = RMT_MODE_TX,
-        .clk_div = 20,
+        .clk_div = RMT_CLOCK_DIVIDER,
         .mem_block_num = 1,
         .tx_config.loop_en = false,
         .tx_config.carrier_en = false,
@@ -408,6 +455,9 @@ void initRMT (settings_t *settings)
     rmtItem[1].duration0 = 0;
     rmtItem[1].duration1 = 0;
 
+    rmt_burst = false;
+    rmt_pulse_ticks = rmtItem[0].duration0 + rmtItem[0].duration1;
+
     uint32_t channel;
     for(channel = 0; channel < N_AXIS; channel++) {
 
@@ -429,6 +479,7 @@ void initRMT (settings_t *settings)
         }
         rmtItem[0].level0 = rmtConfig.tx_config.idle_level;
         rmtItem[0].level1 = !rmtConfig.tx_config.idle_level;
+        rmt_pulse[channel] = rmtItem[0];
         rmt_config(&rmtConfig);
         rmt_fill_tx_items(rmtConfig.channel, &rmtItem[0], 2, 0);
     }
@@ -445,6 +496,25 @@ void vTimerCallback (TimerHandle_t xTimer)
     xDelayTimer = NULL;
 }
 
+IRAM_ATTR static uint32_t getCycleCount (void)
+{
+    return esp_cpu_get_ccount();
+}
+
+IRAM_ATTR static uint32_t getMicros (void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+#ifdef ENABLE_MEMORY_REPORT
+
+static uint32_t getFreeMem (void)
+{
+    return esp_get_free_heap_size();
+}
+
+#endif
+
 IRAM_ATTR static void driver_delay_ms (uint32_t ms, void (*callback)(void))
 {
     if(callback) {
@@ -572,10 +642,20 @@ IRAM_ATTR static void I2S_stepperCyclesPerTick (uint32_t cycles_per_tick)
 // Sets stepper direction and pulse pins and starts a step pulse
 IRAM_ATTR static void I2S_stepperPulseStart (stepper_t *stepper)
 {
-    if(stepper->dir_change) {
+    if(stepper->dir_change)
         set_dir_outputs(stepper->dir_outbits);
 
-    if(stepper->step_outbits.value) {
+    if(stepper->burst_steps) {
+        // Burst mode, output the step events back to back with a gap of one pulse length.
+        uint_fast8_t idx = 0;
+        do {
+            if(idx)
+                i2s_out_push_sample(i2s_step_samples);
+            i2s_set_step_outputs(stepper->step_burst[idx]);
+            i2s_out_push_sample(i2s_step_samples);
+            i2s_set_step_outputs((axes_signals_t){0});
+        } while(++idx < stepper->burst_steps);
+    } else if(stepper->step_outbits.value) {
         i2s_set_step_outputs(stepper->step_outbits);
         i2s_out_push_sample(i2s_step_samples);
         i2s_set_step_outputs((axes_signals_t){0});
@@ -587,6 +667,9 @@ static void I2S_stepperWakeUp (void)
 {
     // Enable stepper drivers.
     stepperEnable((axes_signals_t){AXES_BITMASK});
+    // Keep the bitstream queue shallow when jogging for quick response to jog cancel,
+    // deep when running a program for throughput.
+    i2s_out_set_latency(sys.state == STATE_JOG ? I2S_OUT_JOG_LATENCY : 0);
     i2s_out_set_stepping();
 }
 
@@ -595,6 +678,17 @@ static void I2S_stepperWakeUp (void)
 // Set stepper pulse output pins
 inline IRAM_ATTR static void set_step_outputs (axes_signals_t step_outbits)
 {
+    if(rmt_burst) {
+        // Restore the single step pulse items overwritten by the last burst.
+        uint_fast8_t channel = 3;
+        rmt_burst = false;
+        do {
+            channel--;
+            RMTMEM.chan[channel].data32[0].val = rmt_pulse[channel].val;
+            RMTMEM.chan[channel].data32[1].val = 0;
+        } while(channel);
+    }
+
     if(step_outbits.x) {
         RMT.conf_ch[0].conf1.mem_rd_rst = 1;
         RMT.conf_ch[0].conf1.tx_start = 1;
@@ -611,6 +705,49 @@ inline IRAM_ATTR static void set_step_outputs (axes_signals_t step_outbits)
     }
 }
 
+// Output the step events of a burst as a pulse train per axis, the pulses are evenly spaced over the
+// stepper interrupt period. The pulse trains are written to the RMT memory, at most 2 * STEP_BURST_MAX + 1 items
+// per channel, and then generated by the RMT peripheral with no further CPU involvement.
+IRAM_ATTR static void set_step_burst_outputs (stepper_t *stepper)
+{
+    uint_fast8_t channel, idx;
+    uint32_t interval = step_cycles_per_tick * STEPPER_DRIVER_PRESCALER / RMT_CLOCK_DIVIDER / stepper->burst_steps, gap, idle;
+    rmt_item32_t item;
+    volatile rmt_item32_t *data;
+
+    gap = interval > rmt_pulse_ticks + 2 ? interval - rmt_pulse_ticks : 2;
+    rmt_burst = true;
+
+    for(channel = 0; channel < 3; channel++) {
+
+        if(!(stepper->step_outbits.mask & bit(channel)))
+            continue;
+
+        idle = 0;
+        data = RMTMEM.chan[channel].data32;
+        item.level0 = item.level1 = rmt_pulse[channel].level0;
+
+        for(idx = 0; idx < stepper->burst_steps; idx++) {
+            if(stepper->step_burst[idx].mask & bit(channel)) {
+                if(idle) {
+                    idle = min(idle, 0xFFFE);
+                    item.duration0 = idle >> 1;
+                    item.duration1 = idle - item.duration0;
+                    (data++)->val = item.val;
+                }
+                (data++)->val = rmt_pulse[channel].val;
+                idle = gap;
+            } else
+                idle += interval;
+        }
+
+        data->val = 0; // End marker
+
+        RMT.conf_ch[channel].conf1.mem_rd_rst = 1;
+        RMT.conf_ch[channel].conf1.tx_start = 1;
+    }
+}
+
 #endif
 
 // Starts stepper driver ISR timer and forces a stepper driver interrupt callback
@@ -646,6 +783,9 @@ IRAM_ATTR static void stepperGoIdle (bool clear_signals)
 // Sets up stepper driver interrupt timeout
 IRAM_ATTR static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
+#ifndef USE_I2S_OUT
+    step_cycles_per_tick = cycles_per_tick;
+#endif
 // Limit min steps/s to about 2 (hal.f_step_timer @ 20MHz)
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
     TIMERG0.hw_timer[STEP_TIMER_INDEX].alarm_low = cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL;
@@ -669,7 +809,10 @@ IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
         }
         i2s_set_step_outputs((axes_signals_t){0});
 #else
-        set_step_outputs(stepper->step_outbits);
+        if(stepper->burst_steps)
+            set_step_burst_outputs(stepper);
+        else
+            set_step_outputs(stepper->step_outbits);
 #endif
     }
 }
@@ -1082,6 +1225,46 @@ void debounceTimerCallback (TimerHandle_t xTimer)
 
 
 // Configures perhipherals when settings are initialized or changed
+#if WIFI_ENABLE || BLUETOOTH_ENABLE
+
+static bool wireless_ready = false;
+static on_deferred_init_ptr on_deferred_init;
+
+static void wireless_start (void)
+{
+#if WIFI_ENABLE
+
+    static bool wifi_ok = false;
+
+    if(!wifi_ok)
+        wifi_ok = wifi_start();
+
+    // TODO: start/stop services...
+#endif
+
+#if BLUETOOTH_ENABLE
+    static bool bluetooth_ok = false;
+    if(!bluetooth_ok)
+        bluetooth_ok = bluetooth_start();
+    // else report error?
+#endif
+}
+
+// Start the wireless stack(s) when the controller is ready to accept commands,
+// bringing up the radio takes a long time and delays realtime command handling when done at boot.
+static void wireless_deferred_init (void)
+{
+    wireless_ready = true;
+
+    if(IOInitDone)
+        wireless_start();
+
+    if(on_deferred_init)
+        on_deferred_init();
+}
+
+#endif
+
 static void settings_changed (settings_t *settings)
 {
 
@@ -1132,21 +1315,9 @@ static void settings_changed (settings_t *settings)
         hal.spindle.set_state = hal.driver_cap.variable_spindle ? spindleSetStateVariable : spindleSetState;
       #endif
 
-#if WIFI_ENABLE
-
-        static bool wifi_ok = false;
-
-        if(!wifi_ok)
-            wifi_ok = wifi_start();
-
-        // TODO: start/stop services...
-#endif
-
-#if BLUETOOTH_ENABLE
-        static bool bluetooth_ok = false;
-        if(!bluetooth_ok)
-            bluetooth_ok = bluetooth_start();
-        // else report error?
+#if WIFI_ENABLE || BLUETOOTH_ENABLE
+        if(wireless_ready)
+            wireless_start();
 #endif
 
         stepperEnable(settings->steppers.deenergize);
@@ -1160,8 +1331,17 @@ static void settings_changed (settings_t *settings)
         if(i2s_step_length < I2S_OUT_USEC_PER_PULSE)
             i2s_step_length = I2S_OUT_USEC_PER_PULSE;
         i2s_step_samples = i2s_step_length / I2S_OUT_USEC_PER_PULSE; // round up?
+
+        // Step bursts must fit in the samples that may be pushed per pulse, 20us (see SAMPLE_SAFE_COUNT in i2s_out.c).
+        hal.driver_cap.step_burst = 0;
+        while(hal.driver_cap.step_burst < 3 && ((2 << (hal.driver_cap.step_burst + 1)) - 1) * i2s_step_samples <= 20 / I2S_OUT_USEC_PER_PULSE)
+            hal.driver_cap.step_burst++;
+
 #else
         initRMT(settings);
+
+        // Up to 8 step events per stepper interrupt may be output as RMT pulse trains.
+        hal.driver_cap.step_burst = 3;
 #endif
 
         /****************************************
@@ -1328,9 +1508,15 @@ static bool driver_setup (settings_t *settings)
 
     timer_init(STEP_TIMER_GROUP, STEP_TIMER_INDEX, &timerConfig);
     timer_set_counter_value(STEP_TIMER_GROUP, STEP_TIMER_INDEX, 0ULL);
-    timer_isr_register(STEP_TIMER_GROUP, STEP_TIMER_INDEX, stepper_driver_isr, 0, ESP_INTR_FLAG_IRAM, NULL);
+    timer_isr_register(STEP_TIMER_GROUP, STEP_TIMER_INDEX, stepper_driver_isr, 0, ESP_INTR_FLAG_IRAM|IRQ_LEVEL_FLAG(IRQ_PRIORITY_STEPPER), NULL);
     timer_enable_intr(STEP_TIMER_GROUP, STEP_TIMER_INDEX);
 
+#if PREP_TASK_ENABLE && !defined(USE_I2S_OUT)
+    // Pinned to the core running the grbl task (and the stepper interrupt registered above).
+    if(xTaskCreatePinnedToCore(prepTask, "Prep", 4096, NULL, uxTaskPriorityGet(NULL) + 1, &prepTaskHandle, xPortGetCoreID()) == pdPASS)
+        hal.stepper.prep_request = stepperPrepRequest;
+#endif
+
     /********************
      *  Output signals  *
      ********************/
@@ -1382,7 +1568,7 @@ static bool driver_setup (settings_t *settings)
      *  Control, limit & probe pins dir init  *
      ******************************************/
 
-    gpio_isr_register(gpio_isr, NULL, (int)ESP_INTR_FLAG_IRAM, NULL);
+    gpio_isr_register(gpio_isr, NULL, (int)(ESP_INTR_FLAG_IRAM|IRQ_LEVEL_FLAG(IRQ_PRIORITY_INPUTS)), NULL);
 
 #ifndef VFD_SPINDLE
 
@@ -1442,7 +1628,7 @@ static bool driver_setup (settings_t *settings)
 
   // Set defaults
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     settings_changed(settings);
 
@@ -1539,6 +1725,16 @@ bool driver_init (void)
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
     hal.get_elapsed_ticks = xTaskGetTickCountFromISR;
+    hal.get_cycle_count = getCycleCount;
+    hal.f_cycle_count = esp_clk_cpu_freq();
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_stepper);
+    irq_stats_register(&irq_inputs);
+#endif
+    hal.get_micros = getMicros;
+#ifdef ENABLE_MEMORY_REPORT
+    hal.get_free_mem = getFreeMem;
+#endif
 
 #ifdef DEBUGOUT
     hal.debug_out = debug_out;
@@ -1602,6 +1798,11 @@ bool driver_init (void)
     bluetooth_init();
 #endif
 
+#if WIFI_ENABLE || BLUETOOTH_ENABLE
+    on_deferred_init = grbl.on_deferred_init;
+    grbl.on_deferred_init = wireless_deferred_init;
+#endif
+
 #if TRINAMIC_ENABLE
     trinamic_init();
 #endif
@@ -1625,15 +1826,21 @@ bool driver_init (void)
 // Main stepper driver
 IRAM_ATTR static void stepper_driver_isr (void *arg)
 {
+    IRQ_STATS_ENTER();
+
     TIMERG0.int_clr_timers.t0 = 1;
     TIMERG0.hw_timer[STEP_TIMER_INDEX].config.alarm_en = TIMER_ALARM_EN;
 
     hal.stepper.interrupt_callback();
+
+    IRQ_STATS_EXIT(&irq_stepper, 0);
 }
 
   //GPIO intr process
 IRAM_ATTR static void gpio_isr (void *arg)
 {
+  IRQ_STATS_ENTER();
+
   bool debounce = false;
   uint8_t grp = 0;
   uint32_t intr_status[2];
@@ -1681,4 +1888,6 @@ IRAM_ATTR static void gpio_isr (void *arg)
   if(grp & INPUT_GROUP_KEYPAD)
       keypad_keyclick_handler(gpio_get_level(KEYPAD_STROBE_PIN));
 #endif
+
+  IRQ_STATS_EXIT(&irq_inputs, 0);
 }
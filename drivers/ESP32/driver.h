@@ -123,6 +123,7 @@
 #include "freertos/semphr.h"
 
 #include "grbl/hal.h"
+#include "grbl/irq_stats.h"
 
 static const DRAM_ATTR float FZERO = 0.0f;
 
@@ -131,6 +132,21 @@ static const DRAM_ATTR float FZERO = 0.0f;
 #define PROBE_ISR        0 // Catch probe state change by interrupt TODO: needs verification!
 #define TRINAMIC_DEV     0 // Development mode, adds a few M-codes to aid debugging. Do not enable in production code
 
+// Interrupt priority levels, 1 - 3 where higher levels preempt lower levels.
+// 0 leaves the choice of a low level to the interrupt allocator.
+
+#ifndef IRQ_PRIORITY_STEPPER
+#define IRQ_PRIORITY_STEPPER 3
+#endif
+#ifndef IRQ_PRIORITY_INPUTS
+#define IRQ_PRIORITY_INPUTS  2
+#endif
+#ifndef IRQ_PRIORITY_SERIAL
+#define IRQ_PRIORITY_SERIAL  0
+#endif
+
+#define IRQ_LEVEL_FLAG(level) ((level) ? (ESP_INTR_FLAG_LEVEL1 << ((level) - 1)) : 0)
+
 // DO NOT change settings here!
 
 #ifndef IOEXPAND_ENABLE
@@ -164,6 +180,10 @@ static const DRAM_ATTR float FZERO = 0.0f;
 #define SDCARD_ENABLE    0
 #endif
 
+#if SDCARD_ENABLE && !defined(SDCARD_BUFFER_SIZE)
+#define SDCARD_BUFFER_SIZE 4096 // Plenty of RAM, read ahead in 4K chunks
+#endif
+
 #ifndef WEBUI_ENABLE
 #define WEBUI_ENABLE     0
 #endif
@@ -173,6 +193,10 @@ static const DRAM_ATTR float FZERO = 0.0f;
 #define TRINAMIC_I2C     0
 #endif
 
+#ifndef PREP_TASK_ENABLE
+#define PREP_TASK_ENABLE 0 // Run step segment preparation from a task with higher priority than the grbl task
+#endif
+
 // end configuration
 
 #if !WIFI_ENABLE
@@ -129,7 +129,7 @@ static void uartEnableInterrupt (uart_t *uart, uart_isr_ptr isr, bool enable_rx)
 {
     UART_MUTEX_LOCK(uart);
 
-    esp_intr_alloc(UART_INTR_SOURCE(uart->num), (int)ESP_INTR_FLAG_IRAM, isr, NULL, &uart->intr_handle);
+    esp_intr_alloc(UART_INTR_SOURCE(uart->num), (int)(ESP_INTR_FLAG_IRAM|IRQ_LEVEL_FLAG(IRQ_PRIORITY_SERIAL)), isr, NULL, &uart->intr_handle);
 
     uart->dev->conf1.rxfifo_full_thrhd = 112;
     uart->dev->conf1.rx_tout_thrhd = 2;
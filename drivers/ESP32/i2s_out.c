@@ -122,6 +122,7 @@ static int i2s_out_initialized = 0;
 static volatile uint64_t             i2s_out_pulse_period;
 static uint64_t                      i2s_out_remain_time_until_next_pulse;  // Time remaining until the next pulse (usec)
 static volatile i2s_out_pulse_func_t i2s_out_pulse_func;
+static volatile uint32_t             i2s_out_fill_limit = DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT;  // Samples to fill per DMA buffer when stepping
 #    endif
 
 static uint8_t i2s_out_ws_pin   = 255;
@@ -358,9 +359,11 @@ static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t* dma_desc) {
         // Therefore, if a buffer is close to full and it is time to generate a pulse,
         // the generation of the buffer is interrupted (the buffer length is shortened slightly)
         // and the pulse generation is postponed until the next buffer is filled.
+        // The buffer may be filled only partly to reduce the output latency, see i2s_out_set_latency().
         //
         o_dma.rw_pos = 0;
-        while (o_dma.rw_pos < (DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT)) {
+        uint32_t fill_limit = i2s_out_fill_limit;
+        while (o_dma.rw_pos < fill_limit) {
             // no data to read (buffer empty)
             if (i2s_out_remain_time_until_next_pulse < I2S_OUT_USEC_PER_PULSE) {
                 // pulser status may change in pulse phase func, so I need to check it every time.
@@ -655,6 +658,20 @@ int IRAM_ATTR i2s_out_set_pulse_period(uint64_t period) {
     return 0;
 }
 
+int IRAM_ATTR i2s_out_set_latency(uint32_t usec) {
+#    ifdef USE_I2S_OUT_STREAM_IMPL
+    uint32_t fill_limit = usec ? usec / (I2S_OUT_DMABUF_COUNT * I2S_OUT_USEC_PER_PULSE) : DMA_SAMPLE_COUNT;
+    // At least room for one pulse, at most a full buffer less the margin for the last pulse.
+    if (fill_limit < SAMPLE_SAFE_COUNT * 2) {
+        fill_limit = SAMPLE_SAFE_COUNT * 2;
+    } else if (fill_limit > DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT) {
+        fill_limit = DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT;
+    }
+    i2s_out_fill_limit = fill_limit;
+#    endif
+    return 0;
+}
+
 int IRAM_ATTR i2s_out_set_pulse_callback(i2s_out_pulse_func_t func) {
 #    ifdef USE_I2S_OUT_STREAM_IMPL
     i2s_out_pulse_func = func;
@@ -160,6 +160,14 @@ void i2s_out_delay();
  */
 int i2s_out_set_pulse_period(uint64_t period);
 
+/*
+   Set the approximate latency from pulse generation to the output in usec.
+   The DMA buffers are filled only partly when stepping, shortening the bitstream queued ahead
+   at the cost of more frequent DMA interrupts and pulse callback task wakeups.
+   usec: target latency, 0 for the maximum (default) of I2S_OUT_DMABUF_COUNT full buffers.
+ */
+int i2s_out_set_latency(uint32_t usec);
+
 /*
    Register a callback function to generate pulse data
  */
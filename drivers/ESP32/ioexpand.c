@@ -74,10 +74,14 @@ IRAM_ATTR void ioexpand_out (ioexpand_t pins)
         .params = NULL
     };
 
+    i2c_task.params = (void *)((uint32_t)pins.mask);
+
+    // Hand the write over to the I2C task, only write synchronously if the queue is not available or full.
     if(xPortInIsrContext()) {
-        i2c_task.params = (void *)((uint32_t)pins.mask);
         BaseType_t xHigherPriorityTaskWoken = pdFALSE;
         xQueueSendFromISR(i2cQueue, (void *)&i2c_task, &xHigherPriorityTaskWoken);
+    } else if(i2cQueue != NULL && xQueueSend(i2cQueue, (void *)&i2c_task, 0) == pdTRUE) {
+        // Queued
     } else if(i2cBusy != NULL && xSemaphoreTake(i2cBusy, 5 / portTICK_PERIOD_MS) == pdTRUE) {
 
         i2c_cmd_handle_t cmd = i2c_cmd_link_create();
@@ -21,11 +21,14 @@
   along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+
 #include "esp_partition.h"
 #include "esp_log.h"
+#include "nvs_flash.h"
 
-#include "nvs.h"
 #include "grbl/hal.h"
+#include "nvs.h"
 
 #ifndef BUFFER_NVSDATA
 #error BUFFER_NVSDATA must be enabled to use flash for settings storage
@@ -38,6 +41,19 @@ static const DRAM_ATTR char ESP_LF = ASCII_CR;
 static const DRAM_ATTR char ESP_QUESTION_MARK = '?';
 static const esp_partition_t *grblNVS = NULL;
 
+// Regions written since the last full image write are stored as separate ESP-IDF NVS blobs, keyed by address,
+// and read back on top of the image. The index blob lists the stored regions.
+#define NVS_REGIONS_MAX 32
+
+typedef struct {
+    uint16_t addr;
+    uint16_t size;
+} nvs_region_t;
+
+static nvs_handle regions_nvs = 0;
+static nvs_region_t regions[NVS_REGIONS_MAX];
+static uint_fast8_t n_regions = 0;
+
 static bool (*realtime_command_handler)(char data); // NOTE: set by grbl at startup
 
 // Strip top bit set characters, control characters except CR and LF and question mark
@@ -46,13 +62,35 @@ static IRAM_ATTR bool nvs_enqueue_realtime_command (char c)
     return (c < ESP_SPACE_CHAR && !(c == ESP_CR || c == ESP_LF)) || c == ESP_QUESTION_MARK || c >= ESP_DEL_CHAR;
 }
 
+static inline char *region_key (uint32_t addr)
+{
+    static char key[8];
+
+    sprintf(key, "r%04X", (unsigned int)addr);
+
+    return key;
+}
+
 bool nvsRead (uint8_t *dest)
 {
     bool ok;
+    size_t size;
+    uint_fast8_t idx;
 
     if(!(ok = grblNVS && esp_partition_read(grblNVS, 0, (void *)dest, hal.nvs.size) == ESP_OK))
         grblNVS = NULL;
 
+    if(ok && regions_nvs) {
+        size = sizeof(regions);
+        if(nvs_get_blob(regions_nvs, "index", regions, &size) == ESP_OK)
+            n_regions = size / sizeof(nvs_region_t);
+        for(idx = 0; idx < n_regions; idx++) {
+            size = regions[idx].size;
+            if(regions[idx].addr + size <= hal.nvs.size)
+                nvs_get_blob(regions_nvs, region_key(regions[idx].addr), dest + regions[idx].addr, &size);
+        }
+    }
+
     return ok;
 }
 
@@ -67,15 +105,63 @@ bool nvsWrite (uint8_t *source)
                esp_partition_erase_range(grblNVS, 0, SPI_FLASH_SEC_SIZE) == ESP_OK &&
                 esp_partition_write(grblNVS, 0, (void *)source, hal.nvs.size) == ESP_OK;
 
+    // The image now holds all regions, remove the region blobs.
+    if(ok && regions_nvs && n_regions) {
+        n_regions = 0;
+        nvs_erase_all(regions_nvs);
+        nvs_commit(regions_nvs);
+    }
+
     // Restore real time command handler
     hal.stream.enqueue_realtime_command = realtime_command_handler;
 
     return ok;
 }
 
+// Writes a single region as a blob, only the changed region is written to flash.
+// Falls back to write the full image if the index is full.
+static nvs_transfer_result_t nvsWriteRegion (uint32_t destination, uint8_t *source, uint32_t size, bool with_checksum)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_regions; idx++) {
+        if(regions[idx].addr == destination)
+            break;
+    }
+
+    // Index full, write the full image. NOTE: source points into the RAM image at offset destination.
+    if(idx == NVS_REGIONS_MAX)
+        return nvsWrite(source - destination) ? NVS_TransferResult_OK : NVS_TransferResult_Failed;
+
+    realtime_command_handler = hal.stream.enqueue_realtime_command;
+    hal.stream.enqueue_realtime_command = nvs_enqueue_realtime_command;
+
+    bool ok = nvs_set_blob(regions_nvs, region_key(destination), source, size) == ESP_OK;
+
+    if(ok && (idx == n_regions || regions[idx].size != size)) {
+        regions[idx].addr = (uint16_t)destination;
+        regions[idx].size = (uint16_t)size;
+        if(idx == n_regions)
+            n_regions++;
+        ok = nvs_set_blob(regions_nvs, "index", regions, n_regions * sizeof(nvs_region_t)) == ESP_OK;
+    }
+
+    ok = ok && nvs_commit(regions_nvs) == ESP_OK;
+
+    hal.stream.enqueue_realtime_command = realtime_command_handler;
+
+    return ok ? NVS_TransferResult_OK : NVS_TransferResult_Failed;
+}
+
 bool nvsInit (void)
 {
     grblNVS = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "grbl");
 
+    // Write changed regions only via the NVS buffer if ESP-IDF NVS is available.
+    if(grblNVS && nvs_open("grbl", NVS_READWRITE, &regions_nvs) == ESP_OK)
+        hal.nvs.memcpy_to_nvs = nvsWriteRegion;
+    else
+        regions_nvs = 0;
+
     return grblNVS != NULL;
 }
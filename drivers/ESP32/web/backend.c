@@ -92,17 +92,73 @@ static esp_err_t redirect_html_get_handler(httpd_req_t *req, char *location)
     return ESP_OK;
 }
 
+/* Sets the ETag and Cache-Control headers, returns true and responds with
+ * 304 Not Modified if the client already has the current version */
+static bool http_not_modified (httpd_req_t *req, const char *etag)
+{
+    char match[24];
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", HTTP_CACHE_CONTROL);
+
+    if(httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK && !strcmp(match, etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return true;
+    }
+
+    return false;
+}
+
+/* Sends a file embedded in flash. The content is passed to the server
+ * in chunks straight from memory mapped flash, without copying */
+esp_err_t http_send_embedded (httpd_req_t *req, http_embedded_file_t *file)
+{
+    const char *data = (const char *)file->start;
+    size_t chunksize, size = file->end - file->start;
+
+    if(*file->etag == '\0') {
+        // FNV-1a hash of content, changes only with a new firmware image.
+        uint32_t hash = 2166136261UL;
+        const unsigned char *p = file->start;
+        while(p < file->end)
+            hash = (hash ^ *p++) * 16777619UL;
+        sprintf(file->etag, "\"%08x\"", (unsigned int)hash);
+    }
+
+    if(http_not_modified(req, file->etag))
+        return ESP_OK;
+
+    set_content_type_from_file(req, file->filename);
+    if(file->gzipped)
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+    while(size) {
+        chunksize = min(size, HTTP_CHUNK_SIZE);
+        if(httpd_resp_send_chunk(req, data, chunksize) != ESP_OK)
+            return ESP_FAIL;
+        data += chunksize;
+        size -= chunksize;
+    }
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 /* Handler to respond with an icon file embedded in flash.
  * Browsers expect to GET website icon at URI /favicon.ico.
  * This can be overridden by uploading file with same name */
-
 static esp_err_t favicon_get_handler(httpd_req_t *req)
 {
     extern const unsigned char favicon_ico_start[] asm("_binary_favicon_ico_start");
     extern const unsigned char favicon_ico_end[]   asm("_binary_favicon_ico_end");
-    const size_t favicon_ico_size = (favicon_ico_end - favicon_ico_start);
-    httpd_resp_set_type(req, "image/x-icon");
-    return httpd_resp_send(req, (const char *)favicon_ico_start, favicon_ico_size);
+
+    static http_embedded_file_t favicon = {
+        .filename = "favicon.ico",
+        .start = favicon_ico_start,
+        .end = favicon_ico_end
+    };
+
+    return http_send_embedded(req, &favicon);
 }
 
 static esp_err_t index_html_get_handler(httpd_req_t *req)
@@ -112,8 +168,14 @@ static esp_err_t index_html_get_handler(httpd_req_t *req)
 #else
     extern const unsigned char index_html_start[] asm("_binary_index_html_start");
     extern const unsigned char index_html_end[]   asm("_binary_index_html_end");
-    const size_t index_html_size = (index_html_end - index_html_start);
-    return httpd_resp_send(req, (const char *)index_html_start, index_html_size);
+
+    static http_embedded_file_t index_html = {
+        .filename = "index.html",
+        .start = index_html_start,
+        .end = index_html_end
+    };
+
+    return http_send_embedded(req, &index_html);
 #endif
 }
 
@@ -121,7 +183,14 @@ static esp_err_t ap_login_html_get_handler(httpd_req_t *req)
 {
     extern const unsigned char ap_login_html_start[] asm("_binary_ap_login_html_start");
     extern const unsigned char ap_login_html_end[]   asm("_binary_ap_login_html_end");
-    return httpd_resp_send(req, (const char *)ap_login_html_start, ap_login_html_end - ap_login_html_start);
+
+    static http_embedded_file_t ap_login_html = {
+        .filename = "ap_login.html",
+        .start = ap_login_html_start,
+        .end = ap_login_html_end
+    };
+
+    return http_send_embedded(req, &ap_login_html);
 }
 
 #define IS_FILE_EXT(filename, ext) \
@@ -139,6 +208,12 @@ esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filename)
             return httpd_resp_set_type(req, "image/jpeg");
         else if (IS_FILE_EXT(filename, ".ico"))
             return httpd_resp_set_type(req, "image/x-icon");
+        else if (IS_FILE_EXT(filename, ".css"))
+            return httpd_resp_set_type(req, "text/css");
+        else if (IS_FILE_EXT(filename, ".js"))
+            return httpd_resp_set_type(req, "application/javascript");
+        else if (IS_FILE_EXT(filename, ".svg"))
+            return httpd_resp_set_type(req, "image/svg+xml");
         else if (IS_FILE_EXT(filename, ".gz"))
             return httpd_resp_set_type(req, "application/x-gzip");
     }
@@ -244,8 +319,19 @@ esp_err_t spiffs_get_handler (httpd_req_t *req)
 
     FILE *file;
     struct stat st;
+    bool gzipped = false;
+    char etag[20], encoding[32];
+    size_t pathlen = strlen(filepath);
+
+    /* Serve gzip compressed version of file if present and accepted by client */
+    if(pathlen + 4 <= sizeof(fs_filepath_t) && !IS_FILE_EXT(filepath, ".gz") &&
+        httpd_req_get_hdr_value_str(req, "Accept-Encoding", encoding, sizeof(encoding)) == ESP_OK && strstr(encoding, "gzip")) {
+        strcat(filepath, ".gz");
+        if(!(gzipped = stat(filepath, &st) == 0))
+            filepath[pathlen] = '\0';
+    }
 
-    if (stat(filepath, &st) != 0) {
+    if (!gzipped && stat(filepath, &st) != 0) {
         /* If file not present on SPIFFS check if URI
          * corresponds to one of the hardcoded paths */
         if (strcmp(filename, "/index.html") == 0) {
@@ -257,11 +343,19 @@ esp_err_t spiffs_get_handler (httpd_req_t *req)
         return ESP_FAIL;
     }
 
+    sprintf(etag, "\"%x-%x\"", (unsigned int)st.st_size, (unsigned int)st.st_mtime);
+
+    if(http_not_modified(req, etag))
+        return ESP_OK;
+
     if ((file = fopen(filepath, "r")) == NULL) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
         return ESP_FAIL;
     }
 
+    if(gzipped)
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
     set_content_type_from_file(req, filename);
 
     size_t chunksize;
@@ -879,6 +973,8 @@ bool httpdaemon_start (network_settings_t *network)
     config.server_port = network->http_port;
     config.uri_match_fn = httpd_uri_match_wildcard;
     config.stack_size = 10240;
+    config.task_priority = HTTP_TASK_PRIORITY;
+    config.core_id = HTTP_TASK_CORE;
 
     httpdaemon_stop();
 
@@ -33,6 +33,19 @@
 
 #define SCRATCH_BUFSIZE  8192
 
+#ifndef HTTP_CHUNK_SIZE
+#define HTTP_CHUNK_SIZE 2048 // max chunk size for files embedded in flash
+#endif
+#ifndef HTTP_CACHE_CONTROL
+#define HTTP_CACHE_CONTROL "no-cache" // revalidate with ETag, unchanged files are not resent
+#endif
+#ifndef HTTP_TASK_PRIORITY
+#define HTTP_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+#ifndef HTTP_TASK_CORE
+#define HTTP_TASK_CORE 0 // keep off the core running the Grbl task
+#endif
+
 typedef char fs_scratch_t[SCRATCH_BUFSIZE];
 typedef char fs_path_t[ESP_VFS_PATH_MAX + 1];
 typedef char fs_filename_t[CONFIG_SPIFFS_OBJ_NAME_LEN + 1];
@@ -44,10 +57,20 @@ typedef struct {
     fs_scratch_t scratch;
 } file_server_data_t;
 
+// File embedded in the application image, read directly from memory mapped flash.
+typedef struct {
+    const char *filename;           // for content type lookup
+    const unsigned char *start;
+    const unsigned char *end;
+    bool gzipped;
+    char etag[11];                  // calculated on first request
+} http_embedded_file_t;
+
 bool httpdaemon_start(network_settings_t *network);
 void httpdaemon_stop();
 esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filename);
 char *http_get_key_value (char *qstring, char *key, char *s, size_t val_size);
+esp_err_t http_send_embedded (httpd_req_t *req, http_embedded_file_t *file);
 
 #endif
 
@@ -32,6 +32,10 @@
 #include <string.h>
 #include <sys/unistd.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
 #include "upload.h"
 
 #include "networking/multipartparser.h"
@@ -40,11 +44,109 @@
 #include "sdcard/sdcard.h"
 #endif
 
+typedef struct {
+    file_upload_t *upload;
+    char *data;
+    size_t length;
+} upload_block_t;
+
 static struct multipartparser parser;
 static struct multipartparser_callbacks *sd_callbacks = NULL;
+static QueueHandle_t write_queue = NULL, free_queue = NULL;
+static TaskHandle_t write_task = NULL;
+
+// Writes the filled buffers while the next one is received, then returns them to the free queue.
+static void upload_write (void *arg)
+{
+    size_t count;
+    upload_block_t block;
+
+    while(true) {
+
+        if(xQueueReceive(write_queue, &block, portMAX_DELAY) == pdTRUE) {
+
+            if(block.upload->write_failed)
+                count = 0;
+            else if(block.upload->to_fatfs) {
+                if(f_write(block.upload->file.fatfs_handle, block.data, block.length, &count) != FR_OK)
+                    count = 0;
+            } else
+                count = fwrite(block.data, sizeof(char), block.length, block.upload->file.handle);
+
+            if(count != block.length)
+                block.upload->write_failed = true;
+
+            xQueueSend(free_queue, &block.data, portMAX_DELAY);
+        }
+    }
+}
+
+// Allocates the buffers and creates the write task on first use, they are kept for later uploads.
+static bool upload_write_init (void)
+{
+    static char *blocks = NULL;
+
+    if(write_task)
+        return true;
+
+    char *data;
+
+    if(!(blocks || (blocks = malloc(2 * UPLOAD_BLOCK_SIZE))))
+        return false;
+
+    if(!(write_queue || (write_queue = xQueueCreate(2, sizeof(upload_block_t)))))
+        return false;
+
+    if(!(free_queue || (free_queue = xQueueCreate(2, sizeof(char *)))))
+        return false;
+
+    if(xTaskCreatePinnedToCore(upload_write, "Upload", 4096, NULL, UPLOAD_TASK_PRIORITY, &write_task, 0) != pdPASS)
+        return false;
+
+    data = blocks;
+    xQueueSend(free_queue, &data, 0);
+    data = blocks + UPLOAD_BLOCK_SIZE;
+    xQueueSend(free_queue, &data, 0);
+
+    return true;
+}
+
+// Queues the buffer being filled for writing.
+static void upload_flush (file_upload_t *upload)
+{
+    if(upload->block) {
+        if(upload->block_length) {
+            upload_block_t block = {
+                .upload = upload,
+                .data = upload->block,
+                .length = upload->block_length
+            };
+            xQueueSend(write_queue, &block, portMAX_DELAY);
+        } else
+            xQueueSend(free_queue, &upload->block, portMAX_DELAY);
+        upload->block = NULL;
+    }
+}
+
+// Waits for the write task to complete all queued writes.
+static void upload_sync (file_upload_t *upload)
+{
+    char *data[2];
+
+    upload_flush(upload);
+
+    if(free_queue) {
+        xQueueReceive(free_queue, &data[0], portMAX_DELAY);
+        xQueueReceive(free_queue, &data[1], portMAX_DELAY);
+        xQueueSend(free_queue, &data[0], portMAX_DELAY);
+        xQueueSend(free_queue, &data[1], portMAX_DELAY);
+    }
+}
 
 static void do_cleanup (file_upload_t *upload)
 {
+    upload_sync(upload);
+
     // close and unlink open file
     if(upload->file.handle) {
         if(upload->to_fatfs) {
@@ -152,15 +254,34 @@ static int on_data(struct multipartparser *parser, const char* data, size_t size
     switch(upload->state) {
 
         case Upload_Write:
-            {
+            // Data is collected in blocks ending at sector boundaries in the file, the write of a
+            // full block is handed to the write task while the next block is received.
+            while(size) {
+
                 size_t count;
-                if(upload->to_fatfs) {
-                    f_write(upload->file.fatfs_handle, data, size, &count);
-                } else
-                    count = fwrite(data, sizeof(char), size, upload->file.handle);
-                if(count != size)
+
+                if(upload->write_failed) {
                     upload->state = Upload_Failed;
+                    break;
+                }
+
+                if(upload->block == NULL) {
+                    xQueueReceive(free_queue, &upload->block, portMAX_DELAY);
+                    upload->block_length = 0;
+                }
+
+                count = UPLOAD_BLOCK_SIZE - upload->block_length;
+                if(count > size)
+                    count = size;
+
+                memcpy(upload->block + upload->block_length, data, count);
+                upload->block_length += count;
                 upload->uploaded += count;
+                data += count;
+                size -= count;
+
+                if(upload->block_length == UPLOAD_BLOCK_SIZE)
+                    upload_flush(upload);
             }
             break;
 
@@ -186,6 +307,11 @@ static int on_part_end(struct multipartparser *parser)
     switch(upload->state) {
 
         case Upload_Write:
+            upload_sync(upload);
+            if(upload->write_failed) {
+                do_cleanup(upload);
+                break;
+            }
             if(upload->to_fatfs) {
                 f_close(upload->file.fatfs_handle);
                 upload->file.fatfs_handle = NULL;
@@ -230,7 +356,7 @@ bool upload_start (httpd_req_t *req, const char* boundary, bool to_fatfs)
         sd_callbacks->on_body_end = on_body_end;
     }
 
-    if(sd_callbacks) {
+    if(sd_callbacks && upload_write_init()) {
 
         multipartparser_init(&parser, boundary);
 
@@ -29,6 +29,17 @@
 #include <esp_http_server.h>
 #include <esp_vfs_fat.h>
 
+// Size of each of the two buffers uploaded data is collected in before written to the file,
+// should be a multiple of the SD card sector size (512 bytes).
+#ifndef UPLOAD_BLOCK_SIZE
+#define UPLOAD_BLOCK_SIZE 4096
+#endif
+
+// Priority of the task writing the buffers, it runs on core 0 along with the network tasks.
+#ifndef UPLOAD_TASK_PRIORITY
+#define UPLOAD_TASK_PRIORITY 1
+#endif
+
 typedef enum
 {
     Upload_Parsing = 0,
@@ -57,6 +68,9 @@ typedef struct {
     FIL fatfs_fd;
     size_t size;
     size_t uploaded;
+    char *block;                // Buffer being filled, NULL if none.
+    size_t block_length;
+    volatile bool write_failed; // Set by the write task.
 } file_upload_t;
 
 bool upload_start (httpd_req_t *req, const char* boundary, bool to_fatfs);
@@ -32,8 +32,13 @@
 #include "grbl/report.h"
 
 #include "flashfs.h"
+#include "sdcard/filebuf.h"
 #include <esp_log.h>
 
+#ifndef FLASHFS_BUFFER_SIZE
+#define FLASHFS_BUFFER_SIZE 4096 // Size of each of the two file read buffers, SPIFFS per call overhead is high.
+#endif
+
 typedef struct
 {
     FILE *handle;
@@ -50,9 +55,12 @@ static file_t file = {
     .pos = 0
 };
 
+static file_buffer_t fbuf;
+static uint8_t fbuf_data[2 * FLASHFS_BUFFER_SIZE];
 static bool frewind = false;
 static io_stream_t active_stream;
 static driver_reset_ptr driver_reset = NULL;
+static on_execute_realtime_ptr on_execute_realtime = NULL;
 static void (*on_realtime_report)(stream_write_ptr stream_write, report_tracking_flags_t report) = NULL;
 static void (*on_state_change)(uint_fast16_t state);
 
@@ -70,6 +78,25 @@ static void file_close (void)
     }
 }
 
+static bool file_fill (void *handle, size_t offset, uint8_t *data, size_t size, size_t *length)
+{
+    bool ok = (size_t)ftell((FILE *)handle) == offset || fseek((FILE *)handle, offset, SEEK_SET) == 0;
+
+    *length = ok ? fread(data, 1, size, (FILE *)handle) : 0;
+
+    return ok && !ferror((FILE *)handle);
+}
+
+// Reads the next chunk into the free buffer, called from the foreground process.
+static void file_prefetch (uint_fast16_t state)
+{
+    if(file.handle)
+        file_buffer_prefetch(&fbuf);
+
+    if(on_execute_realtime)
+        on_execute_realtime(state);
+}
+
 static bool file_open (char *filename)
 {
     struct stat st;
@@ -82,6 +109,7 @@ static bool file_open (char *filename)
         file.pos = 0;
         file.line = 0;
         file.eol = false;
+        file_buffer_init(&fbuf, file.handle, file_fill, fbuf_data, FLASHFS_BUFFER_SIZE);
         char *leafname = strrchr(filename, '/');
         strncpy(file.name, leafname ? leafname + 1 : filename, sizeof(file.name));
         file.name[sizeof(file.name) - 1] = '\0';
@@ -92,17 +120,17 @@ static bool file_open (char *filename)
 
 static int16_t file_read (void)
 {
-    int c;
+    int16_t c;
 
-    if((c = fgetc(file.handle)) != EOF)
-        file.pos = ftell(file.handle);
+    if((c = file_buffer_getc(&fbuf)) != -1)
+        file.pos = file_buffer_tell(&fbuf);
 
     if(c == '\r' || c == '\n')
         file.eol++;
     else
         file.eol = 0;
 
-    return (int16_t)c;
+    return c;
 }
 
 static void flashfs_end_job (void)
@@ -115,7 +143,11 @@ static void flashfs_end_job (void)
     if(grbl.on_state_change == trap_state_change_request)
         grbl.on_state_change = on_state_change;
 
+    if(grbl.on_execute_realtime == file_prefetch)
+        grbl.on_execute_realtime = on_execute_realtime;
+
     on_realtime_report = NULL;
+    on_execute_realtime = NULL;
     on_state_change = NULL;
 
     memcpy(&hal.stream, &active_stream, sizeof(io_stream_t));   // Restore stream pointers
@@ -198,7 +230,7 @@ static message_code_t trap_feedback_message (message_code_t message_code)
 
     if(message_code == Message_ProgramEnd) {
         if(frewind) {
-            fseek(file.handle, 0, SEEK_SET);
+            file_buffer_reset(&fbuf, 0);
             file.pos = file.line = 0;
             file.eol = false;
             report_feedback_message(Message_CycleStartToRerun);
@@ -267,6 +299,8 @@ status_code_t flashfs_stream_file (char *filename)
 #endif
             on_realtime_report = grbl.on_realtime_report;
             grbl.on_realtime_report = flashfs_report;                   // Add percent complete to real time report
+            on_execute_realtime = grbl.on_execute_realtime;
+            grbl.on_execute_realtime = file_prefetch;                   // Prefetch file data in the foreground process
             grbl.report.status_message = trap_status_report;            // Redirect status message and feedback message
             grbl.report.feedback_message = trap_feedback_message;       // reports here
             retval = Status_OK;
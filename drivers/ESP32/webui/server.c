@@ -1064,9 +1064,15 @@ esp_err_t webui_index_html_get_handler (httpd_req_t *req)
 {
     extern const unsigned char index_html_gz_start[] asm("_binary_index_html_gz_start");
     extern const unsigned char index_html_gz_end[]   asm("_binary_index_html_gz_end");
-    set_content_type_from_file(req, "index.html");
-    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-    return httpd_resp_send(req, (const char *)index_html_gz_start, index_html_gz_end - index_html_gz_start);
+
+    static http_embedded_file_t index_html = {
+        .filename = "index.html",
+        .start = index_html_gz_start,
+        .end = index_html_gz_end,
+        .gzipped = true
+    };
+
+    return http_send_embedded(req, &index_html);
 }
 
 #endif
@@ -130,6 +130,112 @@ typedef struct {
 
 static qei_t qei = {0};
 
+#if QEI_HW_DECODER
+
+#define QEI_HW_FILTER_COUNT  3 // Number of consecutive samples, less 3, that must agree before an input transition is accepted.
+#define QEI_HW_FILTER_PERIOD 20 // Filter sample period, IPG clock cycles.
+
+typedef struct {
+    uint8_t pin;
+    uint8_t mux;                        // Pad mux mode for the XBAR1 function
+    uint8_t xbar_io;                    // XBAR1 input number
+    volatile uint32_t *select_input;    // Daisy chain register, NULL if none
+    uint8_t select_val;
+} xbar_pin_t;
+
+static const xbar_pin_t xbar_pins[] = {
+    { .pin = 0,  .mux = 1, .xbar_io = 17, .select_input = &IOMUXC_XBAR1_IN17_SELECT_INPUT, .select_val = 1 },
+    { .pin = 1,  .mux = 1, .xbar_io = 16, .select_input = &IOMUXC_XBAR1_IN16_SELECT_INPUT, .select_val = 0 },
+    { .pin = 2,  .mux = 3, .xbar_io = 6 },
+    { .pin = 3,  .mux = 3, .xbar_io = 7 },
+    { .pin = 4,  .mux = 3, .xbar_io = 8 },
+    { .pin = 5,  .mux = 3, .xbar_io = 17, .select_input = &IOMUXC_XBAR1_IN17_SELECT_INPUT, .select_val = 0 },
+    { .pin = 7,  .mux = 1, .xbar_io = 15, .select_input = &IOMUXC_XBAR1_IN15_SELECT_INPUT, .select_val = 1 },
+    { .pin = 8,  .mux = 1, .xbar_io = 14, .select_input = &IOMUXC_XBAR1_IN14_SELECT_INPUT, .select_val = 1 },
+    { .pin = 30, .mux = 1, .xbar_io = 23, .select_input = &IOMUXC_XBAR1_IN23_SELECT_INPUT, .select_val = 0 },
+    { .pin = 31, .mux = 1, .xbar_io = 22, .select_input = &IOMUXC_XBAR1_IN22_SELECT_INPUT, .select_val = 0 },
+    { .pin = 33, .mux = 3, .xbar_io = 9 }
+};
+
+static bool qei_hw = false;
+static int32_t qei_hw_velocity = 0;
+
+static const xbar_pin_t *qei_xbar_pin (uint8_t pin)
+{
+    uint_fast8_t idx = sizeof(xbar_pins) / sizeof(xbar_pin_t);
+
+    do {
+        if(xbar_pins[--idx].pin == pin)
+            return &xbar_pins[idx];
+    } while(idx);
+
+    return NULL;
+}
+
+static void xbar_connect (uint32_t input, uint32_t output)
+{
+    volatile uint16_t *xbar = &XBARA1_SEL0 + (output >> 1);
+
+    *xbar = output & 1 ? (*xbar & 0x00FF) | (input << 8) : (*xbar & 0xFF00) | input;
+}
+
+static void qei_hw_pin_route (const xbar_pin_t *xpin, uint32_t output)
+{
+    *(portConfigRegister(xpin->pin)) = xpin->mux; // Switch pad from GPIO to XBAR1, pad configuration is kept.
+    if(xpin->select_input)
+        *xpin->select_input = xpin->select_val;
+    xbar_connect(xpin->xbar_io, output);
+}
+
+// Routes the A and B inputs to the ENC1 quadrature decoder, called after the pins are configured as GPIO inputs.
+static void qei_hw_configure (void)
+{
+    static bool init_ok = false;
+
+    qei_hw_pin_route(qei_xbar_pin(QEI_A_PIN), XBARA1_OUT_ENC1_PHASE_A_INPUT);
+    qei_hw_pin_route(qei_xbar_pin(QEI_B_PIN), XBARA1_OUT_ENC1_PHASE_B_INPUT);
+
+    if(!init_ok) {
+        init_ok = true;
+        CCM_CCGR2 |= CCM_CCGR2_XBAR1(CCM_CCGR_ON);
+        CCM_CCGR4 |= CCM_CCGR4_ENC1(CCM_CCGR_ON);
+        ENC1_FILT = ENC_FILT_FILT_CNT(QEI_HW_FILTER_COUNT) | ENC_FILT_FILT_PER(QEI_HW_FILTER_PERIOD);
+        ENC1_UINIT = 0;
+        ENC1_LINIT = 0;
+        ENC1_CTRL = ENC_CTRL_SWIP; // Load the initialization values.
+    }
+}
+
+// Reading POSD snapshots the position counter to the hold registers.
+static inline int32_t qei_hw_position (void)
+{
+    (void)ENC1_POSD;
+
+    return (int32_t)(((uint32_t)ENC1_UPOSH << 16) | ENC1_LPOSH);
+}
+
+static bool qei_get_data (uint_fast8_t id, encoder_data_t *data)
+{
+    if(!qei_hw || id != 0)
+        return false;
+
+    uint32_t ms = millis();
+
+    data->position = qei_hw_position();
+
+    if(ms != qei.vel_timestamp) {
+        qei_hw_velocity = (data->position - qei.vel_count) * 1000 / (int32_t)(ms - qei.vel_timestamp);
+        qei.vel_count = data->position;
+        qei.vel_timestamp = ms;
+    }
+
+    data->velocity = qei_hw_velocity;
+
+    return true;
+}
+
+#endif // QEI_HW_DECODER
+
 #endif
 
 static debounce_queue_t debounce_queue = {0};
@@ -295,6 +401,19 @@ static volatile bool ms_event = false;
 static bool IOInitDone = false, probe_invert = false;
 static uint16_t pulse_length, pulse_delay;
 static axes_signals_t next_step_outbits;
+#ifdef STEP_PHASE_SMOOTHING
+// QuadTimer 4 channels 1 - 3 times the step pulses of the X, Y and Z axes, channel 0 any other axes.
+typedef struct {
+    axes_signals_t mask;    // Step outputs controlled by the channel
+    volatile bool active;   // Channel is timing the step delay or pulse
+    volatile bool pulse;    // Channel is timing the step pulse
+} step_phase_channel_t;
+
+static step_phase_channel_t phase_channel[4] = {0};
+static volatile axes_signals_t phase_step_outbits = {0}; // Currently active step outputs
+static uint32_t phase_scale;                             // Step timer to IP bus clock cycles factor, 24.8 fixed point
+static uint32_t phase_min_delay;                         // Minimum step delay after a direction change in IP bus clock cycles
+#endif
 static delay_t grbl_delay = { .ms = 0, .callback = NULL };
 #ifdef SQUARING_ENABLED
 static axes_signals_t motors_1 = {AXES_BITMASK}, motors_2 = {AXES_BITMASK};
@@ -336,7 +455,7 @@ static void enetStreamWriteS (const char *data)
 {
 #if TELNET_ENABLE
     if(services.telnet)
-        TCPStreamWriteS(data);
+        TCPStreamWriteAllS(data);
 #endif
 #if WEBSOCKET_ENABLE
     if(services.websocket)
@@ -431,12 +550,23 @@ const io_stream_t serial_stream = {
 static void stepper_driver_isr (void);
 static void stepper_pulse_isr (void);
 static void stepper_pulse_isr_delayed (void);
+#ifdef STEP_PHASE_SMOOTHING
+static void stepper_phase_isr (void);
+#endif
 static void gpio_isr (void);
 static void debounce_isr (void);
 static void systick_isr (void);
 
 static void (*systick_isr_org)(void) = NULL;
 
+#ifdef ENABLE_IRQ_STATS
+static irq_stats_t irq_stepper = { .name = "STEPPER", .priority = IRQ_PRIORITY_STEPPER, .timed = true, .step_timing = true };
+static irq_stats_t irq_step_pulse = { .name = "PULSE", .priority = IRQ_PRIORITY_STEP_PULSE };
+static irq_stats_t irq_inputs = { .name = "INPUTS", .priority = min(IRQ_PRIORITY_LIMITS, IRQ_PRIORITY_CONTROL) };
+static irq_stats_t irq_debounce = { .name = "DEBOUNCE", .priority = IRQ_PRIORITY_DEBOUNCE };
+static irq_stats_t irq_systick = { .name = "SYSTICK", .priority = IRQ_PRIORITY_SYSTICK };
+#endif
+
 // Millisecond resolution delay function
 // Will return immediately if a callback function is provided
 static void driver_delay_ms (uint32_t ms, void (*callback)(void))
@@ -491,6 +621,114 @@ void selectStream (stream_type_t stream)
     active_stream = stream;
 }
 
+// Step and direction output lookup tables, DR_SET and DR_CLEAR words per GPIO port indexed by the axis bitmask.
+// The tables are built from the pin assignments by outmap_init() on startup and settings changes,
+// signal inversions included. Output takes two stores per port used regardless of the pin mapping.
+
+#define OUTMAP_SIZE (1 << N_AXIS)
+#define OUTMAP_PORTS 4 // GPIO6 - GPIO9
+
+typedef struct {
+    uint_fast8_t n_ports;
+    struct {
+        gpio_reg_t *reg;
+        uint32_t set[OUTMAP_SIZE];
+        uint32_t clear[OUTMAP_SIZE];
+    } port[OUTMAP_PORTS];
+} gpio_outmap_t;
+
+#ifndef SQUARING_ENABLED
+static gpio_outmap_t step_outmap;
+#endif
+static gpio_outmap_t dir_outmap;
+
+// Adds an output pin, driven by the axes in the axes bitmask, to the map.
+static void outmap_add (gpio_outmap_t *map, gpio_t *gpio, uint_fast8_t axes, uint_fast8_t invert)
+{
+    uint_fast8_t idx, port = 0;
+
+    while(port < map->n_ports && map->port[port].reg != gpio->reg)
+        port++;
+
+    if(port == map->n_ports) {
+        if(port == OUTMAP_PORTS)
+            return;
+        map->n_ports++;
+        map->port[port].reg = gpio->reg;
+        memset(map->port[port].set, 0, sizeof(map->port[port].set));
+        memset(map->port[port].clear, 0, sizeof(map->port[port].clear));
+    }
+
+    for(idx = 0; idx < OUTMAP_SIZE; idx++) {
+        if((idx ^ invert) & axes)
+            map->port[port].set[idx] |= gpio->bit;
+        else
+            map->port[port].clear[idx] |= gpio->bit;
+    }
+}
+
+inline static __attribute__((always_inline)) void outmap_write (gpio_outmap_t *map, uint_fast8_t axes)
+{
+    uint_fast8_t port = map->n_ports;
+
+    axes &= (OUTMAP_SIZE - 1);
+
+    while(port) {
+        port--;
+        map->port[port].reg->DR_SET = map->port[port].set[axes];
+        map->port[port].reg->DR_CLEAR = map->port[port].clear[axes];
+    }
+}
+
+static void outmap_init (settings_t *settings)
+{
+#ifndef SQUARING_ENABLED
+    uint_fast8_t invert = settings->steppers.step_invert.mask;
+
+    step_outmap.n_ports = 0;
+    outmap_add(&step_outmap, &stepX, X_AXIS_BIT, invert);
+  #ifdef X2_STEP_PIN
+    outmap_add(&step_outmap, &stepX2, X_AXIS_BIT, invert);
+  #endif
+    outmap_add(&step_outmap, &stepY, Y_AXIS_BIT, invert);
+  #ifdef Y2_STEP_PIN
+    outmap_add(&step_outmap, &stepY2, Y_AXIS_BIT, invert);
+  #endif
+    outmap_add(&step_outmap, &stepZ, Z_AXIS_BIT, invert);
+  #ifdef Z2_STEP_PIN
+    outmap_add(&step_outmap, &stepZ2, Z_AXIS_BIT, invert);
+  #endif
+  #ifdef A_AXIS
+    outmap_add(&step_outmap, &stepA, A_AXIS_BIT, invert);
+  #endif
+  #ifdef B_AXIS
+    outmap_add(&step_outmap, &stepB, B_AXIS_BIT, invert);
+  #endif
+#endif
+
+    uint_fast8_t dir_invert = settings->steppers.dir_invert.mask;
+
+    dir_outmap.n_ports = 0;
+    outmap_add(&dir_outmap, &dirX, X_AXIS_BIT, dir_invert);
+#ifdef X2_DIRECTION_PIN
+    outmap_add(&dir_outmap, &dirX2, X_AXIS_BIT, dir_invert);
+#endif
+    outmap_add(&dir_outmap, &dirY, Y_AXIS_BIT, dir_invert);
+#ifdef Y2_DIRECTION_PIN
+    outmap_add(&dir_outmap, &dirY2, Y_AXIS_BIT, dir_invert);
+#endif
+    outmap_add(&dir_outmap, &dirZ, Z_AXIS_BIT, dir_invert);
+#ifdef Z2_DIRECTION_PIN
+    outmap_add(&dir_outmap, &dirZ2, Z_AXIS_BIT, dir_invert);
+#endif
+#ifdef A_AXIS
+    outmap_add(&dir_outmap, &dirA, A_AXIS_BIT, dir_invert);
+#endif
+#ifdef B_AXIS
+    outmap_add(&dir_outmap, &dirB, B_AXIS_BIT, dir_invert);
+#endif
+}
+
 // Set stepper pulse output pins.
 // step_outbits.value (or step_outbits.mask) are: bit0 -> X, bit1 -> Y...
 // Individual step bits can be accessed by step_outbits.x, step_outbits.y, ...
@@ -527,29 +765,7 @@ inline static __attribute__((always_inline)) void set_step_outputs (axes_signals
 #else
 inline static __attribute__((always_inline)) void set_step_outputs (axes_signals_t step_outbits)
 {
-    step_outbits.value ^= settings.steppers.step_invert.mask;
-
-    DIGITAL_OUT(stepX, step_outbits.x);
-#ifdef X2_STEP_PIN
-    DIGITAL_OUT(stepX2, step_outbits.x);
-#endif
-
-    DIGITAL_OUT(stepY, step_outbits.y);
-#ifdef Y2_STEP_PIN
-    DIGITAL_OUT(stepY2, step_outbits.y);
-#endif
-
-    DIGITAL_OUT(stepZ, step_outbits.z);
-#ifdef Z2_STEP_PIN
-    DIGITAL_OUT(stepZ2, step_outbits.z);
-#endif
-
-#ifdef A_AXIS
-    DIGITAL_OUT(stepA, step_outbits.a);
-#endif
-#ifdef B_AXIS
-    DIGITAL_OUT(stepB, step_outbits.b);
-#endif
+    outmap_write(&step_outmap, step_outbits.value);
 }
 #endif
 
@@ -558,29 +774,7 @@ inline static __attribute__((always_inline)) void set_step_outputs (axes_signals
 // Individual direction bits can be accessed by dir_outbits.x, dir_outbits.y, ...
 inline static __attribute__((always_inline)) void set_dir_outputs (axes_signals_t dir_outbits)
 {
-    dir_outbits.value ^= settings.steppers.dir_invert.mask;
-
-    DIGITAL_OUT(dirX, dir_outbits.x);
-#ifdef X2_DIRECTION_PIN
-    DIGITAL_OUT(dirX2, dir_outbits.x);
-#endif
-
-    DIGITAL_OUT(dirY, dir_outbits.y);
-#ifdef Y2_DIRECTION_PIN
-    DIGITAL_OUT(dirY2, dir_outbits.y);
-#endif
-
-    DIGITAL_OUT(dirZ, dir_outbits.z);
-#ifdef Z2_DIRECTION_PIN
-    DIGITAL_OUT(dirZ2, dir_outbits.z);
-#endif
-
-#ifdef A_AXIS
-    DIGITAL_OUT(dirA, dir_outbits.a);
-#endif
-#ifdef B_AXIS
-    DIGITAL_OUT(dirB, dir_outbits.b);
-#endif
+    outmap_write(&dir_outmap, dir_outbits.value);
 }
 
 // Enable steppers.
@@ -641,6 +835,16 @@ static void stepperGoIdle (bool clear_signals)
     PIT_TCTRL0 &= ~(PIT_TCTRL_TIE|PIT_TCTRL_TEN);
 
     if(clear_signals) {
+#ifdef STEP_PHASE_SMOOTHING
+        uint_fast8_t ch = 4;
+        do {
+            ch--;
+            IMXRT_TMR4.CH[ch].CTRL &= ~TMR_CTRL_CM(0b111);
+            IMXRT_TMR4.CH[ch].CSCTRL &= ~TMR_CSCTRL_TCF1;
+            phase_channel[ch].active = false;
+        } while(ch);
+        phase_step_outbits.mask = 0;
+#endif
         set_step_outputs((axes_signals_t){0});
         set_dir_outputs((axes_signals_t){0});
     }
@@ -721,6 +925,92 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
     }
 }
 
+#ifdef STEP_PHASE_SMOOTHING
+
+// Starts a QuadTimer 4 channel timing cycles IP bus clock cycles, the prescaler is increased as needed for the 16 bit counter.
+inline static __attribute__((always_inline)) void phase_timer_start (uint_fast8_t ch, uint32_t cycles)
+{
+    uint32_t pcs = 0b1000; // IP bus clock
+
+    while(cycles > 0xFFFF && pcs < 0b1111) {
+        cycles >>= 1;
+        pcs++;
+    }
+
+    IMXRT_TMR4.CH[ch].CTRL = TMR_CTRL_PCS(pcs) | TMR_CTRL_ONCE | TMR_CTRL_LENGTH;
+    IMXRT_TMR4.CH[ch].CNTR = 0;
+    IMXRT_TMR4.CH[ch].COMP1 = cycles > 0xFFFF ? 0xFFFF : (cycles ? cycles : 1);
+    IMXRT_TMR4.CH[ch].CTRL |= TMR_CTRL_CM(0b001);
+}
+
+// Starts the step pulse or the step delay for a channel.
+// NOTE: called with interrupts disabled.
+inline static __attribute__((always_inline)) void phase_channel_start (uint_fast8_t ch, axes_signals_t mask, uint32_t delay)
+{
+    step_phase_channel_t *channel = &phase_channel[ch];
+
+    // Terminate a pulse still active, this may only happen if the step pulse length is too long for the step rate.
+    if(channel->active && channel->pulse) {
+        phase_step_outbits.mask &= ~channel->mask.mask;
+        set_step_outputs(phase_step_outbits);
+    }
+
+    channel->mask = mask;
+    channel->active = true;
+
+    if((channel->pulse = delay < F_BUS_MHZ)) { // Output immediately if delay is less than 1 us
+        phase_step_outbits.mask |= mask.mask;
+        set_step_outputs(phase_step_outbits);
+        delay = pulse_length;
+    }
+
+    phase_timer_start(ch, delay);
+}
+
+// Start a stepper pulse, step phase smoothing version.
+// The step pulses of the X, Y and Z axes are delayed individually by stepper->step_delay[] for smooth
+// pulse trains, the pulse timing is done in hardware by QuadTimer 4 channels 1 - 3.
+// Step pulses for any other axes are output at the start of the step event.
+// NOTE: the step delay after a direction change is the minimum delay for all axes.
+static void stepperPulseStartPhased (stepper_t *stepper)
+{
+#ifdef SPINDLE_SYNC_ENABLE
+    if(stepper->new_block && stepper->exec_segment->spindle_sync) {
+        spindle_tracker.stepper_pulse_start_normal = hal.stepper.pulse_start;
+        hal.stepper.pulse_start = stepperPulseStartSynchronized;
+        hal.stepper.pulse_start(stepper);
+        return;
+    }
+#endif
+
+    if(stepper->dir_change)
+        set_dir_outputs(stepper->dir_outbits);
+
+    if(stepper->step_outbits.value) {
+
+        uint_fast8_t idx;
+        uint32_t delay, min_delay = stepper->dir_change ? phase_min_delay : 0;
+        axes_signals_t step_outbits = stepper->step_outbits;
+
+        __disable_irq();
+
+        for(idx = 0; idx < 3; idx++) {
+            if(step_outbits.mask & bit(idx)) {
+                step_outbits.mask &= ~bit(idx);
+                delay = (stepper->step_delay[idx] * phase_scale) >> 8;
+                phase_channel_start(idx + 1, (axes_signals_t){ .mask = bit(idx) }, delay > min_delay ? delay : min_delay);
+            }
+        }
+
+        if(step_outbits.mask)
+            phase_channel_start(0, step_outbits, min_delay);
+
+        __enable_irq();
+    }
+}
+
+#endif
+
 #ifdef SPINDLE_SYNC_ENABLE
 
 // Spindle sync version: sets stepper direction and pulse pins and starts a step pulse.
@@ -744,10 +1034,15 @@ static void stepperPulseStartSynchronized (stepper_t *stepper)
         spindle_tracker.segment_id = 0;
         spindle_tracker.prev_pos = 0.0f;
         block_start = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
+#ifdef SPINDLE_SYNC_PID_FIXED
+        pidq_init(&spindle_tracker.pidq, &settings.position.pid, spindle_tracker.steps_per_mm * 256.0f);
+#else
         pidf_reset(&spindle_tracker.pid);
+#endif
 #ifdef PID_LOG
         sys.pid_log.idx = 0;
         sys.pid_log.setpoint = 100.0f;
+        sys.pid_log.t_exec_max = 0;
 #endif
     }
 
@@ -777,7 +1072,21 @@ static void stepperPulseStartSynchronized (stepper_t *stepper)
                 }
 
                 actual_pos -= block_start;
+
+#ifdef PID_LOG
+                uint32_t t_exec = ARM_DWT_CYCCNT;
+#endif
+#ifdef SPINDLE_SYNC_PID_FIXED
+                float scale = spindle_tracker.steps_per_mm * 256.0f;
+                int32_t step_delta = pidq(&spindle_tracker.pidq, (int32_t)(spindle_tracker.prev_pos * scale), (int32_t)(actual_pos * scale)) / 256;
+#else
                 int32_t step_delta = (int32_t)(pidf(&spindle_tracker.pid, spindle_tracker.prev_pos, actual_pos, dt) * spindle_tracker.steps_per_mm);
+#endif
+#ifdef PID_LOG
+                t_exec = ARM_DWT_CYCCNT - t_exec;
+                if(t_exec > sys.pid_log.t_exec_max)
+                    sys.pid_log.t_exec_max = t_exec;
+#endif
 
 
                 int32_t ticks = (((int32_t)stepper->step_count + step_delta) * (int32_t)stepper->exec_segment->cycles_per_tick) / (int32_t)stepper->step_count;
@@ -831,6 +1140,74 @@ void stepperOutputStep (axes_signals_t step_outbits, axes_signals_t dir_outbits)
 
 #endif
 
+#if PLASMA_ADC_ENABLE
+
+#define dmaTCD(ch, reg) dmaTCDi(ch, reg)
+#define dmaTCDi(ch, reg) DMA_TCD ## ch ## _ ## reg
+#define dmaMUX(ch) dmaMUXi(ch)
+#define dmaMUXi(ch) DMAMUX_CHCFG ## ch
+
+// Arc voltage is converted continuously by ADC1, samples are transferred to the ring buffer by DMA.
+// NOTE: the buffer is placed in DTCM which is not cached, DMAMEM (OCRAM) would require cache maintenance.
+static volatile uint16_t thc_adc_buffer[PLASMA_ADC_BUFFER_SIZE] __attribute__((aligned(32)));
+static void (*thc_control_loop)(void) = NULL;
+
+static uint_fast16_t thcADCGetHead (void)
+{
+    return (PLASMA_ADC_BUFFER_SIZE - (dmaTCD(PLASMA_ADC_DMA_CHANNEL, CITER_ELINKNO) & 0x7FFF)) & (PLASMA_ADC_BUFFER_SIZE - 1);
+}
+
+// Called from driver_setup() when the plugin has claimed the sampling, the PIT module is enabled at that point.
+static void thcADCInit (void)
+{
+    CCM_CCGR5 |= CCM_CCGR5_DMA(CCM_CCGR_ON);
+    DMA_CERQ = PLASMA_ADC_DMA_CHANNEL;
+
+    // Circular transfer: one 16 bit sample per request, destination rewinds after a full major loop.
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, SADDR) = &ADC1_R0;
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, SOFF) = 0;
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, ATTR) = DMA_TCD_ATTR_SSIZE(1) | DMA_TCD_ATTR_DSIZE(1);
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, NBYTES_MLNO) = sizeof(uint16_t);
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, SLAST) = 0;
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, DADDR) = thc_adc_buffer;
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, DOFF) = sizeof(uint16_t);
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, CITER_ELINKNO) = PLASMA_ADC_BUFFER_SIZE;
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, DLASTSGA) = -(int32_t)sizeof(thc_adc_buffer);
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, BITER_ELINKNO) = PLASMA_ADC_BUFFER_SIZE;
+    dmaTCD(PLASMA_ADC_DMA_CHANNEL, CSR) = 0;
+
+    dmaMUX(PLASMA_ADC_DMA_CHANNEL) = 0;
+    dmaMUX(PLASMA_ADC_DMA_CHANNEL) = DMAMUX_SOURCE_ADC1 | DMAMUX_CHCFG_ENBL;
+    DMA_SERQ = PLASMA_ADC_DMA_CHANNEL;
+
+    // ADC1 is initialized by the Teensy core, switch to continuous conversion with DMA requests.
+    ADC1_GC |= ADC_GC_ADCO | ADC_GC_DMAEN;
+    ADC1_HC0 = PLASMA_ADC_CHANNEL;
+
+    // Control loop timer, PIT1 shares the interrupt with the stepper driver timer.
+    PIT_TCTRL1 &= ~PIT_TCTRL_TEN;
+    PIT_LDVAL1 = hal.f_step_timer / PLASMA_THC_RATE - 1;
+    PIT_TFLG1 |= PIT_TFLG_TIF;
+    PIT_TCTRL1 |= (PIT_TCTRL_TIE|PIT_TCTRL_TEN);
+}
+
+static bool thcADCStart (void (*control_loop)(void))
+{
+    thc_control_loop = control_loop;
+
+    return true;
+}
+
+static const thc_adc_t thc_adc = {
+    .buffer = thc_adc_buffer,
+    .buffer_size = PLASMA_ADC_BUFFER_SIZE,
+    .control_rate = PLASMA_THC_RATE,
+    .get_head = thcADCGetHead,
+    .start = thcADCStart
+};
+
+#endif
+
 #ifdef DUAL_LIMIT_SWITCHES
 
 // Returns limit state as an axes_signals_t variable.
@@ -1217,7 +1594,9 @@ static void spindlePulseOn (uint_fast16_t pulse_length)
 
 static spindle_data_t spindleGetData (spindle_data_request_t request)
 {
-    bool stopped;
+    bool stopped, fitted;
+    float period;
+    uint32_t last_pulse;
     uint32_t pulse_length = spindle_encoder.timer.pulse_length / spindle_encoder.counter.tics_per_irq;
     spindle_encoder.pulse_distance = 1.0f / 120.0f;
     uint32_t rpm_timer_delta = GPT1_CNT - spindle_encoder.timer.last_pulse;
@@ -1228,6 +1607,10 @@ static spindle_data_t spindleGetData (spindle_data_request_t request)
         rpm_timer_delta = (GPT2_CNT - spindle_encoder.counter.last_count) * pulse_length;
     }
 
+    // Use the least squares estimate of the pulse length from the last interrupts when running.
+    if((fitted = !stopped && request != SpindleData_Counters && spindle_encoder_fit_edges(&spindle_encoder.edges, &period, &last_pulse)))
+        period /= (float)spindle_encoder.counter.tics_per_irq;
+
     switch(request) {
 
         case SpindleData_Counters:
@@ -1236,16 +1619,20 @@ static spindle_data_t spindleGetData (spindle_data_request_t request)
 
         case SpindleData_RPM:
             if(!stopped)
-                spindle_data.rpm = spindle_encoder.rpm_factor / (float)pulse_length;
+                spindle_data.rpm = spindle_encoder.rpm_factor / (fitted ? period : (float)pulse_length);
             break;
 
         case SpindleData_AngularPosition:;
             while(spindleLock);
             int32_t d = spindle_encoder.counter.last_count - spindle_encoder.counter.last_index;
-            spindle_data.angular_position = (float)spindle_data.index_count +
-                    ((float)(d) +
-                             (pulse_length == 0 ? 0.0f : (float)rpm_timer_delta / (float)pulse_length)) *
-                                spindle_encoder.pulse_distance;
+            float pulses;
+            if(fitted) {
+                // Extrapolate from the fitted time of the last interrupt, limited to the pulses until the next interrupt.
+                int32_t delta = (int32_t)(GPT1_CNT - last_pulse);
+                pulses = delta <= 0 ? 0.0f : min((float)delta / period, (float)spindle_encoder.counter.tics_per_irq);
+            } else
+                pulses = pulse_length == 0 ? 0.0f : (float)rpm_timer_delta / (float)pulse_length;
+            spindle_data.angular_position = (float)spindle_data.index_count + ((float)(d) + pulses) * spindle_encoder.pulse_distance;
             break;
     }
 
@@ -1274,6 +1661,7 @@ static void spindleDataReset (void)
 
     spindle_encoder.timer.last_index = GPT1_CNT;
     spindle_encoder.timer.pulse_length = 0;
+    spindle_encoder.edges.count = 0;
     spindle_encoder.counter.last_count = 0;
     spindle_encoder.counter.last_index = 0;
 
@@ -1359,6 +1747,8 @@ static void settings_changed (settings_t *settings)
 {
     if(IOInitDone) {
 
+        outmap_init(settings);
+
         stepperEnable(settings->steppers.deenergize);
 
 #ifdef SQUARING_ENABLED
@@ -1424,6 +1814,21 @@ static void settings_changed (settings_t *settings)
         TMR4_CTRL0 &= ~TMR_CTRL_OUTMODE(0b000);
         attachInterruptVector(IRQ_QTIMER4, stepper_pulse_isr);
 
+#ifdef STEP_PHASE_SMOOTHING
+        phase_scale = (uint32_t)(((uint64_t)F_BUS_ACTUAL << 8) / hal.f_step_timer);
+        phase_min_delay = hal.stepper.pulse_start == stepperPulseStartDelayed ? pulse_delay : 0;
+        hal.stepper.pulse_start = stepperPulseStartPhased;
+
+        uint_fast8_t ch;
+        for(ch = 1; ch < 4; ch++) {
+            IMXRT_TMR4.CH[ch].LOAD = 0;
+            IMXRT_TMR4.CH[ch].CTRL = TMR_CTRL_PCS(0b1000) | TMR_CTRL_ONCE | TMR_CTRL_LENGTH;
+            IMXRT_TMR4.CH[ch].CSCTRL = TMR_CSCTRL_TCF1EN;
+        }
+        TMR4_ENBL = 0b1111;
+        attachInterruptVector(IRQ_QTIMER4, stepper_phase_isr);
+#endif
+
 #if PLASMA_ENABLE
         TMR2_CSCTRL0 &= ~(TMR_CSCTRL_TCF1|TMR_CSCTRL_TCF2);
         TMR2_COMP10 = pulse_length;
@@ -1540,12 +1945,12 @@ static void settings_changed (settings_t *settings)
 #endif
 #if QEI_ENABLE
                 case Input_QEI_A:
-                    if(qei_enable)
-                        signal->irq_mode = IRQ_Mode_Change;
-                    break;
-
                 case Input_QEI_B:
+  #if QEI_HW_DECODER
+                    if(qei_enable && !qei_hw)
+  #else
                     if(qei_enable)
+  #endif
                         signal->irq_mode = IRQ_Mode_Change;
                     break;
 
@@ -1612,6 +2017,11 @@ static void settings_changed (settings_t *settings)
             }
         } while(i);
 
+#if QEI_ENABLE && QEI_HW_DECODER
+        if(qei_enable && qei_hw)
+            qei_hw_configure();
+#endif
+
         NVIC_ENABLE_IRQ(IRQ_GPIO6789);
     }
 }
@@ -1663,6 +2073,13 @@ static void qei_reset (uint_fast8_t id)
     qei.vel_timeout = 0;
     qei.count = qei.vel_count = 0;
     qei.vel_timestamp = millis();
+#if QEI_HW_DECODER
+    if(qei_hw) {
+        ENC1_CTRL |= ENC_CTRL_SWIP;
+        qei_hw_velocity = 0;
+        return; // Velocity is computed by qei_get_data().
+    }
+#endif
     qei.vel_timeout = qei.encoder.axis != 0xFF ? QEI_VELOCITY_TIMEOUT : 0;
 }
 
@@ -1690,16 +2107,21 @@ static bool driver_setup (settings_t *settings)
     CCM_CCGR1 |= CCM_CCGR1_PIT(CCM_CCGR_ON);
 
     attachInterruptVector(IRQ_PIT, stepper_driver_isr);
-    NVIC_SET_PRIORITY(IRQ_PIT, 2);
+    NVIC_SET_PRIORITY(IRQ_PIT, IRQ_PRIORITY_STEPPER);
     NVIC_ENABLE_IRQ(IRQ_PIT);
 
+#if PLASMA_ADC_ENABLE
+    if(thc_control_loop)
+        thcADCInit();
+#endif
+
     TMR4_ENBL = 0;
     TMR4_LOAD0 = 0;
     TMR4_CTRL0 = TMR_CTRL_PCS(0b1000) | TMR_CTRL_ONCE | TMR_CTRL_LENGTH;
     TMR4_CSCTRL0 = TMR_CSCTRL_TCF1EN;
 
     attachInterruptVector(IRQ_QTIMER4, stepper_pulse_isr);
-    NVIC_SET_PRIORITY(IRQ_QTIMER4, 0);
+    NVIC_SET_PRIORITY(IRQ_QTIMER4, IRQ_PRIORITY_STEP_PULSE);
     NVIC_ENABLE_IRQ(IRQ_QTIMER4);
 
     TMR4_ENBL = 1;
@@ -1711,7 +2133,7 @@ static bool driver_setup (settings_t *settings)
     TMR2_CSCTRL0 = TMR_CSCTRL_TCF1EN;
 
     attachInterruptVector(IRQ_QTIMER2, output_pulse_isr);
-    NVIC_SET_PRIORITY(IRQ_QTIMER2, 0);
+    NVIC_SET_PRIORITY(IRQ_QTIMER2, IRQ_PRIORITY_STEP_PULSE);
     NVIC_ENABLE_IRQ(IRQ_QTIMER2);
 
     TMR2_ENBL = 1;
@@ -1795,7 +2217,7 @@ static bool driver_setup (settings_t *settings)
         TMR3_CSCTRL0 = TMR_CSCTRL_TCF1EN;
 
         attachInterruptVector(IRQ_QTIMER3, debounce_isr);
-        NVIC_SET_PRIORITY(IRQ_QTIMER3, 4);
+        NVIC_SET_PRIORITY(IRQ_QTIMER3, IRQ_PRIORITY_DEBOUNCE);
         NVIC_ENABLE_IRQ(IRQ_QTIMER3);
 
         TMR3_ENBL = 1;
@@ -1806,6 +2228,7 @@ static bool driver_setup (settings_t *settings)
     ***********************/
 
     attachInterruptVector(IRQ_GPIO6789, gpio_isr);
+    NVIC_SET_PRIORITY(IRQ_GPIO6789, min(IRQ_PRIORITY_LIMITS, IRQ_PRIORITY_CONTROL));
 
    /***********************
     *  Coolant pins init  *
@@ -1874,7 +2297,7 @@ static bool driver_setup (settings_t *settings)
     GPT2_IR = GPT_IR_OF1IE;
 
     attachInterruptVector(IRQ_GPT2, spindle_pulse_isr);
-    NVIC_SET_PRIORITY(IRQ_GPT2, 1);
+    NVIC_SET_PRIORITY(IRQ_GPT2, IRQ_PRIORITY_SPINDLE_PULSE);
     NVIC_ENABLE_IRQ(IRQ_GPT2);
 
   #endif
@@ -1890,7 +2313,7 @@ static bool driver_setup (settings_t *settings)
     PPI_TIMER.CH[0].CSCTRL = TMR_CSCTRL_TCF1EN;
 
     attachInterruptVector(PPI_TIMERIRQ, ppi_timeout_isr);
-    NVIC_SET_PRIORITY(PPI_TIMERIRQ, 3);
+    NVIC_SET_PRIORITY(PPI_TIMERIRQ, IRQ_PRIORITY_PPI);
     NVIC_ENABLE_IRQ(PPI_TIMERIRQ);
 
     PPI_TIMER.ENBL = 1;
@@ -1905,7 +2328,7 @@ static bool driver_setup (settings_t *settings)
 
   // Set defaults
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     hal.settings_changed(settings);
     hal.stepper.go_idle(true);
@@ -2013,6 +2436,12 @@ static void reboot (void)
     SCB_AIRCR = 0x05FA0004;
 }
 
+// NOTE: The cycle counter is enabled by the Teensy core at startup.
+static uint32_t getCycleCount (void)
+{
+    return ARM_DWT_CYCCNT;
+}
+
 // Initialize HAL pointers, setup serial comms and enable EEPROM.
 // NOTE: Grbl is not yet configured (from EEPROM data), driver_setup() will be called when done.
 bool driver_init (void)
@@ -2024,6 +2453,7 @@ bool driver_init (void)
     if(systick_isr_org == NULL) 
         systick_isr_org = _VectorsRam[15];
     _VectorsRam[15] = systick_isr;
+    SCB_SHPR3 = (SCB_SHPR3 & 0x00FFFFFF) | ((uint32_t)IRQ_PRIORITY_SYSTICK << 24);
 
     // Enable lazy stacking of FPU registers here if a FPU is available.
 
@@ -2130,6 +2560,17 @@ bool driver_init (void)
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
     hal.get_elapsed_ticks = millis;
+    hal.get_cycle_count = getCycleCount;
+    hal.f_cycle_count = F_CPU_ACTUAL;
+    hal.get_micros = micros;
+
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_stepper);
+    irq_stats_register(&irq_step_pulse);
+    irq_stats_register(&irq_inputs);
+    irq_stats_register(&irq_debounce);
+    irq_stats_register(&irq_systick);
+#endif
 
 #if ETHERNET_ENABLE || ADD_MSEVENT
     grbl.on_execute_realtime = execute_realtime;
@@ -2138,6 +2579,10 @@ bool driver_init (void)
 #if QEI_ENABLE
     hal.encoder.reset = qei_reset;
     hal.encoder.on_event = encoder_event;
+  #if QEI_HW_DECODER
+    if((qei_hw = qei_xbar_pin(QEI_A_PIN) && qei_xbar_pin(QEI_B_PIN)))
+        hal.encoder.get_data = qei_get_data;
+  #endif
 #endif
 
 #if MODBUS_ENABLE
@@ -2175,6 +2620,9 @@ bool driver_init (void)
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
     hal.driver_cap.amass_level = 3;
+#ifdef STEP_PHASE_SMOOTHING
+    hal.driver_cap.step_phase = On;
+#endif
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
     hal.driver_cap.probe_pull_up = On;
@@ -2210,7 +2658,11 @@ bool driver_init (void)
 
 #if PLASMA_ENABLE
     hal.stepper.output_step = stepperOutputStep;
-    plasma_init();
+  #if PLASMA_ADC_ENABLE
+    plasma_init(&thc_adc);
+  #else
+    plasma_init(NULL);
+  #endif
 #endif
 
     my_plugin_init();
@@ -2229,10 +2681,24 @@ bool driver_init (void)
 // Main stepper driver.
 static void stepper_driver_isr (void)
 {
+    IRQ_STATS_ENTER();
+#ifdef ENABLE_IRQ_STATS
+    uint32_t latency = PIT_LDVAL0 - PIT_CVAL0; // PIT ticks since the timer reloaded, it counts down
+#endif
+
     if(PIT_TFLG0 & PIT_TFLG_TIF) {
         PIT_TFLG0 |= PIT_TFLG_TIF;
         hal.stepper.interrupt_callback();
     }
+
+#if PLASMA_ADC_ENABLE
+    if(PIT_TFLG1 & PIT_TFLG_TIF) {
+        PIT_TFLG1 |= PIT_TFLG_TIF;
+        thc_control_loop();
+    }
+#endif
+
+    IRQ_STATS_EXIT(&irq_stepper, latency * (F_CPU_ACTUAL / hal.f_step_timer));
 }
 
 /* The Stepper Port Reset Interrupt: This interrupt handles the falling edge of the step
@@ -2248,13 +2714,59 @@ static void stepper_driver_isr (void)
 // completing one step cycle.
 static void stepper_pulse_isr (void)
 {
+    IRQ_STATS_ENTER();
+
     TMR4_CSCTRL0 &= ~TMR_CSCTRL_TCF1;
 
     set_step_outputs((axes_signals_t){0});
+
+    IRQ_STATS_EXIT(&irq_step_pulse, 0);
 }
 
+#ifdef STEP_PHASE_SMOOTHING
+
+// Step phase smoothing step delay and pulse timeout interrupt, shared by all channels.
+static void stepper_phase_isr (void)
+{
+    uint_fast8_t ch = 4;
+
+    do {
+        ch--;
+        if(IMXRT_TMR4.CH[ch].CSCTRL & TMR_CSCTRL_TCF1) {
+
+            IMXRT_TMR4.CH[ch].CSCTRL &= ~TMR_CSCTRL_TCF1;
+
+            if(!phase_channel[ch].active) {
+                // Channel 0 pulse started by the spindle synchronized version, see stepper_pulse_isr().
+                if(ch == 0)
+                    set_step_outputs(phase_step_outbits);
+                continue;
+            }
+
+            if(phase_channel[ch].pulse) { // End of pulse
+                phase_channel[ch].active = false;
+                phase_step_outbits.mask &= ~phase_channel[ch].mask.mask;
+                set_step_outputs(phase_step_outbits);
+                if(ch == 0) { // Restore pulse timing for the spindle synchronized version.
+                    IMXRT_TMR4.CH[0].CTRL = TMR_CTRL_PCS(0b1000) | TMR_CTRL_ONCE | TMR_CTRL_LENGTH;
+                    IMXRT_TMR4.CH[0].COMP1 = pulse_length;
+                }
+            } else { // End of delay, start pulse
+                phase_channel[ch].pulse = true;
+                phase_step_outbits.mask |= phase_channel[ch].mask.mask;
+                set_step_outputs(phase_step_outbits);
+                phase_timer_start(ch, pulse_length);
+            }
+        }
+    } while(ch);
+}
+
+#endif
+
 static void stepper_pulse_isr_delayed (void)
 {
+    IRQ_STATS_ENTER();
+
     TMR4_CSCTRL0 &= ~TMR_CSCTRL_TCF1;
 
     set_step_outputs(next_step_outbits);
@@ -2262,6 +2774,8 @@ static void stepper_pulse_isr_delayed (void)
     attachInterruptVector(IRQ_QTIMER4, stepper_pulse_isr);
     TMR4_COMP10 = pulse_length;
     TMR4_CTRL0 |= TMR_CTRL_CM(0b001);
+
+    IRQ_STATS_EXIT(&irq_step_pulse, 0);
 }
 
 #if defined(SPINDLE_SYNC_ENABLE) && SPINDLE_PULSE_PIN == 14
@@ -2280,6 +2794,8 @@ static void spindle_pulse_isr (void)
     spindle_encoder.counter.last_count = spindle_data.pulse_count;
     spindle_encoder.timer.pulse_length = tval - spindle_encoder.timer.last_pulse;
     spindle_encoder.timer.last_pulse = tval;
+    spindle_encoder.edges.timestamp[spindle_encoder.edges.count % SPINDLE_ENCODER_EDGES] = tval;
+    spindle_encoder.edges.count++;
 
     spindleLock = false;
 }
@@ -2340,6 +2856,8 @@ inline static input_signal_t *get_debounce (void)
 
 static void debounce_isr (void)
 {
+    IRQ_STATS_ENTER();
+
     uint8_t grp = 0;
     input_signal_t *signal;
 
@@ -2372,11 +2890,15 @@ static void debounce_isr (void)
     }
 
 #endif
+
+    IRQ_STATS_EXIT(&irq_debounce, 0);
 }
 
   //GPIO intr process
 static void gpio_isr (void)
 {
+    IRQ_STATS_ENTER();
+
     bool debounce = false;
     uint8_t grp = 0;
     uint32_t intr_status[4];
@@ -2472,11 +2994,15 @@ static void gpio_isr (void)
     if(grp & INPUT_GROUP_KEYPAD)
         keypad_keyclick_handler(!(KeypadStrobe.reg->DR & KeypadStrobe.bit));
 #endif
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 // Interrupt handler for 1 ms interval timer
 static void systick_isr (void)
 {
+    IRQ_STATS_ENTER();
+
     systick_isr_org();
 
 #if ADD_MSEVENT
@@ -2489,4 +3015,6 @@ static void systick_isr (void)
             grbl_delay.callback = NULL;
         }
     }
+
+    IRQ_STATS_EXIT(&irq_systick, 0);
 }
@@ -36,6 +36,7 @@
 
 #include "grbl/hal.h"
 #include "grbl/nuts_bolts.h"
+#include "grbl/irq_stats.h"
 
 #if USB_SERIAL_CDC > 0
 //#define UART_DEBUG // For development only - enable only with USB_SERIAL_CDC enabled and SPINDLE_HUANYANG disabled
@@ -50,6 +51,9 @@
 #ifndef PLASMA_ENABLE
 #define PLASMA_ENABLE       0
 #endif
+#ifndef PLASMA_ADC_ENABLE
+#define PLASMA_ADC_ENABLE   0
+#endif
 #ifndef PPI_ENABLE
 #define PPI_ENABLE          0
 #endif
@@ -59,6 +63,9 @@
 #ifndef QEI_ENABLE
 #define QEI_ENABLE          0
 #endif
+#ifndef QEI_HW_DECODER
+#define QEI_HW_DECODER      1 // Count the encoder with the ENC1 quadrature decoder if the A and B pins can be routed to it via XBAR1.
+#endif
 #ifndef ODOMETER_ENABLE
 #define ODOMETER_ENABLE     0
 #endif
@@ -142,6 +149,7 @@
 //#define SPINDLE_PWM_TIMER TMR1 (pin 12) or TMR2 (pin 3)
 //#define DEBOUNCE_TIMER    TMR3
 //#define PLASMA_TIMER      TMR2
+//#define PLASMA_THC_TIMER  PIT1 (shares interrupt with STEPPER_TIMER)
 //#define PPI_TIMER         inverse of SPINDLE_PWM_TIMER
 
 // Timers used for spindle encoder if spindle sync is enabled:
@@ -175,6 +183,40 @@
 #define STEP_PULSE_LATENCY 0.2f // microseconds
 #endif
 
+// Interrupt priorities, 0 - 255 where lower values preempt higher. Only the upper 4 bits are implemented by
+// the i.MX RT1062 so priorities are in steps of 16. The step pulse timer ends the step pulses and should have
+// the highest priority, followed by the step timer for low step timing jitter. Limit and control inputs share
+// the GPIO interrupt, it gets the higher priority of the two. Enable ENABLE_IRQ_STATS in grbl/config.h and
+// use the $IRQ command to check the entry latencies and execution times when changing these.
+// NOTE: USB and Ethernet interrupt priorities are set by the Teensyduino core and libraries.
+#ifndef IRQ_PRIORITY_STEP_PULSE
+#define IRQ_PRIORITY_STEP_PULSE     0
+#endif
+#ifndef IRQ_PRIORITY_SPINDLE_PULSE
+#define IRQ_PRIORITY_SPINDLE_PULSE  16
+#endif
+#ifndef IRQ_PRIORITY_STEPPER
+#define IRQ_PRIORITY_STEPPER        32
+#endif
+#ifndef IRQ_PRIORITY_PPI
+#define IRQ_PRIORITY_PPI            48
+#endif
+#ifndef IRQ_PRIORITY_DEBOUNCE
+#define IRQ_PRIORITY_DEBOUNCE       64
+#endif
+#ifndef IRQ_PRIORITY_LIMITS
+#define IRQ_PRIORITY_LIMITS         128
+#endif
+#ifndef IRQ_PRIORITY_CONTROL
+#define IRQ_PRIORITY_CONTROL        128
+#endif
+#ifndef IRQ_PRIORITY_SERIAL
+#define IRQ_PRIORITY_SERIAL         0
+#endif
+#ifndef IRQ_PRIORITY_SYSTICK
+#define IRQ_PRIORITY_SYSTICK        32
+#endif
+
 #ifndef IOPORTS_ENABLE
 #define IOPORTS_ENABLE 0
 #endif
@@ -206,6 +248,24 @@
 #include "plasma/thc.h"
 #endif
 
+#if PLASMA_ADC_ENABLE
+#if !PLASMA_ENABLE
+#error "PLASMA_ADC_ENABLE requires PLASMA_ENABLE!"
+#endif
+#ifndef PLASMA_ADC_CHANNEL
+#define PLASMA_ADC_CHANNEL      1  // ADC1 channel for arc voltage input, channel 1 is pin 24 (A10).
+#endif
+#ifndef PLASMA_ADC_DMA_CHANNEL
+#define PLASMA_ADC_DMA_CHANNEL  15 // DMA channel for transferring samples to the ring buffer.
+#endif
+#ifndef PLASMA_ADC_BUFFER_SIZE
+#define PLASMA_ADC_BUFFER_SIZE  256 // Must be a power of 2.
+#endif
+#ifndef PLASMA_THC_RATE
+#define PLASMA_THC_RATE         2000 // THC control loop rate in Hz.
+#endif
+#endif
+
 #if ODOMETER_ENABLE
 #include "odometer/odometer.h"
 #endif
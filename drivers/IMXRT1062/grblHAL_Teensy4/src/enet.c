@@ -39,6 +39,17 @@
 #include "networking/TCPStream.h"
 #include "networking/WsStream.h"
 
+#ifndef ENET_POLL_INTERVAL_US
+#define ENET_POLL_INTERVAL_US 500 // Min. time between RX ring polls, bounds foreground time spent on network floods
+#endif
+
+typedef struct {
+    uint32_t polls;
+    uint32_t poll_time_max;         // Longest RX poll, in microseconds
+    uint32_t poll_time_total;       // in microseconds
+} enet_stats_t;
+
+static enet_stats_t stats = {0};
 static volatile bool linkUp = false;
 static char IPAddress[IP4ADDR_STRLEN_MAX];
 static network_services_t services = {0};
@@ -53,6 +64,15 @@ static void reportIP (void)
     hal.stream.write("[IP:");
     hal.stream.write(IPAddress);
     hal.stream.write("]" ASCII_EOL);
+
+    // Frames dropped by the MAC because the RX ring was full or the FIFO overflowed.
+    hal.stream.write("[NETSTAT:");
+    hal.stream.write(uitoa(ENET_IEEE_R_DROP + ENET_IEEE_R_MACERR));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats.poll_time_max));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats.polls ? stats.poll_time_total / stats.polls : 0));
+    hal.stream.write("]" ASCII_EOL);
 }
 
 static void link_status_callback (struct netif *netif)
@@ -88,10 +108,23 @@ static void netif_status_callback (struct netif *netif)
 
 void grbl_enet_poll (void)
 {
-    static uint32_t last_ms0, last_ms1;
-    uint32_t ms;
+    static uint32_t last_ms0, last_ms1, last_us;
+    uint32_t ms, us = micros();
 
-    enet_proc_input();
+    // Process received frames at a bounded rate, frames arriving faster than the RX ring is
+    // drained are dropped by the MAC instead of stealing time from the foreground process.
+    if(us - last_us >= ENET_POLL_INTERVAL_US) {
+
+        last_us = us;
+
+        enet_proc_input();
+
+        us = micros() - us;
+        stats.polls++;
+        stats.poll_time_total += us;
+        if(us > stats.poll_time_max)
+            stats.poll_time_max = us;
+    }
 
     ms = millis();
 
@@ -127,6 +160,8 @@ bool grbl_enet_start (void)
         else
             enet_init(NULL, NULL, NULL);
 
+        ENET_MIBC = 0; // Enable MIB counters for drop statistics
+
         netif_set_status_callback(netif_default, netif_status_callback);
         netif_set_link_callback(netif_default, link_status_callback);
 
@@ -53,6 +53,7 @@ N_AXIS has a default value of 3, edit grbl\config.h to increase.
 //#define SDCARD_ENABLE      1 // Run gcode programs from SD card, requires sdcard plugin.
 //#define KEYPAD_ENABLE      1 // I2C keypad for jogging etc., requires keypad plugin.
 //#define PLASMA_ENABLE      1 // Plasma/THC plugin. To be completed.
+//#define PLASMA_ADC_ENABLE  1 // Continuous DMA sampling of plasma arc voltage with timer driven THC control loop. Requires PLASMA_ENABLE.
 //#define PPI_ENABLE         1 // Laser PPI plugin. To be completed.
 //#define ODOMETER_ENABLE    1 // Odometer plugin. To be completed.
 //#define EEPROM_ENABLE      1 // I2C EEPROM support. Set to 1 for 24LC16(2K), 2 for larger sizes. Requires eeprom plugin.
@@ -69,6 +69,10 @@ typedef struct {
 
 static void uart_interrupt_handler (void);
 
+#ifdef ENABLE_IRQ_STATS
+static irq_stats_t irq_serial = { .name = "SERIAL", .priority = IRQ_PRIORITY_SERIAL };
+#endif
+
 static const uart_hardware_t uart1_hardware =
 {
     .port = &IMXRT_LPUART6,
@@ -185,9 +189,13 @@ void serialInit (uint32_t baud_rate)
     // Enable the transmitter, receiver and enable receiver interrupt
     NVIC_DISABLE_IRQ(UART.irq);
     attachInterruptVector(UART.irq, UART.irq_handler);
-    NVIC_SET_PRIORITY(UART.irq, 0);
+    NVIC_SET_PRIORITY(UART.irq, IRQ_PRIORITY_SERIAL);
     NVIC_ENABLE_IRQ(UART.irq);
 
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_serial);
+#endif
+
     tx_fifo_size = (UART.port->FIFO >> 4) & 0x7;
     tx_fifo_size = tx_fifo_size ? (2 << tx_fifo_size) : 1;
 
@@ -352,6 +360,8 @@ uint16_t serialTxCount(void) {
 
 static void uart_interrupt_handler (void)
 {
+    IRQ_STATS_ENTER();
+
     uint_fast16_t bptr;
     uint32_t data, ctrl = UART.port->CTRL;
 
@@ -416,4 +426,6 @@ static void uart_interrupt_handler (void)
         if (UART.port->STAT & LPUART_STAT_IDLE)
             UART.port->STAT |= LPUART_STAT_IDLE; // writing a 1 to idle should clear it. 
     }
+
+    IRQ_STATS_EXIT(&irq_serial, 0);
 }
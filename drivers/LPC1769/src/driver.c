@@ -167,6 +167,16 @@ static input_signal_t inputpin[] = {
   #endif
 };
 
+#if (STEP_OUTMODE == GPIO_MAP) || (DIRECTION_OUTMODE == GPIO_MAP)
+
+// Port SET and CLR words for an output bitmap, inverted as per settings.
+typedef struct {
+    uint32_t set;
+    uint32_t clr;
+} gpio_outmap_t;
+
+#endif
+
 #if STEP_OUTMODE == GPIO_MAP
 
     static const uint32_t c_step_outmap[8] = {
@@ -180,7 +190,7 @@ static input_signal_t inputpin[] = {
         X_STEP_BIT|Y_STEP_BIT|Z_STEP_BIT
     };
 
-    static uint32_t step_outmap[8];
+    static gpio_outmap_t step_outmap[8];
 
 #endif
 
@@ -197,7 +207,7 @@ static input_signal_t inputpin[] = {
         X_DIRECTION_BIT|Y_DIRECTION_BIT|Z_DIRECTION_BIT
     };
 
-    static uint32_t dir_outmap[8];
+    static gpio_outmap_t dir_outmap[8];
 
 #endif
 
@@ -266,7 +276,7 @@ static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 // Mapping to registers can be done by
 // 1. bitbanding. Pros: can assign pins to different ports, no RMW needed. Cons: overhead, pin changes not synchronous
 // 2. bit shift. Pros: fast, Cons: bits must be consecutive
-// 3. lookup table. Pros: signal inversions done at setup, Cons: slower than bit shift?
+// 3. lookup table. Pros: signal inversions done at setup, can assign pins in any order, no RMW needed. Cons: bits must be on the same port
 inline static __attribute__((always_inline)) void stepperSetStepOutputs (axes_signals_t step_outbits)
 {
 #if STEP_OUTMODE == GPIO_BITBAND
@@ -281,7 +291,8 @@ inline static __attribute__((always_inline)) void stepperSetStepOutputs (axes_si
     BITBAND_GPIO(B_STEP_PORT->PIN, B_STEP_PIN) = step_outbits.b;
   #endif
 #elif STEP_OUTMODE == GPIO_MAP
-    STEP_PORT->PIN = (STEP_PORT->PIN & ~STEP_MASK) | step_outmap[step_outbits.value];
+    STEP_PORT->SET = step_outmap[step_outbits.value].set;
+    STEP_PORT->CLR = step_outmap[step_outbits.value].clr;
 #else
     STEP_PORT->PIN = (STEP_PORT->PIN & ~STEP_MASK) | ((step_outbits.value << STEP_OUTMODE) ^ settings.steppers.step_invert.value);
 #endif
@@ -303,7 +314,8 @@ inline static __attribute__((always_inline)) void stepperSetDirOutputs (axes_sig
     BITBAND_GPIO(B_DIRECTION_PORT->PIN, B_DIRECTION_PIN) = dir_outbits.b;
   #endif
 #elif DIRECTION_OUTMODE == GPIO_MAP
-    DIRECTION_PORT->PIN = (DIRECTION_PORT->PIN & ~DIRECTION_MASK) | dir_outmap[dir_outbits.value];
+    DIRECTION_PORT->SET = dir_outmap[dir_outbits.value].set;
+    DIRECTION_PORT->CLR = dir_outmap[dir_outbits.value].clr;
 #else
     DIRECTION_PORT->PIN = (DIRECTION_PORT->PIN & ~DIRECTION_MASK) | ((dir_outbits.value << DIRECTION_OUTMODE) ^ settings.steppers.dir_invert.value);
 #endif
@@ -691,13 +703,17 @@ void settings_changed (settings_t *settings)
 #endif
 
 #if STEP_OUTMODE == GPIO_MAP
-    for(i = 0; i < sizeof(step_outmap) / sizeof(uint32_t); i++)
-        step_outmap[i] = c_step_outmap[i ^ settings->steppers.step_invert.value];
+    for(i = 0; i < sizeof(step_outmap) / sizeof(gpio_outmap_t); i++) {
+        step_outmap[i].set = c_step_outmap[i ^ settings->steppers.step_invert.value];
+        step_outmap[i].clr = STEP_MASK & ~step_outmap[i].set;
+    }
 #endif
 
 #if DIRECTION_OUTMODE == GPIO_MAP
-    for(i = 0; i < sizeof(dir_outmap) / sizeof(uint32_t); i++)
-        dir_outmap[i] = c_dir_outmap[i ^ settings->steppers.dir_invert.value];
+    for(i = 0; i < sizeof(dir_outmap) / sizeof(gpio_outmap_t); i++) {
+        dir_outmap[i].set = c_dir_outmap[i ^ settings->steppers.dir_invert.value];
+        dir_outmap[i].clr = DIRECTION_MASK & ~dir_outmap[i].set;
+    }
 #endif
 
     if(IOInitDone) {
@@ -1013,7 +1029,7 @@ static bool driver_setup (settings_t *settings)
 
  // Set defaults
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     settings_changed(settings);
 
@@ -1322,7 +1322,7 @@ static bool driver_setup (settings_t *settings)
     atc_init();
 #endif
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     hal.settings_changed(settings);
     hal.stepper.go_idle(true);
@@ -1525,7 +1525,7 @@ bool driver_init (void)
 #endif
 
 #if PLASMA_ENABLE
-    plasma_init();
+    plasma_init(NULL);
 #endif
 
 	my_plugin_init();
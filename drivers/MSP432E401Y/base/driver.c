@@ -92,7 +92,7 @@ static void enetStreamWriteS (const char *data)
 {
 #if TELNET_ENABLE
     if(services.telnet)
-        TCPStreamWriteS(data);
+        TCPStreamWriteAllS(data);
 #endif
 #if WEBSOCKET_ENABLE
     if(services.websocket)
@@ -1578,7 +1578,7 @@ static bool driver_setup (settings_t *settings)
 
   // Set defaults
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     settings_changed(settings);
 
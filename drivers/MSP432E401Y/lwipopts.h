@@ -50,8 +50,12 @@
 #define PHY_PHYS_ADDR      1
 //#define EEE_SUPPORT        1
 #endif
+#ifndef NUM_TX_DESCRIPTORS
 #define NUM_TX_DESCRIPTORS 8
-#define NUM_RX_DESCRIPTORS 8
+#endif
+#ifndef NUM_RX_DESCRIPTORS
+#define NUM_RX_DESCRIPTORS 16 // Room for bursts while the tcpip thread is held off by higher priority tasks
+#endif
 
 #define LWIP_DONT_PROVIDE_BYTEORDER_FUNCTIONS
 
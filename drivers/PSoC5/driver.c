@@ -158,10 +158,42 @@ static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 //        StepperTimer_Enable();
 }
 
+#if UDB_STEP_ENGINE
+
+// Loads a segment into the UDB step engine, called from stepper_driver_interrupt_handler().
+// On each StepperTimer tick the engine adds steps[] to the per axis accumulators and outputs a step pulse
+// and subtracts step_event_count when an accumulator exceeds step_event_count, as the core Bresenham does.
+// It raises Stepper_Interrupt after step_count ticks, StepperTimer interrupts are masked while it is busy.
+static bool stepperLoadSegment (stepper_t *stepper)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(stepper->new_block) {
+        DirOutput_Write(stepper->dir_outbits.value);
+        StepEngine_WriteEventCount(stepper->step_event_count);
+    }
+
+    do {
+        idx--;
+        StepEngine_WriteCounter(idx, stepper->counter[idx]);
+        StepEngine_WriteSteps(idx, stepper->steps[idx]);
+    } while(idx);
+
+    StepEngine_WriteLength(stepper->step_count);
+    StepEngine_Start();
+
+    return true;
+}
+
+#endif
+
 // Disables stepper driver interrups, called from st_go_idle()
 static void stepperGoIdle (bool clear_signals)
 {
     StepperTimer_Stop();
+#if UDB_STEP_ENGINE
+    StepEngine_Stop();
+#endif
     if(clear_signals)
         StepOutput_Write(0);
 }
@@ -368,6 +400,9 @@ static bool driver_setup (settings_t *settings)
 {
     StepPulseClock_Start();
     StepperTimer_Init();
+#if UDB_STEP_ENGINE
+    StepEngine_Init();
+#endif
     Stepper_Interrupt_SetVector(stepper_driver_isr);
     Stepper_Interrupt_SetPriority(1);
     Stepper_Interrupt_Enable();
@@ -391,7 +426,7 @@ static bool driver_setup (settings_t *settings)
     DelayTimer_Interrupt_Enable();
     DelayTimer_Start();
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     settings_changed(settings);
 
@@ -432,6 +467,9 @@ bool driver_init (void)
     hal.stepper.enable = stepperEnable;
     hal.stepper.cycles_per_tick = stepperCyclesPerTick;
     hal.stepper.pulse_start = stepperPulseStart;
+#if UDB_STEP_ENGINE
+    hal.stepper.load_segment = stepperLoadSegment;
+#endif
 
     hal.limits.enable = limitsEnable;
     hal.limits.get_state = limitsGetState;
@@ -502,6 +540,9 @@ bool driver_init (void)
 static void stepper_driver_isr (void)
 {
     StepperTimer_ReadStatusRegister(); // Clear interrupt
+#if UDB_STEP_ENGINE
+    StepEngine_ReadStatus();
+#endif
 
     hal.stepper.interrupt_callback();
 }
@@ -27,5 +27,6 @@
 #include "grbl/hal.h"
 
 #define KEYPAD_ENABLE 1 //uncomment to enable I2C keypad for jogging etc.
+#define UDB_STEP_ENGINE 0 // set to 1 to generate step pulses in the UDB step engine, requires the StepEngine component in TopDesign.
 
 #endif
\ No newline at end of file
@@ -836,6 +836,11 @@ static uint_fast16_t valueSetAtomic (volatile uint_fast16_t *ptr, uint_fast16_t
     return prev;
 }
 
+static uint32_t getCycleCount (void)
+{
+    return DWT->CYCCNT;
+}
+
 static void PIO_Mode (Pio *port, uint32_t bit, bool mode)
 {
     port->PIO_WPMR = PIO_WPMR_WPKEY(0x50494F);
@@ -1339,7 +1344,7 @@ static bool driver_setup (settings_t *settings)
 
  // Set defaults
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     settings_changed(settings);
 
@@ -1466,6 +1471,11 @@ bool driver_init (void)
 //    NVIC_SetPriority(SysTick_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
     NVIC_EnableIRQ(SysTick_IRQn);
 
+    // Enable the DWT cycle counter, used by hal.get_cycle_count()
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     hal.info = "SAM3X8E";
 	hal.driver_version = "201014";
 #ifdef BOARD_NAME
@@ -1549,6 +1559,9 @@ bool driver_init (void)
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
     hal.get_elapsed_ticks = millis;
+    hal.get_cycle_count = getCycleCount;
+    hal.f_cycle_count = SystemCoreClock;
+    hal.get_micros = micros;
 
 #if USB_SERIAL_CDC
     hal.execute_realtime = execute_realtime;
@@ -68,6 +68,8 @@ typedef enum
 #define SD_CLOCK_ID GCM_SERCOM4_CORE
 
 static Sercom *sd_spi = SERCOM4; // Alt mode C
+#define SD_DMAC_ID_RX SERCOM4_DMAC_ID_RX
+#define SD_DMAC_ID_TX SERCOM4_DMAC_ID_TX
 
 /*
 #define SD_SCK_PIN  8
@@ -148,6 +150,132 @@ void rcvr_spi_m (BYTE *dst)
     *dst = rcvr_spi();
 }
 
+/*-----------------------------------------------------------------------*/
+/* Keep step segment buffer filled while waiting for the card, the       */
+/* driver does not run segment preparation from a low priority interrupt */
+/*-----------------------------------------------------------------------*/
+
+static
+void sd_yield (void)
+{
+    if(hal.stepper.prep_request == NULL && (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_SAFETY_DOOR|STATE_JOG)))
+        st_prep_buffer();
+}
+
+#if SDCARD_DMA_ENABLE
+
+/*-----------------------------------------------------------------------*/
+/* Block transfers by DMA  (Platform dependent)                          */
+/*-----------------------------------------------------------------------*/
+
+#define DMA_CH_RX 0
+#define DMA_CH_TX 1
+
+static __attribute__((aligned(16))) DmacDescriptor dma_descriptor[2];
+static __attribute__((aligned(16))) DmacDescriptor dma_writeback[2];
+
+static volatile
+bool dma_busy = false;
+
+static
+BYTE dma_dummy;
+
+static
+void dma_complete (void)
+{
+    dma_busy = false;
+}
+
+static
+void (*dma_on_complete)(void) = dma_complete;
+
+static
+void DMAC_IRQHandler (void)
+{
+    DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_RX);
+
+    if(DMAC->CHINTFLAG.bit.TCMPL) {
+        DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+        dma_on_complete();
+    }
+}
+
+static
+void dma_init (void)
+{
+    PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+    PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+    DMAC->CTRL.reg &= ~DMAC_CTRL_DMAENABLE;
+    DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+    while(DMAC->CTRL.reg & DMAC_CTRL_SWRST);
+
+    DMAC->BASEADDR.reg = (uint32_t)dma_descriptor;
+    DMAC->WRBADDR.reg = (uint32_t)dma_writeback;
+    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE|DMAC_CTRL_LVLEN(0xF);
+
+    DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_RX);
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while(DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(1)|DMAC_CHCTRLB_TRIGSRC(SD_DMAC_ID_RX)|DMAC_CHCTRLB_TRIGACT_BEAT;
+    DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+
+    DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_TX);
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while(DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0)|DMAC_CHCTRLB_TRIGSRC(SD_DMAC_ID_TX)|DMAC_CHCTRLB_TRIGACT_BEAT;
+
+    IRQRegister(DMAC_IRQn, DMAC_IRQHandler);
+    NVIC_SetPriority(DMAC_IRQn, 3);
+    NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+/* Starts a full duplex transfer, on_complete is called from interrupt   */
+/* context when the last byte is received. rx may be NULL to discard the */
+/* received data, tx NULL to transmit 0xFF.                              */
+static
+void spi_dma_transfer (BYTE *rx, const BYTE *tx, UINT len, void (*on_complete)(void))
+{
+    dma_dummy = 0xFF;
+    dma_on_complete = on_complete;
+
+    while(sd_spi->SPI.INTFLAG.bit.RXC)  /* Drop any stale received byte */
+        (void)sd_spi->SPI.DATA.reg;
+
+    /* Incrementing addresses are set to the end of the block */
+    dma_descriptor[DMA_CH_RX].BTCTRL.reg = DMAC_BTCTRL_VALID|DMAC_BTCTRL_BEATSIZE_BYTE|(rx ? DMAC_BTCTRL_DSTINC : 0);
+    dma_descriptor[DMA_CH_RX].BTCNT.reg = len;
+    dma_descriptor[DMA_CH_RX].SRCADDR.reg = (uint32_t)&sd_spi->SPI.DATA.reg;
+    dma_descriptor[DMA_CH_RX].DSTADDR.reg = rx ? (uint32_t)(rx + len) : (uint32_t)&dma_dummy;
+    dma_descriptor[DMA_CH_RX].DESCADDR.reg = 0;
+
+    dma_descriptor[DMA_CH_TX].BTCTRL.reg = DMAC_BTCTRL_VALID|DMAC_BTCTRL_BEATSIZE_BYTE|(tx ? DMAC_BTCTRL_SRCINC : 0);
+    dma_descriptor[DMA_CH_TX].BTCNT.reg = len;
+    dma_descriptor[DMA_CH_TX].SRCADDR.reg = tx ? (uint32_t)(tx + len) : (uint32_t)&dma_dummy;
+    dma_descriptor[DMA_CH_TX].DSTADDR.reg = (uint32_t)&sd_spi->SPI.DATA.reg;
+    dma_descriptor[DMA_CH_TX].DESCADDR.reg = 0;
+
+    DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_RX); /* RX enabled first so no byte is missed */
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+    DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_TX);
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+}
+
+/* Transfers a block by DMA, rx or tx may be NULL. Segment preparation   */
+/* continues in the foreground until the transfer is completed.          */
+static
+void xfer_spi_dma (BYTE *rx, const BYTE *tx, UINT len)
+{
+    dma_busy = true;
+
+    spi_dma_transfer(rx, tx, len, dma_complete);
+
+    while(dma_busy)
+        sd_yield();
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Wait for card ready                                                   */
 /*-----------------------------------------------------------------------*/
@@ -160,9 +288,8 @@ BYTE wait_ready (void)
 
     Timer2 = 50;    /* Wait for ready in timeout of 500ms */
     rcvr_spi();
-    do
-        res = rcvr_spi();
-    while ((res != 0xFF) && Timer2);
+    while ((res = rcvr_spi()) != 0xFF && Timer2)
+        sd_yield();
 
     return res;
 }
@@ -244,7 +371,12 @@ void power_on (void)
     sd_spi->SPI.BAUD.reg = SystemCoreClock / (2 * 400000) - 1;
 
     sd_spi->SPI.CTRLA.bit.ENABLE = 1;
-    while(sd_spi->SPI.SYNCBUSY.bit.ENABLE)
+    while(sd_spi->SPI.SYNCBUSY.bit.ENABLE);
+
+#if SDCARD_DMA_ENABLE
+    if(!init)
+        dma_init();
+#endif
 
     init = true;
     PowerFlag = 1;
@@ -297,10 +429,16 @@ BOOL rcvr_datablock (
 
     Timer1 = 100;
     do {                            /* Wait for data packet in timeout of 100ms */
-        token = rcvr_spi();
+        if((token = rcvr_spi()) == 0xFF)
+            sd_yield();
     } while ((token == 0xFF) && Timer1);
     if(token != 0xFE) return FALSE;    /* If not valid data token, retutn with error */
 
+#if SDCARD_DMA_ENABLE
+    if(btr == 512)                  /* Sectors are received by DMA, */
+        xfer_spi_dma(buff, NULL, btr);
+    else                            /* short CSD/CID blocks polled */
+#endif
     do {                            /* Receive the data block into buffer */
         rcvr_spi_m(buff++);
         rcvr_spi_m(buff++);
@@ -332,10 +470,14 @@ BOOL xmit_datablock (
     xmit_spi(token);                    /* Xmit data token */
     if (token != 0xFD) {    /* Is data token */
         wc = 0;
+#if SDCARD_DMA_ENABLE
+        xfer_spi_dma(NULL, buff, 512);  /* Xmit the 512 byte data block to MMC by DMA */
+#else
         do {                            /* Xmit the 512 byte data block to MMC */
             xmit_spi(*buff++);
             xmit_spi(*buff++);
         } while (--wc);
+#endif
         xmit_spi(0xFF);                    /* CRC (Dummy) */
         xmit_spi(0xFF);
         resp = rcvr_spi();                /* Reveive data response */
@@ -62,6 +62,9 @@
 #ifndef TRINAMIC_DEV
 #define TRINAMIC_DEV        0
 #endif
+#ifndef SDCARD_DMA_ENABLE
+#define SDCARD_DMA_ENABLE   0 // SD card sector transfers by SPI DMA, only used if SDCARD_ENABLE is set
+#endif
 
 // clock definitions
 
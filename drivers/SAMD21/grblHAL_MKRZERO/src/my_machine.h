@@ -29,6 +29,7 @@
 #define USB_SERIAL_CDC       1 // Comment out to use UART communication.
 //#define IOEXPAND_ENABLE    1 // Use I2C IO expander for some output signals.
 //#define SDCARD_ENABLE      1 // Run gcode programs from SD card, requires sdcard plugin.
+//#define SDCARD_DMA_ENABLE  1 // SD card sector transfers by SPI DMA, uses DMAC channels 0 and 1.
 //#define TRINAMIC_ENABLE    1 // Trinamic TMC2130 stepper driver support. NOTE: work in progress.
 //#define TRINAMIC_I2C       1 // Trinamic I2C - SPI bridge interface.
 //#define TRINAMIC_DEV       1 // Development mode, adds a few M-codes to aid debugging. Do not enable in production code//#define KEYPAD_ENABLE      1 // I2C keypad for jogging etc., requires keypad plugin.
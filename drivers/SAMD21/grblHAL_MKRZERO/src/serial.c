@@ -78,6 +78,20 @@ static stream_rx_buffer_t rxbuffer = {0}, rxbackup;
 
 static stream_rx_buffer_t txbuffer = {0};
 
+#ifdef ENABLE_MEMORY_REPORT
+
+static on_report_memory_ptr on_report_memory = NULL;
+
+static void serialReportMemory (void)
+{
+    report_memory_usage("SERIAL", sizeof(rxbuffer) + sizeof(txbuffer) + sizeof(rxbackup));
+
+    if(on_report_memory)
+        on_report_memory();
+}
+
+#endif
+
 static void SERIAL_IRQHandler (void);
 
 void initSerClockNVIC (Sercom *sercom)
@@ -200,6 +214,11 @@ void serialInit (void)
     NVIC_SetPriority(SERCOM5_IRQn, 1);
 
     //  __enable_interrupts();
+
+#ifdef ENABLE_MEMORY_REPORT
+    on_report_memory = grbl.on_report_memory;
+    grbl.on_report_memory = serialReportMemory;
+#endif
 }
 
 //
@@ -908,7 +908,7 @@ static bool driver_setup (settings_t *settings)
   #endif
 #endif
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     hal.settings_changed(settings);
     hal.spindle.set_state((spindle_state_t){0}, 0.0f);
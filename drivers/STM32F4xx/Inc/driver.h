@@ -35,6 +35,7 @@
 #include "grbl/hal.h"
 #include "grbl/grbl.h"
 #include "grbl/nuts_bolts.h"
+#include "grbl/irq_stats.h"
 
 #ifndef OVERRIDE_MY_MACHINE
 #include "my_machine.h"
@@ -82,6 +83,18 @@
 #ifndef TRINAMIC_DEV
 #define TRINAMIC_DEV        0
 #endif
+#ifndef PREP_PENDSV_ENABLE
+#define PREP_PENDSV_ENABLE  0 // Run step segment preparation from the lowest priority PendSV interrupt
+#endif
+#ifndef STEP_DMA_ENABLE
+#define STEP_DMA_ENABLE     0 // Output step pulses by timer triggered DMA to the step port BSRR register
+#endif
+#ifndef SERIAL_DMA_ENABLE
+#define SERIAL_DMA_ENABLE   0 // UART receive and transmit by DMA, only used if USB_SERIAL_CDC is disabled
+#endif
+#ifndef SDCARD_DMA_ENABLE
+#define SDCARD_DMA_ENABLE   0 // SD card sector transfers by SPI DMA, only used if SDCARD_ENABLE is set
+#endif
 
 #define CNC_BOOSTERPACK     0
 
@@ -139,6 +152,12 @@
 #define PPI_TIMER_IRQn              timerINT(PPI_TIMER_N)
 #define PPI_TIMER_IRQHandler        timerHANDLER(PPI_TIMER_N)
 
+// Step pulse DMA, GPIO ports are only accessible by DMA2 so the TIM8 update request is used.
+#define STEP_DMA_TIMER_N            8
+#define STEP_DMA_TIMER              timer(STEP_DMA_TIMER_N)
+#define STEP_DMA_STREAM             DMA2_Stream1
+#define STEP_DMA_CHANNEL            7
+
 #ifdef BOARD_CNC_BOOSTERPACK
   #if N_AXIS > 3
     #error Max number of axes is 3!
@@ -166,6 +185,35 @@
 #define STEP_PULSE_LATENCY 1.0f // microseconds
 #endif
 
+// Interrupt priorities, 0 - 15 where lower values preempt higher. The step pulse timer ends the step pulses
+// and should have the highest priority, followed by the step timer for low step timing jitter. EXTI lines shared
+// by limit and control inputs get the higher priority of the two. Enable ENABLE_IRQ_STATS in grbl/config.h and
+// use the $IRQ command to check the entry latencies and execution times when changing these.
+#ifndef IRQ_PRIORITY_STEP_PULSE
+#define IRQ_PRIORITY_STEP_PULSE 0
+#endif
+#ifndef IRQ_PRIORITY_STEPPER
+#define IRQ_PRIORITY_STEPPER    1
+#endif
+#ifndef IRQ_PRIORITY_LIMITS
+#define IRQ_PRIORITY_LIMITS     2
+#endif
+#ifndef IRQ_PRIORITY_CONTROL
+#define IRQ_PRIORITY_CONTROL    2
+#endif
+#ifndef IRQ_PRIORITY_DEBOUNCE
+#define IRQ_PRIORITY_DEBOUNCE   2
+#endif
+#ifndef IRQ_PRIORITY_SERIAL
+#define IRQ_PRIORITY_SERIAL     0
+#endif
+#ifndef IRQ_PRIORITY_USB
+#define IRQ_PRIORITY_USB        0
+#endif
+#ifndef IRQ_PRIORITY_SYSTICK
+#define IRQ_PRIORITY_SYSTICK    0
+#endif
+
 // End configuration
 
 #if EEPROM_ENABLE == 0
@@ -199,6 +247,16 @@
 #error Keypad plugin not supported!
 #endif
 
+#if STEP_DMA_ENABLE
+  #ifndef TIM8
+    #error Step pulse DMA requires TIM8, not available on this MCU!
+  #endif
+  #if STEP_OUTMODE == GPIO_BITBAND
+    #error Step pulse DMA requires all step pins on the same port!
+  #endif
+#endif
+
+
 #if SDCARD_ENABLE && !defined(SD_CS_PORT)
 #error SD card plugin not supported!
 #endif
@@ -25,6 +25,32 @@
 #include "driver.h"
 #include "grbl/plugins.h"
 
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE 8 // number of queued transfers, must be a power of 2
+#endif
+
+typedef struct i2c_transfer i2c_transfer_t;
+
+typedef void (*i2c_complete_ptr)(i2c_transfer_t *transfer, bool ok);
+
+// Queued transfer, must be kept in scope until done.
+// on_complete is called from interrupt context, it may queue a new transfer.
+struct i2c_transfer {
+    uint8_t address;                // 7-bit device address
+    uint8_t reg_bytes;              // 0 - 2, number of register/word address bytes sent before data
+    uint16_t reg;                   // register/word address
+    bool read;
+    uint8_t *data;
+    uint16_t count;
+    volatile bool done;
+    volatile bool ok;
+    i2c_complete_ptr on_complete;   // optional
+    void *context;                  // optional, free for use by caller
+};
+
+bool i2c_enqueue (i2c_transfer_t *transfer);
+bool i2c_transfer (i2c_transfer_t *transfer);
+
 #if TRINAMIC_ENABLE && TRINAMIC_I2C
 
 #include "trinamic\trinamic2130.h"
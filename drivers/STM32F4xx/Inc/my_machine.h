@@ -43,5 +43,11 @@
 //#define TRINAMIC_DEV         1 // Development mode, adds a few M-codes to aid debugging. Do not enable in production code.
 //#define EEPROM_ENABLE        1 // I2C EEPROM support. Set to 1 for 24LC16(2K), 2 for larger sizes. Requires eeprom plugin.
 //#define EEPROM_IS_FRAM       1 // Uncomment when EEPROM is enabled and chip is FRAM, this to remove write delay.
+//#define PREP_PENDSV_ENABLE   1 // Step segment preparation from a low priority interrupt, avoids segment buffer starvation on long foreground tasks.
+//#define STEP_DMA_ENABLE      1 // Step pulses output by DMA, no step pulse end interrupts. F407 and F446 only, uses TIM8.
+                                 // Enable ENABLE_STEP_BURST in grbl/config.h to output several step pulses per stepper interrupt.
+//#define SERIAL_DMA_ENABLE    1 // UART receive and transmit by DMA, reduces interrupt load at high baud rates.
+//#define SDCARD_DMA_ENABLE    1 // SD card sector transfers by SPI DMA, uses DMA2 streams 0 and 3.
+
 
 /**/
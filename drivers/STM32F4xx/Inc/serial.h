@@ -29,6 +29,7 @@
 
 void serialInit(void);
 int16_t serialGetC(void);
+uint16_t serialReadBlock (char *data, uint16_t size);
 void serialWriteS(const char *s);
 uint16_t serialRxFree(void);
 void serialRxFlush(void);
@@ -28,4 +28,10 @@ void spi_disable (void);
 uint8_t spi_get_byte (void);
 void spi_put_byte (uint8_t byte);
 
+#if SDCARD_DMA_ENABLE
+typedef void (*spi_dma_complete_ptr)(void);
+
+void spi_dma_transfer (uint8_t *rx, const uint8_t *tx, uint16_t length, spi_dma_complete_ptr on_complete);
+#endif
+
 #endif
@@ -26,6 +26,7 @@
 
 void usbInit (void);
 int16_t usbGetC(void);
+uint16_t usbReadBlock (char *data, uint16_t size);
 void usbWriteS(const char *s);
 uint16_t usbRxFree (void);
 void usbRxFlush(void);
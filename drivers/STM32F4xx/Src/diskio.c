@@ -94,6 +94,44 @@ void rcvr_spi_m (BYTE *dst)
     *dst = rcvr_spi();
 }
 
+/*-----------------------------------------------------------------------*/
+/* Keep step segment buffer filled while waiting for the card, not       */
+/* needed if segment preparation is run from a low priority interrupt.   */
+/*-----------------------------------------------------------------------*/
+
+static
+void sd_yield (void)
+{
+    if(hal.stepper.prep_request == NULL && (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_SAFETY_DOOR|STATE_JOG)))
+        st_prep_buffer();
+}
+
+#if SDCARD_DMA_ENABLE
+
+static volatile
+bool dma_busy = false;
+
+static
+void dma_complete (void)
+{
+    dma_busy = false;
+}
+
+/* Transfers a block by DMA, rx or tx may be NULL. Segment preparation   */
+/* continues in the foreground until the transfer is completed.          */
+static
+void xfer_spi_dma (BYTE *rx, const BYTE *tx, UINT len)
+{
+    dma_busy = true;
+
+    spi_dma_transfer(rx, tx, len, dma_complete);
+
+    while(dma_busy)
+        sd_yield();
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Wait for card ready                                                   */
 /*-----------------------------------------------------------------------*/
@@ -106,9 +144,8 @@ BYTE wait_ready (void)
 
     Timer2 = 50;    /* Wait for ready in timeout of 500ms */
     rcvr_spi();
-    do
-        res = rcvr_spi();
-    while ((res != 0xFF) && Timer2);
+    while ((res = rcvr_spi()) != 0xFF && Timer2)
+        sd_yield();
 
     return res;
 }
@@ -180,10 +217,16 @@ BOOL rcvr_datablock (
 
     Timer1 = 100;
     do {                            /* Wait for data packet in timeout of 100ms */
-        token = rcvr_spi();
+        if((token = rcvr_spi()) == 0xFF)
+            sd_yield();
     } while ((token == 0xFF) && Timer1);
     if(token != 0xFE) return FALSE;    /* If not valid data token, retutn with error */
 
+#if SDCARD_DMA_ENABLE
+    if(btr == 512)                  /* Sectors are received by DMA, */
+        xfer_spi_dma(buff, NULL, btr);
+    else                            /* short CSD/CID blocks polled */
+#endif
     do {                            /* Receive the data block into buffer */
         rcvr_spi_m(buff++);
         rcvr_spi_m(buff++);
@@ -215,10 +258,14 @@ BOOL xmit_datablock (
     xmit_spi(token);                    /* Xmit data token */
     if (token != 0xFD) {    /* Is data token */
         wc = 0;
+#if SDCARD_DMA_ENABLE
+        xfer_spi_dma(NULL, buff, 512);  /* Xmit the 512 byte data block to MMC by DMA */
+#else
         do {                            /* Xmit the 512 byte data block to MMC */
             xmit_spi(*buff++);
             xmit_spi(*buff++);
         } while (--wc);
+#endif
         xmit_spi(0xFF);                    /* CRC (Dummy) */
         xmit_spi(0xFF);
         resp = rcvr_spi();                /* Reveive data response */
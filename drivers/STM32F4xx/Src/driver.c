@@ -68,6 +68,13 @@ static bool pwmEnabled = false, IOInitDone = false;
 // Inverts the probe pin state depending on user settings and probing cycle mode.
 static bool probe_invert;
 static axes_signals_t next_step_outbits;
+#if STEP_DMA_ENABLE
+// Step pulse DMA data, the buffer holds the step port BSRR words for the start and end of each step pulse in a tick.
+static struct {
+    uint32_t off;
+    uint32_t buffer[STEP_BURST_MAX * 2];
+} step_dma;
+#endif
 static spindle_pwm_t spindle_pwm;
 static delay_t delay = { .ms = 1, .callback = NULL }; // NOTE: initial ms set to 1 for "resetting" systick timer on startup
 static status_code_t (*on_unknown_sys_command)(uint_fast16_t state, char *line, char *lcline);
@@ -114,7 +121,7 @@ static const uint32_t c_step_outmap[] = {
 	B_STEP_BIT,
 	B_STEP_BIT | X_STEP_BIT,
 	B_STEP_BIT | Y_STEP_BIT,
-	B_STEP_BIT | X_STEP_BIT,
+	B_STEP_BIT | Y_STEP_BIT | X_STEP_BIT,
 	B_STEP_BIT | Z_STEP_BIT,
 	B_STEP_BIT | Z_STEP_BIT | X_STEP_BIT,
 	B_STEP_BIT | Z_STEP_BIT | Y_STEP_BIT,
@@ -130,7 +137,7 @@ static const uint32_t c_step_outmap[] = {
 #endif
 };
 
-static uint32_t step_outmap[sizeof(c_step_outmap) / sizeof(uint32_t)];
+static uint32_t step_outmap[sizeof(c_step_outmap) / sizeof(uint32_t)]; // BSRR words, inverted as per settings
 
 #elif STEP_OUTMODE == GPIO_BITBAND
   #ifndef X_STEP_PORT
@@ -169,7 +176,7 @@ static const uint32_t c_dir_outmap[] = {
 	B_DIRECTION_BIT,
 	B_DIRECTION_BIT | X_DIRECTION_BIT,
 	B_DIRECTION_BIT | Y_DIRECTION_BIT,
-	B_DIRECTION_BIT | X_DIRECTION_BIT,
+	B_DIRECTION_BIT | Y_DIRECTION_BIT | X_DIRECTION_BIT,
 	B_DIRECTION_BIT | Z_DIRECTION_BIT,
 	B_DIRECTION_BIT | Z_DIRECTION_BIT | X_DIRECTION_BIT,
 	B_DIRECTION_BIT | Z_DIRECTION_BIT | Y_DIRECTION_BIT,
@@ -185,7 +192,7 @@ static const uint32_t c_dir_outmap[] = {
 #endif
 };
 
-static uint32_t dir_outmap[sizeof(c_dir_outmap) / sizeof(uint32_t)];
+static uint32_t dir_outmap[sizeof(c_dir_outmap) / sizeof(uint32_t)]; // BSRR words, inverted as per settings
 
 #endif
 
@@ -212,6 +219,19 @@ static uint32_t dir_outmap[sizeof(c_dir_outmap) / sizeof(uint32_t)];
 
 #define DRIVER_IRQMASK (LIMIT_MASK|CONTROL_MASK|KEYPAD_STROBE_BIT|SPINDLE_INDEX_BIT)
 
+// Priority of the EXTI interrupt serving lines, the higher of limits and control if shared.
+#define EXTI_PRIORITY(lines) ((LIMIT_MASK & (lines)) \
+                               ? ((CONTROL_MASK & (lines)) ? min(IRQ_PRIORITY_LIMITS, IRQ_PRIORITY_CONTROL) : IRQ_PRIORITY_LIMITS) \
+                               : IRQ_PRIORITY_CONTROL)
+
+#ifdef ENABLE_IRQ_STATS
+static irq_stats_t irq_stepper = { .name = "STEPPER", .priority = IRQ_PRIORITY_STEPPER, .timed = true, .step_timing = true };
+static irq_stats_t irq_step_pulse = { .name = "PULSE", .priority = IRQ_PRIORITY_STEP_PULSE };
+static irq_stats_t irq_inputs = { .name = "INPUTS", .priority = min(IRQ_PRIORITY_LIMITS, IRQ_PRIORITY_CONTROL) };
+static irq_stats_t irq_debounce = { .name = "DEBOUNCE", .priority = IRQ_PRIORITY_DEBOUNCE };
+static irq_stats_t irq_systick = { .name = "SYSTICK", .priority = IRQ_PRIORITY_SYSTICK, .timed = true };
+#endif
+
 static void spindle_set_speed (uint_fast16_t pwm_value);
 
 static void driver_delay (uint32_t ms, void (*callback)(void))
@@ -265,6 +285,15 @@ static void stepperGoIdle (bool clear_signals)
     STEPPER_TIMER->CNT = 0;
 }
 
+#if PREP_PENDSV_ENABLE
+
+// Requests step segment preparation, executed by the PendSV handler (in stm32f4xx_it.c) calling hal.stepper.prep_callback()
+static void stepperPrepRequest (void)
+{
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+#endif
 
 // Sets up stepper driver interrupt timeout, "Normal" version
 static void stepperCyclesPerTick (uint32_t cycles_per_tick)
@@ -298,9 +327,10 @@ inline static __attribute__((always_inline)) void stepperSetStepOutputs (axes_si
     BITBAND_PERI(Y_STEP_PORT->ODR, Y_STEP_PIN) = step_outbits.y;
     BITBAND_PERI(Z_STEP_PORT->ODR, Z_STEP_PIN) = step_outbits.z;
 #elif STEP_OUTMODE == GPIO_MAP
-	STEP_PORT->ODR = (STEP_PORT->ODR & ~STEP_MASK) | step_outmap[step_outbits.value];
+    STEP_PORT->BSRR = step_outmap[step_outbits.value];
 #else
-    STEP_PORT->ODR = (STEP_PORT->ODR & ~STEP_MASK) | ((step_outbits.mask ^ settings.steppers.step_invert.mask) << STEP_OUTMODE);
+    uint32_t pins = ((step_outbits.mask ^ settings.steppers.step_invert.mask) << STEP_OUTMODE) & STEP_MASK;
+    STEP_PORT->BSRR = pins | ((STEP_MASK & ~pins) << 16);
 #endif
 }
 
@@ -314,12 +344,58 @@ inline static __attribute__((always_inline)) void stepperSetDirOutputs (axes_sig
     BITBAND_PERI(Y_DIRECTION_PORT->ODR, Y_DIRECTION_PIN) = dir_outbits.y;
     BITBAND_PERI(Z_DIRECTION_PORT->ODR, Z_DIRECTION_PIN) = dir_outbits.z;
 #elif DIRECTION_OUTMODE == GPIO_MAP
-    DIRECTION_PORT->ODR = (DIRECTION_PORT->ODR & ~DIRECTION_MASK) | dir_outmap[dir_outbits.value];
+    DIRECTION_PORT->BSRR = dir_outmap[dir_outbits.value];
 #else
-    DIRECTION_PORT->ODR = (DIRECTION_PORT->ODR & ~DIRECTION_MASK) | ((dir_outbits.mask ^ settings.steppers.dir_invert.mask) << DIRECTION_OUTMODE);
+    uint32_t pins = ((dir_outbits.mask ^ settings.steppers.dir_invert.mask) << DIRECTION_OUTMODE) & DIRECTION_MASK;
+    DIRECTION_PORT->BSRR = pins | ((DIRECTION_MASK & ~pins) << 16);
 #endif
 }
 
+#if STEP_DMA_ENABLE
+
+// Returns the step port BSRR word for setting the step pins to the step_outbits state.
+inline static __attribute__((always_inline)) uint32_t stepperStepBSRR (axes_signals_t step_outbits)
+{
+#if STEP_OUTMODE == GPIO_MAP
+    return step_outmap[step_outbits.value];
+#else
+    uint32_t pins = ((step_outbits.mask ^ settings.steppers.step_invert.mask) << STEP_OUTMODE) & STEP_MASK;
+
+    return pins | ((STEP_MASK & ~pins) << 16);
+#endif
+}
+
+// Starts the step pulse(s) of a stepper tick, more than one when in burst mode.
+// The first pulse is started immediately, the following BSRR words are written to the step port
+// by DMA at pulse length intervals, triggered by the step DMA timer update request.
+static void stepperStartStepDMA (stepper_t *stepper)
+{
+    uint_fast8_t idx = 0, words = 0;
+
+    if(stepper->burst_steps) do {
+        step_dma.buffer[words++] = stepperStepBSRR(stepper->step_burst[idx]);
+        step_dma.buffer[words++] = step_dma.off;
+    } while(++idx < stepper->burst_steps);
+    else {
+        step_dma.buffer[words++] = stepperStepBSRR(stepper->step_outbits);
+        step_dma.buffer[words++] = step_dma.off;
+    }
+
+    STEP_DMA_TIMER->DIER &= ~TIM_DIER_UDE;  // Drop any pending request
+    STEP_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+    while(STEP_DMA_STREAM->CR & DMA_SxCR_EN);
+    DMA2->LIFCR = DMA_LIFCR_CTCIF1|DMA_LIFCR_CHTIF1|DMA_LIFCR_CTEIF1|DMA_LIFCR_CDMEIF1|DMA_LIFCR_CFEIF1;
+    STEP_DMA_STREAM->M0AR = (uint32_t)&step_dma.buffer[1];
+    STEP_DMA_STREAM->NDTR = words - 1;
+
+    STEP_PORT->BSRR = step_dma.buffer[0];   // Begin first step pulse
+    STEP_DMA_TIMER->EGR = TIM_EGR_UG;       // and restart pulse timing, no DMA request as URS is set
+    STEP_DMA_STREAM->CR |= DMA_SxCR_EN;
+    STEP_DMA_TIMER->DIER |= TIM_DIER_UDE;
+}
+
+#endif
+
 // Sets stepper direction and pulse pins and starts a step pulse.
 static void stepperPulseStart (stepper_t *stepper)
 {
@@ -336,9 +412,13 @@ static void stepperPulseStart (stepper_t *stepper)
         stepperSetDirOutputs(stepper->dir_outbits);
 
     if(stepper->step_outbits.value) {
+#if STEP_DMA_ENABLE
+        stepperStartStepDMA(stepper);
+#else
         stepperSetStepOutputs(stepper->step_outbits);
         PULSE_TIMER->EGR = TIM_EGR_UG;
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
+#endif
     }
 }
 
@@ -407,9 +487,13 @@ static void stepperPulseStartSynchronized (stepper_t *stepper)
     }
 
     if(stepper->step_outbits.value) {
+#if STEP_DMA_ENABLE
+        stepperStartStepDMA(stepper);
+#else
         stepperSetStepOutputs(stepper->step_outbits);
         PULSE_TIMER->EGR = TIM_EGR_UG;
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
+#endif
     }
 
     if(spindle_tracker.segment_id != stepper->exec_segment->id) {
@@ -825,6 +909,38 @@ static uint32_t getElapsedTicks (void)
     return uwTick;
 }
 
+static uint32_t getCycleCount (void)
+{
+    return DWT->CYCCNT;
+}
+
+// Returns the elapsed milliseconds times 1000 plus the microseconds since the last SysTick interrupt.
+static uint32_t getMicros (void)
+{
+    uint32_t ms, count;
+
+    do {
+        ms = uwTick;
+        count = SysTick->VAL;
+    } while(ms != uwTick); // Read again if the SysTick interrupt was served in between.
+
+    return ms * 1000UL + (SysTick->LOAD - count) / (SystemCoreClock / 1000000UL);
+}
+
+#ifdef ENABLE_MEMORY_REPORT
+
+// Returns the number of bytes between the top of the heap and the stack pointer.
+static uint32_t getFreeMem (void)
+{
+    extern void *_sbrk (int incr);
+
+    char top;
+
+    return &top - (char *)_sbrk(0);
+}
+
+#endif
+
 // Configures peripherals when settings are initialized or changed
 void settings_changed (settings_t *settings)
 {
@@ -843,6 +959,7 @@ void settings_changed (settings_t *settings)
     do {
         i--;
         step_outmap[i] = c_step_outmap[i ^ settings->steppers.step_invert.value];
+        step_outmap[i] |= (STEP_MASK & ~step_outmap[i]) << 16; // Reset bits for the pins not set
     } while(i);
 #endif
 
@@ -851,6 +968,7 @@ void settings_changed (settings_t *settings)
     do {
         i--;
         dir_outmap[i] = c_dir_outmap[i ^ settings->steppers.dir_invert.value];
+        dir_outmap[i] |= (DIRECTION_MASK & ~dir_outmap[i]) << 16; // Reset bits for the pins not set
     } while(i);
 #endif
 
@@ -956,6 +1074,12 @@ void settings_changed (settings_t *settings)
         PULSE_TIMER->ARR = pulse_length;
         PULSE_TIMER->EGR = TIM_EGR_UG;
 
+#if STEP_DMA_ENABLE
+        step_dma.off = stepperStepBSRR((axes_signals_t){0});
+        STEP_DMA_TIMER->ARR = (uint32_t)(10.0f * settings->steppers.pulse_microseconds) - 1;
+        STEP_DMA_TIMER->EGR = TIM_EGR_UG;
+#endif
+
         /*************************
          *  Control pins config  *
          *************************/
@@ -1103,31 +1227,31 @@ void settings_changed (settings_t *settings)
         __HAL_GPIO_EXTI_CLEAR_IT(DRIVER_IRQMASK);
 
 #if DRIVER_IRQMASK & (1<<0)
-        HAL_NVIC_SetPriority(EXTI0_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI0_IRQn, EXTI_PRIORITY(1<<0), 0);
         HAL_NVIC_EnableIRQ(EXTI0_IRQn);
 #endif
 #if DRIVER_IRQMASK & (1<<1)
-        HAL_NVIC_SetPriority(EXTI1_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI1_IRQn, EXTI_PRIORITY(1<<1), 0);
         HAL_NVIC_EnableIRQ(EXTI1_IRQn);
 #endif
 #if DRIVER_IRQMASK & (1<<2)
-        HAL_NVIC_SetPriority(EXTI2_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI2_IRQn, EXTI_PRIORITY(1<<2), 0);
         HAL_NVIC_EnableIRQ(EXTI2_IRQn);
 #endif
 #if DRIVER_IRQMASK & (1<<3)
-        HAL_NVIC_SetPriority(EXTI3_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI3_IRQn, EXTI_PRIORITY(1<<3), 0);
         HAL_NVIC_EnableIRQ(EXTI3_IRQn);
 #endif
 #if DRIVER_IRQMASK & (1<<4)
-        HAL_NVIC_SetPriority(EXTI4_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI4_IRQn, EXTI_PRIORITY(1<<4), 0);
         HAL_NVIC_EnableIRQ(EXTI4_IRQn);
 #endif
 #if DRIVER_IRQMASK & 0x03F0
-        HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI9_5_IRQn, EXTI_PRIORITY(0x03F0), 0);
         HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
 #endif
 #if DRIVER_IRQMASK & 0xFE00
-        HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0, 2);
+        HAL_NVIC_SetPriority(EXTI15_10_IRQn, EXTI_PRIORITY(0xFE00), 0);
         HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
 #endif
     }
@@ -1149,12 +1273,21 @@ static bool driver_setup (settings_t *settings)
 {
     //    Interrupt_disableSleepOnIsrExit();
 
+    // Enable the DWT cycle counter, used by hal.get_cycle_count()
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     __HAL_RCC_TIM1_CLK_ENABLE();
     __HAL_RCC_TIM2_CLK_ENABLE();
     __HAL_RCC_TIM3_CLK_ENABLE();
     __HAL_RCC_TIM4_CLK_ENABLE();
     __HAL_RCC_TIM5_CLK_ENABLE();
     __HAL_RCC_TIM9_CLK_ENABLE();
+#if STEP_DMA_ENABLE
+    __HAL_RCC_TIM8_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+#endif
 
     GPIO_InitTypeDef GPIO_Init = {0};
 
@@ -1208,9 +1341,13 @@ static bool driver_setup (settings_t *settings)
     STEPPER_TIMER->CNT = 0;
     STEPPER_TIMER->DIER |= TIM_DIER_UIE;
 
-    NVIC_SetPriority(STEPPER_TIMER_IRQn, 1);
+    NVIC_SetPriority(STEPPER_TIMER_IRQn, IRQ_PRIORITY_STEPPER);
     NVIC_EnableIRQ(STEPPER_TIMER_IRQn);
 
+#if PREP_PENDSV_ENABLE
+    NVIC_SetPriority(PendSV_IRQn, (1UL << __NVIC_PRIO_BITS) - 1); // Lowest priority
+#endif
+
  // Single-shot 100 ns per tick
     PULSE_TIMER->CR1 |= TIM_CR1_OPM|TIM_CR1_DIR|TIM_CR1_CKD_1|TIM_CR1_ARPE|TIM_CR1_URS;
     PULSE_TIMER->PSC = hal.f_step_timer / 10000000UL - 1;
@@ -1218,13 +1355,21 @@ static bool driver_setup (settings_t *settings)
     PULSE_TIMER->CNT = 0;
     PULSE_TIMER->DIER |= TIM_DIER_UIE;
 
-    NVIC_SetPriority(PULSE_TIMER_IRQn, 0);
+    NVIC_SetPriority(PULSE_TIMER_IRQn, IRQ_PRIORITY_STEP_PULSE);
     NVIC_EnableIRQ(PULSE_TIMER_IRQn);
 
- // Limit pins init
+#if STEP_DMA_ENABLE
+ // Free running 100 ns per tick, each update requests the DMA transfer of the next step port BSRR word
+ // NOTE: assumes APB2 prescaler > 1, timer clock is then twice PCLK2.
+    STEP_DMA_TIMER->CR1 |= TIM_CR1_ARPE|TIM_CR1_URS;
+    STEP_DMA_TIMER->PSC = HAL_RCC_GetPCLK2Freq() * 2 / 10000000UL - 1;
+    STEP_DMA_TIMER->RCR = 0;
+    STEP_DMA_TIMER->EGR = TIM_EGR_UG;
+    STEP_DMA_TIMER->CR1 |= TIM_CR1_CEN;
 
-    if (settings->limits.flags.hard_enabled)
-        HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0x02, 0x02);
+    STEP_DMA_STREAM->CR = (STEP_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos)|DMA_SxCR_PL|DMA_SxCR_MSIZE_1|DMA_SxCR_PSIZE_1|DMA_SxCR_MINC|DMA_SxCR_DIR_0;
+    STEP_DMA_STREAM->PAR = (uint32_t)&STEP_PORT->BSRR;
+#endif
 
  // Control pins init
 
@@ -1236,6 +1381,7 @@ static bool driver_setup (settings_t *settings)
         DEBOUNCE_TIMER->ARR = 400; // 40 ms timeout
         DEBOUNCE_TIMER->DIER |= TIM_DIER_UIE;
 
+        HAL_NVIC_SetPriority(DEBOUNCE_TIMER_IRQn, IRQ_PRIORITY_DEBOUNCE, 0);
         HAL_NVIC_EnableIRQ(DEBOUNCE_TIMER_IRQn); // Enable debounce interrupt
     }
 
@@ -1335,7 +1481,7 @@ static bool driver_setup (settings_t *settings)
 
 #endif
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     hal.settings_changed(settings);
     hal.spindle.set_state((spindle_state_t){0}, 0.0f);
@@ -1393,6 +1539,10 @@ bool driver_init (void)
     hal.stepper.go_idle = stepperGoIdle;
     hal.stepper.enable = stepperEnable;
     hal.stepper.cycles_per_tick = stepperCyclesPerTick;
+#if PREP_PENDSV_ENABLE
+    hal.stepper.prep_request = stepperPrepRequest;
+#endif
+
     hal.stepper.pulse_start = stepperPulseStart;
 
     hal.limits.enable = limitsEnable;
@@ -1419,12 +1569,29 @@ bool driver_init (void)
     hal.control.get_state = systemGetState;
 
     hal.get_elapsed_ticks = getElapsedTicks;
+    hal.get_cycle_count = getCycleCount;
+    hal.f_cycle_count = SystemCoreClock;
+    hal.get_micros = getMicros;
+
+    NVIC_SetPriority(SysTick_IRQn, IRQ_PRIORITY_SYSTICK);
+
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_stepper);
+    irq_stats_register(&irq_step_pulse);
+    irq_stats_register(&irq_inputs);
+    irq_stats_register(&irq_debounce);
+    irq_stats_register(&irq_systick);
+#endif
+#ifdef ENABLE_MEMORY_REPORT
+    hal.get_free_mem = getFreeMem;
+#endif
     hal.set_bits_atomic = bitsSetAtomic;
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
 
 #if USB_SERIAL_CDC
     hal.stream.read = usbGetC;
+    hal.stream.read_block = usbReadBlock;
     hal.stream.write = usbWriteS;
     hal.stream.write_all = usbWriteS;
     hal.stream.get_rx_buffer_available = usbRxFree;
@@ -1433,6 +1600,7 @@ bool driver_init (void)
     hal.stream.suspend_read = usbSuspendInput;
 #else
     hal.stream.read = serialGetC;
+    hal.stream.read_block = serialReadBlock;
     hal.stream.write = serialWriteS;
     hal.stream.write_all = serialWriteS;
     hal.stream.get_rx_buffer_available = serialRxFree;
@@ -1469,7 +1637,12 @@ bool driver_init (void)
     hal.driver_cap.mist_control = On;
 #endif
     hal.driver_cap.software_debounce = On;
+#if STEP_DMA_ENABLE
+    hal.driver_cap.step_burst = 3; // Up to STEP_BURST_MAX pulses per tick fits in the DMA buffer
+#else
     hal.driver_cap.step_pulse_delay = On;
+#endif
+
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
@@ -1505,12 +1678,19 @@ bool driver_init (void)
 // Main stepper driver
 void STEPPER_TIMER_IRQHandler (void)
 {
+    IRQ_STATS_ENTER();
+#ifdef ENABLE_IRQ_STATS
+    uint32_t latency = STEPPER_TIMER->CNT; // Timer ticks since the update event
+#endif
+
     if ((STEPPER_TIMER->SR & TIM_SR_UIF) != 0)                  // check interrupt source
     {
         STEPPER_TIMER->SR = ~TIM_SR_UIF; // clear UIF flag
         STEPPER_TIMER->CNT = 0;
         hal.stepper.interrupt_callback();
     }
+
+    IRQ_STATS_EXIT(&irq_stepper, latency * (SystemCoreClock / hal.f_step_timer));
 }
 
 /* The Stepper Port Reset Interrupt: This interrupt handles the falling edge of the step
@@ -1533,6 +1713,8 @@ void STEPPER_TIMER_IRQHandler (void)
 // completing one step cycle.
 void PULSE_TIMER_IRQHandler (void)
 {
+    IRQ_STATS_ENTER();
+
     PULSE_TIMER->SR &= ~TIM_SR_UIF;                 // Clear UIF flag
 
     if (PULSE_TIMER->ARR == pulse_delay)            // Delayed step pulse?
@@ -1543,17 +1725,23 @@ void PULSE_TIMER_IRQHandler (void)
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
     } else
         stepperSetStepOutputs((axes_signals_t){0}); // end step pulse
+
+    IRQ_STATS_EXIT(&irq_step_pulse, 0);
 }
 
 // Debounce timer interrupt handler
 void DEBOUNCE_TIMER_IRQHandler (void)
 {
+    IRQ_STATS_ENTER();
+
     DEBOUNCE_TIMER->SR = ~TIM_SR_UIF; // clear UIF flag;
 
     axes_signals_t state = (axes_signals_t)limitsGetState();
 
     if(state.value) //TODO: add check for limit switches having same state as when limit_isr were invoked?
         hal.limits.interrupt_callback(state);
+
+    IRQ_STATS_EXIT(&irq_debounce, 0);
 }
 
 #if PPI_ENABLE
@@ -1591,6 +1779,8 @@ void RPM_COUNTER_IRQHandler (void)
 
 void EXTI0_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<0);
 
     if(ifg) {
@@ -1605,6 +1795,8 @@ void EXTI0_IRQHandler(void)
             hal.limits.interrupt_callback(limitsGetState());
 #endif
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1613,6 +1805,8 @@ void EXTI0_IRQHandler(void)
 
 void EXTI1_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<1);
 
     if(ifg) {
@@ -1627,6 +1821,8 @@ void EXTI1_IRQHandler(void)
             hal.limits.interrupt_callback(limitsGetState());
 #endif
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1635,6 +1831,8 @@ void EXTI1_IRQHandler(void)
 
 void EXTI2_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<2);
 
     if(ifg) {
@@ -1649,6 +1847,8 @@ void EXTI2_IRQHandler(void)
             hal.limits.interrupt_callback(limitsGetState());
 #endif
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1657,6 +1857,8 @@ void EXTI2_IRQHandler(void)
 
 void EXTI3_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<3);
 
     if(ifg) {
@@ -1671,6 +1873,8 @@ void EXTI3_IRQHandler(void)
             hal.limits.interrupt_callback(limitsGetState());
 #endif
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1679,6 +1883,8 @@ void EXTI3_IRQHandler(void)
 
 void EXTI4_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(1<<4);
 
     if(ifg) {
@@ -1693,6 +1899,8 @@ void EXTI4_IRQHandler(void)
             hal.limits.interrupt_callback(limitsGetState());
 #endif
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1701,6 +1909,8 @@ void EXTI4_IRQHandler(void)
 
 void EXTI9_5_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(0x03F0);
 
     if(ifg) {
@@ -1717,6 +1927,8 @@ void EXTI9_5_IRQHandler(void)
                 hal.limits.interrupt_callback(limitsGetState());
         }
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1725,6 +1937,8 @@ void EXTI9_5_IRQHandler(void)
 
 void EXTI15_10_IRQHandler(void)
 {
+    IRQ_STATS_ENTER();
+
     uint32_t ifg = __HAL_GPIO_EXTI_GET_IT(0xFE00);
 
     if(ifg) {
@@ -1754,6 +1968,8 @@ void EXTI15_10_IRQHandler(void)
             keypad_keyclick_handler(BITBAND_PERI(KEYPAD_PORT->IDR, KEYPAD_STROBE_PIN));
 #endif
     }
+
+    IRQ_STATS_EXIT(&irq_inputs, 0);
 }
 
 #endif
@@ -1761,6 +1977,11 @@ void EXTI15_10_IRQHandler(void)
 // Interrupt handler for 1 ms interval timer
 void HAL_IncTick(void)
 {
+    IRQ_STATS_ENTER();
+#ifdef ENABLE_IRQ_STATS
+    uint32_t latency = SysTick->LOAD - SysTick->VAL; // SysTick counts down from reload at the core clock
+#endif
+
 #if SDCARD_ENABLE
     static uint32_t fatfs_ticks = 10;
     if(!(--fatfs_ticks)) {
@@ -1776,4 +1997,6 @@ void HAL_IncTick(void)
             delay.callback = NULL;
         }
     }
+
+    IRQ_STATS_EXIT(&irq_systick, latency);
 }
@@ -47,6 +47,148 @@ static I2C_HandleTypeDef i2c_port = {
     .Init.NoStretchMode = I2C_NOSTRETCH_DISABLE
 };
 
+// Transfer queue, the transfer at the tail is the one in progress.
+static struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    i2c_transfer_t *transfer[I2C_QUEUE_SIZE];
+} queue = {0};
+
+static void i2c_complete (bool ok)
+{
+    i2c_transfer_t *transfer = queue.transfer[queue.tail];
+
+    queue.tail = (queue.tail + 1) & (I2C_QUEUE_SIZE - 1);
+
+    transfer->ok = ok;
+    transfer->done = true;
+
+    if(transfer->on_complete)
+        transfer->on_complete(transfer, ok);
+}
+
+// Start the transfer at the queue tail, if any. Transfers that fail to start are completed with an error.
+static void i2c_start (void)
+{
+    HAL_StatusTypeDef ret;
+    i2c_transfer_t *transfer;
+
+    while(queue.tail != queue.head) {
+
+        transfer = queue.transfer[queue.tail];
+
+        if(transfer->reg_bytes)
+            ret = transfer->read
+                   ? HAL_I2C_Mem_Read_IT(&i2c_port, transfer->address << 1, transfer->reg, transfer->reg_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT, transfer->data, transfer->count)
+                   : HAL_I2C_Mem_Write_IT(&i2c_port, transfer->address << 1, transfer->reg, transfer->reg_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT, transfer->data, transfer->count);
+        else
+            ret = transfer->read
+                   ? HAL_I2C_Master_Receive_IT(&i2c_port, transfer->address << 1, transfer->data, transfer->count)
+                   : HAL_I2C_Master_Transmit_IT(&i2c_port, transfer->address << 1, transfer->data, transfer->count);
+
+        if(ret == HAL_OK)
+            break;
+
+        i2c_complete(false);
+    }
+}
+
+// Add transfer to the queue, starts it immediately if the bus is idle.
+// May be called from interrupt context, returns false if the queue is full.
+bool i2c_enqueue (i2c_transfer_t *transfer)
+{
+    bool ok;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    uint_fast8_t next = (queue.head + 1) & (I2C_QUEUE_SIZE - 1);
+
+    if((ok = next != queue.tail)) {
+        bool idle = queue.head == queue.tail;
+        transfer->done = transfer->ok = false;
+        queue.transfer[queue.head] = transfer;
+        queue.head = next;
+        if(idle)
+            i2c_start();
+    }
+
+    __set_PRIMASK(primask);
+
+    return ok;
+}
+
+// Queue transfer and wait for it to complete, for foreground use only.
+bool i2c_transfer (i2c_transfer_t *transfer)
+{
+    uint32_t ms = HAL_GetTick();
+
+    while(!i2c_enqueue(transfer)) {
+        if(HAL_GetTick() - ms > 100)
+            return false;
+    }
+
+    while(!transfer->done);
+
+    return transfer->ok;
+}
+
+void HAL_I2C_MasterRxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    i2c_complete(true);
+    i2c_start();
+}
+
+void HAL_I2C_MasterTxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    i2c_complete(true);
+    i2c_start();
+}
+
+void HAL_I2C_MemRxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    i2c_complete(true);
+    i2c_start();
+}
+
+void HAL_I2C_MemTxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    i2c_complete(true);
+    i2c_start();
+}
+
+void HAL_I2C_ErrorCallback (I2C_HandleTypeDef *hi2c)
+{
+    i2c_complete(false);
+    i2c_start();
+}
+
+#if I2C_PORT == 1
+
+void I2C1_EV_IRQHandler (void)
+{
+    HAL_I2C_EV_IRQHandler(&i2c_port);
+}
+
+void I2C1_ER_IRQHandler (void)
+{
+    HAL_I2C_ER_IRQHandler(&i2c_port);
+}
+
+#else
+
+void I2C2_EV_IRQHandler (void)
+{
+    HAL_I2C_EV_IRQHandler(&i2c_port);
+}
+
+void I2C2_ER_IRQHandler (void)
+{
+    HAL_I2C_ER_IRQHandler(&i2c_port);
+}
+
+#endif
+
 void i2c_init (void)
 {
     GPIO_InitTypeDef GPIO_InitStruct = {0};
@@ -62,6 +204,12 @@ void i2c_init (void)
     __HAL_RCC_I2C1_CLK_ENABLE();
 
     HAL_I2C_Init(&i2c_port);
+
+    // Below stepper and control input interrupts, completion callbacks are not time critical.
+    HAL_NVIC_SetPriority(I2C1_EV_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+    HAL_NVIC_SetPriority(I2C1_ER_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
 #endif
 
 #if I2C_PORT == 2
@@ -75,6 +223,12 @@ void i2c_init (void)
     __HAL_RCC_I2C2_CLK_ENABLE();
 
     HAL_I2C_Init(&i2c_port);
+
+    // Below stepper and control input interrupts, completion callbacks are not time critical.
+    HAL_NVIC_SetPriority(I2C2_EV_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
+    HAL_NVIC_SetPriority(I2C2_ER_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
 #endif
 }
 
@@ -84,18 +238,23 @@ void i2c_init (void)
 
 nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *i2c, bool read)
 {
-    while (HAL_I2C_GetState(&i2c_port) != HAL_I2C_STATE_READY);
+    i2c_transfer_t transfer = {
+        .address = i2c->address,
+        .reg = i2c->word_addr,
+        .reg_bytes = i2c->word_addr_bytes == 2 ? 2 : 1,
+        .read = read,
+        .data = i2c->data,
+        .count = i2c->count
+    };
 
 //    while (HAL_I2C_IsDeviceReady(&i2c_port, (uint16_t)(0xA0), 3, 100) != HAL_OK);
 
-    if(read)
-        HAL_I2C_Mem_Read(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT, i2c->data, i2c->count, 100);
-    else {
-        HAL_I2C_Mem_Write(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT, i2c->data, i2c->count, 100);
+    i2c_transfer(&transfer);
+
 #if !EEPROM_IS_FRAM
+    if(!read)
         hal.delay_ms(5, NULL);
 #endif
-    }
     i2c->data += i2c->count;
 
     return NVS_TransferResult_OK;
@@ -106,24 +265,29 @@ nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *i2c, bool read)
 #if KEYPAD_ENABLE
 
 static uint8_t keycode = 0;
-static keycode_callback_ptr keypad_callback = NULL;
 
-void I2C_GetKeycode (uint32_t i2cAddr, keycode_callback_ptr callback)
+static void keycode_received (i2c_transfer_t *transfer, bool ok)
 {
-    keycode = 0;
-    keypad_callback = callback;
-
-    HAL_StatusTypeDef ret = HAL_I2C_Master_Receive_IT(&i2c_port, KEYPAD_I2CADDR << 1, &keycode, 1);
-
-    if(!ret)
-        ret = HAL_I2C_Master_Receive_IT(&i2c_port, KEYPAD_I2CADDR << 1, &keycode, 1);
+    if(ok && keycode != 0)
+        ((keycode_callback_ptr)transfer->context)(keycode);
 }
 
-void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+// Called from the keypad strobe interrupt, the keycode is passed to the callback on transfer completion.
+void I2C_GetKeycode (uint32_t i2cAddr, keycode_callback_ptr callback)
 {
-    if(keypad_callback && keycode != 0) {
-        keypad_callback(keycode);
-        keypad_callback = NULL;
+    static i2c_transfer_t transfer = {
+        .data = &keycode,
+        .count = 1,
+        .read = true,
+        .done = true,
+        .on_complete = keycode_received
+    };
+
+    if(transfer.done) { // Ignore strobe if previous read is still pending
+        keycode = 0;
+        transfer.address = i2cAddr;
+        transfer.context = (void *)callback;
+        i2c_enqueue(&transfer);
     }
 }
 
@@ -131,8 +295,6 @@ void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
 
 #if TRINAMIC_ENABLE && TRINAMIC_I2C
 
-static const uint8_t tmc_addr = I2C_ADR_I2CBRIDGE << 1;
-
 static TMC2130_status_t TMC_I2C_ReadRegister (TMC2130_t *driver, TMC2130_datagram_t *reg)
 {
     uint8_t tmc_reg, buffer[5] = {0};
@@ -142,7 +304,16 @@ static TMC2130_status_t TMC_I2C_ReadRegister (TMC2130_t *driver, TMC2130_datagra
         return status; // unsupported register
     }
 
-    HAL_I2C_Mem_Read(&i2c_port, tmc_addr, tmc_reg, I2C_MEMADD_SIZE_8BIT, buffer, 5, 100);
+    i2c_transfer_t transfer = {
+        .address = I2C_ADR_I2CBRIDGE,
+        .reg = tmc_reg,
+        .reg_bytes = 1,
+        .read = true,
+        .data = buffer,
+        .count = 5
+    };
+
+    i2c_transfer(&transfer);
 
     status.value = buffer[0];
     reg->payload.value = buffer[4];
@@ -169,7 +340,15 @@ static TMC2130_status_t TMC_I2C_WriteRegister (TMC2130_t *driver, TMC2130_datagr
         buffer[2] = (reg->payload.value >> 8) & 0xFF;
         buffer[3] = reg->payload.value & 0xFF;
 
-        HAL_I2C_Mem_Write(&i2c_port, tmc_addr, tmc_reg, I2C_MEMADD_SIZE_8BIT, buffer, 4, 100);
+        i2c_transfer_t transfer = {
+            .address = I2C_ADR_I2CBRIDGE,
+            .reg = tmc_reg,
+            .reg_bytes = 1,
+            .data = buffer,
+            .count = 4
+        };
+
+        i2c_transfer(&transfer);
     }
 
     return status;
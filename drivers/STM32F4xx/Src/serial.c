@@ -31,6 +31,48 @@
 
 static stream_rx_buffer_t rxbuf = {0};
 static stream_tx_buffer_t txbuf = {0}, rxbackup;
+#ifdef ENABLE_RX_FILTER
+static stream_rx_filter_t rxfilter = {0};
+#endif
+#ifdef ENABLE_IRQ_STATS
+static irq_stats_t irq_serial = { .name = "SERIAL", .priority = IRQ_PRIORITY_SERIAL };
+#endif
+
+#if SERIAL_DMA_ENABLE
+
+#ifndef SERIAL_DMA_RX_SIZE
+#define SERIAL_DMA_RX_SIZE 64 // must be a power of 2
+#endif
+
+#define SERIAL_RXIE USART_CR1_IDLEIE
+
+static char rxdma[SERIAL_DMA_RX_SIZE];      // Circular DMA receive buffer
+static uint_fast16_t rxdma_tail = 0;        // Next character in rxdma to be moved to rxbuf
+static volatile uint_fast16_t txdma_length = 0; // Number of characters in the ongoing DMA transmit transfer, 0 if idle
+
+#else
+#define SERIAL_RXIE USART_CR1_RXNEIE
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+
+static on_report_memory_ptr on_report_memory = NULL;
+
+static void serialReportMemory (void)
+{
+    uint32_t size = sizeof(rxbuf) + sizeof(txbuf) + sizeof(rxbackup);
+
+#if SERIAL_DMA_ENABLE
+    size += sizeof(rxdma);
+#endif
+
+    report_memory_usage("SERIAL", size);
+
+    if(on_report_memory)
+        on_report_memory();
+}
+
+#endif
 
 void serialInit (void)
 {
@@ -46,6 +88,20 @@ void serialInit (void)
 
   #define USART USART2
   #define USART_IRQHandler USART2_IRQHandler
+  #if SERIAL_DMA_ENABLE
+    #define SERIAL_DMA_RX_STREAM        DMA1_Stream5
+    #define SERIAL_DMA_RX_IRQn          DMA1_Stream5_IRQn
+    #define SERIAL_DMA_RX_IRQHandler    DMA1_Stream5_IRQHandler
+    #define SERIAL_DMA_RX_IFCR          DMA1->HIFCR
+    #define SERIAL_DMA_RX_FLAGS         (DMA_HIFCR_CTCIF5|DMA_HIFCR_CHTIF5|DMA_HIFCR_CTEIF5|DMA_HIFCR_CDMEIF5|DMA_HIFCR_CFEIF5)
+    #define SERIAL_DMA_TX_STREAM        DMA1_Stream6
+    #define SERIAL_DMA_TX_IRQn          DMA1_Stream6_IRQn
+    #define SERIAL_DMA_TX_IRQHandler    DMA1_Stream6_IRQHandler
+    #define SERIAL_DMA_TX_IFCR          DMA1->HIFCR
+    #define SERIAL_DMA_TX_FLAGS         (DMA_HIFCR_CTCIF6|DMA_HIFCR_CHTIF6|DMA_HIFCR_CTEIF6|DMA_HIFCR_CDMEIF6|DMA_HIFCR_CFEIF6)
+
+    __HAL_RCC_DMA1_CLK_ENABLE();
+  #endif
 
     __HAL_RCC_USART2_CLK_ENABLE();
 
@@ -55,15 +111,29 @@ void serialInit (void)
 
     USART->CR1 = USART_CR1_RE|USART_CR1_TE;
     USART->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK1Freq(), 115200);
-    USART->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+    USART->CR1 |= (USART_CR1_UE|SERIAL_RXIE);
 
-    HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
+    HAL_NVIC_SetPriority(USART2_IRQn, IRQ_PRIORITY_SERIAL, 0);
     HAL_NVIC_EnableIRQ(USART2_IRQn);
 
 #else
 
   #define USART USART1
   #define USART_IRQHandler USART1_IRQHandler
+  #if SERIAL_DMA_ENABLE
+    #define SERIAL_DMA_RX_STREAM        DMA2_Stream2
+    #define SERIAL_DMA_RX_IRQn          DMA2_Stream2_IRQn
+    #define SERIAL_DMA_RX_IRQHandler    DMA2_Stream2_IRQHandler
+    #define SERIAL_DMA_RX_IFCR          DMA2->LIFCR
+    #define SERIAL_DMA_RX_FLAGS         (DMA_LIFCR_CTCIF2|DMA_LIFCR_CHTIF2|DMA_LIFCR_CTEIF2|DMA_LIFCR_CDMEIF2|DMA_LIFCR_CFEIF2)
+    #define SERIAL_DMA_TX_STREAM        DMA2_Stream7
+    #define SERIAL_DMA_TX_IRQn          DMA2_Stream7_IRQn
+    #define SERIAL_DMA_TX_IRQHandler    DMA2_Stream7_IRQHandler
+    #define SERIAL_DMA_TX_IFCR          DMA2->HIFCR
+    #define SERIAL_DMA_TX_FLAGS         (DMA_HIFCR_CTCIF7|DMA_HIFCR_CHTIF7|DMA_HIFCR_CTEIF7|DMA_HIFCR_CDMEIF7|DMA_HIFCR_CFEIF7)
+
+    __HAL_RCC_DMA2_CLK_ENABLE();
+  #endif
 
     __HAL_RCC_USART1_CLK_ENABLE();
 
@@ -73,14 +143,80 @@ void serialInit (void)
 
     USART->CR1 = USART_CR1_RE|USART_CR1_TE;
     USART->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), 115200);
-    USART->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+    USART->CR1 |= (USART_CR1_UE|SERIAL_RXIE);
 
-    HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
+    HAL_NVIC_SetPriority(USART1_IRQn, IRQ_PRIORITY_SERIAL, 0);
     HAL_NVIC_EnableIRQ(USART1_IRQn);
 
 #endif
+
+#if SERIAL_DMA_ENABLE
+
+    // Receive by circular DMA transfer, data is moved to the input buffer on half and full
+    // transfer complete and on idle line interrupts.
+    SERIAL_DMA_RX_STREAM->CR = 0;
+    while(SERIAL_DMA_RX_STREAM->CR & DMA_SxCR_EN);
+    SERIAL_DMA_RX_IFCR = SERIAL_DMA_RX_FLAGS;
+    SERIAL_DMA_RX_STREAM->PAR = (uint32_t)&USART->DR;
+    SERIAL_DMA_RX_STREAM->M0AR = (uint32_t)rxdma;
+    SERIAL_DMA_RX_STREAM->NDTR = SERIAL_DMA_RX_SIZE;
+    SERIAL_DMA_RX_STREAM->CR = DMA_SxCR_CHSEL_2|DMA_SxCR_MINC|DMA_SxCR_CIRC|DMA_SxCR_HTIE|DMA_SxCR_TCIE|DMA_SxCR_EN;
+
+    // Transmit contiguous chunks of the output buffer by DMA transfers, memory to peripheral.
+    SERIAL_DMA_TX_STREAM->CR = 0;
+    while(SERIAL_DMA_TX_STREAM->CR & DMA_SxCR_EN);
+    SERIAL_DMA_TX_IFCR = SERIAL_DMA_TX_FLAGS;
+    SERIAL_DMA_TX_STREAM->PAR = (uint32_t)&USART->DR;
+    SERIAL_DMA_TX_STREAM->CR = DMA_SxCR_CHSEL_2|DMA_SxCR_MINC|DMA_SxCR_DIR_0|DMA_SxCR_TCIE;
+
+    USART->CR3 |= USART_CR3_DMAR|USART_CR3_DMAT;
+
+    HAL_NVIC_SetPriority(SERIAL_DMA_RX_IRQn, IRQ_PRIORITY_SERIAL, 0);
+    HAL_NVIC_EnableIRQ(SERIAL_DMA_RX_IRQn);
+    HAL_NVIC_SetPriority(SERIAL_DMA_TX_IRQn, IRQ_PRIORITY_SERIAL, 0);
+    HAL_NVIC_EnableIRQ(SERIAL_DMA_TX_IRQn);
+
+#endif
+
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_serial);
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+    on_report_memory = grbl.on_report_memory;
+    grbl.on_report_memory = serialReportMemory;
+#endif
+}
+
+#if SERIAL_DMA_ENABLE
+
+//
+// Starts transmission of the next contiguous chunk of the output buffer when not already transmitting.
+// Must be called with interrupts disabled or from the DMA transmit interrupt handler.
+//
+static void serialTxDMAStart (void)
+{
+    uint_fast16_t tail = txbuf.tail, head = txbuf.head;
+
+    if(txdma_length == 0 && (txdma_length = head >= tail ? head - tail : TX_BUFFER_SIZE - tail)) {
+        SERIAL_DMA_TX_IFCR = SERIAL_DMA_TX_FLAGS;
+        SERIAL_DMA_TX_STREAM->M0AR = (uint32_t)&txbuf.data[tail];
+        SERIAL_DMA_TX_STREAM->NDTR = txdma_length;
+        SERIAL_DMA_TX_STREAM->CR |= DMA_SxCR_EN;
+    }
 }
 
+inline static void serialTxKick (void)
+{
+    if(txdma_length == 0) {
+        __disable_irq();
+        serialTxDMAStart();
+        __enable_irq();
+    }
+}
+
+#endif
+
 //
 // Returns number of free characters in serial input buffer
 //
@@ -96,6 +232,9 @@ uint16_t serialRxFree (void)
 void serialRxFlush (void)
 {
     rxbuf.head = rxbuf.tail = 0;
+#ifdef ENABLE_RX_FILTER
+    rxfilter.value = 0;
+#endif
 }
 
 //
@@ -106,6 +245,9 @@ void serialRxCancel (void)
     rxbuf.data[rxbuf.head] = ASCII_CAN;
     rxbuf.tail = rxbuf.head;
     rxbuf.head = (rxbuf.tail + 1) & (RX_BUFFER_SIZE - 1);
+#ifdef ENABLE_RX_FILTER
+    rxfilter.value = 0;
+#endif
 }
 
 //
@@ -121,6 +263,55 @@ inline static bool serialPutCNonBlocking (const char c)
     return ok;
 }
 
+#if SERIAL_DMA_ENABLE
+
+//
+// Adds a character to the serial output buffer, transmission is started by serialTxKick()
+//
+inline static bool serialBufferC (const char c)
+{
+    uint16_t next_head = (txbuf.head + 1) & (TX_BUFFER_SIZE - 1);   // Get pointer to next free slot in buffer
+
+    while(txbuf.tail == next_head) {                                // While TX buffer full
+        serialTxKick();                                             // ensure buffer is being emptied,
+        if(!hal.stream_blocking_callback())                         // check if blocking for space,
+            return false;                                           // exit if not (leaves TX buffer in an inconsistent state)
+    }
+
+    txbuf.data[txbuf.head] = c;                                     // Add data to buffer
+    txbuf.head = next_head;                                         // and update head pointer
+
+    return true;
+}
+
+//
+// Writes a character to the serial output stream
+//
+bool serialPutC (const char c)
+{
+    bool ok;
+
+    if((ok = serialBufferC(c)))
+        serialTxKick();
+
+    return ok;
+}
+
+//
+// Writes a null terminated string to the serial output stream, blocks if buffer full
+//
+void serialWriteS (const char *s)
+{
+    char c, *ptr = (char *)s;
+
+    while((c = *ptr++) != '\0')
+        serialBufferC(c);
+
+    serialTxKick();
+}
+
+#else
+
 //
 // Writes a character to the serial output stream
 //
@@ -154,6 +345,8 @@ void serialWriteS (const char *s)
         serialPutC(c);
 }
 
+#endif
+
 //
 // Writes a number of characters from string to the serial output stream followed by EOL, blocks if buffer full
 //
@@ -181,6 +374,26 @@ int16_t serialGetC (void)
     return (int16_t)data;
 }
 
+//
+// serialReadBlock - copies data up to and including the first end of line character, returns number of characters copied
+//
+uint16_t serialReadBlock (char *data, uint16_t size)
+{
+    char c;
+    uint16_t bptr = rxbuf.tail, head = rxbuf.head, count = 0;
+
+    while(bptr != head && count < size) {
+        c = data[count++] = rxbuf.data[bptr];
+        bptr = (bptr + 1) & (RX_BUFFER_SIZE - 1);
+        if(c == '\n' || c == '\r')
+            break;
+    }
+
+    rxbuf.tail = bptr;
+
+    return count;
+}
+
 // "dummy" version of serialGetC
 static int16_t serialGetNull (void)
 {
@@ -189,39 +402,101 @@ static int16_t serialGetNull (void)
 
 bool serialSuspendInput (bool suspend)
 {
-    if(suspend)
+    if(suspend) {
         hal.stream.read = serialGetNull;
-    else if(rxbuf.backup)
+        hal.stream.read_block = NULL;
+    } else if(rxbuf.backup)
         memcpy(&rxbuf, &rxbackup, sizeof(stream_rx_buffer_t));
 
     return rxbuf.tail != rxbuf.head;
 }
 
-void USART_IRQHandler (void)
+//
+// Adds a received character to the input buffer, realtime commands are stripped
+// and, if enabled, whitespace and comments are filtered out
+//
+inline static void serialRxC (char data)
+{
+    uint16_t next_head = (rxbuf.head + 1) & (RX_BUFFER_SIZE - 1);   // Get and increment buffer pointer
+
+    if(rxbuf.tail == next_head)                                     // If buffer full
+        rxbuf.overflow = 1;                                         // flag overflow
+    else if(data == CMD_TOOL_ACK && !rxbuf.backup) {
+
+        memcpy(&rxbackup, &rxbuf, sizeof(stream_rx_buffer_t));
+        rxbuf.backup = true;
+        rxbuf.tail = rxbuf.head;
+        hal.stream.read = serialGetC; // restore normal input
+        hal.stream.read_block = serialReadBlock;
+
+    } else if(!hal.stream.enqueue_realtime_command(data)            // Check and strip realtime commands,
+#ifdef ENABLE_RX_FILTER
+               && (data = stream_rx_filter(&rxfilter, data))         // filter input,
+#endif
+              ) {
+        rxbuf.data[rxbuf.head] = data;                              // if not add data to buffer
+        rxbuf.head = next_head;                                     // and update pointer
+    }
+}
+
+#if SERIAL_DMA_ENABLE
+
+//
+// Moves characters received by DMA to the input buffer
+//
+static void serialRxDMA (void)
 {
-    if(USART->SR & USART_SR_RXNE) {
+    uint_fast16_t head = (SERIAL_DMA_RX_SIZE - SERIAL_DMA_RX_STREAM->NDTR) & (SERIAL_DMA_RX_SIZE - 1);
 
-        uint16_t next_head = (rxbuf.head + 1) & (RX_BUFFER_SIZE - 1);   // Get and increment buffer pointer
+    while(rxdma_tail != head) {
+        serialRxC(rxdma[rxdma_tail]);
+        rxdma_tail = (rxdma_tail + 1) & (SERIAL_DMA_RX_SIZE - 1);
+    }
+}
 
-        if(rxbuf.tail == next_head) {                                   // If buffer full
-            rxbuf.overflow = 1;                                         // flag overflow
-            next_head =  USART->DR;                                     // and do dummy read to clear interrupt
-        } else {
-            char data = USART->DR;
-            if(data == CMD_TOOL_ACK && !rxbuf.backup) {
+void SERIAL_DMA_RX_IRQHandler (void)
+{
+    IRQ_STATS_ENTER();
 
-                memcpy(&rxbackup, &rxbuf, sizeof(stream_rx_buffer_t));
-                rxbuf.backup = true;
-                rxbuf.tail = rxbuf.head;
-                hal.stream.read = serialGetC; // restore normal input
+    SERIAL_DMA_RX_IFCR = SERIAL_DMA_RX_FLAGS;   // Clear half and full transfer complete flags
+    serialRxDMA();
 
-            } else if(!hal.stream.enqueue_realtime_command(data)) {     // Check and strip realtime commands,
-                rxbuf.data[rxbuf.head] = data;                          // if not add data to buffer
-                rxbuf.head = next_head;                                 // and update pointer
-            }
-        }
+    IRQ_STATS_EXIT(&irq_serial, 0);
+}
+
+void SERIAL_DMA_TX_IRQHandler (void)
+{
+    IRQ_STATS_ENTER();
+
+    SERIAL_DMA_TX_IFCR = SERIAL_DMA_TX_FLAGS;                               // Clear transfer complete flag,
+    txbuf.tail = (txbuf.tail + txdma_length) & (TX_BUFFER_SIZE - 1);        // release the characters sent and
+    txdma_length = 0;
+    serialTxDMAStart();                                                     // start transfer of the next chunk, if any
+
+    IRQ_STATS_EXIT(&irq_serial, 0);
+}
+
+void USART_IRQHandler (void)
+{
+    IRQ_STATS_ENTER();
+
+    if(USART->SR & USART_SR_IDLE) {
+        (void)USART->DR;    // Clear idle line flag
+        serialRxDMA();
     }
 
+    IRQ_STATS_EXIT(&irq_serial, 0);
+}
+
+#else
+
+void USART_IRQHandler (void)
+{
+    IRQ_STATS_ENTER();
+
+    if(USART->SR & USART_SR_RXNE)
+        serialRxC(USART->DR);
+
     if((USART->SR & USART_SR_TXE) && (USART->CR1 & USART_CR1_TXEIE)) {
 
         uint16_t tail = txbuf.tail;             // Get buffer pointer
@@ -236,4 +511,8 @@ void USART_IRQHandler (void)
         if(tail == txbuf.head)                  // If buffer empty then
             USART->CR1 &= ~USART_CR1_TXEIE;     // disable UART TX interrupt
    }
+
+    IRQ_STATS_EXIT(&irq_serial, 0);
 }
+
+#endif
@@ -37,6 +37,73 @@ static SPI_HandleTypeDef hspi1 = {
     .Init.CRCPolynomial = 10
 };
 
+#if SDCARD_DMA_ENABLE
+
+// SPI1 RX and TX on DMA2 channel 3, streams chosen to not collide with step and USART1 DMA.
+#define SPI_DMA_RX_STREAM       DMA2_Stream0
+#define SPI_DMA_RX_IRQn         DMA2_Stream0_IRQn
+#define SPI_DMA_RX_IRQHandler   DMA2_Stream0_IRQHandler
+#define SPI_DMA_RX_FLAGS        (DMA_LIFCR_CTCIF0|DMA_LIFCR_CHTIF0|DMA_LIFCR_CTEIF0|DMA_LIFCR_CDMEIF0|DMA_LIFCR_CFEIF0)
+#define SPI_DMA_TX_STREAM       DMA2_Stream3
+#define SPI_DMA_TX_FLAGS        (DMA_LIFCR_CTCIF3|DMA_LIFCR_CHTIF3|DMA_LIFCR_CTEIF3|DMA_LIFCR_CDMEIF3|DMA_LIFCR_CFEIF3)
+#define SPI_DMA_CHANNEL         (DMA_SxCR_CHSEL_0|DMA_SxCR_CHSEL_1)
+
+static uint8_t dma_dummy;
+static spi_dma_complete_ptr dma_complete = NULL;
+
+static void spi_dma_init (void)
+{
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    SPI_DMA_RX_STREAM->CR = 0;
+    while(SPI_DMA_RX_STREAM->CR & DMA_SxCR_EN);
+    SPI_DMA_RX_STREAM->PAR = (uint32_t)&hspi1.Instance->DR;
+
+    SPI_DMA_TX_STREAM->CR = 0;
+    while(SPI_DMA_TX_STREAM->CR & DMA_SxCR_EN);
+    SPI_DMA_TX_STREAM->PAR = (uint32_t)&hspi1.Instance->DR;
+
+    DMA2->LIFCR = SPI_DMA_RX_FLAGS|SPI_DMA_TX_FLAGS;
+
+    HAL_NVIC_SetPriority(SPI_DMA_RX_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(SPI_DMA_RX_IRQn);
+}
+
+// Starts a full duplex transfer of length bytes, on_complete is called from interrupt context when the
+// last byte has been received. rx may be NULL to discard received data, tx NULL to transmit 0xFF.
+void spi_dma_transfer (uint8_t *rx, const uint8_t *tx, uint16_t length, spi_dma_complete_ptr on_complete)
+{
+    dma_complete = on_complete;
+    dma_dummy = 0xFF;
+
+    while(hspi1.Instance->SR & SPI_SR_BSY);
+    (void)hspi1.Instance->DR;               // Drop any stale received byte
+    __HAL_SPI_CLEAR_OVRFLAG(&hspi1);
+
+    DMA2->LIFCR = SPI_DMA_RX_FLAGS|SPI_DMA_TX_FLAGS;
+
+    SPI_DMA_RX_STREAM->M0AR = (uint32_t)(rx ? rx : &dma_dummy);
+    SPI_DMA_RX_STREAM->NDTR = length;
+    SPI_DMA_RX_STREAM->CR = SPI_DMA_CHANNEL|DMA_SxCR_PL_1|(rx ? DMA_SxCR_MINC : 0)|DMA_SxCR_TCIE|DMA_SxCR_EN;
+
+    SPI_DMA_TX_STREAM->M0AR = (uint32_t)(tx ? tx : &dma_dummy);
+    SPI_DMA_TX_STREAM->NDTR = length;
+    SPI_DMA_TX_STREAM->CR = SPI_DMA_CHANNEL|DMA_SxCR_DIR_0|(tx ? DMA_SxCR_MINC : 0)|DMA_SxCR_EN;
+
+    hspi1.Instance->CR2 |= SPI_CR2_RXDMAEN|SPI_CR2_TXDMAEN; // RX enabled first so no byte is missed
+}
+
+void SPI_DMA_RX_IRQHandler (void)
+{
+    DMA2->LIFCR = SPI_DMA_RX_FLAGS|SPI_DMA_TX_FLAGS;    // Clear transfer complete flags and
+    hspi1.Instance->CR2 &= ~(SPI_CR2_RXDMAEN|SPI_CR2_TXDMAEN); // return SPI to polled mode
+
+    if(dma_complete)
+        dma_complete();
+}
+
+#endif
+
 void spi_init (void)
 {
     static bool init = false;
@@ -60,6 +127,10 @@ void spi_init (void)
 
         HAL_SPI_Init(&hspi1);
         __HAL_SPI_ENABLE(&hspi1);
+
+#if SDCARD_DMA_ENABLE
+        spi_dma_init();
+#endif
     }
 
     init = true;
@@ -23,6 +23,7 @@
 #include "stm32f4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "driver.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -42,6 +43,9 @@
 
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN PV */
+#ifdef ENABLE_IRQ_STATS
+irq_stats_t irq_usb = { .name = "USB", .priority = IRQ_PRIORITY_USB };
+#endif
 
 /* USER CODE END PV */
 
@@ -169,8 +173,11 @@ void DebugMon_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+#if PREP_PENDSV_ENABLE
+  hal.stepper.prep_callback();
+#endif
   /* USER CODE END PendSV_IRQn 0 */
+
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
   /* USER CODE END PendSV_IRQn 1 */
@@ -203,11 +210,11 @@ void SysTick_Handler(void)
 void OTG_FS_IRQHandler(void)
 {
   /* USER CODE BEGIN OTG_FS_IRQn 0 */
-
+  IRQ_STATS_ENTER();
   /* USER CODE END OTG_FS_IRQn 0 */
   HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
   /* USER CODE BEGIN OTG_FS_IRQn 1 */
-
+  IRQ_STATS_EXIT(&irq_usb, 0);
   /* USER CODE END OTG_FS_IRQn 1 */
 }
 
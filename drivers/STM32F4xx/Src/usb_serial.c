@@ -29,17 +29,87 @@
 #include "usbd_cdc_if.h"
 #include "usb_device.h"
 
+// Complete lines are held back for up to USB_TX_COALESCE_MS milliseconds while the input buffer holds data,
+// coalescing responses into full 64 byte packets. Full speed USB transfers at most one packet per frame.
+// Set to 0 to transmit on every line end.
+#ifndef USB_TX_COALESCE_MS
+#define USB_TX_COALESCE_MS 1
+#endif
+
+#define USB_TX_PACKET_SIZE 64
+
+#ifdef ENABLE_IRQ_STATS
+extern irq_stats_t irq_usb; // Updated by OTG_FS_IRQHandler(), see stm32f4xx_it.c
+#endif
+
 static char txdata2[BLOCK_TX_BUFFER_SIZE]; // Secondary TX buffer (for double buffering)
 static bool use_tx2data = false;
 static stream_rx_buffer_t rxbuf = {0}, rxbackup;
+#ifdef ENABLE_RX_FILTER
+static stream_rx_filter_t rxfilter = {0};
+#endif
 static stream_block_tx_buffer_t txbuf = {0};
 
+#ifdef ENABLE_MEMORY_REPORT
+
+static on_report_memory_ptr on_report_memory = NULL;
+
+static void usbReportMemory (void)
+{
+    report_memory_usage("USB", sizeof(rxbuf) + sizeof(txbuf) + sizeof(rxbackup) + sizeof(txdata2));
+
+    if(on_report_memory)
+        on_report_memory();
+}
+
+#endif
+
+#if USB_TX_COALESCE_MS
+
+static volatile bool tx_pending = false;
+static uint32_t tx_timestamp;
+static on_execute_realtime_ptr on_execute_realtime;
+
+static bool usb_write (void);
+
+// Transmits held back lines when the input buffer is empty or on timeout.
+static inline void usb_tx_flush (void)
+{
+    if(tx_pending && (rxbuf.tail == rxbuf.head || (hal.get_elapsed_ticks() - tx_timestamp) >= USB_TX_COALESCE_MS))
+        usb_write();
+}
+
+static void usb_execute_realtime (uint_fast16_t state)
+{
+    usb_tx_flush();
+
+    on_execute_realtime(state);
+}
+
+#endif
+
 void usbInit (void)
 {
     MX_USB_DEVICE_Init();
 
+    HAL_NVIC_SetPriority(OTG_FS_IRQn, IRQ_PRIORITY_USB, 0); // Replaces the priority set by HAL_PCD_MspInit()
+
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_usb);
+#endif
+
     txbuf.s = txbuf.data;
     txbuf.max_length = BLOCK_TX_BUFFER_SIZE;
+
+#if USB_TX_COALESCE_MS
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = usb_execute_realtime;
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+    on_report_memory = grbl.on_report_memory;
+    grbl.on_report_memory = usbReportMemory;
+#endif
 }
 
 //
@@ -57,6 +127,9 @@ uint16_t usbRxFree (void)
 void usbRxFlush (void)
 {
     rxbuf.head = rxbuf.tail = 0;
+#ifdef ENABLE_RX_FILTER
+    rxfilter.value = 0;
+#endif
 }
 
 //
@@ -67,15 +140,22 @@ void usbRxCancel (void)
     rxbuf.data[rxbuf.head] = ASCII_CAN;
     rxbuf.tail = rxbuf.head;
     rxbuf.head = (rxbuf.tail + 1) & (RX_BUFFER_SIZE - 1);
+#ifdef ENABLE_RX_FILTER
+    rxfilter.value = 0;
+#endif
 }
 
 //
 // Writes current buffer to the USB output stream, swaps buffers
 //
-static inline bool usb_write (void)
+static bool usb_write (void)
 {
     static uint8_t dummy = 0;
 
+#if USB_TX_COALESCE_MS
+    tx_pending = false;
+#endif
+
     txbuf.s = use_tx2data ? txdata2 : txbuf.data;
 
     while(CDC_Transmit_FS((uint8_t *)txbuf.s, txbuf.length) == USBD_BUSY) {
@@ -116,6 +196,15 @@ void usbWriteS (const char *s)
     txbuf.s += length;
 
     if(s[length - 1] == ASCII_LF) {
+#if USB_TX_COALESCE_MS
+        if(txbuf.length < USB_TX_PACKET_SIZE && rxbuf.tail != rxbuf.head) {
+            if(!tx_pending) {
+                tx_timestamp = hal.get_elapsed_ticks();
+                tx_pending = true;
+            }
+            return;
+        }
+#endif
         if(!usb_write())
             return;
     }
@@ -128,6 +217,10 @@ int16_t usbGetC (void)
 {
     uint16_t bptr = rxbuf.tail;
 
+#if USB_TX_COALESCE_MS
+    usb_tx_flush();
+#endif
+
     if(bptr == rxbuf.head)
         return -1; // no data available else EOF
 
@@ -137,6 +230,26 @@ int16_t usbGetC (void)
     return (int16_t)data;
 }
 
+//
+// usbReadBlock - copies data up to and including the first end of line character, returns number of characters copied
+//
+uint16_t usbReadBlock (char *data, uint16_t size)
+{
+    char c;
+    uint16_t bptr = rxbuf.tail, head = rxbuf.head, count = 0;
+
+    while(bptr != head && count < size) {
+        c = data[count++] = rxbuf.data[bptr];
+        bptr = (bptr + 1) & (RX_BUFFER_SIZE - 1);
+        if(c == '\n' || c == '\r')
+            break;
+    }
+
+    rxbuf.tail = bptr;
+
+    return count;
+}
+
 // "dummy" version of serialGetC
 static int16_t usbGetNull (void)
 {
@@ -145,9 +258,10 @@ static int16_t usbGetNull (void)
 
 bool usbSuspendInput (bool suspend)
 {
-    if(suspend)
+    if(suspend) {
         hal.stream.read = usbGetNull;
-    else if(rxbuf.backup)
+        hal.stream.read_block = NULL;
+    } else if(rxbuf.backup)
         memcpy(&rxbuf, &rxbackup, sizeof(stream_rx_buffer_t));
 
     return rxbuf.tail != rxbuf.head;
@@ -168,8 +282,13 @@ void usbBufferInput (uint8_t *data, uint32_t length)
                 rxbuf.backup = true;
                 rxbuf.tail = rxbuf.head;
                 hal.stream.read = usbGetC; // restore normal input
+                hal.stream.read_block = usbReadBlock;
 
-            } else if(!hal.stream.enqueue_realtime_command(*data)) {        // Check and strip realtime commands,
+            } else if(!hal.stream.enqueue_realtime_command(*data)           // Check and strip realtime commands,
+#ifdef ENABLE_RX_FILTER
+                       && (*data = stream_rx_filter(&rxfilter, *data))       // filter input,
+#endif
+                      ) {
                 rxbuf.data[rxbuf.head] = *data;                             // if not add data to buffer
                 rxbuf.head = next_head;                                     // and update pointer
             }
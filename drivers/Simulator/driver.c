@@ -20,14 +20,24 @@
 
 */
 
+#include <stdio.h>
+
 #include "mcu.h"
 #include "driver.h"
 #include "serial.h"
 #include "eeprom.h"
 #include "grbl_eeprom_extensions.h"
 #include "platform.h"
+#include "simulator.h"
 
 #include "grbl/hal.h"
+#include "grbl/irq_stats.h"
+
+#ifdef ENABLE_IRQ_STATS
+// The simulated MCU has no interrupt priorities and serves interrupts when raised, entry latency is always 0.
+static irq_stats_t irq_stepper = { .name = "STEPPER", .timed = true, .step_timing = true };
+static irq_stats_t irq_systick = { .name = "SYSTICK", .timed = true };
+#endif
 
 static bool probe_invert;
 static delay_t delay = { .ms = 1, .callback = NULL }; // NOTE: initial ms set to 1 for "resetting" systick timer on startup
@@ -35,6 +45,7 @@ static delay_t delay = { .ms = 1, .callback = NULL }; // NOTE: initial ms set to
 void SysTick_Handler (void);
 void Stepper_IRQHandler (void);
 void Limits0_IRQHandler (void);
+void Probe_IRQHandler (void);
 void Control_IRQHandler (void);
 
 #define SQUARING_ENABLED
@@ -218,6 +229,12 @@ static void probeConfigureInvertMask (bool is_probe_away, bool probing)
 
   if (is_probe_away)
       probe_invert ^= is_probe_away;
+
+  // Interrupt on the edge that triggers the probe while probing.
+  gpio[PROBE_PORT].rising.mask = probe_invert ? 0 : PROBE_BIT;
+  gpio[PROBE_PORT].falling.mask = probe_invert ? PROBE_BIT : 0;
+  gpio[PROBE_PORT].irq_state.mask &= ~PROBE_BIT;
+  gpio[PROBE_PORT].irq_mask.mask = probing ? PROBE_BIT : 0;
 }
 
 // Returns the probe connected and triggered pin states.
@@ -316,6 +333,36 @@ static uint_fast16_t valueSetAtomic (volatile uint_fast16_t *ptr, uint_fast16_t
     return prev;
 }
 
+#ifdef TOOL_TABLE_CACHE
+
+// Tool table kept in a file indexed by tool number, one record per tool.
+static FILE *tool_table_fp (void)
+{
+    static FILE *fp = NULL;
+
+    if(fp == NULL && (fp = fopen("TOOLS.DAT", "r+b")) == NULL)
+        fp = fopen("TOOLS.DAT", "w+b");
+
+    return fp;
+}
+
+static bool toolTableRead (uint32_t tool, tool_data_t *tool_data)
+{
+    FILE *fp = tool_table_fp();
+
+    return fp && fseek(fp, (tool - 1) * sizeof(tool_data_t), SEEK_SET) == 0 && fread(tool_data, sizeof(tool_data_t), 1, fp) == 1;
+}
+
+static bool toolTableWrite (tool_data_t *tool_data)
+{
+    FILE *fp = tool_table_fp();
+
+    return fp && fseek(fp, (tool_data->tool - 1) * sizeof(tool_data_t), SEEK_SET) == 0 &&
+            fwrite(tool_data, sizeof(tool_data_t), 1, fp) == 1 && fflush(fp) == 0;
+}
+
+#endif
+
 void settings_changed (settings_t *settings)
 {
 
@@ -352,6 +399,7 @@ bool driver_setup (settings_t *settings)
     gpio[CONTROL_PORT].irq_mask.mask = CONTROL_MASK;
     mcu_register_irq_handler(Control_IRQHandler, CONTROL_IRQ);
 
+    mcu_register_irq_handler(Probe_IRQHandler, PROBE_IRQ);
     mcu_gpio_in(&gpio[PROBE_PORT], PROBE_CONNECTED_BIT, PROBE_CONNECTED_BIT); // default to connected
 
     hal.settings_changed(settings);
@@ -359,7 +407,7 @@ bool driver_setup (settings_t *settings)
     hal.spindle.set_state((spindle_state_t){0}, 0.0f);
     hal.coolant.set_state((coolant_state_t){0});
 
-    return settings->version == 18;
+    return settings->version == 19;
 }
 
 // used to inject a sleep in grbl main loop, 
@@ -369,6 +417,16 @@ void sim_process_realtime (uint_fast16_t state)
     platform_sleep(0);
 }
 
+static uint32_t getCycleCount (void)
+{
+    return (uint32_t)sim.masterclock;
+}
+
+static uint32_t getMicros (void)
+{
+    return (uint32_t)(sim.masterclock / (F_CPU / 1000000UL));
+}
+
 bool driver_init ()
 {
     mcu_reset();
@@ -387,6 +445,14 @@ bool driver_init ()
     hal.f_step_timer = F_CPU;
     hal.delay_ms = driver_delay_ms;
     hal.settings_changed = settings_changed;
+    hal.get_cycle_count = getCycleCount;
+    hal.f_cycle_count = F_CPU;
+    hal.get_micros = getMicros;
+
+#ifdef ENABLE_IRQ_STATS
+    irq_stats_register(&irq_stepper);
+    irq_stats_register(&irq_systick);
+#endif
 
     grbl.on_execute_realtime = sim_process_realtime;
 
@@ -435,6 +501,11 @@ bool driver_init ()
     hal.nvs.memcpy_to_nvs = memcpy_to_eeprom;
     hal.nvs.memcpy_from_nvs = memcpy_from_eeprom;
 
+#ifdef TOOL_TABLE_CACHE
+    hal.tool.table_read = toolTableRead;
+    hal.tool.table_write = toolTableWrite;
+#endif
+
     hal.set_bits_atomic = bitsSetAtomic;
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
@@ -458,6 +529,7 @@ bool driver_init ()
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
     hal.driver_cap.probe_pull_up = On;
+    hal.driver_cap.probe_latch = On;
 #ifdef SQUARING_ENABLED
  //   hal.driver_cap.axis_ganged_x = On;
 #endif
@@ -468,7 +540,11 @@ bool driver_init ()
 // Main stepper driver
 void Stepper_IRQHandler (void)
 {
+    IRQ_STATS_ENTER();
+
     hal.stepper.interrupt_callback();
+
+    IRQ_STATS_EXIT(&irq_stepper, 0);
 }
 
 void Control_IRQHandler (void)
@@ -483,6 +559,13 @@ void Limits0_IRQHandler (void)
     hal.limits.interrupt_callback(hal.limits.get_state());
 }
 
+void Probe_IRQHandler (void)
+{
+    gpio[PROBE_PORT].irq_state.mask &= ~PROBE_BIT;
+    if(probeGetState().triggered)
+        hal.probe.interrupt_callback();
+}
+
 #ifdef SQUARING_ENABLED
 
 void Limits1_IRQHandler (void)
@@ -496,6 +579,8 @@ void Limits1_IRQHandler (void)
 // Interrupt handler for 1 ms interval timer
 void SysTick_Handler (void)
 {
+    IRQ_STATS_ENTER();
+
     if(!(--delay.ms)) {
         systick_timer.enable = 0;
         if(delay.callback) {
@@ -503,4 +588,6 @@ void SysTick_Handler (void)
             delay.callback = NULL;
         }
     }
+
+    IRQ_STATS_EXIT(&irq_systick, 0);
 }
@@ -55,6 +55,7 @@
 #define CONTROL_MASK        (RESET_BIT|FEED_HOLD_BIT|CYCLE_START_BIT|SAFETY_DOOR_BIT)
 
 #define PROBE_PORT          5
+#define PROBE_IRQ           portINT(PROBE_PORT)
 #define PROBE_PIN           0
 #define PROBE_CONNECTED_PIN 1
 #define PROBE_BIT           (1<<PROBE_PIN)
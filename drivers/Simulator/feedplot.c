@@ -0,0 +1,366 @@
+/*
+  feedplot.c - commanded vs. achieved feed analysis of binary step traces written by the simulator
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Reads a version 2 step trace and lists the junctions where the planned speed is below a fraction of
+  the commanded feed rate, each attributed to a cause. Optionally the commanded, planned junction and
+  achieved feed is plotted along the path to an SVG file.
+
+  The achieved feed is computed from the step positions sampled at a fixed interval. The planned entry
+  speeds are those recorded when each block started executing, causes are derived from them:
+
+    JUNCTION:   the entry speed is at the junction deviation limit of the block.
+    ACCEL:      the entry speed is limited by acceleration, either from a slower junction before
+                or to a slower junction after, e.g. for short segments.
+    LOOKAHEAD:  the entry speed is lower than the following blocks allow, it was planned for a
+                deceleration to a stop at the end of a full planner buffer.
+    STARVATION: as LOOKAHEAD but the planner buffer was not full, or the planner ran empty and
+                motion was restarted from a stop.
+
+  Stops programmed by dwells or commands synchronizing with motion are also classified as STARVATION
+  as these cannot be told apart from the trace.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "steptrace.h"
+
+#define SAMPLE_MS 10.0          // Default sampling interval for achieved feed (ms)
+#define SLOWDOWN_FRACTION 0.5   // Default threshold, fraction of commanded feed
+#define DEFAULT_STEPS_PER_MM 250.0
+#define SPEED_TOLERANCE 0.02f   // Relative tolerance used when comparing squared speeds
+
+#define PLOT_WIDTH 1200
+#define PLOT_HEIGHT 500
+#define PLOT_MARGIN 60
+
+typedef enum {
+    Cause_None = 0,
+    Cause_Junction,
+    Cause_Accel,
+    Cause_Lookahead,
+    Cause_Starvation
+} cause_t;
+
+static const char *cause_name[] = { "", "JUNCTION", "ACCEL", "LOOKAHEAD", "STARVATION" };
+static const char *cause_color[] = { "", "red", "orange", "purple", "black" };
+
+typedef struct {
+    steptrace_block_t plan;
+    uint64_t start_ticks;
+    double achieved;        // Achieved feed at block start (mm/min)
+    double distance;        // Path distance at block start (mm), from the block lengths
+    size_t sample;          // Index of the sample containing the block start
+    cause_t cause;
+} exec_block_t;
+
+typedef struct {
+    double distance;        // Path distance at the end of the sample (mm)
+    double feed;            // Achieved feed (mm/min)
+} sample_t;
+
+static exec_block_t *blocks = NULL;
+static sample_t *samples = NULL;
+static size_t n_blocks = 0, n_samples = 0;
+
+// Returns the array with room for element n, the allocation is doubled when full.
+static void *grow (void *array, size_t n, size_t size)
+{
+    if((n == 0 || (n >= 64 && (n & (n - 1)) == 0)) && (array = realloc(array, (n ? n * 2 : 64) * size)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    return array;
+}
+
+static int usage (const char *progname)
+{
+    printf("Usage: %s [-o <svg file>] [-s <steps/mm>[,<steps/mm>...]] [-t <fraction>] [-w <ms>] <step trace file>\n"
+           "  -o : plot commanded, planned and achieved feed along the path to an SVG file\n"
+           "  -s : steps per mm for each axis, default %g for all\n"
+           "  -t : junctions planned below this fraction of the commanded feed are listed, default %g\n"
+           "  -w : achieved feed sampling interval in ms, default %g\n"
+           "\n  The trace is recorded by the simulator with -S, see README.md.\n",
+           progname, DEFAULT_STEPS_PER_MM, SLOWDOWN_FRACTION, SAMPLE_MS);
+
+    return 1;
+}
+
+static inline bool speed_equal (float a, float b)
+{
+    return fabsf(a - b) <= SPEED_TOLERANCE * fmaxf(a, b) + 1.0f;
+}
+
+// Commanded feed at the junction to block idx, the lower of the programmed rates of the blocks meeting there.
+static float commanded_feed (size_t idx)
+{
+    return fminf(blocks[idx - 1].plan.programmed_rate, blocks[idx].plan.programmed_rate);
+}
+
+// Attributes a slow junction to a cause, walking backwards so the cause of a deceleration is inherited
+// from the junction it decelerates for.
+static void classify (float fraction)
+{
+    size_t idx = n_blocks;
+
+    while(--idx > 0) {
+
+        exec_block_t *block = &blocks[idx], *prev = &blocks[idx - 1];
+        float entry = block->plan.entry_speed_sqr, limit = commanded_feed(idx) * fraction;
+        float from_prev = prev->plan.entry_speed_sqr + 2.0f * prev->plan.acceleration * prev->plan.millimeters;
+        float to_next = (idx + 1 < n_blocks ? blocks[idx + 1].plan.entry_speed_sqr : 0.0f) + 2.0f * block->plan.acceleration * block->plan.millimeters;
+
+        if(entry >= limit * limit)
+            continue;
+
+        if(block->plan.max_junction_speed_sqr == 0.0f && entry == 0.0f)
+            block->cause = Cause_Starvation; // Restarted from a stop with an empty planner.
+        else if(speed_equal(entry, block->plan.max_junction_speed_sqr))
+            block->cause = Cause_Junction;
+        else if(speed_equal(entry, from_prev))
+            block->cause = Cause_Accel;
+        else if(entry >= to_next * (1.0f - SPEED_TOLERANCE) - 1.0f)
+            block->cause = idx + 1 < n_blocks && (blocks[idx + 1].cause == Cause_Lookahead || blocks[idx + 1].cause == Cause_Starvation)
+                            ? blocks[idx + 1].cause
+                            : Cause_Accel;
+        else // Planned lower than the following blocks allow
+            block->cause = block->plan.planned < block->plan.capacity ? Cause_Starvation : Cause_Lookahead;
+    }
+}
+
+static double plot_x (double distance, double max_distance)
+{
+    return PLOT_MARGIN + distance / max_distance * (PLOT_WIDTH - 2 * PLOT_MARGIN);
+}
+
+static double plot_y (double feed, double max_feed)
+{
+    return PLOT_HEIGHT - PLOT_MARGIN - feed / max_feed * (PLOT_HEIGHT - 2 * PLOT_MARGIN);
+}
+
+static void plot (FILE *svg, double max_distance)
+{
+    size_t idx;
+    int tick;
+    double max_feed = 1.0;
+
+    for(idx = 0; idx < n_blocks; idx++)
+        max_feed = fmax(max_feed, blocks[idx].plan.programmed_rate);
+    for(idx = 0; idx < n_samples; idx++)
+        max_feed = fmax(max_feed, samples[idx].feed);
+    max_feed *= 1.1;
+
+    if(max_distance <= 0.0)
+        max_distance = 1.0;
+
+    fprintf(svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" font-family=\"sans-serif\" font-size=\"11\">\n", PLOT_WIDTH, PLOT_HEIGHT);
+    fprintf(svg, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+
+    // Grid and axis labels
+    for(tick = 0; tick <= 10; tick++) {
+        double x = plot_x(max_distance * tick / 10.0, max_distance), y = plot_y(max_feed * tick / 10.0, max_feed);
+        fprintf(svg, "<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\" stroke=\"#ddd\"/>\n", x, PLOT_MARGIN, x, PLOT_HEIGHT - PLOT_MARGIN);
+        fprintf(svg, "<text x=\"%.1f\" y=\"%d\" text-anchor=\"middle\">%.1f</text>\n", x, PLOT_HEIGHT - PLOT_MARGIN + 15, max_distance * tick / 10.0);
+        fprintf(svg, "<line x1=\"%d\" y1=\"%.1f\" x2=\"%d\" y2=\"%.1f\" stroke=\"#ddd\"/>\n", PLOT_MARGIN, y, PLOT_WIDTH - PLOT_MARGIN, y);
+        fprintf(svg, "<text x=\"%d\" y=\"%.1f\" text-anchor=\"end\">%.0f</text>\n", PLOT_MARGIN - 5, y + 4, max_feed * tick / 10.0);
+    }
+    fprintf(svg, "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\">path (mm)</text>\n", PLOT_WIDTH / 2, PLOT_HEIGHT - 20);
+    fprintf(svg, "<text x=\"15\" y=\"%d\" transform=\"rotate(-90 15 %d)\" text-anchor=\"middle\">feed (mm/min)</text>\n", PLOT_HEIGHT / 2, PLOT_HEIGHT / 2);
+
+    // Slowdown markers
+    for(idx = 1; idx < n_blocks; idx++) {
+        if(blocks[idx].cause != Cause_None) {
+            double x = plot_x(blocks[idx].distance, max_distance);
+            fprintf(svg, "<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\" stroke=\"%s\" stroke-opacity=\"0.4\"><title>block %u: %s</title></line>\n",
+                     x, PLOT_MARGIN, x, PLOT_HEIGHT - PLOT_MARGIN, cause_color[blocks[idx].cause], (unsigned)idx, cause_name[blocks[idx].cause]);
+        }
+    }
+
+    // Commanded feed, programmed rate per block
+    fprintf(svg, "<polyline fill=\"none\" stroke=\"gray\" stroke-width=\"1.5\" points=\"");
+    for(idx = 0; idx < n_blocks; idx++) {
+        double end = idx + 1 < n_blocks ? blocks[idx + 1].distance : max_distance, y = plot_y(blocks[idx].plan.programmed_rate, max_feed);
+        fprintf(svg, "%.1f,%.1f %.1f,%.1f ", plot_x(blocks[idx].distance, max_distance), y, plot_x(end, max_distance), y);
+    }
+    fprintf(svg, "\"/>\n");
+
+    // Planned junction speeds
+    for(idx = 0; idx < n_blocks; idx++)
+        fprintf(svg, "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"2\" fill=\"green\"/>\n",
+                 plot_x(blocks[idx].distance, max_distance), plot_y(sqrt(blocks[idx].plan.entry_speed_sqr), max_feed));
+
+    // Achieved feed
+    fprintf(svg, "<polyline fill=\"none\" stroke=\"blue\" stroke-width=\"1\" points=\"");
+    for(idx = 0; idx < n_samples; idx++)
+        fprintf(svg, "%.1f,%.1f ", plot_x(samples[idx].distance, max_distance), plot_y(samples[idx].feed, max_feed));
+    fprintf(svg, "\"/>\n");
+
+    // Legend
+    fprintf(svg, "<text x=\"%d\" y=\"20\"><tspan fill=\"gray\">commanded</tspan> <tspan fill=\"green\">planned junction</tspan> <tspan fill=\"blue\">achieved</tspan>", PLOT_MARGIN);
+    for(idx = Cause_Junction; idx <= Cause_Starvation; idx++)
+        fprintf(svg, " <tspan fill=\"%s\">%s</tspan>", cause_color[idx], cause_name[idx]);
+    fprintf(svg, "</text>\n</svg>\n");
+}
+
+int main (int argc, char *argv[])
+{
+    int type = -1;
+    uint_fast8_t axis;
+    size_t idx;
+    unsigned counts[Cause_Starvation + 1] = {0};
+    char *progname = argv[0], *svg_name = NULL, *arg;
+    double steps_per_mm[STEPTRACE_MAX_AXES], sample_ms = SAMPLE_MS, fraction = SLOWDOWN_FRACTION;
+    double distance = 0.0, block_distance = 0.0;
+    uint64_t sample_ticks, sample_end = 0;
+    int32_t sample_position[STEPTRACE_MAX_AXES] = {0};
+    FILE *file, *svg;
+    steptrace_reader_t trace;
+
+    for(axis = 0; axis < STEPTRACE_MAX_AXES; axis++)
+        steps_per_mm[axis] = DEFAULT_STEPS_PER_MM;
+
+    while(argc > 2 && argv[1][0] == '-') {
+        switch(argv[1][1]) {
+
+            case 'o':
+                svg_name = argv[2];
+                break;
+
+            case 's':
+                for(axis = 0, arg = argv[2]; axis < STEPTRACE_MAX_AXES && *arg; axis++) {
+                    if((steps_per_mm[axis] = strtod(arg, &arg)) <= 0.0)
+                        return usage(progname);
+                    if(*arg == ',')
+                        arg++;
+                }
+                for(; axis < STEPTRACE_MAX_AXES; axis++) // Remaining axes as the last given
+                    steps_per_mm[axis] = steps_per_mm[axis - 1];
+                break;
+
+            case 't':
+                if((fraction = strtod(argv[2], NULL)) <= 0.0 || fraction > 1.0)
+                    return usage(progname);
+                break;
+
+            case 'w':
+                if((sample_ms = strtod(argv[2], NULL)) <= 0.0)
+                    return usage(progname);
+                break;
+
+            default:
+                return usage(progname);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    if(argc != 2)
+        return usage(progname);
+
+    if((file = fopen(argv[1], "rb")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if(!steptrace_reader_open(&trace, file) || trace.version < 2) {
+        fprintf(stderr, "%s: not a version 2 or later step trace file\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    sample_ticks = (uint64_t)(trace.clock_hz * sample_ms / 1000.0);
+    if(sample_ticks == 0)
+        sample_ticks = 1;
+    sample_end = sample_ticks;
+
+    while(type != StepTrace_End && (type = steptrace_read(&trace)) >= 0) {
+
+        // Close samples ending before this record.
+        // NOTE: The position is already updated from the record, at most one step is attributed to the wrong sample.
+        while(trace.ticks >= sample_end) {
+            double d = 0.0;
+            for(axis = 0; axis < trace.n_axis; axis++) {
+                double delta = (trace.position[axis] - sample_position[axis]) / steps_per_mm[axis];
+                d += delta * delta;
+            }
+            d = sqrt(d);
+            distance += d;
+            samples = grow(samples, n_samples, sizeof(sample_t));
+            samples[n_samples].distance = distance;
+            samples[n_samples++].feed = d / (sample_ms / 60000.0);
+            memcpy(sample_position, trace.position, sizeof(sample_position));
+            sample_end += sample_ticks;
+        }
+
+        if(type == StepTrace_BlockStart) {
+            blocks = grow(blocks, n_blocks, sizeof(exec_block_t));
+            memset(&blocks[n_blocks], 0, sizeof(exec_block_t));
+            memcpy(&blocks[n_blocks].plan, &trace.block, sizeof(steptrace_block_t));
+            blocks[n_blocks].start_ticks = trace.ticks;
+            blocks[n_blocks].distance = block_distance;
+            blocks[n_blocks].sample = n_samples;
+            block_distance += trace.block.millimeters;
+            n_blocks++;
+        }
+    }
+
+    fclose(file);
+
+    if(type == -2)
+        fprintf(stderr, "%s: corrupt trace, analyzing records read\n", argv[1]);
+
+    if(n_blocks > 1)
+        classify((float)fraction);
+
+    for(idx = 0; idx < n_blocks; idx++)
+        blocks[idx].achieved = blocks[idx].sample < n_samples ? samples[blocks[idx].sample].feed : 0.0;
+
+    printf("# block, path (mm), commanded, planned, achieved (mm/min), lookahead, cause\n");
+
+    for(idx = 1; idx < n_blocks; idx++) {
+        if(blocks[idx].cause != Cause_None) {
+            counts[blocks[idx].cause]++;
+            printf("%u, %.3f, %.1f, %.1f, %.1f, %u/%u, %s\n", (unsigned)idx, blocks[idx].distance, commanded_feed(idx), sqrt(blocks[idx].plan.entry_speed_sqr),
+                    blocks[idx].achieved, (unsigned)blocks[idx].plan.planned, (unsigned)blocks[idx].plan.capacity, cause_name[blocks[idx].cause]);
+        }
+    }
+
+    printf("# %u blocks, %.3f mm, %.3f s", (unsigned)n_blocks, block_distance, (double)trace.ticks / (double)trace.clock_hz);
+    for(idx = Cause_Junction; idx <= Cause_Starvation; idx++)
+        printf(", %s %u", cause_name[idx], counts[idx]);
+    printf("\n");
+
+    if(svg_name) {
+        if((svg = fopen(svg_name, "w")) == NULL) {
+            perror(svg_name);
+            return 1;
+        }
+        plot(svg, fmax(block_distance, distance));
+        fclose(svg);
+    }
+
+    free(blocks);
+    free(samples);
+
+    return type == -2 ? 2 : 0;
+}
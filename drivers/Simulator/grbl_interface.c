@@ -27,6 +27,7 @@
 #include "mcu.h"
 #include "driver.h"
 #include "simulator.h"
+#include "steptrace.h"
 
 #include "grbl/hal.h"
 
@@ -46,6 +47,9 @@ void grbl_app_init (void)
 {
     //setup local tacking vars
     next_print_time = args.step_time;
+
+    if (args.step_trace_file)
+        steptrace_open(args.step_trace_file, N_AXIS, F_CPU);
 }
 
 void grbl_per_tick (void)
@@ -61,8 +65,8 @@ void grbl_per_tick (void)
 
 void grbl_per_byte (void)
 {
-    if(sim.socket_fd) {
-        switch (platform_poll_stdin()) {
+    if(sim.socket_fd && sim.getkey) {
+        switch (sim.getkey()) {
 
             case 'e':
             case 'E':
@@ -142,12 +146,16 @@ void grbl_app_exit (void)
 {
     //force final position print
     print_steps(1);
+
+    steptrace_close(sim.masterclock);
 }
 
 //show current position in steps
 static void print_steps (bool force)
 { 
     static plan_block_t* printed_block = NULL;
+    static plan_block_t* traced_block = NULL;
+    static uint32_t traced_blocks = 0;
 
     plan_block_t* current_block = plan_get_current_block();
     int ocr = 0;
@@ -156,6 +164,25 @@ static void print_steps (bool force)
     if (sim.exit == exit_REQ && sys.state < STATE_HOMING )
         sim.exit = exit_OK;
 
+    //binary trace of every step, independent of the text output interval
+    if (args.step_trace_file) {
+        if (current_block != traced_block) {
+            if ((traced_block = current_block)) {
+                steptrace_block_t block = {
+                    .entry_speed_sqr = current_block->entry_speed_sqr,
+                    .max_junction_speed_sqr = plan_block_max_junction_speed_sqr(current_block),
+                    .acceleration = current_block->acceleration,
+                    .millimeters = current_block->millimeters,
+                    .programmed_rate = current_block->programmed_rate,
+                    .planned = plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available(),
+                    .capacity = plan_get_block_buffer_size() - 1
+                };
+                steptrace_block_start(sim.masterclock, traced_blocks++, &block);
+            }
+        }
+        steptrace_steps(sim.masterclock, sys_position);
+    }
+
     if (next_print_time == 0.0)
         return;  //no printing
 
@@ -200,13 +227,14 @@ static void printBlock (void)
         int i;
         for (i = 0; i < N_AXIS; i++) {
             if(b->direction_bits.mask & bit(i))
-                block_position[i] -= b->steps[i];
+                block_position[i] -= plan_block_steps(b, i);
             else
-                block_position[i] += b->steps[i];
+                block_position[i] += plan_block_steps(b, i);
             fprintf(args.block_out_file,"%d, ", block_position[i]);
         }
         fprintf(args.block_out_file,"%f\n", b->entry_speed_sqr);
         fflush(args.block_out_file); //TODO: needed?
+        steptrace_block_planned(sim.masterclock, block_position, b->entry_speed_sqr, b->millimeters, b->programmed_rate);
         last_block = b;
     }
 }
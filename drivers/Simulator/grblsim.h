@@ -0,0 +1,34 @@
+/*
+  grblsim.h - entry point of the replay harness when built as the libgrblsim.a library
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GRBLSIM_H_
+#define _GRBLSIM_H_
+
+#ifdef GRBL_REENTRANT
+
+// Replays a session as replay.exe does, argv holds the replay.exe command line, argv[0] is the program name.
+// Returns the replay.exe exit code. The core state is thread local, calls from different threads run in
+// parallel, each with its own machine.
+// NOTE: Each call must be made from a new thread since the core can only be initialized once per thread.
+//       Use -o to write the trace of each call to a separate file.
+int grbl_replay (int argc, char *argv[]);
+
+#endif
+
+#endif
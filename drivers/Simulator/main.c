@@ -34,6 +34,7 @@
 
 #include "simulator.h"
 #include "eeprom.h"
+#include "sim_io.h"
 #include "grbl_interface.h"
 
 #include "grbl/grbllib.h"
@@ -43,6 +44,7 @@ const char* progname;
 
 static int socket_fd = 0;
 static fd_set rfds;
+static uint8_t (*session_getchar)(void);
 
 int usage(const char* badarg)
 {
@@ -54,9 +56,13 @@ int usage(const char* badarg)
       "  Options:\n"
       "    -r <report time>   : minimum time step for printing stepper values. Default=0=no print.\n"
       "    -t <time factor>   : multiplier to realtime clock. Default=1. (needs work)\n"
+      "    -x                 : event driven, skip idle clock ticks. With -t 0 run as fast as possible.\n"
+      "    -T                 : host I/O in separate thread, the simulation loop only runs hardware timing.\n"
       "    -g <response file> : file to report responses from grbl.  default = stdout\n"
       "    -b <block file>    : file to report each block executed.  default = stdout\n"
       "    -s <step file>     : file to report each step executed.  default = stderr\n"
+      "    -S <trace file>    : binary trace of every step, all axes. Read with stepdump.exe\n"
+      "    -w <session file>  : record bytes received with time stamps. Replay with replay.exe\n"
       "    -e <EEPROM file>   : file containing grblHAL settings.  default = EEPROM.DAT\n"
       "    -p <port>          : port to open raw telnet communication.\n"
       "    -c<comment_char>   : character to print before each line from grbl.  default = '#'\n"
@@ -130,6 +136,17 @@ uint8_t sim_socket_in()
     return c;
 }
 
+//record char read for replay
+uint8_t sim_session_in()
+{
+    uint8_t c = session_getchar();
+
+    if(c)
+        sim_session_record(c);
+
+    return c;
+}
+
 static void exithandler (int signum)
 {
     eeprom_close();
@@ -169,6 +186,14 @@ int main(int argc, char *argv[])
                     args.comment_char = 0;
                     break;
 
+                case 'x': //Event driven clock
+                    sim.event_driven = true;
+                    break;
+
+                case 'T': //Host I/O in separate thread
+                    args.io_thread = true;
+                    break;
+
                 case 't': //Tick rate
                     argv++; argc--;
                     tick_rate = atof(*argv);
@@ -199,6 +224,26 @@ int main(int argc, char *argv[])
                     }
                     break;
 
+                case 'S': //Binary step trace file
+                    argv++; argc--;
+                    args.step_trace_file = fopen(*argv,"wb");
+                    if (!args.step_trace_file) {
+                        perror("fopen");
+                        printf("Error opening : %s\n",*argv);
+                        return(usage(0));
+                    }
+                    break;
+
+                case 'w': //Session record file
+                    argv++; argc--;
+                    args.session_file = fopen(*argv,"w");
+                    if (!args.session_file) {
+                        perror("fopen");
+                        printf("Error opening : %s\n",*argv);
+                        return(usage(0));
+                    }
+                    break;
+
                 case 'g': //Grbl output
                     argv++; argc--;
                     args.serial_out_file = fopen(*argv,"w");
@@ -309,12 +354,23 @@ int main(int argc, char *argv[])
 */
         sim.getchar = sim_socket_in;
         sim.putchar = sim_socket_out;
+        sim.getkey = platform_poll_stdin;
 
     } else {
         sim.getchar = platform_poll_stdin;
         sim.putchar = sim_serial_out;
     }
 
+    if(args.io_thread && !sim_io_start()) {
+        printf("Fatal: Unable to start I/O thread.\n");
+        exit(-5);
+    }
+
+    if(args.session_file) {
+        session_getchar = sim.getchar;
+        sim.getchar = sim_session_in;
+    }
+
     //launch a thread with the original grbl code.
     plat_thread_t *th = platform_start_thread(grbl_main_thread); 
     if (!th){
@@ -329,6 +385,9 @@ int main(int argc, char *argv[])
     // All the stream io and interrupt happen in this thread.
     sim_loop();
 
+    if(args.io_thread)
+        sim_io_stop();
+
     // Graceful exit
     shutdown_simulator();
 
@@ -338,6 +397,12 @@ int main(int argc, char *argv[])
     fclose(args.block_out_file);
     fclose(args.step_out_file);
     fclose(args.serial_out_file);
+    if(args.step_trace_file)
+        fclose(args.step_trace_file);
+    if(args.session_file) {
+        sim_session_close();
+        fclose(args.session_file);
+    }
 
     if(args.port) {
         if(sim.socket_fd)
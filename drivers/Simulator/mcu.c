@@ -133,6 +133,89 @@ void mcu_master_clock (void)
     }
 }
 
+// Returns the number of master clock ticks until the first tick that may fire an interrupt.
+// Timer counting follows mcu_master_clock() above.
+static uint64_t timer_ticks_to_expiry (mcu_timer_t *t, bool prescaled)
+{
+    uint64_t decs;
+
+    if(t->value == 0) {
+        if(t->load == 0)
+            return UINT64_MAX; // never fires
+        decs = (uint64_t)t->load + 1;
+    } else
+        decs = t->value;
+
+    if(!prescaled || t->prescaler == 0)
+        return decs;
+
+    return (t->prescale > 1 ? t->prescale : 1) + (decs - 1) * t->prescaler;
+}
+
+// Advances a timer by ticks without expiry, ticks must be less than timer_ticks_to_expiry().
+static void timer_skip_ticks (mcu_timer_t *t, bool prescaled, uint64_t ticks)
+{
+    uint64_t decs = ticks, first;
+
+    if(prescaled && t->prescaler) {
+        first = t->prescale > 1 ? t->prescale : 1;
+        if(ticks < first) {
+            t->prescale -= ticks;
+            return;
+        }
+        decs = 1 + (ticks - first) / t->prescaler;
+        t->prescale = t->prescaler - (ticks - first) % t->prescaler;
+    }
+
+    if(decs && t->value == 0) {
+        t->value = t->load;
+        decs--;
+    }
+
+    t->value -= (uint32_t)decs;
+}
+
+uint64_t mcu_ticks_to_next_event (void)
+{
+    uint_fast8_t i;
+    uint64_t ticks = UINT64_MAX, t;
+
+    if(!booted)
+        return 1;
+
+    for(i = 0; i < MCU_N_GPIO; i++) {
+        if(gpio[i].irq_state.value & gpio[i].irq_mask.value)
+            return 1;
+    }
+
+    for(i = 0; i < MCU_N_TIMERS; i++) {
+        if(timer[i].enable && (t = timer_ticks_to_expiry(&timer[i], true)) < ticks)
+            ticks = t;
+    }
+
+    if(systick_timer.enable && (t = timer_ticks_to_expiry(&systick_timer, false)) < ticks)
+        ticks = t;
+
+    return ticks;
+}
+
+// Advances the clock by ticks without firing any interrupts, ticks must be less than mcu_ticks_to_next_event().
+void mcu_skip_ticks (uint64_t ticks)
+{
+    uint_fast8_t i;
+
+    if(!booted || ticks == 0)
+        return;
+
+    for(i = 0; i < MCU_N_TIMERS; i++) {
+        if(timer[i].enable)
+            timer_skip_ticks(&timer[i], true, ticks);
+    }
+
+    if(systick_timer.enable)
+        timer_skip_ticks(&systick_timer, false, ticks);
+}
+
 void mcu_gpio_set (gpio_port_t *port, uint8_t pins, uint8_t mask)
 {
     port->state.value = (port->state.value & ~mask) | (pins & mask);
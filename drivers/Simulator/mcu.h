@@ -110,6 +110,8 @@ void mcu_reset (void);
 void mcu_enable_interrupts (void);
 void mcu_disable_interrupts (void);
 void mcu_master_clock (void);
+uint64_t mcu_ticks_to_next_event (void);
+void mcu_skip_ticks (uint64_t ticks);
 void mcu_register_irq_handler (interrupt_handler handler, irq_num_t irq_num);
 void mcu_gpio_set (gpio_port_t *port, uint8_t pins, uint8_t mask);
 uint8_t mcu_gpio_get (gpio_port_t *port, uint8_t mask);
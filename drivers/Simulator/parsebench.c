@@ -0,0 +1,234 @@
+/*
+  parsebench.c - g-code parser line rate benchmark
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Host version of the $PBENCH command, see grbl/gcode_bench.c. Lines from the generated corpora,
+  or from the G-code files given, are filtered and executed by gc_execute_block() in check mode.
+  Cycles are host nanoseconds.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/nvs_buffer.h"
+#include "grbl/stepper.h"
+#include "grbl/state_machine.h"
+#include "grbl/gcode_bench.h"
+
+static const char *progname;
+
+static int usage (const char* badarg)
+{
+    if (badarg)
+        printf("Unrecognized option %s\n", badarg);
+
+    printf("Usage: \n"
+     "%s <Options> [gcode_file ...]\n"
+     "  Options:\n"
+     "    -n <n>    : number of lines per generated corpus, default %d\n"
+     "\n  Runs the generated surfacing, raster and engraving corpora, or the G-code file(s) if given,"
+     "\n  through the parser in check mode and reports lines per second and nanoseconds per line,"
+     "\n  in total and by line class. The output format is the same as for the $PBENCH command.",
+     progname, PARSER_BENCHMARK_LINES);
+
+    return -1;
+}
+
+static uint32_t get_ns (void)
+{
+    return platform_ns();
+}
+
+static uint32_t get_us (void)
+{
+    return platform_ns() / 1000UL;
+}
+
+static uint32_t get_ms (void)
+{
+    return platform_ns() / 1000000UL;
+}
+
+static void bench_write (const char *data)
+{
+    fputs(data, stdout);
+}
+
+static void bench_write_null (const char *data)
+{
+}
+
+static int16_t bench_read (void)
+{
+    return SERIAL_NO_DATA;
+}
+
+static bool bench_suspend_read (bool suspend)
+{
+    return false;
+}
+
+static status_code_t bench_report_status_message (status_code_t status_code)
+{
+    return status_code;
+}
+
+static int bench_init (void)
+{
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = protocol_execute_noop;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION;
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+    hal.stream.enqueue_realtime_command = protocol_enqueue_realtime_command;
+    hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_alloc(); // Allocate memory block for NVS buffer
+#endif
+
+    report_init_fns();
+
+    if(!driver_init())
+       return -1;
+
+    hal.stream.read = bench_read;
+    hal.stream.write = bench_write_null; // Suppress startup messages
+    hal.stream.write_all = bench_write_null;
+    hal.stream.suspend_read = bench_suspend_read;
+    hal.get_cycle_count = get_ns;
+    hal.f_cycle_count = 1000000000UL;
+    hal.get_micros = get_us;
+    hal.get_elapsed_ticks = get_ms;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_init();
+#endif
+    settings_init();
+
+    if(!plan_alloc() || !hal.driver_setup(&settings))
+        return -1;
+
+    memset(sys_position, 0, sizeof(sys_position));
+    sys.override.feed_rate = DEFAULT_FEED_OVERRIDE;
+    sys.override.rapid_rate = DEFAULT_RAPID_OVERRIDE;
+    sys.override.spindle_rpm = DEFAULT_SPINDLE_RPM_OVERRIDE;
+
+    gc_init(true);
+    plan_reset();
+    st_reset();
+    sync_position();
+
+    report_init_fns();
+    grbl.report.status_message = bench_report_status_message;
+
+    set_state(STATE_IDLE);
+
+    hal.stream.write = bench_write;
+    hal.stream.write_all = bench_write;
+
+    return 0;
+}
+
+static int bench_file (const char *filename)
+{
+    char buffer[LINE_BUFFER_SIZE];
+    uint32_t ms;
+    gc_bench_t bench;
+    FILE *file;
+
+    if((file = fopen(filename, "r")) == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    gc_init(true);
+    set_state(STATE_CHECK_MODE);
+    gc_bench_init(&bench);
+
+    ms = get_ms();
+
+    while(fgets(buffer, sizeof(buffer), file))
+        gc_bench_line(&bench, buffer);
+
+    ms = get_ms() - ms;
+
+    fclose(file);
+    set_state(STATE_IDLE);
+
+    gc_bench_report(filename, &bench, ms);
+
+    return bench.errors ? 1 : 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int n_files = 0, failed = 0;
+    uint32_t lines = PARSER_BENCHMARK_LINES;
+    char **files = malloc(argc * sizeof(char *));
+
+    progname = argv[0];
+
+    while (argc > 1) {
+        argv++; argc--;
+        if (argv[0][0] == '-') {
+            switch(argv[0][1]) {
+
+                case 'n':
+                    if(argc < 2 || (lines = (uint32_t)strtol(argv[1], NULL, 10)) < 1)
+                        return usage(*argv);
+                    argv++; argc--;
+                    break;
+
+                case 'h':
+                    return usage(NULL);
+
+                default:
+                    return usage(*argv);
+            }
+        } else //handle positional arguments
+            files[n_files++] = *argv;
+    }
+
+    if(bench_init()) {
+        printf("Initialization failed\n");
+        return -1;
+    }
+
+    if(n_files) for(int idx = 0; idx < n_files; idx++)
+        failed += bench_file(files[idx]) ? 1 : 0;
+    else
+        failed = gc_bench_run(lines) == Status_OK ? 0 : 1;
+
+    free(files);
+
+    return failed;
+}
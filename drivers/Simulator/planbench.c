@@ -0,0 +1,544 @@
+/*
+  planbench.c - planner throughput benchmark
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Motions are pushed straight into plan_buffer_line(), with the oldest block discarded whenever
+  the buffer is full (the steady state when streaming a job), and the time spent in each call is
+  measured. Replans per block is the number of blocks between the optimally planned pointer and
+  the buffer head when a block is added, that is, the number of blocks the planner has to revisit.
+
+  Synthetic corpora are generated from fixed segment patterns, G-code files are first run through
+  the parser and the real stepper code, as in the validator, and the planned motions recorded for
+  the benchmark run. Settings are the compiled in defaults.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "platform.h"
+#include "validator.h"
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/nvs_buffer.h"
+#include "grbl/stepper.h"
+#include "grbl/limits.h"
+#include "grbl/state_machine.h"
+#include "grbl/motion_control.h"
+
+#define CIRCLE_RADIUS 10.0f // mm
+#define LINE_TRAVEL 100.0f  // mm, the line pattern reverses direction after this distance
+
+typedef struct {
+    float target[N_AXIS];
+    plan_line_data_t pl_data;
+} motion_t;
+
+typedef struct {
+    const char *name;
+    motion_t *motion;
+    uint32_t length;
+    uint32_t size;
+} corpus_t;
+
+typedef struct {
+    uint32_t blocks;
+    uint64_t ns;
+    uint32_t max_ns;
+    uint64_t replans;
+    uint32_t max_replans;
+} bench_result_t;
+
+typedef struct {
+    uint32_t segments;
+    float segment_length;
+    float feed_rate;
+    uint32_t repeat;
+    uint16_t planner_blocks;
+    const char *pattern;
+} arg_vars_t;
+
+static arg_vars_t args = {
+    .segments = 100000,
+    .segment_length = 0.1f,
+    .feed_rate = 1000.0f,
+    .repeat = 1,
+    .planner_blocks = 0,
+    .pattern = NULL
+};
+
+static const char *progname;
+
+// Set when recording motions from a G-code file.
+static corpus_t *recording = NULL;
+static plan_block_t *recorded = NULL;
+static int32_t recorded_position[N_AXIS];
+
+// Functions for peeking inside planner state:
+plan_block_t *get_block_buffer_head();
+plan_block_t *get_block_buffer_tail();
+plan_block_t *get_block_buffer_planned();
+
+static int usage (const char* badarg)
+{
+    if (badarg)
+        printf("Unrecognized option %s\n", badarg);
+
+    printf("Usage: \n"
+     "%s <Options> [gcode_file ...]\n"
+     "  Options:\n"
+     "    -b <n>    : planner buffer size in blocks, default $7 default\n"
+     "    -n <n>    : number of segments per synthetic pattern, default 100000\n"
+     "    -l <mm>   : synthetic segment length, default 0.1\n"
+     "    -f <rate> : synthetic feed rate in mm/min, default 1000\n"
+     "    -p <name> : synthetic pattern to run, line, zigzag, circle or random, default all\n"
+     "    -r <n>    : number of times each corpus is pushed through the planner, default 1\n"
+     "\n  Runs the synthetic patterns, or the motions from the G-code file(s) if given,"
+     "\n  through the planner and reports blocks per second, average and worst case"
+     "\n  insertion time and replanned blocks per insertion.",
+     progname);
+
+    return -1;
+}
+
+static void bench_write (const char *data)
+{
+}
+
+static int16_t bench_read (void)
+{
+    return SERIAL_NO_DATA;
+}
+
+static bool bench_suspend_read (bool suspend)
+{
+    return false;
+}
+
+static bool corpus_add (corpus_t *corpus, float *target, plan_line_data_t *pl_data)
+{
+    if(corpus->length == corpus->size) {
+
+        motion_t *motion = realloc(corpus->motion, (corpus->size ? corpus->size * 2 : 1024) * sizeof(motion_t));
+
+        if(motion == NULL)
+            return false;
+
+        corpus->motion = motion;
+        corpus->size = corpus->size ? corpus->size * 2 : 1024;
+    }
+
+    memcpy(corpus->motion[corpus->length].target, target, sizeof(corpus->motion[0].target));
+    memcpy(&corpus->motion[corpus->length].pl_data, pl_data, sizeof(plan_line_data_t));
+    corpus->length++;
+
+    return true;
+}
+
+static void corpus_free (corpus_t *corpus)
+{
+    free(corpus->motion);
+    memset(corpus, 0, sizeof(corpus_t));
+}
+
+// Synthetic patterns
+
+static bool generate (corpus_t *corpus, const char *pattern)
+{
+    uint32_t segment;
+    uint_fast8_t idx;
+    float target[N_AXIS] = {0}, position = 0.0f, direction = 1.0f;
+    plan_line_data_t pl_data;
+
+    memset(&pl_data, 0, sizeof(plan_line_data_t));
+    pl_data.feed_rate = args.feed_rate;
+
+    srand(1);
+
+    for(segment = 1; segment <= args.segments; segment++) {
+
+        if(!strcmp(pattern, "line")) {
+            // Collinear segments, best case: the planned pointer follows the head.
+            if((position += direction * args.segment_length) > LINE_TRAVEL || position < 0.0f)
+                position += (direction = -direction) * 2.0f * args.segment_length;
+            target[X_AXIS] = position;
+        } else if(!strcmp(pattern, "zigzag")) {
+            // 90 degree corners, junction speed limited.
+            target[X_AXIS] += args.segment_length * 0.70710678f;
+            target[Y_AXIS] = segment & 1 ? args.segment_length * 0.70710678f : 0.0f;
+        } else if(!strcmp(pattern, "circle")) {
+            // Arc segments, small direction change per junction.
+            float angle = (float)segment * args.segment_length / CIRCLE_RADIUS;
+            target[X_AXIS] = CIRCLE_RADIUS * cosf(angle) - CIRCLE_RADIUS;
+            target[Y_AXIS] = CIRCLE_RADIUS * sinf(angle);
+        } else if(!strcmp(pattern, "random")) {
+            // Random direction in all axes, worst case for per axis limits.
+            float delta[N_AXIS], length = 0.0f;
+            for(idx = 0; idx < N_AXIS; idx++) {
+                delta[idx] = (float)rand() / (float)RAND_MAX - 0.5f;
+                length += delta[idx] * delta[idx];
+            }
+            length = sqrtf(length);
+            for(idx = 0; idx < N_AXIS; idx++)
+                target[idx] += length > 0.0f ? delta[idx] * args.segment_length / length : 0.0f;
+        } else
+            return false;
+
+        if(!corpus_add(corpus, target, &pl_data))
+            return false;
+    }
+
+    corpus->name = pattern;
+
+    return true;
+}
+
+// G-code file recording
+
+// Adds the blocks queued since the last call to the corpus being recorded. The block target is
+// reconstructed from the step counts, as planned, and the programmed rate replaces the feed rate.
+static void record_blocks (void)
+{
+    uint_fast8_t idx;
+    float target[N_AXIS];
+    plan_line_data_t pl_data;
+    plan_block_t *head = get_block_buffer_head();
+
+    while(recorded != head) {
+
+        for(idx = 0; idx < N_AXIS; idx++) {
+            recorded_position[idx] += recorded->direction_bits.mask & bit(idx) ? -(int32_t)plan_block_steps(recorded, idx) : (int32_t)plan_block_steps(recorded, idx);
+            target[idx] = (float)recorded_position[idx] / settings.axis[idx].steps_per_mm;
+        }
+
+        memset(&pl_data, 0, sizeof(plan_line_data_t));
+        pl_data.feed_rate = recorded->programmed_rate;
+        pl_data.condition = recorded->condition;
+        pl_data.condition.inverse_time = Off;
+        pl_data.overrides = recorded->overrides;
+#ifdef COMPACT_PLAN_BLOCKS
+        pl_data.spindle.rpm = recorded->spindle.rpm;
+#else
+        pl_data.spindle = recorded->spindle;
+#endif
+        pl_data.line_number = recorded->line_number;
+
+        corpus_add(recording, target, &pl_data);
+
+        recorded = recorded->next;
+    }
+}
+
+// Records the queued blocks and executes them by calling the stepper interrupt handler until a
+// planner block has been consumed or the stepper goes idle. The stepper is only started by the
+// core when the buffer is full or when it waits for the motions to complete.
+static void bench_execute_realtime (uint_fast16_t state)
+{
+    if(recording == NULL)
+        return;
+
+    record_blocks();
+
+    if(validator_driver.stepper_running) {
+
+        uint_fast16_t available = plan_get_block_buffer_available();
+
+        do {
+            hal.stepper.interrupt_callback();
+            st_prep_buffer();
+        } while(validator_driver.stepper_running && plan_get_block_buffer_available() == available);
+    }
+}
+
+// Strips whitespace and comments and converts to upper case, as the protocol loop does.
+static char *clean_line (char *line)
+{
+    char c, *in = line, *out = line;
+    bool comment = false;
+
+    while((c = *in++) != '\0') {
+        if(c == ';' || c == '\r' || c == '\n')
+            break;
+        if(comment)
+            comment = c != ')';
+        else if(c == '(')
+            comment = true;
+        else if(c > ' ')
+            *out++ = toupper(c);
+    }
+
+    *out = '\0';
+
+    return line;
+}
+
+static bool record_file (corpus_t *corpus, const char *filename)
+{
+    char buffer[LINE_BUFFER_SIZE * 4], *line;
+    uint32_t line_number = 0;
+    status_code_t status;
+    FILE *file;
+
+    if((file = fopen(filename, "r")) == NULL) {
+        perror(filename);
+        return false;
+    }
+
+    gc_init(true);
+    sync_position();
+    memset(recorded_position, 0, sizeof(recorded_position));
+    recorded = get_block_buffer_head();
+    recording = corpus;
+
+    while(fgets(buffer, sizeof(buffer), file)) {
+        line_number++;
+        line = clean_line(buffer);
+        if(*line == '\0' || *line == '$' || *line == '%')
+            continue;
+        if((status = gc_execute_block(line, NULL)) != Status_OK) {
+            fprintf(stderr, "%s:%" PRIu32 ": error %d\n", filename, line_number, (int)status);
+            gc_state.last_error = Status_OK;
+        }
+        if(sys.abort)
+            break;
+    }
+
+    protocol_buffer_synchronize();
+    record_blocks();
+
+    recording = NULL;
+    fclose(file);
+
+    corpus->name = filename;
+
+    return !sys.abort;
+}
+
+// Benchmark
+
+static bool bench_run (corpus_t *corpus, bench_result_t *result)
+{
+    uint32_t idx, repeat, start, elapsed, replans;
+    plan_block_t *block, *head;
+
+    memset(result, 0, sizeof(bench_result_t));
+    memset(sys_position, 0, sizeof(sys_position));
+    plan_reset();
+    st_reset();
+    plan_sync_position();
+
+    for(repeat = 0; repeat < args.repeat; repeat++) {
+
+        for(idx = 0; idx < corpus->length; idx++) {
+
+            // Consume the oldest block, as the stepper would, when the buffer is full.
+            if(plan_check_full_buffer())
+                plan_discard_current_block();
+
+            replans = 0;
+            head = get_block_buffer_head();
+            for(block = get_block_buffer_planned(); block != head; block = block->next)
+                replans++;
+
+            start = platform_ns();
+            plan_buffer_line(corpus->motion[idx].target, &corpus->motion[idx].pl_data);
+            elapsed = platform_ns() - start;
+
+            result->blocks++;
+            result->ns += elapsed;
+            result->replans += replans;
+            if(elapsed > result->max_ns)
+                result->max_ns = elapsed;
+            if(replans > result->max_replans)
+                result->max_replans = replans;
+        }
+    }
+
+#ifdef PLANNER_HOLD_LINE
+    plan_flush_held_line();
+#endif
+
+    return result->blocks > 0;
+}
+
+static void bench_report (corpus_t *corpus, bench_result_t *result)
+{
+    double seconds = (double)result->ns / 1e9;
+
+    printf("%-24s %10" PRIu32 " %12.0f %9.3f %9.3f %9.2f %7" PRIu32 "\n",
+            corpus->name, result->blocks,
+            seconds > 0.0 ? (double)result->blocks / seconds : 0.0,
+            (double)result->ns / (double)result->blocks / 1000.0,
+            (double)result->max_ns / 1000.0,
+            (double)result->replans / (double)result->blocks,
+            result->max_replans);
+}
+
+static int bench_init (void)
+{
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = bench_execute_realtime;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION;
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+    hal.stream.enqueue_realtime_command = protocol_enqueue_realtime_command;
+    hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_alloc(); // Allocate memory block for NVS buffer
+#endif
+
+    report_init_fns();
+
+    if(!driver_init())
+       return -1;
+
+    hal.stream.read = bench_read;
+    hal.stream.write = bench_write;
+    hal.stream.write_all = bench_write;
+    hal.stream.suspend_read = bench_suspend_read;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_init();
+#endif
+    settings_init();
+
+    if(args.planner_blocks)
+        settings.planner_buffer_blocks = args.planner_blocks;
+
+    if(!plan_alloc() || !hal.driver_setup(&settings))
+        return -1;
+
+    memset(sys_position, 0, sizeof(sys_position));
+    sys.override.feed_rate = DEFAULT_FEED_OVERRIDE;
+    sys.override.rapid_rate = DEFAULT_RAPID_OVERRIDE;
+    sys.override.spindle_rpm = DEFAULT_SPINDLE_RPM_OVERRIDE;
+
+    gc_init(true);
+    plan_reset();
+    st_reset();
+    limits_set_homing_axes();
+    sync_position();
+
+    report_init_fns();
+
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    static const char *patterns[] = { "line", "zigzag", "circle", "random" };
+
+    int n_files = 0, failed = 0;
+    char **files = malloc(argc * sizeof(char *));
+    corpus_t corpus = {0};
+    bench_result_t result;
+
+    progname = argv[0];
+
+    while (argc > 1) {
+        argv++; argc--;
+        if (argv[0][0] == '-') {
+            if(argv[0][1] != 'h' && argc < 2)
+                return usage(*argv);
+            switch(argv[0][1]) {
+
+                case 'b':
+                    args.planner_blocks = (uint16_t)strtol(argv[1], NULL, 10);
+                    break;
+
+                case 'n':
+                    args.segments = (uint32_t)strtol(argv[1], NULL, 10);
+                    break;
+
+                case 'l':
+                    if((args.segment_length = strtof(argv[1], NULL)) <= 0.0f)
+                        return usage(*argv);
+                    break;
+
+                case 'f':
+                    if((args.feed_rate = strtof(argv[1], NULL)) <= 0.0f)
+                        return usage(*argv);
+                    break;
+
+                case 'p':
+                    args.pattern = argv[1];
+                    break;
+
+                case 'r':
+                    if((args.repeat = (uint32_t)strtol(argv[1], NULL, 10)) < 1)
+                        return usage(*argv);
+                    break;
+
+                case 'h':
+                    return usage(NULL);
+
+                default:
+                    return usage(*argv);
+            }
+            argv++; argc--;
+        } else //handle positional arguments
+            files[n_files++] = *argv;
+    }
+
+    if(bench_init()) {
+        printf("Initialization failed\n");
+        return -1;
+    }
+
+    printf("N_AXIS: %d, planner blocks: %u, segment length: %.3f mm\n\n", N_AXIS, (unsigned int)plan_get_block_buffer_size(), (double)args.segment_length);
+    printf("%-24s %10s %12s %9s %9s %9s %7s\n", "corpus", "blocks", "blocks/s", "avg us", "max us", "replans", "max");
+
+    if(n_files) for(int idx = 0; idx < n_files; idx++) {
+        if(record_file(&corpus, files[idx]) && bench_run(&corpus, &result))
+            bench_report(&corpus, &result);
+        else
+            failed++;
+        corpus_free(&corpus);
+    } else {
+        uint_fast8_t idx, runs = 0;
+        for(idx = 0; idx < sizeof(patterns) / sizeof(char *); idx++) {
+            if(args.pattern && strcmp(args.pattern, patterns[idx]))
+                continue;
+            if(generate(&corpus, patterns[idx]) && bench_run(&corpus, &result))
+                bench_report(&corpus, &result);
+            else
+                failed++;
+            corpus_free(&corpus);
+            runs++;
+        }
+        if(runs == 0)
+            return usage(args.pattern);
+    }
+
+    free(files);
+
+    return failed;
+}
@@ -0,0 +1,934 @@
+/*
+  replay.c - deterministic replay of a recorded host session
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  A session file, as written by grbl_sim.exe -w, holds the bytes sent by the host with the time
+  they were sent. Each line is a record:
+
+    <ms> <data>
+
+  where <ms> is the time since start in milliseconds and <data> the bytes sent, with \n, \r, \\
+  and \xHH escapes. Lines starting with # are comments.
+
+  The core is run single threaded in virtual time, the stepper timer is replaced by the step timer
+  periods summed up as by stepbench.exe and delays are added to the virtual time. Bytes are fed to
+  the input buffer no earlier than their time stamp and no faster than the baud rate allows.
+  Realtime commands bypass the input buffer, as by the serial interrupt, and are not held up by
+  a full buffer. Otherwise bytes are fed in the order sent. When the core is idle virtual time jumps to the next byte, so the replay
+  is deterministic and the output, the trace, is the same for each run.
+
+  The trace can be compared to a golden trace and the job metrics to a baseline, regressions are
+  reported and cause a non-zero exit code.
+
+  When built with GRBL_REENTRANT, as for libgrblsim.a, main() is replaced by grbl_replay(), see grblsim.h.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform.h"
+#include "validator.h"
+#include "grblsim.h"
+#include "steptrace.h"
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/nvs_buffer.h"
+#include "grbl/stepper.h"
+#include "grbl/limits.h"
+#include "grbl/state_machine.h"
+#include "grbl/profile.h"
+#include "grbl/flightrec.h"
+#include "grbl/linetime.h"
+#include "grbl/scheduler.h"
+#include "grbl/heightmap.h"
+#include "grbl/pvt.h"
+#include "grbl/raster.h"
+#include "grbl/motion_control.h"
+
+#define TRACE_LINE_LENGTH 256
+#define IDLE_CALLS 10 // Calls without input read or planner change before virtual time jumps to the next byte.
+
+typedef struct {
+    uint64_t time;  // Time stamp in step timer ticks.
+    uint8_t data;
+    bool realtime;  // Realtime command, bypasses the input buffer.
+} session_byte_t;
+
+typedef struct {
+    session_byte_t *bytes;
+    uint32_t length;
+    uint32_t next;          // Next byte to be fed to the input buffer.
+    uint32_t next_rt;       // Next realtime command.
+    uint64_t link_free;     // Virtual time the serial link can transfer the next byte.
+} session_t;
+
+typedef struct {
+    double job_time;        // Virtual time at end of replay (s).
+    double motion_time;     // Virtual time spent with the stepper running (s).
+    uint32_t blocks;
+    uint32_t segments;
+    uint32_t underflows;
+    uint32_t starved;       // Motion stopped with the planner empty while a line is being received.
+    uint32_t errors;
+    uint32_t alarms;
+    uint32_t overflows;     // Bytes dropped by a full input buffer, realtime command not accepted.
+} metrics_t;
+
+typedef struct arg_vars {
+    FILE *trace_file;
+    FILE *golden_file;
+    FILE *baseline_file;
+    FILE *metrics_file;
+    FILE *step_trace_file;
+    bool timestamps;        // Prefix trace lines with virtual time.
+    float tolerance;        // Allowed job and motion time increase vs. baseline (%).
+    uint32_t baud_ticks;
+} arg_vars_t;
+
+static THREAD_LOCAL arg_vars_t args;
+static THREAD_LOCAL session_t session;
+static THREAD_LOCAL metrics_t metrics;
+static THREAD_LOCAL const char *progname;
+static THREAD_LOCAL uint64_t ticks = 0;          // Virtual time in step timer ticks.
+static THREAD_LOCAL uint64_t motion_start;
+static THREAD_LOCAL uint32_t reads = 0, idle_calls = 0, trace_lines = 0, golden_line = 0;
+static THREAD_LOCAL bool trace_mismatch = false, running = false;
+static THREAD_LOCAL char trace_line[TRACE_LINE_LENGTH];
+static THREAD_LOCAL uint_fast16_t trace_length = 0;
+static THREAD_LOCAL double trace_time;
+static THREAD_LOCAL stream_rx_buffer_t rxbuffer = {0};
+#ifdef ENABLE_RX_FILTER
+static THREAD_LOCAL stream_rx_filter_t rxfilter = {0};
+#endif
+static THREAD_LOCAL stepper_go_idle_ptr go_idle;
+static THREAD_LOCAL stepper_wake_up_ptr wake_up;
+
+static int usage (const char* badarg)
+{
+    if (badarg)
+        printf("Unrecognized option %s\n", badarg);
+
+    printf("Usage: \n"
+     "%s <Options> session_file\n"
+     "  Options:\n"
+     "    -o <trace file>    : write trace to file, default stdout\n"
+     "    -g <golden file>   : compare trace to golden trace\n"
+     "    -m <metrics file>  : write job metrics to file\n"
+     "    -b <baseline file> : compare job metrics to baseline metrics file\n"
+     "    -p <percent>       : allowed job and motion time increase vs. baseline, default 0\n"
+     "    -B <baud rate>     : serial link speed, default 115200\n"
+     "    -t                 : prefix trace lines with virtual time in ms\n"
+     "    -S <step trace>    : write binary step trace to file, for stepdump.exe and feedplot.exe\n"
+     "\n  Replays a session recorded with grbl_sim.exe -w in virtual time and outputs the responses"
+     "\n  from grbl as a trace. Exits with 1 if the trace differs from the golden trace or the metrics"
+     "\n  regressed vs. the baseline.\n",
+     progname);
+
+    return -1;
+}
+
+static inline double ticks_to_ms (uint64_t t)
+{
+    return (double)t * 1000.0 / (double)hal.f_step_timer;
+}
+
+static bool is_realtime (uint8_t c)
+{
+    return c == CMD_STATUS_REPORT_LEGACY || c == CMD_FEED_HOLD_LEGACY || c == CMD_CYCLE_START_LEGACY ||
+            (c < ' ' && c != '\n' && c != '\r' && c != '\t') || c >= 0x80;
+}
+
+static bool session_add (uint64_t time, uint8_t c)
+{
+    static THREAD_LOCAL uint32_t size = 0;
+
+    if(session.length == size) {
+        size = size ? size * 2 : 4096;
+        if((session.bytes = realloc(session.bytes, size * sizeof(session_byte_t))) == NULL)
+            return false;
+    }
+
+    session.bytes[session.length].time = time;
+    session.bytes[session.length].data = c;
+    session.bytes[session.length++].realtime = is_realtime(c);
+
+    return true;
+}
+
+static int hex_digit (char c)
+{
+    return c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : (c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1));
+}
+
+static bool session_load (FILE *file)
+{
+    char buffer[1024], *s;
+    double ms;
+    uint32_t line = 0;
+
+    while(fgets(buffer, sizeof(buffer), file)) {
+
+        line++;
+
+        if(*buffer == '#' || *buffer == '\n' || *buffer == '\r')
+            continue;
+
+        ms = strtod(buffer, &s);
+        if(s == buffer || *s != ' ' || ms < 0.0) {
+            fprintf(stderr, "Session line %" PRIu32 ": bad time stamp\n", line);
+            return false;
+        }
+
+        uint64_t time = (uint64_t)llround(ms * (double)F_CPU / 1000.0);
+
+        while(*++s && *s != '\n' && *s != '\r') {
+
+            uint8_t c = (uint8_t)*s;
+
+            if(c == '\\') switch(*++s) {
+
+                case 'n':
+                    c = '\n';
+                    break;
+
+                case 'r':
+                    c = '\r';
+                    break;
+
+                case '\\':
+                    c = '\\';
+                    break;
+
+                case 'x':
+                    if(hex_digit(s[1]) >= 0 && hex_digit(s[2]) >= 0) {
+                        c = (uint8_t)(hex_digit(s[1]) << 4 | hex_digit(s[2]));
+                        s += 2;
+                        break;
+                    } // else fall through
+
+                default:
+                    fprintf(stderr, "Session line %" PRIu32 ": bad escape sequence\n", line);
+                    return false;
+            }
+
+            if(!session_add(time, c))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* Input buffer, fed from the session */
+
+static uint16_t rx_count (void)
+{
+    uint_fast16_t head = rxbuffer.head, tail = rxbuffer.tail;
+
+    return BUFCOUNT(head, tail, RX_BUFFER_SIZE);
+}
+
+static uint16_t replay_rx_free (void)
+{
+    return (RX_BUFFER_SIZE - 1) - rx_count();
+}
+
+static void replay_rx_flush (void)
+{
+    rxbuffer.tail = rxbuffer.head;
+#ifdef ENABLE_RX_FILTER
+    rxfilter.value = 0;
+#endif
+}
+
+static void replay_rx_cancel (void)
+{
+    replay_rx_flush();
+    rxbuffer.data[rxbuffer.head] = ASCII_CAN;
+    rxbuffer.head = (rxbuffer.tail + 1) & (RX_BUFFER_SIZE - 1);
+}
+
+static bool rx_put (uint8_t c)
+{
+    uint_fast16_t next_head = (rxbuffer.head + 1) & (RX_BUFFER_SIZE - 1);
+
+#ifdef ENABLE_RX_FILTER
+    if((c = (uint8_t)stream_rx_filter(&rxfilter, (char)c)) == '\0')
+        return true;
+#endif
+
+    if(next_head == rxbuffer.tail)
+        return false;
+
+    rxbuffer.data[rxbuffer.head] = c;
+    rxbuffer.head = next_head;
+
+    return true;
+}
+
+// Transfers the next byte over the serial link if due, returns false if not.
+static bool link_transfer (session_byte_t *byte)
+{
+    uint64_t due = byte->time > session.link_free ? byte->time : session.link_free;
+
+    if(due > ticks)
+        return false;
+
+    session.link_free = due + args.baud_ticks;
+
+    return true;
+}
+
+// Feeds the bytes due to the input buffer, as received by the serial interrupt.
+// Returns true if any byte was fed.
+static bool feed_input (void)
+{
+    bool fed = false;
+    session_byte_t *byte;
+
+    while(true) {
+
+        // Skip realtime bytes already fed and bytes not realtime.
+        while(session.next < session.next_rt && session.bytes[session.next].realtime)
+            session.next++;
+        while(session.next_rt < session.length && !session.bytes[session.next_rt].realtime)
+            session.next_rt++;
+
+        // Bytes are fed in order, realtime bytes overtake bytes held back by a full input buffer only.
+        if(session.next < session.length && session.next < session.next_rt && replay_rx_free()) {
+            byte = &session.bytes[session.next];
+            if(!link_transfer(byte))
+                break;
+            session.next++;
+            if(!hal.stream.enqueue_realtime_command((char)byte->data))
+                rx_put(byte->data);
+        } else if(session.next_rt < session.length) {
+            byte = &session.bytes[session.next_rt];
+            if(!link_transfer(byte))
+                break;
+            session.next_rt++;
+            if(!hal.stream.enqueue_realtime_command((char)byte->data) && !rx_put(byte->data))
+                metrics.overflows++;
+        } else
+            break;
+
+        fed = true;
+    }
+
+    return fed;
+}
+
+// Returns the virtual time the next byte can be fed, UINT64_MAX if none.
+static uint64_t next_input_time (void)
+{
+    uint64_t time = UINT64_MAX;
+    uint32_t idx;
+
+    for(idx = session.next_rt; idx < session.length; idx++) {
+        if(session.bytes[idx].realtime) {
+            time = session.bytes[idx].time;
+            break;
+        }
+    }
+
+    if(session.next < session.length && replay_rx_free()) {
+        for(idx = session.next; idx < session.length; idx++) {
+            if(!session.bytes[idx].realtime) {
+                if(session.bytes[idx].time < time)
+                    time = session.bytes[idx].time;
+                break;
+            }
+        }
+    }
+
+    return time == UINT64_MAX ? time : (time > session.link_free ? time : session.link_free);
+}
+
+// True if a line is being received when the planner runs empty, the host could not keep up.
+// Not true if a complete line is waiting, the parser is then blocked by a synchronizing command.
+static bool input_in_flight (void)
+{
+    uint_fast16_t bptr = rxbuffer.tail;
+
+    while(bptr != rxbuffer.head) {
+        if(rxbuffer.data[bptr] == '\n' || rxbuffer.data[bptr] == '\r')
+            return false;
+        bptr = (bptr + 1) & (RX_BUFFER_SIZE - 1);
+    }
+
+    return rx_count() || (session.next < session.length && session.bytes[session.next].time <= ticks);
+}
+
+/* Trace output and comparison */
+
+static void trace_compare (const char *line)
+{
+    static THREAD_LOCAL char golden[TRACE_LINE_LENGTH + 32];
+
+    if(args.golden_file == NULL || trace_mismatch)
+        return;
+
+    golden_line++;
+
+    if(fgets(golden, sizeof(golden), args.golden_file) == NULL)
+        *golden = '\0';
+    else
+        golden[strcspn(golden, "\r\n")] = '\0';
+
+    if(strcmp(golden, line)) {
+        trace_mismatch = true;
+        fprintf(stderr, "Trace mismatch at line %" PRIu32 ":\n  expected: %s\n  got:      %s\n", golden_line, golden, line);
+    }
+}
+
+static void trace_output (void)
+{
+    char line[TRACE_LINE_LENGTH + 32];
+
+    trace_line[trace_length] = '\0';
+
+    if(trace_length == 0)
+        trace_time = ticks_to_ms(ticks);
+
+    if(args.timestamps)
+        sprintf(line, "%.3f %s", trace_time, trace_line);
+    else
+        strcpy(line, trace_line);
+
+    fprintf(args.trace_file, "%s\n", line);
+    trace_compare(line);
+    trace_lines++;
+
+    if(!strncmp(trace_line, "error:", 6))
+        metrics.errors++;
+    else if(!strncmp(trace_line, "ALARM:", 6))
+        metrics.alarms++;
+
+    trace_length = 0;
+}
+
+static void replay_write (const char *data)
+{
+    char c;
+
+    while((c = *data++)) {
+        if(c == '\n') {
+            trace_output();
+        } else if(c != '\r') {
+            if(trace_length == 0)
+                trace_time = ticks_to_ms(ticks);
+            if(trace_length < TRACE_LINE_LENGTH - 1)
+                trace_line[trace_length++] = c;
+        }
+    }
+}
+
+static void replay_write_null (const char *data)
+{
+}
+
+static int16_t replay_read (void)
+{
+    int16_t data;
+    uint_fast16_t bptr = rxbuffer.tail;
+
+    if(bptr == rxbuffer.head)
+        return SERIAL_NO_DATA;
+
+    data = rxbuffer.data[bptr++];
+    rxbuffer.tail = bptr & (RX_BUFFER_SIZE - 1);
+    reads++;
+
+    return data;
+}
+
+static bool replay_suspend_read (bool suspend)
+{
+    return false;
+}
+
+/* Virtual time */
+
+static uint32_t replay_get_elapsed_ticks (void)
+{
+    return (uint32_t)ticks_to_ms(ticks);
+}
+
+static uint32_t replay_get_micros (void)
+{
+    return (uint32_t)(ticks * 1000000UL / hal.f_step_timer);
+}
+
+static void replay_delay_ms (uint32_t ms, void (*callback)(void))
+{
+    ticks += (uint64_t)ms * hal.f_step_timer / 1000UL;
+    idle_calls = 0;
+
+    feed_input();
+
+    if(callback)
+        callback();
+}
+
+static void replay_wake_up (void)
+{
+    wake_up();
+
+    if(!running) {
+        running = true;
+        motion_start = ticks;
+    }
+}
+
+static void replay_go_idle (bool clear_signals)
+{
+    go_idle(clear_signals);
+
+    if(running) {
+        running = false;
+        metrics.motion_time += (double)(ticks - motion_start) / (double)hal.f_step_timer;
+        // Count as underflow if motion was not ended by the segment preparation and there are blocks left to execute.
+        if(!sys.step_control.end_motion && plan_get_current_block())
+            metrics.underflows++;
+        else if(plan_get_current_block() == NULL && input_in_flight())
+            metrics.starved++;
+    }
+}
+
+static void on_segment_loaded (stepper_t *stepper)
+{
+    metrics.segments++;
+}
+
+// Binary trace of every step, adds a block start record when the stepper starts a new block.
+static void step_trace (void)
+{
+    static THREAD_LOCAL plan_block_t *traced_block = NULL;
+    static THREAD_LOCAL uint32_t traced_blocks = 0;
+
+    plan_block_t *current_block = plan_get_current_block();
+
+    if(current_block != traced_block && (traced_block = current_block)) {
+        steptrace_block_t block = {
+            .entry_speed_sqr = current_block->entry_speed_sqr,
+            .max_junction_speed_sqr = plan_block_max_junction_speed_sqr(current_block),
+            .acceleration = current_block->acceleration,
+            .millimeters = current_block->millimeters,
+            .programmed_rate = current_block->programmed_rate,
+            .planned = plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available(),
+            .capacity = plan_get_block_buffer_size() - 1
+        };
+        steptrace_block_start(ticks, traced_blocks++, &block);
+    }
+
+    steptrace_steps(ticks, sys_position);
+}
+
+// Advances virtual time while executing motions queued in the planner, or jumps to the next
+// byte from the session when idle. Ends the replay when the session is exhausted.
+static void replay_execute_realtime (uint_fast16_t state)
+{
+    static THREAD_LOCAL uint32_t last_reads = 0;
+    static THREAD_LOCAL uint_fast16_t available = 0;
+
+    uint_fast16_t now_available = plan_get_block_buffer_available();
+    bool progress = last_reads != reads || available != now_available;
+
+    feed_input();
+
+    if(validator_driver.stepper_running && (plan_check_full_buffer() || !progress)) {
+
+        idle_calls = 0;
+
+        do {
+            ticks += validator_driver.cycles_per_tick;
+            hal.stepper.interrupt_callback();
+            if(args.step_trace_file)
+                step_trace();
+            st_prep_buffer();
+        } while(!feed_input() && !sys_rt_exec_state && validator_driver.stepper_running && plan_get_block_buffer_available() == now_available);
+
+    } else if(!validator_driver.stepper_running && !progress && ++idle_calls >= IDLE_CALLS) {
+
+        uint64_t next = next_input_time();
+
+        idle_calls = 0;
+
+        if(next != UINT64_MAX) {
+            if(next > ticks)
+                ticks = next;
+            feed_input();
+        } else if(rx_count() == 0) {
+            sys.flags.exit = On;
+            sys.abort = On;
+        }
+    } else if(progress)
+        idle_calls = 0;
+
+    last_reads = reads;
+    available = plan_get_block_buffer_available();
+}
+
+/* Metrics */
+
+static void metrics_write (FILE *file)
+{
+    fprintf(file, "job_time %.6f\n", metrics.job_time);
+    fprintf(file, "motion_time %.6f\n", metrics.motion_time);
+    fprintf(file, "blocks %" PRIu32 "\n", metrics.blocks);
+    fprintf(file, "segments %" PRIu32 "\n", metrics.segments);
+    fprintf(file, "underflows %" PRIu32 "\n", metrics.underflows);
+    fprintf(file, "starved %" PRIu32 "\n", metrics.starved);
+    fprintf(file, "errors %" PRIu32 "\n", metrics.errors);
+    fprintf(file, "alarms %" PRIu32 "\n", metrics.alarms);
+    fprintf(file, "overflows %" PRIu32 "\n", metrics.overflows);
+}
+
+static bool check_time (const char *name, double value, double baseline)
+{
+    if(value > baseline * (1.0 + args.tolerance / 100.0) + 1e-6) {
+        fprintf(stderr, "Regression: %s %.6f s, baseline %.6f s (+%.2f %%)\n", name, value, baseline, baseline > 0.0 ? (value - baseline) * 100.0 / baseline : 0.0);
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_count (const char *name, uint32_t value, double baseline)
+{
+    if((double)value > baseline) {
+        fprintf(stderr, "Regression: %s %" PRIu32 ", baseline %.0f\n", name, value, baseline);
+        return false;
+    }
+
+    return true;
+}
+
+// Compares the metrics to the baseline, a missing entry is not checked.
+static bool metrics_compare (FILE *file)
+{
+    bool ok = true;
+    char name[32];
+    double value;
+
+    while(fscanf(file, "%31s %lf", name, &value) == 2) {
+        if(!strcmp(name, "job_time"))
+            ok &= check_time(name, metrics.job_time, value);
+        else if(!strcmp(name, "motion_time"))
+            ok &= check_time(name, metrics.motion_time, value);
+        else if(!strcmp(name, "underflows"))
+            ok &= check_count(name, metrics.underflows, value);
+        else if(!strcmp(name, "starved"))
+            ok &= check_count(name, metrics.starved, value);
+        else if(!strcmp(name, "errors"))
+            ok &= check_count(name, metrics.errors, value);
+        else if(!strcmp(name, "alarms"))
+            ok &= check_count(name, metrics.alarms, value);
+        else if(!strcmp(name, "overflows"))
+            ok &= check_count(name, metrics.overflows, value);
+    }
+
+    return ok;
+}
+
+static int replay_run (void)
+{
+    bool cold_start = true, looping = true;
+
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = replay_execute_realtime;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION;
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+    hal.stream.enqueue_realtime_command = protocol_enqueue_realtime_command;
+    hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_alloc(); // Allocate memory block for NVS buffer
+#endif
+
+    report_init_fns();
+
+    if(!driver_init())
+       return -1;
+
+    hal.stream.read = replay_read;
+    hal.stream.write = replay_write_null; // Suppress messages from settings initialization
+    hal.stream.write_all = replay_write_null;
+    hal.stream.suspend_read = replay_suspend_read;
+    hal.stream.get_rx_buffer_available = replay_rx_free;
+    hal.stream.reset_read_buffer = replay_rx_flush;
+    hal.stream.cancel_read_buffer = replay_rx_cancel;
+    hal.get_elapsed_ticks = replay_get_elapsed_ticks;
+    hal.get_micros = replay_get_micros;
+    hal.delay_ms = replay_delay_ms;
+
+    wake_up = hal.stepper.wake_up;
+    hal.stepper.wake_up = replay_wake_up;
+
+    go_idle = hal.stepper.go_idle;
+    hal.stepper.go_idle = replay_go_idle;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_init();
+#endif
+    settings_init();
+
+    if(!plan_alloc() || !hal.driver_setup(&settings))
+        return -1;
+
+    memset(sys_position, 0, sizeof(sys_position));
+
+    if(args.step_trace_file)
+        steptrace_open(args.step_trace_file, N_AXIS, hal.f_step_timer);
+
+#ifdef ENABLE_PROFILING
+    profile_init();
+#endif
+
+#ifdef ENABLE_FLIGHT_RECORDER
+    flightrec_init();
+#endif
+
+#ifdef ENABLE_LINE_TIMING
+    linetime_init();
+#endif
+
+#ifdef ENABLE_SCHEDULER
+    scheduler_init();
+#endif
+
+#ifdef ENABLE_HEIGHTMAP
+    heightmap_init();
+#endif
+
+#ifdef ENABLE_PVT_STREAM
+    pvt_init();
+#endif
+
+#ifdef ENABLE_LASER_RASTER
+    raster_init();
+#endif
+
+    hal.stream.write = replay_write;
+    hal.stream.write_all = replay_write;
+
+    // Initialization loop upon power-up or a reset from the session, as in grbl_enter().
+    while(looping) {
+
+        uint_fast16_t prior_state = sys.state;
+
+        report_init_fns();
+
+        memset(&sys, 0, sizeof(system_t));
+        set_state(prior_state);
+        sys.override.feed_rate = DEFAULT_FEED_OVERRIDE;
+        sys.override.rapid_rate = DEFAULT_RAPID_OVERRIDE;
+        sys.override.spindle_rpm = DEFAULT_SPINDLE_RPM_OVERRIDE;
+        sys_rt_exec_state = 0;
+        sys_rt_exec_alarm = 0;
+
+        hal.stream.reset_read_buffer();
+        gc_init(cold_start);
+        plan_reset();
+        st_reset();
+#ifdef ENABLE_VELOCITY_JOG
+        mc_jog_velocity_reset();
+#endif
+#ifdef ENABLE_PARSE_AHEAD
+        mc_parse_ahead_reset();
+#endif
+#ifdef ENABLE_PVT_STREAM
+        pvt_reset();
+#endif
+#ifdef ENABLE_LASER_RASTER
+        raster_reset();
+#endif
+#ifdef ENABLE_LINE_TIMING
+        linetime_reset();
+#endif
+        limits_set_homing_axes();
+        sync_position();
+
+        if(cold_start)
+            st_add_segment_hook(on_segment_loaded);
+
+        report_init_message();
+
+        looping = protocol_main_loop(cold_start);
+        cold_start = false;
+    }
+
+    if(trace_length)
+        trace_output();
+
+    if(args.step_trace_file) {
+        steptrace_close(ticks);
+        fclose(args.step_trace_file);
+    }
+
+    metrics.job_time = (double)ticks / (double)hal.f_step_timer;
+    metrics.blocks = validator_driver.motion_blocks;
+
+    return 0;
+}
+
+#ifdef GRBL_REENTRANT
+int grbl_replay (int argc, char *argv[])
+#else
+int main (int argc, char *argv[])
+#endif
+{
+    int ret;
+    bool ok = true;
+    FILE *session_file = NULL;
+    uint32_t baud = 115200;
+
+    args.trace_file = stdout;
+    args.tolerance = 0.0f;
+
+    progname = argv[0];
+
+    while (argc > 1) {
+        argv++; argc--;
+        if (argv[0][0] == '-') {
+
+            FILE **file = NULL;
+            const char *mode = "r";
+
+            switch(argv[0][1]) {
+
+                case 'o':
+                    file = &args.trace_file;
+                    mode = "w";
+                    break;
+
+                case 'g':
+                    file = &args.golden_file;
+                    break;
+
+                case 'm':
+                    file = &args.metrics_file;
+                    mode = "w";
+                    break;
+
+                case 'b':
+                    file = &args.baseline_file;
+                    break;
+
+                case 'S':
+                    file = &args.step_trace_file;
+                    mode = "wb";
+                    break;
+
+                case 'p':
+                case 'B':
+                    if(argc < 2)
+                        return usage(*argv);
+                    if(argv[0][1] == 'p')
+                        args.tolerance = strtof(argv[1], NULL);
+                    else if((baud = (uint32_t)strtol(argv[1], NULL, 10)) == 0)
+                        return usage(*argv);
+                    argv++; argc--;
+                    break;
+
+                case 't':
+                    args.timestamps = true;
+                    break;
+
+                case 'h':
+                    return usage(NULL);
+
+                default:
+                    return usage(*argv);
+            }
+
+            if(file) {
+                if(argc < 2)
+                    return usage(*argv);
+                argv++; argc--;
+                if((*file = fopen(*argv, mode)) == NULL) {
+                    perror("fopen");
+                    printf("Error opening : %s\n", *argv);
+                    return(usage(0));
+                }
+            }
+        } else if((session_file = fopen(*argv, "r")) == NULL) {
+            perror("fopen");
+            printf("Error opening : %s\n", *argv);
+            return(usage(0));
+        }
+    }
+
+    if(session_file == NULL)
+        return usage(NULL);
+
+    // 10 bits per byte: start, 8 data and stop bit
+    args.baud_ticks = F_CPU * 10UL / baud;
+
+    if(!session_load(session_file))
+        return -1;
+
+    fclose(session_file);
+
+    if((ret = replay_run())) {
+        printf("Initialization failed\n");
+        return ret;
+    }
+
+    metrics_write(stderr);
+
+    if(args.metrics_file) {
+        metrics_write(args.metrics_file);
+        fclose(args.metrics_file);
+    }
+
+    if(args.golden_file) {
+        char c;
+        if(!trace_mismatch && fread(&c, 1, 1, args.golden_file) == 1) {
+            trace_mismatch = true;
+            fprintf(stderr, "Trace mismatch: trace ends at line %" PRIu32 ", golden trace is longer\n", trace_lines);
+        }
+        ok &= !trace_mismatch;
+        fclose(args.golden_file);
+    }
+
+    if(args.baseline_file) {
+        ok &= metrics_compare(args.baseline_file);
+        fclose(args.baseline_file);
+    }
+
+    if(args.trace_file != stdout)
+        fclose(args.trace_file);
+
+    free(session.bytes);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/*
+  sim_io.c - host I/O thread for the simulator, exchanges bytes with the hardware simulation through lock-free queues
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  The simulation loop reads and writes host data at the simulated baud rate, the platform functions for that
+  make several system calls per byte slot and may block on output. Run with -T the host side is handled by
+  a separate thread and the simulation loop only reads from and writes to memory, so realtime paced runs keep
+  up at high step rates.
+
+  Each queue has a single producer and a single consumer thread. The producer only writes head, the consumer
+  only writes tail, data is published by a release store of head and released by a release store of tail.
+*/
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "simulator.h"
+#include "sim_io.h"
+
+#define QUEUE_MASK (SIM_IO_QUEUE_SIZE - 1)
+
+#if SIM_IO_QUEUE_SIZE & QUEUE_MASK
+#error "SIM_IO_QUEUE_SIZE must be a power of 2!"
+#endif
+
+typedef struct {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint8_t data[SIM_IO_QUEUE_SIZE];
+} io_queue_t;
+
+static io_queue_t rx, tx, keys;
+static bool eof = false;
+static plat_thread_t *thread = NULL;
+static uint8_t (*host_getchar)(void);
+static uint8_t (*host_getkey)(void);
+static void (*host_putchar)(uint8_t);
+
+static bool queue_put (io_queue_t *queue, uint8_t c)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if(head - atomic_load_explicit(&queue->tail, memory_order_acquire) == SIM_IO_QUEUE_SIZE)
+        return false;
+
+    queue->data[head & QUEUE_MASK] = c;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+static bool queue_get (io_queue_t *queue, uint8_t *c)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if(tail == atomic_load_explicit(&queue->head, memory_order_acquire))
+        return false;
+
+    *c = queue->data[tail & QUEUE_MASK];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+static inline bool queue_full (io_queue_t *queue)
+{
+    return atomic_load_explicit(&queue->head, memory_order_relaxed) - atomic_load_explicit(&queue->tail, memory_order_acquire) == SIM_IO_QUEUE_SIZE;
+}
+
+// Functions called by the simulation loop.
+
+static uint8_t io_getchar (void)
+{
+    uint8_t c;
+
+    return queue_get(&rx, &c) ? c : 0;
+}
+
+static uint8_t io_getkey (void)
+{
+    uint8_t c;
+
+    return queue_get(&keys, &c) ? c : 0;
+}
+
+static void io_putchar (uint8_t c)
+{
+    while(!queue_put(&tx, c)) // Output is not dropped, wait for the host to catch up.
+        platform_sleep(SIM_IO_IDLE_SLEEP);
+}
+
+// Transfers all data available, returns true if any byte was transferred.
+static bool io_transfer (bool input)
+{
+    uint8_t c;
+    bool busy = false;
+
+    while(input && !eof && !queue_full(&rx) && (c = host_getchar())) {
+        queue_put(&rx, c);
+        eof = c == 0xFF; // End of input, passed on to the stream which requests exit.
+        busy = true;
+    }
+
+    if(input && host_getkey && !queue_full(&keys) && (c = host_getkey())) {
+        queue_put(&keys, c);
+        busy = true;
+    }
+
+    while(queue_get(&tx, &c)) {
+        host_putchar(c);
+        busy = true;
+    }
+
+    return busy;
+}
+
+static PLAT_THREAD_FUNC(io_thread, exit)
+{
+    while(!*(volatile int *)exit) {
+        if(!io_transfer(true))
+            platform_sleep(SIM_IO_IDLE_SLEEP);
+    }
+
+    io_transfer(false); // Write remaining output.
+
+    return 0;
+}
+
+bool sim_io_start (void)
+{
+    host_getchar = sim.getchar;
+    host_putchar = sim.putchar;
+    host_getkey = sim.getkey;
+
+    sim.getchar = io_getchar;
+    sim.putchar = io_putchar;
+    sim.getkey = host_getkey ? io_getkey : NULL;
+
+    if((thread = platform_start_thread(io_thread)) == NULL) {
+        sim.getchar = host_getchar;
+        sim.putchar = host_putchar;
+        sim.getkey = host_getkey;
+    }
+
+    return thread != NULL;
+}
+
+void sim_io_stop (void)
+{
+    if(thread) {
+        platform_stop_thread(thread);
+        thread = NULL;
+        sim.getchar = host_getchar;
+        sim.putchar = host_putchar;
+        sim.getkey = host_getkey;
+    }
+}
@@ -0,0 +1,42 @@
+/*
+  sim_io.h - host I/O thread for the simulator, exchanges bytes with the hardware simulation through lock-free queues
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SIM_IO_H_
+#define _SIM_IO_H_
+
+#include <stdbool.h>
+
+#ifndef SIM_IO_QUEUE_SIZE
+#define SIM_IO_QUEUE_SIZE 65536 // Size of each of the queues, must be a power of 2.
+#endif
+
+// Time in microseconds the I/O thread sleeps when there is nothing to transfer.
+#ifndef SIM_IO_IDLE_SLEEP
+#define SIM_IO_IDLE_SLEEP 100
+#endif
+
+// Starts the I/O thread. The host functions in sim.getchar, sim.putchar and sim.getkey are then called by
+// the I/O thread only and are replaced by functions reading and writing the queues, the simulation loop
+// thus does not block on or make system calls for host I/O.
+bool sim_io_start (void);
+
+// Stops the I/O thread after the output queued has been written.
+void sim_io_stop (void);
+
+#endif
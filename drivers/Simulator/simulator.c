@@ -96,10 +96,28 @@ void sim_loop (void)
             simulated_ticks += F_CPU / 1e9f * ns_elapsed;
             ns_prev = ns_now;
         }
+        else if (sim.event_driven)
+            simulated_ticks = sim.masterclock + F_CPU / 100; // as fast as possible, 10 ms slices
         else
             simulated_ticks++;  //as fast as possible
 
         while (sim.masterclock < simulated_ticks) {
+
+            if (sim.event_driven) {
+                // Jump to the tick before the next timer expiry or serial byte, nothing happens in between.
+                uint64_t skip = mcu_ticks_to_next_event() - 1;
+                if (next_byte_tick <= sim.masterclock)
+                    skip = 0;
+                else if (next_byte_tick - sim.masterclock < skip)
+                    skip = next_byte_tick - sim.masterclock;
+                if (simulated_ticks - sim.masterclock - 1 < skip)
+                    skip = simulated_ticks - sim.masterclock - 1;
+                if (skip) {
+                    mcu_skip_ticks(skip);
+                    sim.masterclock += skip;
+                }
+            }
+
             // only read serial port as fast as the baud rate allows
             bool read_serial = (sim.masterclock >= next_byte_tick);
 
@@ -140,6 +158,48 @@ void sim_serial_out (uint8_t data)
     }
 }
 
+// Record bytes received to args.session_file, one record per line or realtime command.
+// Records are written as "<ms> <data>", time stamped with the first byte, see replay.c.
+static struct {
+    char data[256];
+    uint_fast16_t length;
+    double ms;
+} record = {0};
+
+void sim_session_close (void)
+{
+    if(record.length) {
+        record.data[record.length] = '\0';
+        fprintf(args.session_file, "%.3f %s\n", record.ms, record.data);
+        record.length = 0;
+    }
+    fflush(args.session_file);
+}
+
+void sim_session_record (uint8_t data)
+{
+    bool realtime = data == '?' || data == '!' || data == '~' ||
+                     (data < ' ' && data != '\n' && data != '\r' && data != '\t') || data >= 0x80;
+
+    if(realtime)
+        sim_session_close();
+
+    if(record.length == 0)
+        record.ms = sim.sim_time * 1000.0;
+
+    if(data == '\n' || data == '\r')
+        record.length += sprintf(&record.data[record.length], data == '\n' ? "\\n" : "\\r");
+    else if(data == '\\')
+        record.length += sprintf(&record.data[record.length], "\\\\");
+    else if(data < ' ' || data > '~')
+        record.length += sprintf(&record.data[record.length], "\\x%02X", data);
+    else
+        record.data[record.length++] = data;
+
+    if(realtime || data == '\n' || data == '\r' || record.length > sizeof(record.data) - 8)
+        sim_session_close();
+}
+
 // Print serial output to sim.socket_fd stream
 void sim_socket_out (uint8_t data)
 {
@@ -25,6 +25,7 @@
 #define simulator_h
 
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "platform.h"
 
@@ -37,10 +38,12 @@ typedef struct sim_vars {
     uint8_t started;  // don't start timers until first char recieved.
     enum {exit_NO, exit_REQ, exit_OK} exit;
     float speedup;
+    bool event_driven; // jump from event to event instead of simulating every tick
     int32_t baud_ticks;
     int socket_fd;
     uint8_t (*getchar)(void);
     void (*putchar)(uint8_t);
+    uint8_t (*getkey)(void); // Keyboard input for the control signals, NULL if stdin is the stream.
     sim_hook_fp on_init;
     sim_hook_fp on_tick;
     sim_hook_fp on_byte;
@@ -54,10 +57,13 @@ typedef struct arg_vars {
     FILE *block_out_file;
     FILE *step_out_file;
     FILE *serial_out_file;
+    FILE *step_trace_file;  // Binary step trace, see steptrace.h
+    FILE *session_file;     // Bytes received with time stamps, for replay by replay.exe
     char eeprom_file[128];
     double step_time;       // Minimum time step for printing stepper values. Given by user via command line
     uint8_t comment_char;   // Char to prefix comments; default  '#' 
     uint16_t port;          // Port number for telnet communication
+    bool io_thread;         // Host I/O in separate thread, see sim_io.h
 } arg_vars_t;
 
 extern arg_vars_t args;
@@ -82,4 +88,8 @@ void simulate_serial (void);
 void sim_serial_out (uint8_t data);
 void sim_socket_out (uint8_t data);
 
+// Record byte received to args.session_file, flush pending record on close
+void sim_session_record (uint8_t data);
+void sim_session_close (void);
+
 #endif
@@ -0,0 +1,536 @@
+/*
+  stepbench.c - step generation fidelity and timing harness
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  G-code is executed by the core as by the validator, with the stepper timer replaced by a virtual
+  timer advanced by the cycles_per_tick value of each step interrupt. Step preparation is called
+  after each interrupt, or at a fixed interval of virtual time to model a busy foreground loop.
+
+  Captured from the step interrupts through hal.stepper.pulse_start and a segment hook:
+   - achieved segment velocity, from the step pulses output and the virtual time, vs. the velocity
+     planned by st_prep_buffer() for the segment,
+   - step interval jitter per axis, the change of the interval between successive steps within a segment,
+   - host execution time of the step interrupt handler and of st_prep_buffer(),
+   - segment buffer fill level over time and underflows.
+  A per segment trace can be written to a CSV file.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform.h"
+#include "validator.h"
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/nvs_buffer.h"
+#include "grbl/stepper.h"
+#include "grbl/limits.h"
+#include "grbl/state_machine.h"
+
+#define MIN_SEGMENT_STEPS 10 // Segments with fewer step events are not included in the velocity error, quantization dominates.
+
+#ifdef MAX_AMASS_LEVEL
+#define AMASS_LEVELS (MAX_AMASS_LEVEL + 1)
+#else
+#define AMASS_LEVELS 1
+#endif
+
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint32_t samples;
+    uint64_t total;
+} ns_stats_t;
+
+typedef struct {
+    uint32_t steps;
+    uint64_t last_step;         // Virtual time of last step.
+    uint32_t last_interval;     // Interval between the last two steps, 0 if not in the same segment.
+    uint32_t segment;           // Segment sequence number of last step.
+    uint64_t intervals;         // Sum of intervals.
+    uint32_t n_intervals;
+    double jitter_sqr;          // Sum of squared interval changes.
+    uint32_t n_jitter;
+    uint32_t max_jitter;
+} axis_stats_t;
+
+typedef struct {
+    uint64_t ticks;             // Virtual time in step timer cycles.
+    uint64_t next_prep;         // Virtual time of next step preparation call.
+    uint32_t segment;           // Segment sequence number.
+    uint64_t segment_start;     // Virtual time the current segment was loaded.
+    uint32_t segment_steps[N_AXIS];
+    float segment_rate;         // Planned velocity at the end of the current segment.
+    float entry_rate;           // Planned velocity at the start of the current segment.
+    uint32_t segment_events;    // Step events of the current segment.
+    uint32_t segments;
+    uint32_t amass[AMASS_LEVELS];
+    uint32_t underflows;
+    double error_time;          // Sum of velocity error times segment time.
+    double time;                // Sum of segment times.
+    float max_error;            // Max velocity error (%)
+    float max_rate;             // Max achieved velocity
+    uint_fast8_t fill;          // Current segment buffer fill.
+    uint_fast8_t min_fill;      // Min fill when executing.
+    uint64_t fill_ticks[SEGMENT_BUFFER_SIZE]; // Time spent at each fill level when executing.
+    uint64_t fill_changed;      // Virtual time of last fill change.
+    bool running;
+    ns_stats_t isr;
+    ns_stats_t pulse;
+    ns_stats_t prep;
+    axis_stats_t axis[N_AXIS];
+} bench_t;
+
+typedef struct arg_vars {
+    FILE *input_file;
+    FILE *csv_file;
+    uint32_t prep_interval;     // Step preparation interval in microseconds, 0 for after each step interrupt.
+} arg_vars_t;
+
+static arg_vars_t args;
+static bench_t bench;
+static const char *progname;
+static uint32_t reads = 0;
+static uint8_t exit_code = 0;
+static stepper_pulse_start_ptr pulse_start;
+static stepper_go_idle_ptr go_idle;
+
+segment_t *get_segment_buffer_tail();
+segment_t *get_segment_buffer_head();
+
+static int usage (const char* badarg)
+{
+    if (badarg)
+        printf("Unrecognized option %s\n", badarg);
+
+    printf("Usage: \n"
+     "%s <Options> [input_file]\n"
+     "  Options:\n"
+     "    -o <csv file> : write per segment trace to file\n"
+     "    -P <us>       : step preparation interval in microseconds, default after each step interrupt\n"
+     "\n  Executes gcode from stdin or input file with a virtual step timer and reports"
+     "\n  achieved vs. planned segment velocity, step interval jitter per axis, step interrupt"
+     "\n  and preparation execution time and segment buffer fill.",
+     progname);
+
+    return -1;
+}
+
+static inline void ns_add (ns_stats_t *stats, uint32_t ns)
+{
+    if(ns < stats->min)
+        stats->min = ns;
+    if(ns > stats->max)
+        stats->max = ns;
+    stats->samples++;
+    stats->total += ns;
+}
+
+static inline float ticks_to_us (uint64_t ticks)
+{
+    return (float)ticks * 1e6f / (float)hal.f_step_timer;
+}
+
+static void update_fill (void)
+{
+    uint_fast8_t fill = 0;
+    segment_t *segment = get_segment_buffer_tail(), *head = get_segment_buffer_head();
+
+    while(segment != head) {
+        fill++;
+        segment = segment->next;
+    }
+
+    if(bench.running) {
+        bench.fill_ticks[bench.fill] += bench.ticks - bench.fill_changed;
+        if(fill < bench.min_fill)
+            bench.min_fill = fill;
+    }
+
+    bench.fill = fill;
+    bench.fill_changed = bench.ticks;
+}
+
+// Completes the statistics for the segment executed since it was loaded.
+static void segment_end (void)
+{
+    uint_fast8_t idx;
+    float distance = 0.0f, time, rate, planned, error;
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        distance += (float)bench.segment_steps[idx] * (float)bench.segment_steps[idx] / (settings.axis[idx].steps_per_mm * settings.axis[idx].steps_per_mm);
+
+    time = (float)(bench.ticks - bench.segment_start) / (float)hal.f_step_timer / 60.0f; // min
+    rate = sqrtf(distance) / time;
+    planned = (bench.entry_rate + bench.segment_rate) * 0.5f;
+    error = planned > 0.0f ? fabsf(rate - planned) * 100.0f / planned : 0.0f;
+
+    if(rate > bench.max_rate)
+        bench.max_rate = rate;
+
+    if(bench.segment_events >= MIN_SEGMENT_STEPS) {
+        bench.error_time += error * time;
+        bench.time += time;
+        if(error > bench.max_error)
+            bench.max_error = error;
+    }
+
+    if(args.csv_file)
+        fprintf(args.csv_file, "%.6f,%" PRIu32 ",%.3f,%.3f,%d\n", (double)bench.segment_start / (double)hal.f_step_timer,
+                 bench.segment_events, (double)planned, (double)rate, (int)bench.fill);
+
+    memset(bench.segment_steps, 0, sizeof(bench.segment_steps));
+    bench.segment_events = 0;
+}
+
+static void on_segment_loaded (stepper_t *stepper)
+{
+    if(bench.running)
+        segment_end();
+
+    if(args.csv_file)
+        fprintf(args.csv_file, "%" PRIu32 ",%" PRIu32 ",%d,", bench.segment, stepper->exec_segment->cycles_per_tick, (int)stepper->exec_segment->amass_level);
+
+    bench.segment++;
+    bench.segments++;
+    bench.segment_start = bench.ticks;
+    bench.entry_rate = bench.running ? bench.segment_rate : 0.0f;
+    bench.segment_rate = stepper->exec_segment->current_rate;
+    if(stepper->exec_segment->amass_level < AMASS_LEVELS)
+        bench.amass[stepper->exec_segment->amass_level]++;
+    bench.running = true;
+}
+
+static void on_pulse_start (stepper_t *stepper)
+{
+    uint32_t start = platform_ns();
+
+    pulse_start(stepper);
+
+    if(stepper->step_outbits.mask) {
+
+        uint_fast8_t idx;
+        axis_stats_t *axis;
+
+        bench.segment_events++;
+
+        for(idx = 0; idx < N_AXIS; idx++) {
+
+            if(!(stepper->step_outbits.mask & bit(idx)))
+                continue;
+
+            axis = &bench.axis[idx];
+            axis->steps++;
+            bench.segment_steps[idx]++;
+
+            if(axis->steps > 1) {
+
+                uint32_t interval = (uint32_t)(bench.ticks - axis->last_step);
+
+                axis->intervals += interval;
+                axis->n_intervals++;
+
+                if(axis->segment == bench.segment) {
+                    if(axis->last_interval) {
+                        uint32_t jitter = interval > axis->last_interval ? interval - axis->last_interval : axis->last_interval - interval;
+                        axis->jitter_sqr += (double)jitter * (double)jitter;
+                        axis->n_jitter++;
+                        if(jitter > axis->max_jitter)
+                            axis->max_jitter = jitter;
+                    }
+                    axis->last_interval = interval;
+                } else
+                    axis->last_interval = 0;
+            }
+
+            axis->last_step = bench.ticks;
+            axis->segment = bench.segment;
+        }
+    }
+
+    ns_add(&bench.pulse, platform_ns() - start);
+}
+
+static void on_go_idle (bool clear_signals)
+{
+    go_idle(clear_signals);
+
+    if(bench.running) {
+        update_fill();
+        segment_end();
+        bench.running = false;
+        // Count as underflow if motion was not ended by the segment preparation and there are blocks left to execute.
+        if(!sys.step_control.end_motion && plan_get_current_block())
+            bench.underflows++;
+    }
+}
+
+// Executes motions queued in the planner by calling the stepper interrupt handler until a
+// planner block has been consumed or the stepper goes idle, as the validator does.
+static void bench_execute_realtime (uint_fast16_t state)
+{
+    static uint32_t last_reads = 0;
+    static uint_fast16_t available = 0;
+
+    uint_fast16_t now_available = plan_get_block_buffer_available();
+
+    if(validator_driver.stepper_running && (plan_check_full_buffer() || (last_reads == reads && available == now_available))) {
+
+        uint32_t start, prep_ticks = (uint32_t)((uint64_t)args.prep_interval * hal.f_step_timer / 1000000UL);
+
+        do {
+            bench.ticks += validator_driver.cycles_per_tick;
+
+            start = platform_ns();
+            hal.stepper.interrupt_callback();
+            ns_add(&bench.isr, platform_ns() - start);
+
+            if(bench.ticks >= bench.next_prep) {
+                update_fill();
+                start = platform_ns();
+                st_prep_buffer();
+                ns_add(&bench.prep, platform_ns() - start);
+                bench.next_prep = bench.ticks + prep_ticks;
+            }
+
+            update_fill();
+
+        } while(validator_driver.stepper_running && plan_get_block_buffer_available() == now_available);
+    }
+
+    last_reads = reads;
+    available = plan_get_block_buffer_available();
+}
+
+int16_t bench_read (void)
+{
+    int16_t data = fgetc(args.input_file);
+
+    if (data == PLATFORM_EXTRA_CR)
+        return(0);
+
+    if (sys.abort || data == -1) {
+        if(sys.abort || (plan_get_current_block() == NULL && !validator_driver.stepper_running)) {
+            sys.flags.exit = On;
+            sys.abort = 1;
+        }
+        return SERIAL_NO_DATA;
+    }
+
+    reads++;
+
+    return data;
+}
+
+void bench_write (const char *data)
+{
+}
+
+bool bench_suspend_read (bool suspend)
+{
+    return false;
+}
+
+static status_code_t bench_report_status_message (status_code_t status_code)
+{
+    if(status_code) {
+        fprintf(stderr, "error:%d\n", (int)status_code);
+        if(!exit_code)
+            exit_code = status_code;
+    }
+
+    return status_code;
+}
+
+static void ns_report (const char *name, ns_stats_t *stats)
+{
+    if(stats->samples)
+        printf("%-8s %12" PRIu32 " %10" PRIu32 " %10.1f %10" PRIu32 "\n", name, stats->samples, stats->min, (double)stats->total / (double)stats->samples, stats->max);
+}
+
+static void bench_report (void)
+{
+    uint_fast8_t idx;
+    uint64_t fill_ticks = 0;
+
+    printf("Virtual time: %.3f s, segments: %" PRIu32 ", underflows: %" PRIu32 "\n", (double)bench.ticks / (double)hal.f_step_timer, bench.segments, bench.underflows);
+
+    printf("\nSegments per AMASS level:");
+    for(idx = 0; idx < AMASS_LEVELS; idx++)
+        printf(" %d:%" PRIu32, (int)idx, bench.amass[idx]);
+
+    printf("\n\nVelocity, achieved vs. planned (segments with %d or more step events):\n", MIN_SEGMENT_STEPS);
+    printf("  mean error %.3f %%, max error %.3f %%, max achieved %.1f mm/min\n",
+            bench.time > 0.0 ? bench.error_time / bench.time : 0.0, (double)bench.max_error, (double)bench.max_rate);
+
+    printf("\nStep intervals (us):\n%-8s %12s %10s %10s %10s\n", "axis", "steps", "mean", "jitter rms", "jitter max");
+    for(idx = 0; idx < N_AXIS; idx++) {
+        axis_stats_t *axis = &bench.axis[idx];
+        if(axis->steps)
+            printf("%-8c %12" PRIu32 " %10.2f %10.3f %10.3f\n", axis_letter[idx][0], axis->steps,
+                    axis->n_intervals ? (double)ticks_to_us(axis->intervals) / (double)axis->n_intervals : 0.0,
+                    axis->n_jitter ? (double)ticks_to_us(1) * sqrt(axis->jitter_sqr / (double)axis->n_jitter) : 0.0,
+                    (double)ticks_to_us(axis->max_jitter));
+    }
+
+    printf("\nHost execution time (ns):\n%-8s %12s %10s %10s %10s\n", "", "calls", "min", "avg", "max");
+    ns_report("isr", &bench.isr);
+    ns_report("pulse", &bench.pulse);
+    ns_report("prep", &bench.prep);
+
+    printf("\nSegment buffer fill when executing (%% of time):\n");
+    for(idx = 0; idx < SEGMENT_BUFFER_SIZE; idx++)
+        fill_ticks += bench.fill_ticks[idx];
+    for(idx = 0; idx < SEGMENT_BUFFER_SIZE; idx++)
+        printf(" %d:%.1f", (int)idx, fill_ticks ? (double)bench.fill_ticks[idx] * 100.0 / (double)fill_ticks : 0.0);
+    printf("\n  min fill %d\n", bench.segments ? (int)bench.min_fill : 0);
+}
+
+static int bench_run (void)
+{
+    memset(&bench, 0, sizeof(bench_t));
+    bench.isr.min = bench.pulse.min = bench.prep.min = UINT32_MAX;
+    bench.min_fill = SEGMENT_BUFFER_SIZE;
+
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = bench_execute_realtime;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION;
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+    hal.stream.enqueue_realtime_command = protocol_enqueue_realtime_command;
+    hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_alloc(); // Allocate memory block for NVS buffer
+#endif
+
+    report_init_fns();
+
+    if(!driver_init())
+       return -1;
+
+    hal.stream.read = bench_read;
+    hal.stream.write = bench_write;
+    hal.stream.write_all = bench_write;
+    hal.stream.suspend_read = bench_suspend_read;
+
+    pulse_start = hal.stepper.pulse_start;
+    hal.stepper.pulse_start = on_pulse_start;
+
+    go_idle = hal.stepper.go_idle;
+    hal.stepper.go_idle = on_go_idle;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_init();
+#endif
+    settings_init();
+
+    if(!plan_alloc() || !hal.driver_setup(&settings))
+        return -1;
+
+    memset(sys_position, 0, sizeof(sys_position));
+    sys.override.feed_rate = DEFAULT_FEED_OVERRIDE;
+    sys.override.rapid_rate = DEFAULT_RAPID_OVERRIDE;
+    sys.override.spindle_rpm = DEFAULT_SPINDLE_RPM_OVERRIDE;
+
+    gc_init(true);
+    plan_reset();
+    st_reset();
+    limits_set_homing_axes();
+    sync_position();
+
+    st_add_segment_hook(on_segment_loaded);
+
+    report_init_fns();
+    grbl.report.status_message = bench_report_status_message;
+
+    if(args.csv_file)
+        fputs("segment,cycles_per_tick,amass_level,time,step_events,planned_rate,achieved_rate,fill\n", args.csv_file);
+
+    protocol_main_loop(true);
+
+    bench_report();
+
+    return exit_code;
+}
+
+int main (int argc, char *argv[])
+{
+    int ret;
+
+    args.input_file = stdin;
+    args.csv_file = NULL;
+    args.prep_interval = 0;
+
+    progname = argv[0];
+
+    while (argc > 1) {
+        argv++; argc--;
+        if (argv[0][0] == '-') {
+            switch(argv[0][1]) {
+
+                case 'o': //CSV file
+                    if(argc < 2)
+                        return usage(*argv);
+                    argv++; argc--;
+                    if((args.csv_file = fopen(*argv, "w")) == NULL) {
+                        perror("fopen");
+                        printf("Error opening : %s\n", *argv);
+                        return(usage(0));
+                    }
+                    break;
+
+                case 'P': //step preparation interval
+                    if(argc < 2)
+                        return usage(*argv);
+                    argv++; argc--;
+                    args.prep_interval = (uint32_t)strtol(*argv, NULL, 10);
+                    break;
+
+                case 'h':
+                    return usage(NULL);
+
+                default:
+                    return usage(*argv);
+            }
+        } else if((args.input_file = fopen(*argv, "r")) == NULL) {
+            perror("fopen");
+            printf("Error opening : %s\n", *argv);
+            return(usage(0));
+        }
+    }
+
+    ret = bench_run();
+
+    if(args.csv_file)
+        fclose(args.csv_file);
+
+    return ret;
+}
@@ -0,0 +1,114 @@
+/*
+  stepdump.c - reader for binary step trace files written by the simulator
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Converts a binary step trace to text on stdout, same layout as the simulator text step output
+// but with all axes. With -s only a summary is printed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "steptrace.h"
+
+static void print_axes (int32_t *values, uint_fast8_t n_axis)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_axis; idx++)
+        printf(idx ? ", %d" : "%d", values[idx]);
+}
+
+int main (int argc, char *argv[])
+{
+    int type = -1;
+    bool summary = false;
+    uint64_t n_steps = 0, n_blocks = 0;
+    FILE *file;
+    steptrace_reader_t trace;
+
+    if(argc > 1 && !strcmp(argv[1], "-s")) {
+        summary = true;
+        argc--;
+        argv++;
+    }
+
+    if(argc != 2) {
+        fprintf(stderr, "Usage: stepdump [-s] <step trace file>\n");
+        return 1;
+    }
+
+    if((file = fopen(argv[1], "rb")) == NULL) {
+        perror("fopen");
+        return 1;
+    }
+
+    if(!steptrace_reader_open(&trace, file)) {
+        fprintf(stderr, "%s: not a version 1 - %d step trace file\n", argv[1], STEPTRACE_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    while(type != StepTrace_End && (type = steptrace_read(&trace)) >= 0) {
+
+        switch(type) {
+
+            case StepTrace_Steps:
+                n_steps++;
+                if(!summary) {
+                    printf("%12.6f ", (double)trace.ticks / (double)trace.clock_hz);
+                    print_axes(trace.position, trace.n_axis);
+                    printf("\n");
+                }
+                break;
+
+            case StepTrace_BlockPlanned:
+                if(!summary) {
+                    printf("# planned block %d: ", (int)n_blocks);
+                    print_axes(trace.target, trace.n_axis);
+                    printf(", %f, %f, %f\n", trace.entry_speed_sqr, trace.millimeters, trace.programmed_rate);
+                }
+                n_blocks++;
+                break;
+
+            case StepTrace_BlockStart:
+                if(!summary) {
+                    printf("# block number %d", (int)trace.block_number);
+                    if(trace.version >= 2)
+                        printf(": %f, %f, %f, %f, %f, %d/%d", trace.block.entry_speed_sqr, trace.block.max_junction_speed_sqr, trace.block.acceleration,
+                                trace.block.millimeters, trace.block.programmed_rate, (int)trace.block.planned, (int)trace.block.capacity);
+                    printf("\n");
+                }
+                break;
+        }
+    }
+
+    fclose(file);
+
+    if(summary || type != StepTrace_End) {
+        printf("# %s: %d axes, %.6f s, %llu position samples, %llu planned blocks%s\n", argv[1], trace.n_axis, (double)trace.ticks / (double)trace.clock_hz,
+                (unsigned long long)n_steps, (unsigned long long)n_blocks, type == -2 ? ", corrupt" : (type == StepTrace_End ? "" : ", truncated"));
+        printf("# final position: ");
+        print_axes(trace.position, trace.n_axis);
+        printf("\n");
+    }
+
+    return type == -2 ? 2 : 0;
+}
@@ -0,0 +1,8 @@
+#include "grbl/hal.h"
+#include "grbl/stepper.h"
+
+static THREAD_LOCAL volatile segment_t *segment_buffer_tail;    // Segment being executed or next to execute
+segment_t *get_segment_buffer_tail() { return (segment_t *)segment_buffer_tail; }
+
+static THREAD_LOCAL segment_t *segment_buffer_head;             // Next segment to be prepped
+segment_t *get_segment_buffer_head() { return segment_buffer_head; }
@@ -0,0 +1,273 @@
+/*
+  steptrace.c - compact binary step trace output for the simulator
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "steptrace.h"
+#include "grbl/grbl.h"
+
+#define STEPTRACE_BUFFER_SIZE (256 * 1024)
+
+static THREAD_LOCAL struct {
+    FILE *file;
+    uint_fast8_t n_axis;
+    uint64_t ticks;
+    int32_t position[STEPTRACE_MAX_AXES];
+    int32_t target[STEPTRACE_MAX_AXES];
+} trace = {0};
+
+static void put_varint (uint64_t value)
+{
+    while(value >= 0x80) {
+        putc((int)(value & 0x7F) | 0x80, trace.file);
+        value >>= 7;
+    }
+    putc((int)value, trace.file);
+}
+
+static void put_float (float value)
+{
+    uint32_t bits;
+    uint_fast8_t i;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    for(i = 0; i < 4; i++) {
+        putc((int)(bits & 0xFF), trace.file);
+        bits >>= 8;
+    }
+}
+
+static void put_record (steptrace_record_t type, uint64_t ticks)
+{
+    putc((int)type, trace.file);
+    put_varint(ticks - trace.ticks);
+    trace.ticks = ticks;
+}
+
+// Starts the trace, file must be opened in binary mode. Output is fully buffered, no flushing per record.
+bool steptrace_open (FILE *file, uint_fast8_t n_axis, uint32_t clock_hz)
+{
+    if(file == NULL || n_axis > STEPTRACE_MAX_AXES)
+        return false;
+
+    memset(&trace, 0, sizeof(trace));
+    trace.file = file;
+    trace.n_axis = n_axis;
+
+    setvbuf(file, NULL, _IOFBF, STEPTRACE_BUFFER_SIZE);
+
+    fwrite(STEPTRACE_MAGIC, 1, 4, file);
+    putc(STEPTRACE_VERSION, file);
+    putc((int)n_axis, file);
+    put_varint(clock_hz);
+
+    return true;
+}
+
+// Adds a record if the position has changed since the last one.
+void steptrace_steps (uint64_t ticks, int32_t *position)
+{
+    uint_fast8_t idx;
+
+    if(trace.file == NULL || !memcmp(position, trace.position, sizeof(int32_t) * trace.n_axis))
+        return;
+
+    put_record(StepTrace_Steps, ticks);
+
+    for(idx = 0; idx < trace.n_axis; idx++) {
+        put_varint(steptrace_zigzag(position[idx] - trace.position[idx]));
+        trace.position[idx] = position[idx];
+    }
+}
+
+void steptrace_block_planned (uint64_t ticks, int32_t *target, float entry_speed_sqr, float millimeters, float programmed_rate)
+{
+    uint_fast8_t idx;
+
+    if(trace.file == NULL)
+        return;
+
+    put_record(StepTrace_BlockPlanned, ticks);
+
+    for(idx = 0; idx < trace.n_axis; idx++) {
+        put_varint(steptrace_zigzag(target[idx] - trace.target[idx]));
+        trace.target[idx] = target[idx];
+    }
+
+    put_float(entry_speed_sqr);
+    put_float(millimeters);
+    put_float(programmed_rate);
+}
+
+void steptrace_block_start (uint64_t ticks, uint32_t block_number, const steptrace_block_t *block)
+{
+    if(trace.file == NULL)
+        return;
+
+    put_record(StepTrace_BlockStart, ticks);
+    put_varint(block_number);
+    put_float(block->entry_speed_sqr);
+    put_float(block->max_junction_speed_sqr);
+    put_float(block->acceleration);
+    put_float(block->millimeters);
+    put_float(block->programmed_rate);
+    put_varint(block->planned);
+    put_varint(block->capacity);
+}
+
+// Ends the trace, the file is left open.
+void steptrace_close (uint64_t ticks)
+{
+    if(trace.file == NULL)
+        return;
+
+    put_record(StepTrace_End, ticks);
+    fflush(trace.file);
+
+    trace.file = NULL;
+}
+
+static bool get_varint (FILE *file, uint64_t *value)
+{
+    int c;
+    uint_fast8_t shift = 0;
+
+    *value = 0;
+
+    do {
+        if((c = getc(file)) == EOF || shift > 63)
+            return false;
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while(c & 0x80);
+
+    return true;
+}
+
+static bool get_uint32 (FILE *file, uint32_t *value)
+{
+    uint64_t value64;
+
+    if(!get_varint(file, &value64))
+        return false;
+
+    *value = (uint32_t)value64;
+
+    return true;
+}
+
+static bool get_float (FILE *file, float *value)
+{
+    uint8_t bytes[4];
+    uint32_t bits;
+
+    if(fread(bytes, 1, 4, file) != 4)
+        return false;
+
+    bits = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    memcpy(value, &bits, sizeof(bits));
+
+    return true;
+}
+
+static bool get_deltas (FILE *file, int32_t *values, uint_fast8_t n_axis)
+{
+    uint64_t delta;
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_axis; idx++) {
+        if(!get_varint(file, &delta))
+            return false;
+        values[idx] += steptrace_unzigzag((uint32_t)delta);
+    }
+
+    return true;
+}
+
+// Reads the file header, file must be opened in binary mode. Returns false if not a step trace file
+// or the version is not supported.
+bool steptrace_reader_open (steptrace_reader_t *reader, FILE *file)
+{
+    char magic[4];
+    int n_axis;
+
+    memset(reader, 0, sizeof(steptrace_reader_t));
+    reader->file = file;
+
+    if(fread(magic, 1, 4, file) != 4 || memcmp(magic, STEPTRACE_MAGIC, 4) ||
+        (reader->version = getc(file)) == EOF || reader->version < 1 || reader->version > STEPTRACE_VERSION ||
+         (n_axis = getc(file)) == EOF || n_axis > STEPTRACE_MAX_AXES || !get_varint(file, &reader->clock_hz) || reader->clock_hz == 0)
+        return false;
+
+    reader->n_axis = (uint_fast8_t)n_axis;
+
+    return true;
+}
+
+// Reads the next record and updates the reader state from it. Returns the record type,
+// -1 at end of file and -2 if the record is corrupt or of an unknown type.
+int steptrace_read (steptrace_reader_t *reader)
+{
+    int type;
+    bool ok;
+    uint64_t delta;
+    FILE *file = reader->file;
+
+    if((type = getc(file)) == EOF)
+        return -1;
+
+    if(!get_varint(file, &delta))
+        return -2;
+
+    reader->ticks += delta;
+
+    switch(type) {
+
+        case StepTrace_Steps:
+            ok = get_deltas(file, reader->position, reader->n_axis);
+            break;
+
+        case StepTrace_BlockPlanned:
+            ok = get_deltas(file, reader->target, reader->n_axis) && get_float(file, &reader->entry_speed_sqr) &&
+                  get_float(file, &reader->millimeters) && get_float(file, &reader->programmed_rate);
+            break;
+
+        case StepTrace_BlockStart:
+            ok = get_uint32(file, &reader->block_number);
+            if(ok && reader->version >= 2)
+                ok = get_float(file, &reader->block.entry_speed_sqr) && get_float(file, &reader->block.max_junction_speed_sqr) &&
+                      get_float(file, &reader->block.acceleration) && get_float(file, &reader->block.millimeters) &&
+                       get_float(file, &reader->block.programmed_rate) && get_uint32(file, &reader->block.planned) &&
+                        get_uint32(file, &reader->block.capacity);
+            break;
+
+        case StepTrace_End:
+            ok = true;
+            break;
+
+        default:
+            ok = false;
+            break;
+    }
+
+    return ok ? type : -2;
+}
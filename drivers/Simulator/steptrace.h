@@ -0,0 +1,107 @@
+/*
+  steptrace.h - compact binary step trace output for the simulator
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  File layout:
+
+    header:  "GSTR", version (byte), number of axes (byte), master clock frequency (varint)
+    records: record type (byte), master clock ticks since previous record (varint), payload
+
+  Record payloads:
+
+    StepTrace_Steps:        position change for each axis in steps (zigzag varint)
+    StepTrace_BlockPlanned: target change for each axis in steps (zigzag varint),
+                            entry_speed_sqr, millimeters and programmed_rate (little endian floats)
+    StepTrace_BlockStart:   block number (varint), version 2 adds the block as planned when execution starts:
+                            entry_speed_sqr, max_junction_speed_sqr, acceleration, millimeters and
+                            programmed_rate (little endian floats), the number of blocks in the planner
+                            including this one and the planner capacity (varints)
+    StepTrace_End:          no payload, last record
+
+  Varints are unsigned LEB128, signed values are zigzag encoded before varint encoding.
+  Positions and targets start at 0, planned blocks are numbered from 0 in file order.
+*/
+
+#ifndef _STEPTRACE_H_
+#define _STEPTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STEPTRACE_MAGIC "GSTR"
+#define STEPTRACE_VERSION 2
+#define STEPTRACE_MAX_AXES 8
+
+typedef enum {
+    StepTrace_End = 0,
+    StepTrace_Steps,
+    StepTrace_BlockPlanned,
+    StepTrace_BlockStart
+} steptrace_record_t;
+
+// Block as planned when execution starts, speeds are in mm/min and acceleration in mm/min^2.
+typedef struct {
+    float entry_speed_sqr;
+    float max_junction_speed_sqr;
+    float acceleration;
+    float millimeters;
+    float programmed_rate;
+    uint32_t planned;   // Number of blocks in the planner including this one, the lookahead depth
+    uint32_t capacity;  // Max number of blocks in the planner
+} steptrace_block_t;
+
+// Reader state, the fields are updated by each record read.
+typedef struct {
+    FILE *file;
+    int version;
+    uint_fast8_t n_axis;
+    uint64_t clock_hz;
+    uint64_t ticks;                         // Time of the last record
+    int32_t position[STEPTRACE_MAX_AXES];   // StepTrace_Steps: position
+    int32_t target[STEPTRACE_MAX_AXES];     // StepTrace_BlockPlanned: target
+    float entry_speed_sqr;                  // StepTrace_BlockPlanned: entry speed when planned
+    float millimeters;                      // StepTrace_BlockPlanned: length
+    float programmed_rate;                  // StepTrace_BlockPlanned: programmed rate
+    uint32_t block_number;                  // StepTrace_BlockStart: block number
+    steptrace_block_t block;                // StepTrace_BlockStart: block as planned, version 2 and later only
+} steptrace_reader_t;
+
+bool steptrace_open (FILE *file, uint_fast8_t n_axis, uint32_t clock_hz);
+void steptrace_steps (uint64_t ticks, int32_t *position);
+void steptrace_block_planned (uint64_t ticks, int32_t *target, float entry_speed_sqr, float millimeters, float programmed_rate);
+void steptrace_block_start (uint64_t ticks, uint32_t block_number, const steptrace_block_t *block);
+void steptrace_close (uint64_t ticks);
+
+bool steptrace_reader_open (steptrace_reader_t *reader, FILE *file);
+int steptrace_read (steptrace_reader_t *reader);
+
+static inline uint32_t steptrace_zigzag (int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t steptrace_unzigzag (uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+#endif
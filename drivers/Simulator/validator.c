@@ -27,38 +27,68 @@
 #include <string.h>
 #include <errno.h>
 
+#ifndef PLAT_WINDOWS
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
 #include "platform.h"
+#include "validator.h"
 #include "grbl/hal.h"
 #include "grbl/report.h"
 #include "grbl/protocol.h"
-#include "grbl/protocol.h"
 #include "grbl/nvs_buffer.h"
+#include "grbl/stepper.h"
+#include "grbl/limits.h"
+#include "grbl/state_machine.h"
+#include "grbl/motion_control.h"
 
 typedef struct arg_vars {
     // Output file handles
     FILE *input_file;
     FILE *output_file;
     uint8_t echo;
-    uint8_t silent;   
+    uint8_t silent;
+    uint8_t json;
+    long jobs;
 } arg_vars_t;
 
+// Per file validation results
+typedef struct {
+    bool started;           // Set when the first character is read, output before that is suppressed.
+    bool eol;               // Last character read was a line terminator.
+    bool blank;             // Current line has no printable characters so far.
+    uint32_t reads;         // Characters read, used for detecting wait loops in the core.
+    uint32_t lines;         // Lines read.
+    uint32_t blocks;        // Non-blank lines read.
+    uint32_t errors;        // Lines reporting an error.
+    uint64_t ticks;         // Stepper timer ticks executed.
+} validation_t;
+
 arg_vars_t args;
 const char* progname;
 uint8_t exit_code = 0;
 
+static validation_t validation;
+
 int usage (const char* badarg)
 {
     if (badarg)
         printf("Unrecognized option %s\n", badarg);
 
     printf("Usage: \n"
-     "%s <Options> [input_file]\n"
+     "%s <Options> [input_file ...]\n"
      "  Options:\n"
      "    -o <output file> : use output file instead of stdout\n"
      "    -e        : echo input to output\n"
      "    -s        : silent, no output only return code \n"
-     "\n  Parses gcode from stdin or input line, prints grbl's expected response"
-     "\n  Returns 0 on successs, or line number of error",
+     "    -j        : JSON output, one object per input file\n"
+     "    -p <n>    : number of files to validate in parallel, default number of CPUs\n"
+     "\n  Parses gcode from stdin or input file(s), prints grbl's expected response"
+     "\n  With -j the errors by line, block counts and estimated run time are reported"
+     "\n  and validation continues after an error."
+     "\n  Returns 0 on successs, or the first error code, or with several input files"
+     "\n  the number of files with errors",
      progname);
 
     return -1;
@@ -66,17 +96,56 @@ int usage (const char* badarg)
 
 status_code_t validator_report_status_message (status_code_t status_code)
 {
+    if(!validation.started)
+        return status_code;
+
+    if(args.json) {
+        if(status_code) {
+            fprintf(args.output_file, "%s{\"line\":%" PRIu32 ",\"code\":%d}", validation.errors ? "," : "", validation.lines, (int)status_code);
+            validation.errors++;
+            gc_state.last_error = Status_OK; // Continue with next line.
+            if(!exit_code)
+                exit_code = status_code;
+        }
+        return status_code;
+    }
+
     report_status_message(status_code);
 
     if (status_code && !exit_code) {
-        printf("EXITING %d\n",status_code);
+        fprintf(args.output_file, "EXITING %d\n", status_code);
         exit_code = status_code;
+        sys.flags.exit = On;
         sys.abort = 1;
     }
 
     return status_code;
 }
 
+// Executes motions queued in the planner by calling the stepper interrupt handler until a
+// planner block has been consumed or the stepper goes idle, the timer periods are added up
+// for the run time estimate. Motions are only executed when the core waits for them, that is
+// when the planner buffer is full or when called repeatedly without any input being read or
+// blocks being queued in between, e.g. from protocol_buffer_synchronize().
+static void validator_execute_realtime (uint_fast16_t state)
+{
+    static uint32_t reads = 0;
+    static uint_fast16_t available = 0;
+
+    uint_fast16_t now_available = plan_get_block_buffer_available();
+
+    if(validator_driver.stepper_running && (plan_check_full_buffer() || (reads == validation.reads && available == now_available))) {
+        do {
+            validation.ticks += validator_driver.cycles_per_tick;
+            hal.stepper.interrupt_callback();
+            st_prep_buffer();
+        } while(validator_driver.stepper_running && plan_get_block_buffer_available() == now_available);
+    }
+
+    reads = validation.reads;
+    available = plan_get_block_buffer_available();
+}
+
 // Read fom input
 int16_t serial_read()
 {
@@ -85,15 +154,43 @@ int16_t serial_read()
     if (data == PLATFORM_EXTRA_CR)
         return(0);
 
-    if (args.echo)
-        fputc(data, args.output_file); 
+    if (sys.abort || data == 0x06 || data == -1) {
+        // Terminate last line if needed, then wait for the queued motions to complete before exiting.
+        if(!sys.abort && !validation.eol && validation.started) {
+            validation.eol = true;
+            validation.lines++;
+            if(!validation.blank)
+                validation.blocks++;
+            return '\n';
+        }
+        if(sys.abort || (plan_get_current_block() == NULL && !validator_driver.stepper_running)) {
+            sys.flags.exit = On;
+            sys.abort = 1;
+        }
+        return SERIAL_NO_DATA;
+    }
 
-    plan_reset();
+    if (args.echo)
+        fputc(data, args.output_file);
 
-    if (sys.abort || feof(args.input_file) || data == 0x06 || data == -1) { 
-        sys.abort = 1;
-        return SERIAL_NO_DATA;
+#ifdef ENABLE_JOB_ESTIMATE
+    // Run in check mode and let the core estimate the run time.
+    if(!validation.started) {
+        set_state(STATE_CHECK_MODE);
+        mc_estimate_start();
     }
+#endif
+
+    validation.started = true;
+    validation.reads++;
+
+    if((validation.eol = data == '\n')) {
+        validation.lines++;
+        if(!validation.blank)
+            validation.blocks++;
+        validation.blank = true;
+    } else if(data > ' ')
+        validation.blank = false;
 
     return data;
 }
@@ -101,22 +198,238 @@ int16_t serial_read()
 // Write to output
 void serial_write (const char *data)
 {
-    if (!args.silent) {
+    if (!args.silent && !args.json && validation.started) {
         char c, *ptr = (char *)data;
         while((c = *ptr++) != '\0')
             fputc(c, args.output_file);
     }
 }
 
+bool serial_suspend_read (bool suspend)
+{
+    return false;
+}
+
+// Output string as JSON string.
+static void json_write_string (const char *s)
+{
+    fputc('"', args.output_file);
+
+    while(*s) {
+        if(*s == '"' || *s == '\\')
+            fputc('\\', args.output_file);
+        if((unsigned char)*s < ' ')
+            fprintf(args.output_file, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, args.output_file);
+        s++;
+    }
+
+    fputc('"', args.output_file);
+}
+
+// Validate the input file, the core state is initialized from scratch so this must only be called once per process.
+static int validate (const char *filename)
+{
+    memset(&validation, 0, sizeof(validation_t));
+    validation.blank = true;
+
+    if(args.json) {
+        fputs("{\"file\":", args.output_file);
+        json_write_string(filename ? filename : "-");
+        fputs(",\"errors\":[", args.output_file);
+    }
+
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = validator_execute_realtime;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION; // Update when signatures and/or contract is changed - driver_init() should fail
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+    hal.stream.enqueue_realtime_command = protocol_enqueue_realtime_command;
+    hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer;
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_alloc(); // Allocate memory block for NVS buffer
+#endif
+
+    report_init_fns();
+
+    if(!driver_init())
+       return -1;
+
+    hal.stream.read = serial_read;
+    hal.stream.write = serial_write;
+    hal.stream.write_all = serial_write;
+    hal.stream.suspend_read = serial_suspend_read;
+
+    // TODO: read settings from EEPROM.dat if exists?
+
+#ifdef BUFFER_NVSDATA
+    nvs_buffer_init();
+#endif
+    settings_init();
+
+    if(!plan_alloc() || !hal.driver_setup(&settings))
+        return -1;
+
+    memset(sys_position, 0, sizeof(sys_position));
+    sys.override.feed_rate = DEFAULT_FEED_OVERRIDE;
+    sys.override.rapid_rate = DEFAULT_RAPID_OVERRIDE;
+    sys.override.spindle_rpm = DEFAULT_SPINDLE_RPM_OVERRIDE;
+
+    gc_init(true);
+    plan_reset();
+    st_reset();
+    limits_set_homing_axes();
+    sync_position();
+
+    report_init_fns();
+    grbl.report.status_message = validator_report_status_message;
+    grbl.report.feedback_message = report_feedback_message;
+
+    protocol_main_loop(true);
+
+    if(args.json) {
+#ifdef ENABLE_JOB_ESTIMATE
+        job_estimate_t *estimate = mc_estimate_end();
+
+        fprintf(args.output_file, "],\"lines\":%" PRIu32 ",\"blocks\":%" PRIu32 ",\"motions\":%" PRIu32 ",\"time\":%.3f,\"tools\":[",
+                 validation.lines, validation.blocks, estimate->blocks, (double)estimate->time);
+
+        for(uint_fast8_t idx = 0; idx < estimate->n_tools; idx++)
+            fprintf(args.output_file, "%s{\"tool\":%" PRIu32 ",\"time\":%.3f}", idx ? "," : "", estimate->tools[idx].tool, (double)estimate->tools[idx].time);
+
+        fputs("]}\n", args.output_file);
+#else
+        fprintf(args.output_file, "],\"lines\":%" PRIu32 ",\"blocks\":%" PRIu32 ",\"motions\":%" PRIu32 ",\"time\":%.3f}\n",
+                 validation.lines, validation.blocks, validator_driver.motion_blocks,
+                  (double)validation.ticks / (double)hal.f_step_timer + (double)validator_driver.delay_ms / 1000.0);
+#endif
+    }
+
+    fflush(args.output_file);
+
+    return exit_code;
+}
+
+#ifndef PLAT_WINDOWS
+
+typedef struct {
+    const char *filename;
+    FILE *output;
+    pid_t pid;
+    int status;
+    bool done;
+} job_t;
+
+// Validate files in parallel, one process per file, output is written in input order.
+static int validate_files (char **files, int n_files)
+{
+    int next = 0, running = 0, written = 0, failed = 0;
+    FILE *output_file = args.output_file;
+    job_t *job = calloc(n_files, sizeof(job_t));
+
+    if(job == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    while(written < n_files) {
+
+        while(running < args.jobs && next < n_files) {
+
+            job[next].filename = files[next];
+
+            if((job[next].output = tmpfile()) == NULL) {
+                perror("tmpfile");
+                return -1;
+            }
+
+            fflush(output_file);
+
+            if((job[next].pid = fork()) == 0) {
+                args.output_file = job[next].output;
+                if((args.input_file = fopen(job[next].filename, "r")) == NULL) {
+                    fprintf(args.output_file, args.json ? "{\"file\":\"%s\",\"error\":\"%s\"}\n" : "Error opening : %s (%s)\n", job[next].filename, strerror(errno));
+                    fflush(args.output_file);
+                    _exit(255);
+                }
+                if(!args.json && !args.silent)
+                    fprintf(args.output_file, "%s:\n", job[next].filename);
+                _exit(validate(job[next].filename) & 0xFF);
+            }
+
+            if(job[next].pid < 0) {
+                perror("fork");
+                return -1;
+            }
+
+            next++;
+            running++;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+
+        if(pid < 0) {
+            perror("wait");
+            return -1;
+        }
+
+        for(int idx = written; idx < next; idx++) {
+            if(job[idx].pid == pid) {
+                job[idx].status = WIFEXITED(status) ? WEXITSTATUS(status) : 255;
+                job[idx].done = true;
+                running--;
+                break;
+            }
+        }
+
+        // Copy output of completed jobs in input order.
+        while(written < next && job[written].done) {
+
+            int c;
+
+            rewind(job[written].output);
+            while((c = fgetc(job[written].output)) != EOF)
+                fputc(c, output_file);
+            fclose(job[written].output);
+
+            if(job[written].status)
+                failed++;
+
+            written++;
+        }
+    }
+
+    fflush(output_file);
+    free(job);
+
+    return failed > 255 ? 255 : failed;
+}
+
+#endif
+
 int main(int argc, char *argv[])
 {
-    int positional_args=0;
+    int n_files = 0;
+    char **files = malloc(argc * sizeof(char *));
 
     //defaults
     args.input_file = stdin;
     args.output_file = stdout;
     args.echo = 0;
     args.silent = 0;
+    args.json = 0;
+    args.jobs = 0;
 
     progname = argv[0];
 
@@ -133,6 +446,16 @@ int main(int argc, char *argv[])
                     args.silent = 1;
                     break;
 
+                case 'j': //JSON output
+                    args.json = 1;
+                    break;
+
+                case 'p': //parallel jobs
+                    if(argc < 2 || (args.jobs = strtol(argv[1], NULL, 10)) < 1)
+                        return usage(*argv);
+                    argv++; argc--;
+                    break;
+
                 case 'o': //output file
                     argv++; argc--;
                     args.output_file = fopen(*argv,"w");
@@ -148,57 +471,30 @@ int main(int argc, char *argv[])
                 default:
                     return usage(*argv);
             }
-        } else { //handle positional arguments
-            positional_args++;
-            switch(positional_args) {
-
-                case 1: //input file
-                    args.input_file = fopen(*argv,"r");
-                    if (!args.input_file) {
-                        perror("fopen");
-                        printf("Error opening : %s\n",*argv);
-                        return(usage(0));
-                    }
-                    break;
-
-                default:
-                    return usage(*argv);
-            }
-        }
+        } else //handle positional arguments
+            files[n_files++] = *argv;
     }
 
-    // Clear all and set some core function pointers
-    memset(&grbl, 0, sizeof(grbl_t));
-    grbl.on_execute_realtime = protocol_execute_noop;
-    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+    if(n_files > 1) {
+#ifdef PLAT_WINDOWS
+        printf("Only one input file is supported on this platform\n");
+        return usage(0);
+#else
+        if(args.jobs == 0 && (args.jobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+            args.jobs = 1;
 
-    // Clear all and set some HAL function pointers
-    memset(&hal, 0, sizeof(grbl_hal_t));
-    hal.version = HAL_VERSION; // Update when signatures and/or contract is changed - driver_init() should fail
-    hal.driver_reset = dummy_handler;
-    hal.irq_enable = dummy_handler;
-    hal.irq_disable = dummy_handler;
-    hal.nvs.size = GRBL_NVS_SIZE;
-
-    if(!driver_init())
-       return -1;
-
-    // TODO: read settings from EEPROM.dat if exists?
-
-    nvs_buffer_init();
-    settings_init();
-
-    report_init_fns();
-    grbl.report.status_message = validator_report_status_message;
-    grbl.report.feedback_message = report_feedback_message;
-
-    hal.stream.read = serial_read;
-    hal.stream.write = serial_write;
-    hal.stream.write_all = serial_write;
+        return validate_files(files, n_files);
+#endif
+    }
 
-    protocol_main_loop(true);
+    if(n_files == 1) {
+        args.input_file = fopen(files[0],"r");
+        if (!args.input_file) {
+            perror("fopen");
+            printf("Error opening : %s\n",files[0]);
+            return(usage(0));
+        }
+    }
 
-    return exit_code;
+    return validate(n_files ? files[0] : NULL);
 }
-
-
@@ -0,0 +1,39 @@
+/*
+  validator.h - Grbl G-code validation, shared with the validator driver
+
+  Part of Grbl Simulator
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VALIDATOR_H_
+#define _VALIDATOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "grbl/grbl.h"
+
+// Stepper and delay state kept by the validator driver. The stepper timer is not run,
+// the validator calls the stepper interrupt handler directly and sums up the timer periods.
+typedef struct {
+    volatile bool stepper_running;  // Set by stepper wake up, cleared by go idle.
+    uint32_t cycles_per_tick;       // Current stepper timer period.
+    uint32_t motion_blocks;         // Number of planner blocks started by the stepper.
+    uint64_t delay_ms;              // Sum of delays requested by the core, e.g. dwells.
+} validator_driver_t;
+
+extern THREAD_LOCAL validator_driver_t validator_driver;
+
+#endif
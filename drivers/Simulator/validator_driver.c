@@ -26,35 +26,47 @@
 #include "eeprom.h"
 #include "grbl_eeprom_extensions.h"
 #include "platform.h"
+#include "validator.h"
 
 #include "grbl/hal.h"
 
-/* don't delay at all in validator */
+THREAD_LOCAL validator_driver_t validator_driver = {0};
+
+/* don't delay at all in validator, only keep track of the time requested */
 static void driver_delay_ms (uint32_t ms, void (*callback)(void))
 {
+    validator_driver.delay_ms += ms;
+
     if(callback)
         callback();
 }
 
-/* Dummy functions */
-
-static void stepperEnable (axes_signals_t enable)
-{
-}
+/* Stepper functions, the step timer is emulated by the validator */
 
 static void stepperWakeUp (void)
 {
+    validator_driver.stepper_running = true;
 }
 
 static void stepperGoIdle (bool clear_signals)
 {
+    validator_driver.stepper_running = false;
 }
 
 static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
+    validator_driver.cycles_per_tick = cycles_per_tick;
 }
 
 static void stepperPulseStart (stepper_t *stepper)
+{
+    if(stepper->new_block)
+        validator_driver.motion_blocks++;
+}
+
+/* Dummy functions */
+
+static void stepperEnable (axes_signals_t enable)
 {
 }
 
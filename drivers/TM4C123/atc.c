@@ -35,7 +35,7 @@ static coord_data_t offset;
 void atc_tool_select (uint8_t tool)
 {
 #ifdef N_TOOLS
-    current_tool = &tool_table[tool];
+    current_tool = gc_get_tool(tool);
 #endif
 }
 
@@ -70,6 +70,10 @@ typedef struct {
 static pwm_ramp_t pwm_ramp;
 #endif
 
+#if RASTER_ENABLE
+#include "laser/raster.h"
+#endif
+
 #if PPI_ENABLE
 
 #include "laser/ppi.h"
@@ -853,6 +857,10 @@ static bool driver_setup (settings_t *settings)
 
 #endif
 
+#if RASTER_ENABLE
+    raster_init();
+#endif
+
    /****************************
     *  Software debounce init  *
     ****************************/
@@ -1001,7 +1009,7 @@ static bool driver_setup (settings_t *settings)
 
   // Set defaults
 
-    IOInitDone = settings->version == 18;
+    IOInitDone = settings->version == 19;
 
     settings_changed(settings);
 
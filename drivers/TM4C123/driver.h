@@ -49,6 +49,9 @@
 #ifndef PPI_ENABLE
 #define PPI_ENABLE              0
 #endif
+#ifndef RASTER_ENABLE
+#define RASTER_ENABLE           0
+#endif
 #ifndef TRINAMIC_ENABLE
 #define TRINAMIC_ENABLE         0
 #endif
@@ -89,7 +89,7 @@ static void enetStreamWriteS (const char *data)
 {
 #if TELNET_ENABLE
     if(services.telnet)
-        TCPStreamWriteS(data);
+        TCPStreamWriteAllS(data);
 #endif
 #if WEBSOCKET_ENABLE
     if(services.websocket)
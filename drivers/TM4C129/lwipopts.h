@@ -48,8 +48,12 @@
 #define EMAC_PHY_CONFIG (EMAC_PHY_TYPE_INTERNAL | EMAC_PHY_INT_MDIX_EN |      \
                          EMAC_PHY_AN_100B_T_FULL_DUPLEX)
 #define PHY_PHYS_ADDR      0
+#ifndef NUM_TX_DESCRIPTORS
 #define NUM_TX_DESCRIPTORS 24
-#define NUM_RX_DESCRIPTORS 8
+#endif
+#ifndef NUM_RX_DESCRIPTORS
+#define NUM_RX_DESCRIPTORS 16 // Room for bursts while the tcpip thread is held off by higher priority tasks
+#endif
 
 //*****************************************************************************
 //
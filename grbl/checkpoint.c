@@ -0,0 +1,259 @@
+/*
+  checkpoint.c - power loss checkpoints written to FRAM
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_NVS_CHECKPOINT
+
+#include <string.h>
+
+#include "checkpoint.h"
+#include "nvs_buffer.h"
+#include "planner.h"
+
+/* The parser records the source, line number and modal state of each line with motion in a ring and tags the
+   planner blocks of the line with the sequence number of the entry. When the stepper ISR starts a block of a new
+   line the line becomes the executing line, a checkpoint is written from the foreground for every
+   CHECKPOINT_INTERVAL lines started or immediately by checkpoint_power_fail(). The checkpoint is written directly
+   to physical storage, bypassing the deferred sync of the NVS buffer, so this is only enabled for FRAM. */
+
+typedef struct {
+    uint32_t tag;
+    int32_t line_number;
+    checkpoint_source_t source;
+    gc_modal_t modal;
+    float feed_rate;
+    float rpm;
+} checkpoint_line_t;
+
+static THREAD_LOCAL uint32_t nvs_address = 0;
+static THREAD_LOCAL checkpoint_source_ptr get_source = NULL;
+static THREAD_LOCAL checkpoint_source_t last_source;
+static THREAD_LOCAL uint32_t last_tag = 0, seq = 0;
+static THREAD_LOCAL volatile uint32_t executing = 0, lines = 0;
+static THREAD_LOCAL volatile bool pending = false;
+static THREAD_LOCAL checkpoint_line_t ring[CHECKPOINT_RING_SIZE];
+static THREAD_LOCAL on_execute_realtime_ptr on_execute_realtime;
+static THREAD_LOCAL on_program_completed_ptr on_program_completed;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+void checkpoint_set_source (checkpoint_source_ptr source)
+{
+    get_source = source;
+    last_tag = 0;
+}
+
+uint32_t checkpoint_tag_block (void)
+{
+    checkpoint_source_t source = {0};
+    checkpoint_line_t *entry;
+
+    if(nvs_address == 0)
+        return 0;
+
+    // Blocks of the same source line share the entry, e.g. a line split into several motions.
+    if(get_source && get_source(&source) && last_tag && !memcmp(&source, &last_source, sizeof(checkpoint_source_t)))
+        return last_tag;
+
+    if(++last_tag == 0) // 0 is no tag.
+        last_tag = 1;
+
+    memcpy(&last_source, &source, sizeof(checkpoint_source_t));
+
+    entry = &ring[last_tag % CHECKPOINT_RING_SIZE];
+    entry->tag = last_tag;
+    entry->line_number = gc_state.line_number;
+    memcpy(&entry->source, &source, sizeof(checkpoint_source_t));
+    memcpy(&entry->modal, &gc_state.modal, sizeof(gc_modal_t));
+    entry->feed_rate = gc_state.feed_rate;
+    entry->rpm = gc_state.spindle.rpm;
+
+    return last_tag;
+}
+
+// Blocks without a tag, e.g. homing and jogging, do not change the executing line.
+ISR_CODE void checkpoint_block_started (uint32_t tag)
+{
+    if(tag && tag != executing) {
+        executing = tag;
+        if(++lines >= CHECKPOINT_INTERVAL) {
+            lines = 0;
+            pending = true;
+        }
+    }
+}
+
+// Builds the checkpoint for the executing line, returns false if the line entry has been reused.
+ISR_CODE static bool checkpoint_build (checkpoint_t *checkpoint, uint32_t tag)
+{
+    checkpoint_line_t *entry = &ring[tag % CHECKPOINT_RING_SIZE];
+
+    if(tag == 0 || entry->tag != tag)
+        return false;
+
+    if(++seq == 0)
+        seq = 1;
+
+    checkpoint->seq = seq;
+    checkpoint->line_number = entry->line_number;
+    memcpy(&checkpoint->source, &entry->source, sizeof(checkpoint_source_t));
+    memcpy(&checkpoint->modal, &entry->modal, sizeof(gc_modal_t));
+    checkpoint->feed_rate = entry->feed_rate;
+    checkpoint->rpm = entry->rpm;
+
+    return true;
+}
+
+ISR_CODE void checkpoint_power_fail (void)
+{
+    checkpoint_t checkpoint;
+
+    if(nvs_address && checkpoint_build(&checkpoint, executing)) {
+        // Copied without the sequence check of system_get_position() as this may be called with the stepper ISR preempted.
+        memcpy(checkpoint.position, sys_position, sizeof(checkpoint.position));
+        nvs_buffer_write_through(nvs_address, (uint8_t *)&checkpoint, sizeof(checkpoint_t));
+    }
+}
+
+static void checkpoint_write (uint32_t tag)
+{
+    checkpoint_t checkpoint;
+
+    if(checkpoint_build(&checkpoint, tag)) {
+        system_get_position(checkpoint.position);
+        nvs_buffer_write_through(nvs_address, (uint8_t *)&checkpoint, sizeof(checkpoint_t));
+    }
+}
+
+static void checkpoint_clear (void)
+{
+    checkpoint_t checkpoint;
+
+    memset(&checkpoint, 0, sizeof(checkpoint_t));
+    nvs_buffer_write_through(nvs_address, (uint8_t *)&checkpoint, sizeof(checkpoint_t));
+    executing = lines = 0;
+    pending = false;
+}
+
+bool checkpoint_get (checkpoint_t *checkpoint)
+{
+    return nvs_address && hal.nvs.memcpy_from_nvs((uint8_t *)checkpoint, nvs_address, sizeof(checkpoint_t), true) == NVS_TransferResult_OK && checkpoint->seq != 0;
+}
+
+static void checkpoint_execute (uint_fast16_t state)
+{
+    on_execute_realtime(state);
+
+    if(pending) {
+        pending = false;
+        checkpoint_write(executing);
+    }
+}
+
+// A completed program is not to be restarted.
+static void checkpoint_program_completed (program_flow_t program_flow)
+{
+    if(sys.state != STATE_CHECK_MODE)
+        checkpoint_clear();
+
+    if(on_program_completed)
+        on_program_completed(program_flow);
+}
+
+// Reports the stored checkpoint as [PWR:<seq>,<line number>,<source line>,<source offset>,<machine position>].
+static void checkpoint_report (checkpoint_t *checkpoint)
+{
+    uint_fast8_t idx;
+    float mpos[N_AXIS];
+
+    system_convert_array_steps_to_mpos(mpos, checkpoint->position);
+
+    hal.stream.write("[PWR:");
+    hal.stream.write(uitoa(checkpoint->seq));
+    hal.stream.write(",");
+    hal.stream.write(checkpoint->line_number < 0 ? "-" : "");
+    hal.stream.write(uitoa((uint32_t)(checkpoint->line_number < 0 ? -checkpoint->line_number : checkpoint->line_number)));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(checkpoint->source.line));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(checkpoint->source.offset));
+    for(idx = 0; idx < N_AXIS; idx++) {
+        hal.stream.write(",");
+        hal.stream.write(ftoa(mpos[idx], N_DECIMAL_COORDVALUE_MM));
+    }
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// $PWR reports the stored checkpoint, $PWR=0 clears it and $PWR=POS restores the machine position from it.
+static status_code_t checkpoint_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(line, "$PWR", 4)) {
+
+        checkpoint_t checkpoint;
+
+        if(line[4] == '\0') {
+            if(checkpoint_get(&checkpoint)) {
+                checkpoint_report(&checkpoint);
+                retval = Status_OK;
+            } else
+                retval = Status_SettingReadFail;
+        } else if(!strcmp(&line[4], "=0")) {
+            checkpoint_clear();
+            retval = Status_OK;
+        } else if(!strcmp(&line[4], "=POS")) {
+            if(!(state == STATE_IDLE || state == STATE_ALARM))
+                retval = Status_IdleError;
+            else if(!checkpoint_get(&checkpoint))
+                retval = Status_SettingReadFail;
+            else {
+                memcpy(sys_position, checkpoint.position, sizeof(sys_position));
+                sync_position();
+                retval = Status_OK;
+            }
+        } else
+            retval = Status_InvalidStatement;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void checkpoint_init (void)
+{
+    if(hal.nvs.type != NVS_FRAM || (nvs_address = nvs_alloc(sizeof(checkpoint_t))) == 0)
+        return;
+
+    if(grbl.on_execute_realtime != checkpoint_execute) {
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = checkpoint_execute;
+    }
+
+    if(grbl.on_program_completed != checkpoint_program_completed) {
+        on_program_completed = grbl.on_program_completed;
+        grbl.on_program_completed = checkpoint_program_completed;
+    }
+
+    if(grbl.on_unknown_sys_command != checkpoint_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = checkpoint_command;
+    }
+}
+
+#endif
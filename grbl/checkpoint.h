@@ -0,0 +1,72 @@
+/*
+  checkpoint.h - power loss checkpoints written to FRAM
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include "hal.h"
+
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL 10 // Number of lines started between checkpoints
+#endif
+
+#ifndef CHECKPOINT_RING_SIZE
+#define CHECKPOINT_RING_SIZE 64 // Number of lines tracked from parsing to execution
+#endif
+
+// Source of the line being parsed, provided by the stream, e.g. a file on the SD card.
+typedef struct {
+    uint32_t id;        // Identifies the source, e.g. from file size and date, 0 if none
+    uint32_t line;      // Number of lines before the line
+    uint32_t offset;    // Offset of the first character of the line
+} checkpoint_source_t;
+
+// Fills in the source of the line being parsed, returns false if not known.
+typedef bool (*checkpoint_source_ptr)(checkpoint_source_t *source);
+
+// Stored checkpoint, the executing line and the modal state before it was executed.
+typedef struct {
+    uint32_t seq;                   // Incremented for each checkpoint written, 0 if cleared
+    int32_t line_number;            // N word of the line
+    checkpoint_source_t source;
+    gc_modal_t modal;
+    float feed_rate;
+    float rpm;
+    int32_t position[N_AXIS];       // Machine position (steps) when the checkpoint was written
+} checkpoint_t;
+
+// Allocates NVS storage if the physical storage is FRAM, must be called before the NVS buffer is loaded.
+void checkpoint_init (void);
+
+// Sets the provider of the line source, NULL to remove it.
+void checkpoint_set_source (checkpoint_source_ptr source);
+
+// Called by the parser on execution of a block with motion, returns the tag to be carried by the planner blocks.
+uint32_t checkpoint_tag_block (void);
+
+// Called from the stepper ISR when a new stepper block is started.
+void checkpoint_block_started (uint32_t tag);
+
+// Writes a checkpoint for the executing line immediately, to be called by the driver from the power fail interrupt.
+void checkpoint_power_fail (void);
+
+// Copies the stored checkpoint, returns false if none or not valid.
+bool checkpoint_get (checkpoint_t *checkpoint);
+
+#endif
@@ -47,14 +47,30 @@
 
 //#define KINEMATICS_API // Remove comment to add HAL entry points for custom kinematics
 
+// Max segment length for kinematics using adaptive line segmentation, Maslow router, wall plotter and linear delta.
+// Segments are otherwise made as long as the arc tolerance ($12) allows in joint space.
+//#define KINEMATICS_SEGMENT_MAX_LENGTH 25.0f // mm. Default 25.0f.
+
 // Enable Maslow router kinematics.
 // Experimental - testing required and homing needs to be worked out.
 //#define MASLOW_ROUTER // Default disabled. Uncomment to enable.
+// Use double precision math for the Maslow chain length calculation, only useful on targets with a double precision FPU.
+//#define MASLOW_DOUBLE_PRECISION // Default disabled. Uncomment to enable.
 
 // Enable wall plotter kinematics.
 // Experimental - testing required and homing needs to be worked out.
 //#define WALL_PLOTTER // Default disabled. Uncomment to enable.
 
+// Enable linear delta kinematics. The X, Y and Z motors drive the carriages of the towers
+// at 210, 330 and 90 degrees, lines, rapids and jogs are segmented as the arc tolerance ($12) requires.
+// IMPORTANT: Home all towers in the same cycle towards the top, e.g. $44=7 and $45=0. Machine
+// positions are set with the effector centered and Z is negative towards the bed.
+// NOTE: Soft limits are checked per tower, the X, Y and Z max travel settings ($130-$132) are the carriage travels.
+//       Targets out of reach of any tower are rejected with a soft limit alarm.
+//#define LINEAR_DELTA // Default disabled. Uncomment to enable.
+//#define DELTA_ARM_LENGTH 250.0f // mm, length of the diagonal rods. Default 250.0f.
+//#define DELTA_RADIUS 124.0f // mm, horizontal distance from the carriage to the effector joints when centered. Default 124.0f.
+
 // Enable CoreXY kinematics. Use ONLY with CoreXY machines.
 // IMPORTANT: If homing is enabled, you must reconfigure the homing cycle #defines above to
 // #define HOMING_CYCLE_0 X_AXIS_BIT and #define HOMING_CYCLE_1 Y_AXIS_BIT
@@ -81,6 +97,33 @@
 //#define SAFETY_DOOR_SPINDLE_DELAY 4.0f // Float (seconds)
 //#define SAFETY_DOOR_COOLANT_DELAY 1.0f // Float (seconds)
 
+// Enables overlapping spindle spin-up with motion. M3/M4 and spindle speed changes no longer wait for the
+// spindle to reach speed, following rapids are executed while it spins up and the first feed motion with the
+// spindle on waits for the at speed signal, or for SPINDLE_SPINUP_DELAY seconds from the start for drivers
+// without the signal. When resuming from a safety door with parking enabled the spindle and coolant are
+// restored at the start of the fast restore motion and their power-up delays awaited before the plunge.
+// NOTE: Drivers without the at speed signal then always wait for the spin-up delay, G4 dwells after M3/M4
+//       may be removed from programs. The delay is not applied in laser mode.
+//#define ENABLE_ASYNC_SPINDLE_START
+//#define SPINDLE_SPINUP_DELAY 4.0f // Float (seconds), defaults to SAFETY_DOOR_SPINDLE_DELAY
+
+// Enables waiting for the spindle to reach speed by the measured RPM for drivers providing RPM feedback from an
+// encoder or a VFD but no at speed signal. Spindle starts then wait until the RPM is within the at speed tolerance
+// ($340, in percent) of the programmed RPM, or raise a spindle alarm after SPINDLE_AT_SPEED_TIMEOUT seconds.
+// The time needed is reported with the current tool number as [MSG:Spindle at speed in <s> s, T<n>].
+// NOTE: The at speed tolerance must be set to a value > 0 for the RPM to be checked.
+//#define ENABLE_SPINDLE_RPM_AT_SPEED
+//#define SPINDLE_AT_SPEED_TIMEOUT 4.0f // Float (seconds), defaults to SAFETY_DOOR_SPINDLE_DELAY
+
+// Enables a PWM lookup table built by spindle_precompute_pwm_values() from the spindle settings, including the
+// linearization pieces if ENABLE_SPINDLE_LINEARIZATION is enabled. spindle_compute_pwm_value() then interpolates
+// between SPINDLE_PWM_LUT_SIZE + 1 table entries instead of evaluating the RPM model, drivers may call the inline
+// spindle_lut_pwm_value() directly. This speeds up laser power updates, which are done for every step segment.
+// NOTE: Adds 2 * SPINDLE_PWM_LUT_SIZE + 10 bytes to the driver PWM data. The table is not used for the PID
+//       limited conversion used by spindle synchronized motion.
+//#define ENABLE_SPINDLE_PWM_LUT
+//#define SPINDLE_PWM_LUT_SIZE 64
+
 // Control signals bit definitions and mask.
 // NOTE: these definitions are only referenced in this file. Do NOT change!
 #define SIGNALS_RESET_BIT (1<<0)
@@ -121,6 +164,15 @@
 //#define REPORT_WCO_REFRESH_BUSY_COUNT 30        // (2-255)
 //#define REPORT_WCO_REFRESH_IDLE_COUNT 10        // (2-255) Must be less than or equal to the busy count
 
+// When compact status reports are enabled by $10 bit 12 the position, buffer state, line number, feed and speed
+// and pin state fields are only reported when changed since the last report, work coordinate offset and override
+// data only when changed. Every n-th report is a full keyframe. A realtime 0x87 request always returns a keyframe.
+//#define REPORT_COMPACT_KEYFRAME_COUNT 20        // (1-255)
+
+// Realtime commands are executed after every n-th line output by the $$ settings listing so that status
+// reports, overrides and feed holds are served while a sender enumerates the settings. Set to 0 to disable.
+//#define REPORT_SETTINGS_YIELD_COUNT 4           // (0-255)
+
 // The temporal resolution of the acceleration management subsystem. A higher number gives smoother
 // acceleration, particularly noticeable on machines that run at very high feedrates, but may negatively
 // impact performance. The correct value for this parameter is machine dependent, so it's advised to
@@ -181,12 +233,47 @@
 // much greater than this. The default setting should capture most, if not all, full arc error situations.
 //#define ARC_ANGULAR_TRAVEL_EPSILON 5E-7f // Float (radians)
 
+// Enables feed aware arc segmentation. Arc segments are normally sized for the chord error to be at the
+// arc tolerance ($12), which for large radius arcs at high feed rates may result in a planner buffer that
+// does not span the distance needed to stop from the feed rate. With this enabled the segment length is
+// increased until the planner buffer spans the stopping distance, with the chord error limited to
+// ARC_ADAPTIVE_TOLERANCE_FACTOR times the arc tolerance. Segments are never made shorter than normal.
+//#define ENABLE_ADAPTIVE_ARC_SEGMENTATION
+//#define ARC_ADAPTIVE_TOLERANCE_FACTOR 5.0f // Float (1.0 or higher)
+
+// Enables arc planner blocks. A G2/G3 arc is then queued as a single planner block and the step
+// segment generator follows the arc, the step segments are sized for the chord error to be within the
+// arc tolerance ($12). The tangential speed is constant when cruising and there are no junctions to
+// slow down for. The feed rate is limited for the centripetal acceleration to be within the axis limits.
+// Arcs are still segmented into lines when axes other than the plane and helical axes move, or when
+// height map compensation or non ISR backlash compensation is active.
+// NOTE: Adds about 60 bytes to each planner block.
+//#define ENABLE_ARC_BLOCKS
+
+// Enables dogleg G0 rapids. Instead of a straight line, where the axis needing the most time limits the rate and
+// acceleration of the others, a rapid is executed as a sequence of lines through the positions the axes would be at
+// if moved independently at their own max rate and acceleration, with a line ending each time an axis reaches the
+// target. Z is moved alone, first when moving up and last when moving down, so the other axes always move at the
+// higher of the start and target Z. The path stays within the box spanned by the start and target positions.
+// NOTE: Only G0 motions are affected, not G28/G30 or canned cycle rapids. Not available with non-cartesian kinematics.
+//#define ENABLE_DOGLEG_RAPIDS
+
+
 // Default constants for G5 Cubic splines
 //
 //#define BEZIER_MIN_STEP 0.002f
 //#define BEZIER_MAX_STEP 0.1f
 //#define BEZIER_SIGMA 0.1f
 
+// Enable to subdivide G5 cubic splines by curvature instead of by the step halving/doubling flatness
+// test above. The parameter step for each segment is computed from the second derivative of the spline
+// so that the chord error stays within the arc tolerance ($12), resulting in few long segments on flat
+// spans and short segments only where the curvature is high. BEZIER_MIN_STEP still limits the number
+// of segments. The number of segments output by the last spline is added to the next real time report
+// as |BZ:<count>, may be used to tune the arc tolerance against throughput.
+//#define ENABLE_ADAPTIVE_SPLINE_SEGMENTATION
+
+
 // Time delay increments performed during a dwell. The default value is set at 50ms, which provides
 // a maximum time delay of roughly 55 minutes, more than enough for most any application. Increasing
 // this delay will increase the maximum dwell time linearly, but also reduces the responsiveness of
@@ -199,7 +286,11 @@
 // available RAM, like when re-compiling for MCU with ample amounts of RAM. Or decrease if the MCU begins to
 // crash due to the lack of available RAM or if the CPU is having trouble keeping up with planning
 // new incoming motions as they are executed.
+// NOTE: The buffer is allocated from the heap at startup and its size can be changed at run time
+// with the $7 setting, this symbol sets the default value for that. Large RAM targets may use
+// several hundred blocks for high density CAM output. A new size is applied on the next startup.
 // #define BLOCK_BUFFER_SIZE 16 // Uncomment to override default in planner.h.
+//#define DEFAULT_PLANNER_BUFFER_BLOCKS 256 // Uncomment to override default $7 value, range 8 - 1024.
 
 // Governs the size of the intermediary step segment buffer between the step execution algorithm
 // and the planner blocks. Each segment is set of steps executed at a constant velocity over a
@@ -209,6 +300,9 @@
 // before having to come back and refill this buffer, currently at ~50msec of step moves.
 // #define SEGMENT_BUFFER_SIZE 6 // Uncomment to override default in stepper.h.
 
+// Max number of plugin hooks called by the stepper ISR once per step segment, see st_add_segment_hook().
+//#define STEPPER_SEGMENT_HOOKS 4 // Default 4.
+
 // Configures the position after a probing cycle during Grbl's check mode. Disabled sets
 // the position to the probe target, when enabled sets the position to the start position.
 // #define SET_CHECK_MODE_PROBE_TO_START // Default disabled. Uncomment to enable.
@@ -233,6 +327,23 @@
 // #define HOMING_AXIS_SEARCH_SCALAR  1.5f // Uncomment to override defaults in limits.c.
 // #define HOMING_AXIS_LOCATE_SCALAR  10.0f // Uncomment to override defaults in limits.c.
 
+// Shortens the locate phase of the homing cycle. The axes stop at the switch contacts found by the
+// previous approach, so after the pull-off they are at the pull-off distance from the contacts. The
+// locate approach is then made at the seek rate up to HOMING_FAST_LOCATE_MARGIN (default 0.5 mm) from
+// the contacts and only the remaining distance at the homing feed rate. With hard limits enabled the limit
+// pin change interrupt locks the axes at first contact during approaches, rather than the homing cycle
+// polling the switches, so the axes stop at the contacts even at high seek rates. The margin must be
+// greater than the switch repeatability, a single locate cycle ($43=1) is then usually sufficient.
+// NOTE: Axes are not locked by the interrupt with kinematics or for auto squared axes.
+//#define HOMING_FAST_LOCATE // Default disabled. Uncomment to enable.
+// #define HOMING_FAST_LOCATE_MARGIN 0.5f // Uncomment to override default in limits.c.
+
+// Squares auto squared (ganged) axes in every approach of the homing cycle, seek and locate. The motor whose
+// switch triggers first is stopped and the other continues until its own switch triggers. The separate homing
+// cycles for each motor of the axis, otherwise run after the main cycle, are then not needed.
+// NOTE: Squaring accuracy is then given by the locate rate, as for the separate cycles.
+//#define HOMING_PARALLEL_SQUARING // Default disabled. Uncomment to enable.
+
 // Enable the '$RST=*', '$RST=$', and '$RST=#' non-volatile storage restore commands. There are cases where
 // these commands may be undesirable. Simply comment the desired macro to disable it.
 // NOTE: See SETTINGS_RESTORE_ALL macro for customizing the `$RST=*` command.
@@ -278,8 +389,387 @@
 // The buffer will be written to non-volatile storage when in idle state.
 //#define BUFFER_NVSDATA_DISABLE
 
+// Number of changed areas (global settings, a coordinate system, a tool table entry...) of the buffer written
+// to non-volatile storage per pass of the foreground process when idle. Remaining areas are written on the following
+// passes, keeping realtime commands responsive while slow storage such as I2C EEPROM is updated.
+//#define NVS_SYNC_REGIONS 1 // (1-255)
+
 //#define ENABLE_BACKLASH_COMPENSATION
 
+// Executes backlash compensation in the stepper interrupt instead of by separate planner blocks. On a direction
+// reversal of an axis the backlash steps are output in addition to the steps of the block, interleaved with them at a
+// rate limited to the axis max rate, keeping the motion plan continuous through the reversal. Machine position is not
+// changed by the backlash steps. Requires ENABLE_BACKLASH_COMPENSATION.
+// NOTE: Backlash steps are not output in step burst mode.
+//#define BACKLASH_COMPENSATION_ISR // Default disabled. Uncomment to enable.
+
+// Enables jerk limited (S-curve) acceleration. Adds a per axis jerk setting ($170 - $17x) and replaces
+// the constant acceleration velocity ramps computed by the step segment generator with ramps where
+// the acceleration is ramped up and down at the jerk limit. The planner derates the block acceleration
+// so that a full ramp to nominal speed can be executed without exceeding the axis acceleration limits.
+// NOTE: Ramps with a smaller velocity change, e.g. between junctions, are executed with the acceleration
+//       clamped to the axis limits and thus at a higher than configured jerk.
+//#define ENABLE_JERK_ACCELERATION // Default disabled. Uncomment to enable.
+
+// Enables input shaping of the velocity ramps computed by the step segment generator. Adds per axis
+// resonance frequency ($180 - $18x, in Hz) and damping ratio ($190 - $19x) settings. Acceleration ramps
+// are convolved with a zero vibration (ZV) shaper for the resonance of the axis having the largest motion
+// component in the block, cancelling the residual vibration so acceleration can be raised without ringing.
+// Set the frequency to 0 to disable shaping for an axis. The planner derates the block acceleration so that
+// a shaped ramp to nominal speed can be executed without exceeding the axis acceleration limits.
+// Shaping is performed when step segments are prepared and does not add to the stepper interrupt load.
+// NOTE: Ramps too short to be shaped without more than doubling the acceleration are executed unshaped.
+// NOTE: The segment time set by ACCELERATION_TICKS_PER_SECOND should be well below half the period of the
+// highest resonance frequency, consider increasing it to 200 or more.
+// NOTE: Cannot be combined with jerk limited acceleration.
+//#define ENABLE_INPUT_SHAPING // Default disabled. Uncomment to enable.
+//#define INPUT_SHAPER_ZVD // Uncomment to use the ZVD shaper, more robust to frequency errors but with twice the delay.
+
+// Enables a separate per axis deceleration limit ($200 - $20x, in mm/sec^2) for forced decelerations to a stop,
+// from a feed hold, a safety door opening or a jog cancel. This may be set well above the acceleration setting,
+// which is tuned for surface finish, shortening the stopping distance and the time until the hold is complete.
+// Values below the acceleration setting, such as the default 0, decelerate with the acceleration setting.
+// NOTE: With jerk limited acceleration the setting limits the average deceleration of the stop ramp.
+//#define ENABLE_STOP_DECELERATION // Default disabled. Uncomment to enable.
+
+// Enables merging of consecutive, nearly collinear, line segments into a single planner block. Segments
+// are merged when they share the same motion conditions, feed rate and spindle speed, and all segment end
+// points are within the tolerance set by $8 from the merged line. High density CAM output then consumes
+// fewer planner blocks and the lookahead spans a longer path. Set $8 to 0 to disable merging at run time.
+// With merging enabled the lookahead depth is measured in path length: the planner buffer is considered full when
+// the blocks queued ahead of the executing block span PLANNER_LOOKAHEAD_DISTANCE mm, the number of blocks then only
+// limits the lookahead of segments that cannot be merged. Long blocks then do not occupy, and replan, the whole buffer.
+// The distance should be at least the stopping distance from the highest feed rate, rate^2 / (2 * acceleration), as
+// the last block is planned to stop. Set it to 0.0f to limit the lookahead by the number of blocks only.
+// NOTE: Not available with kinematics since these may rely on lines being segmented.
+//#define ENABLE_PATH_MERGING // Default disabled. Uncomment to enable.
+//#define PLANNER_LOOKAHEAD_DISTANCE 100.0f // Default 100 mm with path merging enabled. Uncomment to override.
+
+// Enables a separate junction deviation, set by $87, for junctions between laser mode motions with the laser off
+// (M5 or S0), such as the travel between the strokes of a vector engraving. The path of these does not affect the
+// engraving so a larger value can be used, letting the travel pass corners without slowing down as when cutting.
+// Junctions between travel and engraving motions use the $11 junction deviation.
+//#define ENABLE_LASER_TRAVEL_JUNCTIONS // Default disabled. Uncomment to enable.
+
+// Enables feed compensation of inner arcs for a constant chip load. The programmed feed rate applies to the tool
+// centre, on an inner (concave) arc of radius R the cutting edge of a tool of radius r moves R + r from the arc
+// centre and thus faster than the centre. The feed rate of such arcs is scaled by R / (R + r), r is the radius of
+// the current tool from the tool table (G10 L1 R). The controller cannot tell on which side of the path the
+// material is, set $88 to 1 when the toolpaths are climb milled, 2 when conventionally milled, 0 to disable.
+// With M4 the sides are swapped. Inverse time feed rate arcs are not compensated.
+// NOTE: The feed rate is not reduced by more than the ARC_FEED_COMPENSATION_MIN factor in motion_control.c.
+//#define ENABLE_ARC_FEED_COMPENSATION // Default disabled. Uncomment to enable.
+
+// Enables path blending mode, G64 P<tolerance>. In this mode corners between consecutive lines are
+// rounded by an arc, approximated by a few short line segments, deviating at most P from the programmed
+// corner. This allows corners to be taken at a much higher speed than in exact path mode, G61.
+// G64 without a P word is accepted and executes in exact path mode.
+// NOTE: Not available with kinematics since these may rely on lines being segmented.
+//#define ENABLE_PATH_BLENDING // Default disabled. Uncomment to enable.
+
+// Enables step burst mode for drivers that support it, indicated by hal.driver_cap.step_burst being
+// non zero. When the step rate exceeds STEP_BURST_RATE several step events are executed per stepper
+// interrupt and then output back to back by the driver, reducing the interrupt rate at high step rates.
+// The number of step events per interrupt is limited to 2^hal.driver_cap.step_burst.
+// NOTE: Burst mode is not used during probing and homing cycles.
+//#define ENABLE_STEP_BURST // Default disabled. Uncomment to enable.
+//#define STEP_BURST_RATE 40000 // Step rate in Hz above which burst mode is used. Default 40000.
+
+// Enables microstep resolution switching for drivers that support it, indicated by hal.stepper.set_microstep_shift
+// being set, e.g. the Trinamic plugin. Blocks with a step rate above MICROSTEP_SWITCH_RATE at their nominal speed are
+// executed with the resolution of all motors divided by a power of two, up to 2^hal.stepper.microstep_shift_max, and
+// the step counts scaled to match. The resolution is switched by the stepper interrupt at the start of the block and
+// restored for the first block below the rate, less a hysteresis. Rounding to coarse steps is carried over to the
+// following blocks and made up for by the next block at the configured resolution. Blocks ending at standstill are
+// always executed at the configured resolution so that motion stops at the exact planned position.
+// NOTE: Not used for homing, probing, parking, backlash compensation, arc blocks and position dependent spindle speed.
+//#define ENABLE_MICROSTEP_SWITCHING // Default disabled. Uncomment to enable.
+//#define MICROSTEP_SWITCH_RATE 40000.0f // Step rate in Hz above which the resolution is reduced. Default 40000.
+
+// Enables time based sizing of the step segment buffer. Segments are prepared until the buffer holds
+// SEGMENT_BUFFER_TIME milliseconds of motion, or is full, rather than always filling all the segments.
+// Cruising segments are made longer, up to SEGMENT_BUFFER_TIME / (SEGMENT_BUFFER_SIZE - 1), so that the
+// buffered time can be reached at high speeds as well. Ramps are still segmented at ACCELERATION_TICKS_PER_SECOND.
+// The buffered time is added to the real time report as |SB:<ms> when buffer state reporting is enabled.
+// NOTE: Cruising segments of spindle synchronized motions are not made longer.
+//#define SEGMENT_BUFFER_TIME 60 // ms. Default disabled. Uncomment to enable.
+
+// Computes the segment step rate in fixed point arithmetic, keeping the segment and partial step times
+// in timer cycles and the steps to execute in 24.8 fixed point. This replaces a float division and
+// several float multiplies and roundings per segment by integer operations, reducing the segment
+// preparation load on processors without a hardware FPU.
+// NOTE: Enabled by default for ARM processors without FPU (Cortex-M0/M3) and for MSP430.
+//#define SEGMENT_PREP_FIXED_POINT // Uncomment to enable.
+
+// Allocates output commands (M62 - M68) and (MSG, ...) messages from fixed size pools instead of the heap.
+// This avoids heap fragmentation and non-deterministic allocation times for programs carrying output commands
+// in many blocks, e.g. laser raster jobs. The heap is used when a pool is exhausted or a message does not fit
+// in a pool slot, the number of times this happened is added to the real time report as |PX:<count> when buffer
+// state reporting is enabled and the count is non zero.
+// NOTE: The pools use approximately OUTPUT_COMMAND_POOL_SIZE * 12 + MESSAGE_POOL_SIZE * MESSAGE_POOL_SLOT_SIZE bytes of RAM.
+//#define ENABLE_ALLOC_POOLS // Default disabled. Uncomment to enable.
+//#define OUTPUT_COMMAND_POOL_SIZE BLOCK_BUFFER_SIZE // Default BLOCK_BUFFER_SIZE.
+//#define MESSAGE_POOL_SIZE BLOCK_BUFFER_SIZE // Default BLOCK_BUFFER_SIZE.
+//#define MESSAGE_POOL_SLOT_SIZE 64 // Max message length + 1. Default 64.
+
+// Enables execution time statistics for the stepper interrupt handler and the step segment preparation,
+// measured in CPU cycles by the driver provided cycle counter (DWT->CYCCNT on Cortex-M3/M4/M7, CCOUNT on ESP32).
+// The number of segment buffer underflows, where the buffer ran empty before motion was completed, is counted too.
+// $STATS prints [ISR:<min>,<avg>,<max>,<samples>], [PREP:<min>,<avg>,<max>,<samples>], [PULSE:<min>,<avg>,<max>,<samples>],
+// [SEGHOOKS:<count>] and [UNDERFLOW:<count>], $STATS=0 clears the statistics. PULSE is the time spent in hal.stepper.pulse_start()
+// per step, including any plugins hooked into it, SEGHOOKS the number of plugins using the cheaper per segment hook.
+// NOTE: Adds some overhead to the stepper interrupt handler.
+//#define ENABLE_STEPPER_STATS // Default disabled. Uncomment to enable.
+
+// Enables entry latency and execution time statistics for the interrupt sources registered by the driver, measured
+// in CPU cycles by the driver provided cycle counter. Entry latency is measured from the hardware event for sources
+// where the driver can tell when it occurred, e.g. from a timer counter. $IRQ prints the configured priority along
+// with the statistics per source and the step timing jitter against IRQ_STATS_JITTER_TARGET (ns), $IRQ=0 clears
+// the statistics. Interrupt priorities are set by IRQ_PRIORITY_* symbols in the driver, see its driver.h.
+// NOTE: Adds some overhead to the interrupt handlers measured.
+//#define ENABLE_IRQ_STATS // Default disabled. Uncomment to enable.
+
+// Enables the flight recorder, a RAM ring buffer logging each step segment when prepped and when loaded by the stepper ISR
+// with a timestamp, the cycles per tick, steps, AMASS level, segment and planner buffer fill and the line number.
+// The log is frozen FLIGHTREC_POST_TRIGGER records after a segment buffer underrun, an alarm or the $FREC=1 command,
+// $FREC outputs it, $FREC=0 clears and rearms it. Timestamps are in microseconds, from hal.get_micros() if available.
+// NOTE: uses FLIGHTREC_SIZE * 20 bytes of RAM, the default 256 records covering about 1.3 seconds of motion at
+//       ACCELERATION_TICKS_PER_SECOND 100.
+//#define ENABLE_FLIGHT_RECORDER // Default disabled. Uncomment to enable.
+//#define FLIGHTREC_SIZE 256 // Default 256.
+
+// Enables per line execution time capture, $LTIME=1 starts and $LTIME=0 stops output of [LT:<line>,<start>,<time>]
+// for each executed line, in microseconds from hal.get_micros() if available. Lines split into several blocks, such
+// as arcs, are timed as one. Compare against the programmed time to find where the machine does not reach the feed rate.
+//#define ENABLE_LINE_TIMING // Default disabled. Uncomment to enable.
+
+// Enables the $PBENCH[=<lines>] command, a g-code parser line rate benchmark. Generated 3D surfacing, laser raster
+// and engraving programs are run through the line filtering and gc_execute_block() in check mode, CPU cycles per line
+// are measured by the driver provided cycle counter. Outputs [PBENCH:<corpus>,<lines>,<avg>,<max>,<lines/s>,<errors>]
+// per corpus and [PBENCH:<corpus>:<class>,<lines>,<avg>,<max>] per line class: COMMENT, ARC, MULTIAXIS (three or more
+// axis words), LINEAR, MCODE and OTHER. Default is PARSER_BENCHMARK_LINES (5000) lines per corpus, must be run in idle state.
+//#define ENABLE_PARSER_BENCHMARK // Default disabled. Uncomment to enable.
+
+// Enables the $BENCH[=<lines>] command, an on-target motion pipeline capacity self-test. Tiny collinear segments of
+// decreasing length, full circle arcs, a laser raster (laser off) and jog commands are executed with the step outputs
+// masked, the planner, segment preparation and stepper interrupt run at the configured X/Y max rates. Outputs
+// [BENCH:<workload>,<lines>,<ms>,<programmed ms>,<lines/s>,<underruns>,<errors>] per workload, ISR load per workload when
+// ENABLE_STEPPER_STATS is enabled, and a [BENCH:MAX,<lines/s>,<step rate>,<ISR headroom %>,<underruns>] summary.
+// Default is MOTION_BENCHMARK_LINES (1000) lines per workload, must be run in idle state. Machine position and parser
+// state are restored on completion.
+// NOTE: direction outputs are not masked and hard limits and other safety inputs stay active.
+//#define ENABLE_MOTION_BENCHMARK // Default disabled. Uncomment to enable.
+
+// Enables the $MEM command, prints the RAM used by the planner, stepper segment, protocol line and parser buffers,
+// settings and system state as [MEM:<subsystem>,<bytes>], followed by buffers reported by drivers and plugins, e.g. the
+// serial and network stream buffers, via grbl.on_report_memory. Ends with [MEM:TOTAL,<bytes>] and [MEM:FREE,<bytes>],
+// the latter if the driver implements hal.get_free_mem(). See doc/script/ram_map.py for a summary from the linker map.
+//#define ENABLE_MEMORY_REPORT // Default disabled. Uncomment to enable.
+
+// Enables execution time profiling of foreground code regions: the parser, planner_recalculate(), st_prep_buffer(),
+// report_realtime_status(), protocol_exec_rt_system() and the Modbus, websocket and telnet poll handlers. Call count,
+// average, max and total time of each region is measured by the driver provided cycle counter, or by the millisecond
+// tick counter if not available. Plugins may add regions with profile_add_region(), see profile.h.
+// $PROF prints [PROF:<region>,<calls>,<avg>,<max>,<total/1000>] for each region entered, [PROFEV:<event>,<count>] for
+// the realtime event handlers in protocol_exec_rt_system() and [PROF:ELAPSED,<ms>]. RTIDLE counts the calls that returned
+// without checking the alarm and state flags and override queues as no event was pending. $PROF=0 clears the counters.
+// Regions are nested, e.g. RTSYSTEM includes REPORT and PREP.
+// NOTE: Adds some overhead to each region, mainly from reading the cycle counter.
+//#define ENABLE_PROFILING // Default disabled. Uncomment to enable.
+
+// Enables the foreground task scheduler, plugins may add tasks with scheduler_add() instead of chaining
+// grbl.on_execute_realtime, see scheduler.h. Tasks are called in priority order: high and normal priority
+// tasks when due, background tasks in turn, one per pass plus more within SCHEDULER_PASS_BUDGET.
+// Segment preparation is run before the tasks and after each task called. $LOAD prints
+// [LOAD:<task>,<priority>,<runs>,<avg>,<max>,<overruns>,<misses>,<deferred>] for each task, $LOAD=0 clears the counters.
+// NOTE: Tasks are not preempted, a task exceeding its budget is only counted as an overrun.
+//#define ENABLE_SCHEDULER // Default disabled. Uncomment to enable.
+
+// Enables static dispatch of the HAL functions called from the stepper interrupt handler and the protocol loop:
+// hal.stepper.pulse_start, hal.stepper.cycles_per_tick, hal.probe.get_state, hal.spindle.update_rpm and
+// hal.stream.read. The driver must provide driver_dispatch.h, which may map any of these to its own functions so
+// that these are called directly and can be inlined, see the hal_* macros at the end of hal.h and the template in
+// templates/arm-driver. Functions not mapped by the driver are called via the function pointers as before.
+// NOTE: Plugins chaining a mapped function by swapping the hal pointer are bypassed, drivers should only map
+//       functions that are not swapped at run time or hooked by the plugins in use.
+//#define HAL_STATIC_DISPATCH // Default disabled. Uncomment to enable.
+
+// Enables step phase smoothing, an alternative to AMASS for drivers capable of delaying the step pulse of
+// each axis individually, indicated by hal.driver_cap.step_phase. Rather than multiplying the stepper interrupt
+// rate at low step rates as AMASS does, the time since the ideal step time of each axis is computed from the
+// Bresenham counters on each step event. The driver delays the step pulse for each axis accordingly, which
+// results in smooth step pulse trains for the non-dominant axes of multi axis motions at the normal interrupt rate.
+// NOTE: Step pulses are output up to one step event later than without step phase smoothing.
+// NOTE: AMASS is disabled when this is enabled, drivers not capable of delaying step pulses get no smoothing.
+//#define STEP_PHASE_SMOOTHING // Default disabled. Uncomment to enable.
+
+// Enables laser power ramping within segments for rate adjusted laser mode (M4). Rather than setting the power for
+// the segment exit speed at the start of each segment, the PWM value is ramped linearly from the power for the segment
+// entry speed to the power for the exit speed, updated every LASER_POWER_RAMP_STEPS step events from the stepper interrupt.
+// This evens out the burn at the ends of raster lines where the segment speed changes rapidly.
+// NOTE: Requires a driver with a spindle update_pwm() implementation that is fast enough to be called at the step rate.
+//#define ENABLE_LASER_POWER_RAMP // Default disabled. Uncomment to enable.
+//#define LASER_POWER_RAMP_STEPS 4 // Step events between PWM updates, power of 2. Default 4.
+
+// Enables a step injection channel for superimposing corrections on a single axis, by default Z, on the motion
+// being executed without replanning, e.g. for plasma torch height control. Steps queued by st_inject_steps() are
+// output from the stepper interrupt at a rate limited to the axis max rate, or a lower rate set by st_set_injection_rate().
+// Injected steps updates the machine position but not the planner position, the planner and parser position should be
+// resynchronized when motion has stopped.
+// NOTE: Steps are injected only while the axis is not moved by the block being executed and not in step burst mode.
+//#define ENABLE_STEP_INJECTION // Default disabled. Uncomment to enable.
+//#define STEP_INJECTION_AXIS Z_AXIS // Default Z_AXIS.
+
+// Enables windowed acknowledge mode for streaming over high latency links, where waiting for an ok per line
+// limits the streaming rate. The sender enables the mode with $ACK=<window>, the controller responds with
+// [ACK:<window>] and then the sender may have up to <window> lines not acknowledged. Accepted lines are
+// acknowledged in batches of window / 2 lines, or when no more input is available, by ok:<line> where <line> is
+// the number of lines processed since the mode was enabled. Errors are still reported per line by error:<code>,
+// acknowledging the line following the last line acknowledged. $ACK=0 or a soft reset disables the mode.
+//#define ENABLE_ACK_WINDOW // Default disabled. Uncomment to enable.
+//#define ACK_WINDOW_MAX 255 // Max window accepted by $ACK, in lines. Default 255.
+
+// Enables packed g-code blocks, pre-tokenised by the sender, that are executed without the character level
+// parsing of text blocks. A packed block is a line starting with STX (0x02) followed by words and a checksum:
+// each word is an uppercase word letter followed by 1 to 8 nibbles, most significant first, of the IEEE 754
+// single precision value of the word. Nibbles are encoded as the characters 'a' to 'p', trailing zero nibbles
+// may be omitted, e.g. G1 is sent as Gdpi. The line number is sent as an N word as usual. The block is ended by
+// '*' followed by the 8-bit sum of the characters between STX and '*' encoded as two nibbles.
+// Words are validated and executed exactly as for text blocks, a checksum mismatch is reported as error 51.
+// NOTE: The printable encoding is used since drivers filter real-time command characters from the input stream.
+//#define ENABLE_PACKED_BLOCKS // Default disabled. Uncomment to enable.
+
+// Enables compressed input for low bandwidth links such as Bluetooth SPP and 115200 baud serial. $ZIP=1 enables
+// and $ZIP=0 disables it after the response to the command line, reported by [ZIP:1] and [ZIP:0]. A soft reset
+// disables it. Input is decoded before the protocol loop sees it, a match character 'a' to 'z' followed by a distance
+// character '@' to '}' copies 3 to 28 characters from the last 62 decoded characters, line ends excluded. '`' escapes
+// lowercase letters, other characters are literals. The character counting protocol then counts compressed bytes.
+// Invalid matches are reported as error 58. doc/script/gcode_zip.py is a host side encoder, doc/script/stream_bench.py -z
+// streams compressed.
+//#define ENABLE_STREAM_COMPRESSION // Default disabled. Uncomment to enable.
+
+// Enables filtering of input in the stream drivers receive path, before characters are added to the input buffer.
+// Whitespace and the content of comments are discarded and letters are uppercased, as done by the protocol loop,
+// except for system and user command lines. The input buffer then holds more g-code when the sender uses the Bf:
+// status report field or XON/XOFF for flow control, a character counting sender still counts the characters sent.
+// Currently supported by the STM32F4xx UART and USB CDC streams and the simulator, other drivers ignore it.
+// NOTE: cannot be combined with ENABLE_STREAM_COMPRESSION.
+//#define ENABLE_RX_FILTER // Default disabled. Uncomment to enable.
+
+// Enables replay of parsed motion blocks. Blocks containing only G0, G1, G2 and G3 motions, plane, distance,
+// units and feed rate mode commands and axis, arc, F and N words are passed to grbl.on_replayable_block after
+// execution, a plugin may record them and later pass them to gc_replay_block() to execute the motion without
+// parsing and validating the block again. The SD card plugin uses this to cache repeated jobs in a .rpl file
+// alongside the g-code file, see plugins/sdcard/README.md.
+//#define ENABLE_BLOCK_REPLAY // Default disabled. Uncomment to enable.
+
+// Enables a line index for jobs run from the SD card, recorded to a .idx file alongside the g-code file. Every
+// SDCARD_INDEX_INTERVAL lines the file offset and the modal state are recorded so that a job can be restarted
+// from a line by $FL<line>=<filename> without reading the file from the start, see plugins/sdcard/README.md.
+//#define ENABLE_SDCARD_INDEX // Default disabled. Uncomment to enable.
+//#define SDCARD_INDEX_INTERVAL 500 // Lines between index checkpoints. Default 500.
+
+// Enables power loss checkpoints for controllers with FRAM for non-volatile storage. Every CHECKPOINT_INTERVAL lines
+// started by the steppers the executing line, its source line and file offset when run from the SD card, the modal
+// state before the line and the machine position are written directly to FRAM, bypassing the deferred NVS sync.
+// A driver may also call checkpoint_power_fail() from a power fail interrupt to write a checkpoint immediately.
+// $PWR reports the checkpoint, $PWR=0 clears it and $PWR=POS restores the machine position from it. With
+// ENABLE_SDCARD_INDEX $FP=<filename> restarts the job from the line executing when the checkpoint was written.
+// The checkpoint is cleared on program end. Ignored if the driver does not report NVS_FRAM storage.
+//#define ENABLE_NVS_CHECKPOINT // Default disabled. Uncomment to enable.
+//#define CHECKPOINT_INTERVAL 10 // Lines between checkpoints. Default 10.
+
+// Enables a job queue for the SD card plugin, a list of files run one after the other, each a given number of times.
+// When a file ends with M2 or M30 the next run is started without returning to the host, see plugins/sdcard/README.md.
+//#define ENABLE_SDCARD_JOB_QUEUE // Default disabled. Uncomment to enable.
+//#define SDCARD_JOB_QUEUE_SIZE 4 // Max number of files in the queue. Default 4.
+
+// Enables O-word subroutines and loops: O<n>SUB ... O<n>ENDSUB, O<n>CALL and O<n>REPEAT[<count>] ... O<n>ENDREPEAT.
+// Bodies are stored in RAM as the filtered block text received by the protocol layer and executed from there
+// without being streamed again. Expressions and parameters are not supported, so WHILE, DO and IF are rejected.
+// Subroutines are cleared by program end (M2, M30) and soft reset.
+//#define ENABLE_OWORDS // Default disabled. Uncomment to enable.
+//#define OWORD_BUFFER_SIZE 2048 // Size of buffer for subroutine and loop bodies. Default 2048 bytes.
+
+// Enables numbered parameters and expressions. Word values may be given as a parameter reference, #<n>, or as an
+// expression in brackets using the LinuxCNC operators and functions, e.g. X[#1 * 2 + SIN[30]]. Parameters are assigned
+// by #<n>=<value>, assignments take effect when the block has been read. #1 - #100 are user parameters, a subset of the
+// LinuxCNC system parameters such as probe results (#5061 - #5070) and current position (#5420 - #5428) is readable.
+// With ENABLE_OWORDS expressions in subroutine and loop bodies are compiled once and evaluated from the compiled form.
+//#define ENABLE_NGC_PARAMETERS // Default disabled. Uncomment to enable.
+
+// Number of slots in the realtime command queue used by protocol_enqueue_rt_command(), range 2 - 16.
+// Increase if plugins enqueue bursts of commands. Queue usage is reported by $RTQ as [RTQ:<size>,<high water mark>,<dropped>],
+// $RTQ=0 clears the high water mark and the dropped count.
+//#define RT_QUEUE_SIZE 8 // Default 8.
+
+// Number of segment buffer underruns logged. An underrun is when the stepper interrupt finds the segment buffer empty while
+// the planner still has blocks to execute, the motion then stutters as the steppers stop until segments are prepared again.
+// $UNDERRUN prints [UNDERRUN:<count>] followed by [UNDERRUN:<ms>,<line number>] for each logged underrun, oldest first.
+// $UNDERRUN=0 clears the log.
+//#define UNDERRUN_LOG_SIZE 8 // Default 8.
+
+// Outputs a [MSG:Warning: Segment buffer underrun, line <n>] feedback message on segment buffer underruns.
+// Underruns occurring before the message is output are reported by one message only.
+//#define UNDERRUN_MESSAGE // Default disabled. Uncomment to enable.
+
+// Enables incremental expansion of the G73, G81 - G83 drilling cycles and the G76 threading cycle. The motions of the
+// cycle are queued as planner space becomes available from protocol_execute_realtime() instead of from within the parser,
+// so the block returns as soon as the planner is full or, for G76, when waiting for the previous pass to finish before a
+// spindle synchronized cut. The next block waits for the cycle to be completely queued before it is executed.
+//#define ENABLE_CANNED_CYCLE_GENERATOR // Default disabled. Uncomment to enable.
+
+// Enables velocity mode jogging for joysticks and pendants. $JV=<axis><velocity>... sets the target velocity of each
+// axis in mm/min (or inches/min in G20 mode), axes not given are stopped and $JV= stops all. Rather than the host
+// streaming short $J= moves the core keeps jog motions queued in the commanded direction, to the travel limits if homed
+// and soft limits are enabled, and applies velocity changes to them in the same way as a feed override.
+// Direction changes stop the motion before restarting it. The jog is stopped if no new velocity is commanded within
+// VELOCITY_JOG_TIMEOUT ms, so the host must repeat the command while jogging. Plugins may call mc_jog_velocity().
+// NOTE: $JV is refused with error 20 if the timeout is enabled and the driver does not provide hal.get_elapsed_ticks().
+//#define ENABLE_VELOCITY_JOG // Default disabled. Uncomment to enable.
+//#define VELOCITY_JOG_TIMEOUT 500 // ms, default 500. Set to 0 to disable the timeout.
+
+// Enables streaming of externally planned trajectories. $PVT switches the input stream to binary frames holding timed
+// position and velocity knots per axis, see pvt.c for the format. The knots are buffered and interpolated into step
+// segments that are queued directly in the segment buffer, bypassing the planner. When the knot buffer runs empty in
+// motion, or on a feed hold or a frame error, the motion is decelerated to a stop and the stream is aborted.
+// Motion from standstill is started when PVT_START_KNOTS knots are buffered. While streaming the real-time report
+// has a |PVT:<free>,<ms> field with the number of knots that can be sent and the time buffered, with PVT_FREE_REPORT
+// set to n this is also output as [PVT:<free>,<ms>] each time n knots have been consumed.
+//#define ENABLE_PVT_STREAM // Default disabled. Uncomment to enable.
+//#define PVT_BUFFER_SIZE 64 // Default 64 knots.
+//#define PVT_START_KNOTS 8 // Default 8 knots.
+//#define PVT_FREE_REPORT 0 // Default 0, disabled.
+
+// Enables the job time estimator. When active the parser runs in check mode but motions are still queued in the planner,
+// planner blocks are then consumed by the step segment generator and the segment times added up instead of being executed.
+// Dwells, planner synchronizations and spindle spin-up delays are added, and the time is accumulated per tool changed to
+// by M6 or M61. Spin-ups awaited by the at speed signal are assumed to take JOB_ESTIMATE_SPINUP_TIME seconds.
+// Used by the simulator validator and by the SD card plugin $FE=<filename> command.
+//#define ENABLE_JOB_ESTIMATE // Default disabled. Uncomment to enable.
+
+// Enables controller driven status reports. A real-time status report is output at the interval set by $9 (milliseconds)
+// and whenever the state changes, without the host having to poll with '?'. The report is built once and written to all
+// streams, so several senders watching the same controller share it. Set $9 to 0 to disable at run time.
+// NOTE: Requires a driver that implements hal.get_elapsed_ticks().
+//#define ENABLE_AUTO_REPORT // Default disabled. Uncomment to enable.
+
+// Enables journaled storage of the NVS buffer in flash. Instead of rewriting the whole image when settings, coordinate
+// systems or tool data are changed a record with the changed data is appended. When the flash bank is full a new
+// image is written to a second bank, the old bank is erased on a later idle pass. Requires a driver that provides
+// hal.nvs.journal, NVS_JOURNAL_ALIGN should be set to the flash programming granularity if larger than 4 bytes.
+//#define ENABLE_NVS_JOURNAL // Default disabled. Uncomment to enable.
+
+// Reports the boot phase times in milliseconds, counted from when driver_init() has completed, as
+// [BOOT:SETTINGS:<ms>|SETUP:<ms>|READY:<ms>|DEFERRED:<ms>] after initialization deferred by drivers and plugins
+// via grbl.on_deferred_init has been run. READY is when the controller starts accepting commands.
+// NOTE: Requires a driver that implements hal.get_elapsed_ticks().
+//#define REPORT_BOOT_TIMING // Default disabled. Uncomment to enable.
+
+
+
+
+
 // End compile time only default configuration
 
 // When the HAL driver supports spindle sync then this option sets the number of pulses per revolution
@@ -375,6 +865,113 @@
 // repeatable. If needed, you can disable this behavior by uncommenting the define below.
 //#define ALLOW_FEED_OVERRIDE_DURING_PROBE_CYCLES // Default disabled. Uncomment to enable.
 
+// Enables debouncing of feed and rapid override commands. Commands are accumulated into a target value that is
+// applied, with a single replan of the planner buffer, when no further commands have been received for
+// OVERRIDE_DEBOUNCE_TIME ms. A burst of commands from an encoder knob then costs one replan instead of one for
+// each command. Set OVERRIDE_RAMP_STEP to ramp the feed override to the target in steps of that many percent,
+// one step each OVERRIDE_DEBOUNCE_TIME ms. See override.h for the defaults of these.
+//#define ENABLE_OVERRIDE_DEBOUNCE // Default disabled. Uncomment to enable.
+
+// By default, probe cycles wait for all preceding motions to complete before the probe is checked and
+// the cycle is started, stopping the machine before every probe move. Enabling this option queues
+// G38.2 and G38.3 motions in the planner behind the pending motions so that these are run without
+// the stop. The probe state is checked when the probe motion is started by the stepper driver.
+// NOTE: Probe away cycles (G38.4 and G38.5) are not queued. Parsing of the blocks following a probe
+// motion is still held until the cycle is completed since these depend on the probe result.
+// A probe contact during the preceding motions raises the probe protection alarm if enabled.
+//#define ENABLE_PROBE_QUEUING // Default disabled. Uncomment to enable.
+
+// Enables a faster tool setter cycle for the semi automatic tool change mode. The retract before the slow
+// probe motion is reduced to TOOL_CHANGE_PROBE_CLEARANCE above the seek probe trigger position, and the slow
+// probe motion is skipped when the driver latches the probe position in the probe pin interrupt, the seek
+// probe position is then as accurate. Enable ENABLE_PROBE_QUEUING as well to run the rapids to the tool setter
+// straight into the seek probe motion without a stop.
+// NOTE: The clearance must be larger than the distance the probe has to move off the tool setter to release.
+//#define ENABLE_FAST_TOOL_SETTER // Default disabled. Uncomment to enable.
+//#define TOOL_CHANGE_PROBE_CLEARANCE 0.5f // Default 0.5 mm.
+
+// By default, coolant changes (M7, M8 and M9) and spindle speed changes wait for all preceding motions
+// to complete, stopping the machine at every change. Enabling this option queues these with the next
+// motion in the planner, the stepper driver then applies them when the motion is started. If no motion
+// follows the change is applied when the buffered motions are completed or the buffer is synchronized.
+// A change is applied immediately as before when no motion is buffered.
+// NOTE: Spindle speed changes are still synchronized if the spindle at speed signal or RPM feedback is
+// used for waiting for the spindle to come up to speed. Spindle start, stop and direction changes, tool
+// changes (M6) and user defined M-codes are always synchronized. The coolant HAL function is called from
+// the stepper interrupt, it must be interrupt safe.
+//#define ENABLE_QUEUED_SPINDLE_COOLANT // Default disabled. Uncomment to enable.
+
+// By default, changes of the work coordinate offsets by G10, G92, G43.x/G49 and coordinate system selection
+// wait for all preceding motions to complete unless the "Sync on WCO change" status report option is disabled,
+// so that the work position reported matches the motion executing. Enabling this option queues the change of
+// the reported offsets with the next motion instead, the stepper driver then updates the report when the
+// motion is started. Up to WCO_QUEUE_SIZE - 1 changes may be queued, the buffer is synchronized when full.
+// NOTE: The planner works in machine coordinates, the change of the offsets itself is already parser side.
+// Offsets written to non-volatile storage are written to the RAM copy and saved to the physical storage when
+// idle, unless FORCE_BUFFER_SYNC_DURING_NVS_WRITE is defined or the driver has no RAM copy.
+//#define ENABLE_QUEUED_WCO_CHANGE // Default disabled. Uncomment to enable.
+
+// By default, the parser waits for room in the planner buffer before a motion is planned, the next block is
+// then read and parsed only after a planner block has been freed. Enabling this option queues up to
+// PARSE_AHEAD_QUEUE_SIZE - 1 parsed motions when the planner buffer is full so that the parser continues with
+// the next block, the queued motions are moved to the planner buffer as soon as blocks are freed.
+// NOTE: Motions carrying queued state changes, see ENABLE_QUEUED_SPINDLE_COOLANT and ENABLE_QUEUED_WCO_CHANGE,
+// and arcs planned as single blocks by ENABLE_ARC_BLOCKS wait for the queue to drain. Buffer synchronization
+// waits for queued motions too.
+//#define ENABLE_PARSE_AHEAD // Default disabled. Uncomment to enable.
+//#define PARSE_AHEAD_QUEUE_SIZE 16 // Default 16.
+
+// By default, the planner plans the last block in the buffer for a stop at its end, limiting the speed of
+// long moves split into many short lines to what can be stopped within the buffer. Enabling this option
+// extends the lookahead to the motions queued by ENABLE_PARSE_AHEAD: for each a compact record holding
+// the length, acceleration and max entry speed is computed, and the last block is planned for exiting at
+// the speed from which the queued motions can be stopped. Increase PARSE_AHEAD_QUEUE_SIZE for more lookahead.
+// NOTE: The queued motions are moved to the planner buffer from the main loop, this must not be kept busy
+// for longer than the execution time of the last block(s). Cannot be combined with path merging or blending.
+//#define ENABLE_FAR_LOOKAHEAD // Default disabled. Uncomment to enable.
+
+// Enables a compact planner block layout for RAM constrained targets, allowing a larger block buffer ($7)
+// in the same amount of memory. Step counts are stored in 24 bits, lines exceeding 2^23 steps on any axis
+// are split into several blocks. The block spindle data is reduced to the RPMs used by the stepper, the
+// rarely used message and output command pointers share a single pointer to heap allocated storage, and
+// the junction speed limit is stored as a 16 bit float, rounded down.
+// NOTE: Lines queued directly by the planner, bypassing mc_line(), are not split and are discarded if too long.
+//#define COMPACT_PLAN_BLOCKS // Default disabled. Uncomment to enable.
+
+// Enables height map (bed levelling) Z compensation of motions. The map is a grid of points in machine
+// coordinates, the Z offset applied is interpolated from the heights of the surrounding points relative
+// to the height of the first point. Lines are split at the grid cell boundaries, and within cells only
+// if the deviation of the line from the interpolated surface would exceed HEIGHTMAP_TOLERANCE.
+// The map is kept in RAM, set it up with these commands, e.g. from a file on a SD card or the sender:
+//  $MAP=<x0>,<y0>,<dx>,<dy>,<nx>,<ny> defines the grid, <nx> * <ny> points spaced <dx>, <dy> mm apart.
+//  $MAPZ=<row>,<z0>,...,<zn> sets the heights of a row of points.
+//  $MAPE=1 enables compensation, all points must be set. $MAPE=0 disables it.
+//  $MAP outputs the grid and the heights of the points in the same format.
+// While compensation is disabled a successful probe cycle ending within HEIGHTMAP_PROBE_TOLERANCE of a
+// grid point stores the probed Z position as the height of the point, thus a map can be created by
+// probing each point.
+// NOTE: Not available for non-cartesian kinematics. System motions, such as parking, are not compensated.
+//#define ENABLE_HEIGHTMAP // Default disabled. Uncomment to enable.
+
+// Enables laser raster mode, the controller adds the overscan so that the sender only has to output the image rows.
+// A row is a sequence of laser mode feed motions along X or Y only, in the same direction and each starting where
+// the previous ended, it is started by a motion with the laser on. Before a row the head is moved with the laser
+// off to a runway distance before the row start, and after the row it is moved the runway distance beyond the end.
+// The runway is the distance needed to accelerate to the row feed rate, from the axis acceleration setting, the
+// current feed override and RASTER_RUNWAY_MARGIN in raster.h. Runways are limited to the soft limits if enabled.
+//  $LRASTER=1 enables raster mode, $LRASTER=0 disables it. $LRASTER outputs [LRASTER:<enabled>].
+// NOTE: Segments with the laser off (S0) continue a row. The row ends with the next motion that does not continue it
+//       or when the planner buffer is synchronized, e.g. on a dwell or program end.
+//#define ENABLE_LASER_RASTER // Default disabled. Uncomment to enable.
+
+// Enables named settings profiles for switching between machine configurations, e.g. laser and spindle.
+// $PRFS=<name> stores the current global settings as a profile, $PRF=<name> loads it, $PRFD=<name>
+// deletes it and $PRF lists the stored profiles. Loading replaces all global settings in one go and
+// notifies the driver once. The number of profiles is set by SETTINGS_PROFILES in settings_profiles.h.
+// NOTE: Profiles are stored in the NVS driver area, each takes the size of the global settings plus 18 bytes.
+//       Driver or plugin settings are not part of a profile.
+//#define ENABLE_SETTINGS_PROFILES // Default disabled. Uncomment to enable.
+
 // Inverts logic of the stepper enable signal(s).
 // NOTE: Not universally available for individual axes - check driver documentation.
 //       Specify at least X_AXIS_BIT if a common enable signal is used.
@@ -439,9 +1036,36 @@
 // #define N_TOOLS 8
 #endif
 
+// Keep the tool table in storage provided by the driver via hal.tool.table_read and hal.tool.table_write,
+// typically an indexed file on SD card or in flash, instead of in NVS. Only the number of entries set here
+// are held in RAM, the least recently used are replaced on demand. Required for N_TOOLS above 8, up to 254.
+// NOTE: The tool table is not persistent if the driver does not provide the storage.
+//#define TOOL_TABLE_CACHE 16 // Default disabled. Uncomment to enable.
+
+// Keep a RAM copy of the coordinate system data (G54 - G59.3, G28, G30 and G92 offsets) read from and
+// written to non-volatile storage. Coordinate system switches, G28/G30 and the $# report then do not
+// read and verify the stored data, the cache is kept coherent since all writes are made through it.
+// NOTE: Requires N_AXIS * 4 bytes of RAM per coordinate system, about 150 bytes for 3 axes.
+//#define ENABLE_COORD_DATA_CACHE // Default disabled. Uncomment to enable.
+
+// Keep the output of the $G report, the $I version and option lines and the $# coordinate system lines
+// in RAM and resend it until the data reported changes. Senders polling $G with the status report then
+// do not have the report rebuilt each time. The $G output is invalidated when the parser state changes,
+// $I and $# when build info or coordinate data is written, and all when settings are changed.
+// NOTE: Requires about 900 bytes of RAM for 3 axes, allocated on first use of each report.
+//#define ENABLE_REPORT_CACHE // Default disabled. Uncomment to enable.
+
 // Max number of entries in log for PID data reporting, to be used for tuning
 //#define PID_LOG 1000 // Default disabled. Uncomment to enable.
 
+// Output the PID log samples as the hex encoded bit patterns of the IEEE 754 float values instead of decimal text.
+// Faster to output and lossless, the report is [PIDX:<setpoint>,<t_sample>,2,<max PID cycles>|<hex samples>].
+//#define PID_LOG_BINARY // Default disabled. Uncomment to enable.
+
+// Use the fixed point PID for spindle synchronized motion, gains are precomputed at the start of each block.
+// For targets without a FPU or with a heavy interrupt load, currently only supported by the iMXRT1062 driver.
+//#define SPINDLE_SYNC_PID_FIXED // Default disabled. Uncomment to enable.
+
 //#define DEFAULT_NO_REPORT_BUFFER_STATE
 //#define DEFAULT_NO_REPORT_LINE_NUMBERS
 //#define DEFAULT_NO_REPORT_CURRENT_FEED_SPEED
@@ -460,6 +1084,19 @@
 //#define DEFAULT_X_ACCELERATION (10.0*60*60) // 10*60*60 mm/min^2 = 10 mm/sec^2
 //#define DEFAULT_Y_ACCELERATION (10.0*60*60) // 10*60*60 mm/min^2 = 10 mm/sec^2
 //#define DEFAULT_Z_ACCELERATION (10.0*60*60) // 10*60*60 mm/min^2 = 10 mm/sec^2
+//#define DEFAULT_X_JERK (100.0*60*60*60) // 100*60*60*60 mm/min^3 = 100 mm/sec^3
+//#define DEFAULT_Y_JERK (100.0*60*60*60) // 100*60*60*60 mm/min^3 = 100 mm/sec^3
+//#define DEFAULT_Z_JERK (100.0*60*60*60) // 100*60*60*60 mm/min^3 = 100 mm/sec^3
+//#define DEFAULT_X_SHAPER_FREQUENCY 0.0f // Hz, 0 = disabled
+//#define DEFAULT_Y_SHAPER_FREQUENCY 0.0f // Hz, 0 = disabled
+//#define DEFAULT_Z_SHAPER_FREQUENCY 0.0f // Hz, 0 = disabled
+//#define DEFAULT_X_SHAPER_DAMPING 0.1f // Damping ratio, 0 - 0.99
+//#define DEFAULT_Y_SHAPER_DAMPING 0.1f // Damping ratio, 0 - 0.99
+//#define DEFAULT_Z_SHAPER_DAMPING 0.1f // Damping ratio, 0 - 0.99
+//#define DEFAULT_X_STOP_DECELERATION 0.0f // mm/min^2, 0 = decelerate with the acceleration setting
+//#define DEFAULT_Y_STOP_DECELERATION 0.0f // mm/min^2, 0 = decelerate with the acceleration setting
+//#define DEFAULT_Z_STOP_DECELERATION 0.0f // mm/min^2, 0 = decelerate with the acceleration setting
+
 //#define DEFAULT_X_MAX_TRAVEL 200.0f // mm NOTE: Must be a positive value.
 //#define DEFAULT_Y_MAX_TRAVEL 200.0f // mm NOTE: Must be a positive value.
 //#define DEFAULT_Z_MAX_TRAVEL 200.0f // mm NOTE: Must be a positive value.
@@ -479,6 +1116,10 @@
 //#define DEFAULT_STEPPER_IDLE_LOCK_TIME 25 // msec (0-65535, 255 keeps steppers enabled)
 //#define DEFAULT_JUNCTION_DEVIATION 0.01f // mm
 //#define DEFAULT_ARC_TOLERANCE 0.002f // mm
+//#define DEFAULT_PATH_MERGE_TOLERANCE 0.002f // mm
+//#define DEFAULT_TRAVEL_JUNCTION_DEVIATION 0.1f // mm
+//#define DEFAULT_ARC_FEED_COMPENSATION 0 // 0 disabled, 1 climb milling, 2 conventional milling
+//#define DEFAULT_AUTO_REPORT_INTERVAL 0 // msec (0 or 50-60000)
 //#define DEFAULT_REPORT_INCHES
 //#define DEFAULT_INVERT_LIMIT_PINS
 //#define DEFAULT_SOFT_LIMIT_ENABLE
@@ -25,6 +25,9 @@
 #include "hal.h"
 #include "protocol.h"
 #include "coolant_control.h"
+#ifdef ENABLE_JOB_ESTIMATE
+#include "motion_control.h"
+#endif
 
 // Main program only. Immediately sets flood coolant running state and also mist coolant,
 // if enabled. Also sets a flag to report an update to a coolant state.
@@ -48,6 +51,10 @@ bool coolant_sync (coolant_state_t mode)
         if((ok = protocol_buffer_synchronize())) // Ensure coolant changes state when specified in program.
             coolant_set_state(mode);
     }
+#ifdef ENABLE_JOB_ESTIMATE
+    else if(sys.flags.estimate)
+        mc_estimate_delay(0.0f); // The planner is synchronized when executed.
+#endif
 
     return ok;
 }
@@ -45,19 +45,37 @@ inline static int32_t corexy_convert_to_b_motor_steps (int32_t *steps)
 }
 
 // Returns machine position of axis 'idx'. Must be sent a 'step' array.
+// NOTE: The motor step sums are converted directly, halving them in the integer domain would truncate odd sums.
 static void corexy_convert_array_steps_to_mpos (float *position, int32_t *steps)
 {
-    position[X_AXIS] = corexy_convert_to_a_motor_steps(steps) / settings.axis[X_AXIS].steps_per_mm;
-    position[Y_AXIS] = corexy_convert_to_b_motor_steps(steps) / settings.axis[Y_AXIS].steps_per_mm;
-    position[Z_AXIS] = steps[Z_AXIS] / settings.axis[Z_AXIS].steps_per_mm;
+    uint_fast8_t idx;
+
+    position[X_AXIS] = (float)(steps[A_MOTOR] + steps[B_MOTOR]) * 0.5f * derived_settings.mm_per_step[X_AXIS];
+    position[Y_AXIS] = (float)(steps[A_MOTOR] - steps[B_MOTOR]) * 0.5f * derived_settings.mm_per_step[Y_AXIS];
+
+    for(idx = Z_AXIS; idx < N_AXIS; idx++)
+        position[idx] = steps[idx] * derived_settings.mm_per_step[idx];
 }
 
 // Transform absolute position from cartesian coordinate system (mm) to corexy coordinate system (step)
+// When X and Y have the same steps/mm the motor positions are computed and rounded directly, A = X + Y and B = X - Y,
+// rather than rounding X and Y to steps first. This halves the rounding error of the motor positions.
 static void corexy_target_to_steps (int32_t *target_steps, float *target)
 {
     uint_fast8_t idx = N_AXIS;
     int32_t a_steps, b_steps;
 
+    if(settings.axis[X_AXIS].steps_per_mm == settings.axis[Y_AXIS].steps_per_mm) {
+
+        while(--idx > Y_AXIS)
+            target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+
+        target_steps[A_MOTOR] = lroundf((target[X_AXIS] + target[Y_AXIS]) * settings.axis[X_AXIS].steps_per_mm);
+        target_steps[B_MOTOR] = lroundf((target[X_AXIS] - target[Y_AXIS]) * settings.axis[X_AXIS].steps_per_mm);
+
+        return;
+    }
+
     do {
         switch(--idx) {
             case X_AXIS:
@@ -36,6 +36,13 @@
 
 // Note: DEFAULT_ACCELERATION is only referenced in this file
 #define DEFAULT_ACCELERATION (10.0f * 60.0f * 60.0f) // 10*60*60 mm/min^2 = 10 mm/sec^2
+// Note: DEFAULT_JERK is only referenced in this file
+#define DEFAULT_JERK (100.0f * 60.0f * 60.0f * 60.0f) // 100*60*60*60 mm/min^3 = 100 mm/sec^3
+// Note: DEFAULT_SHAPER_FREQUENCY and DEFAULT_SHAPER_DAMPING are only referenced in this file
+#define DEFAULT_SHAPER_FREQUENCY 0.0f // Hz, 0 = input shaping disabled
+#define DEFAULT_SHAPER_DAMPING 0.1f
+// Note: DEFAULT_STOP_DECELERATION is only referenced in this file
+#define DEFAULT_STOP_DECELERATION 0.0f // mm/min^2, 0 = decelerate with the acceleration setting
 
 #ifdef DEFAULT_REPORT_MACHINE_POSITION
 #undef DEFAULT_REPORT_MACHINE_POSITION
@@ -141,6 +148,42 @@
 #ifndef DEFAULT_Z_ACCELERATION
 #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_X_JERK
+#define DEFAULT_X_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_X_SHAPER_FREQUENCY
+#define DEFAULT_X_SHAPER_FREQUENCY DEFAULT_SHAPER_FREQUENCY
+#endif
+#ifndef DEFAULT_X_SHAPER_DAMPING
+#define DEFAULT_X_SHAPER_DAMPING DEFAULT_SHAPER_DAMPING
+#endif
+#ifndef DEFAULT_X_STOP_DECELERATION
+#define DEFAULT_X_STOP_DECELERATION DEFAULT_STOP_DECELERATION
+#endif
+#ifndef DEFAULT_Y_JERK
+#define DEFAULT_Y_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_Y_SHAPER_FREQUENCY
+#define DEFAULT_Y_SHAPER_FREQUENCY DEFAULT_SHAPER_FREQUENCY
+#endif
+#ifndef DEFAULT_Y_SHAPER_DAMPING
+#define DEFAULT_Y_SHAPER_DAMPING DEFAULT_SHAPER_DAMPING
+#endif
+#ifndef DEFAULT_Y_STOP_DECELERATION
+#define DEFAULT_Y_STOP_DECELERATION DEFAULT_STOP_DECELERATION
+#endif
+#ifndef DEFAULT_Z_JERK
+#define DEFAULT_Z_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_Z_SHAPER_FREQUENCY
+#define DEFAULT_Z_SHAPER_FREQUENCY DEFAULT_SHAPER_FREQUENCY
+#endif
+#ifndef DEFAULT_Z_SHAPER_DAMPING
+#define DEFAULT_Z_SHAPER_DAMPING DEFAULT_SHAPER_DAMPING
+#endif
+#ifndef DEFAULT_Z_STOP_DECELERATION
+#define DEFAULT_Z_STOP_DECELERATION DEFAULT_STOP_DECELERATION
+#endif
 #ifndef DEFAULT_X_MAX_TRAVEL
 #define DEFAULT_X_MAX_TRAVEL 200.0f
 #endif
@@ -257,6 +300,18 @@
 #ifndef DEFAULT_A_ACCELERATION
 #define DEFAULT_A_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_A_JERK
+#define DEFAULT_A_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_A_SHAPER_FREQUENCY
+#define DEFAULT_A_SHAPER_FREQUENCY DEFAULT_SHAPER_FREQUENCY
+#endif
+#ifndef DEFAULT_A_SHAPER_DAMPING
+#define DEFAULT_A_SHAPER_DAMPING DEFAULT_SHAPER_DAMPING
+#endif
+#ifndef DEFAULT_A_STOP_DECELERATION
+#define DEFAULT_A_STOP_DECELERATION DEFAULT_STOP_DECELERATION
+#endif
 #ifndef DEFAULT_A_MAX_TRAVEL
 #define DEFAULT_A_MAX_TRAVEL 200.0f
 #endif
@@ -270,6 +325,18 @@
 #ifndef DEFAULT_B_ACCELERATION
 #define DEFAULT_B_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_B_JERK
+#define DEFAULT_B_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_B_SHAPER_FREQUENCY
+#define DEFAULT_B_SHAPER_FREQUENCY DEFAULT_SHAPER_FREQUENCY
+#endif
+#ifndef DEFAULT_B_SHAPER_DAMPING
+#define DEFAULT_B_SHAPER_DAMPING DEFAULT_SHAPER_DAMPING
+#endif
+#ifndef DEFAULT_B_STOP_DECELERATION
+#define DEFAULT_B_STOP_DECELERATION DEFAULT_STOP_DECELERATION
+#endif
 #ifndef DEFAULT_B_MAX_TRAVEL
 #define DEFAULT_B_MAX_TRAVEL 200.0f
 #endif
@@ -283,10 +350,42 @@
 #ifndef DEFAULT_C_ACCELERATION
 #define DEFAULT_C_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_C_JERK
+#define DEFAULT_C_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_C_SHAPER_FREQUENCY
+#define DEFAULT_C_SHAPER_FREQUENCY DEFAULT_SHAPER_FREQUENCY
+#endif
+#ifndef DEFAULT_C_SHAPER_DAMPING
+#define DEFAULT_C_SHAPER_DAMPING DEFAULT_SHAPER_DAMPING
+#endif
+#ifndef DEFAULT_C_STOP_DECELERATION
+#define DEFAULT_C_STOP_DECELERATION DEFAULT_STOP_DECELERATION
+#endif
 #ifndef DEFAULT_C_MAX_TRAVEL
 #define DEFAULT_C_MAX_TRAVEL 200.0f
 #endif
 
+#ifndef DEFAULT_PLANNER_BUFFER_BLOCKS
+#define DEFAULT_PLANNER_BUFFER_BLOCKS BLOCK_BUFFER_SIZE
+#endif
+
+#ifndef DEFAULT_PATH_MERGE_TOLERANCE
+#define DEFAULT_PATH_MERGE_TOLERANCE 0.002f
+#endif
+
+#ifndef DEFAULT_TRAVEL_JUNCTION_DEVIATION
+#define DEFAULT_TRAVEL_JUNCTION_DEVIATION 0.1f
+#endif
+
+#ifndef DEFAULT_ARC_FEED_COMPENSATION
+#define DEFAULT_ARC_FEED_COMPENSATION 0
+#endif
+
+#ifndef DEFAULT_AUTO_REPORT_INTERVAL
+#define DEFAULT_AUTO_REPORT_INTERVAL 0
+#endif
+
 #ifndef DEFAULT_G73_RETRACT
 #define DEFAULT_G73_RETRACT 0.1f
 #endif
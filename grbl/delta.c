@@ -0,0 +1,336 @@
+/*
+  delta.c - linear delta kinematics implementation
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef LINEAR_DELTA
+
+#include <math.h>
+#include <string.h>
+
+#include "hal.h"
+#include "settings.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "limits.h"
+#include "delta.h"
+
+/* The X, Y and Z motors drive the carriages of the towers A, B and C at 210, 330 and 90 degrees around the
+   machine center. Joint positions are carriage heights, for a cartesian target at x, y, z the height of tower n is
+   z + sqrt(arm_length^2 - (x - tower_x[n])^2 - (y - tower_y[n])^2). At the machine origin the effector is centered
+   and the joint positions equal the carriage offset, the height of the carriages above the effector.
+   Axes above Z are mapped linearly. The derived geometry is recalculated on settings changes so that the
+   transform needs a single square root per tower. */
+
+#define N_TOWERS 3
+#define A_TOWER X_AXIS // Must be X_AXIS
+#define B_TOWER Y_AXIS // Must be Y_AXIS
+#define C_TOWER Z_AXIS // Must be Z_AXIS
+
+typedef struct {
+    float tower_x[N_TOWERS];
+    float tower_y[N_TOWERS];
+    float arm_pow[N_TOWERS];        // Squared arm lengths
+    float carriage_offset[N_TOWERS]; // Carriage height above the effector with the effector centered, mm
+    float steps_per_mm[N_TOWERS];
+} machine_t;
+
+static THREAD_LOCAL machine_t machine = {0};
+static THREAD_LOCAL bool joint_mode = false, out_of_reach = false;
+static THREAD_LOCAL settings_changed_ptr settings_changed;
+
+static void delta_geometry (settings_t *settings)
+{
+    static const float tower_angle[N_TOWERS] = { 210.0f, 330.0f, 90.0f };
+
+    uint_fast8_t idx = N_TOWERS;
+
+    do {
+        idx--;
+        machine.tower_x[idx] = DELTA_RADIUS * cosf(tower_angle[idx] * RADDEG);
+        machine.tower_y[idx] = DELTA_RADIUS * sinf(tower_angle[idx] * RADDEG);
+        machine.arm_pow[idx] = DELTA_ARM_LENGTH * DELTA_ARM_LENGTH;
+        machine.carriage_offset[idx] = sqrtf(machine.arm_pow[idx] - DELTA_RADIUS * DELTA_RADIUS);
+        machine.steps_per_mm[idx] = settings->axis[idx].steps_per_mm;
+    } while(idx);
+}
+
+// Homing moves the carriages in joint space: limits_go_home() requests the axis masks before it converts the
+// current position to the start of the first approach, and the machine positions are set after the last pull-off.
+inline static bool in_joint_space (void)
+{
+    return joint_mode && sys.state == STATE_HOMING;
+}
+
+// Returns machine position in mm converted from system position steps, from the intersection of the three
+// spheres with the arm lengths as radius centered at the carriage joints, below the carriages.
+static void delta_convert_array_steps_to_mpos (float *position, int32_t *steps)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        position[idx] = steps[idx] / settings.axis[idx].steps_per_mm;
+    } while(idx);
+
+    if(in_joint_space())
+        return;
+
+    float ex[3], ey[3], ez[3], d, i, j, x, y, z;
+
+    ex[0] = machine.tower_x[B_TOWER] - machine.tower_x[A_TOWER];
+    ex[1] = machine.tower_y[B_TOWER] - machine.tower_y[A_TOWER];
+    ex[2] = position[B_TOWER] - position[A_TOWER];
+    d = sqrtf(ex[0] * ex[0] + ex[1] * ex[1] + ex[2] * ex[2]);
+    ex[0] /= d;
+    ex[1] /= d;
+    ex[2] /= d;
+
+    ey[0] = machine.tower_x[C_TOWER] - machine.tower_x[A_TOWER];
+    ey[1] = machine.tower_y[C_TOWER] - machine.tower_y[A_TOWER];
+    ey[2] = position[C_TOWER] - position[A_TOWER];
+    i = ex[0] * ey[0] + ex[1] * ey[1] + ex[2] * ey[2];
+    ey[0] -= i * ex[0];
+    ey[1] -= i * ex[1];
+    ey[2] -= i * ex[2];
+    j = sqrtf(ey[0] * ey[0] + ey[1] * ey[1] + ey[2] * ey[2]);
+    ey[0] /= j;
+    ey[1] /= j;
+    ey[2] /= j;
+
+    ez[0] = ex[1] * ey[2] - ex[2] * ey[1];
+    ez[1] = ex[2] * ey[0] - ex[0] * ey[2];
+    ez[2] = ex[0] * ey[1] - ex[1] * ey[0];
+
+    x = (machine.arm_pow[A_TOWER] - machine.arm_pow[B_TOWER] + d * d) / (2.0f * d);
+    y = (machine.arm_pow[A_TOWER] - machine.arm_pow[C_TOWER] + i * i + j * j - 2.0f * i * x) / (2.0f * j);
+    z = machine.arm_pow[A_TOWER] - x * x - y * y;
+    z = z > 0.0f ? sqrtf(z) : 0.0f;
+
+    // ez points up as the towers are ordered counterclockwise.
+    position[X_AXIS] = machine.tower_x[A_TOWER] + x * ex[0] + y * ey[0] - z * ez[0];
+    position[Y_AXIS] = machine.tower_y[A_TOWER] + x * ex[1] + y * ey[1] - z * ez[1];
+    position[Z_AXIS] = steps[A_TOWER] / settings.axis[A_TOWER].steps_per_mm + x * ex[2] + y * ey[2] - z * ez[2];
+}
+
+// Transform absolute position from cartesian coordinate system (mm) to carriage positions (step).
+// NOTE: targets out of reach are rejected by delta_segment_line(), the clamp only guards against rounding errors
+//       and the midpoints checked by the segmentation.
+static void delta_plan_target_to_steps (int32_t *target_steps, float *target)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(in_joint_space()) do {
+        idx--;
+        target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+    } while(idx);
+    else {
+
+        float dx, dy, h;
+
+        while(--idx > C_TOWER)
+            target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+
+        idx = N_TOWERS;
+        do {
+            idx--;
+            dx = target[X_AXIS] - machine.tower_x[idx];
+            dy = target[Y_AXIS] - machine.tower_y[idx];
+            h = machine.arm_pow[idx] - dx * dx - dy * dy;
+            target_steps[idx] = lroundf((target[Z_AXIS] + (h > 0.0f ? sqrtf(h) : 0.0f)) * machine.steps_per_mm[idx]);
+        } while(idx);
+    }
+}
+
+// Converts a cartesian position to carriage positions relative to the machine origin in mm,
+// returns false if out of reach of a tower.
+static bool delta_to_joints (float *joints, float *target)
+{
+    bool ok = true;
+    float dx, dy, h;
+    uint_fast8_t idx = N_AXIS;
+
+    while(--idx > C_TOWER)
+        joints[idx] = target[idx];
+
+    idx = N_TOWERS;
+    do {
+        idx--;
+        dx = target[X_AXIS] - machine.tower_x[idx];
+        dy = target[Y_AXIS] - machine.tower_y[idx];
+        h = machine.arm_pow[idx] - dx * dx - dy * dy;
+        if(h > 0.0f)
+            joints[idx] = target[Z_AXIS] + sqrtf(h) - machine.carriage_offset[idx];
+        else
+            ok = false;
+    } while(idx);
+
+    return ok;
+}
+
+static bool delta_is_reachable (float *target)
+{
+    float joints[N_AXIS];
+
+    return delta_to_joints(joints, target);
+}
+
+// Soft limits are checked in joint space, the max travel settings of the X, Y and Z axes are the carriage
+// travels of the towers. Targets out of reach always fail.
+static bool delta_check_travel_limits (float *target)
+{
+    float joints[N_AXIS];
+
+    return delta_to_joints(joints, target) && system_check_axis_limits(joints);
+}
+
+// Shortens jog motions going outside the soft limits, or out of reach if not homed, by bisection of the motion.
+static void delta_apply_jog_limits (float *target, float *position)
+{
+    bool (*check)(float *target) = (sys.homed.mask & (X_AXIS_BIT|Y_AXIS_BIT|Z_AXIS_BIT)) == (X_AXIS_BIT|Y_AXIS_BIT|Z_AXIS_BIT)
+                                    ? delta_check_travel_limits
+                                    : delta_is_reachable;
+
+    if(check(target))
+        return;
+
+    uint_fast8_t idx, iterations = 16;
+    float valid = 0.0f, invalid = 1.0f, t, start[N_AXIS], end[N_AXIS];
+
+    memcpy(start, position, sizeof(start));
+    memcpy(end, target, sizeof(end));
+
+    do {
+        t = (valid + invalid) * 0.5f;
+        for(idx = 0; idx < N_AXIS; idx++)
+            target[idx] = start[idx] + (end[idx] - start[idx]) * t;
+        if(check(target))
+            valid = t;
+        else
+            invalid = t;
+    } while(--iterations);
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        target[idx] = start[idx] + (end[idx] - start[idx]) * valid;
+}
+
+// Rapid and jog motions are segmented as well, as the carriages must not move linearly.
+// The target and the segment end points are checked as the reach is not convex in carriage travel,
+// a soft limit alarm is raised if a point is out of reach or, with soft limits enabled, outside the limits.
+static bool delta_segment_line (float *target, plan_line_data_t *pl_data, bool init)
+{
+    if(init) {
+
+        plan_line_data_t pl_segmented;
+
+        memcpy(&pl_segmented, pl_data, sizeof(plan_line_data_t));
+        pl_segmented.condition.rapid_motion = pl_segmented.condition.jog_motion = Off;
+
+        if((out_of_reach = !delta_is_reachable(target)))
+            limits_soft_check(target);
+
+        return kinematics_segment_line_adaptive(target, &pl_segmented, true);
+    }
+
+    if(out_of_reach || !kinematics_segment_line_adaptive(target, pl_data, false))
+        return out_of_reach = false;
+
+    if(!(settings.limits.flags.soft_enabled ? delta_check_travel_limits(target) : delta_is_reachable(target))) {
+        limits_soft_check(target);
+        return false;
+    }
+
+    return true;
+}
+
+static uint_fast8_t delta_limits_get_axis_mask (uint_fast8_t idx)
+{
+    joint_mode = true;
+
+    return bit(idx);
+}
+
+static void delta_limits_set_target_pos (uint_fast8_t idx)
+{
+    sys_position[idx] = 0;
+}
+
+// Set machine positions for homed limit switches. Don't update non-homed axes.
+// The homed position is with the effector centered, towers should be homed in the same cycle.
+// NOTE: settings.max_travel[] is stored as a negative value.
+static void delta_limits_set_machine_positions (axes_signals_t cycle)
+{
+    float position;
+    uint_fast8_t idx = N_AXIS;
+
+    joint_mode = false;
+
+    do {
+        if(cycle.mask & bit(--idx)) {
+            if(settings.homing.flags.force_set_origin)
+                position = 0.0f;
+            else
+                position = bit_istrue(settings.homing.dir_mask.value, bit(idx))
+                            ? settings.axis[idx].max_travel + settings.homing.pulloff
+                            : -settings.homing.pulloff;
+            if(idx < N_TOWERS)
+                position += machine.carriage_offset[idx];
+            sys_position[idx] = lroundf(position * settings.axis[idx].steps_per_mm);
+        }
+    } while(idx);
+}
+
+static void delta_settings_changed (settings_t *settings)
+{
+    delta_geometry(settings);
+
+    if(settings_changed)
+        settings_changed(settings);
+}
+
+// Initialize API pointers for linear delta kinematics
+void delta_init (void)
+{
+    delta_geometry(&settings);
+
+    // Place the effector at the origin if the position is not restored by the driver.
+    if(sys_position[A_TOWER] == 0 && sys_position[B_TOWER] == 0 && sys_position[C_TOWER] == 0) {
+        uint_fast8_t idx = N_TOWERS;
+        do {
+            idx--;
+            sys_position[idx] = lroundf(machine.carriage_offset[idx] * machine.steps_per_mm[idx]);
+        } while(idx);
+    }
+
+    if(hal.settings_changed != delta_settings_changed) {
+        settings_changed = hal.settings_changed;
+        hal.settings_changed = delta_settings_changed;
+    }
+
+    kinematics.limits_set_target_pos = delta_limits_set_target_pos;
+    kinematics.limits_get_axis_mask = delta_limits_get_axis_mask;
+    kinematics.limits_set_machine_positions = delta_limits_set_machine_positions;
+    kinematics.plan_target_to_steps = delta_plan_target_to_steps;
+    kinematics.convert_array_steps_to_mpos = delta_convert_array_steps_to_mpos;
+    kinematics.segment_line = delta_segment_line;
+    kinematics.check_travel_limits = delta_check_travel_limits;
+    kinematics.apply_jog_limits = delta_apply_jog_limits;
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+  delta.h - linear delta kinematics implementation
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#ifndef DELTA_ARM_LENGTH
+#define DELTA_ARM_LENGTH 250.0f // Length of the diagonal rods, mm
+#endif
+
+#ifndef DELTA_RADIUS
+#define DELTA_RADIUS 124.0f // Horizontal distance from the carriage joints to the effector joints with the effector centered, mm
+#endif
+
+// Initialize HAL pointers for linear delta kinematics
+void delta_init (void);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+  flightrec.c - flight recorder, RAM log of the most recent step segments
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_FLIGHT_RECORDER
+
+#include <string.h>
+
+#include "flightrec.h"
+#include "planner.h"
+
+static const char *trigger_name[] = { "NONE", "UNDERRUN", "ALARM", "USER" };
+
+// Ring buffer of records, the oldest record is overwritten when full.
+static THREAD_LOCAL struct {
+    volatile bool frozen;           // Set when no more records are to be logged
+    volatile bool dumping;          // Set while the log is output, suspends logging
+    flightrec_trigger_t trigger;
+    uint32_t trigger_us;
+    uint_fast16_t post_trigger;     // Records left to log before the log is frozen
+    uint_fast16_t head;
+    uint_fast16_t count;
+    flightrec_record_t record[FLIGHTREC_SIZE];
+} rec = {0};
+
+static THREAD_LOCAL on_state_change_ptr on_state_change;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+ISR_CODE static inline uint32_t get_us (void)
+{
+    return hal.get_micros ? hal.get_micros() : (hal.get_elapsed_ticks ? hal.get_elapsed_ticks() * 1000UL : 0);
+}
+
+// Logs a record, called from the stepper ISR.
+// NOTE: The segment preparation must not preempt the stepper ISR, it may be the other way around.
+ISR_CODE void flightrec_log_isr (flightrec_event_t event, uint32_t cycles_per_tick, uint_fast16_t n_step, uint_fast8_t amass_level, uint_fast8_t segments, int32_t line_number)
+{
+    if(rec.frozen || rec.dumping)
+        return;
+
+    uint_fast16_t blocks = plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available();
+    flightrec_record_t *record = &rec.record[rec.head];
+
+    record->us = get_us();
+    record->cycles_per_tick = cycles_per_tick;
+    record->line_number = line_number;
+    record->n_step = (uint16_t)min(n_step, UINT16_MAX);
+    record->event = (uint8_t)event;
+    record->amass_level = (uint8_t)amass_level;
+    record->segments = (uint8_t)segments;
+    record->blocks = (uint8_t)min(blocks, UINT8_MAX);
+
+    rec.head = rec.head == FLIGHTREC_SIZE - 1 ? 0 : rec.head + 1;
+    if(rec.count < FLIGHTREC_SIZE)
+        rec.count++;
+
+    if(rec.trigger != FlightRecTrigger_None && --rec.post_trigger == 0)
+        rec.frozen = true;
+}
+
+// Logs a record, called from the segment preparation.
+void flightrec_log (flightrec_event_t event, uint32_t cycles_per_tick, uint_fast16_t n_step, uint_fast8_t amass_level, uint_fast8_t segments, int32_t line_number)
+{
+    if(!rec.frozen) {
+        hal.irq_disable();
+        flightrec_log_isr(event, cycles_per_tick, n_step, amass_level, segments, line_number);
+        hal.irq_enable();
+    }
+}
+
+// Freezes the log after FLIGHTREC_POST_TRIGGER more records, ignored if already triggered.
+ISR_CODE void flightrec_trigger (flightrec_trigger_t reason)
+{
+    if(rec.trigger == FlightRecTrigger_None) {
+        rec.trigger_us = get_us();
+        rec.post_trigger = FLIGHTREC_POST_TRIGGER;
+        rec.trigger = reason;
+        if(rec.post_trigger == 0)
+            rec.frozen = true;
+    }
+}
+
+static void flightrec_clear (void)
+{
+    hal.irq_disable();
+    rec.head = rec.count = 0;
+    rec.trigger = FlightRecTrigger_None;
+    rec.frozen = false;
+    hal.irq_enable();
+}
+
+static void on_state_changed (uint_fast16_t state)
+{
+    if(state & (STATE_ALARM|STATE_ESTOP)) {
+        hal.irq_disable();
+        flightrec_trigger(FlightRecTrigger_Alarm);
+        hal.irq_enable();
+    }
+
+    if(on_state_change)
+        on_state_change(state);
+}
+
+// Outputs [FREC:<trigger>,<us>,<records>] followed by the records, oldest first, as
+// [FR:<us>,<P|X>,<line>,<cycles per tick>,<steps>,<AMASS level>,<segments queued>,<blocks queued>].
+// P is a segment prepped by st_prep_buffer(), X a segment loaded by the stepper ISR.
+// Logging is suspended while the records are output.
+static void flightrec_report (void)
+{
+    uint_fast16_t idx, count;
+    flightrec_record_t *record;
+
+    rec.dumping = true;
+
+    idx = rec.count < FLIGHTREC_SIZE ? 0 : rec.head;
+    count = rec.count;
+
+    hal.stream.write("[FREC:");
+    hal.stream.write(trigger_name[rec.trigger]);
+    hal.stream.write(",");
+    hal.stream.write(uitoa(rec.trigger == FlightRecTrigger_None ? 0 : rec.trigger_us));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(count));
+    hal.stream.write("]" ASCII_EOL);
+
+    while(count--) {
+        record = &rec.record[idx];
+        hal.stream.write("[FR:");
+        hal.stream.write(uitoa(record->us));
+        hal.stream.write(record->event == FlightRec_Prep ? ",P," : ",X,");
+        hal.stream.write(record->line_number < 0 ? "-" : "");
+        hal.stream.write(uitoa((uint32_t)(record->line_number < 0 ? -record->line_number : record->line_number)));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(record->cycles_per_tick));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(record->n_step));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(record->amass_level));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(record->segments));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(record->blocks));
+        hal.stream.write("]" ASCII_EOL);
+        idx = idx == FLIGHTREC_SIZE - 1 ? 0 : idx + 1;
+    }
+
+    rec.dumping = false;
+}
+
+static status_code_t flightrec_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "FREC", 4)) {
+        if(line[5] == '\0') {
+            flightrec_report();
+            retval = Status_OK;
+        } else if(!strcmp(&line[5], "=0")) {
+            flightrec_clear();
+            retval = Status_OK;
+        } else if(!strcmp(&line[5], "=1")) {
+            hal.irq_disable();
+            flightrec_trigger(FlightRecTrigger_User);
+            hal.irq_enable();
+            retval = Status_OK;
+        } else
+            retval = Status_InvalidStatement;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void flightrec_init (void)
+{
+    if(grbl.on_unknown_sys_command != flightrec_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = flightrec_command;
+        on_state_change = grbl.on_state_change;
+        grbl.on_state_change = on_state_changed;
+    }
+}
+
+#endif
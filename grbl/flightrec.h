@@ -0,0 +1,70 @@
+/*
+  flightrec.h - flight recorder, RAM log of the most recent step segments
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FLIGHTREC_H_
+#define _FLIGHTREC_H_
+
+#include "hal.h"
+
+#ifndef FLIGHTREC_SIZE
+#define FLIGHTREC_SIZE 256 // Number of records, two are logged per segment.
+#endif
+
+// Number of records logged after a trigger before the log is frozen.
+#ifndef FLIGHTREC_POST_TRIGGER
+#define FLIGHTREC_POST_TRIGGER 16
+#endif
+
+typedef enum {
+    FlightRec_Prep = 0, // Segment prepped by st_prep_buffer()
+    FlightRec_Exec      // Segment loaded by the stepper ISR
+} flightrec_event_t;
+
+typedef enum {
+    FlightRecTrigger_None = 0,
+    FlightRecTrigger_Underrun,
+    FlightRecTrigger_Alarm,
+    FlightRecTrigger_User
+} flightrec_trigger_t;
+
+typedef struct {
+    uint32_t us;              // Timestamp, from hal.get_micros() or hal.get_elapsed_ticks() * 1000
+    uint32_t cycles_per_tick;
+    int32_t line_number;
+    uint16_t n_step;
+    uint8_t event;            // flightrec_event_t
+    uint8_t amass_level;
+    uint8_t segments;         // Segments queued, including the segment being executed
+    uint8_t blocks;           // Planner blocks queued, capped at 255
+} flightrec_record_t;
+
+// Logs a record, called from the stepper ISR.
+void flightrec_log_isr (flightrec_event_t event, uint32_t cycles_per_tick, uint_fast16_t n_step, uint_fast8_t amass_level, uint_fast8_t segments, int32_t line_number);
+
+// Logs a record, called from the segment preparation.
+void flightrec_log (flightrec_event_t event, uint32_t cycles_per_tick, uint_fast16_t n_step, uint_fast8_t amass_level, uint_fast8_t segments, int32_t line_number);
+
+// Freezes the log after FLIGHTREC_POST_TRIGGER more records, ignored if already triggered.
+// Called from the stepper ISR or with interrupts disabled.
+void flightrec_trigger (flightrec_trigger_t reason);
+
+// Adds the $FREC system command.
+void flightrec_init (void);
+
+#endif
@@ -28,6 +28,9 @@
 #include "hal.h"
 #include "motion_control.h"
 #include "protocol.h"
+#ifdef ENABLE_NVS_CHECKPOINT
+#include "checkpoint.h"
+#endif
 
 // NOTE: Max line number is defined by the g-code standard to be 99999. It seems to be an
 // arbitrary value, and some GUIs may require more. So we increased it based on a max safe
@@ -55,18 +58,95 @@ typedef enum {
 } axis_command_t;
 
 // Declare gc extern struct
-parser_state_t gc_state, *saved_state = NULL;
+THREAD_LOCAL parser_state_t gc_state, *saved_state = NULL;
 #ifdef N_TOOLS
-tool_data_t tool_table[N_TOOLS + 1];
+#ifdef TOOL_TABLE_CACHE
+#if TOOL_TABLE_CACHE < 3 || TOOL_TABLE_CACHE > 254 || N_TOOLS > 254
+#error "TOOL_TABLE_CACHE must be 3 - 254 and N_TOOLS max 254!"
+#endif
+static THREAD_LOCAL tool_data_t tool_cache[TOOL_TABLE_CACHE + 1];    // Entry 0 is for tools not in tool table.
+static THREAD_LOCAL uint32_t tool_used[TOOL_TABLE_CACHE + 1];        // Access count at last access, 0 if entry is free.
+static THREAD_LOCAL uint32_t tool_access = 0;
+static THREAD_LOCAL uint8_t tool_entry[N_TOOLS + 1];                 // Cache entry holding the tool, 0 if not cached.
+#else
+THREAD_LOCAL tool_data_t tool_table[N_TOOLS + 1];
+#endif
 #else
-tool_data_t tool_table;
+THREAD_LOCAL tool_data_t tool_table;
 #endif
 
 #define FAIL(status) return(status);
 
-static gc_thread_data thread;
-static output_command_t *output_commands = NULL; // Linked list
-static scale_factor_t scale_factor = {
+// Non-command word lookup table, indexed by letter - 'A'.
+typedef enum {
+    ValueWord_Unsupported = 0,
+    ValueWord_Float,    // Value is stored at offset in gc_values_t, axis and arc offset words set their tracking bit.
+    ValueWord_Integer,  // Value must be an integer.
+    ValueWord_LineNumber
+} value_word_type_t;
+
+typedef struct {
+    uint8_t type;       // value_word_type_t
+    uint8_t word;       // parameter_word_t
+    uint8_t offset;     // Offset of float value in gc_values_t.
+    uint8_t axis_bit;   // Bit to set in axis_words.
+    uint8_t ijk_bit;    // Bit to set in ijk_words.
+} value_word_t;
+
+#define FLOAT_WORD(w, value) { .type = ValueWord_Float, .word = w, .offset = offsetof(gc_values_t, value) }
+#define AXIS_WORD(w, axis) { .type = ValueWord_Float, .word = w, .offset = offsetof(gc_values_t, xyz) + axis * sizeof(float), .axis_bit = bit(axis) }
+#define IJK_WORD(w, idx) { .type = ValueWord_Float, .word = w, .offset = offsetof(gc_values_t, ijk) + idx * sizeof(float), .ijk_bit = bit(idx) }
+
+static const value_word_t value_word_table[26] = {
+#ifdef A_AXIS
+    ['A' - 'A'] = AXIS_WORD(Word_A, A_AXIS),
+#endif
+#ifdef B_AXIS
+    ['B' - 'A'] = AXIS_WORD(Word_B, B_AXIS),
+#endif
+#ifdef C_AXIS
+    ['C' - 'A'] = AXIS_WORD(Word_C, C_AXIS),
+#endif
+    ['D' - 'A'] = FLOAT_WORD(Word_D, d),
+    ['E' - 'A'] = FLOAT_WORD(Word_E, e),
+    ['F' - 'A'] = FLOAT_WORD(Word_F, f),
+    ['H' - 'A'] = { .type = ValueWord_Integer, .word = Word_H },
+    ['I' - 'A'] = IJK_WORD(Word_I, I_VALUE),
+    ['J' - 'A'] = IJK_WORD(Word_J, J_VALUE),
+    ['K' - 'A'] = IJK_WORD(Word_K, K_VALUE),
+    ['L' - 'A'] = { .type = ValueWord_Integer, .word = Word_L },
+    ['N' - 'A'] = { .type = ValueWord_LineNumber, .word = Word_N },
+    ['P' - 'A'] = FLOAT_WORD(Word_P, p), // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
+    ['Q' - 'A'] = FLOAT_WORD(Word_Q, q), // may be used for user defined mcodes or G61,G76
+    ['R' - 'A'] = FLOAT_WORD(Word_R, r),
+    ['S' - 'A'] = FLOAT_WORD(Word_S, s),
+    ['T' - 'A'] = { .type = ValueWord_Integer, .word = Word_T },
+    ['X' - 'A'] = AXIS_WORD(Word_X, X_AXIS),
+    ['Y' - 'A'] = AXIS_WORD(Word_Y, Y_AXIS),
+    ['Z' - 'A'] = AXIS_WORD(Word_Z, Z_AXIS)
+};
+
+static THREAD_LOCAL gc_thread_data thread;
+static THREAD_LOCAL output_command_t *output_commands = NULL; // Linked list
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+static THREAD_LOCAL struct {
+    bool coolant;
+    bool spindle_rpm;
+} queued_state = {0}; // State changes waiting to be queued with the next motion, see gc_flush_queued_state().
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+// Work coordinate offsets reported for the motions executing before each queued change. Head is
+// advanced by the parser when a change is queued, tail by the stepper driver when the motion queued
+// with it is started.
+static THREAD_LOCAL struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    bool changed; // Offsets changed by the block executing.
+    bool pending; // Change waiting to be queued with the next motion.
+    float offset[WCO_QUEUE_SIZE][N_AXIS];
+} wco_queue = {0};
+#endif
+static THREAD_LOCAL scale_factor_t scale_factor = {
     .ijk[X_AXIS] = 1.0f,
     .ijk[Y_AXIS] = 1.0f,
     .ijk[Z_AXIS] = 1.0f
@@ -81,6 +161,14 @@ static scale_factor_t scale_factor = {
 #endif
 };
 
+// Combined scaling and work coordinate offsets applied to absolute axis words of motion blocks,
+// recomputed by update_transform() before the next motion block when any of them has changed.
+static THREAD_LOCAL struct {
+    bool valid;
+    float scale[N_AXIS];
+    float offset[N_AXIS];
+} transform = {0};
+
 // Simple hypotenuse computation function.
 inline static float hypot_f (float x, float y)
 {
@@ -100,6 +188,7 @@ static void set_scaling (float factor)
     } while(idx);
 
     gc_state.modal.scaling_active = factor != 1.0f;
+    transform.valid = false;
 
     if(state.value != gc_get_g51_state().value)
         sys.report.scaling = On;
@@ -130,11 +219,85 @@ float gc_get_offset (uint_fast8_t idx)
     return gc_state.modal.coord_system.xyz[idx] + gc_state.g92_coord_offset[idx] + gc_state.tool_length_offset[idx];
 }
 
+#ifdef TOOL_TABLE_CACHE
+
+// Returns the cached tool table entry for the tool, if not cached it is read from storage to the least
+// recently used entry. Entries for the current and the pending tool are not replaced since they may be
+// referenced by pointers held elsewhere.
+tool_data_t *gc_get_tool (uint32_t tool)
+{
+    uint_fast8_t idx, entry;
+
+    if(tool == 0)
+        return &tool_cache[0];
+
+    if((entry = tool_entry[tool]) == 0) {
+
+        for(idx = 1; idx <= TOOL_TABLE_CACHE; idx++) {
+            if(&tool_cache[idx] == gc_state.tool || (tool_used[idx] && tool_cache[idx].tool == gc_state.tool_pending))
+                continue;
+            if(entry == 0 || tool_used[idx] < tool_used[entry])
+                entry = idx;
+            if(tool_used[idx] == 0)
+                break;
+        }
+
+        if(tool_used[entry])
+            tool_entry[tool_cache[entry].tool] = 0;
+
+        settings_read_tool_data(tool, &tool_cache[entry]);
+        tool_entry[tool] = entry;
+    }
+
+    tool_used[entry] = ++tool_access;
+
+    return &tool_cache[entry];
+}
+
+#endif
+
 inline static float gc_get_block_offset (parser_block_t *gc_block, uint_fast8_t idx)
 {
     return gc_block->modal.coord_system.xyz[idx] + gc_state.g92_coord_offset[idx] + gc_state.tool_length_offset[idx];
 }
 
+// Flags a change of the work coordinate offsets, for reporting and for recomputing the transform.
+static inline void wco_changed (void)
+{
+    transform.valid = false;
+    system_flag_wco_change();
+}
+
+// Flags a change of the work coordinate offsets by the block executing, see wco_change_queue().
+static inline void block_wco_changed (void)
+{
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    transform.valid = false;
+    wco_queue.changed = true;
+#else
+    wco_changed();
+#endif
+}
+
+// Fuses scaling around the scaling center with the work coordinate offsets to a single scale and offset per axis.
+static void update_transform (void)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        if(gc_state.modal.scaling_active) {
+            transform.scale[idx] = scale_factor.ijk[idx];
+            transform.offset[idx] = scale_factor.xyz[idx] - scale_factor.xyz[idx] * scale_factor.ijk[idx] + gc_get_offset(idx);
+        } else {
+            transform.scale[idx] = 1.0f;
+            transform.offset[idx] = gc_get_offset(idx);
+        }
+    } while(idx);
+
+    transform.valid = true;
+}
+
 void gc_set_tool_offset (tool_offset_mode_t mode, uint_fast8_t idx, int32_t offset)
 {
     bool tlo_changed = false;
@@ -164,105 +327,1097 @@ void gc_set_tool_offset (tool_offset_mode_t mode, uint_fast8_t idx, int32_t offs
             break;
     }
 
-    gc_state.modal.tool_offset_mode = mode;
+    gc_state.modal.tool_offset_mode = mode;
+
+    if(tlo_changed) {
+        sys.report.tool_offset = true;
+        wco_changed();
+    }
+}
+
+plane_t *gc_get_plane_data (plane_t *plane, plane_select_t select)
+{
+    switch (select) {
+
+        case PlaneSelect_XY:
+            plane->axis_0 = X_AXIS;
+            plane->axis_1 = Y_AXIS;
+            plane->axis_linear = Z_AXIS;
+            break;
+
+        case PlaneSelect_ZX:
+            plane->axis_0 = Z_AXIS;
+            plane->axis_1 = X_AXIS;
+            plane->axis_linear = Y_AXIS;
+            break;
+
+        default: // case PlaneSelect_YZ:
+            plane->axis_0 = Y_AXIS;
+            plane->axis_1 = Z_AXIS;
+            plane->axis_linear = X_AXIS;
+    }
+
+    return plane;
+}
+
+#ifdef ENABLE_OWORDS
+
+#ifndef OWORD_BUFFER_SIZE
+#define OWORD_BUFFER_SIZE 2048
+#endif
+#ifndef OWORD_MAX_SUBROUTINES
+#define OWORD_MAX_SUBROUTINES 8
+#endif
+#ifndef OWORD_MAX_NESTING
+#define OWORD_MAX_NESTING 4
+#endif
+
+typedef enum {
+    OWord_None = 0,
+    OWord_Sub,
+    OWord_Repeat
+} oword_body_type_t;
+
+typedef struct {
+    uint32_t o_number;
+    uint16_t start; // Buffer offset of first block.
+    uint16_t end;   // Buffer offset following last block.
+} oword_body_t;
+
+/* Bodies are stored as 0-terminated blocks. Subroutines are kept at the start of the buffer, up to used.
+   Loop bodies are recorded after them and discarded when the loop has been executed, loops started from
+   an executing body are recorded after the executing bodies. */
+static THREAD_LOCAL struct {
+    oword_body_type_t recording;    // Type of body being recorded.
+    bool overflow;                  // Body being recorded did not fit.
+    uint_fast8_t depth;             // Number of bodies executing.
+    uint_fast8_t n_subs;
+    uint16_t used;                  // End of subroutines.
+    uint16_t top;                   // End of buffer in use.
+    uint32_t count;                 // Repeat count for loop being recorded.
+    oword_body_t body;              // Body being recorded.
+    oword_body_t sub[OWORD_MAX_SUBROUTINES];
+    char buffer[OWORD_BUFFER_SIZE];
+} oword = {0};
+
+#if defined(ENABLE_NGC_PARAMETERS) && !defined(NGC_EXPRESSION_CACHE_SIZE)
+#define NGC_EXPRESSION_CACHE_SIZE 4
+#endif
+
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+static void ngc_expression_cache_clear (void);
+#endif
+
+#ifdef ENABLE_PACKED_BLOCKS
+static THREAD_LOCAL char oword_packed_block[LINE_BUFFER_SIZE]; // Packed blocks are terminated at the checksum by the parser, execute a copy.
+#endif
+
+static void oword_clear (void)
+{
+    oword.recording = OWord_None;
+    oword.overflow = false;
+    oword.depth = oword.n_subs = 0;
+    oword.used = oword.top = 0;
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+    ngc_expression_cache_clear();
+#endif
+}
+
+// Parses the O number of an O-word block, returns a pointer to the statement following it or NULL on error.
+static char *oword_parse (char *block, uint32_t *o_number)
+{
+    uint_fast8_t char_counter = 1;
+    uint_fast16_t mantissa;
+
+    return block[0] == 'O' && read_uint(block, &char_counter, o_number, &mantissa) && mantissa == 0 ? &block[char_counter] : NULL;
+}
+
+static oword_body_t *oword_find_sub (uint32_t o_number)
+{
+    uint_fast8_t idx = oword.n_subs;
+
+    while(idx) {
+        if(oword.sub[--idx].o_number == o_number)
+            return &oword.sub[idx];
+    }
+
+    return NULL;
+}
+
+// Executes the blocks of a body, stops on the first error or abort.
+static status_code_t oword_run (uint16_t start, uint16_t end)
+{
+    char *block;
+    status_code_t status = Status_OK;
+
+    if(oword.depth == OWORD_MAX_NESTING)
+        FAIL(Status_FlowControlOutOfMemory); // [Nesting too deep]
+
+    oword.depth++;
+
+    while(start < end && status == Status_OK && protocol_execute_realtime()) {
+        block = &oword.buffer[start];
+        start += strlen(block) + 1;
+#ifdef ENABLE_PACKED_BLOCKS
+        if(block[0] == ASCII_STX)
+            block = strcpy(oword_packed_block, block);
+#endif
+        status = gc_execute_block(block, NULL);
+    }
+
+    oword.depth--;
+
+    return status;
+}
+
+// Records a block of the body being recorded, executes the body if the block ends a loop.
+static status_code_t oword_record (char *block)
+{
+    char *statement;
+    uint32_t o_number;
+
+    if((statement = oword_parse(block, &o_number)) && o_number == oword.body.o_number &&
+        !strcmp(statement, oword.recording == OWord_Sub ? "ENDSUB" : "ENDREPEAT")) {
+
+        oword_body_t body = oword.body;
+        oword_body_type_t recording = oword.recording;
+        status_code_t status = Status_OK;
+
+        oword.recording = OWord_None;
+        body.end = oword.top;
+
+        if(oword.overflow) {
+            oword.overflow = false;
+            oword.top = body.start;
+            FAIL(Status_FlowControlOutOfMemory); // [Body does not fit in buffer]
+        }
+
+        if(recording == OWord_Sub) {
+            memcpy(&oword.sub[oword.n_subs++], &body, sizeof(oword_body_t));
+            oword.used = oword.top;
+        } else {
+            uint32_t count = oword.count;
+            while(count-- && status == Status_OK)
+                status = oword_run(body.start, body.end);
+            oword.top = body.start;
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+            ngc_expression_cache_clear(); // Body is discarded, the cached expressions are no longer valid.
+#endif
+        }
+
+        return status;
+    }
+
+    if(!oword.overflow) {
+
+        size_t length = strlen(block) + 1;
+
+        if((oword.overflow = oword.top + length > OWORD_BUFFER_SIZE))
+            FAIL(Status_FlowControlOutOfMemory); // [Body does not fit in buffer]
+
+        memcpy(&oword.buffer[oword.top], block, length);
+        oword.top += length;
+    }
+
+    return Status_OK;
+}
+
+// Executes an O-word block: starts recording a subroutine or loop body or calls a subroutine.
+static status_code_t oword_execute (char *block)
+{
+    char *statement;
+    uint32_t o_number;
+    oword_body_t *sub;
+
+    if(!(statement = oword_parse(block, &o_number)))
+        FAIL(Status_BadNumberFormat); // [Expected O number]
+
+    if(!strcmp(statement, "CALL")) {
+
+        if(!(sub = oword_find_sub(o_number)))
+            FAIL(Status_FlowControlSyntaxError); // [Undefined subroutine]
+
+        return oword_run(sub->start, sub->end);
+    }
+
+    if(!strcmp(statement, "SUB")) {
+
+        if(oword.depth || oword_find_sub(o_number))
+            FAIL(Status_FlowControlSyntaxError); // [Subroutine defined in body or redefined]
+
+        if(oword.n_subs == OWORD_MAX_SUBROUTINES)
+            FAIL(Status_FlowControlOutOfMemory); // [Too many subroutines]
+
+        oword.recording = OWord_Sub;
+
+    } else if(!strncmp(statement, "REPEAT", 6)) {
+
+        uint_fast8_t char_counter = 6;
+        uint_fast16_t mantissa;
+        bool bracket = statement[char_counter] == '[';
+
+        if(bracket)
+            char_counter++;
+
+        if(!read_uint(statement, &char_counter, &oword.count, &mantissa) || mantissa ||
+            (bracket ? strcmp(&statement[char_counter], "]") : statement[char_counter] != '\0'))
+            FAIL(Status_BadNumberFormat); // [Invalid repeat count]
+
+        oword.recording = OWord_Repeat;
+
+    } else if(!strcmp(statement, "ENDSUB") || !strcmp(statement, "ENDREPEAT")) {
+        FAIL(Status_FlowControlSyntaxError); // [Unmatched end statement]
+    } else
+        FAIL(Status_GcodeUnsupportedCommand); // [WHILE, DO, IF etc. are not supported]
+
+    oword.body.o_number = o_number;
+    oword.body.start = oword.top;
+
+    return Status_OK;
+}
+
+#endif
+
+#ifdef ENABLE_NGC_PARAMETERS
+
+#ifndef NGC_N_PARAMETERS
+#define NGC_N_PARAMETERS 100
+#endif
+#ifndef NGC_MAX_ASSIGNMENTS
+#define NGC_MAX_ASSIGNMENTS 8
+#endif
+#ifndef NGC_RPN_MAX
+#define NGC_RPN_MAX 24
+#endif
+#ifndef NGC_MAX_NESTING
+#define NGC_MAX_NESTING 8
+#endif
+#ifndef ENABLE_OWORDS
+#undef NGC_EXPRESSION_CACHE_SIZE
+#endif
+
+#define NGC_RAD_PER_DEG 0.0174532925f
+#define NGC_DEG_PER_RAD 57.2957795f
+
+typedef enum {
+    NGCOp_Number = 0,
+    NGCOp_Parameter,
+    NGCOp_Negate,
+    // Binary operators
+    NGCOp_Power,
+    NGCOp_Multiply,
+    NGCOp_Divide,
+    NGCOp_Modulo,
+    NGCOp_Add,
+    NGCOp_Subtract,
+    NGCOp_EQ,
+    NGCOp_NE,
+    NGCOp_GT,
+    NGCOp_GE,
+    NGCOp_LT,
+    NGCOp_LE,
+    NGCOp_And,
+    NGCOp_Or,
+    NGCOp_Xor,
+    // Functions
+    NGCOp_Abs,
+    NGCOp_Acos,
+    NGCOp_Asin,
+    NGCOp_Atan,
+    NGCOp_Cos,
+    NGCOp_Exp,
+    NGCOp_Fix,
+    NGCOp_Fup,
+    NGCOp_Ln,
+    NGCOp_Round,
+    NGCOp_Sin,
+    NGCOp_Sqrt,
+    NGCOp_Tan
+} ngc_op_t;
+
+typedef struct {
+    const char name[6];
+    ngc_op_t op;
+    uint8_t precedence;
+} ngc_operator_t;
+
+// NOTE: Operators starting with the same characters must be listed longest first.
+static const ngc_operator_t ngc_binary_ops[] = {
+    { "**",  NGCOp_Power,    4 },
+    { "*",   NGCOp_Multiply, 3 },
+    { "/",   NGCOp_Divide,   3 },
+    { "MOD", NGCOp_Modulo,   3 },
+    { "+",   NGCOp_Add,      2 },
+    { "-",   NGCOp_Subtract, 2 },
+    { "EQ",  NGCOp_EQ,       1 },
+    { "NE",  NGCOp_NE,       1 },
+    { "GT",  NGCOp_GT,       1 },
+    { "GE",  NGCOp_GE,       1 },
+    { "LT",  NGCOp_LT,       1 },
+    { "LE",  NGCOp_LE,       1 },
+    { "AND", NGCOp_And,      0 },
+    { "OR",  NGCOp_Or,       0 },
+    { "XOR", NGCOp_Xor,      0 }
+};
+
+static const ngc_operator_t ngc_functions[] = {
+    { "ABS",   NGCOp_Abs },
+    { "ACOS",  NGCOp_Acos },
+    { "ASIN",  NGCOp_Asin },
+    { "ATAN",  NGCOp_Atan },
+    { "COS",   NGCOp_Cos },
+    { "EXP",   NGCOp_Exp },
+    { "FIX",   NGCOp_Fix },
+    { "FUP",   NGCOp_Fup },
+    { "LN",    NGCOp_Ln },
+    { "ROUND", NGCOp_Round },
+    { "SIN",   NGCOp_Sin },
+    { "SQRT",  NGCOp_Sqrt },
+    { "TAN",   NGCOp_Tan }
+};
+
+typedef struct {
+    float value;
+    uint8_t op;
+} ngc_token_t;
+
+// Expression compiled to reverse polish notation.
+typedef struct {
+    uint_fast8_t length;
+    uint_fast8_t nesting;
+    ngc_token_t token[NGC_RPN_MAX];
+} ngc_rpn_t;
+
+static THREAD_LOCAL float ngc_params[NGC_N_PARAMETERS];
+
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+
+// Expressions in O-word bodies are compiled once and looked up by their address in the body buffer.
+typedef struct {
+    const char *source;
+    uint_fast8_t length;    // Number of characters compiled.
+    ngc_rpn_t rpn;
+} ngc_cached_expression_t;
+
+static THREAD_LOCAL uint_fast8_t ngc_cache_next = 0;
+static THREAD_LOCAL ngc_cached_expression_t ngc_cache[NGC_EXPRESSION_CACHE_SIZE];
+
+static void ngc_expression_cache_clear (void)
+{
+    uint_fast8_t idx = NGC_EXPRESSION_CACHE_SIZE;
+
+    do {
+        ngc_cache[--idx].source = NULL;
+    } while(idx);
+}
+
+#endif
+
+static inline float ngc_to_program_units (float value)
+{
+    return gc_state.modal.units_imperial ? value * INCH_PER_MM : value;
+}
+
+// Converts a parameter number to an axis index, returns N_AXIS if the number is not for an axis in range.
+static inline uint_fast8_t ngc_param_axis (uint32_t id, uint32_t first)
+{
+    return id >= first && id < first + 9 && id - first < N_AXIS ? (uint_fast8_t)(id - first) : N_AXIS;
+}
+
+/* Gets a parameter value, supported parameters are:
+     #1-#NGC_N_PARAMETERS  user parameters, cleared on cold start.
+     #5061-#5069           last probe position in work coordinates, #5070 1 if last probe was successful.
+     #5161-#5169           G28 position, #5181-#5189 G30 position.
+     #5211-#5219           G92 offsets.
+     #5220                 active coordinate system, 1-9 for G54-G59.3.
+     #5221-#5400           G54-G59.3 offsets, 20 numbers per coordinate system.
+     #5400                 current tool number.
+     #5420-#5428           current position in work coordinates.
+   Values are in program units, axis numbers for axes not available read as 0. */
+static status_code_t ngc_param_get (float number, float *value)
+{
+    uint32_t id, base;
+    uint_fast8_t idx;
+    float data[N_AXIS];
+
+    if(number < 0.0f || !isintf(number))
+        FAIL(Status_ExpressionInvalidParameter);
+
+    *value = 0.0f;
+    id = (uint32_t)lroundf(number);
+
+    if(id >= 1 && id <= NGC_N_PARAMETERS)
+        *value = ngc_params[id - 1];
+
+    else if(id >= 5061 && id <= 5069) {
+        if((idx = ngc_param_axis(id, 5061)) < N_AXIS) {
+            float probe_position[N_AXIS];
+            system_convert_array_steps_to_mpos(probe_position, sys_probe_position);
+            *value = ngc_to_program_units(probe_position[idx] - gc_get_offset(idx));
+        }
+    } else if(id == 5070)
+        *value = sys.flags.probe_succeeded ? 1.0f : 0.0f;
+
+    else if(id == 5220)
+        *value = (float)(gc_state.modal.coord_system.id + 1);
+
+    else if(id == 5400)
+        *value = (float)gc_state.tool->tool;
+
+    else if(id >= 5420 && id <= 5428) {
+        if((idx = ngc_param_axis(id, 5420)) < N_AXIS)
+            *value = ngc_to_program_units(gc_state.position[idx] - gc_get_offset(idx));
+
+    } else if(id >= 5211 && id <= 5219) {
+        if((idx = ngc_param_axis(id, 5211)) < N_AXIS)
+            *value = ngc_to_program_units(gc_state.g92_coord_offset[idx]);
+
+    } else if((id >= 5161 && id <= 5169) || (id >= 5181 && id <= 5189) || (id >= 5221 && id < 5221 + N_WorkCoordinateSystems * 20)) {
+
+        coord_system_id_t cs;
+
+        if(id < 5181) {
+            cs = CoordinateSystem_G28;
+            base = 5161;
+        } else if(id < 5221) {
+            cs = CoordinateSystem_G30;
+            base = 5181;
+        } else {
+            cs = (coord_system_id_t)((id - 5221) / 20);
+            base = 5221 + cs * 20;
+        }
+
+        if((idx = ngc_param_axis(id, base)) < N_AXIS) {
+            if(!settings_read_coord_data(cs, &data))
+                FAIL(Status_SettingReadFail);
+            *value = ngc_to_program_units(data[idx]);
+        } else if(id - base >= 9)
+            FAIL(Status_ExpressionInvalidParameter);
+
+    } else
+        FAIL(Status_ExpressionInvalidParameter);
+
+    return Status_OK;
+}
+
+// Sets a parameter value, only user parameters may be set.
+static status_code_t ngc_param_set (float number, float value)
+{
+    if(number < 1.0f || number > (float)NGC_N_PARAMETERS || !isintf(number))
+        FAIL(Status_ExpressionInvalidParameter);
+
+    ngc_params[lroundf(number) - 1] = value;
+
+    return Status_OK;
+}
+
+static status_code_t ngc_emit (ngc_rpn_t *rpn, ngc_op_t op, float value)
+{
+    if(rpn->length == NGC_RPN_MAX)
+        FAIL(Status_ExpressionSyntaxError); // [Expression too complex]
+
+    rpn->token[rpn->length].op = (uint8_t)op;
+    rpn->token[rpn->length++].value = value;
+
+    return Status_OK;
+}
+
+static status_code_t ngc_compile_expression (char *block, uint_fast8_t *char_counter, ngc_rpn_t *rpn, uint_fast8_t min_precedence);
+
+// Compiles a bracketed expression, the opening bracket has already been consumed.
+static status_code_t ngc_compile_bracket (char *block, uint_fast8_t *char_counter, ngc_rpn_t *rpn)
+{
+    status_code_t status;
+
+    if(++rpn->nesting > NGC_MAX_NESTING)
+        FAIL(Status_ExpressionSyntaxError); // [Too deeply nested]
+
+    if((status = ngc_compile_expression(block, char_counter, rpn, 0)) == Status_OK && block[(*char_counter)++] != ']')
+        status = Status_ExpressionSyntaxError; // [Missing closing bracket]
+
+    rpn->nesting--;
+
+    return status;
+}
+
+// Compiles an operand: a number, a parameter reference, a bracketed expression, a function call
+// or a unary minus or plus followed by an operand.
+static status_code_t ngc_compile_operand (char *block, uint_fast8_t *char_counter, ngc_rpn_t *rpn)
+{
+    float value;
+    status_code_t status;
+    char c = block[*char_counter];
+
+    if(c == '-' || c == '+' || c == '#') {
+        (*char_counter)++;
+        if((status = ngc_compile_operand(block, char_counter, rpn)) == Status_OK && c != '+')
+            status = ngc_emit(rpn, c == '#' ? NGCOp_Parameter : NGCOp_Negate, 0.0f);
+        return status;
+    }
+
+    if(c == '[') {
+        (*char_counter)++;
+        return ngc_compile_bracket(block, char_counter, rpn);
+    }
+
+    if((c >= '0' && c <= '9') || c == '.')
+        return read_float(block, char_counter, &value) ? ngc_emit(rpn, NGCOp_Number, value) : Status_BadNumberFormat;
+
+    uint_fast8_t idx = sizeof(ngc_functions) / sizeof(ngc_operator_t);
+
+    while(idx--) {
+        size_t length = strlen(ngc_functions[idx].name);
+        if(!strncmp(&block[*char_counter], ngc_functions[idx].name, length) && block[*char_counter + length] == '[') {
+            *char_counter += length + 1;
+            if((status = ngc_compile_bracket(block, char_counter, rpn)) != Status_OK)
+                return status;
+            // ATAN takes two arguments: ATAN[y]/[x]
+            if(ngc_functions[idx].op == NGCOp_Atan) {
+                if(block[*char_counter] != '/' || block[*char_counter + 1] != '[')
+                    FAIL(Status_ExpressionSyntaxError);
+                *char_counter += 2;
+                if((status = ngc_compile_bracket(block, char_counter, rpn)) != Status_OK)
+                    return status;
+            }
+            return ngc_emit(rpn, ngc_functions[idx].op, 0.0f);
+        }
+    }
+
+    FAIL(Status_ExpressionSyntaxError); // [Unknown function or missing operand]
+}
+
+// Compiles a binary expression by precedence climbing, operators of equal precedence are evaluated left to right.
+static status_code_t ngc_compile_expression (char *block, uint_fast8_t *char_counter, ngc_rpn_t *rpn, uint_fast8_t min_precedence)
+{
+    status_code_t status;
+    const ngc_operator_t *op;
+
+    if((status = ngc_compile_operand(block, char_counter, rpn)) != Status_OK)
+        return status;
+
+    while(true) {
+
+        uint_fast8_t idx = 0;
+
+        op = NULL;
+        do {
+            if(!strncmp(&block[*char_counter], ngc_binary_ops[idx].name, strlen(ngc_binary_ops[idx].name)))
+                op = &ngc_binary_ops[idx];
+        } while(op == NULL && ++idx < sizeof(ngc_binary_ops) / sizeof(ngc_operator_t));
+
+        if(op == NULL || op->precedence < min_precedence)
+            break;
+
+        *char_counter += strlen(op->name);
+
+        if((status = ngc_compile_expression(block, char_counter, rpn, op->precedence + 1)) != Status_OK ||
+            (status = ngc_emit(rpn, op->op, 0.0f)) != Status_OK)
+            break;
+    }
+
+    return status;
+}
+
+static status_code_t ngc_evaluate (ngc_rpn_t *rpn, float *result)
+{
+    status_code_t status;
+    uint_fast8_t idx, sp = 0;
+    float stack[NGC_RPN_MAX / 2 + 1], a, b = 0.0f;
+
+    for(idx = 0; idx < rpn->length; idx++) {
+
+        ngc_token_t *token = &rpn->token[idx];
+
+        if(token->op == NGCOp_Number) {
+            stack[sp++] = token->value;
+            continue;
+        }
+
+        a = stack[sp - 1];
+
+        // Binary operators and ATAN pop the right operand.
+        if((token->op >= NGCOp_Power && token->op <= NGCOp_Xor) || token->op == NGCOp_Atan) {
+            b = a;
+            a = stack[--sp - 1];
+        }
+
+        switch((ngc_op_t)token->op) {
+
+            case NGCOp_Parameter:
+                if((status = ngc_param_get(a, &a)) != Status_OK)
+                    return status;
+                break;
+
+            case NGCOp_Negate:   a = -a; break;
+            case NGCOp_Power:    a = powf(a, b); break;
+            case NGCOp_Multiply: a *= b; break;
+
+            case NGCOp_Divide:
+            case NGCOp_Modulo:
+                if(b == 0.0f)
+                    FAIL(Status_ExpressionDivisionByZero);
+                if(token->op == NGCOp_Divide)
+                    a /= b;
+                else if((a = fmodf(a, b)) < 0.0f)
+                    a += fabsf(b);
+                break;
+
+            case NGCOp_Add:      a += b; break;
+            case NGCOp_Subtract: a -= b; break;
+            case NGCOp_EQ:       a = a == b ? 1.0f : 0.0f; break;
+            case NGCOp_NE:       a = a != b ? 1.0f : 0.0f; break;
+            case NGCOp_GT:       a = a > b ? 1.0f : 0.0f; break;
+            case NGCOp_GE:       a = a >= b ? 1.0f : 0.0f; break;
+            case NGCOp_LT:       a = a < b ? 1.0f : 0.0f; break;
+            case NGCOp_LE:       a = a <= b ? 1.0f : 0.0f; break;
+            case NGCOp_And:      a = a != 0.0f && b != 0.0f ? 1.0f : 0.0f; break;
+            case NGCOp_Or:       a = a != 0.0f || b != 0.0f ? 1.0f : 0.0f; break;
+            case NGCOp_Xor:      a = (a != 0.0f) != (b != 0.0f) ? 1.0f : 0.0f; break;
+            case NGCOp_Abs:      a = fabsf(a); break;
+
+            case NGCOp_Acos:
+            case NGCOp_Asin:
+                if(a < -1.0f || a > 1.0f)
+                    FAIL(Status_ExpressionArgumentOutOfRange);
+                a = (token->op == NGCOp_Acos ? acosf(a) : asinf(a)) * NGC_DEG_PER_RAD;
+                break;
+
+            case NGCOp_Atan:     a = atan2f(a, b) * NGC_DEG_PER_RAD; break;
+            case NGCOp_Cos:      a = cosf(a * NGC_RAD_PER_DEG); break;
+            case NGCOp_Exp:      a = expf(a); break;
+            case NGCOp_Fix:      a = floorf(a); break;
+            case NGCOp_Fup:      a = ceilf(a); break;
+
+            case NGCOp_Ln:
+                if(a <= 0.0f)
+                    FAIL(Status_ExpressionArgumentOutOfRange);
+                a = logf(a);
+                break;
+
+            case NGCOp_Round:    a = roundf(a); break;
+            case NGCOp_Sin:      a = sinf(a * NGC_RAD_PER_DEG); break;
+
+            case NGCOp_Sqrt:
+                if(a < 0.0f)
+                    FAIL(Status_ExpressionArgumentOutOfRange);
+                a = sqrtf(a);
+                break;
+
+            case NGCOp_Tan:      a = tanf(a * NGC_RAD_PER_DEG); break;
+
+            default:
+                break;
+        }
+
+        stack[sp - 1] = a;
+    }
+
+    *result = stack[0];
+
+    return Status_OK;
+}
+
+// Reads a parameter reference or a bracketed expression and returns its value.
+static status_code_t ngc_eval (char *block, uint_fast8_t *char_counter, float *value)
+{
+    status_code_t status;
+    ngc_rpn_t rpn, *compiled = &rpn;
+    uint_fast8_t start = *char_counter;
+
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+    char *source = &block[start];
+    bool cacheable = source >= oword.buffer && source < oword.buffer + OWORD_BUFFER_SIZE;
+
+    if(cacheable) {
+        uint_fast8_t idx = NGC_EXPRESSION_CACHE_SIZE;
+        do {
+            if(ngc_cache[--idx].source == source) {
+                *char_counter += ngc_cache[idx].length;
+                return ngc_evaluate(&ngc_cache[idx].rpn, value);
+            }
+        } while(idx);
+    }
+#endif
+
+    rpn.length = rpn.nesting = 0;
+
+    if((status = ngc_compile_operand(block, char_counter, &rpn)) != Status_OK)
+        return status;
+
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+    if(cacheable) {
+        ngc_cached_expression_t *entry = &ngc_cache[ngc_cache_next];
+        ngc_cache_next = (ngc_cache_next + 1) % NGC_EXPRESSION_CACHE_SIZE;
+        entry->source = source;
+        entry->length = *char_counter - start;
+        memcpy(&entry->rpn, &rpn, sizeof(ngc_rpn_t));
+        compiled = &entry->rpn;
+    }
+#else
+    (void)start;
+#endif
+
+    return ngc_evaluate(compiled, value);
+}
+
+#endif
+
+#ifdef ENABLE_NGC_PARAMETERS
+#define is_plain_value(c) (c != '#' && c != '[')
+#else
+#define is_plain_value(c) true
+#endif
+
+// Reads a word value, a number or if parameters are enabled a parameter reference or expression.
+static status_code_t read_value (char *block, uint_fast8_t *char_counter, float *value)
+{
+#ifdef ENABLE_NGC_PARAMETERS
+    if(block[*char_counter] == '#' || block[*char_counter] == '[')
+        return ngc_eval(block, char_counter, value);
+#endif
+
+    return read_float(block, char_counter, value) ? Status_OK : Status_BadNumberFormat;
+}
+
+void gc_init (bool cold_start)
+{
+
+#if COMPATIBILITY_LEVEL > 1
+    cold_start = true;
+#endif
+
+    if(cold_start) {
+        memset(&gc_state, 0, sizeof(parser_state_t));
+#ifdef ENABLE_NGC_PARAMETERS
+        memset(ngc_params, 0, sizeof(ngc_params));
+#endif
+      #ifdef N_TOOLS
+        gc_state.tool = gc_get_tool(0);
+      #else
+        memset(&tool_table, 0, sizeof(tool_table));
+        gc_state.tool = &tool_table;
+      #endif
+    } else {
+        memset(&gc_state, 0, offsetof(parser_state_t, g92_coord_offset));
+        gc_state.tool_pending = gc_state.tool->tool;
+        if(hal.tool.select)
+            hal.tool.select(gc_state.tool, false);
+        // TODO: restore offsets, tool offset mode?
+    }
+
+    // Clear any pending output commands
+    gc_output_command_free(output_commands);
+    output_commands = NULL;
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+    memset(&queued_state, 0, sizeof(queued_state));
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    wco_queue.head = wco_queue.tail = 0;
+    wco_queue.changed = wco_queue.pending = false;
+#endif
+
+#ifdef ENABLE_OWORDS
+    oword_clear();
+#endif
+
+    // Load default override status
+    gc_state.modal.override_ctrl = sys.override.control;
+    gc_state.spindle.css.max_rpm = settings.spindle.rpm_max; // default max speed for CSS mode
+
+    set_scaling(1.0f);
+
+    // Load default G54 coordinate system.
+    if (!settings_read_coord_data(gc_state.modal.coord_system.id, &gc_state.modal.coord_system.xyz))
+        grbl.report.status_message(Status_SettingReadFail);
+
+#if COMPATIBILITY_LEVEL <= 1
+    if (cold_start && !settings_read_coord_data(CoordinateSystem_G92, &gc_state.g92_coord_offset))
+        grbl.report.status_message(Status_SettingReadFail);
+#endif
+
+//    if(settings.flags.lathe_mode)
+//        gc_state.modal.plane_select = PlaneSelect_ZX;
+}
+
+
+// Set dynamic laser power mode to PPI (Pulses Per Inch)
+// Returns true if driver uses hardware implementation.
+// Driver support for pulsing the laser on signal is required for this to work.
+bool gc_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length)
+{
+    gc_state.is_laser_ppi_mode = ppi > 0 && pulse_length > 0;
+
+    return grbl.on_laser_ppi_enable && grbl.on_laser_ppi_enable(ppi, pulse_length);
+}
+
+#ifdef ENABLE_ALLOC_POOLS
+
+#ifndef OUTPUT_COMMAND_POOL_SIZE
+#define OUTPUT_COMMAND_POOL_SIZE BLOCK_BUFFER_SIZE
+#endif
+#ifndef MESSAGE_POOL_SIZE
+#define MESSAGE_POOL_SIZE BLOCK_BUFFER_SIZE
+#endif
+#ifndef MESSAGE_POOL_SLOT_SIZE
+#define MESSAGE_POOL_SLOT_SIZE 64
+#endif
+
+typedef union message_slot {
+    union message_slot *next;
+    char text[MESSAGE_POOL_SLOT_SIZE];
+} message_slot_t;
+
+static THREAD_LOCAL struct {
+    bool initialized;
+    uint32_t exhausted;
+    output_command_t *free_command;
+    message_slot_t *free_message;
+    output_command_t command[OUTPUT_COMMAND_POOL_SIZE];
+    message_slot_t message[MESSAGE_POOL_SIZE];
+} pool = {0};
+
+// Link all pool entries into the free lists, called on first allocation.
+static void pool_init (void)
+{
+    uint_fast16_t idx;
+
+    for(idx = 0; idx < OUTPUT_COMMAND_POOL_SIZE; idx++)
+        pool.command[idx].next = idx < OUTPUT_COMMAND_POOL_SIZE - 1 ? &pool.command[idx + 1] : NULL;
+
+    for(idx = 0; idx < MESSAGE_POOL_SIZE; idx++)
+        pool.message[idx].next = idx < MESSAGE_POOL_SIZE - 1 ? &pool.message[idx + 1] : NULL;
+
+    pool.free_command = &pool.command[0];
+    pool.free_message = &pool.message[0];
+    pool.initialized = true;
+}
+
+// Returns the number of allocations that could not be satisfied from the pools since startup.
+uint32_t gc_pool_exhausted_count (void)
+{
+    return pool.exhausted;
+}
+
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+
+// Returns RAM used by the parser state, the tool table and the buffers of the optional parser extensions.
+uint32_t gc_get_memory (void)
+{
+#ifdef TOOL_TABLE_CACHE
+    uint32_t size = sizeof(gc_state) + sizeof(tool_cache) + sizeof(tool_used) + sizeof(tool_entry);
+#else
+    uint32_t size = sizeof(gc_state) + sizeof(tool_table);
+#endif
+
+#ifdef ENABLE_OWORDS
+    size += sizeof(oword);
+  #ifdef ENABLE_PACKED_BLOCKS
+    size += sizeof(oword_packed_block);
+  #endif
+#endif
+#ifdef ENABLE_NGC_PARAMETERS
+    size += sizeof(ngc_params);
+#endif
+#ifdef NGC_EXPRESSION_CACHE_SIZE
+    size += sizeof(ngc_cache);
+#endif
+#ifdef ENABLE_ALLOC_POOLS
+    size += sizeof(pool);
+#endif
+
+    return size;
+}
+
+#endif
+
+/* Output commands and messages are allocated from fixed size pools if ENABLE_ALLOC_POOLS is defined,
+   falling back to the heap when a pool is exhausted. They may be released by the stepper segment
+   preparation, which can run in a low priority interrupt context, so the pools are protected by the prep lock.
+*/
+
+// Allocate an output command, returns NULL if out of memory.
+output_command_t *gc_output_command_alloc (void)
+{
+    output_command_t *cmd;
+
+#ifdef ENABLE_ALLOC_POOLS
+    st_prep_lock();
+
+    if(!pool.initialized)
+        pool_init();
+
+    if((cmd = pool.free_command))
+        pool.free_command = cmd->next;
+    else
+        pool.exhausted++;
+
+    st_prep_unlock();
+
+    if(cmd == NULL)
+#endif
+    cmd = malloc(sizeof(output_command_t));
+
+    return cmd;
+}
+
+// Free a linked list of output commands.
+void gc_output_command_free (output_command_t *cmd)
+{
+    output_command_t *next;
+
+#ifdef ENABLE_ALLOC_POOLS
+    st_prep_lock();
+#endif
+
+    while(cmd) {
+        next = cmd->next;
+#ifdef ENABLE_ALLOC_POOLS
+        if(cmd >= &pool.command[0] && cmd <= &pool.command[OUTPUT_COMMAND_POOL_SIZE - 1]) {
+            cmd->next = pool.free_command;
+            pool.free_command = cmd;
+        } else
+#endif
+        free(cmd);
+        cmd = next;
+    }
+
+#ifdef ENABLE_ALLOC_POOLS
+    st_prep_unlock();
+#endif
+}
+
+// Allocate a message buffer of size bytes, returns NULL if out of memory.
+char *gc_message_alloc (uint_fast16_t size)
+{
+    char *message = NULL;
+
+#ifdef ENABLE_ALLOC_POOLS
+    st_prep_lock();
+
+    if(!pool.initialized)
+        pool_init();
+
+    if(size <= MESSAGE_POOL_SLOT_SIZE && pool.free_message) {
+        message = pool.free_message->text;
+        pool.free_message = pool.free_message->next;
+    } else
+        pool.exhausted++;
+
+    st_prep_unlock();
+
+    if(message == NULL)
+#endif
+    message = malloc(size);
+
+    return message;
+}
+
+// Free a message buffer allocated by gc_message_alloc().
+void gc_message_free (char *message)
+{
+#ifdef ENABLE_ALLOC_POOLS
+    message_slot_t *slot = (message_slot_t *)message;
+
+    if(slot >= &pool.message[0] && slot <= &pool.message[MESSAGE_POOL_SIZE - 1]) {
+        st_prep_lock();
+        slot->next = pool.free_message;
+        pool.free_message = slot;
+        st_prep_unlock();
+    } else
+#endif
+    free(message);
+}
+
+#ifdef GC_QUEUED_STATE
 
-    if(tlo_changed) {
-        sys.report.tool_offset = true;
-        system_flag_wco_change();
-    }
+// Returns true if a state change can be queued for execution by the stepper driver when the next
+// motion is started. It is not when no motion is buffered, the change is then executed immediately.
+static inline bool state_change_is_queueable (void)
+{
+    return sys.state != STATE_CHECK_MODE && plan_get_current_block() != NULL;
 }
 
-plane_t *gc_get_plane_data (plane_t *plane, plane_select_t select)
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+
+// Queues a change of the work coordinate offsets made by the block executing. The previously reported
+// offsets are kept for reporting until the next motion is started, it is then flagged by wco_change
+// in the planner block. The change is reported immediately when no motion is buffered.
+static void wco_change_queue (float *previous)
 {
-    switch (select) {
+    if(wco_queue.changed) {
 
-        case PlaneSelect_XY:
-            plane->axis_0 = X_AXIS;
-            plane->axis_1 = Y_AXIS;
-            plane->axis_linear = Z_AXIS;
-            break;
+        uint_fast8_t next = (wco_queue.head + 1) % WCO_QUEUE_SIZE;
 
-        case PlaneSelect_ZX:
-            plane->axis_0 = Z_AXIS;
-            plane->axis_1 = X_AXIS;
-            plane->axis_linear = Y_AXIS;
-            break;
+        wco_queue.changed = false;
 
-        default: // case PlaneSelect_YZ:
-            plane->axis_0 = Y_AXIS;
-            plane->axis_1 = Z_AXIS;
-            plane->axis_linear = X_AXIS;
+        if(wco_queue.pending)
+            return; // The offsets reported are already queued.
+
+        if(state_change_is_queueable() && next == wco_queue.tail)
+            protocol_buffer_synchronize(); // Queue is full, wait for the queued changes to be started.
+
+        if(state_change_is_queueable()) {
+            memcpy(wco_queue.offset[wco_queue.head], previous, sizeof(wco_queue.offset[0]));
+            wco_queue.head = next;
+            wco_queue.pending = true;
+        } else
+            system_flag_wco_change();
     }
+}
 
-    return plane;
+float gc_get_reported_offset (uint_fast8_t idx)
+{
+    uint_fast8_t tail = wco_queue.tail;
+
+    return tail == wco_queue.head ? gc_get_offset(idx) : wco_queue.offset[tail][idx];
 }
 
-void gc_init (bool cold_start)
+// NOTE: Called from the stepper interrupt.
+void gc_wco_change_started (void)
 {
+    if(wco_queue.tail != wco_queue.head)
+        wco_queue.tail = (wco_queue.tail + 1) % WCO_QUEUE_SIZE;
+
+    sys.report.wco = On;
+}
 
-#if COMPATIBILITY_LEVEL > 1
-    cold_start = true;
 #endif
 
-    if(cold_start) {
-        memset(&gc_state, 0, sizeof(parser_state_t));
-      #ifdef N_TOOLS
-        gc_state.tool = &tool_table[0];
-      #else
-        memset(&tool_table, 0, sizeof(tool_table));
-        gc_state.tool = &tool_table;
-      #endif
-    } else {
-        memset(&gc_state, 0, offsetof(parser_state_t, g92_coord_offset));
-        gc_state.tool_pending = gc_state.tool->tool;
-        if(hal.tool.select)
-            hal.tool.select(gc_state.tool, false);
-        // TODO: restore offsets, tool offset mode?
+// Executes state changes not yet queued with a motion, called when the buffered motions are completed.
+void gc_flush_queued_state (void)
+{
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    if(wco_queue.pending || wco_queue.tail != wco_queue.head) {
+        wco_queue.pending = false;
+        wco_queue.tail = wco_queue.head;
+        sys.report.wco = On;
     }
+#endif
 
-    // Clear any pending output commands
-    while(output_commands) {
-        output_command_t *next = output_commands->next;
-        free(output_commands);
-        output_commands = next;
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+    if(queued_state.coolant) {
+        queued_state.coolant = false;
+        coolant_set_state(gc_state.modal.coolant);
     }
 
-    // Load default override status
-    gc_state.modal.override_ctrl = sys.override.control;
-    gc_state.spindle.css.max_rpm = settings.spindle.rpm_max; // default max speed for CSS mode
-
-    set_scaling(1.0f);
-
-    // Load default G54 coordinate system.
-    if (!settings_read_coord_data(gc_state.modal.coord_system.id, &gc_state.modal.coord_system.xyz))
-        grbl.report.status_message(Status_SettingReadFail);
-
-#if COMPATIBILITY_LEVEL <= 1
-    if (cold_start && !settings_read_coord_data(CoordinateSystem_G92, &gc_state.g92_coord_offset))
-        grbl.report.status_message(Status_SettingReadFail);
+    if(queued_state.spindle_rpm) {
+        queued_state.spindle_rpm = false;
+        if(gc_state.modal.spindle.on)
+            spindle_set_state(gc_state.modal.spindle, gc_state.spindle.rpm);
+    }
 #endif
-
-//    if(settings.flags.lathe_mode)
-//        gc_state.modal.plane_select = PlaneSelect_ZX;
 }
 
-
-// Set dynamic laser power mode to PPI (Pulses Per Inch)
-// Returns true if driver uses hardware implementation.
-// Driver support for pulsing the laser on signal is required for this to work.
-bool gc_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length)
-{
-    gc_state.is_laser_ppi_mode = ppi > 0 && pulse_length > 0;
-
-    return grbl.on_laser_ppi_enable && grbl.on_laser_ppi_enable(ppi, pulse_length);
-}
+#endif
 
 // Add output command to linked list
 static bool add_output_command (output_command_t *command)
 {
     output_command_t *add_cmd;
 
-    if((add_cmd = malloc(sizeof(output_command_t)))) {
+    if((add_cmd = gc_output_command_alloc())) {
 
         memcpy(add_cmd, command, sizeof(output_command_t));
 
@@ -303,14 +1458,86 @@ static status_code_t init_sync_motion (plan_line_data_t *pl_data, float pitch)
     return Status_OK;
 }
 
+#ifdef ENABLE_PACKED_BLOCKS
+
+// Verifies the checksum of a packed block, the 8-bit sum of the characters between STX and the '*'
+// end marker must match the two nibbles following the marker. Terminates the block at the marker.
+static bool packed_block_is_valid (char *block)
+{
+    uint8_t sum = 0;
+    char *ptr = block + 1;
+
+    while(*ptr != '\0' && *ptr != '*')
+        sum += (uint8_t)*ptr++;
+
+    if(*ptr != '*' || ptr[1] < 'a' || ptr[1] > 'p' || ptr[2] < 'a' || ptr[2] > 'p' || ptr[3] != '\0')
+        return false;
+
+    *ptr = '\0';
+
+    return sum == (uint8_t)(((ptr[1] - 'a') << 4) | (ptr[2] - 'a'));
+}
+
+// Reads a packed block word value, 1 to 8 nibbles encoded as 'a' to 'p', most significant first,
+// of the IEEE 754 single precision representation of the value. Omitted trailing nibbles are zero.
+static bool read_packed_float (char *block, uint_fast8_t *char_counter, float *float_ptr)
+{
+    char *ptr = block + *char_counter;
+    uint_fast8_t nibbles = 0;
+    union {
+        uint32_t u;
+        float f;
+    } value = {0};
+
+    while(nibbles < 8 && *ptr >= 'a' && *ptr <= 'p') {
+        value.u = (value.u << 4) | (uint32_t)(*ptr++ - 'a');
+        nibbles++;
+    }
+
+    // Fail if no value or value is infinite or NaN.
+    if(nibbles == 0 || (((value.u <<= (8 - nibbles) * 4) & 0x7F800000) == 0x7F800000))
+        return false;
+
+    *float_ptr = value.f;
+    *char_counter = ptr - block;
+
+    return true;
+}
+
+#endif
+
 // Executes one block (line) of 0-terminated G-Code. The block is assumed to contain only uppercase
 // characters and signed floating point values (no whitespace). Comments and block delete
 // characters have been removed. In this function, all units and positions are converted and
 // exported to grbl's internal functions in terms of (mm, mm/min) and absolute machine
 // coordinates, respectively.
+// If packed blocks are enabled a block starting with STX is a packed block, its words are read
+// by read_packed_float() instead of read_float() and then validated and executed as usual.
 status_code_t gc_execute_block(char *block, char *message)
 {
-    static parser_block_t gc_block;
+    static THREAD_LOCAL parser_block_t gc_block;
+
+#ifdef ENABLE_OWORDS
+    // Blocks are recorded while a subroutine or loop body is being defined.
+    if(oword.recording)
+        return oword_record(block);
+
+    if(block[0] == 'O')
+        return oword_execute(block);
+#endif
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    // Wait for an incomplete canned cycle to be queued before the block is executed.
+    if(!mc_cycle_flush())
+        return Status_OK;
+#endif
+
+#ifdef ENABLE_PACKED_BLOCKS
+    bool packed = block[0] == ASCII_STX;
+
+    if(packed && !packed_block_is_valid(block))
+        FAIL(Status_BlockChecksumError); // [Checksum mismatch]
+#endif
 
     // Determine if the line is a program start/end marker.
     // Old comment from protocol.c:
@@ -363,22 +1590,49 @@ status_code_t gc_execute_block(char *block, char *message)
      perform initial error-checks for command word modal group violations, for any repeated
      words, and for negative values set for the value words F, N, P, T, and S. */
 
+#ifdef ENABLE_PACKED_BLOCKS
+    uint_fast8_t char_counter = gc_parser_flags.jog_motion ? 3 /* Start parsing after `$J=` */ : (packed ? 1 /* and STX */ : 0);
+#else
     uint_fast8_t char_counter = gc_parser_flags.jog_motion ? 3 /* Start parsing after `$J=` */ : 0;
+#endif
     char letter;
     float value;
     uint32_t int_value = 0;
     uint_fast16_t mantissa = 0;
     word_bit_t word_bit = { .parameter = (parameter_word_t)0 }; // Bit-value for assigning tracking variables
 
+#ifdef ENABLE_NGC_PARAMETERS
+    uint_fast8_t n_assignments = 0;
+    struct {
+        float number;
+        float value;
+    } assignment[NGC_MAX_ASSIGNMENTS];
+#endif
+
     while ((letter = block[char_counter++]) != '\0') { // Loop until no more g-code words in block.
 
+#ifdef ENABLE_NGC_PARAMETERS
+        // Parameter assignment, #<number>=<value>. Assignments are performed after the block has been read
+        // so that parameter references in the block are evaluated with the values set by previous blocks.
+        if(letter == '#') {
+            status_code_t status;
+            if(n_assignments == NGC_MAX_ASSIGNMENTS)
+                FAIL(Status_ExpressionSyntaxError); // [Too many assignments]
+            if((status = ngc_eval(block, &char_counter, &assignment[n_assignments].number)) != Status_OK) // Parameter number
+                FAIL(status);
+            if(block[char_counter++] != '=')
+                FAIL(Status_ExpressionSyntaxError); // [Expected =]
+            if((status = read_value(block, &char_counter, &assignment[n_assignments].value)) != Status_OK)
+                FAIL(status);
+            n_assignments++;
+            continue;
+        }
+#endif
+
         // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
         if((letter < 'A') || (letter > 'Z'))
             FAIL(Status_ExpectedCommandLetter); // [Expected word letter]
 
-        if (!read_float(block, &char_counter, &value))
-            FAIL(Status_BadNumberFormat); // [Expected word value]
-
         // Convert values to smaller uint8 significand and mantissa values for parsing this word.
         // NOTE: Mantissa is multiplied by 100 to catch non-integer command values. This is more
         // accurate than the NIST gcode requirement of x10 when used for commands, but not quite
@@ -386,9 +1640,27 @@ status_code_t gc_execute_block(char *block, char *message)
         // a good enough comprimise and catch most all non-integer errors. To make it compliant,
         // we would simply need to change the mantissa to int16, but this add compiled flash space.
         // Maybe update this later.
-        int_value = (uint32_t)truncf(value);
-        mantissa = (uint_fast16_t)roundf(100.0f * (value - int_value)); // Compute mantissa for Gxx.x commands.
-        // NOTE: Rounding must be used to catch small floating point errors.
+#ifdef ENABLE_PACKED_BLOCKS
+        if (!packed && (letter == 'G' || letter == 'M') && is_plain_value(block[char_counter])) {
+#else
+        if ((letter == 'G' || letter == 'M') && is_plain_value(block[char_counter])) {
+#endif
+            // Command words only use the integer part and mantissa, read them without float conversion.
+            if (!read_uint(block, &char_counter, &int_value, &mantissa))
+                FAIL(Status_BadNumberFormat); // [Expected word value]
+        } else {
+            status_code_t status;
+#ifdef ENABLE_PACKED_BLOCKS
+            if ((status = packed ? (read_packed_float(block, &char_counter, &value) ? Status_OK : Status_BadNumberFormat) : read_value(block, &char_counter, &value)) != Status_OK)
+#else
+            if ((status = read_value(block, &char_counter, &value)) != Status_OK)
+#endif
+                FAIL(status); // [Expected word value]
+
+            int_value = (uint32_t)truncf(value);
+            mantissa = (uint_fast16_t)roundf(100.0f * (value - int_value)); // Compute mantissa for Gxx.x commands.
+            // NOTE: Rounding must be used to catch small floating point errors.
+        }
 
         // Check if the g-code word is supported or errors due to modal group violations or has
         // been repeated in the g-code block. If ok, update the command or record its value.
@@ -561,8 +1833,17 @@ status_code_t gc_execute_block(char *block, char *message)
                         word_bit.group = ModalGroup_G13;
                         if (mantissa != 0) // [G61.1 not supported]
                             FAIL(Status_GcodeUnsupportedCommand);
-                        // gc_block.modal.control = CONTROL_MODE_EXACT_PATH; // G61
+#ifdef ENABLE_PATH_BLENDING
+                        gc_block.modal.control = ControlMode_ExactPath; // G61
+#endif
+                        break;
+
+#ifdef ENABLE_PATH_BLENDING
+                    case 64:
+                        word_bit.group = ModalGroup_G13;
+                        gc_block.modal.control = ControlMode_Continuous; // G64
                         break;
+#endif
 
                     case 96: case 97:
                         if(settings.mode == Mode_Lathe && hal.driver_cap.variable_spindle) {
@@ -741,134 +2022,47 @@ status_code_t gc_execute_block(char *block, char *message)
                 legal g-code words and stores their value. Error-checking is performed later since some
                 words (I,J,K,L,P,R) have multiple connotations and/or depend on the issued commands. */
 
-                switch(letter) {
-
-                  #ifdef A_AXIS
-                    case 'A':
-                        word_bit.parameter = Word_A;
-                        gc_block.values.xyz[A_AXIS] = value;
-                        bit_true(axis_words, bit(A_AXIS));
-                        break;
-                  #endif
-
-                  #ifdef B_AXIS
-                    case 'B':
-                        word_bit.parameter = Word_B;
-                        gc_block.values.xyz[B_AXIS] = value;
-                        bit_true(axis_words, bit(B_AXIS));
-                        break;
-                  #endif
-
-                  #ifdef C_AXIS
-                    case 'C':
-                        word_bit.parameter = Word_C;
-                        gc_block.values.xyz[C_AXIS] = value;
-                        bit_true(axis_words, bit(C_AXIS));
-                        break;
-                 #endif
-
-                    case 'D':
-                        word_bit.parameter = Word_D;
-                        gc_block.values.d = value;
-                        break;
-
-                    case 'E':
-                        word_bit.parameter = Word_E;
-                        gc_block.values.e = value;
-                        break;
-
-                    case 'F':
-                        word_bit.parameter = Word_F;
-                        gc_block.values.f = value;
-                        break;
-
-                    case 'H':
-                        if (mantissa > 0)
-                            FAIL(Status_GcodeCommandValueNotInteger);
-                        word_bit.parameter = Word_H;
-                        gc_block.values.h = int_value;
-                        break;
-
-                    case 'I':
-                        word_bit.parameter = Word_I;
-                        gc_block.values.ijk[I_VALUE] = value;
-                        bit_true(ijk_words, bit(I_VALUE));
-                        break;
-
-                    case 'J':
-                        word_bit.parameter = Word_J;
-                        gc_block.values.ijk[J_VALUE] = value;
-                        bit_true(ijk_words, bit(J_VALUE));
-                        break;
-
-                    case 'K':
-                        word_bit.parameter = Word_K;
-                        gc_block.values.ijk[K_VALUE] = value;
-                        bit_true(ijk_words, bit(K_VALUE));
-                        break;
-
-                    case 'L':
-                        if (mantissa > 0)
-                            FAIL(Status_GcodeCommandValueNotInteger);
-                        word_bit.parameter = Word_L;
-                        gc_block.values.l = (uint8_t)int_value;
-                        break;
-
-                    case 'N':
-                        word_bit.parameter = Word_N;
-                        gc_block.values.n = (int32_t)truncf(value);
-                        break;
-
-                    case 'P': // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
-                        word_bit.parameter = Word_P;
-                        gc_block.values.p = value;
-                        break;
+                {
+                    const value_word_t *value_word = &value_word_table[letter - 'A'];
 
-                    case 'Q': // may be used for user defined mcodes or G61,G76
-                        word_bit.parameter = Word_Q;
-                        gc_block.values.q = value;
-                        break;
+                    word_bit.parameter = (parameter_word_t)value_word->word;
 
-                    case 'R':
-                        word_bit.parameter = Word_R;
-                        gc_block.values.r = value;
-                        break;
+                    switch(value_word->type) {
 
-                    case 'S':
-                        word_bit.parameter = Word_S;
-                        gc_block.values.s = value;
-                        break;
+                        case ValueWord_Float:
+                            *(float *)((uint8_t *)&gc_block.values + value_word->offset) = value;
+                            axis_words |= value_word->axis_bit;
+                            ijk_words |= value_word->ijk_bit;
+                            break;
 
-                    case 'T':
-                        if (mantissa > 0)
-                            FAIL(Status_GcodeCommandValueNotInteger);
-                        if (int_value > MAX_TOOL_NUMBER)
-                            FAIL(Status_GcodeIllegalToolTableEntry);
-                        word_bit.parameter = Word_T;
-                        gc_block.values.t = int_value;
-                        break;
+                        case ValueWord_Integer:
+                            if (mantissa > 0)
+                                FAIL(Status_GcodeCommandValueNotInteger);
+                            switch(letter) {
 
-                    case 'X':
-                        word_bit.parameter = Word_X;
-                        gc_block.values.xyz[X_AXIS] = value;
-                        bit_true(axis_words, bit(X_AXIS));
-                        break;
+                                case 'H':
+                                    gc_block.values.h = int_value;
+                                    break;
 
-                    case 'Y':
-                        word_bit.parameter = Word_Y;
-                        gc_block.values.xyz[Y_AXIS] = value;
-                        bit_true(axis_words, bit(Y_AXIS));
-                        break;
+                                case 'L':
+                                    gc_block.values.l = (uint8_t)int_value;
+                                    break;
 
-                    case 'Z':
-                        word_bit.parameter = Word_Z;
-                        gc_block.values.xyz[Z_AXIS] = value;
-                        bit_true(axis_words, bit(Z_AXIS));
-                        break;
+                                default: // 'T'
+                                    if (int_value > MAX_TOOL_NUMBER)
+                                        FAIL(Status_GcodeIllegalToolTableEntry);
+                                    gc_block.values.t = int_value;
+                                    break;
+                            }
+                            break;
 
-                    default: FAIL(Status_GcodeUnsupportedCommand);
+                        case ValueWord_LineNumber:
+                            gc_block.values.n = (int32_t)truncf(value);
+                            break;
 
-                } // end parameter letter switch
+                        default: FAIL(Status_GcodeUnsupportedCommand);
+                    }
+                }
 
                 // NOTE: Variable 'word_bit' is always assigned, if the non-command letter is valid.
                 if (bit_istrue(value_words, bit(word_bit.parameter)))
@@ -886,6 +2080,29 @@ status_code_t gc_execute_block(char *block, char *message)
 
     // Parsing complete!
 
+#ifdef ENABLE_NGC_PARAMETERS
+    uint_fast8_t assigned;
+    for(assigned = 0; assigned < n_assignments; assigned++) {
+        status_code_t status;
+        if((status = ngc_param_set(assignment[assigned].number, assignment[assigned].value)) != Status_OK)
+            FAIL(status);
+    }
+
+    // Blocks with assignments only are done.
+    if(n_assignments && command_words == 0 && value_words == 0)
+        return Status_OK;
+#endif
+
+#ifdef ENABLE_BLOCK_REPLAY
+    // Only blocks without side effects other than the motion and the modal state changes may be replayed.
+    bool replayable = grbl.on_replayable_block && message == NULL && !gc_parser_flags.jog_motion &&
+                       !(command_words & ~(bit(ModalGroup_G1)|bit(ModalGroup_G2)|bit(ModalGroup_G3)|bit(ModalGroup_G5)|bit(ModalGroup_G6))) &&
+                        !(value_words & ~(AXIS_WORDS_MASK|bit(Word_F)|bit(Word_I)|bit(Word_J)|bit(Word_K)|bit(Word_N)|bit(Word_R)));
+  #ifdef ENABLE_NGC_PARAMETERS
+    replayable = replayable && strpbrk(block, "#[") == NULL; // Values may change between runs.
+  #endif
+#endif
+
 
   /* -------------------------------------------------------------------------------------
      STEP 3: Error-check all commands and values passed in this block. This step ensures all of
@@ -1268,13 +2485,22 @@ status_code_t gc_execute_block(char *block, char *message)
 #endif
             sys.report.scaling = sys.report.scaling || gc_state.modal.scaling_active != gc_block.modal.scaling_active;
             gc_state.modal.scaling_active = gc_block.modal.scaling_active;
+            transform.valid = false;
 
         } else
             set_scaling(1.0f);
     }
 
+    // Absolute axis words of motion blocks in the active coordinate system are transformed in one pass, with scaling
+    // fused with the work coordinate offsets, when the target is computed below.
+    bool fused_transform = !(gc_block.non_modal_command == NonModal_SetCoordinateData ||
+                              gc_block.non_modal_command == NonModal_SetCoordinateOffset ||
+                               gc_block.non_modal_command == NonModal_AbsoluteOverride ||
+                                axis_command == AxisCommand_ToolLengthOffset) &&
+                                 gc_block.modal.coord_system.id == gc_state.modal.coord_system.id;
+
     // Scale axis words if scaling active
-    if(gc_state.modal.scaling_active) {
+    if(gc_state.modal.scaling_active && !fused_transform) {
         idx = N_AXIS;
         do {
             if(bit_istrue(axis_words, bit(--idx))) {
@@ -1349,7 +2575,20 @@ status_code_t gc_execute_block(char *block, char *message)
             FAIL(Status_SettingReadFail);
     }
 
-    // [16. Set path control mode ]: N/A. Only G61. G61.1 and G64 NOT SUPPORTED.
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED. G64 NOT SUPPORTED unless path blending is enabled.
+    //                              G64 P (tolerance) is optional and must not be negative.
+#ifdef ENABLE_PATH_BLENDING
+    if (bit_istrue(command_words, bit(ModalGroup_G13))) {
+        gc_block.modal.path_tolerance = 0.0f;
+        if (gc_block.modal.control == ControlMode_Continuous && bit_istrue(value_words, bit(Word_P))) {
+            if(gc_block.values.p < 0.0f)
+                FAIL(Status_NegativeValue);
+            gc_block.modal.path_tolerance = gc_block.modal.units_imperial ? gc_block.values.p * MM_PER_INCH : gc_block.values.p;
+            bit_false(value_words, bit(Word_P));
+        }
+    }
+#endif
+
     // [17. Set distance mode ]: N/A. Only G91.1. G90.1 NOT SUPPORTED.
     // [18. Set retract mode ]: N/A.
 
@@ -1418,10 +2657,12 @@ status_code_t gc_execute_block(char *block, char *message)
                     if(p_value == 0 || p_value > MAX_TOOL_NUMBER)
                        FAIL(Status_GcodeIllegalToolTableEntry); // [Greater than MAX_TOOL_NUMBER]
 
-                    tool_table[p_value].tool = p_value;
+                    tool_data_t *tool_data = gc_get_tool(p_value);
+
+                    tool_data->tool = p_value;
 
                     if(bit_istrue(value_words, bit(Word_R))) {
-                        tool_table[p_value].radius = gc_block.values.r;
+                        tool_data->radius = gc_block.values.r;
                         bit_false(value_words, bit(Word_R));
                     }
 
@@ -1433,19 +2674,19 @@ status_code_t gc_execute_block(char *block, char *message)
                     do {
                         if (bit_istrue(axis_words, bit(--idx))) {
                             if(gc_block.values.l == 1)
-                                tool_table[p_value].offset[idx] = gc_block.values.xyz[idx];
+                                tool_data->offset[idx] = gc_block.values.xyz[idx];
                             else if(gc_block.values.l == 10)
-                                tool_table[p_value].offset[idx] = gc_state.position[idx] - gc_state.g92_coord_offset[idx] - gc_block.values.xyz[idx];
+                                tool_data->offset[idx] = gc_state.position[idx] - gc_state.g92_coord_offset[idx] - gc_block.values.xyz[idx];
                             else if(gc_block.values.l == 11)
-                                tool_table[p_value].offset[idx] = g59_3_offset[idx] - gc_block.values.xyz[idx];
+                                tool_data->offset[idx] = g59_3_offset[idx] - gc_block.values.xyz[idx];
                             if (gc_block.values.l != 1)
-                                tool_table[p_value].offset[idx] -= gc_state.tool_length_offset[idx];
+                                tool_data->offset[idx] -= gc_state.tool_length_offset[idx];
                         }
                         // else, keep current stored value.
                     } while(idx);
 
                     if(gc_block.values.l == 1)
-                        settings_write_tool_data(&tool_table[p_value]);
+                        settings_write_tool_data(tool_data);
 
                     break;
 #endif
@@ -1479,7 +2720,19 @@ status_code_t gc_execute_block(char *block, char *message)
             // target position with the coordinate system offsets, G92 offsets, absolute override, and distance
             // modes applied. This includes the motion mode commands. We can now pre-compute the target position.
             // NOTE: Tool offsets may be appended to these conversions when/if this feature is added.
-            if (axis_words && axis_command != AxisCommand_ToolLengthOffset) { // TLO block any axis command.
+            if (axis_words && fused_transform) {
+                if(!transform.valid)
+                    update_transform();
+                idx = N_AXIS;
+                do {
+                    if (bit_isfalse(axis_words, bit(--idx)))
+                        gc_block.values.xyz[idx] = gc_state.position[idx]; // No axis word in block. Keep same axis position.
+                    else if (gc_block.modal.distance_incremental)
+                        gc_block.values.xyz[idx] = gc_block.values.xyz[idx] * transform.scale[idx] + gc_state.position[idx];
+                    else // Absolute mode
+                        gc_block.values.xyz[idx] = gc_block.values.xyz[idx] * transform.scale[idx] + transform.offset[idx];
+                } while(idx);
+            } else if (axis_words && axis_command != AxisCommand_ToolLengthOffset) { // TLO block any axis command.
                 idx = N_AXIS;
                 do { // Axes indices are consistent, so loop may be used to save flash space.
                     if (bit_isfalse(axis_words, bit(--idx)))
@@ -2098,9 +3351,14 @@ status_code_t gc_execute_block(char *block, char *message)
     // NOTE: If no line number is present, the value is zero.
     gc_state.line_number = gc_block.values.n;
     plan_data.line_number = gc_state.line_number; // Record data for planner use.
+#ifdef ENABLE_NVS_CHECKPOINT
+    // Tagged before the modal state is changed by the block so that the line can be restarted from the checkpoint.
+    if(axis_command == AxisCommand_MotionMode || axis_command == AxisCommand_NonModal)
+        plan_data.checkpoint = checkpoint_tag_block();
+#endif
 
     // [1. Comments feedback ]: Extracted in protocol.c if HAL entry point provided
-    if(message && sys.state != STATE_CHECK_MODE && (plan_data.message = malloc(strlen(message) + 1)))
+    if(message && sys.state != STATE_CHECK_MODE && (plan_data.message = gc_message_alloc(strlen(message) + 1)))
         strcpy(plan_data.message, message);
 
     // [2. Set feed rate mode ]:
@@ -2133,8 +3391,16 @@ status_code_t gc_execute_block(char *block, char *message)
 
 
     if ((gc_state.spindle.rpm != gc_block.values.s) || gc_parser_flags.spindle_force_sync) {
-        if (gc_state.modal.spindle.on && !gc_parser_flags.laser_is_motion)
+        if (gc_state.modal.spindle.on && !gc_parser_flags.laser_is_motion) {
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+            // Speed changes of the running spindle are output by the stepper driver when the next motion is started.
+            if(!gc_parser_flags.spindle_force_sync && !gc_parser_flags.laser_disable && gc_block.modal.spindle.value == gc_state.modal.spindle.value &&
+                state_change_is_queueable() && spindle_rpm_change_is_queueable())
+                queued_state.spindle_rpm = On;
+            else
+#endif
             spindle_sync(gc_state.modal.spindle, gc_parser_flags.laser_disable ? 0.0f : gc_block.values.s);
+        }
         gc_state.spindle.rpm = gc_block.values.s; // Update spindle speed state.
     }
 
@@ -2151,7 +3417,7 @@ status_code_t gc_execute_block(char *block, char *message)
         // If M6 not available or M61 commanded set new tool immediately
         if(set_tool || settings.tool_change.mode == ToolChange_Ignore || !(hal.stream.suspend_read || hal.tool.change)) {
 #ifdef N_TOOLS
-            gc_state.tool = &tool_table[gc_state.tool_pending];
+            gc_state.tool = gc_get_tool(gc_state.tool_pending);
 #else
             gc_state.tool->tool = gc_state.tool_pending;
 #endif
@@ -2161,13 +3427,21 @@ status_code_t gc_execute_block(char *block, char *message)
         // Prepare tool carousel when available
         if(hal.tool.select) {
 #ifdef N_TOOLS
-            hal.tool.select(&tool_table[gc_state.tool_pending], !set_tool);
+            hal.tool.select(gc_get_tool(gc_state.tool_pending), !set_tool);
 #else
             hal.tool.select(gc_state.tool, !set_tool);
 #endif
         } else
             sys.report.tool = On;
     }
+#ifdef ENABLE_JOB_ESTIMATE
+    else if(sys.flags.estimate) {
+        // Tools are not tracked in check mode, track them for the per tool run time estimate.
+        gc_state.tool_pending = gc_block.values.t;
+        if(bit_istrue(command_words, bit(ModalGroup_M6)))
+            mc_estimate_tool(gc_state.tool_pending);
+    }
+#endif
 
     // [5a. HAL pin I/O ]: M62 - M68. (Modal group M10)
 
@@ -2206,12 +3480,12 @@ status_code_t gc_execute_block(char *block, char *message)
 
         if(plan_data.message) {
             report_message(plan_data.message, Message_Plain);
-            free(plan_data.message);
+            gc_message_free(plan_data.message);
             plan_data.message = NULL;
         }
 
 #ifdef N_TOOLS
-        gc_state.tool = &tool_table[gc_state.tool_pending];
+        gc_state.tool = gc_get_tool(gc_state.tool_pending);
 #else
         gc_state.tool->tool = gc_state.tool_pending;
 #endif
@@ -2245,13 +3519,26 @@ status_code_t gc_execute_block(char *block, char *message)
     if (gc_parser_flags.set_coolant && gc_state.modal.coolant.value != gc_block.modal.coolant.value) {
     // NOTE: Coolant M-codes are modal. Only one command per line is allowed. But, multiple states
     // can exist at the same time, while coolant disable clears all states.
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+        if(state_change_is_queueable()) {
+            queued_state.coolant = On;
+            gc_state.modal.coolant = gc_block.modal.coolant;
+        } else
+#endif
         if(coolant_sync(gc_block.modal.coolant))
             gc_state.modal.coolant = gc_block.modal.coolant;
     }
 
     plan_data.condition.coolant = gc_state.modal.coolant; // Set condition flag for planner use.
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+    plan_data.condition.coolant_change = queued_state.coolant;
+    plan_data.condition.spindle_rpm_change = queued_state.spindle_rpm;
+#endif
 
-    sys.flags.delay_overrides = Off;
+    if(sys.flags.delay_overrides) {
+        sys.flags.delay_overrides = Off;
+        system_set_exec_pending(); // Execute overrides enqueued in the meantime.
+    }
 
     // [9. Override control ]:
     if (gc_state.modal.override_ctrl.value != gc_block.modal.override_ctrl.value) {
@@ -2288,6 +3575,15 @@ status_code_t gc_execute_block(char *block, char *message)
     // [13. Cutter radius compensation ]: G41/42 NOT SUPPORTED
     // gc_state.modal.cutter_comp = gc_block.modal.cutter_comp; // NOTE: Not needed since always disabled.
 
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    float wco_previous[N_AXIS]; // Offsets reported until a change by this block is started.
+    idx = N_AXIS;
+    do {
+        idx--;
+        wco_previous[idx] = gc_get_offset(idx);
+    } while(idx);
+#endif
+
     // [14. Tool length compensation ]: G43, G43.1 and G49 supported. G43 supported when N_TOOLS defined.
     // NOTE: If G43 were supported, its operation wouldn't be any different from G43.1 in terms
     // of execution. The error-checking step would simply load the offset value into the correct
@@ -2295,6 +3591,12 @@ status_code_t gc_execute_block(char *block, char *message)
     if (axis_command == AxisCommand_ToolLengthOffset) { // Indicates a change.
 
         bool tlo_changed = false;
+#ifdef N_TOOLS
+        tool_data_t *tool_data = gc_block.modal.tool_offset_mode == ToolLengthOffset_Enable ||
+                                  gc_block.modal.tool_offset_mode == ToolLengthOffset_ApplyAdditional
+                                   ? gc_get_tool(gc_block.values.h)
+                                   : NULL;
+#endif
 
         idx = N_AXIS;
         gc_state.modal.tool_offset_mode = gc_block.modal.tool_offset_mode;
@@ -2311,15 +3613,15 @@ status_code_t gc_execute_block(char *block, char *message)
                     break;
 #ifdef N_TOOLS
                 case ToolLengthOffset_Enable: // G43
-                    if (gc_state.tool_length_offset[idx] != tool_table[gc_block.values.h].offset[idx]) {
+                    if (gc_state.tool_length_offset[idx] != tool_data->offset[idx]) {
                         tlo_changed = true;
-                        gc_state.tool_length_offset[idx] = tool_table[gc_block.values.h].offset[idx];
+                        gc_state.tool_length_offset[idx] = tool_data->offset[idx];
                     }
                     break;
 
                 case ToolLengthOffset_ApplyAdditional: // G43.2
-                    tlo_changed |= tool_table[gc_block.values.h].offset[idx] != 0.0f;
-                    gc_state.tool_length_offset[idx] += tool_table[gc_block.values.h].offset[idx];
+                    tlo_changed |= tool_data->offset[idx] != 0.0f;
+                    gc_state.tool_length_offset[idx] += tool_data->offset[idx];
                     break;
 #endif
                 case ToolLengthOffset_EnableDynamic: // G43.1
@@ -2336,7 +3638,7 @@ status_code_t gc_execute_block(char *block, char *message)
 
         if(tlo_changed) {
             sys.report.tool_offset = true;
-            system_flag_wco_change();
+            block_wco_changed();
         }
     }
 
@@ -2344,11 +3646,24 @@ status_code_t gc_execute_block(char *block, char *message)
     if (gc_state.modal.coord_system.id != gc_block.modal.coord_system.id) {
         memcpy(&gc_state.modal.coord_system, &gc_block.modal.coord_system, sizeof(gc_state.modal.coord_system));
         sys.report.gwco = On;
-        system_flag_wco_change();
+        block_wco_changed();
     }
 
-    // [16. Set path control mode ]: G61.1/G64 NOT SUPPORTED
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    wco_change_queue(wco_previous);
+    plan_data.condition.wco_change = wco_queue.pending;
+#endif
+
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED
+#ifdef ENABLE_PATH_BLENDING
+    gc_state.modal.control = gc_block.modal.control;
+    gc_state.modal.path_tolerance = gc_block.modal.path_tolerance;
+    plan_data.path_tolerance = gc_state.modal.path_tolerance;
+#else
+
     // gc_state.modal.control = gc_block.modal.control; // NOTE: Always default.
+#endif
+
 
     // [17. Set distance mode ]:
     gc_state.modal.distance_incremental = gc_block.modal.distance_incremental;
@@ -2364,7 +3679,7 @@ status_code_t gc_execute_block(char *block, char *message)
             // Update system coordinate system if currently active.
             if (gc_state.modal.coord_system.id == gc_block.values.coord_data.id) {
                 memcpy(gc_state.modal.coord_system.xyz, gc_block.values.coord_data.xyz, sizeof(gc_state.modal.coord_system.xyz));
-                system_flag_wco_change();
+                block_wco_changed();
             }
             break;
 
@@ -2393,29 +3708,35 @@ status_code_t gc_execute_block(char *block, char *message)
 #if COMPATIBILITY_LEVEL <= 1
             settings_write_coord_data(CoordinateSystem_G92, &gc_state.g92_coord_offset); // Save G92 offsets to non-volatile storage
 #endif
-            system_flag_wco_change();
+            block_wco_changed();
             break;
 
         case NonModal_ResetCoordinateOffset: // G92.1
             clear_vector(gc_state.g92_coord_offset); // Disable G92 offsets by zeroing offset vector.
             settings_write_coord_data(CoordinateSystem_G92, &gc_state.g92_coord_offset); // Save G92 offsets to non-volatile storage
-            system_flag_wco_change();
+            block_wco_changed();
             break;
 
         case NonModal_ClearCoordinateOffset: // G92.2
             clear_vector(gc_state.g92_coord_offset); // Disable G92 offsets by zeroing offset vector.
-            system_flag_wco_change();
+            block_wco_changed();
             break;
 
         case NonModal_RestoreCoordinateOffset: // G92.3
             settings_read_coord_data(CoordinateSystem_G92, &gc_state.g92_coord_offset); // Restore G92 offsets from non-volatile storage
-            system_flag_wco_change();
+            block_wco_changed();
             break;
 
         default:
             break;
     }
 
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    wco_queue.pending &= plan_data.condition.wco_change; // Cleared by the planner when queued with a G28 or G30 motion.
+    wco_change_queue(wco_previous);
+    plan_data.condition.wco_change = wco_queue.pending;
+#endif
+
     // [20. Motion modes ]:
     // NOTE: Commands G10,G28,G30,G92 lock out and prevent axis words from use in motion modes.
     // Enter motion modes only if there are axis words or a motion mode command word in the block.
@@ -2429,6 +3750,15 @@ status_code_t gc_execute_block(char *block, char *message)
 
         pos_update_t gc_update_pos = GCUpdatePos_Target;
 
+#ifdef ENABLE_BLOCK_REPLAY
+        gc_replay_block_t replay_block;
+
+        if((replayable = replayable && plan_data.output_commands == NULL && !(plan_data.condition.coolant_change || plan_data.condition.spindle_rpm_change || plan_data.condition.wco_change) && !gc_parser_flags.spindle_force_sync && !gc_state.spindle.css.active &&
+                          (gc_state.modal.motion == MotionMode_Seek || gc_state.modal.motion == MotionMode_Linear ||
+                            gc_state.modal.motion == MotionMode_CwArc || gc_state.modal.motion == MotionMode_CcwArc)))
+            memcpy(&replay_block.pl_data, &plan_data, sizeof(plan_line_data_t));
+#endif
+
         switch(gc_state.modal.motion) {
 
             case MotionMode_Linear:
@@ -2442,7 +3772,11 @@ status_code_t gc_execute_block(char *block, char *message)
 
             case MotionMode_Seek:
                 plan_data.condition.rapid_motion = On; // Set rapid motion condition flag.
+#ifdef ENABLE_DOGLEG_RAPIDS
+                mc_rapid(gc_block.values.xyz, &plan_data, gc_state.position);
+#else
                 mc_line(gc_block.values.xyz, &plan_data);
+#endif
                 break;
 
             case MotionMode_CwArc:
@@ -2485,9 +3819,7 @@ status_code_t gc_execute_block(char *block, char *message)
                     if(status != Status_OK)
                         FAIL(status);
 
-                    mc_thread(&plan_data, gc_state.position, &thread, overrides.feed_hold_disable);
-
-                    sys.override.control = overrides; // then restore previous override disable status.
+                    mc_thread(&plan_data, gc_state.position, &thread, overrides); // Restores previous override disable status when completed.
                 }
                 break;
 
@@ -2519,11 +3851,17 @@ status_code_t gc_execute_block(char *block, char *message)
             gc_update_pos = GCUpdatePos_None;
 
         //  Clean out any remaining output commands (may linger on error)
-        while(plan_data.output_commands) {
-            output_command_t *next = plan_data.output_commands;
-            free(plan_data.output_commands);
-            plan_data.output_commands = next;
-        }
+        gc_output_command_free(plan_data.output_commands);
+        plan_data.output_commands = NULL;
+
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+        // State changes are queued by the planner with the first block of the motion, keep them pending if none was.
+        queued_state.coolant &= plan_data.condition.coolant_change;
+        queued_state.spindle_rpm &= plan_data.condition.spindle_rpm_change;
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+        wco_queue.pending &= plan_data.condition.wco_change;
+#endif
 
         // As far as the parser is concerned, the position is now == target. In reality the
         // motion control system might still be processing the action and the real tool position
@@ -2533,11 +3871,22 @@ status_code_t gc_execute_block(char *block, char *message)
         else if (gc_update_pos == GCUpdatePos_System)
             gc_sync_position(); // gc_state.position[] = sys_position
         // == GCUpdatePos_None
+
+#ifdef ENABLE_BLOCK_REPLAY
+        if(replayable && gc_update_pos == GCUpdatePos_Target) {
+            memcpy(&replay_block.modal, &gc_state.modal, sizeof(gc_modal_t));
+            memcpy(replay_block.target, gc_block.values.xyz, sizeof(replay_block.target));
+            memcpy(replay_block.ijk, gc_block.values.ijk, sizeof(replay_block.ijk));
+            replay_block.feed_rate = gc_state.feed_rate;
+            replay_block.r = gc_block.values.r;
+            grbl.on_replayable_block(&replay_block);
+        }
+#endif
     }
 
     if(plan_data.message) {
         report_message(plan_data.message, Message_Plain);
-        free(plan_data.message);
+        gc_message_free(plan_data.message);
     }
 
     // [21. Program flow ]:
@@ -2600,7 +3949,7 @@ status_code_t gc_execute_block(char *block, char *message)
 
                 if (!(settings_read_coord_data(gc_state.modal.coord_system.id, &gc_state.modal.coord_system.xyz)))
                     FAIL(Status_SettingReadFail);
-                system_flag_wco_change(); // Set to refresh immediately just in case something altered.
+                wco_changed(); // Set to refresh immediately just in case something altered.
                 hal.spindle.set_state(gc_state.modal.spindle, 0.0f);
                 hal.coolant.set_state(gc_state.modal.coolant);
                 sys.report.spindle = On; // Set to report change immediately
@@ -2611,11 +3960,13 @@ status_code_t gc_execute_block(char *block, char *message)
             }
 
             // Clear any pending output commands
-            while(output_commands) {
-                output_command_t *next = output_commands->next;
-                free(output_commands);
-                output_commands = next;
-            }
+            gc_output_command_free(output_commands);
+            output_commands = NULL;
+
+#ifdef ENABLE_OWORDS
+            if(!oword.depth) // Subroutines are kept until the end of the program executing them.
+                oword_clear();
+#endif
 
             grbl.report.feedback_message(Message_ProgramEnd);
         }
@@ -2626,3 +3977,50 @@ status_code_t gc_execute_block(char *block, char *message)
 
     return Status_OK;
 }
+
+#ifdef ENABLE_BLOCK_REPLAY
+
+// Executes a block recorded from grbl.on_replayable_block, the motion is performed as by gc_execute_block()
+// and the parser state is updated to the state after the recorded block.
+void gc_replay_block (gc_replay_block_t *block)
+{
+    plane_t plane;
+    plan_line_data_t plan_data;
+
+    memcpy(&plan_data, &block->pl_data, sizeof(plan_line_data_t));
+    memcpy(&gc_state.modal, &block->modal, sizeof(gc_modal_t));
+    gc_state.feed_rate = block->feed_rate;
+    gc_state.line_number = plan_data.line_number;
+
+    switch(gc_state.modal.motion) {
+
+        case MotionMode_Linear:
+            if(gc_state.modal.feed_mode == FeedMode_UnitsPerRev)
+                plan_data.condition.spindle.synchronized = On;
+            mc_line(block->target, &plan_data);
+            break;
+
+        case MotionMode_Seek:
+            plan_data.condition.rapid_motion = On;
+#ifdef ENABLE_DOGLEG_RAPIDS
+            mc_rapid(block->target, &plan_data, gc_state.position);
+#else
+            mc_line(block->target, &plan_data);
+#endif
+            break;
+
+        case MotionMode_CwArc:
+        case MotionMode_CcwArc:
+            mc_arc(block->target, &plan_data, gc_state.position, block->ijk, block->r,
+                    *gc_get_plane_data(&plane, gc_state.modal.plane_select), gc_state.modal.motion == MotionMode_CwArc);
+            break;
+
+        default:
+            break;
+    }
+
+    if(!sys.cancel)
+        memcpy(gc_state.position, block->target, sizeof(gc_state.position));
+}
+
+#endif
@@ -82,6 +82,14 @@ typedef enum {
     Status_ValueWordConflict = 48,
 
     Status_EStop = 50,
+    Status_BlockChecksumError = 51,
+    Status_FlowControlSyntaxError = 52,
+    Status_FlowControlOutOfMemory = 53,
+    Status_ExpressionSyntaxError = 54,
+    Status_ExpressionDivisionByZero = 55,
+    Status_ExpressionArgumentOutOfRange = 56,
+    Status_ExpressionInvalidParameter = 57,
+    Status_StreamDecodeError = 58,
     Status_Unhandled = 59, // For internal use only
 
 // Some error codes as defined in bdring's ESP32 port
@@ -250,7 +258,10 @@ typedef enum {
 //#define CUTTER_COMP_DISABLE 0 // G40 (Default: Must be zero)
 
 // Modal Group G13: Control mode
-//#define CONTROL_MODE_EXACT_PATH 0 // G61 (Default: Must be zero)
+typedef enum {
+    ControlMode_ExactPath = 0,  // G61 (Default: Must be zero)
+    ControlMode_Continuous = 1  // G64 (Do not alter value)
+} control_mode_t;
 
 // Modal Group G8: Tool length offset
 typedef enum {
@@ -424,7 +435,12 @@ typedef struct {
     // uint8_t cutter_comp;              // {G40} NOTE: Don't track. Only default supported.
     tool_offset_mode_t tool_offset_mode; // {G43,G43.1,G49}
     coord_system_t coord_system;         // {G54,G55,G56,G57,G58,G59,G59.1,G59.2,G59.3}
+#ifdef ENABLE_PATH_BLENDING
+    control_mode_t control;              // {G61,G64}
+    float path_tolerance;                // {G64} P value, in mm
+#else
     // uint8_t control;                  // {G61} NOTE: Don't track. Only default supported.
+#endif
     program_flow_t program_flow;         // {M0,M1,M2,M30,M60}
     coolant_state_t coolant;             // {M7,M8,M9}
     spindle_state_t spindle;             // {M3,M4,M5}
@@ -515,6 +531,7 @@ typedef struct {
     spindle_t spindle;                  // RPM
     float feed_rate;                    // Millimeters/min
     float distance_per_rev;             // Millimeters/rev
+
     float position[N_AXIS];             // Where the interpreter considers the tool to be at this point in the code
     int32_t line_number;                // Last line number sent
     uint32_t tool_pending;              // Tool to be selected on next M6
@@ -536,11 +553,21 @@ typedef struct {
     float ijk[N_AXIS]; // Scaling factors
 } scale_factor_t;
 
-extern parser_state_t gc_state;
+extern THREAD_LOCAL parser_state_t gc_state;
 #ifdef N_TOOLS
-extern tool_data_t tool_table[N_TOOLS + 1];
+#ifdef TOOL_TABLE_CACHE
+tool_data_t *gc_get_tool (uint32_t tool);
+#else
+extern THREAD_LOCAL tool_data_t tool_table[N_TOOLS + 1];
+
+// Returns the tool table entry for the tool, entry 0 is for tools not in the tool table.
+static inline tool_data_t *gc_get_tool (uint32_t tool)
+{
+    return &tool_table[tool];
+}
+#endif
 #else
-extern tool_data_t tool_table;
+extern THREAD_LOCAL tool_data_t tool_table;
 #endif
 
 typedef struct {
@@ -559,6 +586,16 @@ void gc_init(bool cold_start);
 // Execute one block of rs275/ngc/g-code
 status_code_t gc_execute_block(char *block, char *message);
 
+#ifdef ENABLE_HEIGHTMAP
+
+#include "heightmap.h"
+
+// The parser position is uncompensated, the height map offset is removed from the machine position.
+#define gc_sync_position() (system_convert_array_steps_to_mpos (gc_state.position, sys_position), heightmap_uncompensate(gc_state.position))
+#define sync_position() plan_sync_position(); gc_sync_position()
+
+#else
+
 // Sets g-code parser position in mm. Input in steps. Called by the system abort and hard
 // limit pull-off routines.
 #define gc_sync_position() system_convert_array_steps_to_mpos (gc_state.position, sys_position)
@@ -566,6 +603,8 @@ status_code_t gc_execute_block(char *block, char *message);
 // Sets g-code parser and planner position in mm.
 #define sync_position() plan_sync_position(); system_convert_array_steps_to_mpos (gc_state.position, sys_position)
 
+#endif
+
 // Set dynamic laser power mode to PPI (Pulses Per Inch)
 // Driver support for pulsing the laser on signal is required for this to work.
 // Returns true if driver uses hardware implementation.
@@ -581,4 +620,52 @@ float gc_get_offset (uint_fast8_t idx);
 void gc_set_tool_offset (tool_offset_mode_t mode, uint_fast8_t idx, int32_t offset);
 plane_t *gc_get_plane_data (plane_t *plane, plane_select_t select);
 
+#ifdef GC_QUEUED_STATE
+// Executes state changes not yet queued with a motion.
+void gc_flush_queued_state (void);
+#endif
+
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+#ifndef WCO_QUEUE_SIZE
+#define WCO_QUEUE_SIZE 8 // Number of entries in the queue of work coordinate offset changes, one less may be queued.
+#endif
+// Returns the work coordinate offset in effect for the motion executing.
+float gc_get_reported_offset (uint_fast8_t idx);
+// Called by the stepper driver when a motion queued with a work coordinate offset change is started.
+void gc_wco_change_started (void);
+#endif
+
+// Allocation of output commands and messages passed to the planner, see ENABLE_ALLOC_POOLS in config.h.
+output_command_t *gc_output_command_alloc (void);
+void gc_output_command_free (output_command_t *cmd);
+char *gc_message_alloc (uint_fast16_t size);
+void gc_message_free (char *message);
+#ifdef ENABLE_ALLOC_POOLS
+uint32_t gc_pool_exhausted_count (void);
+#endif
+#ifdef ENABLE_MEMORY_REPORT
+uint32_t gc_get_memory (void);
+#endif
+
+#ifdef ENABLE_BLOCK_REPLAY
+
+#include "planner.h"
+
+// Parsed and validated motion block, see ENABLE_BLOCK_REPLAY in config.h.
+// NOTE: pl_data.message and pl_data.output_commands are always NULL.
+typedef struct {
+    gc_modal_t modal;           // Modal state after the block has been executed, modal.motion is G0, G1, G2 or G3.
+    float feed_rate;            // Parser feed rate after the block has been executed.
+    float target[N_AXIS];       // Target position in machine coordinates.
+    float ijk[3];               // Arc center offsets from the start position.
+    float r;                    // Arc radius.
+    plan_line_data_t pl_data;   // Planner data before any motion mode specific conditions are added.
+} gc_replay_block_t;
+
+// Execute a block previously passed to grbl.on_replayable_block.
+// NOTE: The caller must ensure the parser state is the same as when the block was recorded.
+void gc_replay_block (gc_replay_block_t *block);
+
+#endif
+
 #endif
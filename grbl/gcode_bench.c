@@ -0,0 +1,384 @@
+/*
+  gcode_bench.c - g-code parser line rate benchmark
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_PARSER_BENCHMARK
+
+#include <math.h>
+#include <string.h>
+
+#include "gcode_bench.h"
+#include "protocol.h"
+#include "state_machine.h"
+
+#define SURFACING_ROW_POINTS 200    // Points per surfacing row
+#define SURFACING_STEP 0.5f         // Surfacing grid spacing (mm)
+#define RASTER_ROW_PIXELS 400       // Pixels per raster row
+#define RASTER_PIXEL 0.1f           // Raster pixel size (mm)
+#define ENGRAVING_GLYPH_LINES 16    // Lines per engraved glyph
+
+static const char *corpus_name[GcBenchCorpus_N] = { "SURFACING", "RASTER", "ENGRAVING" };
+static const char *class_name[GcBench_Classes] = { "COMMENT", "ARC", "MULTIAXIS", "LINEAR", "MCODE", "OTHER" };
+
+void gc_bench_init (gc_bench_t *bench)
+{
+    memset(bench, 0, sizeof(gc_bench_t));
+    bench->get_cycles = hal.get_cycle_count;
+}
+
+// Strips whitespace, control characters and comments and converts to upper case, as protocol_main_loop() does.
+// Returns true if the line had a comment. Message comments are stripped as well, block delete is not handled.
+static bool filter_line (const char *block, char *line)
+{
+    char c;
+    bool comment = false, parentheses = false;
+    uint_fast16_t char_counter = 0;
+
+    while((c = *block++) != '\0' && c != '\n' && c != '\r') {
+        if(parentheses) {
+            if(c == ')')
+                parentheses = false;
+        } else if(c == '(')
+            comment = parentheses = true;
+        else if(c == ';') {
+            comment = true;
+            break;
+        } else if(c > ' ' && char_counter < LINE_BUFFER_SIZE - 1)
+            line[char_counter++] = CAPS(c);
+    }
+
+    line[char_counter] = '\0';
+
+    return comment;
+}
+
+static gc_bench_class_t classify_line (const char *line)
+{
+    char c;
+    const char *s = line;
+    uint_fast8_t idx, axis_words = 0;
+
+    if(*line == '\0')
+        return GcBench_Comment;
+
+    while((c = *s++)) {
+        if(c >= 'A' && c <= 'Z') for(idx = 0; idx < N_AXIS; idx++) {
+            if(c == *axis_letter[idx]) {
+                axis_words++;
+                break;
+            }
+        }
+    }
+
+    if(axis_words)
+        return gc_state.modal.motion == MotionMode_CwArc || gc_state.modal.motion == MotionMode_CcwArc
+                ? GcBench_Arc
+                : (axis_words >= 3 ? GcBench_MultiAxis : GcBench_Linear);
+
+    return strchr(line, 'M') ? GcBench_MCode : GcBench_Other;
+}
+
+static inline void stats_add (gc_bench_stats_t *stats, uint32_t cycles)
+{
+    stats->lines++;
+    stats->cycles += cycles;
+    if(cycles > stats->max)
+        stats->max = cycles;
+}
+
+status_code_t gc_bench_line (gc_bench_t *bench, const char *block)
+{
+    char line[LINE_BUFFER_SIZE];
+    status_code_t status = Status_OK;
+    uint32_t cycles = bench->get_cycles ? bench->get_cycles() : 0;
+
+    filter_line(block, line);
+
+    if(*line != '\0')
+        status = gc_execute_block(line, NULL);
+
+    if(bench->get_cycles)
+        cycles = bench->get_cycles() - cycles;
+
+    stats_add(&bench->total, cycles);
+    stats_add(&bench->line[classify_line(line)], cycles);
+
+    if(status != Status_OK) {
+        bench->errors++;
+        gc_state.last_error = Status_OK;
+    }
+
+    return status;
+}
+
+// Corpus generators, each line is computed from its number only.
+
+static char *append (char *s, const char *word)
+{
+    while(*word)
+        *s++ = *word++;
+    *s = '\0';
+
+    return s;
+}
+
+static char *append_word (char *s, char letter, float value, uint8_t decimal_places)
+{
+    *s++ = letter;
+
+    return ftoa_append(s, value, decimal_places);
+}
+
+// Pseudo random pixel intensity.
+static inline uint32_t intensity (uint32_t n)
+{
+    return ((n * 1103515245UL + 12345UL) >> 16) & 0xFF;
+}
+
+static void surfacing_line (uint32_t n, char *s)
+{
+    uint32_t row = n / (SURFACING_ROW_POINTS + 1), point = n % (SURFACING_ROW_POINTS + 1);
+
+    if(n == 0) {
+        append(s, "G21G90G94G17M3S12000");
+        return;
+    }
+
+    if(point == 0) {
+        s = append(s, "(ROW ");
+        s = append(s, uitoa(row));
+        append(s, ")");
+        return;
+    }
+
+    float x = (float)((row & 1) ? SURFACING_ROW_POINTS - point : point - 1) * SURFACING_STEP;
+    float y = (float)row * SURFACING_STEP;
+
+    s = append(s, "G1");
+    s = append_word(s, 'X', x, 3);
+    s = append_word(s, 'Y', y, 3);
+    s = append_word(s, 'Z', -1.0f + 0.5f * sinf(x * 0.1f) * cosf(y * 0.1f), 4);
+#if N_AXIS > 3
+    s = append_word(s, 'A', x * 0.9f, 3);
+#endif
+    if(point == 1)
+        append(s, "F1500");
+}
+
+static void raster_line (uint32_t n, char *s)
+{
+    uint32_t row = n / (RASTER_ROW_PIXELS + 2), pixel = n % (RASTER_ROW_PIXELS + 2);
+
+    if(n == 0) {
+        append(s, "G21G90M4S0");
+        return;
+    }
+
+    switch(pixel) {
+
+        case 0:
+            s = append(s, "G0");
+            s = append_word(s, 'X', 0.0f, 1);
+            append_word(s, 'Y', (float)row * RASTER_PIXEL, 2);
+            break;
+
+        case 1:
+            append(s, "G1F6000");
+            break;
+
+        default:
+            s = append_word(s, 'X', (float)(pixel - 1) * RASTER_PIXEL, 2);
+            s = append(s, "S");
+            append(s, uitoa(intensity(n)));
+            break;
+    }
+}
+
+static void engraving_line (uint32_t n, char *s)
+{
+    uint32_t glyph = n / ENGRAVING_GLYPH_LINES, k = n % ENGRAVING_GLYPH_LINES;
+    float cx = (float)(glyph % 20) * 5.0f + 2.0f, cy = (float)((glyph / 20) % 20) * 5.0f + 2.0f;
+
+    if(n == 0) {
+        append(s, "G21G90G17M3S18000");
+        return;
+    }
+
+    switch(k) {
+
+        case 0:
+            s = append(s, "; glyph ");
+            append(s, uitoa(glyph));
+            break;
+
+        case 1:
+            append(s, "G0 Z1.");
+            break;
+
+        case 2:
+            s = append(s, "G0 ");
+            s = append_word(s, 'X', cx + 1.0f, 4);
+            *s++ = ' ';
+            append_word(s, 'Y', cy, 4);
+            break;
+
+        case 3:
+            append(s, "G1 Z-0.1 F300 (plunge)");
+            break;
+
+        case 12:
+        case 13:
+        case 14:
+            s = append(s, "G1 ");
+            s = append_word(s, 'X', cx + 0.25f * (float)(k - 12), 4);
+            *s++ = ' ';
+            append_word(s, 'Y', cy + ((k & 1) ? 0.5f : -0.5f), 4);
+            break;
+
+        case 15:
+            append(s, (glyph & 1) ? "M3 S18000" : "M5");
+            break;
+
+        default: { // CCW full circle of 8 arcs around the glyph center.
+            float a0 = (float)(k - 4) * M_PI / 4.0f, a1 = (float)(k - 3) * M_PI / 4.0f;
+            s = append(s, k == 4 ? "G3 " : "");
+            s = append_word(s, 'X', cx + cosf(a1), 4);
+            *s++ = ' ';
+            s = append_word(s, 'Y', cy + sinf(a1), 4);
+            *s++ = ' ';
+            s = append_word(s, 'I', -cosf(a0), 4);
+            *s++ = ' ';
+            s = append_word(s, 'J', -sinf(a0), 4);
+            if(k == 4)
+                append(s, " F600");
+            } break;
+    }
+}
+
+void gc_bench_corpus_line (gc_bench_corpus_t corpus, uint32_t n, char *line)
+{
+    *line = '\0';
+
+    switch(corpus) {
+
+        case GcBenchCorpus_Surfacing:
+            surfacing_line(n, line);
+            break;
+
+        case GcBenchCorpus_Raster:
+            raster_line(n, line);
+            break;
+
+        case GcBenchCorpus_Engraving:
+            engraving_line(n, line);
+            break;
+
+        default:
+            break;
+    }
+}
+
+const char *gc_bench_corpus_name (gc_bench_corpus_t corpus)
+{
+    return corpus < GcBenchCorpus_N ? corpus_name[corpus] : "?";
+}
+
+const char *gc_bench_class_name (gc_bench_class_t line_class)
+{
+    return line_class < GcBench_Classes ? class_name[line_class] : "?";
+}
+
+static void report_stats (const char *name, const char *line_class, gc_bench_stats_t *stats)
+{
+    hal.stream.write("[PBENCH:");
+    hal.stream.write(name);
+    if(line_class) {
+        hal.stream.write(":");
+        hal.stream.write(line_class);
+    }
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->lines));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->lines ? (uint32_t)(stats->cycles / stats->lines) : 0));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->max));
+}
+
+// Outputs [PBENCH:<name>,<lines>,<avg cycles>,<max cycles>,<lines/s>,<errors>] followed by
+// [PBENCH:<name>:<class>,<lines>,<avg cycles>,<max cycles>] for each line class present.
+void gc_bench_report (const char *name, gc_bench_t *bench, uint32_t ms)
+{
+    uint_fast8_t idx;
+
+    report_stats(name, NULL, &bench->total);
+    hal.stream.write(",");
+    hal.stream.write(uitoa(ms ? (uint32_t)((uint64_t)bench->total.lines * 1000 / ms) : 0));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(bench->errors));
+    hal.stream.write("]" ASCII_EOL);
+
+    for(idx = 0; idx < GcBench_Classes; idx++) {
+        if(bench->line[idx].lines) {
+            report_stats(name, class_name[idx], &bench->line[idx]);
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+}
+
+status_code_t gc_bench_run (uint32_t lines)
+{
+    static THREAD_LOCAL parser_state_t saved_gc_state;
+
+    char line[LINE_BUFFER_SIZE];
+    uint32_t n, ms;
+    gc_bench_t bench;
+    gc_bench_corpus_t corpus;
+
+    if(sys.state != STATE_IDLE)
+        return Status_IdleError;
+
+    if(lines == 0)
+        lines = PARSER_BENCHMARK_LINES;
+
+    memcpy(&saved_gc_state, &gc_state, sizeof(parser_state_t));
+    set_state(STATE_CHECK_MODE);
+
+    for(corpus = GcBenchCorpus_Surfacing; corpus < GcBenchCorpus_N; corpus++) {
+
+        gc_bench_init(&bench);
+        ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+
+        for(n = 0; n < lines && !sys.abort; n++) {
+            gc_bench_corpus_line(corpus, n, line);
+            gc_bench_line(&bench, line);
+        }
+
+        ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() - ms : 0;
+
+        gc_bench_report(corpus_name[corpus], &bench, ms);
+    }
+
+    memcpy(&gc_state, &saved_gc_state, sizeof(parser_state_t));
+    set_state(STATE_IDLE);
+
+    return Status_OK;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+  gcode_bench.h - g-code parser line rate benchmark
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GCODE_BENCH_H_
+#define _GCODE_BENCH_H_
+
+#include "gcode.h"
+
+#ifndef PARSER_BENCHMARK_LINES
+#define PARSER_BENCHMARK_LINES 5000 // Default number of lines per corpus run by $PBENCH.
+#endif
+
+// Line classes, a line is counted in the first class it matches.
+typedef enum {
+    GcBench_Comment = 0,    // Comment only or blank line
+    GcBench_Arc,            // Arc motion, G2/G3 with axis words
+    GcBench_MultiAxis,      // Linear motion with three or more axis words
+    GcBench_Linear,         // Linear motion with one or two axis words
+    GcBench_MCode,          // Block with M-code(s) and no axis words
+    GcBench_Other,          // Any other block, e.g. modal G-codes or feed rate only
+    GcBench_Classes
+} gc_bench_class_t;
+
+// Generated corpora.
+typedef enum {
+    GcBenchCorpus_Surfacing = 0,    // 3D surfacing, dense three axis G1 moves
+    GcBenchCorpus_Raster,           // Laser raster, modal X moves with S word per pixel
+    GcBenchCorpus_Engraving,        // High density engraving, short arcs and lines with comments
+    GcBenchCorpus_N
+} gc_bench_corpus_t;
+
+typedef struct {
+    uint32_t lines;
+    uint32_t max;       // Max cycles per line
+    uint64_t cycles;    // Total cycles
+} gc_bench_stats_t;
+
+typedef struct {
+    uint32_t (*get_cycles)(void);   // Cycle counter, hal.get_cycle_count() by default. Cycles are not counted if NULL.
+    uint32_t errors;                // Number of lines failing with an error.
+    gc_bench_stats_t total;
+    gc_bench_stats_t line[GcBench_Classes];
+} gc_bench_t;
+
+// Clears the statistics.
+void gc_bench_init (gc_bench_t *bench);
+
+// Filters the block as protocol_main_loop() does and executes it with gc_execute_block().
+// The parser must be in check mode so that no motion is queued.
+status_code_t gc_bench_line (gc_bench_t *bench, const char *block);
+
+// Generates line n of a corpus to line, a buffer of LINE_BUFFER_SIZE chars.
+void gc_bench_corpus_line (gc_bench_corpus_t corpus, uint32_t n, char *line);
+
+// Returns the name of a corpus.
+const char *gc_bench_corpus_name (gc_bench_corpus_t corpus);
+
+// Returns the name of a line class.
+const char *gc_bench_class_name (gc_bench_class_t line_class);
+
+// Outputs the statistics, ms is the elapsed time used for computing lines per second.
+void gc_bench_report (const char *name, gc_bench_t *bench, uint32_t ms);
+
+// Runs lines of each corpus in check mode and outputs the statistics, the parser state is restored
+// afterwards. Executed by the $PBENCH[=<lines>] system command, must be called in idle state.
+status_code_t gc_bench_run (uint32_t lines);
+
+#endif
@@ -48,6 +48,16 @@
 #define ISR_CODE
 #endif
 
+// Used to decorate core state, i.e. global and static variables that are not constant.
+// When GRBL_REENTRANT is defined the state is thread local, each thread running the core has its own instance.
+// This is for simulator builds running several machines in one process, the core and all its interrupt handlers
+// must then be run by the same thread. Do not define for microcontroller builds.
+#ifdef GRBL_REENTRANT
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL
+#endif
+
 #ifndef N_AXIS
 #define N_AXIS 3 // Number of axes
 #endif
@@ -56,10 +66,51 @@
 #define COMPATIBILITY_LEVEL 0
 #endif
 
-#if (defined(COREXY) || defined(WALL_PLOTTER) || defined(MASLOW_ROUTER)) && !defined(KINEMATICS_API)
+#if (defined(COREXY) || defined(WALL_PLOTTER) || defined(MASLOW_ROUTER) || defined(LINEAR_DELTA)) && !defined(KINEMATICS_API)
 #define KINEMATICS_API
 #endif
 
+#if defined(KINEMATICS_API)
+#undef ENABLE_PATH_MERGING
+#undef ENABLE_PATH_BLENDING
+#undef ENABLE_ARC_BLOCKS
+#undef ENABLE_DOGLEG_RAPIDS
+#endif
+
+#if defined(ENABLE_PATH_MERGING) || defined(ENABLE_PATH_BLENDING)
+#define PLANNER_HOLD_LINE // Planner holds back the last line for merging or blending with the next line.
+#endif
+
+#if defined(ENABLE_QUEUED_SPINDLE_COOLANT) || defined(ENABLE_QUEUED_WCO_CHANGE)
+#define GC_QUEUED_STATE // Parser state changes are queued with the next motion, see gc_flush_queued_state().
+#endif
+
+#if defined(ENABLE_INPUT_SHAPING) && defined(ENABLE_JERK_ACCELERATION)
+#error "Input shaping cannot be combined with jerk limited acceleration!"
+#endif
+
+#if defined(ENABLE_FAR_LOOKAHEAD) && !defined(ENABLE_PARSE_AHEAD)
+#error "Far lookahead requires the parse-ahead queue, enable ENABLE_PARSE_AHEAD!"
+#endif
+
+#if defined(ENABLE_FAR_LOOKAHEAD) && defined(PLANNER_HOLD_LINE)
+#error "Far lookahead cannot be combined with path merging or blending!"
+#endif
+
+#if defined(ENABLE_HEIGHTMAP) && defined(KINEMATICS_API)
+#error "Height map compensation cannot be combined with non-cartesian kinematics!"
+#endif
+
+#if defined(ENABLE_RX_FILTER) && defined(ENABLE_STREAM_COMPRESSION)
+#error "Input filtering cannot be combined with compressed input!"
+#endif
+
+#if defined(ENABLE_NVS_CHECKPOINT) && defined(BUFFER_NVSDATA_DISABLE)
+#error "Power loss checkpoints require the NVS buffer, do not define BUFFER_NVSDATA_DISABLE!"
+#endif
+
+
+
 #ifndef CHECK_MODE_DELAY
 #define CHECK_MODE_DELAY 0 // ms
 #endif
@@ -215,7 +266,16 @@
 // frequencies below 10kHz, where the aliasing between axes of multi-axis motions can cause audible
 // noise and shake your machine. At even lower step frequencies, AMASS adapts and provides even better
 // step smoothing. See stepper.c for more details on the AMASS system works.
+// NOTE: AMASS is disabled when STEP_PHASE_SMOOTHING is enabled in config.h.
+#ifndef STEP_PHASE_SMOOTHING
 #define ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING  // Default enabled. Comment to disable.
+#endif
+
+// Use fixed point step rate computation in segment preparation for processors without a hardware FPU.
+#if !defined(SEGMENT_PREP_FIXED_POINT) && ((defined(__arm__) && !defined(__ARM_FP)) || defined(__MSP430__))
+#define SEGMENT_PREP_FIXED_POINT
+#endif
+
 
 // Define Adaptive Multi-Axis Step-Smoothing(AMASS) levels and cutoff frequencies. The highest level
 // frequency bin starts at 0Hz and ends at its cutoff frequency. The next lower level frequency bin
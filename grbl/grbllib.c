@@ -23,6 +23,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <assert.h>
 
 #include "hal.h"
@@ -31,9 +32,19 @@
 #include "override.h"
 #include "protocol.h"
 #include "limits.h"
+#include "motion_control.h"
 #include "report.h"
 #include "state_machine.h"
 #include "nvs_buffer.h"
+#include "profile.h"
+#include "flightrec.h"
+#include "linetime.h"
+#include "scheduler.h"
+#include "heightmap.h"
+#include "pvt.h"
+#include "raster.h"
+#include "settings_profiles.h"
+#include "checkpoint.h"
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -46,18 +57,24 @@
 #include "wall_plotter.h"
 #endif
 
+#ifdef LINEAR_DELTA
+#include "delta.h"
+#endif
+
 // Declare system global variable structure
-system_t sys;
-int32_t sys_position[N_AXIS];               // Real-time machine (aka home) position vector in steps.
-int32_t sys_probe_position[N_AXIS];         // Last probe position in machine coordinates and steps.
-bool prior_mpg_mode;                        // Enter MPG mode on startup?
-bool cold_start = true;
-volatile probing_state_t sys_probing_state; // Probing state value. Used to coordinate the probing cycle with stepper ISR.
-volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
-volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtime executor bitflag variable for setting various alarms.
-
-grbl_t grbl;
-grbl_hal_t hal;
+THREAD_LOCAL system_t sys;
+THREAD_LOCAL int32_t sys_position[N_AXIS];               // Real-time machine (aka home) position vector in steps.
+THREAD_LOCAL int32_t sys_probe_position[N_AXIS];         // Last probe position in machine coordinates and steps.
+THREAD_LOCAL volatile uint32_t sys_position_seq = 0;     // Sequence counter for sys_position, odd while the stepper ISR is updating it.
+THREAD_LOCAL bool prior_mpg_mode;                        // Enter MPG mode on startup?
+THREAD_LOCAL bool cold_start = true;
+THREAD_LOCAL volatile probing_state_t sys_probing_state; // Probing state value. Used to coordinate the probing cycle with stepper ISR.
+THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
+THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtime executor bitflag variable for setting various alarms.
+THREAD_LOCAL volatile bool sys_rt_exec_pending;          // Set when any realtime event is pending.
+
+THREAD_LOCAL grbl_t grbl;
+THREAD_LOCAL grbl_hal_t hal;
 
 // called from stream drivers while tx is blocking, return false to terminate
 
@@ -69,12 +86,12 @@ static bool stream_tx_blocking (void)
 
 #ifdef KINEMATICS_API
 
-kinematics_t kinematics;
+THREAD_LOCAL kinematics_t kinematics;
 
 // called from mc_line() to segment lines if not overridden, default implementation for pass-through
 static bool kinematics_segment_line (float *target, plan_line_data_t *pl_data, bool init)
 {
-    static uint_fast8_t iterations;
+    static THREAD_LOCAL uint_fast8_t iterations;
 
     if(init)
         iterations = 2;
@@ -84,6 +101,132 @@ static bool kinematics_segment_line (float *target, plan_line_data_t *pl_data, b
     return iterations != 0;
 }
 
+#ifndef KINEMATICS_SEGMENT_MAX_LENGTH
+#define KINEMATICS_SEGMENT_MAX_LENGTH 25.0f // mm
+#endif
+#define KINEMATICS_SEGMENT_MIN_LENGTH 0.01f // mm
+#define KINEMATICS_SEGMENT_MAX_TRIES 8
+
+static THREAD_LOCAL struct {
+    bool segmented;
+    bool done;
+    float length;           // Line length, mm
+    float distance;         // Distance completed, mm
+    float segment_length;   // Length of last segment, mm
+    float start[N_AXIS];
+    float end[N_AXIS];
+    float unit_vec[N_AXIS];
+    int32_t start_steps[N_AXIS]; // Joint position of last segment end point, steps
+} seg;
+
+// Max deviation in joint space of the transformed segment midpoint from the midpoint of the transformed
+// end points, relative to the tolerance. A value > 1.0 means the segment is out of tolerance.
+static float segment_error (float *end, int32_t *end_steps, float length)
+{
+    uint_fast8_t idx = N_AXIS;
+    int32_t mid_steps[N_AXIS];
+    float mid[N_AXIS], error = 0.0f;
+
+    do {
+        idx--;
+        mid[idx] = end[idx] - seg.unit_vec[idx] * length * 0.5f;
+    } while(idx);
+
+    kinematics.plan_target_to_steps(mid_steps, mid);
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        error = max(error, fabsf((float)mid_steps[idx] - ((float)seg.start_steps[idx] + (float)end_steps[idx]) * 0.5f) * derived_settings.inv_arc_tolerance_steps[idx]);
+    } while(idx);
+
+    return error;
+}
+
+/* Adaptive line segmentation for non-linear kinematics, may be assigned to kinematics.segment_line.
+   Rather than splitting lines at a fixed length, each segment is made as long as possible while the joint
+   space position of its transformed midpoint deviates less than the arc tolerance ($12) from the linear
+   interpolation between the transformed end points, which is what the stepper executes.
+   Since the error grows with the square of the segment length the next length is estimated from the error
+   of the last attempt, and is allowed to grow for the next segment. This results in long segments where the
+   kinematics are close to linear and short ones where the curvature is high.
+   NOTE: The segment length is limited to KINEMATICS_SEGMENT_MAX_LENGTH since a midpoint check may miss
+         deviations over long distances. Rapid and jog motions are not segmented. */
+bool kinematics_segment_line_adaptive (float *target, plan_line_data_t *pl_data, bool init)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(init) {
+
+        seg.length = 0.0f;
+
+        do {
+            idx--;
+            seg.start[idx] = gc_state.position[idx];
+            seg.end[idx] = target[idx];
+            seg.unit_vec[idx] = target[idx] - gc_state.position[idx];
+        } while(idx);
+
+        seg.segmented = !(pl_data->condition.rapid_motion || pl_data->condition.jog_motion) &&
+                         !(seg.unit_vec[X_AXIS] == 0.0f && seg.unit_vec[Y_AXIS] == 0.0f) &&
+                          (seg.length = convert_delta_vector_to_unit_vector(seg.unit_vec)) > KINEMATICS_SEGMENT_MIN_LENGTH;
+
+        if(seg.segmented) {
+            seg.distance = 0.0f;
+            seg.segment_length = KINEMATICS_SEGMENT_MAX_LENGTH;
+            kinematics.plan_target_to_steps(seg.start_steps, seg.start);
+        }
+
+        seg.done = false;
+
+    } else if(!seg.segmented) {
+        // target is left unchanged, return true the first time only.
+        if(seg.done)
+            return false;
+        seg.done = true;
+
+    } else {
+
+        if(seg.done)
+            return false;
+
+        uint_fast8_t tries = KINEMATICS_SEGMENT_MAX_TRIES;
+        int32_t end_steps[N_AXIS];
+        float end[N_AXIS], error, remaining = seg.length - seg.distance;
+        float length = min(seg.segment_length * 2.0f, KINEMATICS_SEGMENT_MAX_LENGTH);
+
+        do {
+
+            if((seg.done = length >= remaining - KINEMATICS_SEGMENT_MIN_LENGTH)) {
+                length = remaining;
+                memcpy(end, seg.end, sizeof(end)); // Use exact end point for the last segment.
+            } else {
+                idx = N_AXIS;
+                do {
+                    idx--;
+                    end[idx] = seg.start[idx] + seg.unit_vec[idx] * (seg.distance + length);
+                } while(idx);
+            }
+
+            kinematics.plan_target_to_steps(end_steps, end);
+
+            if((error = segment_error(end, end_steps, length)) <= 1.0f || length <= KINEMATICS_SEGMENT_MIN_LENGTH || --tries == 0)
+                break;
+
+            // Error is proportional to the square of the length, aim for 80% of the tolerance.
+            length = max(length * sqrtf(0.8f / error), KINEMATICS_SEGMENT_MIN_LENGTH);
+
+        } while(true);
+
+        memcpy(target, end, sizeof(end));
+        seg.distance += length;
+        seg.segment_length = length;
+        memcpy(seg.start_steps, end_steps, sizeof(end_steps));
+    }
+
+    return true;
+}
+
 #endif
 
 #ifdef DEBUGOUT
@@ -93,11 +236,51 @@ static void debug_out (bool on)
 }
 #endif
 
+#ifdef REPORT_BOOT_TIMING
+
+// Boot phase times in milliseconds from when driver_init() has completed.
+static THREAD_LOCAL struct {
+    uint32_t start;
+    uint32_t settings;
+    uint32_t setup;
+    uint32_t ready;
+} boot;
+
+static inline uint32_t boot_time (void)
+{
+    return hal.get_elapsed_ticks ? hal.get_elapsed_ticks() - boot.start : 0;
+}
+
+#endif
+
+// Run initialization deferred by drivers and plugins until the controller is ready to accept commands.
+// Executed once from the foreground process on the first pass of the main loop after power up.
+static void deferred_init (uint_fast16_t state)
+{
+    if(grbl.on_deferred_init) {
+        grbl.on_deferred_init();
+        grbl.on_deferred_init = NULL;
+    }
+
+#ifdef REPORT_BOOT_TIMING
+    uint32_t deferred = boot_time();
+    hal.stream.write_all("[BOOT:SETTINGS:");
+    hal.stream.write_all(uitoa(boot.settings));
+    hal.stream.write_all("|SETUP:");
+    hal.stream.write_all(uitoa(boot.setup));
+    hal.stream.write_all("|READY:");
+    hal.stream.write_all(uitoa(boot.ready));
+    hal.stream.write_all("|DEFERRED:");
+    hal.stream.write_all(uitoa(deferred));
+    hal.stream.write_all("]" ASCII_EOL);
+#endif
+}
+
 // main entry point
 
 int grbl_enter (void)
 {
-#ifdef N_TOOLS
+#ifdef NVS_ADDR_TOOL_TABLE
     assert(NVS_ADDR_GLOBAL + sizeof(settings_t) + NVS_CRC_BYTES < NVS_ADDR_TOOL_TABLE);
 #else
     assert(NVS_ADDR_GLOBAL + sizeof(settings_t) + NVS_CRC_BYTES < NVS_ADDR_PARAMETERS);
@@ -124,6 +307,9 @@ int grbl_enter (void)
     hal.limits.interrupt_callback = limit_interrupt_handler;
     hal.control.interrupt_callback = control_interrupt_handler;
     hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.probe.interrupt_callback = probe_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer;
+
     hal.stream_blocking_callback = stream_tx_blocking;
 
 #ifdef BUFFER_NVSDATA
@@ -143,6 +329,10 @@ int grbl_enter (void)
 #endif
     driver_ok = driver_init();
 
+#ifdef REPORT_BOOT_TIMING
+    boot.start = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+#endif
+
 #if COMPATIBILITY_LEVEL > 0
     hal.stream.suspend_read = NULL;
 #endif
@@ -154,10 +344,25 @@ int grbl_enter (void)
 #endif
 
   #ifdef BUFFER_NVSDATA
+   #ifdef ENABLE_SETTINGS_PROFILES
+    settings_profiles_init(); // Allocates NVS storage, must be called before the buffer is loaded
+   #endif
+   #ifdef ENABLE_NVS_CHECKPOINT
+    checkpoint_init(); // Allocates NVS storage, must be called before the buffer is loaded
+   #endif
     nvs_buffer_init();
   #endif
     settings_init(); // Load Grbl settings from non-volatile storage
 
+#ifdef REPORT_BOOT_TIMING
+    boot.settings = boot_time();
+#endif
+
+    if(!plan_alloc()) { // Allocate planner block buffer
+        hal.stream.write("GrblHAL: not enough heap for planner buffer" ASCII_EOL);
+        while(true);
+    }
+
     memset(sys_position, 0, sizeof(sys_position)); // Clear machine position.
 
 // check and configure driver
@@ -181,6 +386,10 @@ int grbl_enter (void)
 
     driver_ok = driver_ok && hal.driver_setup(&settings);
 
+#ifdef REPORT_BOOT_TIMING
+    boot.setup = boot_time();
+#endif
+
 #ifdef ENABLE_SPINDLE_LINEARIZATION
     driver_ok = driver_ok && hal.driver_cap.spindle_pwm_linearization;
 #endif
@@ -205,6 +414,38 @@ int grbl_enter (void)
     wall_plotter_init();
 #endif
 
+#ifdef LINEAR_DELTA
+    delta_init();
+#endif
+
+#ifdef ENABLE_PROFILING
+    profile_init();
+#endif
+
+#ifdef ENABLE_FLIGHT_RECORDER
+    flightrec_init();
+#endif
+
+#ifdef ENABLE_LINE_TIMING
+    linetime_init();
+#endif
+
+#ifdef ENABLE_SCHEDULER
+    scheduler_init();
+#endif
+
+#ifdef ENABLE_HEIGHTMAP
+    heightmap_init();
+#endif
+
+#ifdef ENABLE_PVT_STREAM
+    pvt_init();
+#endif
+
+#ifdef ENABLE_LASER_RASTER
+    raster_init();
+#endif
+
     // Grbl initialization loop upon power-up or a system abort. For the latter, all processes
     // will return to this loop to be cleanly re-initialized.
     while(looping) {
@@ -238,6 +479,24 @@ int grbl_enter (void)
         hal.limits.enable(settings.limits.flags.hard_enabled, false);
         plan_reset(); // Clear block buffer and planner variables
         st_reset(); // Clear stepper subsystem variables.
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+        mc_cycle_reset(); // Discard any incomplete canned cycle.
+#endif
+#ifdef ENABLE_VELOCITY_JOG
+        mc_jog_velocity_reset(); // Discard any velocity jog.
+#endif
+#ifdef ENABLE_PARSE_AHEAD
+        mc_parse_ahead_reset(); // Discard any queued parsed motions.
+#endif
+#ifdef ENABLE_PVT_STREAM
+        pvt_reset(); // End any trajectory stream.
+#endif
+#ifdef ENABLE_LASER_RASTER
+        raster_reset(); // Discard the current raster row.
+#endif
+#ifdef ENABLE_LINE_TIMING
+        linetime_reset(); // Discard the line being timed.
+#endif
         limits_set_homing_axes(); // Set axes to be homed from settings.
 #ifdef ENABLE_BACKLASH_COMPENSATION
         mc_backlash_init(); // Init backlash configuration.
@@ -262,6 +521,14 @@ int grbl_enter (void)
             hal.stream.enqueue_realtime_command(sys.mpg_mode ? CMD_STATUS_REPORT_ALL : CMD_STATUS_REPORT);
         }
 
+        // Run deferred initialization when the main loop is started after power up.
+        if(cold_start) {
+#ifdef REPORT_BOOT_TIMING
+            boot.ready = boot_time();
+#endif
+            protocol_enqueue_rt_command(deferred_init);
+        }
+
         // Start Grbl main loop. Processes program inputs and executes them.
         if(!(looping = protocol_main_loop(cold_start)))
             looping = hal.driver_release == NULL || hal.driver_release();
@@ -68,7 +68,10 @@ typedef union {
                  probe_connected           :1,
                  atc                       :1,
                  no_gcode_message_handling :1,
-                 unassigned                :4;
+                 step_burst                :2, // 0...3, driver can output up to 2^step_burst step events per stepper interrupt
+                 step_phase                :1, // driver can delay the step pulse of each axis individually by stepper_t.step_delay[]
+                 probe_latch               :1; // driver calls hal.probe.interrupt_callback() from the probe pin edge interrupt
+
     };
 } driver_cap_t;
 
@@ -90,6 +93,10 @@ typedef struct {
     void (*cancel_read_buffer)(void);
     bool (*suspend_read)(bool await);
     enqueue_realtime_command_ptr enqueue_realtime_command; // NOTE: set by grbl at startup.
+    // Optional, copies buffered input up to and including the first end of line character ('\n' or '\r'), but no more
+    // than size characters, to data. Returns the number of characters copied, 0 if no data is available.
+    // Used instead of read() when set, must be cleared when input is suspended and restored together with read().
+    uint16_t (*read_block)(char *data, uint16_t size);
 } io_stream_t;
 
 typedef struct {
@@ -174,6 +181,10 @@ typedef void (*stepper_pulse_start_ptr)(stepper_t *stepper);
 typedef void (*stepper_output_step_ptr)(axes_signals_t step_outbits, axes_signals_t dir_outbits);
 typedef axes_signals_t (*stepper_get_auto_squared_ptr)(void);
 typedef void (*stepper_interrupt_callback_ptr)(void);
+typedef void (*stepper_prep_callback_ptr)(void);
+typedef void (*stepper_prep_request_ptr)(void);
+typedef bool (*stepper_set_microstep_shift_ptr)(uint_fast8_t shift);
+typedef bool (*stepper_load_segment_ptr)(stepper_t *stepper);
 
 typedef struct {
     stepper_wake_up_ptr wake_up;
@@ -183,9 +194,24 @@ typedef struct {
     stepper_cycles_per_tick_ptr cycles_per_tick;
     stepper_pulse_start_ptr pulse_start;
     stepper_interrupt_callback_ptr interrupt_callback; // set up by core before driver_init() is called.
+    stepper_prep_callback_ptr prep_callback;           // set up by core before driver_init() is called.
     // Optional entry points:
     stepper_get_auto_squared_ptr get_auto_squared;
     stepper_output_step_ptr output_step;
+    stepper_prep_request_ptr prep_request; // Called by the stepper ISR when a segment is consumed. Should trigger a low priority
+                                           // interrupt or task, running at lower priority than the stepper ISR but preempting
+                                           // the foreground process, that calls prep_callback() to refill the segment buffer.
+    stepper_set_microstep_shift_ptr set_microstep_shift; // Called from the stepper ISR to divide the microstep resolution of all motors
+                                                         // by 2^shift, 0 restores the configured resolution. Returns false if busy, the
+                                                         // call is then retried on the next interrupt. Used if ENABLE_MICROSTEP_SWITCHING is enabled.
+    uint8_t microstep_shift_max;                         // Max shift accepted by set_microstep_shift().
+    stepper_load_segment_ptr load_segment; // Called from the stepper ISR when a segment is started. Returns true if the driver executes the
+                                           // step_count step events of the segment by itself, using the Bresenham counter[], steps[] and
+                                           // step_event_count values and the tick rate set by cycles_per_tick(). The driver should output
+                                           // dir_outbits first if new_block is set, and call interrupt_callback() when the segment is done.
+                                           // Not called while homing or probing. Per step core features such as step injection, step bursts
+                                           // and ISR backlash compensation are not applied to segments executed by the driver.
+
 } stepper_ptrs_t;
 
 // Driver/plugin settings (optional)
@@ -212,19 +238,25 @@ typedef struct {
 typedef probe_state_t (*probe_get_state_ptr)(void);
 typedef void (*probe_configure_ptr)(bool is_probe_away, bool probing);
 typedef void (*probe_connected_toggle_ptr)(void);
+typedef void (*probe_interrupt_callback_ptr)(void);
 
 typedef struct {
     probe_configure_ptr configure;
     probe_get_state_ptr get_state;
     probe_connected_toggle_ptr connected_toggle;
+    probe_interrupt_callback_ptr interrupt_callback; // set up by core before driver_init() is called.
 } probe_ptrs_t;
 
 typedef void (*tool_select_ptr)(tool_data_t *tool, bool next);
 typedef status_code_t (*tool_change_ptr)(parser_state_t *gc_state);
+typedef bool (*tool_table_read_ptr)(uint32_t tool, tool_data_t *tool_data);
+typedef bool (*tool_table_write_ptr)(tool_data_t *tool_data);
 
 typedef struct {
     tool_select_ptr select;
     tool_change_ptr change;
+    tool_table_read_ptr table_read;     // Optional, reads a tool table entry from storage if TOOL_TABLE_CACHE is enabled.
+    tool_table_write_ptr table_write;   // Optional, writes a tool table entry to storage if TOOL_TABLE_CACHE is enabled.
 } tool_ptrs_t;
 
 // User M-codes (optional)
@@ -241,12 +273,21 @@ typedef struct {
 
 // Encoder (optional)
 
+typedef struct {
+    int32_t position; // counts
+    int32_t velocity; // counts/s, signed
+} encoder_data_t;
+
 typedef void (*encoder_on_event_ptr)(encoder_t *encoder, int32_t position);
 typedef void (*encoder_reset_ptr)(uint_fast8_t id);
+typedef bool (*encoder_get_data_ptr)(uint_fast8_t id, encoder_data_t *data);
 
 typedef struct {
     encoder_on_event_ptr on_event;
     encoder_reset_ptr reset;
+    encoder_get_data_ptr get_data; // Optional, for encoders counted by a hardware quadrature decoder. Returns false if encoder id is not,
+                                   // position change events are then not raised by the driver and encoder consumers poll the count instead.
+                                   // Called from the foreground process, velocity is computed over the time since the previous call.
 } encoder_ptrs_t;
 
 //
@@ -284,6 +325,10 @@ typedef struct {
     bool (*driver_release)(void);
     bool (*get_position)(int32_t (*position)[N_AXIS]);
     uint32_t (*get_elapsed_ticks)(void);
+    uint32_t (*get_cycle_count)(void); // Free running CPU cycle counter, used for execution time statistics.
+    uint32_t f_cycle_count; // Frequency of the hal.get_cycle_count() counter in Hz, 0 if unknown.
+    uint32_t (*get_micros)(void); // Free running microseconds counter, wraps around after about 71 minutes.
+    uint32_t (*get_free_mem)(void); // Optional, returns RAM left for heap and stack in bytes, reported by $MEM.
     void (*pallet_shuttle)(void);
     void (*reboot)(void);
 #ifdef DEBUGOUT
@@ -343,6 +388,7 @@ typedef void (*on_state_change_ptr)(uint_fast16_t state);
 typedef void (*on_probe_completed_ptr)(void);
 typedef void (*on_program_completed_ptr)(program_flow_t program_flow);
 typedef void (*on_execute_realtime_ptr)(uint_fast16_t state);
+typedef void (*on_deferred_init_ptr)(void);
 typedef void (*on_unknown_accessory_override_ptr)(uint8_t cmd);
 typedef void (*on_report_options_ptr)(void);
 typedef void (*on_realtime_report_ptr)(stream_write_ptr stream_write, report_tracking_flags_t report);
@@ -351,6 +397,21 @@ typedef bool (*on_laser_ppi_enable_ptr)(uint_fast16_t ppi, uint_fast16_t pulse_l
 typedef status_code_t (*on_unknown_sys_command_ptr)(uint_fast16_t state, char *line, char *lcline); // return Status_Unhandled.
 typedef status_code_t (*on_user_command_ptr)(char *line);
 
+// Binary telemetry records, forwarded by side channels such as the websocket status push. Not sent to the grbl streams.
+#define TELEMETRY_RECORD_MAX 62 // max record length in bytes
+
+typedef enum {
+    Telemetry_TrinamicLoad = 1
+} telemetry_channel_t;
+
+typedef void (*on_telemetry_ptr)(telemetry_channel_t channel, const void *data, uint_fast8_t length);
+typedef void (*on_block_started_ptr)(plan_block_t *block, float nominal_speed);
+typedef void (*on_block_prepared_ptr)(plan_block_t *block);
+typedef void (*on_report_memory_ptr)(void);
+#ifdef ENABLE_BLOCK_REPLAY
+typedef void (*on_replayable_block_ptr)(gc_replay_block_t *block);
+#endif
+
 typedef struct {
     // report entry points set by core at reset.
     report_t report;
@@ -359,6 +420,7 @@ typedef struct {
     on_probe_completed_ptr on_probe_completed;
     on_program_completed_ptr on_program_completed;
     on_execute_realtime_ptr on_execute_realtime;
+    on_deferred_init_ptr on_deferred_init; // called once from the foreground process after power up when the controller is ready to accept commands.
     on_unknown_accessory_override_ptr on_unknown_accessory_override;
     on_report_options_ptr on_report_options;
     on_realtime_report_ptr on_realtime_report;
@@ -366,12 +428,46 @@ typedef struct {
     on_unknown_sys_command_ptr on_unknown_sys_command; // return Status_Unhandled if not handled.
     on_user_command_ptr on_user_command;
     on_laser_ppi_enable_ptr on_laser_ppi_enable;
+    on_telemetry_ptr on_telemetry; // called from the foreground process, the record must be copied if not sent immediately.
+    on_block_started_ptr on_block_started;   // called by st_prep_buffer() when a planner block is loaded for preparation, ahead of its execution by the motion
+                                             // queued in the segment buffer. nominal_speed is the override adjusted nominal speed of the block (mm/min).
+                                             // NOTE: may be called from interrupt context if the driver provides hal.stepper.prep_request. Not called for system motions.
+    on_block_prepared_ptr on_block_prepared; // called by st_prep_buffer() when all steps of a planner block are queued for execution, before the block is discarded.
+                                             // NOTE: may be called from interrupt context if the driver provides hal.stepper.prep_request. Not called for system motions.
+#ifdef ENABLE_BLOCK_REPLAY
+    on_replayable_block_ptr on_replayable_block; // called after execution of blocks that may be replayed by gc_replay_block().
+#endif
+    on_report_memory_ptr on_report_memory; // called by the $MEM command, subscribers report their buffers with report_memory_usage().
     // core entry points - set up by core before driver_init() is called.
     bool (*protocol_enqueue_gcode)(char *data);
 } grbl_t;
 
-extern grbl_t grbl;
-extern grbl_hal_t hal;
+extern THREAD_LOCAL grbl_t grbl;
+extern THREAD_LOCAL grbl_hal_t hal;
 extern bool driver_init (void);
 
+/* Calls on the hot paths, in the stepper interrupt handler and the protocol loop, are made via these macros.
+   By default these call through the function pointers. With HAL_STATIC_DISPATCH defined the driver provides
+   driver_dispatch.h which may map any of them directly to its functions, possibly static inline, declared
+   there. Functions not mapped by the driver are still called via the pointers. */
+#ifdef HAL_STATIC_DISPATCH
+#include "driver_dispatch.h"
+#endif
+
+#ifndef hal_stepper_pulse_start
+#define hal_stepper_pulse_start(stp) hal.stepper.pulse_start(stp)
+#endif
+#ifndef hal_stepper_cycles_per_tick
+#define hal_stepper_cycles_per_tick(cycles) hal.stepper.cycles_per_tick(cycles)
+#endif
+#ifndef hal_probe_get_state
+#define hal_probe_get_state() hal.probe.get_state()
+#endif
+#ifndef hal_spindle_update_rpm
+#define hal_spindle_update_rpm(rpm) hal.spindle.update_rpm(rpm)
+#endif
+#ifndef hal_stream_read
+#define hal_stream_read() hal.stream.read()
+#endif
+
 #endif
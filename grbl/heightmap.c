@@ -0,0 +1,386 @@
+/*
+  heightmap.c - height map (bed levelling) Z compensation
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_HEIGHTMAP
+
+#include <math.h>
+#include <string.h>
+
+#include "heightmap.h"
+#include "system.h"
+
+#define GRID_EPSILON 1E-4f // Fraction of a cell
+
+/* The map is a grid of nx * ny points in machine coordinates, with the first point at x0, y0 and spaced
+   dx and dy mm apart. The offset applied is the bilinear interpolation of the heights of the grid points
+   surrounding the position, relative to the height of the first point. Outside the grid the height of the
+   nearest edge is used. */
+typedef struct {
+    float x0, y0, dx, dy;
+    uint_fast16_t nx, ny;
+    bool active;
+    float z[HEIGHTMAP_POINTS_MAX]; // Row by row, NAN if not set.
+} heightmap_t;
+
+// Bilinear coefficients of the last cell looked up, valid until the map is changed.
+typedef struct {
+    int_fast16_t i, j;
+    float a, b, c, d;
+} heightmap_cell_t;
+
+typedef struct {
+    float start[N_AXIS];
+    float delta[N_AXIS];
+    float t;            // End of the last segment output, as a fraction of the line
+    float feed_rate;
+    bool done;
+} heightmap_line_t;
+
+static THREAD_LOCAL heightmap_t map = {0};
+static THREAD_LOCAL heightmap_cell_t cell = { .i = -1 };
+static THREAD_LOCAL heightmap_line_t line;
+static THREAD_LOCAL float last[N_AXIS]; // Uncompensated target of the last line.
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+static inline float clampf (float value, float max)
+{
+    return value < 0.0f ? 0.0f : (value > max ? max : value);
+}
+
+// Returns the offset at x, y and in cross the coefficient of the x * y term in mm^-1,
+// which is zero when outside the grid on any of the axes.
+static float get_offset (float x, float y, float *cross)
+{
+    float gx = (x - map.x0) / map.dx, gy = (y - map.y0) / map.dy, u, v;
+    int_fast16_t i, j;
+    bool inside = gx > 0.0f && gx < (float)(map.nx - 1) && gy > 0.0f && gy < (float)(map.ny - 1);
+
+    gx = clampf(gx, (float)(map.nx - 1));
+    gy = clampf(gy, (float)(map.ny - 1));
+    i = min((int_fast16_t)gx, (int_fast16_t)map.nx - 2);
+    j = min((int_fast16_t)gy, (int_fast16_t)map.ny - 2);
+
+    if(i != cell.i || j != cell.j) {
+        float *z = &map.z[j * map.nx + i];
+        cell.i = i;
+        cell.j = j;
+        cell.a = z[0] - map.z[0];
+        cell.b = z[1] - z[0];
+        cell.c = z[map.nx] - z[0];
+        cell.d = z[map.nx + 1] - z[map.nx] - z[1] + z[0];
+    }
+
+    u = gx - (float)i;
+    v = gy - (float)j;
+
+    if(cross)
+        *cross = inside ? cell.d / (map.dx * map.dy) : 0.0f;
+
+    return cell.a + cell.b * u + cell.c * v + cell.d * u * v;
+}
+
+// Returns the fraction of the line from t to the next grid line crossed on an axis, 2.0 if none.
+static float next_grid_line (float t, uint_fast8_t axis, float origin, float spacing, uint_fast16_t n)
+{
+    float delta = line.delta[axis], g, next;
+
+    if(delta == 0.0f)
+        return 2.0f;
+
+    g = (line.start[axis] + delta * t - origin) / spacing;
+
+    if(delta > 0.0f) {
+        if((next = max(floorf(g + GRID_EPSILON) + 1.0f, 0.0f)) > (float)(n - 1))
+            return 2.0f;
+    } else if((next = min(ceilf(g - GRID_EPSILON) - 1.0f, (float)(n - 1))) < 0.0f)
+        return 2.0f;
+
+    return (origin + next * spacing - line.start[axis] - delta * t) / delta;
+}
+
+bool heightmap_segment_line (float *target, plan_line_data_t *pl_data, bool init)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(init) {
+
+        if(!map.active || pl_data->condition.system_motion) {
+            memcpy(last, target, sizeof(last));
+            return false;
+        }
+
+        do {
+            idx--;
+            line.start[idx] = last[idx];
+            line.delta[idx] = target[idx] - last[idx];
+        } while(idx);
+
+        memcpy(last, target, sizeof(last));
+        line.t = 0.0f;
+        line.feed_rate = pl_data->feed_rate;
+        line.done = false;
+
+        return true;
+    }
+
+    if(line.done) {
+        pl_data->feed_rate = line.feed_rate;
+        return false;
+    }
+
+    float t = line.t, t_end, cross, k;
+
+    // End the segment at the next cell boundary...
+    t_end = t + min(next_grid_line(t, X_AXIS, map.x0, map.dx, map.nx), next_grid_line(t, Y_AXIS, map.y0, map.dy, map.ny));
+    if(t_end > 1.0f - GRID_EPSILON)
+        t_end = 1.0f;
+
+    // ...or earlier if the surface is curved along the line. Within a cell the offset along the line is a
+    // quadratic in t with the coefficient k, the max deviation from the chord of a segment is k * dt^2 / 4.
+    get_offset(line.start[X_AXIS] + line.delta[X_AXIS] * (t + t_end) * 0.5f,
+                line.start[Y_AXIS] + line.delta[Y_AXIS] * (t + t_end) * 0.5f, &cross);
+
+    if((k = fabsf(cross * line.delta[X_AXIS] * line.delta[Y_AXIS])) > 0.0f) {
+        float dt = 2.0f * sqrtf(HEIGHTMAP_TOLERANCE / k);
+        if(t_end - t > dt)
+            t_end = t + (t_end - t) / ceilf((t_end - t) / dt);
+    }
+
+    if((line.done = t_end == 1.0f)) {
+        do {
+            idx--;
+            target[idx] = line.start[idx] + line.delta[idx];
+        } while(idx);
+    } else do {
+        idx--;
+        target[idx] = line.start[idx] + line.delta[idx] * t_end;
+    } while(idx);
+
+    target[Z_AXIS] += get_offset(target[X_AXIS], target[Y_AXIS], NULL);
+
+    // Inverse time feed rate is for the whole line, scale it by the fraction of the line of the segment.
+    if(pl_data->condition.inverse_time)
+        pl_data->feed_rate = line.feed_rate / (t_end - t);
+
+    line.t = t_end;
+
+    return true;
+}
+
+bool heightmap_is_active (void)
+{
+    return map.active;
+}
+
+void heightmap_uncompensate (float *position)
+{
+    if(map.active)
+        position[Z_AXIS] -= get_offset(position[X_AXIS], position[Y_AXIS], NULL);
+
+    memcpy(last, position, sizeof(last));
+}
+
+// Returns the index of the grid point at x, y or -1 if not within HEIGHTMAP_PROBE_TOLERANCE of one.
+static int_fast16_t get_grid_point (float x, float y)
+{
+    float gx = (x - map.x0) / map.dx, gy = (y - map.y0) / map.dy;
+    int_fast16_t i = (int_fast16_t)lroundf(gx), j = (int_fast16_t)lroundf(gy);
+
+    if(i < 0 || i >= (int_fast16_t)map.nx || j < 0 || j >= (int_fast16_t)map.ny ||
+        fabsf(gx - (float)i) * map.dx > HEIGHTMAP_PROBE_TOLERANCE || fabsf(gy - (float)j) * map.dy > HEIGHTMAP_PROBE_TOLERANCE)
+        return -1;
+
+    return j * map.nx + i;
+}
+
+void heightmap_probe_completed (void)
+{
+    if(map.nx && !map.active && sys.flags.probe_succeeded) {
+
+        int_fast16_t point;
+        float position[N_AXIS];
+
+        system_convert_array_steps_to_mpos(position, sys_probe_position);
+
+        if((point = get_grid_point(position[X_AXIS], position[Y_AXIS])) >= 0)
+            map.z[point] = position[Z_AXIS];
+    }
+}
+
+// Outputs [MAP:<x0>,<y0>,<dx>,<dy>,<nx>,<ny>,<active>] and [MAPZ:<row>,<z>,...] for each row,
+// empty for points not set.
+static void heightmap_report (void)
+{
+    uint_fast16_t i, j;
+
+    hal.stream.write("[MAP:");
+    hal.stream.write(ftoa(map.x0, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.y0, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.dx, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.dy, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(map.nx));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(map.ny));
+    hal.stream.write(map.active ? ",1]" ASCII_EOL : ",0]" ASCII_EOL);
+
+    for(j = 0; j < map.ny; j++) {
+        hal.stream.write("[MAPZ:");
+        hal.stream.write(uitoa(j));
+        for(i = 0; i < map.nx; i++) {
+            hal.stream.write(",");
+            if(!isnan(map.z[j * map.nx + i]))
+                hal.stream.write(ftoa(map.z[j * map.nx + i], N_DECIMAL_COORDVALUE_MM));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+// Reads n comma separated values starting at line[counter], returns false if not exactly n.
+static bool read_values (char *line, uint_fast8_t counter, float *values, uint_fast16_t n)
+{
+    while(n--) {
+        if(!read_float(line, &counter, values++) || line[counter++] != (n ? ',' : '\0'))
+            return false;
+    }
+
+    return true;
+}
+
+// $MAP=<x0>,<y0>,<dx>,<dy>,<nx>,<ny> defines the grid and clears all points.
+static status_code_t heightmap_define (char *line)
+{
+    float values[6];
+    uint_fast16_t idx = HEIGHTMAP_POINTS_MAX;
+
+    if(!read_values(line, 5, values, 6))
+        return Status_BadNumberFormat;
+
+    if(!(isintf(values[4]) && isintf(values[5])) || values[4] < 2.0f || values[5] < 2.0f || values[4] * values[5] > (float)HEIGHTMAP_POINTS_MAX)
+        return Status_GcodeValueOutOfRange;
+
+    if(values[2] <= 0.0f || values[3] <= 0.0f)
+        return Status_NonPositiveValue;
+
+    map.active = false;
+    map.x0 = values[0];
+    map.y0 = values[1];
+    map.dx = values[2];
+    map.dy = values[3];
+    map.nx = (uint_fast16_t)values[4];
+    map.ny = (uint_fast16_t)values[5];
+
+    do {
+        map.z[--idx] = NAN;
+    } while(idx);
+
+    return Status_OK;
+}
+
+// $MAPZ=<row>,<z>,... sets the heights of the points of a row, a value is required for each point.
+static status_code_t heightmap_set_row (char *line)
+{
+    float row, *z;
+    uint_fast8_t counter = 6;
+    uint_fast16_t idx;
+
+    if(map.nx == 0)
+        return Status_InvalidStatement;
+
+    if(!read_float(line, &counter, &row) || line[counter++] != ',')
+        return Status_BadNumberFormat;
+
+    if(!isintf(row) || row < 0.0f || row >= (float)map.ny)
+        return Status_GcodeValueOutOfRange;
+
+    z = &map.z[(uint_fast16_t)row * map.nx];
+    cell.i = -1;
+
+    if(!read_values(line, counter, z, map.nx)) {
+        idx = map.nx;
+        do {
+            z[--idx] = NAN; // Clear the row on error.
+        } while(idx);
+        map.active = false;
+        return Status_BadNumberFormat;
+    }
+
+    return Status_OK;
+}
+
+// $MAPE=1 enables compensation, all points must be set. $MAPE=0 disables it.
+static status_code_t heightmap_enable (char *line)
+{
+    uint_fast16_t idx;
+
+    if(!strcmp(&line[5], "=0"))
+        map.active = false;
+    else if(!strcmp(&line[5], "=1")) {
+        if((idx = map.nx * map.ny) == 0)
+            return Status_InvalidStatement;
+        do {
+            if(isnan(map.z[--idx]))
+                return Status_InvalidStatement;
+        } while(idx);
+        cell.i = -1;
+        map.active = true;
+    } else
+        return Status_InvalidStatement;
+
+    return Status_OK;
+}
+
+static status_code_t heightmap_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "MAP", 3)) {
+
+        if(line[4] == '\0') {
+            heightmap_report();
+            retval = Status_OK;
+        } else if(!(state == STATE_IDLE || (state & (STATE_ALARM|STATE_ESTOP|STATE_CHECK_MODE))))
+            retval = Status_IdleError;
+        else if(line[4] == '=')
+            retval = heightmap_define(line);
+        else if(!strncmp(&line[4], "Z=", 2))
+            retval = heightmap_set_row(line);
+        else if(line[4] == 'E')
+            retval = heightmap_enable(line);
+        else
+            retval = Status_InvalidStatement;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void heightmap_init (void)
+{
+    if(grbl.on_unknown_sys_command != heightmap_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = heightmap_command;
+    }
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+  heightmap.h - height map (bed levelling) Z compensation
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HEIGHTMAP_H_
+#define _HEIGHTMAP_H_
+
+#include "planner.h"
+
+#ifndef HEIGHTMAP_POINTS_MAX
+#define HEIGHTMAP_POINTS_MAX 256 // Max number of grid points, X points times Y points.
+#endif
+
+// Max deviation in mm of the compensated path from the interpolated surface within a grid cell.
+// Lines crossing a cell are split only if the curvature of the surface along the line exceeds it.
+#ifndef HEIGHTMAP_TOLERANCE
+#define HEIGHTMAP_TOLERANCE 0.002f
+#endif
+
+// Max distance in mm between a probed position and a grid point for the probe result to be stored.
+#ifndef HEIGHTMAP_PROBE_TOLERANCE
+#define HEIGHTMAP_PROBE_TOLERANCE 0.05f
+#endif
+
+// Splits the line to target at grid cell boundaries, and within cells where required by the tolerance,
+// and adds the height map offset to the Z coordinate of the segment end points.
+// Call with init set and the target before outputting segments, returns true if the line is compensated.
+// Then call with init cleared until it returns false, the next segment end point is returned in target.
+bool heightmap_segment_line (float *target, plan_line_data_t *pl_data, bool init);
+
+// Returns true if compensation is enabled.
+bool heightmap_is_active (void);
+
+// Subtracts the height map offset from the Z coordinate of a machine position, called when the parser
+// position is synchronized to the machine position.
+void heightmap_uncompensate (float *position);
+
+// Stores the probed Z position in the matching grid point while compensation is disabled.
+void heightmap_probe_completed (void);
+
+// Adds the $MAP system commands.
+void heightmap_init (void);
+
+#endif
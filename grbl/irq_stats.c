@@ -0,0 +1,138 @@
+/*
+  irq_stats.c - interrupt entry latency and execution time statistics
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_IRQ_STATS
+
+#include <string.h>
+
+#include "irq_stats.h"
+
+static THREAD_LOCAL irq_stats_t *sources = NULL;
+
+static void clear (irq_stats_t *irq)
+{
+    irq->samples = 0;
+    irq->latency_min = UINT32_MAX;
+    irq->latency_max = 0;
+    irq->latency_total = 0;
+    irq->duration_max = 0;
+    irq->duration_total = 0;
+}
+
+void irq_stats_register (irq_stats_t *irq)
+{
+    irq_stats_t *last = sources;
+
+    clear(irq);
+    irq->next = NULL;
+
+    if(last == NULL)
+        sources = irq;
+    else {
+        while(last->next)
+            last = last->next;
+        last->next = irq;
+    }
+}
+
+void irq_stats_clear (void)
+{
+    irq_stats_t *irq = sources;
+
+    hal.irq_disable();
+
+    while(irq) {
+        clear(irq);
+        irq = irq->next;
+    }
+
+    hal.irq_enable();
+}
+
+static uint32_t cycles_to_ns (uint32_t cycles)
+{
+    return (uint32_t)((uint64_t)cycles * 1000000000ULL / hal.f_cycle_count);
+}
+
+// Prints [IRQ:<name>,<priority>,<samples>,<min latency>,<avg latency>,<max latency>,<avg duration>,<max duration>]
+// per source in CPU cycles, latencies are 0 for sources where only the execution time is measured.
+// Ends with [IRQ:JITTER,<ns>,<target ns>,<PASS|FAIL>] when the cycle counter frequency is known, where jitter is
+// the spread of the entry latencies of the sources that determine step timing.
+status_code_t irq_stats_report (void)
+{
+    irq_stats_t *irq = sources, copy;
+    uint32_t latency_min = UINT32_MAX, latency_max = 0;
+
+    if(hal.get_cycle_count == NULL || sources == NULL)
+        return Status_GcodeUnsupportedCommand;
+
+    while(irq) {
+
+        hal.irq_disable();
+        memcpy(&copy, irq, sizeof(irq_stats_t));
+        hal.irq_enable();
+
+        if(!(copy.timed && copy.samples)) {
+            copy.latency_min = copy.latency_max = 0;
+            copy.latency_total = 0;
+        } else if(copy.step_timing) {
+            if(copy.latency_min < latency_min)
+                latency_min = copy.latency_min;
+            if(copy.latency_max > latency_max)
+                latency_max = copy.latency_max;
+        }
+
+        hal.stream.write("[IRQ:");
+        hal.stream.write(copy.name);
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.priority));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.samples));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.latency_min));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.samples ? (uint32_t)(copy.latency_total / copy.samples) : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.latency_max));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.samples ? (uint32_t)(copy.duration_total / copy.samples) : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(copy.duration_max));
+        hal.stream.write("]" ASCII_EOL);
+
+        irq = copy.next;
+    }
+
+    if(hal.f_cycle_count && latency_min != UINT32_MAX) {
+
+        uint32_t jitter = cycles_to_ns(latency_max - latency_min);
+
+        hal.stream.write("[IRQ:JITTER,");
+        hal.stream.write(uitoa(jitter));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(IRQ_STATS_JITTER_TARGET));
+        hal.stream.write(jitter <= IRQ_STATS_JITTER_TARGET ? ",PASS]" ASCII_EOL : ",FAIL]" ASCII_EOL);
+    }
+
+    return Status_OK;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+  irq_stats.h - interrupt entry latency and execution time statistics
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _IRQ_STATS_H_
+#define _IRQ_STATS_H_
+
+#include "hal.h"
+
+#ifdef ENABLE_IRQ_STATS
+
+#ifndef IRQ_STATS_JITTER_TARGET
+#define IRQ_STATS_JITTER_TARGET 1000 // Step timing jitter target (ns)
+#endif
+
+// Statistics for an interrupt source, times are in CPU cycles as counted by hal.get_cycle_count().
+typedef struct irq_stats {
+    const char *name;           // Source name, e.g. "STEPPER"
+    uint8_t priority;           // Priority as configured by the driver, in the encoding of the MCU
+    bool timed;                 // Entry latency is measured from the hardware event, only the execution time is if not
+    bool step_timing;           // Entry latency adds to step timing jitter
+    uint32_t samples;
+    uint32_t latency_min;
+    uint32_t latency_max;
+    uint64_t latency_total;
+    uint32_t duration_max;
+    uint64_t duration_total;
+    struct irq_stats *next;
+} irq_stats_t;
+
+// Adds an interrupt source to the $IRQ report, to be called by drivers at init.
+void irq_stats_register (irq_stats_t *irq);
+
+// Clears the statistics of all sources.
+void irq_stats_clear (void);
+
+// Prints the statistics of all sources.
+status_code_t irq_stats_report (void);
+
+// Returns the cycle count on interrupt handler entry.
+ISR_CODE static inline uint32_t irq_stats_enter (void)
+{
+    return hal.get_cycle_count ? hal.get_cycle_count() : 0;
+}
+
+// To be called on interrupt handler exit with the cycle count returned by irq_stats_enter()
+// and the entry latency in CPU cycles, latency is ignored if the source is not timed.
+ISR_CODE static inline void irq_stats_exit (irq_stats_t *irq, uint32_t entry, uint32_t latency)
+{
+    if(hal.get_cycle_count) {
+
+        uint32_t duration = hal.get_cycle_count() - entry;
+
+        if(irq->timed) {
+            if(latency < irq->latency_min)
+                irq->latency_min = latency;
+            if(latency > irq->latency_max)
+                irq->latency_max = latency;
+            irq->latency_total += latency;
+        }
+
+        if(duration > irq->duration_max)
+            irq->duration_max = duration;
+        irq->duration_total += duration;
+        irq->samples++;
+    }
+}
+
+// Shorthands for interrupt handlers, the arguments to IRQ_STATS_EXIT() are not evaluated when ENABLE_IRQ_STATS is not defined.
+#define IRQ_STATS_ENTER() uint32_t irq_stats_entry = irq_stats_enter()
+#define IRQ_STATS_EXIT(irq, latency) irq_stats_exit(irq, irq_stats_entry, latency)
+
+#else
+
+#define IRQ_STATS_ENTER()
+#define IRQ_STATS_EXIT(irq, latency)
+
+#endif
+
+#endif
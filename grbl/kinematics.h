@@ -29,8 +29,13 @@ typedef struct {
     uint_fast8_t (*limits_get_axis_mask)(uint_fast8_t idx);
     void (*limits_set_target_pos)(uint_fast8_t idx);
     void (*limits_set_machine_positions)(axes_signals_t cycle);
+    bool (*check_travel_limits)(float *target);                 // Optional, replaces the per axis soft limits check
+    void (*apply_jog_limits)(float *target, float *position);   // Optional, replaces the per axis jog limits
 } kinematics_t;
 
-extern kinematics_t kinematics;
+extern THREAD_LOCAL kinematics_t kinematics;
+
+// Segments lines by joint space deviation rather than by a fixed length, for non-linear kinematics.
+bool kinematics_segment_line_adaptive (float *target, plan_line_data_t *pl_data, bool init);
 
 #endif
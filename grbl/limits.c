@@ -45,6 +45,17 @@
   #define HOMING_AXIS_LOCATE_SCALAR 5.0f // Must be > 1 to ensure limit switch is cleared.
 #endif
 
+#ifdef HOMING_FAST_LOCATE
+#ifndef HOMING_FAST_LOCATE_MARGIN
+  #define HOMING_FAST_LOCATE_MARGIN 0.5f // Distance from the switch contact where the locate approach slows down, in mm.
+#endif
+#ifndef KINEMATICS_API
+// Axes to lock by limit_interrupt_handler() on switch contact, set for the approach phases of the homing cycle.
+static THREAD_LOCAL volatile axes_signals_t homing_latch = {0};
+#define HOMING_LATCH
+#endif
+#endif
+
 // This is the Limit Pin Change Interrupt, which handles the hard limit feature. A bouncing
 // limit switch can cause a lot of problems, like false readings and multiple interrupt calls.
 // If a switch is triggered at all, something bad has happened and treat it as such, regardless
@@ -59,6 +70,18 @@
 
 ISR_CODE void limit_interrupt_handler (axes_signals_t state) // DEFAULT: Limit pin change interrupt process.
 {
+#ifdef HOMING_LATCH
+    // Lock the axes at the first switch contact during homing approach phases, instead of
+    // when seen by the polling loop in limits_homing_cycle(). Hard limits are not active while homing.
+    if(sys.state == STATE_HOMING) {
+        if((state.mask &= homing_latch.mask)) {
+            sys.homing_axis_lock.mask &= ~state.mask;
+            homing_latch.mask &= ~state.mask;
+        }
+        return;
+    }
+#endif
+
     // Ignore limit switches if already in an alarm state or in-process of executing an alarm.
     // When in the alarm state, Grbl should have been reset or will force a reset, so any pending
     // moves in the planner and stream input buffers are all cleared and newly sent blocks will be
@@ -124,6 +147,9 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
     float max_travel = 0.0f;
     float homing_rate = settings.homing.seek_rate;
     bool approach = true, autosquare_check = false, both_motors = mode == SquaringMode_Both && auto_square.mask;
+#ifdef HOMING_FAST_LOCATE
+    bool fast_locate = false;
+#endif
     axes_signals_t axislock, limit_state;
     plan_line_data_t plan_data;
 
@@ -167,6 +193,14 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
     // Set search mode with approach at seek rate to quickly engage the specified cycle.mask limit switches.
     do {
 
+#ifdef HOMING_PARALLEL_SQUARING
+        // Square the two motors in each approach, locate approaches included.
+        if(approach && mode == SquaringMode_Both && auto_square.mask) {
+            both_motors = true;
+            autosquare_check = false;
+        }
+#endif
+
         // Initialize and declare variables needed for homing routine.
         system_convert_array_steps_to_mpos(target, sys_position);
         axislock = (axes_signals_t){0};
@@ -197,6 +231,9 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
 
         homing_rate *= sqrtf(n_active_axis); // [sqrt(N_AXIS)] Adjust so individual axes all move at homing rate.
         sys.homing_axis_lock.mask = axislock.mask;
+#ifdef HOMING_LATCH
+        homing_latch.mask = approach ? axislock.mask & ~auto_square.mask : 0; // Auto squared axes are locked by the polling loop.
+#endif
 
         // Perform homing cycle. Planner buffer should be empty, as required to initiate the homing cycle.
         plan_data.feed_rate = homing_rate; // Set current homing rate.
@@ -242,7 +279,13 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
                     }
                 } while(idx);
 
+#ifdef HOMING_LATCH
+                hal.irq_disable(); // Keep axes locked by limit_interrupt_handler() locked.
+                axislock.mask = sys.homing_axis_lock.mask &= axislock.mask;
+                hal.irq_enable();
+#else
                 sys.homing_axis_lock.mask = axislock.mask;
+#endif
 
                 if (autosquare_check && abs(initial_trigger_position - sys_position[dual_motor_axis]) > autosquare_fail_distance) {
                     system_set_exec_alarm(Alarm_HomingFailAutoSquaringApproach);
@@ -272,7 +315,11 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
                     system_set_exec_alarm(Alarm_FailPulloff);
 
                 // Homing failure condition: Limit switch not found during approach.
+#ifdef HOMING_FAST_LOCATE
+                if (approach && !fast_locate && (rt_exec & EXEC_CYCLE_COMPLETE))
+#else
                 if (approach && (rt_exec & EXEC_CYCLE_COMPLETE))
+#endif
                     system_set_exec_alarm(Alarm_HomingFailApproach);
 
                 if (sys_rt_exec_alarm) {
@@ -290,19 +337,41 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
 
         } while (axislock.mask & AXES_BITMASK);
 
+#ifdef HOMING_LATCH
+        homing_latch.mask = 0;
+#endif
         st_reset(); // Immediately force kill steppers and reset step segment buffer.
         hal.delay_ms(settings.homing.debounce_delay, 0); // Delay to allow transient dynamics to dissipate.
 
         // Reverse direction and reset homing rate for locate cycle(s).
+#ifdef HOMING_FAST_LOCATE
+        if(fast_locate)
+            n_cycle++; // The fast approach is not counted as a cycle, continue the approach at the locate rate.
+        else
+#endif
         approach = !approach;
 
         // After first cycle, homing enters locating phase. Shorten search to pull-off distance.
         if (approach) {
+#ifndef HOMING_PARALLEL_SQUARING
             // Only one initial pass for auto squared axis when both motors are active
             if(mode == SquaringMode_Both && auto_square.mask)
                 cycle.mask &= ~auto_square.mask;
+#endif
             max_travel = settings.homing.pulloff * HOMING_AXIS_LOCATE_SCALAR;
             homing_rate = settings.homing.feed_rate;
+#ifdef HOMING_FAST_LOCATE
+            if(fast_locate) {
+                // Search the remaining distance at the locate rate.
+                fast_locate = false;
+                max_travel -= settings.homing.pulloff - HOMING_FAST_LOCATE_MARGIN;
+            } else if((fast_locate = settings.homing.pulloff > HOMING_FAST_LOCATE_MARGIN)) {
+                // The axes are at the pull-off distance from the switch contacts located by the previous
+                // approach, approach at the seek rate up to the locate margin first.
+                max_travel = settings.homing.pulloff - HOMING_FAST_LOCATE_MARGIN;
+                homing_rate = settings.homing.seek_rate;
+            }
+#endif
         } else {
             max_travel = settings.homing.pulloff;
             homing_rate = settings.homing.seek_rate;
@@ -361,11 +430,13 @@ bool limits_go_home (axes_signals_t cycle)
 
     if(homed && auto_square.mask) {
 
+#ifndef HOMING_PARALLEL_SQUARING // The axis is squared by the main cycle.
         sys.homed.mask &= ~auto_square.mask;
         if((homed = limits_homing_cycle(auto_square, auto_square, SquaringMode_A))) {
             sys.homed.mask &= ~auto_square.mask;
             homed = limits_homing_cycle(auto_square, auto_square, SquaringMode_B);
         }
+#endif
 
         hal.stepper.disable_motors((axes_signals_t){0}, SquaringMode_Both);
 
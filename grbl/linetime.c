@@ -0,0 +1,167 @@
+/*
+  linetime.c - per line execution time capture
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_LINE_TIMING
+
+#include <string.h>
+
+#include "linetime.h"
+
+typedef struct {
+    int32_t line_number;
+    uint32_t us;
+    bool end;               // Set when motion ended, line_number is not valid
+} linetime_event_t;
+
+// Queue of block starts, single producer (stepper ISR) single consumer (foreground).
+static THREAD_LOCAL struct {
+    volatile bool enabled;
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    volatile bool overflow;
+    linetime_event_t event[LINETIME_QUEUE_SIZE];
+} queue = {0};
+
+// Line being timed.
+static THREAD_LOCAL struct {
+    bool active;
+    int32_t line_number;
+    uint32_t start_us;
+} timed = {0};
+
+static THREAD_LOCAL on_execute_realtime_ptr on_execute_realtime;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+ISR_CODE static inline uint32_t get_us (void)
+{
+    return hal.get_micros ? hal.get_micros() : (hal.get_elapsed_ticks ? hal.get_elapsed_ticks() * 1000UL : 0);
+}
+
+ISR_CODE static void event_add (int32_t line_number, bool end)
+{
+    uint_fast8_t head = queue.head, next_head = head == LINETIME_QUEUE_SIZE - 1 ? 0 : head + 1;
+
+    if(next_head == queue.tail)
+        queue.overflow = true;
+    else {
+        queue.event[head].us = get_us();
+        queue.event[head].line_number = line_number;
+        queue.event[head].end = end;
+        queue.head = next_head;
+    }
+}
+
+// Called from the stepper ISR when a new stepper block is started.
+// NOTE: The timestamp is taken here as the foreground process may be busy for milliseconds,
+//       formatting and output is left to the foreground.
+ISR_CODE void linetime_block_started (int32_t line_number)
+{
+    if(queue.enabled)
+        event_add(line_number, false);
+}
+
+// Called from the stepper ISR when motion ends as the segment buffer is empty.
+ISR_CODE void linetime_motion_ended (void)
+{
+    if(queue.enabled)
+        event_add(0, true);
+}
+
+void linetime_reset (void)
+{
+    queue.tail = queue.head;
+    queue.overflow = false;
+    timed.active = false;
+}
+
+// Outputs [LT:<line>,<start>,<time>] for each line executed, start is the time the line was started
+// and time the execution time, both in microseconds. Consecutive blocks with the same line number,
+// such as arc chords, are timed as one timed. The time includes any feed hold or dwell within the timed.
+// [LT:OVERFLOW] is output if block starts were lost, the following line time may then be too long.
+static void linetime_execute (uint_fast16_t state)
+{
+    on_execute_realtime(state);
+
+    while(queue.tail != queue.head) {
+
+        linetime_event_t *event = &queue.event[queue.tail];
+
+        if(timed.active && (event->end || event->line_number != timed.line_number)) {
+            hal.stream.write("[LT:");
+            hal.stream.write(timed.line_number < 0 ? "-" : "");
+            hal.stream.write(uitoa((uint32_t)(timed.line_number < 0 ? -timed.line_number : timed.line_number)));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(timed.start_us));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(event->us - timed.start_us));
+            hal.stream.write("]" ASCII_EOL);
+            timed.active = false;
+        }
+
+        if(!event->end && !timed.active) {
+            timed.active = true;
+            timed.line_number = event->line_number;
+            timed.start_us = event->us;
+        }
+
+        queue.tail = queue.tail == LINETIME_QUEUE_SIZE - 1 ? 0 : queue.tail + 1;
+    }
+
+    if(queue.overflow) {
+        queue.overflow = false;
+        hal.stream.write("[LT:OVERFLOW]" ASCII_EOL);
+    }
+}
+
+static status_code_t linetime_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "LTIME", 5)) {
+        if(!strcmp(&line[6], "=0")) {
+            queue.enabled = false;
+            linetime_reset();
+            retval = Status_OK;
+        } else if(!strcmp(&line[6], "=1")) {
+            linetime_reset();
+            queue.enabled = true;
+            retval = Status_OK;
+        } else
+            retval = Status_InvalidStatement;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void linetime_init (void)
+{
+    if(grbl.on_execute_realtime != linetime_execute) {
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = linetime_execute;
+    }
+
+    if(grbl.on_unknown_sys_command != linetime_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = linetime_command;
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  linetime.h - per line execution time capture
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LINETIME_H_
+#define _LINETIME_H_
+
+#include "hal.h"
+
+#ifndef LINETIME_QUEUE_SIZE
+#define LINETIME_QUEUE_SIZE 16 // Max number of block starts queued for output, less one
+#endif
+
+// Called from the stepper ISR when a new stepper block is started.
+void linetime_block_started (int32_t line_number);
+
+// Called from the stepper ISR when motion ends as the segment buffer is empty.
+void linetime_motion_ended (void);
+
+// Discards the line being timed and any queued block starts, called on soft reset.
+void linetime_reset (void);
+
+// Adds the $LTIME system command.
+void linetime_init (void);
+
+#endif
@@ -51,15 +51,17 @@ typedef struct {
     float xCordOfMotor_x4;
     float xCordOfMotor_x2_pow;
     float yCordOfMotor;
+    float xCorrScaling;
+    float yCorrScaling;
     float height_to_bit; //distance between sled attach point and bit
 } machine_t;
 
-static machine_t machine = {0};
+static THREAD_LOCAL machine_t machine = {0};
 
-uint_fast8_t selected_motor = A_MOTOR;
+THREAD_LOCAL uint_fast8_t selected_motor = A_MOTOR;
 
-maslow_hal_t maslow_hal = {0};
-static driver_setting_ptrs_t driver_settings;
+THREAD_LOCAL maslow_hal_t maslow_hal = {0};
+static THREAD_LOCAL driver_setting_ptrs_t driver_settings;
 
 static const maslow_settings_t maslow_defaults = {
     .pid[A_MOTOR].Kp = MASLOW_A_KP,
@@ -203,8 +205,10 @@ static status_code_t maslow_settings_set (setting_type_t param, float value, cha
             break;
     }
 
-    if(status == Status_OK)
+    if(status == Status_OK) {
+        recomputeGeometry();
         hal.nvs.memcpy_to_nvs(hal.nvs.driver_area.address, (uint8_t *)&maslow_hal.settings, sizeof(maslow_settings_t), true);
+    }
 
     return status;
 }
@@ -350,7 +354,9 @@ void recomputeGeometry()
     machine.xCordOfMotor = (maslow_hal.settings.distBetweenMotors / 2.0f);
     machine.yCordOfMotor = (machine.halfHeight + maslow_hal.settings.motorOffsetY);
     machine.xCordOfMotor_x4 = machine.xCordOfMotor * 4.0f;
-    machine.xCordOfMotor_x2_pow = powf((machine.xCordOfMotor * 2.0f), 2.0f);
+    machine.xCordOfMotor_x2_pow = (machine.xCordOfMotor * 2.0f) * (machine.xCordOfMotor * 2.0f);
+    machine.xCorrScaling = maslow_hal.settings.XcorrScaling;
+    machine.yCorrScaling = maslow_hal.settings.YcorrScaling;
 }
 
 // limit motion to stay within table (in mm)
@@ -372,10 +378,10 @@ static void maslow_convert_array_steps_to_mpos (float *position, int32_t *steps)
     float a_len = ((float)steps[A_MOTOR] / settings.axis[A_MOTOR].steps_per_mm);
     float b_len = ((float)steps[B_MOTOR] / settings.axis[B_MOTOR].steps_per_mm);
 
-    a_len = (machine.xCordOfMotor_x2_pow - powf(b_len, 2.0f) + powf(a_len, 2.0f)) / machine.xCordOfMotor_x4;
+    a_len = (machine.xCordOfMotor_x2_pow - b_len * b_len + a_len * a_len) / machine.xCordOfMotor_x4;
     position[X_AXIS] = a_len - machine.xCordOfMotor;
     a_len = maslow_hal.settings.distBetweenMotors - a_len;
-    position[Y_AXIS] = machine.yCordOfMotor - sqrtf(powf(b_len, 2.0f) - powf(a_len, 2.0f));
+    position[Y_AXIS] = machine.yCordOfMotor - sqrtf(b_len * b_len - a_len * a_len);
     position[Z_AXIS] = steps[Z_AXIS] / settings.axis[Z_AXIS].steps_per_mm;
 
 // back out any correction factor
@@ -391,14 +397,30 @@ inline static void triangularInverse (int32_t *target_steps, float *target)
     //Confirm that the coordinates are on the table
 //    verifyValidTarget(&xTarget, &yTarget);
 
+#ifdef MASLOW_DOUBLE_PRECISION
     // scale target (absolute position) by any correction factor
-    double xxx = (double)target[A_MOTOR] * (double)maslow_hal.settings.XcorrScaling;
-    double yyy = (double)target[B_MOTOR] * (double)maslow_hal.settings.YcorrScaling;
-    double yyp = pow((double)machine.yCordOfMotor - yyy, 2.0);
+    double xxx = (double)target[A_MOTOR] * (double)machine.xCorrScaling;
+    double yyy = (double)machine.yCordOfMotor - (double)target[B_MOTOR] * (double)machine.yCorrScaling;
+    double xxa = (double)machine.xCordOfMotor + xxx;
+    double xxb = (double)machine.xCordOfMotor - xxx;
+    double yyp = yyy * yyy;
 
     //Calculate motor axes length to the bit
-    target_steps[A_MOTOR] = (int32_t)lround(sqrt(pow((double)machine.xCordOfMotor + xxx, 2.0f) + yyp) * settings.axis[A_MOTOR].steps_per_mm);
-    target_steps[B_MOTOR] = (int32_t)lround(sqrt(pow((double)machine.xCordOfMotor - xxx, 2.0f) + yyp) * settings.axis[B_MOTOR].steps_per_mm);
+    target_steps[A_MOTOR] = (int32_t)lround(sqrt(xxa * xxa + yyp) * settings.axis[A_MOTOR].steps_per_mm);
+    target_steps[B_MOTOR] = (int32_t)lround(sqrt(xxb * xxb + yyp) * settings.axis[B_MOTOR].steps_per_mm);
+#else
+    // Single precision is sufficient, chain lengths in steps are well within the 24 bit float mantissa.
+    // scale target (absolute position) by any correction factor
+    float xxx = target[A_MOTOR] * machine.xCorrScaling;
+    float yyy = machine.yCordOfMotor - target[B_MOTOR] * machine.yCorrScaling;
+    float xxa = machine.xCordOfMotor + xxx;
+    float xxb = machine.xCordOfMotor - xxx;
+    float yyp = yyy * yyy;
+
+    //Calculate motor axes length to the bit
+    target_steps[A_MOTOR] = (int32_t)lroundf(sqrtf(xxa * xxa + yyp) * settings.axis[A_MOTOR].steps_per_mm);
+    target_steps[B_MOTOR] = (int32_t)lroundf(sqrtf(xxb * xxb + yyp) * settings.axis[B_MOTOR].steps_per_mm);
+#endif
 }
 
 // Transform absolute position from cartesian coordinate system (mm) to maslow coordinate system (step)
@@ -418,61 +440,6 @@ static uint_fast8_t maslow_limits_get_axis_mask (uint_fast8_t idx)
     return ((idx == A_MOTOR) || (idx == B_MOTOR)) ? (bit(X_AXIS) | bit(Y_AXIS)) : bit(idx);
 }
 
-// MASLOW is circular in motion, so long lines must be divided up
-static bool maslow_segment_line (float *target, plan_line_data_t *pl_data, bool init)
-{
-    static uint_fast16_t iterations;
-    static bool segmented;
-    static float delta[N_AXIS], segment_target[N_AXIS];
-//    static plan_line_data_t plan;
-
-    uint_fast8_t idx = N_AXIS;
-
-    if(init) {
-
-        float max_delta = 0.0f;
-
-        do {
-            idx--;
-            delta[idx] = target[idx] - gc_state.position[idx];
-            max_delta = max(max_delta, fabsf(delta[idx]));
-        } while(idx);
-
-        if((segmented = !(pl_data->condition.rapid_motion || pl_data->condition.jog_motion) &&
-                          max_delta > MAX_SEG_LENGTH_MM && !(delta[X_AXIS] == 0.0f && delta[Y_AXIS] == 0.0f))) {
-
-            idx = N_AXIS;
-            iterations = (uint_fast16_t)ceilf(max_delta / MAX_SEG_LENGTH_MM);
-
-            memcpy(segment_target, gc_state.position, sizeof(segment_target));
-//            memcpy(&plan, pl_data, sizeof(plan_line_data_t));
-
-            do {
-                delta[--idx] /= (float)iterations;
-                target[idx] = gc_state.position[idx];
-            } while(idx);
-
-        } else
-            iterations = 1;
-
-        iterations++; // return at least one iteration
-
-    } else {
-
-        iterations--;
-
-        if(segmented && iterations) do {
-            idx--;
-            segment_target[idx] += delta[idx];
-            target[idx] = segment_target[idx];
-//            memcpy(pl_data, &plan, sizeof(plan_line_data_t));
-        } while(idx);
-
-    }
-
-    return iterations != 0;
-}
-
 static void maslow_limits_set_target_pos (uint_fast8_t idx) // fn name?
 {
     /*
@@ -783,7 +750,7 @@ bool maslow_init (void)
         kinematics.limits_set_machine_positions = maslow_limits_set_machine_positions;
         kinematics.plan_target_to_steps = maslow_target_to_steps;
         kinematics.convert_array_steps_to_mpos = maslow_convert_array_steps_to_mpos;
-        kinematics.segment_line = maslow_segment_line;
+        kinematics.segment_line = kinematics_segment_line_adaptive;
 
         grbl.on_unknown_sys_command = maslow_tuning;
     }
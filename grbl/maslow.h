@@ -36,7 +36,6 @@
 
 #define FP_SCALING 1024.0f
 #define SPROCKET_RADIUS_MM (10.1f)
-#define MAX_SEG_LENGTH_MM 2.0f /* long lines must be segmented due to circular motion */
 
   // PID position loop factors              X: Kp = 25000 Ki = 15000 Kd = 22000 Imax = 5000
   // 14.000 fixed point arithmatic S13.10
@@ -156,10 +155,11 @@ typedef struct {
     maslow_debug_t *(*get_debug_data)(uint_fast8_t idx);
 } maslow_hal_t;
 
-extern maslow_hal_t maslow_hal;
+extern THREAD_LOCAL maslow_hal_t maslow_hal;
 
 // Initialize HAL pointers for Maslow Router kinematics
 bool maslow_init (void);
+void recomputeGeometry (void);
 static status_code_t maslow_tuning (uint_fast16_t state, char *line, char *lcline);
 
 #endif
@@ -0,0 +1,302 @@
+/*
+  motion_bench.c - motion pipeline capacity self-test
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_MOTION_BENCHMARK
+
+#include <math.h>
+#include <string.h>
+
+#include "motion_bench.h"
+#include "protocol.h"
+#include "state_machine.h"
+
+#define SEGMENT_LEVELS 5            // Number of segment length levels
+#define ARC_RADIUS 1.0f             // Arc radius (mm)
+#define RASTER_ROW_PIXELS 200       // Pixels per raster row
+#define RASTER_PIXEL 0.1f           // Raster pixel size (mm)
+#define JOG_DISTANCE 0.5f           // Distance per jog command (mm)
+
+// Segment lengths (mm) of the tiny segment levels, the demanded block rate doubles or more for each level.
+static const float segment_length[SEGMENT_LEVELS] = { 0.1f, 0.05f, 0.02f, 0.01f, 0.005f };
+
+typedef enum {
+    MotionBench_Segments = 0,   // Collinear X moves, forward then back
+    MotionBench_Arcs,           // Full circles alternating CW and CCW
+    MotionBench_Raster,         // Laser raster rows with S word per pixel, laser off
+    MotionBench_Jog             // Back and forth jog commands
+} motion_bench_workload_t;
+
+typedef struct {
+    uint32_t lines;
+    uint32_t errors;
+    uint32_t underruns;
+    uint32_t ms;
+    float distance;             // Programmed path length (mm)
+    float feed_rate;            // Programmed feed rate (mm/min)
+} motion_bench_run_t;
+
+typedef struct {
+    uint32_t lines_per_sec;     // Max line rate of workloads completed without underruns or errors
+    uint32_t isr_max;           // Max stepper ISR cycles
+    uint32_t isr_load;          // Max stepper ISR load, in 0.1%
+    uint32_t underruns;
+} motion_bench_summary_t;
+
+static char *append (char *s, const char *word)
+{
+    while(*word)
+        *s++ = *word++;
+    *s = '\0';
+
+    return s;
+}
+
+static char *append_word (char *s, char letter, float value, uint8_t decimal_places)
+{
+    *s++ = letter;
+
+    return ftoa_append(s, value, decimal_places);
+}
+
+// Pseudo random pixel intensity.
+static inline uint32_t intensity (uint32_t n)
+{
+    return ((n * 1103515245UL + 12345UL) >> 16) & 0xFF;
+}
+
+// Generates line n of a workload of lines lines, line 0 sets the modal state.
+static void workload_line (motion_bench_workload_t workload, uint32_t n, uint32_t lines, float length, motion_bench_run_t *run, char *s)
+{
+    *s = '\0';
+
+    switch(workload) {
+
+        case MotionBench_Segments:
+            if(n == 0) {
+                s = append(s, "G21G91G94G1");
+                append_word(s, 'F', run->feed_rate, 0);
+            } else {
+                append_word(s, 'X', n <= lines / 2 ? length : -length, 4);
+                run->distance += length;
+            }
+            break;
+
+        case MotionBench_Arcs:
+            if(n == 0) {
+                s = append(s, "G21G91G94G17");
+                append_word(s, 'F', run->feed_rate, 0);
+            } else {
+                s = append(s, (n & 1) ? "G2X0Y0" : "G3X0Y0");
+                append_word(s, 'I', ARC_RADIUS, 1);
+                run->distance += 2.0f * M_PI * ARC_RADIUS;
+            }
+            break;
+
+        case MotionBench_Raster:
+            if(n == 0) {
+                s = append(s, "G21G91G94M5G1");
+                append_word(s, 'F', run->feed_rate, 0);
+            } else if(n % (RASTER_ROW_PIXELS + 1) == 0) {
+                append_word(s, 'Y', RASTER_PIXEL, 1);
+                run->distance += RASTER_PIXEL;
+            } else {
+                s = append_word(s, 'X', ((n / (RASTER_ROW_PIXELS + 1)) & 1) ? -RASTER_PIXEL : RASTER_PIXEL, 1);
+                s = append(s, "S");
+                append(s, uitoa(intensity(n)));
+                run->distance += RASTER_PIXEL;
+            }
+            break;
+
+        case MotionBench_Jog:
+            if(n) {
+                s = append(s, "$J=G21G91");
+                s = append_word(s, 'X', (n & 1) ? JOG_DISTANCE : -JOG_DISTANCE, 1);
+                append_word(s, 'F', run->feed_rate, 0);
+                run->distance += JOG_DISTANCE;
+            }
+            break;
+    }
+}
+
+// Outputs [BENCH:<name>,<lines>,<ms>,<programmed ms>,<lines/s>,<underruns>,<errors>] and, if the stepper
+// stats are available, [BENCH:<name>:ISR,<avg cycles>,<max cycles>,<interrupts/s>,<load %>].
+static void report_run (const char *name, motion_bench_run_t *run, motion_bench_summary_t *summary)
+{
+    uint32_t lines_per_sec = run->ms ? (uint32_t)((uint64_t)run->lines * 1000 / run->ms) : 0;
+
+    hal.stream.write("[BENCH:");
+    hal.stream.write(name);
+    hal.stream.write(",");
+    hal.stream.write(uitoa(run->lines));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(run->ms));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(run->feed_rate > 0.0f ? (uint32_t)lroundf(run->distance / run->feed_rate * 60000.0f) : 0));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(lines_per_sec));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(run->underruns));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(run->errors));
+    hal.stream.write("]" ASCII_EOL);
+
+    summary->underruns += run->underruns;
+    if(run->underruns == 0 && run->errors == 0 && lines_per_sec > summary->lines_per_sec)
+        summary->lines_per_sec = lines_per_sec;
+
+#ifdef ENABLE_STEPPER_STATS
+    st_stats_t *stats = st_get_stats();
+
+    if(stats && stats->isr.samples && run->ms) {
+
+        uint32_t load = hal.f_cycle_count ? (uint32_t)(stats->isr.total * 1000ULL / ((uint64_t)run->ms * (hal.f_cycle_count / 1000))) : 0;
+
+        hal.stream.write("[BENCH:");
+        hal.stream.write(name);
+        hal.stream.write(":ISR,");
+        hal.stream.write(uitoa((uint32_t)(stats->isr.total / stats->isr.samples)));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->isr.max));
+        hal.stream.write(",");
+        hal.stream.write(uitoa((uint32_t)((uint64_t)stats->isr.samples * 1000 / run->ms)));
+        hal.stream.write(",");
+        hal.stream.write(ftoa((float)load / 10.0f, 1));
+        hal.stream.write("]" ASCII_EOL);
+
+        if(stats->isr.max > summary->isr_max)
+            summary->isr_max = stats->isr.max;
+        if(load > summary->isr_load)
+            summary->isr_load = load;
+    }
+#endif
+}
+
+// Executes the lines of a workload and waits for the motion to complete, returns false if aborted.
+static bool run_workload (const char *name, motion_bench_workload_t workload, float length, uint32_t lines, motion_bench_summary_t *summary)
+{
+    bool ok;
+    char line[LINE_BUFFER_SIZE];
+    uint32_t n, underruns = st_get_underruns()->count;
+    motion_bench_run_t run = {0};
+
+    run.feed_rate = workload == MotionBench_Arcs
+                     ? min(settings.axis[X_AXIS].max_rate, settings.axis[Y_AXIS].max_rate)
+                     : settings.axis[X_AXIS].max_rate;
+
+#ifdef ENABLE_STEPPER_STATS
+    st_clear_stats();
+#endif
+
+    run.ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+
+    for(n = 0; n <= lines && !sys.abort; n++) {
+        workload_line(workload, n, lines, length, &run, line);
+        if(*line == '\0')
+            continue;
+        if(gc_execute_block(line, NULL) == Status_OK) {
+            if(n)
+                run.lines++;
+        } else {
+            run.errors++;
+            gc_state.last_error = Status_OK;
+        }
+    }
+
+    // protocol_buffer_synchronize() does not wait for the last segments of jog motions to complete.
+    ok = protocol_buffer_synchronize();
+    while(ok && sys.state == STATE_JOG)
+        ok = protocol_execute_realtime();
+
+    if((ok = ok && !sys.abort)) {
+        run.ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() - run.ms : 0;
+        run.underruns = st_get_underruns()->count - underruns;
+        report_run(name, &run, summary);
+    }
+
+    return ok;
+}
+
+// Outputs a line per workload, see report_run(), followed by [BENCH:MAX,<lines/s>,<step rate>,<ISR headroom %>,<underruns>]
+// where lines/s is the highest line rate of a workload completed without underruns and the step rate ceiling is
+// computed from the max stepper ISR execution time. The latter two are 0 if the stepper stats are not available.
+status_code_t motion_bench_run (uint32_t lines)
+{
+    static THREAD_LOCAL parser_state_t saved_gc_state;
+
+    bool ok = true;
+    char name[16];
+    uint_fast8_t level;
+    int32_t position[N_AXIS];
+    limit_settings_flags_t limits = settings.limits.flags;
+    motion_bench_summary_t summary = {0};
+
+    if(sys.state != STATE_IDLE)
+        return Status_IdleError;
+
+    if(lines < 2)
+        lines = MOTION_BENCHMARK_LINES;
+
+    memcpy(&saved_gc_state, &gc_state, sizeof(parser_state_t));
+    memcpy(position, sys_position, sizeof(position));
+
+    // No physical motion takes place, soft limits would only reject the workloads depending on the current position.
+    settings.limits.flags.soft_enabled = settings.limits.flags.jog_soft_limited = Off;
+    st_mask_steps(true);
+
+    for(level = 0; ok && level < SEGMENT_LEVELS; level++) {
+        strcpy(name, "SEG");
+        strcat(name, ftoa(segment_length[level], 3));
+        ok = run_workload(name, MotionBench_Segments, segment_length[level], lines, &summary);
+    }
+
+    if(ok)
+        ok = run_workload("ARCS", MotionBench_Arcs, 0.0f, lines / 10, &summary);
+
+    if(ok)
+        ok = run_workload("RASTER", MotionBench_Raster, 0.0f, lines, &summary);
+
+    if(ok)
+        ok = run_workload("JOG", MotionBench_Jog, 0.0f, lines, &summary);
+
+    st_mask_steps(false);
+    settings.limits.flags = limits;
+
+    // The machine did not move, restore the position and parser state.
+    memcpy(sys_position, position, sizeof(position));
+    plan_sync_position();
+    memcpy(&gc_state, &saved_gc_state, sizeof(parser_state_t));
+
+    if(ok) {
+        hal.stream.write("[BENCH:MAX,");
+        hal.stream.write(uitoa(summary.lines_per_sec));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(summary.isr_max ? hal.f_cycle_count / summary.isr_max : 0));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(summary.isr_max ? 100.0f - (float)summary.isr_load / 10.0f : 0.0f, 1));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(summary.underruns));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return ok ? Status_OK : Status_Reset;
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+  motion_bench.h - motion pipeline capacity self-test
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MOTION_BENCH_H_
+#define _MOTION_BENCH_H_
+
+#include "gcode.h"
+
+#ifndef MOTION_BENCHMARK_LINES
+#define MOTION_BENCHMARK_LINES 1000 // Default number of lines per workload run by $BENCH.
+#endif
+
+// Runs the synthetic workloads through the parser, planner, segment preparation and stepper ISR with
+// step outputs masked off and outputs the statistics. Machine position, parser state and soft limits
+// are restored afterwards. Executed by the $BENCH[=<lines>] system command, must be called in idle state.
+status_code_t motion_bench_run (uint32_t lines);
+
+#endif
@@ -35,9 +35,18 @@
 #include "state_machine.h"
 #include "motion_control.h"
 #include "tool_change.h"
+#ifdef ENABLE_PARSE_AHEAD
+#include "report.h"
+#endif
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
+#ifdef ENABLE_HEIGHTMAP
+#include "heightmap.h"
+#endif
+#ifdef ENABLE_LASER_RASTER
+#include "raster.h"
+#endif
 
 #ifndef N_ARC_CORRECTION
 #define N_ARC_CORRECTION 12
@@ -45,10 +54,17 @@
 #ifndef ARC_ANGULAR_TRAVEL_EPSILON // Float (radians)
 #define ARC_ANGULAR_TRAVEL_EPSILON 5E-7f // Float (radians)
 #endif
+#ifndef ARC_ADAPTIVE_TOLERANCE_FACTOR
+#define ARC_ADAPTIVE_TOLERANCE_FACTOR 5.0f
+#endif
 
 #ifndef BEZIER_MIN_STEP
 #define BEZIER_MIN_STEP 0.002f
 #endif
+
+#ifndef ARC_FEED_COMPENSATION_MIN
+#define ARC_FEED_COMPENSATION_MIN 0.2f // Min factor applied to the feed rate of inner arcs.
+#endif
 #ifndef BEZIER_MAX_STEP
 #define BEZIER_MAX_STEP 0.1f
 #endif
@@ -56,10 +72,14 @@
 #define BEZIER_SIGMA 0.1f
 #endif
 
+#ifdef ENABLE_JOB_ESTIMATE
+static THREAD_LOCAL job_estimate_t estimate;
+#endif
+
 #ifdef ENABLE_BACKLASH_COMPENSATION
 
-static float target_prev[N_AXIS];
-static axes_signals_t dir_negative, backlash_enabled;
+static THREAD_LOCAL float target_prev[N_AXIS];
+static THREAD_LOCAL axes_signals_t dir_negative, backlash_enabled;
 
 void mc_backlash_init (void)
 {
@@ -75,6 +95,10 @@ void mc_backlash_init (void)
 
     dir_negative.value ^= settings.homing.dir_mask.value;
 
+#ifdef BACKLASH_COMPENSATION_ISR
+    st_backlash_init(backlash_enabled, dir_negative);
+#endif
+
     mc_sync_backlash_position();
 }
 
@@ -86,6 +110,214 @@ void mc_sync_backlash_position (void)
 
 #endif
 
+// Plan and queue motion into planner buffer.
+static inline void plan_motion (float *target, plan_line_data_t *pl_data)
+{
+    if(!plan_buffer_line(target, pl_data) && settings.mode == Mode_Laser && pl_data->condition.spindle.on && !pl_data->condition.spindle.ccw) {
+        // Correctly set spindle state, if there is a coincident position passed.
+        // Forces a buffer sync while in M3 laser mode only.
+        hal.spindle.set_state(pl_data->condition.spindle, pl_data->spindle.rpm);
+    }
+}
+
+#ifdef ENABLE_PARSE_AHEAD
+
+typedef struct {
+    float target[N_AXIS];
+    plan_line_data_t pl_data;
+#ifdef ENABLE_FAR_LOOKAHEAD
+    plan_lookahead_t lookahead;
+#endif
+} parsed_motion_t;
+
+static THREAD_LOCAL struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    parsed_motion_t motion[PARSE_AHEAD_QUEUE_SIZE];
+} parse_ahead = {0};
+
+// Returns true if a motion has to wait for room in the planner buffer, also when parsed motions are queued ahead of it.
+static inline bool planner_busy (void)
+{
+    return parse_ahead.tail != parse_ahead.head || plan_check_full_buffer();
+}
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+
+// Returns the max entry speed (sqr) of the queued motion at tail, planned for stopping after the last queued motion.
+static float lookahead_entry_speed_sqr (uint_fast8_t tail)
+{
+    float speed_sqr = 0.0f;
+    uint_fast8_t idx = parse_ahead.head;
+
+    while(idx != tail) {
+        idx = (idx == 0 ? PARSE_AHEAD_QUEUE_SIZE : idx) - 1;
+        speed_sqr = plan_lookahead_entry_speed_sqr(&parse_ahead.motion[idx].lookahead, speed_sqr);
+    }
+
+    return speed_sqr;
+}
+
+#endif
+
+// Queues the motion if it would have to wait for room in the planner buffer, the parser then continues with the next block.
+// Returns false if the motion is to be planned directly.
+static bool parse_ahead_queue (float *target, plan_line_data_t *pl_data)
+{
+    // Motions carrying state changes are not queued, these have to be planned for the parser to keep them pending.
+    if(pl_data->condition.jog_motion || pl_data->condition.system_motion ||
+        pl_data->condition.coolant_change || pl_data->condition.spindle_rpm_change || pl_data->condition.wco_change)
+        return false;
+
+#ifdef ENABLE_JOB_ESTIMATE
+    if(sys.flags.estimate)
+        return false;
+#endif
+
+    if(!planner_busy())
+        return false;
+
+    uint_fast8_t next_head = parse_ahead.head + 1;
+
+    if(next_head == PARSE_AHEAD_QUEUE_SIZE)
+        next_head = 0;
+
+    // Wait for room in the queue.
+    while(next_head == parse_ahead.tail) {
+        protocol_auto_cycle_start();     // Auto-cycle start when buffer is full.
+        if(!protocol_execute_realtime()) // Check for any run-time commands
+            return true;                 // Bail, if system abort.
+    }
+
+    parsed_motion_t *motion = &parse_ahead.motion[parse_ahead.head];
+
+    memcpy(motion->target, target, sizeof(motion->target));
+    memcpy(&motion->pl_data, pl_data, sizeof(plan_line_data_t));
+
+    pl_data->message = NULL;         // Owned by the queued motion from now on.
+    pl_data->output_commands = NULL;
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+    plan_lookahead_line(target, pl_data, &motion->lookahead, parse_ahead.tail == parse_ahead.head);
+#endif
+
+    parse_ahead.head = next_head;
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+    // The last block in the planner buffer may now exit at the entry speed of the queued motions.
+    plan_set_exit_speed_sqr(lookahead_entry_speed_sqr(parse_ahead.tail));
+#endif
+
+    return true;
+}
+
+// Move queued parsed motions to the planner buffer while there is room. Called from protocol_execute_realtime().
+void mc_parse_ahead_poll (void)
+{
+    if(parse_ahead.tail == parse_ahead.head)
+        return;
+
+    parsed_motion_t *motion;
+
+    while(parse_ahead.tail != parse_ahead.head && !plan_check_full_buffer()) {
+
+        motion = &parse_ahead.motion[parse_ahead.tail];
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+        // Plan the motion for exiting at the entry speed of the motions queued after it.
+        plan_set_exit_speed_sqr(lookahead_entry_speed_sqr(parse_ahead.tail == PARSE_AHEAD_QUEUE_SIZE - 1 ? 0 : parse_ahead.tail + 1));
+#endif
+
+        plan_motion(motion->target, &motion->pl_data);
+
+        // Zero-length motion, output message and discard output commands as the parser does.
+        if(motion->pl_data.message) {
+            report_message(motion->pl_data.message, Message_Plain);
+            gc_message_free(motion->pl_data.message);
+            motion->pl_data.message = NULL;
+        }
+
+        if(motion->pl_data.output_commands) {
+            gc_output_command_free(motion->pl_data.output_commands);
+            motion->pl_data.output_commands = NULL;
+        }
+
+        if(++parse_ahead.tail == PARSE_AHEAD_QUEUE_SIZE)
+            parse_ahead.tail = 0;
+    }
+
+    if(plan_check_full_buffer())
+        protocol_auto_cycle_start(); // Auto-cycle start when buffer is full.
+}
+
+bool mc_parse_ahead_pending (void)
+{
+    return parse_ahead.tail != parse_ahead.head;
+}
+
+// Discard queued parsed motions, called on soft reset.
+void mc_parse_ahead_reset (void)
+{
+    parsed_motion_t *motion;
+
+    while(parse_ahead.tail != parse_ahead.head) {
+
+        motion = &parse_ahead.motion[parse_ahead.tail];
+
+        if(motion->pl_data.message) {
+            gc_message_free(motion->pl_data.message);
+            motion->pl_data.message = NULL;
+        }
+
+        if(motion->pl_data.output_commands) {
+            gc_output_command_free(motion->pl_data.output_commands);
+            motion->pl_data.output_commands = NULL;
+        }
+
+        if(++parse_ahead.tail == PARSE_AHEAD_QUEUE_SIZE)
+            parse_ahead.tail = 0;
+    }
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+    plan_set_exit_speed_sqr(0.0f);
+#endif
+}
+
+#else
+
+static inline bool planner_busy (void)
+{
+    return plan_check_full_buffer();
+}
+
+#endif // ENABLE_PARSE_AHEAD
+
+#if defined(COMPACT_PLAN_BLOCKS) || defined(ENABLE_LASER_RASTER)
+
+// Returns the start position of the next line, the target of the last motion queued.
+static void line_start_position (float *position)
+{
+#ifdef ENABLE_PARSE_AHEAD
+    if(parse_ahead.tail != parse_ahead.head) {
+        memcpy(position, parse_ahead.motion[parse_ahead.head ? parse_ahead.head - 1 : PARSE_AHEAD_QUEUE_SIZE - 1].target, sizeof(float) * N_AXIS);
+        return;
+    }
+#endif
+    plan_get_line_start(position);
+}
+
+#endif
+
+// Starts executing queued jog motions if not already executing.
+static void jog_start (void)
+{
+    if ((sys.state == STATE_IDLE || sys.state == STATE_TOOL_CHANGE) && plan_get_current_block() != NULL) { // Check if there is a block to execute.
+        set_state(STATE_JOG);
+        st_prep_buffer();
+        st_wake_up();  // NOTE: Manual start. No state machine required.
+    }
+}
+
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
 // (1 minute)/feed_rate time.
@@ -95,6 +327,91 @@ void mc_sync_backlash_position (void)
 // in the planner and to let backlash compensation or canned cycle integration simple and direct.
 bool mc_line (float *target, plan_line_data_t *pl_data)
 {
+#ifdef ENABLE_LASER_RASTER
+    static THREAD_LOCAL bool rastering = false;
+
+    // Add the acceleration and deceleration runways where laser raster rows are started and ended.
+    if(!rastering) {
+
+        float start[N_AXIS];
+
+        line_start_position(start);
+
+        if(raster_segment_line(target, pl_data, start, true)) {
+
+            bool ok = true;
+            float segment[N_AXIS];
+
+            rastering = true;
+            plan_batch_begin();
+            while(ok && raster_segment_line(segment, pl_data, NULL, false))
+                ok = mc_line(segment, pl_data);
+            plan_batch_commit();
+            rastering = false;
+
+            return ok;
+        }
+    }
+#endif
+
+#ifdef ENABLE_HEIGHTMAP
+    static THREAD_LOCAL bool compensating = false;
+
+    // Split the line where required by the height map and queue the compensated segments.
+    if(!compensating && heightmap_segment_line(target, pl_data, true)) {
+
+        bool ok = true;
+        float segment[N_AXIS];
+
+        compensating = true;
+        plan_batch_begin();
+        while(ok && heightmap_segment_line(segment, pl_data, false))
+            ok = mc_line(segment, pl_data);
+        plan_batch_commit();
+        compensating = false;
+
+        return ok;
+    }
+#endif
+
+#ifdef COMPACT_PLAN_BLOCKS
+    static THREAD_LOCAL bool splitting = false;
+
+    // Split lines exceeding the step count range of the compact planner blocks.
+    if(!splitting) {
+
+        uint32_t blocks;
+        float start[N_AXIS];
+
+        line_start_position(start);
+
+        if((blocks = plan_line_split_count(start, target)) > 1) {
+
+            bool ok = true;
+            uint_fast8_t idx;
+            uint32_t block;
+            float segment[N_AXIS], feed_rate = pl_data->feed_rate;
+
+            if(pl_data->condition.inverse_time)
+                pl_data->feed_rate *= (float)blocks; // Each block takes its share of the time.
+
+            splitting = true;
+            plan_batch_begin();
+            for(block = 1; ok && block < blocks; block++) {
+                for(idx = 0; idx < N_AXIS; idx++)
+                    segment[idx] = start[idx] + (target[idx] - start[idx]) * (float)block / (float)blocks;
+                ok = mc_line(segment, pl_data);
+            }
+            if(ok)
+                ok = mc_line(target, pl_data);
+            plan_batch_commit();
+            splitting = false;
+            pl_data->feed_rate = feed_rate;
+
+            return ok;
+        }
+    }
+#endif
 
     // If enabled, check for soft limit violations. Placed here all line motions are picked up
     // from everywhere in Grbl.
@@ -103,7 +420,25 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
         limits_soft_check(target);
 
     // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
+    // NOTE: Motions are queued when estimating the job time, see mc_estimate_start().
+#ifdef ENABLE_JOB_ESTIMATE
+    if ((sys.state != STATE_CHECK_MODE || sys.flags.estimate) && protocol_execute_realtime()) {
+#else
     if (sys.state != STATE_CHECK_MODE && protocol_execute_realtime()) {
+#endif
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+        // Feed motions with the spindle on wait for a spin-up started by spindle_sync() to complete.
+        if(pl_data->condition.spindle.on && !(pl_data->condition.rapid_motion || pl_data->condition.system_motion || pl_data->condition.jog_motion)) {
+  #ifdef ENABLE_JOB_ESTIMATE
+            if(sys.flags.estimate)
+                mc_estimate_await_spinup();
+            else
+  #endif
+            if(!spindle_await_at_speed(DelayMode_Dwell))
+                return false;
+        }
+#endif
 
         // NOTE: Backlash compensation may be installed here. It will need direction info to track when
         // to insert a backlash line motion(s) before the intended line motion and will require its own
@@ -119,7 +454,7 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
         // doesn't update the machine position values. Since the position values used by the g-code
         // parser and planner are separate from the system machine positions, this is doable.
 
-#ifdef ENABLE_BACKLASH_COMPENSATION
+#if defined(ENABLE_BACKLASH_COMPENSATION) && !defined(BACKLASH_COMPENSATION_ISR)
 
         if(backlash_enabled.mask) {
 
@@ -155,15 +490,21 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
                 pl_backlash.line_number = pl_data->line_number;
                 pl_backlash.spindle.rpm = pl_data->spindle.rpm;
 
+#ifdef ENABLE_PARSE_AHEAD
+                if(!parse_ahead_queue(target_prev, &pl_backlash)) {
+#endif
                 // If the buffer is full: good! That means we are well ahead of the robot.
                 // Remain in this loop until there is room in the buffer.
-                while(plan_check_full_buffer()) {
+                while(planner_busy()) {
                     protocol_auto_cycle_start();     // Auto-cycle start when buffer is full.
                     if(!protocol_execute_realtime()) // Check for any run-time commands
                         return false;                // Bail, if system abort.
                 }
 
                 plan_buffer_line(target_prev, &pl_backlash);
+#ifdef ENABLE_PARSE_AHEAD
+                }
+#endif
             }
 
             memcpy(target_prev, target, sizeof(float) * N_AXIS);
@@ -173,35 +514,261 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
 
 #ifdef KINEMATICS_API
      kinematics.segment_line(target, pl_data, true);
+     plan_batch_begin();
 
      while(kinematics.segment_line(target, pl_data, false)) {
+#endif
+#ifdef ENABLE_PARSE_AHEAD
+        // Queue the motion if the planner buffer is full, the parser continues with the next block.
+        if(!parse_ahead_queue(target, pl_data)) {
 #endif
         // If the buffer is full: good! That means we are well ahead of the robot.
         // Remain in this loop until there is room in the buffer.
          do {
-            if(!protocol_execute_realtime())    // Check for any run-time commands
+            if(!protocol_execute_realtime()) {  // Check for any run-time commands
+#ifdef KINEMATICS_API
+                plan_batch_commit();
+#endif
                 return false;                   // Bail, if system abort.
-            if(plan_check_full_buffer())
-                protocol_auto_cycle_start();    // Auto-cycle start when buffer is full.
-            else
+            }
+            if(!planner_busy())
                 break;
+#ifdef KINEMATICS_API
+            if(pl_data->condition.jog_motion)
+                jog_start();                    // Start segmented jog motions when the buffer is full.
+            else
+#endif
+            protocol_auto_cycle_start();        // Auto-cycle start when buffer is full.
         } while(true);
 
-        // Plan and queue motion into planner buffer
-        // bool plan_status; // Not used in normal operation.
-        if(!plan_buffer_line(target, pl_data) && settings.mode == Mode_Laser && pl_data->condition.spindle.on && !pl_data->condition.spindle.ccw) {
-            // Correctly set spindle state, if there is a coincident position passed.
-            // Forces a buffer sync while in M3 laser mode only.
-            hal.spindle.set_state(pl_data->condition.spindle, pl_data->spindle.rpm);
+#ifdef KINEMATICS_API
+        if(pl_data->condition.jog_motion && sys.flags.jog_cancel)
+            break;                              // Jog canceled, skip the remaining segments.
+#endif
+
+        plan_motion(target, pl_data);
+#ifdef ENABLE_PARSE_AHEAD
         }
+#endif
 #ifdef KINEMATICS_API
       }
+      plan_batch_commit();
 #endif
     }
 
     return !ABORTED;
 }
 
+#ifdef ENABLE_DOGLEG_RAPIDS
+
+// Returns the time needed to travel distance from standstill to standstill in a trapezoidal profile,
+// and if t is not NULL replaces it with the distance travelled at that time.
+static float rapid_profile (float distance, float rate, float accel, float *t)
+{
+    float t_accel = rate / accel, time;
+
+    if(distance < rate * t_accel) { // Triangle profile
+        t_accel = sqrtf(distance / accel);
+        rate = accel * t_accel;
+    }
+
+    time = 2.0f * t_accel + (distance - accel * t_accel * t_accel) / rate;
+
+    if(t) {
+        if(*t >= time)
+            *t = distance;
+        else if(*t <= t_accel)
+            *t = 0.5f * accel * *t * *t;
+        else if(*t <= time - t_accel)
+            *t = 0.5f * accel * t_accel * t_accel + rate * (*t - t_accel);
+        else
+            *t = distance - 0.5f * accel * (time - *t) * (time - *t);
+    }
+
+    return time;
+}
+
+// Executes a rapid motion as a sequence of lines through the positions the axes would be at when moved
+// independently, each in its own max rate and acceleration limited profile. A line ends each time an
+// axis reaches the target. Z is moved alone, first when moving up and last when moving down, so that
+// the other axes move at the higher Z height. Each axis moves monotonically from position to target,
+// the path stays within the box spanned by them.
+// NOTE: Axes needing less than DOGLEG_RAPID_MERGE_FACTOR more time than the previous axis end with it
+// in the same line, this avoids short lines with a near complete stop at the junction. For the same
+// reason the axes are moved in a straight line if that is not slower by more than this factor.
+bool mc_rapid (float *target, plan_line_data_t *pl_data, float *position)
+{
+    bool ok = true, straight;
+    uint_fast8_t idx, n_axes = 0, next, axes[N_AXIS];
+    float point[N_AXIS], time[N_AXIS], delta[N_AXIS], t_end, t_limit, travel, length = 0.0f, rate = SOME_LARGE_VALUE, accel = SOME_LARGE_VALUE;
+
+    memcpy(point, position, sizeof(point));
+
+    // Sort the moving axes by the time needed.
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(idx != Z_AXIS && (delta[idx] = fabsf(target[idx] - position[idx])) > 0.0f) {
+            length += delta[idx] * delta[idx];
+            time[idx] = rapid_profile(delta[idx], settings.axis[idx].max_rate, settings.axis[idx].acceleration, NULL);
+            for(next = n_axes++; next && time[axes[next - 1]] > time[idx]; next--)
+                axes[next] = axes[next - 1];
+            axes[next] = idx;
+        }
+    }
+
+    // Compare with the time needed for a straight line, limited by the axes as by the planner.
+    if(!(straight = n_axes < 2)) {
+        length = sqrtf(length);
+        for(next = 0; next < n_axes; next++) {
+            idx = axes[next];
+            rate = min(rate, settings.axis[idx].max_rate * length / delta[idx]);
+            accel = min(accel, settings.axis[idx].acceleration * length / delta[idx]);
+        }
+        straight = rapid_profile(length, rate, accel, NULL) <= time[axes[n_axes - 1]] * (1.0f + DOGLEG_RAPID_MERGE_FACTOR);
+    }
+
+    plan_batch_begin();
+
+    if(target[Z_AXIS] > position[Z_AXIS] && n_axes) {
+        point[Z_AXIS] = target[Z_AXIS];
+        ok = mc_line(point, pl_data);
+    }
+
+    next = 0;
+    while(ok && next < n_axes) {
+
+        // Axes ending within the merge factor of the first remaining axis end in this line.
+        t_limit = time[axes[next]] * (1.0f + DOGLEG_RAPID_MERGE_FACTOR);
+        do {
+            t_end = time[axes[next]];
+            point[axes[next]] = target[axes[next]];
+        } while(++next < n_axes && (straight || time[axes[next]] <= t_limit));
+
+        for(idx = next; idx < n_axes; idx++) {
+            travel = t_end;
+            rapid_profile(delta[axes[idx]], settings.axis[axes[idx]].max_rate, settings.axis[axes[idx]].acceleration, &travel);
+            point[axes[idx]] = position[axes[idx]] + (target[axes[idx]] > position[axes[idx]] ? travel : -travel);
+        }
+
+        ok = mc_line(point, pl_data);
+    }
+
+    if(ok && point[Z_AXIS] != target[Z_AXIS])
+        ok = mc_line(target, pl_data);
+
+    plan_batch_commit();
+
+    return ok;
+}
+
+#endif
+
+#ifdef ENABLE_ARC_BLOCKS
+
+// Queues the arc as a single planner block, returns false if it has to be segmented into lines.
+static bool arc_block (float *target, plan_line_data_t *pl_data, float *position, float *offset, plane_t plane, float angular_travel)
+{
+    uint_fast8_t idx = N_AXIS;
+    float radius;
+    plan_arc_t arc;
+
+    // mc_line() handles check mode and job time estimation.
+    if(sys.state == STATE_CHECK_MODE)
+        return false;
+
+#if defined(ENABLE_BACKLASH_COMPENSATION) && !defined(BACKLASH_COMPENSATION_ISR)
+    if(backlash_enabled.mask)
+        return false;
+#endif
+
+#ifdef ENABLE_HEIGHTMAP
+    if(heightmap_is_active())
+        return false;
+#endif
+
+    // Axes other than the plane and helical axes are moved by the last segment, not supported by arc blocks.
+    do {
+        idx--;
+        if(idx != plane.axis_0 && idx != plane.axis_1 && idx != plane.axis_linear && target[idx] != position[idx])
+            return false;
+    } while(idx);
+
+    arc.axis_0 = plane.axis_0;
+    arc.axis_1 = plane.axis_1;
+    arc.axis_linear = plane.axis_linear;
+    arc.center[0] = position[plane.axis_0] + offset[plane.axis_0];
+    arc.center[1] = position[plane.axis_1] + offset[plane.axis_1];
+    arc.radius = hypotf(offset[plane.axis_0], offset[plane.axis_1]);
+    // The target radius may differ slightly, the radius is interpolated along the arc.
+    arc.radius_change = hypotf(target[plane.axis_0] - arc.center[0], target[plane.axis_1] - arc.center[1]) - arc.radius;
+    arc.start_angle = atan2f(-offset[plane.axis_1], -offset[plane.axis_0]);
+    arc.angular_travel = angular_travel;
+    arc.linear_start = position[plane.axis_linear];
+    arc.linear_travel = target[plane.axis_linear] - position[plane.axis_linear];
+    arc.length = hypotf(angular_travel * (arc.radius + 0.5f * arc.radius_change), arc.linear_travel);
+
+    if((radius = min(arc.radius, arc.radius + arc.radius_change)) <= settings.arc_tolerance)
+        return false;
+
+#ifdef COMPACT_PLAN_BLOCKS
+    // The step event count of the block must fit in the compact block layout.
+    if(arc.length * max(max(settings.axis[plane.axis_0].steps_per_mm, settings.axis[plane.axis_1].steps_per_mm),
+                         settings.axis[plane.axis_linear].steps_per_mm) > (float)PLAN_BLOCK_STEPS_SPLIT)
+        return false;
+#endif
+
+    arc.segment_length = 2.0f * sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance));
+
+    // Check the end point and the extreme points of the circle passed. NOTE: Placed here as mc_line() is bypassed.
+    if(settings.limits.flags.soft_enabled) {
+
+        float point[N_AXIS], angle, f;
+
+        limits_soft_check(target);
+
+        memcpy(point, target, sizeof(point));
+        for(idx = 0; idx < 4; idx++) {
+            angle = (float)idx * 0.5f * M_PI - arc.start_angle;
+            if(angular_travel < 0.0f)
+                angle = -angle;
+            angle = fmodf(angle + 4.0f * M_PI, 2.0f * M_PI);
+            if(angle <= fabsf(angular_travel)) {
+                f = angle / fabsf(angular_travel);
+                radius = arc.radius + arc.radius_change * f;
+                angle = (float)idx * 0.5f * M_PI;
+                point[plane.axis_0] = arc.center[0] + radius * cosf(angle);
+                point[plane.axis_1] = arc.center[1] + radius * sinf(angle);
+                point[plane.axis_linear] = arc.linear_start + arc.linear_travel * f;
+                limits_soft_check(point);
+            }
+        }
+    }
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+    if(pl_data->condition.spindle.on && !spindle_await_at_speed(DelayMode_Dwell))
+        return true;
+#endif
+
+    // If the buffer is full: good! That means we are well ahead of the robot.
+    // Remain in this loop until there is room in the buffer.
+    do {
+        if(!protocol_execute_realtime())    // Check for any run-time commands
+            return true;                    // Bail, if system abort.
+        if(planner_busy())
+            protocol_auto_cycle_start();    // Auto-cycle start when buffer is full.
+        else
+            break;
+    } while(true);
+
+    plan_buffer_arc(target, pl_data, &arc);
+
+#ifdef ENABLE_HEIGHTMAP
+    heightmap_uncompensate(target); // Compensation is not active, records the end of the arc as the start of the next line.
+#endif
+
+    return true;
+}
+
+#endif
 
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_X defines circle plane in tool space, axis_linear is
@@ -237,6 +804,48 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
     // For the intended uses of Grbl, this value shouldn't exceed 2000 for the strictest of cases.
     uint16_t segments = (uint16_t)floorf(fabsf(0.5f * angular_travel * radius) / sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance)));
 
+#ifdef ENABLE_ARC_FEED_COMPENSATION
+    // Scale the feed rate of inner arcs for the cutting edge, at radius + tool radius, to move at the programmed feed rate.
+    // With climb milling and M3 the material is to the right of the tool, arcs turning left (CCW) are inner arcs.
+    if(settings.arc_feed_compensation && gc_state.tool->radius > 0.0f && pl_data->condition.spindle.on &&
+        !(pl_data->condition.inverse_time || pl_data->condition.rapid_motion || pl_data->condition.system_motion || pl_data->condition.jog_motion) &&
+         (!is_clockwise_arc ^ (settings.arc_feed_compensation == 2) ^ !!pl_data->condition.spindle.ccw))
+        pl_data->feed_rate *= max(radius / (radius + gc_state.tool->radius), ARC_FEED_COMPENSATION_MIN);
+#endif
+
+#ifdef ENABLE_ARC_BLOCKS
+    if (segments > 1 && arc_block(target, pl_data, position, offset, plane, angular_travel))
+        return;
+#endif
+
+#ifdef ENABLE_ADAPTIVE_ARC_SEGMENTATION
+    if (segments > 1) {
+        // Reduce the number of segments so that the planner buffer spans the distance required to stop
+        // from the feed rate, v^2 / 2a, limiting the chord error to the max adaptive arc tolerance.
+        float arc_length = fabsf(angular_travel * radius);
+        float feed_rate = pl_data->condition.inverse_time ? pl_data->feed_rate * arc_length : pl_data->feed_rate;
+        float acceleration = min(settings.axis[plane.axis_0].acceleration, settings.axis[plane.axis_1].acceleration);
+        float max_tolerance = min(settings.arc_tolerance * ARC_ADAPTIVE_TOLERANCE_FACTOR, radius);
+
+        feed_rate *= (float)sys.override.feed_rate / 100.0f;
+
+        if (feed_rate > 0.0f) {
+
+            // Number of segments where each segment is long enough for the buffer to span the stopping distance.
+            float lookahead_segments = floorf(arc_length * 2.0f * acceleration * (float)(plan_get_block_buffer_size() - 1) / (feed_rate * feed_rate));
+
+            if (lookahead_segments < (float)segments) {
+                uint16_t min_segments = (uint16_t)floorf(0.5f * arc_length / sqrtf(max_tolerance * (2.0f * radius - max_tolerance)));
+                segments = min(segments, max((uint16_t)lookahead_segments, max(min_segments, 1)));
+            }
+        }
+    }
+
+#endif
+
+    // Replan once when all segments are queued.
+    plan_batch_begin();
+
     if (segments) {
 
         // Multiply inverse feed_rate to compensate for the fact that this movement is approximated
@@ -310,12 +919,15 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
             position[plane.axis_linear] += linear_per_segment;
 
             // Bail mid-circle on system abort. Runtime command check already performed by mc_line.
-            if(!mc_line(position, pl_data))
+            if(!mc_line(position, pl_data)) {
+                plan_batch_commit();
                 return;
+            }
         }
     }
     // Ensure last segment arrives at target location.
     mc_line(target, pl_data);
+    plan_batch_commit();
 }
 
 // Bezier splines, from a pull request for Marlin
@@ -353,11 +965,40 @@ static inline float dist1(const float x1, const float y1, const float x2, const
     return fabsf(x1 - x2) + fabsf(y1 - y2);
 }
 
+#ifdef ENABLE_ADAPTIVE_SPLINE_SEGMENTATION
+
 /**
- * The algorithm for computing the step is loosely based on the one in Kig
- * (See https://sources.debian.net/src/kig/4:15.08.3-1/misc/kigpainter.cpp/#L759)
- * However, we do not use the stack.
- *
+ * Returns the magnitude of the second derivative of the spline at t. The second derivative
+ * of a cubic Bezier is linear in t: 6 * ((1 - t) * d0 + t * d1) where d0 = P0 - 2P1 + P2 and
+ * d1 = P1 - 2P2 + P3, thus its magnitude over an interval is largest at one of the end points.
+ */
+static inline float bezier_accel (const float *d0, const float *d1, const float t)
+{
+    const float x = interp(d0[X_AXIS], d1[X_AXIS], t),
+                y = interp(d0[Y_AXIS], d1[Y_AXIS], t);
+
+    return 6.0f * sqrtf(x * x + y * y);
+
+}
+
+/**
+ * Returns the parameter step for a segment with a chord error less than the tolerance.
+ * The chord error of the segment [t, t + step] is bounded by step^2 / 8 * the maximum
+ * magnitude of the second derivative over the interval.
+ */
+static inline float bezier_step (const float accel, const float tolerance)
+{
+    return accel > 0.0f ? max(sqrtf(8.0f * tolerance / accel), BEZIER_MIN_STEP) : 1.0f;
+}
+
+#endif
+
+
+/**
+ * The algorithm for computing the step is loosely based on the one in Kig
+ * (See https://sources.debian.net/src/kig/4:15.08.3-1/misc/kigpainter.cpp/#L759)
+ * However, we do not use the stack.
+ *
  * The algorithm goes as it follows: the parameters t runs from 0.0 to
  * 1.0 describing the curve, which is evaluated by eval_bezier(). At
  * each iteration we have to choose a step, i.e., the increment of the
@@ -403,8 +1044,55 @@ void mc_cubic_b_spline (float *target, plan_line_data_t *pl_data, float *positio
 
     memcpy(bez_target, position, sizeof(float) * N_AXIS);
 
+    // Replan once when all segments are queued.
+    plan_batch_begin();
+
+#ifdef ENABLE_ADAPTIVE_SPLINE_SEGMENTATION
+
+    // Curvature driven subdivision, the step is computed from the second derivative
+    // at the start of the segment and then reduced if required by the second derivative
+    // at the end of the segment.
+
+    uint16_t segments = 0;
+    float t = 0.0f, new_t, accel;
+    float d0[2] = { position[X_AXIS] - 2.0f * first[X_AXIS] + second[X_AXIS], position[Y_AXIS] - 2.0f * first[Y_AXIS] + second[Y_AXIS] };
+    float d1[2] = { first[X_AXIS] - 2.0f * second[X_AXIS] + target[X_AXIS], first[Y_AXIS] - 2.0f * second[Y_AXIS] + target[Y_AXIS] };
+
+    while (t < 1.0f) {
+
+        accel = bezier_accel(d0, d1, t);
+        new_t = min(t + bezier_step(accel, settings.arc_tolerance), 1.0f);
+        accel = max(accel, bezier_accel(d0, d1, new_t));
+        new_t = min(t + bezier_step(accel, settings.arc_tolerance), 1.0f);
+
+        // Avoid a very short final segment.
+        if(1.0f - new_t < BEZIER_MIN_STEP)
+            new_t = 1.0f;
+
+        t = new_t;
+
+        if(t < 1.0f) {
+            bez_target[X_AXIS] = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], t);
+            bez_target[Y_AXIS] = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], t);
+        } else {
+            bez_target[X_AXIS] = target[X_AXIS];
+            bez_target[Y_AXIS] = target[Y_AXIS];
+        }
+
+        segments++;
+
+        // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
+        if(!mc_line(bez_target, pl_data))
+            break;
+    }
+
+    sys.spline_segments = segments;
+
+#else
+
     float t = 0.0f, step = BEZIER_MAX_STEP;
 
+
     while (t < 1.0f) {
 
         // First try to reduce the step in order to make it sufficiently
@@ -481,101 +1169,320 @@ void mc_cubic_b_spline (float *target, plan_line_data_t *pl_data, float *positio
 
         // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
         if(!mc_line(bez_target, pl_data))
-            return;
+            break;
     }
+
+#endif
+
+    plan_batch_commit();
 }
 
+
 // end Bezier splines
 
-void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_data, float *position, plane_t plane, uint32_t repeats, gc_canned_t *canned)
-{
-    pl_data->condition.rapid_motion = On; // Set rapid motion condition flag.
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
 
-    // if current Z < R, rapid move to R
-    if(position[plane.axis_linear] < canned->retract_position) {
-        position[plane.axis_linear] = canned->retract_position;
-        if(!mc_line(position, pl_data))
-            return;
-    }
+// Canned cycle generator, queues the motions of the active cycle one step at a time.
+
+typedef enum {
+    CycleStep_Done = 0, // Cycle completed or aborted.
+    CycleStep_Continue, // More steps to queue.
+    CycleStep_Wait      // Waiting for the motions queued to be executed.
+} cycle_step_t;
+
+typedef cycle_step_t (*cycle_step_ptr)(void);
+
+static THREAD_LOCAL bool cycle_busy = false;
+static THREAD_LOCAL cycle_step_ptr cycle_step = NULL;
+static THREAD_LOCAL plan_line_data_t *cycle_pl_data = NULL;
 
-    // rapid move to X, Y
-    memcpy(position, target, sizeof(float) * N_AXIS);
-    position[plane.axis_linear] = canned->prev_position > canned->retract_position ? canned->prev_position : canned->retract_position;
-    if(!mc_line(position, pl_data))
+// Activate a cycle generator and queue its first motions.
+// NOTE: the cycle takes ownership of the message and output commands of pl_data until the first motion is queued.
+static void cycle_start (cycle_step_ptr step, plan_line_data_t *pl_data)
+{
+    cycle_step = step;
+    cycle_pl_data = pl_data;
+    mc_cycle_resume();
+}
+
+// Queue motions of the active cycle until the planner buffer is full, the cycle has to wait for
+// queued motions to be executed or the cycle is completed. Called from protocol_execute_realtime().
+void mc_cycle_resume (void)
+{
+    if(cycle_busy || cycle_step == NULL)
         return;
 
-    // if current Z > R, rapid move to R
-    if(position[plane.axis_linear] > canned->retract_position) {
-        position[plane.axis_linear] = canned->retract_position;
-        if(!mc_line(position, pl_data))
-            return;
+    cycle_step_t status = CycleStep_Continue;
+
+    cycle_busy = true;
+
+    while(status == CycleStep_Continue) {
+        if(planner_busy()) {
+            protocol_auto_cycle_start(); // Auto-cycle start when buffer is full.
+            break;
+        }
+        if((status = cycle_step()) == CycleStep_Done)
+            cycle_step = NULL;
     }
 
-    if(canned->retract_mode == CCRetractMode_RPos)
-        canned->prev_position = canned->retract_position;
+    cycle_busy = false;
+}
 
-    while(repeats--) {
+// Wait for the active cycle, if any, to be completely queued.
+// Returns false on system abort.
+bool mc_cycle_flush (void)
+{
+    while(cycle_step) {
+        if(!protocol_execute_realtime())
+            return false;
+    }
 
-        float current_z = canned->retract_position;
+    return true;
+}
 
-        while(current_z > canned->xyz[plane.axis_linear]) {
+// Discard the active cycle, called on soft reset.
+void mc_cycle_reset (void)
+{
+    cycle_step = NULL;
+    cycle_busy = false;
 
-            current_z -= canned->delta;
-            if(current_z < canned->xyz[plane.axis_linear])
-                current_z = canned->xyz[plane.axis_linear];
+    // Free message and output commands if the cycle was discarded before its first motion was queued.
+    if(cycle_pl_data) {
 
-            pl_data->condition.rapid_motion = Off;
+        if(cycle_pl_data->message) {
+            gc_message_free(cycle_pl_data->message);
+            cycle_pl_data->message = NULL;
+        }
 
-            position[plane.axis_linear] = current_z;
-            if(!mc_line(position, pl_data)) // drill
-                return;
+        if(cycle_pl_data->output_commands) {
+            gc_output_command_free(cycle_pl_data->output_commands);
+            cycle_pl_data->output_commands = NULL;
+        }
 
-            if(canned->dwell > 0.0f)
-                mc_dwell(canned->dwell);
+        cycle_pl_data = NULL;
+    }
+}
 
-            if(canned->spindle_off)
-                hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+#endif // ENABLE_CANNED_CYCLE_GENERATOR
+
+typedef enum {
+    DrillStep_RapidToR = 0,
+    DrillStep_RapidToXY,
+    DrillStep_RapidDownToR,
+    DrillStep_Repeat,
+    DrillStep_Drill,
+    DrillStep_Dwell,
+    DrillStep_Retract,
+    DrillStep_SpindleRestart,
+    DrillStep_NextPosition,
+    DrillStep_FinalRetract,
+    DrillStep_Done
+} drill_step_t;
+
+typedef struct {
+    drill_step_t step;
+    motion_mode_t motion;
+    plane_t plane;
+    uint32_t repeats;
+    bool distance_incremental;
+    spindle_state_t spindle;
+    float current_z;
+    float target[N_AXIS];
+    float position[N_AXIS];
+    gc_canned_t canned;
+    plan_line_data_t pl_data;
+} drill_cycle_t;
+
+// Advances the drilling cycle by one step, each step queues at most one motion.
+// If execute is false the steps are only computed, used for finding the final position of the cycle.
+// Returns false on system abort.
+static bool canned_drill_step (drill_cycle_t *cycle, bool execute)
+{
+    bool move = false;
+    float *position = cycle->position;
+    gc_canned_t *canned = &cycle->canned;
+    uint_fast8_t axis_linear = cycle->plane.axis_linear;
+
+    switch(cycle->step) {
+
+        case DrillStep_RapidToR:
+            cycle->pl_data.condition.rapid_motion = On; // Set rapid motion condition flag.
+            // if current Z < R, rapid move to R
+            if((move = position[axis_linear] < canned->retract_position))
+                position[axis_linear] = canned->retract_position;
+            cycle->step = DrillStep_RapidToXY;
+            break;
+
+        case DrillStep_RapidToXY:
+            // rapid move to X, Y
+            memcpy(position, cycle->target, sizeof(float) * N_AXIS);
+            position[axis_linear] = canned->prev_position > canned->retract_position ? canned->prev_position : canned->retract_position;
+            move = true;
+            cycle->step = DrillStep_RapidDownToR;
+            break;
+
+        case DrillStep_RapidDownToR:
+            // if current Z > R, rapid move to R
+            if((move = position[axis_linear] > canned->retract_position))
+                position[axis_linear] = canned->retract_position;
+            if(canned->retract_mode == CCRetractMode_RPos)
+                canned->prev_position = canned->retract_position;
+            cycle->step = DrillStep_Repeat;
+            break;
+
+        case DrillStep_Repeat:
+            if(cycle->repeats) {
+                cycle->repeats--;
+                cycle->current_z = canned->retract_position;
+                cycle->step = DrillStep_Drill;
+            } else {
+                memcpy(cycle->target, position, sizeof(float) * N_AXIS);
+                cycle->step = DrillStep_FinalRetract;
+            }
+            break;
+
+        case DrillStep_Drill:
+            if(cycle->current_z > canned->xyz[axis_linear]) {
+                cycle->current_z -= canned->delta;
+                if(cycle->current_z < canned->xyz[axis_linear])
+                    cycle->current_z = canned->xyz[axis_linear];
+                cycle->pl_data.condition.rapid_motion = Off;
+                position[axis_linear] = cycle->current_z;
+                move = true;
+                cycle->step = DrillStep_Dwell;
+            } else
+                cycle->step = DrillStep_NextPosition;
+            break;
+
+        case DrillStep_Dwell:
+            if(execute) {
+                if(canned->dwell > 0.0f)
+                    mc_dwell(canned->dwell);
+                if(canned->spindle_off)
+                    hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+            }
+            cycle->step = DrillStep_Retract;
+            break;
 
+        case DrillStep_Retract:
             // rapid retract
-            switch(motion) {
+            switch(cycle->motion) {
 
                 case MotionMode_DrillChipBreak:
-                    position[plane.axis_linear] = position[plane.axis_linear] == canned->xyz[plane.axis_linear]
-                                                   ? canned->retract_position
-                                                   : position[plane.axis_linear] + settings.g73_retract;
+                    position[axis_linear] = position[axis_linear] == canned->xyz[axis_linear]
+                                             ? canned->retract_position
+                                             : position[axis_linear] + settings.g73_retract;
                     break;
 
                 default:
-                    position[plane.axis_linear] = canned->retract_position;
+                    position[axis_linear] = canned->retract_position;
                     break;
             }
+            cycle->pl_data.condition.rapid_motion = canned->rapid_retract;
+            move = true;
+            cycle->step = DrillStep_SpindleRestart;
+            break;
+
+        case DrillStep_SpindleRestart:
+            if(execute && canned->spindle_off)
+                spindle_sync(cycle->spindle, cycle->pl_data.spindle.rpm);
+            cycle->step = DrillStep_Drill;
+            break;
+
+        case DrillStep_NextPosition:
+            // rapid move to next position if incremental mode
+            if(cycle->repeats && cycle->distance_incremental) {
+                position[cycle->plane.axis_0] += canned->xyz[cycle->plane.axis_0];
+                position[cycle->plane.axis_1] += canned->xyz[cycle->plane.axis_1];
+                position[axis_linear] = canned->prev_position;
+                move = true;
+            }
+            cycle->step = DrillStep_Repeat;
+            break;
+
+        case DrillStep_FinalRetract:
+            if(canned->retract_mode == CCRetractMode_Previous && cycle->motion != MotionMode_DrillChipBreak && cycle->target[axis_linear] < canned->prev_position) {
+                cycle->pl_data.condition.rapid_motion = On;
+                cycle->target[axis_linear] = canned->prev_position;
+                memcpy(position, cycle->target, sizeof(float) * N_AXIS);
+                move = true;
+            }
+            cycle->step = DrillStep_Done;
+            break;
 
-            pl_data->condition.rapid_motion = canned->rapid_retract;
-            if(!mc_line(position, pl_data))
-                return;
-
-            if(canned->spindle_off)
-                spindle_sync(gc_state.modal.spindle, pl_data->spindle.rpm);
-        }
+        default:
+            break;
+    }
 
-       // rapid move to next position if incremental mode
-        if(repeats && gc_state.modal.distance_incremental) {
-            position[plane.axis_0] += canned->xyz[plane.axis_0];
-            position[plane.axis_1] += canned->xyz[plane.axis_1];
-            position[plane.axis_linear] = canned->prev_position;
-            if(!mc_line(position, pl_data))
-                return;
-        }
+    if(move && execute && !mc_line(position, &cycle->pl_data)) {
+        cycle->step = DrillStep_Done;
+        return false;
     }
 
-    memcpy(target, position, sizeof(float) * N_AXIS);
+    return true;
+}
 
-    if(canned->retract_mode == CCRetractMode_Previous && motion != MotionMode_DrillChipBreak && target[plane.axis_linear] < canned->prev_position) {
-        pl_data->condition.rapid_motion = On;
-        target[plane.axis_linear] = canned->prev_position;
-        if(!mc_line(target, pl_data))
-            return;
-    }
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+
+static THREAD_LOCAL drill_cycle_t drill_cycle;
+
+static cycle_step_t drill_generator_step (void)
+{
+    return canned_drill_step(&drill_cycle, true) && drill_cycle.step != DrillStep_Done ? CycleStep_Continue : CycleStep_Done;
+}
+
+#endif
+
+// Execute canned cycle (drill), on return target holds the final position of the cycle.
+// NOTE: If the canned cycle generator is enabled the motions are queued as planner space becomes available,
+// mc_canned_drill() only queues as many motions as the planner buffer holds before returning.
+void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_data, float *position, plane_t plane, uint32_t repeats, gc_canned_t *canned)
+{
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    drill_cycle_t *cycle = &drill_cycle;
+#else
+    drill_cycle_t drill_cycle, *cycle = &drill_cycle;
+#endif
+
+    cycle->motion = motion;
+    cycle->plane = plane;
+    cycle->repeats = repeats;
+    cycle->distance_incremental = gc_state.modal.distance_incremental;
+    cycle->spindle = gc_state.modal.spindle;
+    memcpy(cycle->target, target, sizeof(float) * N_AXIS);
+    memcpy(cycle->position, position, sizeof(float) * N_AXIS);
+    memcpy(&cycle->canned, canned, sizeof(gc_canned_t));
+    memcpy(&cycle->pl_data, pl_data, sizeof(plan_line_data_t));
+    cycle->step = DrillStep_RapidToR;
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+
+    // Find the final position without queuing any motions.
+    drill_cycle_t final;
+
+    memcpy(&final, cycle, sizeof(drill_cycle_t));
+    while(final.step != DrillStep_Done)
+        canned_drill_step(&final, false);
+
+    memcpy(target, final.target, sizeof(float) * N_AXIS);
+    memcpy(position, final.position, sizeof(float) * N_AXIS);
+    canned->prev_position = final.canned.prev_position;
+
+    pl_data->message = NULL;
+    pl_data->output_commands = NULL;
+
+    cycle_start(drill_generator_step, &cycle->pl_data);
+
+#else
+
+    while(cycle->step != DrillStep_Done && canned_drill_step(cycle, true));
+
+    memcpy(target, cycle->target, sizeof(float) * N_AXIS);
+    memcpy(position, cycle->position, sizeof(float) * N_AXIS);
+    memcpy(pl_data, &cycle->pl_data, sizeof(plan_line_data_t));
+    canned->prev_position = cycle->canned.prev_position;
+
+#endif
 }
 
 // Calculates depth-of-cut (DOC) for a given threading pass.
@@ -584,42 +1491,227 @@ inline static float calc_thread_doc (uint_fast16_t pass, float cut_depth, float
     return cut_depth * powf((float)pass, inv_degression);
 }
 
+typedef enum {
+    ThreadStep_InitialZ = 0,
+    ThreadStep_Pass,
+    ThreadStep_Synchronize,
+    ThreadStep_EntryTaper,
+    ThreadStep_Main,
+    ThreadStep_ExitTaper,
+    ThreadStep_Retract,
+    ThreadStep_Reposition,
+    ThreadStep_Done
+} thread_step_t;
+
+typedef struct {
+    thread_step_t step;
+    uint_fast16_t pass;
+    uint_fast16_t passes;
+    float doc;
+    float inv_degression;
+    float thread_length;
+    float entry_taper_length;
+    float exit_taper_length;
+    float infeed_factor;
+    float start_z;
+    float target[N_AXIS];
+    float position[N_AXIS];
+    gc_override_flags_t overrides;
+    gc_thread_data thread;
+    plan_line_data_t pl_data;
+} thread_cycle_t;
+
+// Advances the threading cycle by one step, each step queues at most one motion.
+// The geometry of the next pass is computed by the retract step so that the cut
+// motions can be queued back-to-back as soon as the previous pass is completed.
+// Returns false when the cycle is completed or on system abort.
+static bool thread_step (thread_cycle_t *cycle)
+{
+    bool move = false;
+    float *target = cycle->target, *position = cycle->position;
+    gc_thread_data *thread = &cycle->thread;
+    plan_line_data_t *pl_data = &cycle->pl_data;
+
+    switch(cycle->step) {
+
+        case ThreadStep_InitialZ:
+            // Initial Z-move for compound slide angle offset.
+            if((move = cycle->infeed_factor != 0.0f))
+                target[Z_AXIS] = cycle->start_z - cycle->doc * cycle->infeed_factor;
+            cycle->step = ThreadStep_Pass;
+            break;
+
+        case ThreadStep_Pass:
+            if(--cycle->passes == 0) {
+                cycle->step = ThreadStep_Done;
+                break;
+            }
+            if(thread->end_taper_type & Taper_Entry)
+                target[X_AXIS] = position[X_AXIS] + (thread->peak + cycle->doc - thread->depth) * thread->cut_direction;
+            else
+                target[X_AXIS] = position[X_AXIS] + (thread->peak + cycle->doc) * thread->cut_direction;
+            move = true;
+            cycle->step = ThreadStep_Synchronize;
+            break;
+
+        case ThreadStep_Synchronize:
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+            // Wait until any previous moves are finished.
+            if(plan_get_current_block() || sys.state == STATE_CYCLE) {
+                protocol_auto_cycle_start();
+                return true;
+            }
+#else
+            if(!protocol_buffer_synchronize() && sys.state != STATE_IDLE) // Wait until any previous moves are finished.
+                cycle->step = ThreadStep_Done;
+#endif
+            pl_data->condition.rapid_motion = Off;          // Clear rapid motion condition flag,
+            pl_data->condition.spindle.synchronized = On;   // enable spindle sync for cut
+            pl_data->overrides.feed_hold_disable = On;      // and disable feed hold
+            if(cycle->step == ThreadStep_Synchronize)
+                cycle->step = ThreadStep_EntryTaper;
+            break;
+
+        // Cut thread pass
+
+        case ThreadStep_EntryTaper:
+            // 1. Entry taper
+            if((move = !!(thread->end_taper_type & Taper_Entry))) {
+                target[X_AXIS] += thread->depth * thread->cut_direction;
+                target[Z_AXIS] -= cycle->entry_taper_length;
+            }
+            cycle->step = ThreadStep_Main;
+            break;
+
+        case ThreadStep_Main:
+            // 2. Main part
+            target[Z_AXIS] += cycle->thread_length;
+            move = true;
+            cycle->step = ThreadStep_ExitTaper;
+            break;
+
+        case ThreadStep_ExitTaper:
+            // 3. Exit taper
+            if((move = !!(thread->end_taper_type & Taper_Exit))) {
+                target[X_AXIS] -= thread->depth * thread->cut_direction;
+                target[Z_AXIS] -= cycle->exit_taper_length;
+            }
+            cycle->step = ThreadStep_Retract;
+            break;
+
+        case ThreadStep_Retract:
+            pl_data->condition.rapid_motion = On;           // Set rapid motion condition flag and
+            pl_data->condition.spindle.synchronized = Off;  // disable spindle sync for retract & reposition
+
+            if(cycle->passes > 1) {
+
+                // Get DOC of next pass.
+                cycle->doc = calc_thread_doc(++cycle->pass, thread->initial_depth, cycle->inv_degression);
+                cycle->doc = min(cycle->doc, thread->depth);
+
+                // 4. Retract
+                target[X_AXIS] = position[X_AXIS] + (cycle->doc - thread->depth) * thread->cut_direction;
+                cycle->step = ThreadStep_Reposition;
+
+            } else {
+                cycle->doc = thread->depth;
+                target[X_AXIS] = position[X_AXIS];
+                cycle->step = ThreadStep_Pass;
+            }
+            move = true;
+            break;
+
+        case ThreadStep_Reposition:
+            // Restore disable feed hold status for reposition move.
+            pl_data->overrides.feed_hold_disable = cycle->overrides.feed_hold_disable;
+
+            // 5. Back to start, add compound slide angle offset when commanded.
+            target[Z_AXIS] = cycle->start_z - (cycle->infeed_factor != 0.0f ? cycle->doc * cycle->infeed_factor : 0.0f);
+            move = true;
+            cycle->step = ThreadStep_Pass;
+            break;
+
+        default:
+            break;
+    }
+
+    if(move && !mc_line(target, pl_data))
+        cycle->step = ThreadStep_Done;
+
+    if(cycle->step == ThreadStep_Done)
+        sys.override.control = cycle->overrides; // Restore previous override disable status.
+
+    return cycle->step != ThreadStep_Done;
+}
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+
+static THREAD_LOCAL thread_cycle_t thread_cycle;
+
+static cycle_step_t thread_generator_step (void)
+{
+    thread_step_t step = thread_cycle.step;
+
+    if(!thread_step(&thread_cycle))
+        return CycleStep_Done;
+
+    return step == ThreadStep_Synchronize && thread_cycle.step == step ? CycleStep_Wait : CycleStep_Continue;
+}
+
+#endif
+
 // Repeated cycle for threading
 // G76 P- X- Z- I- J- R- K- Q- H- E- L-
 // P - picth, X - main taper distance, Z - final position, I - thread peak offset, J - initial depth, K - full depth
 // R - depth regression, Q - compound slide angle, H - spring passes, E - taper, L - taper end
+// overrides is the override disable status to restore when the cycle is completed.
+// NOTE: If the canned cycle generator is enabled the passes are queued as planner space becomes available,
+// the wait for the previous motions to finish before each cut does not block the caller.
 
 // TODO: change pitch to follow any tapers
 
-void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thread, bool feed_hold_disabled)
+void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thread, gc_override_flags_t overrides)
 {
-    uint_fast16_t pass = 1, passes = 0;
-    float doc = thread->initial_depth, inv_degression = 1.0f / thread->depth_degression, thread_length;
-    float entry_taper_length = thread->end_taper_type & Taper_Entry ? thread->end_taper_length : 0.0f;
-    float exit_taper_length = thread->end_taper_type & Taper_Exit ? thread->end_taper_length : 0.0f;
-    float infeed_factor = tanf(thread->infeed_angle * RADDEG);
-    float target[N_AXIS], start_z = position[Z_AXIS] + thread->depth * infeed_factor;
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    thread_cycle_t *cycle = &thread_cycle;
+#else
+    thread_cycle_t thread_cycle, *cycle = &thread_cycle;
+#endif
 
-    memcpy(target, position, sizeof(float) * N_AXIS);
+    memcpy(&cycle->thread, thread, sizeof(gc_thread_data));
+    memcpy(&cycle->pl_data, pl_data, sizeof(plan_line_data_t));
+    memcpy(cycle->position, position, sizeof(float) * N_AXIS);
+    memcpy(cycle->target, position, sizeof(float) * N_AXIS);
+
+    thread = &cycle->thread;
+    cycle->overrides = overrides;
+    cycle->pass = 1;
+    cycle->passes = 0;
+    cycle->doc = thread->initial_depth;
+    cycle->inv_degression = 1.0f / thread->depth_degression;
+    cycle->entry_taper_length = thread->end_taper_type & Taper_Entry ? thread->end_taper_length : 0.0f;
+    cycle->exit_taper_length = thread->end_taper_type & Taper_Exit ? thread->end_taper_length : 0.0f;
+    cycle->infeed_factor = tanf(thread->infeed_angle * RADDEG);
+    cycle->start_z = position[Z_AXIS] + thread->depth * cycle->infeed_factor;
 
     // Calculate number of passes
-    while(calc_thread_doc(++passes, doc, inv_degression) < thread->depth);
+    while(calc_thread_doc(++cycle->passes, cycle->doc, cycle->inv_degression) < thread->depth);
 
-    passes += thread->spring_passes + 1;
+    cycle->passes += thread->spring_passes + 1;
 
-    if((thread_length = thread->z_final - position[Z_AXIS]) > 0.0f) {
+    if((cycle->thread_length = thread->z_final - position[Z_AXIS]) > 0.0f) {
         if(thread->end_taper_type & Taper_Entry)
-            entry_taper_length = -entry_taper_length;
+            cycle->entry_taper_length = -cycle->entry_taper_length;
         if(thread->end_taper_type & Taper_Exit)
-            exit_taper_length = - exit_taper_length;
+            cycle->exit_taper_length = - cycle->exit_taper_length;
     }
 
-    thread_length += entry_taper_length + exit_taper_length;
+    cycle->thread_length += cycle->entry_taper_length + cycle->exit_taper_length;
 
     if(thread->main_taper_height != 0.0f)
-        thread->main_taper_height = thread->main_taper_height * thread_length / (thread_length - (entry_taper_length + exit_taper_length));
+        thread->main_taper_height = thread->main_taper_height * cycle->thread_length / (cycle->thread_length - (cycle->entry_taper_length + cycle->exit_taper_length));
 
-    pl_data->condition.rapid_motion = On; // Set rapid motion condition flag.
+    cycle->pl_data.condition.rapid_motion = On; // Set rapid motion condition flag.
 
     // TODO: Add to initial move to compensate for acceleration distance?
     /*
@@ -627,113 +1719,296 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
     acc_distance = acc_distance * acc_distance * settings.acceleration[Z_AXIS] * 0.5f;
      */
 
-    // Initial Z-move for compound slide angle offset.
-    if(infeed_factor != 0.0f) {
-        target[Z_AXIS] = start_z - doc * infeed_factor;
-        if(!mc_line(target, pl_data))
-            return;
+    cycle->step = ThreadStep_InitialZ;
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    pl_data->message = NULL;
+    pl_data->output_commands = NULL;
+
+    cycle_start(thread_generator_step, &cycle->pl_data);
+#else
+    while(thread_step(cycle));
+
+    memcpy(pl_data, &cycle->pl_data, sizeof(plan_line_data_t));
+#endif
+}
+
+static THREAD_LOCAL bool jog_busy = false; // Set while a jog motion is waiting for room in the planner buffer.
+
+// Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
+static status_code_t jog_execute (float *target, plan_line_data_t *pl_data)
+{
+    // NOTE: Spindle and coolant are allowed to fully function with overrides during a jog.
+    pl_data->condition.no_feed_override = On;
+    pl_data->condition.jog_motion = On;
+
+    if(settings.limits.flags.jog_soft_limited)
+        system_apply_jog_limits(target);
+    else if (settings.limits.flags.soft_enabled && !system_check_travel_limits(target))
+        return Status_TravelExceeded;
+
+    // Valid jog command. Plan, set state, and execute.
+    jog_busy = true;
+    sys.flags.jog_cancel = Off;
+    mc_line(target, pl_data);
+    jog_busy = false;
+
+#ifdef KINEMATICS_API
+    // Canceled while segments were queued, the parser position is to be synced to the actual position.
+    // If the cancel has completed it has already done that, otherwise it will when it completes.
+    if(sys.flags.jog_cancel) {
+        sys.flags.jog_cancel = Off;
+        if(!(sys.state & STATE_JOG))
+            memcpy(target, gc_state.position, sizeof(float) * N_AXIS);
+        return Status_OK;
     }
+#endif
 
-    while(--passes) {
+    jog_start();
 
-        if(thread->end_taper_type & Taper_Entry)
-            target[X_AXIS] = position[X_AXIS] + (thread->peak + doc - thread->depth) * thread->cut_direction;
-        else
-            target[X_AXIS] = position[X_AXIS] + (thread->peak + doc) * thread->cut_direction;
+    return Status_OK;
+}
 
-        if(!mc_line(target, pl_data))
-            return;
+status_code_t mc_jog_execute (plan_line_data_t *pl_data, parser_block_t *gc_block)
+{
+    // Initialize planner data struct for jogging motions.
+    pl_data->feed_rate = gc_block->values.f;
+    pl_data->line_number = gc_block->values.n;
 
-        if(!protocol_buffer_synchronize() && sys.state != STATE_IDLE) // Wait until any previous moves are finished.
-            return;
+    return jog_execute(gc_block->values.xyz, pl_data);
+}
 
-        pl_data->condition.rapid_motion = Off;          // Clear rapid motion condition flag,
-        pl_data->condition.spindle.synchronized = On;   // enable spindle sync for cut
-        pl_data->overrides.feed_hold_disable = On;      // and disable feed hold
+// Jogs the axes distance mm from the parser position at feed_rate mm/min, as a $J=G91 command with the
+// axis words for the distances would. For plugins, e.g. MPG handwheels, the motion is queued directly
+// without formatting and parsing a command. Must be called from the foreground process.
+// NOTE: rejected when called from grbl.on_execute_realtime while another jog motion is waiting
+//       for room in the planner buffer, the parser position is then not yet updated for that motion.
+status_code_t mc_jog_relative (float *distance, float feed_rate)
+{
+    status_code_t status;
+    uint_fast8_t idx = N_AXIS;
+    float target[N_AXIS];
+    plan_line_data_t pl_data;
 
-        // Cut thread pass
+    if(jog_busy || !(sys.state == STATE_IDLE || (sys.state & (STATE_JOG|STATE_TOOL_CHANGE))))
+        return Status_IdleError;
 
-        // 1. Entry taper
-        if(thread->end_taper_type & Taper_Entry) {
+    if(feed_rate <= 0.0f)
+        return Status_GcodeUndefinedFeedRate;
 
-            target[X_AXIS] += thread->depth * thread->cut_direction;
-            target[Z_AXIS] -= entry_taper_length;
-            if(!mc_line(target, pl_data))
-                return;
-        }
+    do {
+        idx--;
+        target[idx] = gc_state.position[idx] + distance[idx];
+    } while(idx);
 
-        // 2. Main part
-        target[Z_AXIS] += thread_length;
-        if(!mc_line(target, pl_data))
-            return;
+    // Initialize planner data to current spindle and coolant modal state, as for $J= jog motions.
+    memset(&pl_data, 0, sizeof(plan_line_data_t));
+    memcpy(&pl_data.spindle, &gc_state.spindle, sizeof(spindle_t));
+    pl_data.condition.spindle = gc_state.modal.spindle;
+    pl_data.condition.coolant = gc_state.modal.coolant;
+    pl_data.condition.is_rpm_rate_adjusted = gc_state.is_rpm_rate_adjusted;
+    pl_data.feed_rate = feed_rate;
 
-        // 3. Exit taper
-        if(thread->end_taper_type & Taper_Exit) {
+    if((status = jog_execute(target, &pl_data)) == Status_OK)
+        memcpy(gc_state.position, target, sizeof(target));
 
-            target[X_AXIS] -= thread->depth * thread->cut_direction;
-            target[Z_AXIS] -= exit_taper_length;
-            if(!mc_line(target, pl_data))
-                return;
-        }
+    return status;
+}
 
-        pl_data->condition.rapid_motion = On;           // Set rapid motion condition flag and
-        pl_data->condition.spindle.synchronized = Off;  // disable spindle sync for retract & reposition
+#ifdef ENABLE_VELOCITY_JOG
 
-        if(passes > 1) {
+// Velocity mode jogging. Jog motions of VELOCITY_JOG_DISTANCE length are queued in the commanded direction, up to the
+// travel limits of homed axes if soft limits are enabled, keeping VELOCITY_JOG_BLOCKS motions ahead. Rate changes are
+// applied to the queued motions on the fly, as for a feed override. Direction changes and stops are executed as a jog
+// cancel, a motion in a new direction is started when the machine has come to a stop.
+// NOTE: Short motions are used since the step segment generator loses precision for motions with very high step counts.
 
-            // Get DOC of next pass.
-            doc = calc_thread_doc(++pass, thread->initial_depth, inv_degression);
-            doc = min(doc, thread->depth);
+typedef struct {
+    bool active;                // Velocity jog motions are executing.
+    bool stopping;              // Jog cancel requested, waiting for the motion to stop.
+    bool pending;               // A velocity jog is to be started when the machine is stopped.
+    bool busy;                  // Queueing jog motions, blocks recursive calls from protocol_execute_realtime().
+    uint32_t updated;           // Time of the last command (ms).
+    float rate;                 // Commanded feed rate (mm/min).
+    float unit_vec[N_AXIS];     // Commanded direction.
+} velocity_jog_t;
 
-            // 4. Retract
-            target[X_AXIS] = position[X_AXIS] + (doc - thread->depth) * thread->cut_direction;
-            if(!mc_line(target, pl_data))
-                return;
+static THREAD_LOCAL velocity_jog_t vjog = {0};
 
-            // Restore disable feed hold status for reposition move.
-            pl_data->overrides.feed_hold_disable = feed_hold_disabled;
+static void velocity_jog_stop (void)
+{
+    if((sys.state & STATE_JOG) && !vjog.stopping) {
+        vjog.stopping = true;
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+    }
+}
 
-            // 5. Back to start, add compound slide angle offset when commanded.
-            target[Z_AXIS] = start_z - (infeed_factor != 0.0f ? doc * infeed_factor : 0.0f);
-            if(!mc_line(target, pl_data))
-                return;
+// Queue jog motions until VELOCITY_JOG_BLOCKS are in the planner buffer or the travel limits are reached.
+static void velocity_jog_queue (void)
+{
+    uint_fast8_t idx;
+    float target[N_AXIS], distance;
+    plan_line_data_t pl_data;
 
-        } else {
+    // Initialize planner data to current spindle and coolant modal state, as for $J= jog motions.
+    memset(&pl_data, 0, sizeof(plan_line_data_t));
+    memcpy(&pl_data.spindle, &gc_state.spindle, sizeof(spindle_t));
+    pl_data.condition.spindle = gc_state.modal.spindle;
+    pl_data.condition.coolant = gc_state.modal.coolant;
+    pl_data.condition.is_rpm_rate_adjusted = gc_state.is_rpm_rate_adjusted;
+    pl_data.feed_rate = vjog.rate;
+    pl_data.condition.no_feed_override = On;
+    pl_data.condition.jog_motion = On;
 
-            doc = thread->depth;
-            target[X_AXIS] = position[X_AXIS];
-            if(!mc_line(target, pl_data))
-                return;
+    vjog.busy = true;
+
+    if(!(sys.state & STATE_JOG))
+        sys.flags.jog_cancel = Off;
+
+    while(plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available() < VELOCITY_JOG_BLOCKS) {
+
+        distance = VELOCITY_JOG_DISTANCE;
+
+        // Shorten the motion to end at the first travel limit crossed.
+        if(settings.limits.flags.soft_enabled || settings.limits.flags.jog_soft_limited) {
+
+            idx = N_AXIS;
+            do {
+                idx--;
+                target[idx] = gc_state.position[idx] + vjog.unit_vec[idx] * distance;
+            } while(idx);
+
+            system_apply_jog_limits(target);
+
+            idx = N_AXIS;
+            do {
+                idx--;
+                if(vjog.unit_vec[idx] != 0.0f)
+                    distance = min(distance, (target[idx] - gc_state.position[idx]) / vjog.unit_vec[idx]);
+            } while(idx);
         }
+
+        if(distance < VELOCITY_JOG_DISTANCE * 0.01f)
+            break;
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            target[idx] = gc_state.position[idx] + vjog.unit_vec[idx] * distance;
+        } while(idx);
+
+        if(!mc_line(target, &pl_data) || sys.flags.jog_cancel)
+            break;
+
+        // The parser position is synced to the actual position when the jog is canceled.
+        memcpy(gc_state.position, target, sizeof(target));
     }
+
+    vjog.busy = false;
 }
 
-// Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
-status_code_t mc_jog_execute (plan_line_data_t *pl_data, parser_block_t *gc_block)
+static void velocity_jog_start (void)
 {
-    // Initialize planner data struct for jogging motions.
-    // NOTE: Spindle and coolant are allowed to fully function with overrides during a jog.
-    pl_data->feed_rate = gc_block->values.f;
-    pl_data->condition.no_feed_override = On;
-    pl_data->condition.jog_motion = On;
-    pl_data->line_number = gc_block->values.n;
+    vjog.pending = false;
 
-    if(settings.limits.flags.jog_soft_limited)
-        system_apply_jog_limits(gc_block->values.xyz);
-    else if (settings.limits.flags.soft_enabled && !system_check_travel_limits(gc_block->values.xyz))
-        return Status_TravelExceeded;
+    velocity_jog_queue();
 
-    // Valid jog command. Plan, set state, and execute.
-    mc_line(gc_block->values.xyz, pl_data);
-    if ((sys.state == STATE_IDLE || sys.state == STATE_TOOL_CHANGE) && plan_get_current_block() != NULL) { // Check if there is a block to execute.
+    if((vjog.active = plan_get_current_block() != NULL)) {
         set_state(STATE_JOG);
         st_prep_buffer();
-        st_wake_up();  // NOTE: Manual start. No state machine required.
+        st_wake_up();
+    }
+}
+
+// Sets the jog velocity in mm/min for each axis, all zero to stop. Must be called from the foreground process.
+// If not repeated within VELOCITY_JOG_TIMEOUT ms the motion is stopped.
+// NOTE: $J= jog commands must not be mixed with velocity jogging.
+status_code_t mc_jog_velocity (float *velocity)
+{
+    uint_fast8_t idx = N_AXIS;
+    float rate = 0.0f, cos_theta = 0.0f, unit_vec[N_AXIS];
+
+#if VELOCITY_JOG_TIMEOUT
+    // The timeout stops the motion if the host stops sending, refuse velocity jogging if it cannot be timed.
+    if(hal.get_elapsed_ticks == NULL)
+        return Status_GcodeUnsupportedCommand;
+#endif
+
+    if(!(sys.state == STATE_IDLE || (sys.state & (STATE_JOG|STATE_TOOL_CHANGE))))
+        return Status_IdleError;
+
+    vjog.updated = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    vjog.pending = false;
+
+    do {
+        idx--;
+        rate += velocity[idx] * velocity[idx];
+    } while(idx);
+
+    if((rate = sqrtf(rate)) == 0.0f) {
+        velocity_jog_stop();
+        return Status_OK;
+    }
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        unit_vec[idx] = velocity[idx] / rate;
+        cos_theta += unit_vec[idx] * vjog.unit_vec[idx];
+    } while(idx);
+
+    // Change the rate of the executing motions if the direction is unchanged.
+    if(vjog.active && !vjog.stopping && cos_theta >= VELOCITY_JOG_DIRECTION_TOLERANCE) {
+        if(rate != vjog.rate)
+            plan_jog_rate(vjog.rate = rate);
+    } else {
+        vjog.rate = rate;
+        memcpy(vjog.unit_vec, unit_vec, sizeof(unit_vec));
+        vjog.pending = true;
+        if(sys.state & STATE_JOG)
+            velocity_jog_stop();
+        else
+            velocity_jog_start();
     }
 
     return Status_OK;
 }
 
+// Keeps the planner buffer filled with jog motions, starts a pending velocity jog when the machine has
+// stopped and stops a velocity jog that has timed out. Called from protocol_execute_realtime().
+void mc_jog_velocity_poll (void)
+{
+    if(vjog.busy)
+        return;
+
+    if(!(sys.state & STATE_JOG))
+        vjog.active = vjog.stopping = false;
+
+#if VELOCITY_JOG_TIMEOUT
+    if((vjog.active || vjog.pending) && hal.get_elapsed_ticks && hal.get_elapsed_ticks() - vjog.updated >= VELOCITY_JOG_TIMEOUT) {
+        vjog.pending = false;
+        velocity_jog_stop();
+    }
+#endif
+
+    if(vjog.active && !vjog.stopping)
+        velocity_jog_queue();
+    else if(vjog.pending) {
+        if(sys.state == STATE_IDLE || sys.state == STATE_TOOL_CHANGE)
+            velocity_jog_start();
+        else if(!(sys.state & STATE_JOG))
+            vjog.pending = false;
+    }
+}
+
+// Discard any velocity jog, called on soft reset.
+void mc_jog_velocity_reset (void)
+{
+    memset(&vjog, 0, sizeof(velocity_jog_t));
+}
+
+#endif // ENABLE_VELOCITY_JOG
+
 // Execute dwell in seconds.
 void mc_dwell (float seconds)
 {
@@ -741,8 +2016,119 @@ void mc_dwell (float seconds)
         protocol_buffer_synchronize();
         delay_sec(seconds, DelayMode_Dwell);
     }
+#ifdef ENABLE_JOB_ESTIMATE
+    else if(sys.flags.estimate)
+        mc_estimate_delay(seconds);
+#endif
+}
+
+#ifdef ENABLE_JOB_ESTIMATE
+
+/* Job time estimator. The parser runs in check mode with the estimate flag set, mc_line() then still queues
+   motions in the planner. When the core waits for the motions to complete, on auto cycle start, the planner
+   blocks are consumed by the step segment generator and the time of the segments prepared is added up, see
+   st_estimate_segments(). Segments are consumed until a block is freed while the planner buffer is full, or
+   until all blocks are executed when the planner is flushed, so the time matches how far ahead the planner
+   and the segment buffer look when the job is executed.
+   NOTE: A soft reset is required to leave check mode after the estimate is completed, see mc_estimate_end(). */
+
+void mc_estimate_start (void)
+{
+    memset(&estimate, 0, sizeof(job_estimate_t));
+
+    sys.flags.estimate = On;
+    mc_estimate_tool(gc_state.tool->tool);
+}
+
+void mc_estimate_blocks (bool flush)
+{
+    float time;
+    uint_fast16_t available;
+
+#ifdef PLANNER_HOLD_LINE
+    if(flush)
+        plan_flush_held_line();
+#endif
+
+    available = plan_get_block_buffer_available();
+    time = st_estimate_segments(flush) * 60.0f;
+
+    estimate.time += time;
+    estimate.blocks += plan_get_block_buffer_available() - available;
+    if(estimate.tool)
+        estimate.tool->time += time;
 }
 
+// Adds a delay to the estimate after the queued motions are completed.
+void mc_estimate_delay (float seconds)
+{
+    mc_estimate_blocks(true);
+
+    estimate.time += seconds;
+    if(estimate.tool)
+        estimate.tool->time += seconds;
+}
+
+// Accounts for a spindle state change by spindle_sync(), the queued motions are completed first as the planner is
+// synchronized when executed. await is set if the spin-up is awaited by the at speed signal, JOB_ESTIMATE_SPINUP_TIME
+// is then added when the spindle is started or its speed changed. Without the signal the spin-up is not awaited,
+// or with asynchronous spindle start SPINDLE_SPINUP_DELAY is awaited on every start. The latter overlaps the motions
+// queued up to the next feed motion, see mc_estimate_await_spinup().
+void mc_estimate_spindle (spindle_state_t state, float rpm, bool await)
+{
+    bool spinup = state.on && settings.mode != Mode_Laser && (!estimate.spindle.on || rpm != estimate.rpm);
+
+    estimate.spindle = state;
+    estimate.rpm = rpm;
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+    mc_estimate_blocks(true);
+    if(await ? spinup : state.on && settings.mode != Mode_Laser)
+        estimate.spinup = estimate.time + (await ? JOB_ESTIMATE_SPINUP_TIME : SPINDLE_SPINUP_DELAY);
+#else
+    mc_estimate_delay(spinup && await ? JOB_ESTIMATE_SPINUP_TIME : 0.0f);
+#endif
+}
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+
+// Waits for a pending spin-up, called before a feed motion with the spindle on is queued.
+void mc_estimate_await_spinup (void)
+{
+    if(estimate.spinup > 0.0f) {
+        mc_estimate_blocks(true); // Motions queued are executed while the spindle spins up.
+        if(estimate.spinup > estimate.time)
+            mc_estimate_delay(estimate.spinup - estimate.time);
+        estimate.spinup = 0.0f;
+    }
+}
+
+#endif
+
+void mc_estimate_tool (uint32_t tool)
+{
+    uint_fast8_t idx;
+
+    mc_estimate_blocks(true); // Motions queued before the tool change are executed with the previous tool.
+
+    for(idx = 0; idx < estimate.n_tools && estimate.tools[idx].tool != tool; idx++);
+
+    if(idx == estimate.n_tools && estimate.n_tools < JOB_ESTIMATE_TOOLS)
+        estimate.tools[estimate.n_tools++].tool = tool;
+
+    estimate.tool = idx < estimate.n_tools ? &estimate.tools[idx] : NULL;
+}
+
+job_estimate_t *mc_estimate_end (void)
+{
+    mc_estimate_blocks(true);
+    sys.flags.estimate = Off;
+
+    return &estimate;
+}
+
+#endif // ENABLE_JOB_ESTIMATE
+
 
 // Perform homing cycle to locate and set machine zero. Only '$H' executes this command.
 // NOTE: There should be no motions in the buffer and Grbl must be in an idle state before
@@ -780,7 +2166,11 @@ status_code_t mc_homing_cycle (axes_signals_t cycle)
         hal.stream.enqueue_realtime_command(CMD_STATUS_REPORT); // Force a status report and
         delay_sec(0.1f, DelayMode_Dwell);                       // delay a bit to get it sent (or perhaps wait a bit for a request?)
 #endif
+#ifdef HOMING_FAST_LOCATE
+        hal.limits.enable(true, true); // Keep limit pin change interrupts enabled for latching switch contacts, hard limits are not active while homing
+#else
         hal.limits.enable(false, true); // Disable hard limits pin change register for cycle duration
+#endif
 
         // Turn off spindle and coolant (and update parser state)
         gc_state.spindle.rpm = 0.0f;
@@ -855,8 +2245,16 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     if (sys.state == STATE_CHECK_MODE)
         return GCProbe_CheckMode;
 
+#ifdef ENABLE_PROBE_QUEUING
+    // Probe motions towards the workpiece are queued behind the motions in the planner buffer, the probe
+    // state is checked and probing is activated by the stepper module when the probe motion is started.
+    bool queued = !parser_flags.probe_is_away;
+#else
+    const bool queued = false;
+#endif
+
     // Finish all queued commands and empty planner buffer before starting probe cycle.
-    if (!protocol_buffer_synchronize())
+    if (!queued && !protocol_buffer_synchronize())
         return GCProbe_Abort; // Return if system reset has been issued.
 
     // Initialize probing control variables
@@ -866,19 +2264,29 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     // After syncing, check if probe is already triggered or not connected. If so, halt and issue alarm.
     // NOTE: This probe initialization error applies to all probing cycles.
     probe_state_t probe = hal.probe.get_state();
-    if (probe.triggered || !probe.connected) { // Check probe state.
+    if (!queued && (probe.triggered || !probe.connected)) { // Check probe state.
         system_set_exec_alarm(Alarm_ProbeFailInitial);
         protocol_execute_realtime();
         hal.probe.configure(false, false); // Re-initialize invert mask before returning.
         return GCProbe_FailInit; // Nothing else to do but bail.
     }
 
+#ifdef ENABLE_PROBE_QUEUING
+    if((pl_data->condition.probing = queued))
+        sys_probing_state = Probing_Queued;
+#endif
+
     // Setup and queue probing motion. Auto cycle-start should not start the cycle.
     if(!mc_line(target, pl_data))
         return GCProbe_Abort;
 
+#ifdef PLANNER_HOLD_LINE
+    plan_flush_held_line(); // Ensure probing motion is not held back by the planner.
+#endif
+
     // Activate the probing state monitor in the stepper module.
-    sys_probing_state = Probing_Active;
+    if(!queued)
+        sys_probing_state = Probing_Active;
 
     // Perform probing cycle. Wait here until probe is triggered or motion completes.
     system_set_exec_state_flag(EXEC_CYCLE_START);
@@ -890,7 +2298,13 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     // Probing cycle complete!
 
     // Set state variables and error out, if the probe failed and cycle with error is enabled.
-    if (sys_probing_state == Probing_Active) {
+#ifdef ENABLE_PROBE_QUEUING
+    bool fail_init = sys_probing_state == Probing_FailInit;
+    if (fail_init)
+        system_set_exec_alarm(Alarm_ProbeFailInitial);
+    else
+#endif
+    if (sys_probing_state != Probing_Off) {
         if (parser_flags.probe_is_no_error)
             memcpy(sys_probe_position, sys_position, sizeof(sys_position));
         else
@@ -907,10 +2321,19 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     plan_reset();           // Reset planner buffer. Zero planner positions. Ensure probing motion is cleared.
     plan_sync_position();   // Sync planner position to current machine position.
 
+#ifdef ENABLE_PROBE_QUEUING
+    if(fail_init)
+        return GCProbe_FailInit; // Probe was triggered or not connected when the probe motion was started.
+#endif
+
     // All done! Output the probe position as message if configured.
     if(settings.status_report.probe_coordinates)
         report_probe_parameters();
 
+#ifdef ENABLE_HEIGHTMAP
+    heightmap_probe_completed();
+#endif
+
     if(grbl.on_probe_completed)
         grbl.on_probe_completed();
 
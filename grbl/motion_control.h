@@ -38,6 +38,17 @@
 // (1 minute)/feed_rate time.
 bool mc_line(float *target, plan_line_data_t *pl_data);
 
+#ifdef ENABLE_DOGLEG_RAPIDS
+
+#ifndef DOGLEG_RAPID_MERGE_FACTOR
+#define DOGLEG_RAPID_MERGE_FACTOR 0.1f // Max fraction of extra time for an axis to end in the same line as the previous.
+#endif
+
+// Execute a rapid motion from position to target with each axis moving in its own max rate and acceleration
+// limited profile, Z is moved separately, first if moving up and last if moving down.
+bool mc_rapid (float *target, plan_line_data_t *pl_data, float *position);
+#endif
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, is_clockwise_arc boolean. Used
@@ -49,11 +60,117 @@ void mc_arc(float *target, plan_line_data_t *pl_data, float *position, float *of
 void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_data, float *position, plane_t plane, uint32_t repeats, gc_canned_t *canned);
 
 // Execute canned cycle (threading)
-void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thread, bool feed_hold_disabled);
+void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thread, gc_override_flags_t overrides);
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+// Queue more motions of the active canned cycle, if any
+void mc_cycle_resume (void);
+
+// Wait for the active canned cycle to be completely queued
+bool mc_cycle_flush (void);
+
+// Discard the active canned cycle
+void mc_cycle_reset (void);
+#endif
+
+#ifdef ENABLE_PARSE_AHEAD
+
+#ifndef PARSE_AHEAD_QUEUE_SIZE
+#define PARSE_AHEAD_QUEUE_SIZE 16 // Number of parsed motions kept queued while the planner buffer is full, plus one
+#endif
+
+// Move queued parsed motions to the planner buffer while there is room
+void mc_parse_ahead_poll (void);
+
+// Returns true if parsed motions are waiting for room in the planner buffer
+bool mc_parse_ahead_pending (void);
+
+// Discard queued parsed motions
+void mc_parse_ahead_reset (void);
+#endif
+
+#ifdef ENABLE_JOB_ESTIMATE
+
+#ifndef JOB_ESTIMATE_TOOLS
+#define JOB_ESTIMATE_TOOLS 16 // Number of tools the run time is accumulated for.
+#endif
+
+#ifndef JOB_ESTIMATE_SPINUP_TIME
+#define JOB_ESTIMATE_SPINUP_TIME SAFETY_DOOR_SPINDLE_DELAY // Spin-up time (s) assumed when awaited by the at speed signal.
+#endif
+
+typedef struct {
+    uint32_t tool;
+    float time;                 // Run time with the tool (s)
+} job_tool_time_t;
+
+typedef struct {
+    float time;                 // Total run time (s)
+    uint32_t blocks;            // Planner blocks consumed
+    uint_fast8_t n_tools;       // Number of tools used, time for tools exceeding JOB_ESTIMATE_TOOLS is only added to the total
+    job_tool_time_t *tool;      // Current tool, NULL if tool time is not tracked
+    job_tool_time_t tools[JOB_ESTIMATE_TOOLS];
+    spindle_state_t spindle;    // Spindle state and speed set by the last spindle_sync()
+    float rpm;
+    float spinup;               // Time the spindle is at speed after an asynchronous start (s), 0 if none pending
+} job_estimate_t;
+
+// Start the job time estimator, the system must be in check mode
+void mc_estimate_start (void);
+
+// Consume the oldest planner block, or all blocks if flush is true, adding their run time to the estimate
+void mc_estimate_blocks (bool flush);
+
+// Add a delay (s) to the estimate after the queued motions are completed
+void mc_estimate_delay (float seconds);
+
+// Account for a spindle state change, await is set if the spin-up is awaited when executed
+void mc_estimate_spindle (spindle_state_t state, float rpm, bool await);
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+// Wait for an asynchronous spindle start to complete before a feed motion
+void mc_estimate_await_spinup (void);
+#endif
+
+// Change tool for the per tool run time estimate
+void mc_estimate_tool (uint32_t tool);
+
+// Stop the job time estimator and return the estimate
+job_estimate_t *mc_estimate_end (void);
+
+#endif
 
 // Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
 status_code_t mc_jog_execute(plan_line_data_t *pl_data, parser_block_t *gc_block);
 
+// Jog the axes by distance from the current position, for plugins.
+status_code_t mc_jog_relative (float *distance, float feed_rate);
+
+#ifdef ENABLE_VELOCITY_JOG
+
+#ifndef VELOCITY_JOG_TIMEOUT
+#define VELOCITY_JOG_TIMEOUT 500 // ms
+#endif
+#ifndef VELOCITY_JOG_DISTANCE
+#define VELOCITY_JOG_DISTANCE 10.0f // mm, length of each jog motion queued
+#endif
+#ifndef VELOCITY_JOG_BLOCKS
+#define VELOCITY_JOG_BLOCKS 8 // Number of jog motions kept queued, must be less than the planner buffer size
+#endif
+#ifndef VELOCITY_JOG_DIRECTION_TOLERANCE
+#define VELOCITY_JOG_DIRECTION_TOLERANCE 0.9999f // cosine of the angle between directions considered unchanged
+#endif
+
+// Set the jog velocity of each axis
+status_code_t mc_jog_velocity (float *velocity);
+
+// Start pending and stop timed out velocity jogs
+void mc_jog_velocity_poll (void);
+
+// Discard any velocity jog
+void mc_jog_velocity_reset (void);
+#endif
+
 // Dwell for a specific number of seconds
 void mc_dwell(float seconds);
 
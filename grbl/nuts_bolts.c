@@ -36,7 +36,7 @@
 
 #define MAX_PRECISION 10
 
-static char buf[STRLEN_COORDVALUE + 1];
+static THREAD_LOCAL char buf[STRLEN_COORDVALUE + 1];
 
 static const float froundvalues[MAX_PRECISION + 1] =
 {
@@ -90,17 +90,35 @@ char *uitoa (uint32_t n)
 // The integers is then efficiently converted to a string.
 char *ftoa (float n, uint8_t decimal_places)
 {
-    bool isNegative;
-    char *bptr = buf + sizeof(buf);
+    ftoa_append(buf, n, decimal_places);
 
-    *--bptr = '\0';
+    return buf;
+}
+
+// Convert float to string written directly to s, for assembling several values without intermediate copies.
+// NOTE: returns pointer to null terminator!
+char *ftoa_append (char *s, float n, uint8_t decimal_places)
+{
+    char digits[10], *bptr = digits;
 
-    if ((isNegative = n < 0.0f))
+    if (n < 0.0f) {
         n = -n;
+        *s++ = '-';
+    }
 
     n += froundvalues[decimal_places];
 
-    uint32_t a = (uint32_t)n;
+    uint32_t a = (uint32_t)n, i = a;
+
+    do { // Integer digits, least significant first.
+        *bptr++ = (i % 10) + '0';
+        i /= 10;
+    } while(i);
+
+    while(bptr != digits)
+        *s++ = *--bptr;
+
+    *s++ = '.'; // Always add decimal point (TODO: is this really needed?)
 
     if (decimal_places) {
 
@@ -117,6 +135,8 @@ char *ftoa (float n, uint8_t decimal_places)
 
         uint32_t b = (uint32_t)n;
 
+        bptr = s += decimal_places;
+
         while(decimal_places--) {
             if(b) {
                 *--bptr = (b % 10) + '0'; // Get digit
@@ -126,44 +146,28 @@ char *ftoa (float n, uint8_t decimal_places)
         }
     }
 
-    *--bptr = '.'; // Always add decimal point (TODO: is this really needed?)
-
-    if(a == 0)
-        *--bptr = '0';
-
-    else while(a) {
-        *--bptr = (a % 10) + '0'; // Get digit
-        a /= 10;
-    }
-
-    if(isNegative)
-        *--bptr = '-';
+    *s = '\0';
 
-    return bptr;
+    return s;
 }
 
-// Extracts a floating point value from a string. The following code is based loosely on
-// the avr-libc strtod() function by Michael Stumpf and Dmitry Xmelkov and many freely
-// available conversion method examples, but has been highly optimized for Grbl. For known
-// CNC applications, the typical decimal value is expected to be in the range of E0 to E-4.
-// Scientific notation is officially not supported by g-code, and the 'E' character may
-// be a g-code word on some CNC systems. So, 'E' notation will not be recognized.
-// NOTE: Thanks to Radu-Eosif Mihailescu for identifying the issues with using strtod().
-bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
+// Powers of ten used for decimal scaling, all are exactly representable as floats.
+static const float pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+// Extracts the digits of a decimal number from a string into an integer, the decimal point
+// position is returned in terms of a decimal exponent. Digits exceeding MAX_INT_DIGITS are dropped.
+// Returns the pointer to the character following the number or NULL if no digits were found.
+static char *read_decimal (char *ptr, uint32_t *intval, int_fast8_t *exp)
 {
-    char *ptr = line + *char_counter;
-    int_fast8_t exp = 0;
     uint_fast8_t ndigit = 0, c;
-    uint32_t intval = 0;
-    bool isnegative, isdecimal = false;
+    bool isdecimal = false;
+
+    *intval = 0;
+    *exp = 0;
 
     // Grab first character and increment pointer. No spaces assumed in line.
     c = *ptr++;
 
-    // Capture initial positive/minus character
-    if ((isnegative = (c == '-')) || c == '+')
-        c = *ptr++;
-
     // Extract number into fast integer. Track decimal in terms of exponent value.
     while(c) {
         c -= '0';
@@ -171,10 +175,10 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
             ndigit++;
             if (ndigit <= MAX_INT_DIGITS) {
                 if (isdecimal)
-                    exp--;
-                intval = (((intval << 2) + intval) << 1) + c; // intval*10 + c
+                    (*exp)--;
+                *intval = (((*intval << 2) + *intval) << 1) + c; // intval*10 + c
             } else if (!isdecimal)
-                exp++;  // Drop overflow digits
+                (*exp)++;  // Drop overflow digits
         } else if (c == (uint_fast8_t)('.' - '0') && !isdecimal)
             isdecimal = true;
          else
@@ -183,30 +187,79 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
         c = *ptr++;
     }
 
+    return ndigit ? ptr - 1 : NULL;
+}
+
+// Extracts a floating point value from a string. The following code is based loosely on
+// the avr-libc strtod() function by Michael Stumpf and Dmitry Xmelkov and many freely
+// available conversion method examples, but has been highly optimized for Grbl. For known
+// CNC applications, the typical decimal value is expected to be in the range of E0 to E-4.
+// Scientific notation is officially not supported by g-code, and the 'E' character may
+// be a g-code word on some CNC systems. So, 'E' notation will not be recognized.
+// NOTE: Thanks to Radu-Eosif Mihailescu for identifying the issues with using strtod().
+bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
+{
+    char *ptr = line + *char_counter;
+    int_fast8_t exp;
+    uint32_t intval;
+    bool isnegative;
+
+    // Capture initial positive/minus character
+    if ((isnegative = (*ptr == '-')) || *ptr == '+')
+        ptr++;
+
     // Return if no digits have been read.
-    if (!ndigit)
+    if (!(ptr = read_decimal(ptr, &intval, &exp)))
         return false;
 
     // Convert integer into floating point.
     float fval = (float)intval;
 
-    // Apply decimal. Should perform no more than two floating point multiplications for the
-    // expected range of E0 to E-4.
+    // Apply decimal. A single division by an exact power of ten is used for the fraction, avoiding the
+    // rounding errors accumulated by multiplying with inexact 0.1 factors.
     if (fval != 0.0f) {
-        while (exp <= -2) {
-            fval *= 0.01f;
-            exp += 2;
-        }
         if (exp < 0)
-            fval *= 0.1f;
-        else if (exp > 0) do {
-            fval *= 10.0f;
-        } while (--exp > 0);
+            fval /= pow10[-exp];
+        else while (exp > 0) {
+            int_fast8_t n = exp > 10 ? 10 : exp;
+            fval *= pow10[n];
+            exp -= n;
+        }
     }
 
     // Assign floating point value with correct sign.
     *float_ptr = isnegative ? - fval : fval;
-    *char_counter = ptr - line - 1; // Set char_counter to next statement
+    *char_counter = ptr - line; // Set char_counter to next statement
+
+    return true;
+}
+
+// Reads an unsigned decimal value from a string without float conversion. The integer part is
+// returned in int_ptr and the first two decimals, rounded, in mantissa as hundredths (G38.2 -> 38, 20).
+// Returns true when it succeeds, signs are not accepted.
+bool read_uint (char *line, uint_fast8_t *char_counter, uint32_t *int_ptr, uint_fast16_t *mantissa)
+{
+    char *ptr = line + *char_counter;
+    int_fast8_t exp;
+    uint32_t intval, scale;
+
+    if (!(ptr = read_decimal(ptr, &intval, &exp)))
+        return false;
+
+    if (exp >= 0) {
+        while (exp-- > 0)
+            intval *= 10;
+        *int_ptr = intval;
+        *mantissa = 0;
+    } else {
+        scale = (uint32_t)pow10[-exp];
+        *int_ptr = intval / scale;
+        intval -= *int_ptr * scale;
+        // Scale the fraction to hundredths, rounding any remaining digits.
+        *mantissa = exp >= -2 ? intval * (exp == -1 ? 10 : 1) : (intval + scale / 200) / (scale / 100);
+    }
+
+    *char_counter = ptr - line; // Set char_counter to next statement
 
     return true;
 }
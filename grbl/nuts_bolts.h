@@ -143,6 +143,10 @@ char *uitoa (uint32_t n);
 // Converts a float variable to string with the specified number of decimal places.
 char *ftoa (float n, uint8_t decimal_places);
 
+// Converts a float variable to string with the specified number of decimal places, written to s.
+// NOTE: returns pointer to null terminator!
+char *ftoa_append (char *s, float n, uint8_t decimal_places);
+
 // Returns true if float value is a whole number (integer)
 bool isintf (float value);
 
@@ -151,6 +155,10 @@ bool isintf (float value);
 // a pointer to the result variable. Returns true when it succeeds
 bool read_float(char *line, uint_fast8_t *char_counter, float *float_ptr);
 
+// Read an unsigned decimal value from a string, returning the integer part and the mantissa
+// as hundredths. Used for command numbers where no float conversion is needed.
+bool read_uint(char *line, uint_fast8_t *char_counter, uint32_t *int_ptr, uint_fast16_t *mantissa);
+
 // Non-blocking delay function used for general operation and suspend features.
 void delay_sec(float seconds, delaymode_t mode);
 
@@ -38,7 +38,7 @@
 #define NVS_ADDR_PARAMETERS     512U
 #define NVS_ADDR_BUILD_INFO     942U
 #define NVS_ADDR_STARTUP_BLOCK  (NVS_ADDR_BUILD_INFO - 1 - N_STARTUP_LINE * (sizeof(stored_line_t) + NVS_CRC_BYTES))
-#ifdef N_TOOLS
+#if defined(N_TOOLS) && !defined(TOOL_TABLE_CACHE)
 #define NVS_ADDR_TOOL_TABLE     (NVS_ADDR_PARAMETERS - 1 - N_TOOLS * (sizeof(tool_data_t) + NVS_CRC_BYTES))
 #endif
 
@@ -62,6 +62,22 @@ typedef enum {
     NVS_TransferResult_OK,
 } nvs_transfer_result_t;
 
+#ifdef ENABLE_NVS_JOURNAL
+
+// Optional low level access to flash storage, used for journaled storage of the NVS buffer.
+// The flash area is split in two banks of equal size that can be erased separately, each must be large
+// enough to hold the NVS image and a number of update records. Flash content is read via the bank addresses.
+typedef struct {
+    uint32_t bank_size;     // Size of each bank in bytes.
+    const uint8_t *bank[2]; // Memory mapped start address of each bank.
+    bool (*erase)(uint_fast8_t bank);
+    // Program size bytes from source to a flash location. Destination and size are multiples of NVS_JOURNAL_ALIGN,
+    // source is word aligned. Return false on failure.
+    bool (*program)(const uint8_t *destination, uint8_t *source, uint32_t size);
+} nvs_journal_io_t;
+
+#endif
+
 typedef struct {
     nvs_type type;
     uint16_t size;
@@ -72,6 +88,9 @@ typedef struct {
     nvs_transfer_result_t (*memcpy_from_nvs)(uint8_t *destination, uint32_t source, uint32_t size, bool with_checksum);
     bool (*memcpy_from_flash)(uint8_t *dest);
     bool (*memcpy_to_flash)(uint8_t *source);
+#ifdef ENABLE_NVS_JOURNAL
+    nvs_journal_io_t journal; // Optional, replaces memcpy_from_flash and memcpy_to_flash when program is set.
+#endif
 } nvs_io_t;
 
 #endif
@@ -33,11 +33,17 @@
 #include "nvs_buffer.h"
 #include "protocol.h"
 
-static uint8_t *nvsbuffer = NULL;
-static nvs_io_t physical_nvs;
-static bool dirty;
+static THREAD_LOCAL uint8_t *nvsbuffer = NULL;
+static THREAD_LOCAL nvs_io_t physical_nvs;
+static THREAD_LOCAL bool dirty;
+static THREAD_LOCAL bool (*write_physical)(uint32_t addr, uint32_t size) = NULL;
+static THREAD_LOCAL uint_fast8_t sync_budget;
+
+#ifndef NVS_SYNC_REGIONS
+#define NVS_SYNC_REGIONS 1 // (1-255)
+#endif
 
-settings_dirty_t settings_dirty;
+THREAD_LOCAL settings_dirty_t settings_dirty;
 
 typedef struct {
     uint16_t addr;
@@ -53,13 +59,13 @@ typedef struct {
 
 #define PARAMETER_ADDR(n) (NVS_ADDR_PARAMETERS + n * (sizeof(coord_data_t) + NVS_CRC_BYTES))
 #define STARTLINE_ADDR(n) (NVS_ADDR_STARTUP_BLOCK + n * (sizeof(stored_line_t) + NVS_CRC_BYTES))
-#ifdef N_TOOLS
+#ifdef NVS_ADDR_TOOL_TABLE
 #define TOOL_ADDR(n) (NVS_ADDR_TOOL_TABLE + n * (sizeof(tool_data_t) + NVS_CRC_BYTES))
 #endif
 
 static const emap_t target[] = {
     {NVS_ADDR_GLOBAL, NVS_GROUP_GLOBAL, 0},
-#ifdef N_TOOLS
+#ifdef NVS_ADDR_TOOL_TABLE
     {TOOL_ADDR(0), NVS_GROUP_TOOLS, 0},
     {TOOL_ADDR(1), NVS_GROUP_TOOLS, 1},
     {TOOL_ADDR(2), NVS_GROUP_TOOLS, 2},
@@ -146,7 +152,7 @@ static nvs_transfer_result_t memcpy_to_ram (uint32_t destination, uint8_t *sourc
                 case NVS_GROUP_GLOBAL:
                     settings_dirty.global_settings = true;
                     break;
-#ifdef N_TOOLS
+#ifdef NVS_ADDR_TOOL_TABLE
                 case NVS_GROUP_TOOLS:
                     settings_dirty.tool_data |= (1 << target[idx].offset);
                     break;
@@ -182,6 +188,239 @@ static nvs_transfer_result_t memcpy_from_ram (uint8_t *destination, uint32_t sou
     return with_checksum ? (checksum == ram_get_byte(source) ? NVS_TransferResult_OK : NVS_TransferResult_Failed) : NVS_TransferResult_OK;
 }
 
+#ifdef ENABLE_NVS_JOURNAL
+
+/* Journaled flash storage. Each bank holds a header, an image of the NVS buffer and a log of update records
+   appended when parts of the buffer are changed. A record consists of the buffer address and size of the
+   data (NVS_ADDR_GLOBAL, a coordinate system, a tool...), the data and a check word, padded to NVS_JOURNAL_ALIGN.
+   When the active bank is full the buffer is written as a new image to the other bank (compaction), the now
+   obsolete bank is erased on a later sync pass so that flash erases are not stacked.
+   On startup the bank with the highest sequence number is loaded and its records replayed.
+   Image headers and record check words are written last so that an interrupted write is detected on startup. */
+
+#ifndef NVS_JOURNAL_ALIGN
+#define NVS_JOURNAL_ALIGN 4 // Flash programming granularity in bytes, power of 2 in the range 4 - 32.
+#endif
+
+#define JOURNAL_MAGIC 0x4A53564EUL // "NVSJ"
+#define JOURNAL_ALIGN(n) (((n) + NVS_JOURNAL_ALIGN - 1) & ~(NVS_JOURNAL_ALIGN - 1))
+#define JOURNAL_IMAGE JOURNAL_ALIGN(sizeof(journal_header_t))
+#define JOURNAL_CHUNK 32
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t size;              // Image size.
+} journal_header_t;
+
+typedef struct {
+    uint16_t addr;
+    uint16_t size;
+} journal_record_t;
+
+static THREAD_LOCAL struct {
+    bool spare_erased;
+    bool compacted;             // Content written as image in the current sync pass.
+    uint_fast8_t bank;          // Active bank.
+    uint32_t sequence;
+    uint32_t image_size;
+    uint32_t offset;            // Start of free space in the active bank.
+} journal;
+
+static THREAD_LOCAL struct {
+    bool ok;
+    const uint8_t *dest;
+    uint_fast8_t fill;
+    uint32_t data[JOURNAL_CHUNK / sizeof(uint32_t)];
+} writer;
+
+static void journal_put (uint8_t *data, uint32_t size)
+{
+    while(size-- && writer.ok) {
+        ((uint8_t *)writer.data)[writer.fill++] = *data++;
+        if(writer.fill == JOURNAL_CHUNK) {
+            writer.ok = physical_nvs.journal.program(writer.dest, (uint8_t *)writer.data, JOURNAL_CHUNK);
+            writer.dest += JOURNAL_CHUNK;
+            writer.fill = 0;
+        }
+    }
+}
+
+// Pad the pending data with erased bytes to the programming granularity and write it out.
+static bool journal_flush (void)
+{
+    if(writer.fill && writer.ok) {
+        uint_fast8_t size = JOURNAL_ALIGN(writer.fill);
+        memset((uint8_t *)writer.data + writer.fill, 0xFF, size - writer.fill);
+        writer.ok = physical_nvs.journal.program(writer.dest, (uint8_t *)writer.data, size);
+        writer.dest += size;
+        writer.fill = 0;
+    }
+
+    return writer.ok;
+}
+
+static void journal_begin (const uint8_t *dest)
+{
+    writer.ok = true;
+    writer.dest = dest;
+    writer.fill = 0;
+}
+
+inline static bool journal_bank_erased (uint_fast8_t bank)
+{
+    uint32_t idx = physical_nvs.journal.bank_size;
+    const uint8_t *data = physical_nvs.journal.bank[bank];
+
+    while(idx && data[--idx] == 0xFF);
+
+    return data[idx] == 0xFF;
+}
+
+// Write the NVS buffer as an image to the spare bank and switch to it.
+static bool journal_compact (void)
+{
+    uint_fast8_t spare = journal.bank ^ 1;
+    journal_header_t header = {
+        .magic = JOURNAL_MAGIC,
+        .sequence = journal.sequence + 1,
+        .size = journal.image_size
+    };
+
+    if(!(journal.spare_erased || physical_nvs.journal.erase(spare)))
+        return false;
+
+    journal_begin(physical_nvs.journal.bank[spare] + JOURNAL_IMAGE);
+    journal_put(nvsbuffer, journal.image_size);
+    journal.spare_erased = false;
+
+    if(!journal_flush())
+        return false;
+
+    journal_begin(physical_nvs.journal.bank[spare]);
+    journal_put((uint8_t *)&header, sizeof(journal_header_t));
+
+    if(!journal_flush())
+        return false;
+
+    journal.bank = spare;
+    journal.sequence = header.sequence;
+    journal.offset = JOURNAL_IMAGE + JOURNAL_ALIGN(journal.image_size);
+    journal.compacted = true;
+
+    return true;
+}
+
+// Append a record for size bytes of the NVS buffer starting at addr, compact if no room left.
+static bool journal_write (uint32_t addr, uint32_t size)
+{
+    if(journal.compacted)
+        return true;
+
+    uint32_t length = JOURNAL_ALIGN(sizeof(journal_record_t) + size + 2);
+
+    if(journal.offset + length > physical_nvs.journal.bank_size)
+        return journal_compact();
+
+    uint8_t check[2];
+    const uint8_t *dest = physical_nvs.journal.bank[journal.bank] + journal.offset;
+    journal_record_t record = {
+        .addr = (uint16_t)addr,
+        .size = (uint16_t)size
+    };
+
+    check[0] = calc_checksum(nvsbuffer + addr, size) ^ (uint8_t)addr;
+    check[1] = ~check[0];
+
+    journal_begin(dest);
+    journal_put((uint8_t *)&record, sizeof(journal_record_t));
+    journal_put(nvsbuffer + addr, size);
+    journal_put(check, 2);
+
+    // A failed write leaves the log unusable, continue in the other bank.
+    if(!journal_flush())
+        return journal_compact();
+
+    journal.offset += length;
+
+    return true;
+}
+
+// Load the image and replay the records of the most recent bank to the NVS buffer.
+// Returns false if no valid bank was found.
+static bool journal_load (void)
+{
+    uint_fast8_t bank = 2;
+    const journal_header_t *header[2] = {
+        (const journal_header_t *)physical_nvs.journal.bank[0],
+        (const journal_header_t *)physical_nvs.journal.bank[1]
+    };
+
+    journal.image_size = hal.nvs.size;
+    journal.spare_erased = journal.compacted = false;
+
+    if(header[0]->magic == JOURNAL_MAGIC)
+        bank = 0;
+
+    if(header[1]->magic == JOURNAL_MAGIC && (bank == 2 || (int32_t)(header[1]->sequence - header[0]->sequence) > 0))
+        bank = 1;
+
+    if(bank == 2) {
+        journal.bank = 1;
+        journal.sequence = 0;
+        journal.offset = physical_nvs.journal.bank_size; // Force compaction on first write.
+        return false;
+    }
+
+    journal.bank = bank;
+    journal.sequence = header[bank]->sequence;
+    journal.offset = JOURNAL_IMAGE + JOURNAL_ALIGN(header[bank]->size);
+    journal.spare_erased = journal_bank_erased(bank ^ 1);
+
+    memcpy(nvsbuffer, physical_nvs.journal.bank[bank] + JOURNAL_IMAGE, min(header[bank]->size, journal.image_size));
+
+    bool ok = header[bank]->size == journal.image_size;
+    const uint8_t *data;
+    journal_record_t record;
+
+    while(journal.offset + JOURNAL_ALIGN(sizeof(journal_record_t) + 2) <= physical_nvs.journal.bank_size) {
+
+        data = physical_nvs.journal.bank[bank] + journal.offset;
+        memcpy(&record, data, sizeof(journal_record_t));
+
+        if(record.addr == 0xFFFF && record.size == 0xFFFF)
+            break;
+
+        data += sizeof(journal_record_t);
+
+        // Bail on an interrupted or otherwise invalid record, all updates following it are lost.
+        if(journal.offset + JOURNAL_ALIGN(sizeof(journal_record_t) + record.size + 2) > physical_nvs.journal.bank_size ||
+            data[record.size] != (uint8_t)(calc_checksum((uint8_t *)data, record.size) ^ (uint8_t)record.addr) ||
+             data[record.size + 1] != (uint8_t)~data[record.size]) {
+            ok = false;
+            break;
+        }
+
+        if(record.addr + record.size <= journal.image_size)
+            memcpy(nvsbuffer + record.addr, data, record.size);
+
+        journal.offset += JOURNAL_ALIGN(sizeof(journal_record_t) + record.size + 2);
+    }
+
+    // Write a fresh image if the bank content could not be fully recovered or the image size has changed.
+    if(!ok)
+        journal_compact();
+
+    return true;
+}
+
+#endif
+
+static bool memcpy_to_physical (uint32_t addr, uint32_t size)
+{
+    return physical_nvs.memcpy_to_nvs(addr, (uint8_t *)(nvsbuffer + addr), size, false) == NVS_TransferResult_OK;
+}
+
 static void nvs_warning (uint_fast16_t state)
 {
     report_message("Not enough heap for NVS buffer!", Message_Warning);
@@ -197,6 +436,12 @@ bool nvs_buffer_alloc (void)
     return nvsbuffer != NULL;
 }
 
+// Returns the size of the RAM buffer, 0 if not allocated.
+uint32_t nvs_buffer_get_size (void)
+{
+    return nvsbuffer ? NVS_SIZE : 0;
+}
+
 //
 // Switch over to RAM based copy.
 // Changes to RAM based copy will be written to physical storage when Grbl is in IDLE state.
@@ -206,6 +451,20 @@ bool nvs_buffer_init (void)
 
         memcpy(&physical_nvs, &hal.nvs, sizeof(nvs_io_t)); // save pointers to physical storage handler functions
 
+        bool loaded = true;
+
+        if(physical_nvs.memcpy_to_nvs)
+            write_physical = memcpy_to_physical;
+
+#ifdef ENABLE_NVS_JOURNAL
+        // Use journaled storage if available and the banks have room for the image and some update records.
+        if(physical_nvs.type == NVS_Flash && physical_nvs.journal.program &&
+            physical_nvs.journal.bank_size >= JOURNAL_IMAGE + JOURNAL_ALIGN(hal.nvs.size) + 8 * JOURNAL_ALIGN(sizeof(journal_record_t) + sizeof(coord_data_t) + 2)) {
+            write_physical = journal_write;
+            loaded = journal_load();
+        } else
+#endif
+
         // Copy physical storage content to RAM when available
         if(physical_nvs.type == NVS_Flash)
             physical_nvs.memcpy_from_flash(nvsbuffer);
@@ -223,11 +482,16 @@ bool nvs_buffer_init (void)
 
         // If no physical storage available or if NVS import fails copy default settings to RAM
         // and write out to physical storage when available.
-        if(physical_nvs.type == NVS_None || ram_get_byte(0) != SETTINGS_VERSION) {
+        if(physical_nvs.type == NVS_None || !loaded || ram_get_byte(0) != SETTINGS_VERSION) {
             settings_restore(settings_all);
+#ifdef ENABLE_NVS_JOURNAL
+            if(write_physical == journal_write)
+                ; // Journal is written by settings_restore()
+            else
+#endif
             if(physical_nvs.type == NVS_Flash)
                 physical_nvs.memcpy_to_flash(nvsbuffer);
-            else
+            else if(physical_nvs.type != NVS_None)
                 physical_nvs.memcpy_to_nvs(0, nvsbuffer, GRBL_NVS_SIZE + hal.nvs.driver_area.size, false);
             grbl.report.status_message(Status_SettingReadFail);
         }
@@ -244,7 +508,7 @@ bool nvs_buffer_init (void)
 // NOTE: allocation has to be done before content is copied from physical storage.
 uint32_t nvs_alloc (size_t size)
 {
-    static uint8_t *mem_address;
+    static THREAD_LOCAL uint8_t *mem_address;
 
     uint32_t addr = 0;
 
@@ -269,27 +533,41 @@ uint32_t nvs_alloc (size_t size)
     return addr;
 }
 
-// Write RAM changes to physical storage
-void nvs_buffer_sync_physical (void)
+// Write a dirty region to physical storage if the number of regions allowed for the current pass is not exhausted.
+// Returns true if the region was written.
+static bool sync_region (uint32_t addr, uint32_t size)
+{
+    if(sync_budget == 0)
+        return false;
+
+    sync_budget--;
+
+    return write_physical(addr, size);
+}
+
+// Write up to regions dirty regions of the RAM copy to physical storage.
+static void sync_physical (uint_fast8_t regions)
 {
     if(!settings_dirty.is_dirty)
         return;
 
-    if(physical_nvs.memcpy_to_nvs) {
+    if(write_physical) {
+
+        sync_budget = regions;
 
-        if(settings_dirty.build_info)
-            settings_dirty.build_info = physical_nvs.memcpy_to_nvs(NVS_ADDR_BUILD_INFO, (uint8_t *)(nvsbuffer + NVS_ADDR_BUILD_INFO), sizeof(stored_line_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
+        if(settings_dirty.build_info && sync_region(NVS_ADDR_BUILD_INFO, sizeof(stored_line_t) + NVS_CRC_BYTES))
+            settings_dirty.build_info = false;
 
-        if(settings_dirty.global_settings)
-            settings_dirty.global_settings = physical_nvs.memcpy_to_nvs(NVS_ADDR_GLOBAL, (uint8_t *)(nvsbuffer + NVS_ADDR_GLOBAL), sizeof(settings_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
+        if(settings_dirty.global_settings && sync_region(NVS_ADDR_GLOBAL, sizeof(settings_t) + NVS_CRC_BYTES))
+            settings_dirty.global_settings = false;
 
-        uint_fast8_t idx = N_STARTUP_LINE, offset;
+        uint_fast8_t idx = N_STARTUP_LINE;
+        uint32_t offset;
         if(settings_dirty.startup_lines) do {
             idx--;
             if(bit_istrue(settings_dirty.startup_lines, bit(idx))) {
-                bit_false(settings_dirty.startup_lines, bit(idx));
                 offset = NVS_ADDR_STARTUP_BLOCK + idx * (sizeof(stored_line_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(stored_line_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
+                if(sync_region(offset, sizeof(stored_line_t) + NVS_CRC_BYTES))
                     bit_false(settings_dirty.startup_lines, bit(idx));
             }
         } while(idx);
@@ -298,25 +576,23 @@ void nvs_buffer_sync_physical (void)
         if(settings_dirty.coord_data) do {
             if(bit_istrue(settings_dirty.coord_data, bit(idx))) {
                 offset = NVS_ADDR_PARAMETERS + idx * (sizeof(coord_data_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(coord_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
+                if(sync_region(offset, sizeof(coord_data_t) + NVS_CRC_BYTES))
                     bit_false(settings_dirty.coord_data, bit(idx));
             }
         } while(idx--);
 
         if(settings_dirty.driver_settings) {
-            if(hal.nvs.driver_area.size > 0)
-                settings_dirty.driver_settings = physical_nvs.memcpy_to_nvs(hal.nvs.driver_area.address, (uint8_t *)(nvsbuffer + hal.nvs.driver_area.address), hal.nvs.driver_area.size, false) != NVS_TransferResult_OK;
-            else
+            if(hal.nvs.driver_area.size == 0 || sync_region(hal.nvs.driver_area.address, hal.nvs.driver_area.size))
                 settings_dirty.driver_settings = false;
         }
 
-#ifdef N_TOOLS
+#ifdef NVS_ADDR_TOOL_TABLE
         idx = N_TOOLS;
         if(settings_dirty.tool_data) do {
             idx--;
             if(bit_istrue(settings_dirty.tool_data, bit(idx))) {
                 offset = NVS_ADDR_TOOL_TABLE + idx * (sizeof(tool_data_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(tool_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
+                if(sync_region(offset, sizeof(tool_data_t) + NVS_CRC_BYTES))
                     bit_false(settings_dirty.tool_data, bit(idx));
             }
         } while(idx);
@@ -325,22 +601,64 @@ void nvs_buffer_sync_physical (void)
                                    settings_dirty.global_settings ||
                                     settings_dirty.driver_settings ||
                                      settings_dirty.startup_lines ||
-#ifdef N_TOOLS
+#ifdef NVS_ADDR_TOOL_TABLE
                                       settings_dirty.tool_data ||
 #endif
                                        settings_dirty.build_info;
 
+#ifdef ENABLE_NVS_JOURNAL
+        if(write_physical == journal_write) {
+            // Erase the bank freed by compaction on a pass with nothing else to write, keep pass requested until done.
+            if(!journal.compacted && !journal.spare_erased && !settings_dirty.is_dirty && sync_budget == regions)
+                journal.spare_erased = physical_nvs.journal.erase(journal.bank ^ 1);
+            else
+                settings_dirty.is_dirty |= !journal.spare_erased;
+            journal.compacted = false;
+        }
+#endif
+
     } else if(physical_nvs.memcpy_to_flash) {
         physical_nvs.memcpy_to_flash(nvsbuffer);
         settings_dirty.is_dirty = false;
     }
 }
 
+// Write all RAM changes to physical storage
+void nvs_buffer_sync_physical (void)
+{
+    sync_physical(UINT_FAST8_MAX);
+}
+
+// Write RAM changes to physical storage, NVS_SYNC_REGIONS dirty regions (global settings, a coordinate system,
+// a tool...) per call. Called from the foreground when idle, remaining regions are written on the following passes
+// so that realtime commands are served in between the writes.
+void nvs_buffer_sync_deferred (void)
+{
+    sync_physical(NVS_SYNC_REGIONS);
+}
+
 nvs_io_t *nvs_buffer_get_physical (void)
 {
     return hal.nvs.type == NVS_Emulated ? &physical_nvs : &hal.nvs;
 }
 
+#ifdef ENABLE_NVS_CHECKPOINT
+
+// Writes data with checksum to the RAM copy without flagging it as dirty and directly to physical storage.
+// For small records written while a job is running, may be called from an interrupt context.
+ISR_CODE nvs_transfer_result_t nvs_buffer_write_through (uint32_t destination, uint8_t *source, uint32_t size)
+{
+    if(nvsbuffer == NULL || physical_nvs.memcpy_to_nvs == NULL)
+        return NVS_TransferResult_Failed;
+
+    memcpy(nvsbuffer + destination, source, size);
+    nvsbuffer[destination + size] = calc_checksum(source, size);
+
+    return physical_nvs.memcpy_to_nvs(destination, nvsbuffer + destination, size + NVS_CRC_BYTES, false);
+}
+
+#endif
+
 #ifndef DEBUGOUT
 
 #include "report.h"
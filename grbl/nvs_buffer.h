@@ -30,18 +30,23 @@ typedef struct {
     bool driver_settings;
     uint8_t startup_lines;
     uint16_t coord_data;
-#ifdef N_TOOLS
+#if defined(N_TOOLS) && !defined(TOOL_TABLE_CACHE)
     uint16_t tool_data;
 #endif
 } settings_dirty_t;
 
-extern settings_dirty_t settings_dirty;
+extern THREAD_LOCAL settings_dirty_t settings_dirty;
 
 bool nvs_buffer_init (void);
 bool nvs_buffer_alloc (void);
+uint32_t nvs_buffer_get_size (void);
 uint32_t nvs_alloc (size_t size);
 void nvs_buffer_sync_physical (void);
+void nvs_buffer_sync_deferred (void);
 nvs_io_t *nvs_buffer_get_physical (void);
+#ifdef ENABLE_NVS_CHECKPOINT
+nvs_transfer_result_t nvs_buffer_write_through (uint32_t destination, uint8_t *source, uint32_t size);
+#endif
 void nvs_memmap (void);
 
 #endif
@@ -23,6 +23,9 @@
 
 #include "grbl.h"
 #include "override.h"
+#include "system.h"
+#include "planner.h"
+#include "hal.h"
 
 typedef struct {
     volatile uint_fast8_t head;
@@ -30,7 +33,16 @@ typedef struct {
     uint8_t buf[OVERRIDE_BUFSIZE];
 } override_queue_t;
 
-static override_queue_t feed = {0}, accessory = {0};
+static THREAD_LOCAL override_queue_t feed = {0}, accessory = {0};
+
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+static THREAD_LOCAL struct {
+    bool pending;
+    uint_fast8_t feed_rate;
+    uint_fast8_t rapid_rate;
+    uint32_t ms;                // Time of the last override command or ramp step.
+} target = {0};
+#endif
 
 ISR_CODE void enqueue_feed_override (uint8_t cmd)
 {
@@ -39,6 +51,7 @@ ISR_CODE void enqueue_feed_override (uint8_t cmd)
     if(bptr != feed.tail) {         // If not buffer full
         feed.buf[feed.head] = cmd;  // add data to buffer
         feed.head = bptr;           // and update pointer
+        system_set_exec_pending();  // and flag it for execute
     }
 }
 
@@ -63,6 +76,7 @@ ISR_CODE void enqueue_accessory_override (uint8_t cmd)
     if(bptr != accessory.tail) {                // If not buffer full
         accessory.buf[accessory.head] = cmd;    // add data to buffer
         accessory.head = bptr;                  // and update pointer
+        system_set_exec_pending();              // and flag it for execute
     }
 }
 
@@ -82,4 +96,57 @@ uint8_t get_accessory_override (void)
 
 void flush_override_buffers () {
     feed.head = feed.tail = accessory.head = accessory.tail = 0;
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+    target.pending = false;
+#endif
+}
+
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+
+void feed_override_get_target (uint_fast8_t *feed_rate, uint_fast8_t *rapid_rate)
+{
+    *feed_rate = target.pending ? target.feed_rate : sys.override.feed_rate;
+    *rapid_rate = target.pending ? target.rapid_rate : sys.override.rapid_rate;
+}
+
+void feed_override_set_target (uint_fast8_t feed_rate, uint_fast8_t rapid_rate)
+{
+    target.feed_rate = max(min(feed_rate, MAX_FEED_RATE_OVERRIDE), MIN_FEED_RATE_OVERRIDE);
+    target.rapid_rate = rapid_rate;
+    target.ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    target.pending = true;
+
+    // Cannot debounce without a tick counter, apply at once.
+    if(!hal.get_elapsed_ticks)
+        feed_override_settle();
+}
+
+// Commands received in a burst, e.g. from an encoder knob, are applied by a single replan. If a ramp
+// step is set the change is applied in steps, each replanning the buffer.
+// NOTE: without a tick counter from the driver commands are applied at once, ramp steps on each realtime pass.
+void feed_override_settle (void)
+{
+    if(!target.pending)
+        return;
+
+    uint32_t ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+
+    if(hal.get_elapsed_ticks && ms - target.ms < OVERRIDE_DEBOUNCE_TIME)
+        return;
+
+    uint_fast8_t feed_rate = target.feed_rate;
+
+#if OVERRIDE_RAMP_STEP
+    if(feed_rate > sys.override.feed_rate + OVERRIDE_RAMP_STEP)
+        feed_rate = sys.override.feed_rate + OVERRIDE_RAMP_STEP;
+    else if(feed_rate + OVERRIDE_RAMP_STEP < sys.override.feed_rate)
+        feed_rate = sys.override.feed_rate - OVERRIDE_RAMP_STEP;
+#endif
+
+    target.ms = ms;
+    target.pending = feed_rate != target.feed_rate && !sys.override.control.feed_rate_disable;
+
+    plan_feed_override(feed_rate, target.rapid_rate);
 }
+
+#endif
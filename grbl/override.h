@@ -28,10 +28,33 @@
 #define OVERRIDE_BUFSIZE 16 // must be a power of 2
 #endif
 
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+
+// Time in ms without feed or rapid override commands before the new values are applied.
+#ifndef OVERRIDE_DEBOUNCE_TIME
+#define OVERRIDE_DEBOUNCE_TIME 20
+#endif
+
+// Max feed override change in percent applied per OVERRIDE_DEBOUNCE_TIME, 0 to apply the new value at once.
+#ifndef OVERRIDE_RAMP_STEP
+#define OVERRIDE_RAMP_STEP 0
+#endif
+
+#endif
+
 void flush_override_buffers ();
 void enqueue_feed_override (uint8_t cmd);
 uint8_t get_feed_override (void);
 void enqueue_accessory_override (uint8_t cmd);
 uint8_t get_accessory_override (void);
 
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+// Returns the feed and rapid override values to be applied, the current values if none are pending.
+void feed_override_get_target (uint_fast8_t *feed_rate, uint_fast8_t *rapid_rate);
+// Sets the feed and rapid override values to be applied when the override commands have settled.
+void feed_override_set_target (uint_fast8_t feed_rate, uint_fast8_t rapid_rate);
+// Applies the pending feed and rapid override values when settled, called from the realtime loop.
+void feed_override_settle (void);
+#endif
+
 #endif
@@ -27,7 +27,61 @@
 
 #include "pid.h"
 
-// Fixed point version: TODO
+// Fixed point version
+
+// Precompute the Q16 gains and the integer error limits, scale converts from the configured unit to the integer unit.
+// NOTE: call from the foreground process or once per block, not per sample. The terms are computed
+//       as the float version does at a constant sample rate.
+void pidq_init (pidq_t *pid, pid_values_t *config, float scale)
+{
+    pidq_reset(pid);
+
+    pid->p_gain = (int32_t)(config->p_gain * 65536.0f);
+    pid->i_gain = (int32_t)(config->i_gain * 65536.0f);
+    pid->d_gain = (int32_t)(config->d_gain * 65536.0f);
+    pid->i_max_error = (int32_t)(config->i_max_error * scale);
+    pid->d_max_error = (int32_t)(config->d_max_error * scale);
+    pid->max_error = (int32_t)(config->max_error * scale);
+}
+
+void pidq_reset (pidq_t *pid)
+{
+    pid->error = 0;
+    pid->i_error = 0;
+    pid->d_error = 0;
+}
+
+static inline int32_t pidq_clamp (int32_t value, int32_t limit)
+{
+    return limit == 0 ? value : (value > limit ? limit : (value < -limit ? -limit : value));
+}
+
+int32_t pidq (pidq_t *pid, int32_t command, int32_t actual)
+{
+    int32_t error = command - actual;
+
+    // calculate and add the integral term
+    pid->i_error = pidq_clamp(pid->i_error + error, pid->i_max_error);
+
+    int64_t pidres = (int64_t)pid->p_gain * error + (int64_t)pid->i_gain * pid->i_error;
+
+    // calculate and add the derivative term
+    if(pid->d_gain != 0) {
+        pidres += (int64_t)pid->d_gain * pidq_clamp(error - pid->d_error, pid->d_max_error);
+        pid->d_error = error;
+    }
+
+    // limit error output
+    pidres >>= 16;
+    if(pidres > INT32_MAX)
+        pidres = INT32_MAX;
+    else if(pidres < -INT32_MAX)
+        pidres = -INT32_MAX;
+
+    pid->error = pidq_clamp((int32_t)pidres, pid->max_error);
+
+    return pid->error;
+}
 
 // Float version
 
@@ -27,6 +27,7 @@
 #define _PID_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "settings.h"
 
@@ -40,8 +41,26 @@ typedef struct {
     float max_error;
 } pidf_t;
 
+// Fixed point version for a constant sample rate, command, actual and output are in the same integer unit.
+// Gains are Q16 and the error limits are converted to the integer unit by pidq_init().
+typedef struct {
+    int32_t p_gain;
+    int32_t i_gain;
+    int32_t d_gain;
+    int32_t i_max_error;
+    int32_t d_max_error;
+    int32_t max_error;
+    int32_t i_error;
+    int32_t d_error;
+    int32_t error;
+} pidq_t;
+
 void pidf_reset (pidf_t *pid);
 void pidf_init(pidf_t *pid, pid_values_t *config);
 float pidf (pidf_t *pid, float command, float actual, float sample_rate);
 
+void pidq_reset (pidq_t *pid);
+void pidq_init (pidq_t *pid, pid_values_t *config, float scale);
+int32_t pidq (pidq_t *pid, int32_t command, int32_t actual);
+
 #endif
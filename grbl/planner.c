@@ -23,12 +23,16 @@
 */
 
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "hal.h"
 #include "nuts_bolts.h"
 #include "planner.h"
+#include "protocol.h"
+#include "report.h"
+#include "profile.h"
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -40,13 +44,140 @@
 #define MINIMUM_FEED_RATE 1.0f
 #endif
 
-static plan_block_t block_buffer[BLOCK_BUFFER_SIZE];    // A ring buffer for motion instructions
-static plan_block_t *block_buffer_tail;                 // Pointer to the block to process now
-static plan_block_t *block_buffer_head;                 // Pointer to the next block to be pushed
-static plan_block_t *next_buffer_head;                  // Pointer to the next buffer head
-static plan_block_t *block_buffer_planned;              // Pointer to the optimally planned block
+static THREAD_LOCAL plan_block_t *block_buffer = NULL;               // A ring buffer for motion instructions, allocated from heap
+static THREAD_LOCAL uint_fast16_t block_buffer_size = 0;             // Number of blocks allocated for the ring buffer
+static THREAD_LOCAL plan_block_t *block_buffer_tail;                 // Pointer to the block to process now
+static THREAD_LOCAL plan_block_t *block_buffer_head;                 // Pointer to the next block to be pushed
+static THREAD_LOCAL plan_block_t *next_buffer_head;                  // Pointer to the next buffer head
+static THREAD_LOCAL plan_block_t *block_buffer_planned;              // Pointer to the optimally planned block
+
+static THREAD_LOCAL planner_t pl;
+
+// Single axis system motion planned ahead of need, see plan_prepare_system_motion().
+static THREAD_LOCAL struct {
+    bool valid;
+    uint_fast8_t axis;      // The moving axis.
+    int32_t start;          // Position of the moving axis the motion was planned from, in steps.
+    int32_t target;         // Target of the moving axis, in steps.
+    float feed_rate;
+    float rpm;
+    planner_cond_t condition;
+} sys_motion = {0};
+
+// Replanning state for blocks added in a batch, see plan_batch_begin().
+static THREAD_LOCAL struct {
+    uint_fast8_t depth;     // Nesting level of open batches.
+    uint_fast16_t pending;  // Number of blocks added without replanning.
+} batch = {0};
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+// Planning state for motions queued ahead of the block buffer, see plan_lookahead_line().
+static THREAD_LOCAL struct {
+    float exit_speed_sqr;               // Max exit speed (sqr) of the last block in the buffer, see plan_set_exit_speed_sqr().
+    int32_t position[N_AXIS];           // Position after the last motion queued ahead, in steps.
+    float previous_unit_vec[N_AXIS];    // Unit vector of the last motion queued ahead.
+    float previous_nominal_speed;       // Nominal speed of the last motion queued ahead.
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    bool previous_travel;               // The last motion queued ahead is a laser off travel motion.
+#endif
+} lookahead = {0};
+#endif
+
+#ifdef PLANNER_HOLD_LINE
+
+#ifndef PATH_MERGE_MAX_SEGMENTS
+#define PATH_MERGE_MAX_SEGMENTS 16 // Max number of line segments merged into a single block.
+#endif
+#ifndef PATH_BLEND_MAX_SEGMENTS
+#define PATH_BLEND_MAX_SEGMENTS 4 // Max number of line segments used for a blend arc.
+#endif
+
+// Number of blocks reserved in the buffer while a line is held back.
+#ifdef ENABLE_PATH_BLENDING
+#define HOLD_RESERVED_BLOCKS (PATH_BLEND_MAX_SEGMENTS + 1)
+#else
+#define HOLD_RESERVED_BLOCKS 1
+#endif
+
+typedef struct {
+    bool pending;                       // A line is held back for merging or blending with following line(s).
+    float position[N_AXIS];             // Target of last queued line, start of the held line.
+    float target[N_AXIS];               // Target of the held line.
+    plan_line_data_t pl_data;           // Planner data of the held line.
+#ifdef ENABLE_PATH_MERGING
+    uint_fast8_t segments;              // Number of line segments merged into the held line.
+    float point[PATH_MERGE_MAX_SEGMENTS - 1][N_AXIS]; // End points of merged segments, excluding the last one.
+#endif
+} held_line_t;
+
+static THREAD_LOCAL held_line_t held;
+
+#endif
+
+static inline bool plan_block_refresh (plan_block_t *block);
+static void plan_scale_planned_blocks (void);
+static bool plan_queue_line (float *target, plan_line_data_t *pl_data);
+
+
+/* Plans a system motion in the block buffer head ahead of need, e.g. the parking retract while a hold is
+   decelerating. Only single axis motions are kept ready, plan_buffer_line() then uses the block rather
+   than planning it again if called for a system motion with the same target and planner data for the
+   moving axis from the same position. The other axes must not move, their start and target positions are
+   not part of a single axis block.
+   This moves the planning out of the latency critical path, the block is discarded by any other line
+   queued. Returns true if the block is kept ready. */
+bool plan_prepare_system_motion (float *target, plan_line_data_t *pl_data)
+{
+#ifdef KINEMATICS_API
+    return false;
+#else
+    uint_fast8_t idx = N_AXIS, axes = 0;
+    plan_block_t *block = block_buffer_head;
+
+    if(!(pl_data->condition.system_motion && plan_queue_line(target, pl_data)))
+        return false;
+
+    do {
+        if(plan_block_steps(block, --idx)) {
+            axes++;
+            sys_motion.axis = idx;
+        }
+    } while(idx);
+
+    if(axes == 1) {
+        idx = sys_motion.axis;
+        sys_motion.target = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+        sys_motion.start = sys_motion.target + ((block->direction_bits.mask & bit(idx)) ? (int32_t)plan_block_steps(block, idx) : -(int32_t)plan_block_steps(block, idx));
+        sys_motion.feed_rate = pl_data->feed_rate;
+        sys_motion.rpm = pl_data->spindle.rpm;
+        sys_motion.condition = pl_data->condition;
+        sys_motion.valid = true;
+    }
+
+    return sys_motion.valid;
+#endif
+}
+
+// Returns true if the prepared system motion block is valid for the motion, it is used once only.
+static bool system_motion_ready (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx = N_AXIS;
+    int32_t steps;
+
+    sys_motion.valid = false;
+
+    if(pl_data->feed_rate != sys_motion.feed_rate || pl_data->spindle.rpm != sys_motion.rpm || pl_data->condition.value != sys_motion.condition.value)
+        return false;
+
+    do {
+        idx--;
+        steps = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+        if(idx == sys_motion.axis ? (steps != sys_motion.target || sys_position[idx] != sys_motion.start) : steps != sys_position[idx])
+            return false;
+    } while(idx);
 
-static planner_t pl;
+    return true;
+}
 
 
 /*                            PLANNER SPEED DEFINITION
@@ -85,9 +216,16 @@ static planner_t pl;
   them. Or, if a set of sequential blocks from the first block in the planner (or a optimal stop-compute
   point) are all accelerating, they are all optimal and can not be altered by a new block added to the
   planner buffer, as this will only further increase the plan speed to chronological blocks until a maximum
-  junction velocity is reached. However, if the operational conditions of the plan changes from infrequently
-  used feed holds or feedrate overrides, the stop-compute pointers will be reset and the entire plan is
-  recomputed as stated in the general guidelines.
+  junction velocity is reached. If the operational conditions of the plan changes from feed holds or feedrate
+  overrides, the stop-compute pointer is kept where possible. After a feed hold only the acceleration curve
+  from the stopped block changes and is recomputed until it meets the planned entry speeds. An override
+  change only flags the blocks as stale by a generation count, the block profiles are recomputed lazily. The
+  next block to execute is recomputed and clamped when fetched by the stepper, the others on the next replan,
+  triggered by a new block or by the input stream being idle. On this replan the entry speeds of blocks
+  entering at their nominal speed limited maximum are scaled with the new nominal speeds, these remain
+  optimal, and the stop-compute pointer is moved back to the first block that cannot be scaled. The reverse
+  pass is extended past the stop-compute pointer when a scaled block cannot decelerate to the replanned
+  speeds following it.
 
   Planner buffer pointer mapping:
   - block_buffer_tail: Points to the beginning of the planner buffer. First to be executed or being executed.
@@ -116,6 +254,10 @@ static planner_t pl;
 */
 static void planner_recalculate ()
 {
+    // Apply any override changes made since the buffer was last planned.
+    if(pl.replan)
+        plan_scale_planned_blocks();
+
     // Initialize block pointer to the last block in the planner buffer.
     plan_block_t *block = block_buffer_head->prev;
 
@@ -123,6 +265,8 @@ static void planner_recalculate ()
     if (block == block_buffer_planned)
         return;
 
+    PROFILE_BEGIN(Profile_PlannerRecalculate);
+
     // Reverse Pass: Coarsely maximize all possible deceleration curves back-planning from the last
     // block in buffer. Cease planning when the last optimal planned or tail pointer is reached.
     // NOTE: Forward pass will later refine and correct the reverse pass to create an optimal plan.
@@ -130,8 +274,16 @@ static void planner_recalculate ()
     plan_block_t *next;
     plan_block_t *current = block;
 
+#ifdef ENABLE_FAR_LOOKAHEAD
+    // Calculate maximum entry speed for last block in buffer, where the exit speed is zero unless motions
+    // queued ahead of the buffer allow otherwise.
+    plan_block_refresh(current);
+    current->entry_speed_sqr = min(current->max_entry_speed_sqr, lookahead.exit_speed_sqr + 2.0f * current->acceleration * current->millimeters);
+#else
     // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
+    plan_block_refresh(current);
     current->entry_speed_sqr = min(current->max_entry_speed_sqr, 2.0f * current->acceleration * current->millimeters);
+#endif
 
     block = block->prev;
     if (block == block_buffer_planned) { // Only two plannable blocks in buffer. Reverse pass complete.
@@ -149,12 +301,25 @@ static void planner_recalculate ()
             st_update_plan_block_parameters();
 
         // Compute maximum entry speed decelerating over the current block from its exit speed.
+        plan_block_refresh(current);
         if (current->entry_speed_sqr != current->max_entry_speed_sqr) {
             entry_speed_sqr = next->entry_speed_sqr + 2.0f * current->acceleration * current->millimeters;
             current->entry_speed_sqr = entry_speed_sqr < current->max_entry_speed_sqr ? entry_speed_sqr : current->max_entry_speed_sqr;
         }
     }
 
+    // The entry speeds of the optimally planned blocks are scaled rather than replanned on override changes.
+    // Continue the reverse pass past the planned pointer until the planned block can decelerate to the
+    // entry speed of the next block.
+    while (block != block_buffer_tail && block->entry_speed_sqr > (entry_speed_sqr = current->entry_speed_sqr + 2.0f * block->acceleration * block->millimeters)) {
+        block->entry_speed_sqr = entry_speed_sqr;
+        current = block;
+        block_buffer_planned = block = block->prev;
+        if (block == block_buffer_tail)
+            st_update_plan_block_parameters();
+    }
+
+
     // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
     next = block_buffer_planned; // Begin at buffer planned pointer
@@ -186,20 +351,92 @@ static void planner_recalculate ()
 
         block = block->next;
     }
+
+    PROFILE_END(Profile_PlannerRecalculate);
 }
 
-inline static void plan_cleanup (plan_block_t *block)
+#ifdef COMPACT_PLAN_BLOCKS
+
+// Frees the extra block data when both the message and the output commands have been taken.
+static inline void free_block_extra (plan_block_t *block)
+{
+    if(block->extra->message == NULL && block->extra->output_commands == NULL) {
+        free(block->extra);
+        block->extra = NULL;
+    }
+}
+
+char *plan_block_take_message (plan_block_t *block)
 {
-    if(block->message) {
-        free(block->message);
-        block->message = NULL;
+    char *message = NULL;
+
+    if(block->extra) {
+        message = block->extra->message;
+        block->extra->message = NULL;
+        free_block_extra(block);
     }
 
-    while(block->output_commands) {
-        output_command_t *next = block->output_commands->next;
-        free(block->output_commands);
-        block->output_commands = next;
+    return message;
+}
+
+output_command_t *plan_block_take_output_commands (plan_block_t *block)
+{
+    output_command_t *output_commands = NULL;
+
+    if(block->extra) {
+        output_commands = block->extra->output_commands;
+        block->extra->output_commands = NULL;
+        free_block_extra(block);
     }
+
+    return output_commands;
+}
+
+// Stores the junction speed limit as the upper half of the float, rounded down.
+static inline void set_max_junction_speed_sqr (plan_block_t *block, float speed_sqr)
+{
+    union {
+        float value;
+        uint32_t bits;
+    } value = { .value = speed_sqr };
+
+    block->max_junction_speed_sqr = (uint16_t)(value.bits >> 16);
+}
+
+#else
+
+char *plan_block_take_message (plan_block_t *block)
+{
+    char *message = block->message;
+
+    block->message = NULL;
+
+    return message;
+}
+
+output_command_t *plan_block_take_output_commands (plan_block_t *block)
+{
+    output_command_t *output_commands = block->output_commands;
+
+    block->output_commands = NULL;
+
+    return output_commands;
+}
+
+#define set_max_junction_speed_sqr(block, speed_sqr) (block)->max_junction_speed_sqr = (speed_sqr)
+
+#endif
+
+inline static void plan_cleanup (plan_block_t *block)
+{
+    char *message;
+    output_command_t *output_commands;
+
+    if((message = plan_block_take_message(block)))
+        gc_message_free(message);
+
+    if((output_commands = plan_block_take_output_commands(block)))
+        gc_output_command_free(output_commands);
 }
 
 
@@ -219,21 +456,63 @@ inline static void plan_reset_buffer (bool soft_reset)
 }
 
 
+static void plan_warning (uint_fast16_t state)
+{
+    report_message("Not enough heap for planner buffer, size reduced!", Message_Warning);
+}
+
+// Try to allocate RAM from heap for the block buffer, size is taken from the planner buffer size setting ($7).
+// If the requested size is not available the size is halved until allocation succeeds or the minimum size is reached.
+bool plan_alloc (void)
+{
+    if(block_buffer == NULL) {
+
+        block_buffer_size = settings.planner_buffer_blocks;
+
+        if(block_buffer_size < BLOCK_BUFFER_SIZE_MIN)
+            block_buffer_size = BLOCK_BUFFER_SIZE_MIN;
+        else if(block_buffer_size > BLOCK_BUFFER_SIZE_MAX)
+            block_buffer_size = BLOCK_BUFFER_SIZE_MAX;
+
+        while((block_buffer = malloc(block_buffer_size * sizeof(plan_block_t))) == NULL && block_buffer_size > BLOCK_BUFFER_SIZE_MIN)
+            block_buffer_size = max(block_buffer_size >> 1, BLOCK_BUFFER_SIZE_MIN);
+
+        if(block_buffer == NULL)
+            block_buffer_size = 0;
+        else if(block_buffer_size < settings.planner_buffer_blocks)
+            protocol_enqueue_rt_command(plan_warning);
+    }
+
+    return block_buffer != NULL;
+}
+
 void plan_reset ()
 {
-    static bool soft_reset = false;
+    static THREAD_LOCAL bool soft_reset = false;
+
+    st_prep_lock();
 
     memset(&pl, 0, sizeof(planner_t)); // Clear planner struct
+    memset(&batch, 0, sizeof(batch));
+#ifdef ENABLE_FAR_LOOKAHEAD
+    memset(&lookahead, 0, sizeof(lookahead));
+#endif
+    sys_motion.valid = false;
+#ifdef PLANNER_HOLD_LINE
+    memset(&held, 0, sizeof(held_line_t)); // Discard any held line
+#endif
 
     // Set up stepper block ringbuffer as circular doubly linked list
-    uint_fast8_t idx;
-    for(idx = 0 ; idx <= BLOCK_BUFFER_SIZE - 1 ; idx++) {
-        block_buffer[idx].prev = &block_buffer[idx == 0 ? BLOCK_BUFFER_SIZE - 1 : idx - 1];
-        block_buffer[idx].next = &block_buffer[idx == BLOCK_BUFFER_SIZE - 1 ? 0 : idx + 1];
+    uint_fast16_t idx;
+    for(idx = 0 ; idx <= block_buffer_size - 1 ; idx++) {
+        block_buffer[idx].prev = &block_buffer[idx == 0 ? block_buffer_size - 1 : idx - 1];
+        block_buffer[idx].next = &block_buffer[idx == block_buffer_size - 1 ? 0 : idx + 1];
     }
 
     plan_reset_buffer(soft_reset);
     soft_reset = true;
+
+    st_prep_unlock();
 }
 
 
@@ -245,6 +524,10 @@ void plan_discard_current_block ()
         if (block_buffer_tail == block_buffer_planned)
             block_buffer_planned = block_buffer_tail->next;
         block_buffer_tail = block_buffer_tail->next;
+#ifdef PLANNER_LOOKAHEAD_DISTANCE
+        // The new tail block is now executing and no longer part of the lookahead.
+        pl.lookahead_distance = block_buffer_tail == block_buffer_head ? 0.0f : pl.lookahead_distance - block_buffer_tail->millimeters;
+#endif
     }
 }
 
@@ -263,17 +546,39 @@ plan_block_t *plan_get_current_block ()
 }
 
 
+// NOTE: If the next block was planned before the latest override change its max entry speed
+// is recomputed here and the entry speed is clamped to it. The following blocks are replanned
+// from it by planner_recalculate(), see plan_scale_planned_blocks().
 inline float plan_get_exec_block_exit_speed_sqr ()
 {
     plan_block_t *block = block_buffer_tail->next;
-    return block == block_buffer_head ? 0.0f : block->entry_speed_sqr;
+
+    if(block == block_buffer_head)
+        return 0.0f;
+
+    if(plan_block_refresh(block) && block->entry_speed_sqr > block->max_entry_speed_sqr)
+        block->entry_speed_sqr = block->max_entry_speed_sqr;
+
+    return block->entry_speed_sqr;
 }
 
 
 // Returns the availability status of the block ring buffer. True, if full.
+// NOTE: If a line is held back blocks are reserved for it and for any blend segments.
+// NOTE: If PLANNER_LOOKAHEAD_DISTANCE is set the buffer is also full when the blocks queued ahead of the
+//       executing block span this path length, the block count then only limits the lookahead of short blocks.
 bool plan_check_full_buffer ()
 {
+#ifdef PLANNER_LOOKAHEAD_DISTANCE
+    if(PLANNER_LOOKAHEAD_DISTANCE > 0.0f && pl.lookahead_distance >= PLANNER_LOOKAHEAD_DISTANCE)
+        return true;
+#endif
+
+#ifdef PLANNER_HOLD_LINE
+    return held.pending ? plan_get_block_buffer_available() <= HOLD_RESERVED_BLOCKS : block_buffer_tail == next_buffer_head;
+#else
     return block_buffer_tail == next_buffer_head;
+#endif
 }
 
 
@@ -303,22 +608,80 @@ inline static float plan_compute_profile_parameters (plan_block_t *block, float
 {
   // Compute the junction maximum entry based on the minimum of the junction speed and neighboring nominal speeds.
     block->max_entry_speed_sqr = nominal_speed > prev_nominal_speed ? (prev_nominal_speed * prev_nominal_speed) : (nominal_speed * nominal_speed);
-    if (block->max_entry_speed_sqr > block->max_junction_speed_sqr)
-        block->max_entry_speed_sqr = block->max_junction_speed_sqr;
+    if (block->max_entry_speed_sqr > plan_block_max_junction_speed_sqr(block))
+        block->max_entry_speed_sqr = plan_block_max_junction_speed_sqr(block);
     return nominal_speed;
 }
 
-// Re-calculates buffered motions profile parameters upon a motion-based override change.
-void plan_update_velocity_profile_parameters ()
+// Re-calculates the profile parameters of a block if planned before the latest motion-based override change.
+// Returns true if recalculated.
+static inline bool plan_block_refresh (plan_block_t *block)
+{
+    if(block->generation == pl.generation)
+        return false;
+
+    block->generation = pl.generation;
+    plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block),
+                                     block == block_buffer_tail ? SOME_LARGE_VALUE : plan_compute_profile_nominal_speed(block->prev));
+
+    return true;
+}
+
+// Applies the latest motion-based override change to the optimally planned blocks, called by planner_recalculate().
+// Blocks entering at their nominal speed limited maximum entry speed have their entry speeds scaled with the
+// new nominal speeds and remain optimal. The planned pointer is moved back before the first block that cannot
+// be scaled or that has been clamped by the step segment generator, this and the following blocks are replanned.
+static void plan_scale_planned_blocks (void)
 {
+    bool scaled;
     plan_block_t *block = block_buffer_tail;
-    float prev_nominal_speed = SOME_LARGE_VALUE; // Set high for first block nominal speed calculation.
 
-    while (block != block_buffer_head) {
-        prev_nominal_speed = plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block), prev_nominal_speed);
+    pl.replan = false;
+
+    st_update_plan_block_parameters();
+    plan_block_refresh(block);
+
+    while (block != block_buffer_planned) {
+
         block = block->next;
+
+        scaled = block->entry_speed_sqr == block->max_entry_speed_sqr && block->max_entry_speed_sqr < plan_block_max_junction_speed_sqr(block);
+
+        // The scaled entry speed must still be nominal speed limited and reachable from the previous block.
+        if (!(plan_block_refresh(block) && scaled && block->max_entry_speed_sqr < plan_block_max_junction_speed_sqr(block) &&
+               fabsf(block->max_entry_speed_sqr - block->prev->entry_speed_sqr) <= 2.0f * block->prev->acceleration * block->prev->millimeters &&
+                (block->next != block_buffer_head || block->max_entry_speed_sqr <= 2.0f * block->acceleration * block->millimeters))) {
+            block_buffer_planned = block->prev;
+            break;
+        }
+
+        block->entry_speed_sqr = block->max_entry_speed_sqr;
+    }
+}
+
+// Flags buffered motions profile parameters for recalculation upon a motion-based override change.
+// Rather than walking the whole buffer the blocks are recalculated lazily, the next block to execute when
+// fetched by the step segment generator and the others when the buffer is next replanned.
+void plan_update_velocity_profile_parameters ()
+{
+    pl.generation++; // Blocks and motions queued ahead of the buffer are stale.
+    pl.replan = true;
+
+    // Update prev nominal speed for next incoming block.
+    pl.previous_nominal_speed = block_buffer_head == block_buffer_tail
+                                 ? SOME_LARGE_VALUE
+                                 : plan_compute_profile_nominal_speed(block_buffer_head->prev);
+}
+
+// Replans the blocks planned before the latest motion-based override change.
+// Called while waiting for input or for the buffer to drain, when no new blocks are queued to trigger replanning.
+void plan_replan_stale_blocks (void)
+{
+    if(pl.replan && block_buffer_head != block_buffer_tail) {
+        st_prep_lock();
+        planner_recalculate();
+        st_prep_unlock();
     }
-    pl.previous_nominal_speed = prev_nominal_speed; // Update prev nominal speed for next incoming block.
 }
 
 static inline float limit_acceleration_by_axis_maximum (float *unit_vec)
@@ -334,6 +697,41 @@ static inline float limit_acceleration_by_axis_maximum (float *unit_vec)
     return limit_value;
 }
 
+#ifdef ENABLE_JERK_ACCELERATION
+
+static inline float limit_jerk_by_axis_maximum (float *unit_vec)
+{
+    uint_fast8_t idx = N_AXIS;
+    float limit_value = SOME_LARGE_VALUE;
+
+    do {
+        if (unit_vec[--idx] != 0.0f)  // Avoid divide by zero.
+            limit_value = min(limit_value, fabsf(settings.axis[idx].jerk / unit_vec[idx]));
+    } while(idx);
+
+    return limit_value;
+}
+
+#endif
+
+#ifdef ENABLE_STOP_DECELERATION
+
+// Axes having a stop deceleration setting below the acceleration setting are stopped at their acceleration limit.
+static inline float limit_stop_deceleration_by_axis_maximum (float *unit_vec)
+{
+    uint_fast8_t idx = N_AXIS;
+    float limit_value = SOME_LARGE_VALUE;
+
+    do {
+        if (unit_vec[--idx] != 0.0f)  // Avoid divide by zero.
+            limit_value = min(limit_value, fabsf(max(settings.axis[idx].stop_deceleration, settings.axis[idx].acceleration) / unit_vec[idx]));
+    } while(idx);
+
+    return limit_value;
+}
+
+#endif
+
 static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
 {
     uint_fast8_t idx = N_AXIS;
@@ -347,39 +745,203 @@ static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
     return limit_value;
 }
 
+#ifdef ENABLE_ARC_BLOCKS
 
+static THREAD_LOCAL plan_arc_t *queue_arc = NULL; // Geometry of the arc to be queued by queue_line(), see plan_buffer_arc().
 
-/* Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
-   in millimeters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
-   rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
-   All position data passed to the planner must be in terms of machine position to keep the planner
-   independent of any coordinate system changes and offsets, which are handled by the g-code parser.
-   NOTE: Assumes buffer is available. Buffer checks are handled at a higher level by motion_control.
-   In other words, the buffer head is never equal to the buffer tail.  Also the feed rate input value
-   is used in three ways: as a normal feed rate if invert_feed_rate is false, as inverse time if
-   invert_feed_rate is true, or as seek/rapids rate if the feed_rate value is negative (and
-   invert_feed_rate always false).
-   The system motion condition tells the planner to plan a motion in the always unused block buffer
-   head. It avoids changing the planner state and preserves the buffer to ensure subsequent gcode
-   motions are still planned correctly, while the stepper module only points to the block buffer head
-   to execute the special system motion. */
-bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
+// Sets up the path length, the axis limited acceleration and rate and the entry and exit unit vectors of an
+// arc block. The direction changes along the arc, the limits are for the worst case direction in the plane.
+// The rate is further limited for the centripetal acceleration to be within half the plane acceleration
+// limit, and the tangential acceleration is derated for the vector sum to be within the limit.
+static void arc_setup (plan_block_t *block, float *entry_vec, float *exit_vec)
+{
+    plan_arc_t *arc = &block->arc;
+    float limit_vec[N_AXIS] = {0};
+    float sin_phi = arc->linear_travel / arc->length, cos_phi = sqrtf(1.0f - sin_phi * sin_phi);
+    float end_angle = arc->start_angle + arc->angular_travel;
+    float radius = min(arc->radius, arc->radius + arc->radius_change);
+
+    if(arc->angular_travel < 0.0f)
+        cos_phi = -cos_phi;
+
+    memset(entry_vec, 0, sizeof(float) * N_AXIS);
+    memset(exit_vec, 0, sizeof(float) * N_AXIS);
+    entry_vec[arc->axis_0] = -sinf(arc->start_angle) * cos_phi;
+    entry_vec[arc->axis_1] = cosf(arc->start_angle) * cos_phi;
+    exit_vec[arc->axis_0] = -sinf(end_angle) * cos_phi;
+    exit_vec[arc->axis_1] = cosf(end_angle) * cos_phi;
+    entry_vec[arc->axis_linear] = exit_vec[arc->axis_linear] = sin_phi;
+
+    limit_vec[arc->axis_0] = limit_vec[arc->axis_1] = fabsf(cos_phi);
+    limit_vec[arc->axis_linear] = sin_phi;
+
+    block->millimeters = arc->length;
+    block->acceleration = limit_acceleration_by_axis_maximum(limit_vec);
+    block->rapid_rate = min(limit_max_rate_by_axis_maximum(limit_vec),
+                             sqrtf(0.5f * min(settings.axis[arc->axis_0].acceleration, settings.axis[arc->axis_1].acceleration) * radius));
+#ifdef ENABLE_JERK_ACCELERATION
+    block->jerk = limit_jerk_by_axis_maximum(limit_vec);
+#endif
+    block->acceleration *= 0.8660254f; // sqrt(1 - 0.5^2)
+#ifdef ENABLE_JERK_ACCELERATION
+    block->max_acceleration = block->acceleration;
+#endif
+#ifdef ENABLE_STOP_DECELERATION
+    block->stop_deceleration = limit_stop_deceleration_by_axis_maximum(limit_vec) * 0.8660254f;
+#endif
+}
+
+#endif
+
+
+
+// Sets the length, acceleration and max rate of a line block from the unit vector numerator of the line.
+static inline void line_setup (plan_block_t *block, float *unit_vec)
+{
+    block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
+    block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
+    block->rapid_rate = limit_max_rate_by_axis_maximum(unit_vec);
+#ifdef ENABLE_JERK_ACCELERATION
+    block->jerk = limit_jerk_by_axis_maximum(unit_vec);
+    block->max_acceleration = block->acceleration;
+#endif
+#ifdef ENABLE_STOP_DECELERATION
+    block->stop_deceleration = limit_stop_deceleration_by_axis_maximum(unit_vec);
+#endif
+}
+
+// Sets the programmed rate of the block and derates the acceleration used for planning where required.
+static void block_rates_setup (plan_block_t *block, float *unit_vec, plan_line_data_t *pl_data)
+{
+#ifdef ENABLE_INPUT_SHAPING
+    uint_fast8_t idx;
+#endif
+
+    // Store programmed rate.
+    if (block->condition.rapid_motion)
+        block->programmed_rate = block->rapid_rate;
+    else {
+        block->programmed_rate = pl_data->feed_rate;
+        if (block->condition.inverse_time)
+            block->programmed_rate *= block->millimeters;
+    }
+
+#ifdef ENABLE_JERK_ACCELERATION
+    // Derate the acceleration used for planning so that a jerk limited ramp from standstill to the
+    // nominal speed can be executed without exceeding the axis acceleration limits. The average
+    // acceleration of such a ramp is v / (v / a + a / j). The step segment generator executes each
+    // ramp with this average acceleration, thus the planned entry speeds and distances are retained.
+    // Ramps with a smaller speed change are executed with the peak acceleration clamped to the axis
+    // limits and a higher jerk, see ramp_init() in stepper.c.
+    block->acceleration = block->max_acceleration / (1.0f + block->max_acceleration * block->max_acceleration / (block->jerk * plan_compute_profile_nominal_speed(block)));
+#endif
+
+#ifdef ENABLE_INPUT_SHAPING
+    // Shape the velocity ramps for the axis with the largest motion component having shaping enabled.
+    float max_component = 0.0f;
+    block->shaper_axis = N_AXIS;
+    idx = N_AXIS;
+    do {
+        idx--;
+        if(settings.axis[idx].shaper_frequency > 0.0f && fabsf(unit_vec[idx]) > max_component) {
+            max_component = fabsf(unit_vec[idx]);
+            block->shaper_axis = idx;
+        }
+    } while(idx);
+
+    // Derate the acceleration used for planning so that a shaped ramp from standstill to the nominal
+    // speed can be executed without exceeding the axis acceleration limits. Such a ramp is the shaped
+    // version of a constant acceleration ramp 2 * shaper delay shorter than the planned ramp.
+
+    if(block->shaper_axis != N_AXIS) {
+        input_shaper_t shaper;
+        st_get_input_shaper(&shaper, block->shaper_axis);
+        block->acceleration = block->acceleration / (1.0f + 2.0f * shaper.delay * block->acceleration / plan_compute_profile_nominal_speed(block));
+    }
+#endif
+}
+
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+
+// Returns true for laser mode motions with the laser off, the travel between engraving strokes.
+static inline bool is_laser_travel (plan_line_data_t *pl_data)
+{
+    return settings.mode == Mode_Laser && (!pl_data->condition.spindle.on || pl_data->spindle.rpm == 0.0f);
+}
+
+#endif
+
+// Computes the max junction speed (sqr) between lines with the given unit vectors for the
+// junction deviation, see queue_line().
+static float compute_junction_speed_sqr (float *previous_unit_vec, float *unit_vec, float junction_deviation)
+{
+    uint_fast8_t idx = N_AXIS;
+    float junction_unit_vec[N_AXIS];
+    float junction_cos_theta = 0.0f;
+
+    do {
+        idx--;
+        junction_cos_theta -= previous_unit_vec[idx] * unit_vec[idx];
+        junction_unit_vec[idx] = unit_vec[idx] - previous_unit_vec[idx];
+    } while(idx);
+
+    // NOTE: Computed without any expensive trig, sin() or acos(), by trig half angle identity of cos(theta).
+    if (junction_cos_theta > 0.999999f)
+        //  For a 0 degree acute junction, just set minimum junction speed.
+        return MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED;
+
+    if (junction_cos_theta < -0.999999f)
+        // Junction is a straight line or 180 degrees. Junction speed is infinite.
+        return SOME_LARGE_VALUE;
+
+    convert_delta_vector_to_unit_vector(junction_unit_vec);
+    float junction_acceleration = limit_acceleration_by_axis_maximum(junction_unit_vec);
+    float sin_theta_d2 = sqrtf(0.5f * (1.0f - junction_cos_theta)); // Trig half angle identity. Always positive.
+
+    return max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
+                (junction_acceleration * junction_deviation * sin_theta_d2) / (1.0f - sin_theta_d2));
+}
+
+// Adds a new linear movement to the buffer, see plan_buffer_line() below.
+static bool queue_line (float *target, plan_line_data_t *pl_data)
 {
+
     // Prepare and initialize new block. Copy relevant pl_data for block execution.
     plan_block_t *block = block_buffer_head;
     int32_t target_steps[N_AXIS], position_steps[N_AXIS], delta_steps;
     uint_fast8_t idx;
-    float unit_vec[N_AXIS];
+    float unit_vec[N_AXIS], *exit_unit_vec = unit_vec;
+#ifdef ENABLE_ARC_BLOCKS
+    float arc_exit_vec[N_AXIS];
+#endif
+#ifdef COMPACT_PLAN_BLOCKS
+    uint32_t step_event_count = 0;
+#endif
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    bool travel = is_laser_travel(pl_data);
+#endif
 
 //    plan_cleanup(block);
-    memset(block, 0, sizeof(plan_block_t) - 2 * sizeof(plan_block_t *));    // Zero all block values (except linked list pointers).
+    sys_motion.valid = false; // The block buffer head is overwritten.
+    memset(&block->entry_speed_sqr, 0, sizeof(plan_block_t) - offsetof(plan_block_t, entry_speed_sqr)); // Zero all block values (except linked list pointers).
+#ifdef COMPACT_PLAN_BLOCKS
+    block->spindle.rpm = pl_data->spindle.rpm;
+    block->spindle.css.target_rpm = pl_data->spindle.css.target_rpm;
+#else
     memcpy(&block->spindle, &pl_data->spindle, sizeof(spindle_t));          // Copy spindle data (RPM etc)
+#endif
+    block->generation = pl.generation;
     block->condition = pl_data->condition;
     block->overrides = pl_data->overrides;
     block->line_number = pl_data->line_number;
+#ifdef ENABLE_NVS_CHECKPOINT
+    block->checkpoint = pl_data->checkpoint;
+#endif
+#ifndef COMPACT_PLAN_BLOCKS
     block->output_commands = pl_data->output_commands;
     block->message = pl_data->message;
     pl_data->message = NULL;
+#endif
 
     // Copy position data based on type of motion being planned.
     memcpy(position_steps, block->condition.system_motion ? sys_position : pl.position, sizeof(position_steps));
@@ -401,9 +963,14 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
 #endif
         delta_steps = target_steps[idx] - position_steps[idx];
+#ifdef COMPACT_PLAN_BLOCKS
+        step_event_count = max(step_event_count, (uint32_t)labs(delta_steps));
+        plan_steps_set(&block->steps[idx], (uint32_t)labs(delta_steps));
+#else
         block->steps[idx] = labs(delta_steps);
         block->step_event_count = max(block->step_event_count, block->steps[idx]);
-        unit_vec[idx] = (float)delta_steps / settings.axis[idx].steps_per_mm; // Store unit vector numerator
+#endif
+        unit_vec[idx] = (float)delta_steps * derived_settings.mm_per_step[idx]; // Store unit vector numerator
 
         // Set direction bits. Bit enabled always means direction is negative.
         if (delta_steps < 0)
@@ -414,43 +981,88 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     // Calculate RPMs to be used for Constant Surface Speed calculations
     if(block->condition.is_rpm_pos_adjusted) {
         float pos;
-        if((pos = (float)position_steps[block->spindle.css.axis] / settings.axis[block->spindle.css.axis].steps_per_mm - block->spindle.css.tool_offset) > 0.0f) {
-            block->spindle.rpm = block->spindle.css.surface_speed / (pos * (float)(2.0f * M_PI));
-            if(block->spindle.rpm > block->spindle.css.max_rpm)
-                block->spindle.rpm = block->spindle.css.max_rpm;
+        css_data_t *css = &pl_data->spindle.css;
+        if((pos = (float)position_steps[css->axis] * derived_settings.mm_per_step[css->axis] - css->tool_offset) > 0.0f) {
+            block->spindle.rpm = css->surface_speed / (pos * (float)(2.0f * M_PI));
+            if(block->spindle.rpm > css->max_rpm)
+                block->spindle.rpm = css->max_rpm;
         } else
-            block->spindle.rpm = block->spindle.css.max_rpm;
-        if((pos = target[block->spindle.css.axis] - block->spindle.css.tool_offset) > 0.0f) {
-            block->spindle.css.target_rpm = block->spindle.css.surface_speed / (pos * (float)(2.0f * M_PI));
-            if(block->spindle.css.target_rpm > block->spindle.css.max_rpm)
-                block->spindle.css.target_rpm = block->spindle.css.max_rpm;
+            block->spindle.rpm = css->max_rpm;
+        if((pos = target[css->axis] - css->tool_offset) > 0.0f) {
+            block->spindle.css.target_rpm = css->surface_speed / (pos * (float)(2.0f * M_PI));
+            if(block->spindle.css.target_rpm > css->max_rpm)
+                block->spindle.css.target_rpm = css->max_rpm;
         } else
-            block->spindle.css.target_rpm = block->spindle.css.max_rpm;
+            block->spindle.css.target_rpm = css->max_rpm;
     }
 
-    // Bail if this is a zero-length block. Highly unlikely to occur.
-    if (block->step_event_count == 0)
-        return false;
+#ifdef ENABLE_ARC_BLOCKS
+    if(block->condition.arc_motion) {
 
-    pl_data->message = NULL;         // Indicate message is already queued for display on execution
+        uint_fast8_t axis[3];
+
+        memcpy(&block->arc, queue_arc, sizeof(plan_arc_t));
+        axis[0] = block->arc.axis_0;
+        axis[1] = block->arc.axis_1;
+        axis[2] = block->arc.axis_linear;
+
+        // The steps and direction bits are for the net motion, a full circle has none. The step event count
+        // sets the resolution of the velocity profile, the steps along the path of the highest resolution axis.
+        float steps_per_mm = 0.0f;
+        idx = 3;
+        do {
+            idx--;
+            block->arc.start_steps[idx] = position_steps[axis[idx]];
+            block->arc.target_steps[idx] = target_steps[axis[idx]];
+            steps_per_mm = max(steps_per_mm, settings.axis[axis[idx]].steps_per_mm);
+        } while(idx);
+
+#ifdef COMPACT_PLAN_BLOCKS
+        step_event_count = (uint32_t)ceilf(block->arc.length * steps_per_mm);
+#else
+        block->step_event_count = (uint32_t)ceilf(block->arc.length * steps_per_mm);
+#endif
+    }
+#endif
+
+#ifdef COMPACT_PLAN_BLOCKS
+    // Bail if this is a zero-length block, or too long for the step counts. Long lines are split by mc_line().
+    if (step_event_count == 0 || step_event_count > PLAN_BLOCK_STEPS_MAX)
+        return false;
+
+    plan_steps_set(&block->step_event_count, step_event_count);
+
+    if((pl_data->message || pl_data->output_commands) && (block->extra = malloc(sizeof(plan_block_extra_t)))) {
+        block->extra->message = pl_data->message;
+        block->extra->output_commands = pl_data->output_commands;
+    } else {
+        if(pl_data->message) // Out of memory, drop the message and commands.
+            gc_message_free(pl_data->message);
+        if(pl_data->output_commands)
+            gc_output_command_free(pl_data->output_commands);
+    }
+#else
+    // Bail if this is a zero-length block. Highly unlikely to occur.
+    if (block->step_event_count == 0)
+        return false;
+#endif
+
+    pl_data->message = NULL;         // Indicate message is already queued for display on execution
     pl_data->output_commands = NULL; // Indicate commands are already queued for execution
+    pl_data->condition.coolant_change = pl_data->condition.spindle_rpm_change = pl_data->condition.wco_change = Off; // and state changes
 
     // Calculate the unit vector of the line move and the block maximum feed rate and acceleration scaled
     // down such that no individual axes maximum values are exceeded with respect to the line direction.
     // NOTE: This calculation assumes all axes are orthogonal (Cartesian) and works with ABC-axes,
     // if they are also orthogonal/independent. Operates on the absolute value of the unit vector.
-    block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
-    block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
-    block->rapid_rate = limit_max_rate_by_axis_maximum(unit_vec);
+#ifdef ENABLE_ARC_BLOCKS
+    if(block->condition.arc_motion)
+        arc_setup(block, unit_vec, exit_unit_vec = arc_exit_vec);
+    else
+#endif
+        line_setup(block, unit_vec);
 
-    // Store programmed rate.
-    if (block->condition.rapid_motion)
-        block->programmed_rate = block->rapid_rate;
-    else {
-        block->programmed_rate = pl_data->feed_rate;
-        if (block->condition.inverse_time)
-            block->programmed_rate *= block->millimeters;
-    }
+    block_rates_setup(block, unit_vec, pl_data);
 
     // TODO: Need to check this method handling zero junction speeds when starting from rest.
     if ((block_buffer_head == block_buffer_tail) || (block->condition.system_motion)) {
@@ -458,7 +1070,7 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         // Initialize block entry speed as zero. Assume it will be starting from rest. Planner will correct this later.
         // If system motion, the system motion block always is assumed to start from rest and end at a complete stop.
         block->entry_speed_sqr = 0.0f;
-        block->max_junction_speed_sqr = 0.0f; // Starting from rest. Enforce start from zero velocity.
+        set_max_junction_speed_sqr(block, 0.0f); // Starting from rest. Enforce start from zero velocity.
 
     } else {
 
@@ -483,31 +1095,16 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         // changed dynamically during operation nor can the line move geometry. This must be kept in
         // memory in the event of a feedrate override changing the nominal speeds of blocks, which can
         // change the overall maximum entry speed conditions of all blocks.
-
-        float junction_unit_vec[N_AXIS];
-        float junction_cos_theta = 0.0f;
-
-        idx = N_AXIS;
-        do {
-            idx--;
-            junction_cos_theta -= pl.previous_unit_vec[idx] * unit_vec[idx];
-            junction_unit_vec[idx] = unit_vec[idx] - pl.previous_unit_vec[idx];
-        } while(idx);
-
-        // NOTE: Computed without any expensive trig, sin() or acos(), by trig half angle identity of cos(theta).
-        if (junction_cos_theta > 0.999999f)
-            //  For a 0 degree acute junction, just set minimum junction speed.
-            block->max_junction_speed_sqr = MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED;
-        else if (junction_cos_theta < -0.999999f) {
-            // Junction is a straight line or 180 degrees. Junction speed is infinite.
-            block->max_junction_speed_sqr = SOME_LARGE_VALUE;
-        } else {
-            convert_delta_vector_to_unit_vector(junction_unit_vec);
-            float junction_acceleration = limit_acceleration_by_axis_maximum(junction_unit_vec);
-            float sin_theta_d2 = sqrtf(0.5f * (1.0f - junction_cos_theta)); // Trig half angle identity. Always positive.
-            block->max_junction_speed_sqr = max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
-                                                  (junction_acceleration * settings.junction_deviation * sin_theta_d2) / (1.0f - sin_theta_d2));
-        }
+        //
+        // NOTE: Junctions between laser off travel motions do not affect the engraved path, these use
+        // the travel junction deviation.
+
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+        set_max_junction_speed_sqr(block, compute_junction_speed_sqr(pl.previous_unit_vec, unit_vec,
+                                    pl.previous_travel && travel ? settings.travel_junction_deviation : settings.junction_deviation));
+#else
+        set_max_junction_speed_sqr(block, compute_junction_speed_sqr(pl.previous_unit_vec, unit_vec, settings.junction_deviation));
+#endif
     }
 
     // Block system motion from updating this data to ensure next g-code motion is computed correctly.
@@ -517,45 +1114,548 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
 
         if(!block->condition.backlash_motion) {
             // Update previous path unit_vector and planner position.
-            memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
+            memcpy(pl.previous_unit_vec, exit_unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
             memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+            pl.previous_travel = travel;
+#endif
+#ifdef PLANNER_HOLD_LINE
+            memcpy(held.position, target, sizeof(held.position));     // held.position[] = target[]
+#endif
         }
+#ifdef PLANNER_LOOKAHEAD_DISTANCE
+        // The first block in an empty buffer is executed next and not part of the lookahead.
+        if(block_buffer_head != block_buffer_tail)
+            pl.lookahead_distance += block->millimeters;
+#endif
         // New block is all set. Update buffer head and next buffer head indices.
         block_buffer_head = next_buffer_head;
         next_buffer_head = block_buffer_head->next;
 
-        // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
+        // Finish up by recalculating the plan with the new block. Deferred while a batch is open, the buffer
+        // has room and the stepper is not running. Else the caller waits until the stepper has made room for
+        // the next block or the stepper may reach blocks not yet replanned, these are planned to stop and
+        // the stepper would otherwise have to slow down to stop within the replanned blocks.
+        if(batch.depth && !plan_check_full_buffer() && !(sys.state & (STATE_CYCLE|STATE_HOLD|STATE_JOG)))
+            batch.pending++;
+        else {
+            batch.pending = 0;
+            planner_recalculate();
+        }
+    }
+
+    return true;
+}
+
+// Adds a new linear movement to the buffer with segment preparation locked out, see st_prep_buffer().
+static bool plan_queue_line (float *target, plan_line_data_t *pl_data)
+{
+    bool ok;
+
+    st_prep_lock();
+    ok = queue_line(target, pl_data);
+    st_prep_unlock();
+
+    return ok;
+}
+
+
+
+#ifdef PLANNER_HOLD_LINE
+
+// Returns true if the line may be held back for merging or blending with the following line(s).
+// Lines carrying messages or output commands, or having a length or position dependent
+// feed rate or spindle speed are never held back.
+static inline bool hold_is_allowed (plan_line_data_t *pl_data)
+{
+    return !(pl_data->condition.system_motion || pl_data->condition.jog_motion || pl_data->condition.backlash_motion || pl_data->condition.probing ||
+              pl_data->condition.inverse_time || pl_data->condition.is_rpm_pos_adjusted) &&
+            pl_data->message == NULL && pl_data->output_commands == NULL &&
+#if defined(ENABLE_PATH_MERGING) && defined(ENABLE_PATH_BLENDING)
+             (settings.path_merge_tolerance > 0.0f || pl_data->path_tolerance > 0.0f);
+#elif defined(ENABLE_PATH_MERGING)
+             settings.path_merge_tolerance > 0.0f;
+#else
+             pl_data->path_tolerance > 0.0f;
+#endif
+}
+
+#endif
+
+#ifdef ENABLE_PATH_MERGING
+
+// Returns true if the point is within the merge tolerance from the line from held.position to target.
+// On return t holds the distance along the line, normalized to the line length squared.
+static bool merge_point_is_within_tolerance (float *target, float *point, float length_sqr, float *t)
+{
+    uint_fast8_t idx = N_AXIS;
+    float dot = 0.0f, dist_sqr = 0.0f, delta;
+
+    do {
+        idx--;
+        delta = point[idx] - held.position[idx];
+        dot += delta * (target[idx] - held.position[idx]);
+        dist_sqr += delta * delta;
+    } while(idx);
+
+    // Point must be between the line end points and not before the previous one.
+    if(dot < *t || dot > length_sqr)
+        return false;
+
+    *t = dot;
+
+    // Squared normal distance to the line, dist^2 - (projected length)^2.
+    return dist_sqr - dot * dot / length_sqr <= settings.path_merge_tolerance * settings.path_merge_tolerance;
+}
+
+// Try to merge the line with the held line, returns true if successful.
+// The merged line must have the same conditions as the held line and all the end points
+// of the merged segments must lie within the merge tolerance from the new line.
+static bool merge_line (float *target, plan_line_data_t *pl_data)
+{
+    if(settings.path_merge_tolerance <= 0.0f || held.segments == PATH_MERGE_MAX_SEGMENTS || !hold_is_allowed(pl_data) ||
+        pl_data->feed_rate != held.pl_data.feed_rate ||
+         pl_data->condition.value != held.pl_data.condition.value ||
+          pl_data->overrides.value != held.pl_data.overrides.value ||
+           pl_data->spindle.rpm != held.pl_data.spindle.rpm)
+        return false;
+
+    uint_fast8_t idx = N_AXIS;
+    float length_sqr = 0.0f, t = 0.0f;
+
+    do {
+        idx--;
+        length_sqr += (target[idx] - held.position[idx]) * (target[idx] - held.position[idx]);
+    } while(idx);
+
+    if(length_sqr == 0.0f)
+        return false;
+
+#ifdef COMPACT_PLAN_BLOCKS
+    if(plan_line_split_count(held.position, target) > 1)
+        return false;
+#endif
+
+    for(idx = 0; idx < held.segments - 1; idx++) {
+        if(!merge_point_is_within_tolerance(target, held.point[idx], length_sqr, &t))
+            return false;
     }
 
+    if(!merge_point_is_within_tolerance(target, held.target, length_sqr, &t))
+        return false;
+
+    memcpy(held.point[held.segments - 1], held.target, sizeof(held.target));
+    memcpy(held.target, target, sizeof(held.target));
+    held.pl_data.line_number = pl_data->line_number;
+    held.segments++;
+
     return true;
 }
 
+#endif
+
+#ifdef ENABLE_PATH_BLENDING
+
+/* Rounds the corner between the held line and the new line by a circular arc, approximated by up
+   to PATH_BLEND_MAX_SEGMENTS line segments within the arc tolerance. The arc is tangent to both lines
+   and its midpoint is at the G64 P tolerance from the corner. The held line is queued shortened by
+   the arc, followed by the arc segments, leaving the planner position at the start of the remaining
+   part of the new line.
+   NOTE: The arc end points are limited so that at least half of the new line is left for the next
+   blend and the held line is not reversed. Junction speeds between the segments are computed as
+   usual from the junction deviation setting. */
+static void blend_lines (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx = N_AXIS, segment, segments = 1;
+    float unit_in[N_AXIS], unit_out[N_AXIS], normal[N_AXIS], start[N_AXIS], point[N_AXIS];
+    float length_in, length_out, cos_turn = 0.0f;
+
+    do {
+        idx--;
+        unit_in[idx] = held.target[idx] - held.position[idx];
+        unit_out[idx] = target[idx] - held.target[idx];
+    } while(idx);
+
+    length_in = convert_delta_vector_to_unit_vector(unit_in);
+    length_out = convert_delta_vector_to_unit_vector(unit_out);
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        cos_turn += unit_in[idx] * unit_out[idx];
+    } while(idx);
+
+    // No blending if the new line has no length, the lines are (nearly) collinear or the direction is reversed.
+    if(!(length_out > 0.0f) || cos_turn > 0.99999f || cos_turn < -0.99999f) {
+        plan_queue_line(held.target, &held.pl_data);
+        return;
+    }
+
+    float sin_half = sqrtf(0.5f * (1.0f - cos_turn));   // Sine of half the turn angle.
+    float cos_half = sqrtf(0.5f * (1.0f + cos_turn));   // Cosine of half the turn angle.
+    float tolerance = min(held.pl_data.path_tolerance, pl_data->path_tolerance);
+    float distance = min(tolerance * sin_half / (1.0f - cos_half), min(length_in, 0.5f * length_out)); // Corner to arc end points.
+    float radius = distance * cos_half / sin_half;
+    float turn = acosf(cos_turn);
+
+    // Unit normal from the arc start point towards the arc center, in the plane of the two lines.
+    idx = N_AXIS;
+    do {
+        idx--;
+        normal[idx] = (unit_out[idx] - cos_turn * unit_in[idx]) / (2.0f * sin_half * cos_half);
+        start[idx] = held.target[idx] - distance * unit_in[idx];
+    } while(idx);
+
+    if(distance < length_in)
+        plan_queue_line(start, &held.pl_data);
+
+    if(settings.arc_tolerance < radius)
+        segments = (uint_fast8_t)min(ceilf(turn / (2.0f * acosf(1.0f - settings.arc_tolerance / radius))), (float)PATH_BLEND_MAX_SEGMENTS);
+
+    for(segment = 1; segment <= segments; segment++) {
+
+        float theta = turn * (float)segment / (float)segments;
+        float sin_theta = sinf(theta), cos_theta = cosf(theta);
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            point[idx] = segment == segments
+                          ? held.target[idx] + distance * unit_out[idx]
+                          : start[idx] + radius * (normal[idx] * (1.0f - cos_theta) + unit_in[idx] * sin_theta);
+        } while(idx);
+
+        plan_queue_line(point, pl_data);
+    }
+}
+
+#endif
+
+#ifdef PLANNER_HOLD_LINE
+
+// Queue the held line, if any, to the planner buffer.
+// Called on auto cycle start and before the planner position is synced.
+// NOTE: plan_check_full_buffer() ensures there is room for the held line.
+void plan_flush_held_line (void)
+{
+    if(held.pending) {
+        held.pending = false;
+        plan_queue_line(held.target, &held.pl_data);
+    }
+}
+
+#endif
+
+/* Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
+   in millimeters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
+   rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
+   All position data passed to the planner must be in terms of machine position to keep the planner
+   independent of any coordinate system changes and offsets, which are handled by the g-code parser.
+   NOTE: Assumes buffer is available. Buffer checks are handled at a higher level by motion_control.
+   In other words, the buffer head is never equal to the buffer tail.  Also the feed rate input value
+   is used in three ways: as a normal feed rate if invert_feed_rate is false, as inverse time if
+   invert_feed_rate is true, or as seek/rapids rate if the feed_rate value is negative (and
+   invert_feed_rate always false).
+   The system motion condition tells the planner to plan a motion in the always unused block buffer
+   head. It avoids changing the planner state and preserves the buffer to ensure subsequent gcode
+   motions are still planned correctly, while the stepper module only points to the block buffer head
+   to execute the special system motion.
+   NOTE: If path merging is enabled consecutive lines having the same conditions and deviating less
+   than the merge tolerance from a straight line are merged into a single block before planning.
+   If path blending is enabled (G64 P) the corners between lines are rounded within the tolerance.
+   This is done by holding back the last line until the next line is known or the line is flushed
+   by auto cycle start. */
+bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
+{
+    if(pl_data->condition.system_motion && sys_motion.valid && system_motion_ready(target, pl_data))
+        return true;
+
+#ifdef PLANNER_HOLD_LINE
+    // System motions are executed from the buffer head without affecting planner state, so the held line is left as is.
+    if(!pl_data->condition.system_motion) {
+
+        if(held.pending) {
+  #ifdef ENABLE_PATH_MERGING
+            if(merge_line(target, pl_data))
+                return true;
+  #endif
+  #ifdef ENABLE_PATH_BLENDING
+            if(held.pl_data.path_tolerance > 0.0f && pl_data->path_tolerance > 0.0f && hold_is_allowed(pl_data)) {
+                held.pending = false;
+                blend_lines(target, pl_data);
+            } else
+  #endif
+            plan_flush_held_line();
+        }
+
+        if(hold_is_allowed(pl_data) && memcmp(target, held.position, sizeof(held.position))) {
+            memcpy(held.target, target, sizeof(held.target));
+            memcpy(&held.pl_data, pl_data, sizeof(plan_line_data_t));
+  #ifdef ENABLE_PATH_MERGING
+            held.segments = 1;
+  #endif
+            held.pending = true;
+            return true;
+        }
+    }
+#endif
+
+    return plan_queue_line(target, pl_data);
+}
+
 
 // Reset the planner position vectors. Called by the system abort/initialization routine.
+#ifdef ENABLE_ARC_BLOCKS
+
+// Arcs are not held back for merging or blending, any held line is queued first.
+bool plan_buffer_arc (float *target, plan_line_data_t *pl_data, plan_arc_t *arc)
+{
+    bool ok;
+
+#ifdef PLANNER_HOLD_LINE
+    plan_flush_held_line();
+#endif
+
+    queue_arc = arc;
+    pl_data->condition.arc_motion = On;
+    ok = plan_queue_line(target, pl_data);
+    pl_data->condition.arc_motion = Off;
+    queue_arc = NULL;
+
+    return ok;
+}
+
+#endif
+
+// Blocks added by motion generators queueing many short segments, e.g. arcs and splines, are replanned
+// once when the batch is committed rather than once per block. Batches may be nested, the plan is
+// recalculated when the outermost batch is committed.
+// NOTE: Replanning is only deferred while the stepper is not running and the buffer has room, blocks not yet
+//       replanned are executed as decelerating to a stop. Batches should only be held open while the
+//       segments are generated.
+void plan_batch_begin (void)
+{
+#if PLANNER_BATCH_REPLAN
+    batch.depth++;
+#endif
+}
+
+void plan_batch_commit (void)
+{
+    if(batch.depth && --batch.depth == 0 && batch.pending) {
+        batch.pending = 0;
+        planner_recalculate();
+    }
+}
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+
+// Computes the profile data of a line motion queued ahead of the block buffer, to be planned after the
+// blocks in the buffer if first is set, else after the previous motion this was called for.
+// The data is computed as by queue_line() for the current override values.
+void plan_lookahead_line (float *target, plan_line_data_t *pl_data, plan_lookahead_t *motion, bool first)
+{
+    plan_block_t block;
+    int32_t target_steps[N_AXIS];
+    uint32_t step_event_count = 0;
+    uint_fast8_t idx;
+    float unit_vec[N_AXIS];
+
+    if(first) {
+        memcpy(lookahead.position, pl.position, sizeof(lookahead.position));
+        memcpy(lookahead.previous_unit_vec, pl.previous_unit_vec, sizeof(lookahead.previous_unit_vec));
+        lookahead.previous_nominal_speed = pl.previous_nominal_speed;
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+        lookahead.previous_travel = pl.previous_travel;
+#endif
+    }
+
+    memset(&block, 0, sizeof(plan_block_t));
+    block.condition = pl_data->condition;
+    motion->generation = pl.generation;
+
+#ifdef KINEMATICS_API
+    kinematics.plan_target_to_steps(target_steps, target);
+#endif
+
+    idx = N_AXIS;
+    do {
+        idx--;
+#ifndef KINEMATICS_API
+        target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+#endif
+        unit_vec[idx] = (float)(target_steps[idx] - lookahead.position[idx]) * derived_settings.mm_per_step[idx];
+        step_event_count = max(step_event_count, (uint32_t)labs(target_steps[idx] - lookahead.position[idx]));
+    } while(idx);
+
+    // Zero-length motions are not planned, the motion is transparent to the motions around it.
+    if(step_event_count == 0) {
+        motion->millimeters = 0.0f;
+        motion->acceleration = 0.0f;
+        motion->max_entry_speed_sqr = SOME_LARGE_VALUE;
+        return;
+    }
+
+    line_setup(&block, unit_vec);
+    block_rates_setup(&block, unit_vec, pl_data);
+
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    bool travel = is_laser_travel(pl_data);
+
+    set_max_junction_speed_sqr(&block, compute_junction_speed_sqr(lookahead.previous_unit_vec, unit_vec,
+                                lookahead.previous_travel && travel ? settings.travel_junction_deviation : settings.junction_deviation));
+#else
+    set_max_junction_speed_sqr(&block, compute_junction_speed_sqr(lookahead.previous_unit_vec, unit_vec, settings.junction_deviation));
+#endif
+    lookahead.previous_nominal_speed = plan_compute_profile_parameters(&block, plan_compute_profile_nominal_speed(&block), lookahead.previous_nominal_speed);
+
+    motion->millimeters = block.millimeters;
+    motion->acceleration = block.acceleration;
+    // The nominal speed of spindle synchronized motions depends on the spindle speed when executed, plan to stop before these.
+    motion->max_entry_speed_sqr = block.condition.spindle.synchronized ? 0.0f : block.max_entry_speed_sqr;
+
+    if(!block.condition.backlash_motion) {
+        memcpy(lookahead.previous_unit_vec, unit_vec, sizeof(unit_vec));
+        memcpy(lookahead.position, target_steps, sizeof(target_steps));
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+        lookahead.previous_travel = travel;
+#endif
+    }
+}
+
+// Returns the max entry speed (sqr) of a motion queued ahead of the block buffer from its exit speed (sqr).
+// Motions computed before the latest override change are planned to be entered from a stop.
+float plan_lookahead_entry_speed_sqr (plan_lookahead_t *motion, float exit_speed_sqr)
+{
+    if(motion->generation != pl.generation)
+        return 0.0f;
+
+    exit_speed_sqr += 2.0f * motion->acceleration * motion->millimeters;
+
+    return exit_speed_sqr < motion->max_entry_speed_sqr ? exit_speed_sqr : motion->max_entry_speed_sqr;
+}
+
+// Sets the max exit speed (sqr) of the last block in the buffer for the following replanning,
+// the entry speed of the first motion queued ahead of the buffer or 0.0f if none.
+void plan_set_exit_speed_sqr (float exit_speed_sqr)
+{
+    lookahead.exit_speed_sqr = exit_speed_sqr;
+}
+
+#endif
+
 void plan_sync_position ()
 {
+#ifdef PLANNER_HOLD_LINE
+    plan_flush_held_line();
+#endif
     memcpy(pl.position, sys_position, sizeof(pl.position));
+#ifdef PLANNER_HOLD_LINE
+    system_convert_array_steps_to_mpos(held.position, sys_position);
+#endif
+}
+
+#if defined(COMPACT_PLAN_BLOCKS) || defined(ENABLE_LASER_RASTER)
+
+void plan_get_line_start (float *position)
+{
+#ifdef PLANNER_HOLD_LINE
+    if(held.pending)
+        memcpy(position, held.target, sizeof(held.target));
+    else
+#endif
+    system_convert_array_steps_to_mpos(position, pl.position);
+}
+
+#endif
+
+#ifdef COMPACT_PLAN_BLOCKS
+
+// NOTE: Lines are split at half the range of the step counts, leaving a margin for rounding and for
+// kinematics combining the motion of several axes.
+uint32_t plan_line_split_count (float *position, float *target)
+{
+    uint_fast8_t idx = N_AXIS;
+    float steps = 0.0f;
+
+    do {
+        idx--;
+        steps = max(steps, fabsf(target[idx] - position[idx]) * settings.axis[idx].steps_per_mm);
+    } while(idx);
+
+    return steps > (float)PLAN_BLOCK_STEPS_SPLIT ? (uint32_t)ceilf(steps / (float)PLAN_BLOCK_STEPS_SPLIT) : 1;
 }
 
+#endif
+
 
 // Returns the number of available blocks are in the planner buffer.
-uint8_t plan_get_block_buffer_available ()
+uint_fast16_t plan_get_block_buffer_available ()
 {
-    return (uint8_t)(block_buffer_head >= block_buffer_tail
-                      ? ((BLOCK_BUFFER_SIZE - 1) - (block_buffer_head - block_buffer_tail))
-                      : ((block_buffer_tail - block_buffer_head) - 1));
+    return (uint_fast16_t)(block_buffer_head >= block_buffer_tail
+                            ? ((block_buffer_size - 1) - (block_buffer_head - block_buffer_tail))
+                            : ((block_buffer_tail - block_buffer_head) - 1));
+}
+
+
+// Returns the number of blocks allocated for the planner buffer.
+uint_fast16_t plan_get_block_buffer_size ()
+{
+    return block_buffer_size;
 }
 
 
 // Re-initialize buffer plan with a partially completed block, assumed to exist at the buffer tail.
 // Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped.
+// NOTE: The reverse planned entry speeds do not depend on the stopped block, only the acceleration
+// curve from it is recomputed until it meets the planned entry speeds.
 void plan_cycle_reinitialize ()
 {
-    // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
+    float entry_speed_sqr;
+    bool past_planned = block_buffer_planned == block_buffer_tail;
+    plan_block_t *block = block_buffer_tail;
+
+    st_prep_lock();
+
+    // Re-plan from a complete stop.
     st_update_plan_block_parameters();
-    block_buffer_planned = block_buffer_tail;
+
+    while (block->next != block_buffer_head) {
+
+        entry_speed_sqr = block->entry_speed_sqr + 2.0f * block->acceleration * block->millimeters;
+        block = block->next;
+
+        if (entry_speed_sqr >= block->entry_speed_sqr)
+            break;
+
+        // Full acceleration, the plan is optimal up to this block.
+        block->entry_speed_sqr = entry_speed_sqr;
+        if (past_planned)
+            block_buffer_planned = block;
+        else
+            past_planned = block == block_buffer_planned;
+    }
+
+    st_prep_unlock();
+}
+
+// Changes the programmed rate of all blocks in the buffer, used by velocity mode jogging.
+// NOTE: All blocks in the buffer must be jog motions.
+void plan_jog_rate (float rate)
+{
+    plan_block_t *block = block_buffer_tail;
+
+    st_prep_lock();
+
+    while(block != block_buffer_head) {
+        block->programmed_rate = rate;
+        block = block->next;
+    }
+
+    plan_update_velocity_profile_parameters();
     planner_recalculate();
+
+    st_prep_unlock();
 }
 
 // Set feed overrides
@@ -571,6 +1671,9 @@ void plan_feed_override (uint_fast8_t feed_override, uint_fast8_t rapid_override
       sys.override.rapid_rate = (uint8_t)rapid_override;
       sys.report.overrides = On; // Set to report change immediately
       plan_update_velocity_profile_parameters();
-      plan_cycle_reinitialize();
+      // Update the executing block and defer replanning of the remaining blocks until the next block
+      // is queued or the input stream is idle, the next block is clamped when the stepper reaches it.
+      st_update_plan_block_parameters();
     }
+
 }
@@ -24,10 +24,23 @@
 #ifndef _PLANNER_H_
 #define _PLANNER_H_
 
-// The number of linear motions that can be in the plan at any give time
+// The default number of linear motions that can be in the plan at any give time.
+// NOTE: The actual size is set by $7 and allocated from the heap at startup.
 #ifndef BLOCK_BUFFER_SIZE
   #define BLOCK_BUFFER_SIZE 36
 #endif
+#define BLOCK_BUFFER_SIZE_MIN 8     // Minimum number of blocks allocated, $7 values below this are rejected.
+#define BLOCK_BUFFER_SIZE_MAX 1024  // Maximum number of blocks allocated, $7 values above this are rejected.
+
+// Set to 0 to replan each block added in a batch immediately, see plan_batch_begin().
+#ifndef PLANNER_BATCH_REPLAN
+  #define PLANNER_BATCH_REPLAN 1
+#endif
+
+// Path length lookahead in mm, see plan_check_full_buffer(). Set to 0.0f to limit the lookahead by the number of blocks only.
+#if defined(ENABLE_PATH_MERGING) && !defined(PLANNER_LOOKAHEAD_DISTANCE)
+  #define PLANNER_LOOKAHEAD_DISTANCE 100.0f
+#endif
 
 typedef union {
     uint32_t value;
@@ -41,25 +54,65 @@ typedef union {
                  is_rpm_rate_adjusted :1,
                  is_rpm_pos_adjusted  :1,
                  is_laser_ppi_mode    :1,
-                 unassigned           :7;
+                 probing              :1,
+                 arc_motion           :1,
+                 coolant_change       :1, // Coolant state to be set when the block is started, see ENABLE_QUEUED_SPINDLE_COOLANT.
+                 spindle_rpm_change   :1, // Spindle RPM to be set when the block is started.
+                 wco_change           :1, // Reported work coordinate offsets to be updated when the block is started, see ENABLE_QUEUED_WCO_CHANGE.
+                 unassigned           :2;
         spindle_state_t spindle;
         coolant_state_t coolant;
     };
 } planner_cond_t;
 
+#ifdef COMPACT_PLAN_BLOCKS
+
+#define PLAN_BLOCK_STEPS_MAX 0xFFFFFFUL // Max step count of a compact block.
+#define PLAN_BLOCK_STEPS_SPLIT 0x800000UL // Lines are split into blocks of at most this number of steps per axis.
+
+// 24 bit step count, little endian.
+typedef struct {
+    uint8_t byte[3];
+} plan_steps_t;
+
+// Rarely used block data, heap allocated.
+typedef struct {
+    char *message;
+    output_command_t *output_commands;
+} plan_block_extra_t;
+
+#endif
+
 // This struct stores a linear movement of a g-code block motion with its critical "nominal" values
 // are as specified in the source g-code.
-typedef struct plan_block {
-    // Fields used by the bresenham algorithm for tracing the line
-    // NOTE: Used by stepper algorithm to execute the block correctly. Do not alter these values.
-    uint32_t steps[N_AXIS];         // Step count along each axis
-    uint32_t step_event_count;      // The maximum step axis count and number of steps required to complete this block.
-    axes_signals_t direction_bits;  // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
+// NOTE: The fields accessed by the reverse and forward passes of planner_recalculate() are kept
+// together at the start of the struct, separate from the data only used when the block is loaded
+// by the stepper. This way the passes touch a minimum of cache lines per block.
+#ifdef ENABLE_ARC_BLOCKS
 
-    // Block condition data to ensure correct execution depending on states and overrides.
-    planner_cond_t condition;       // Block bitfield variable defining block run conditions. Copied from pl_line_data.
-    gc_override_flags_t overrides;  // Block bitfield variable for overrides
-    int32_t line_number;            // Block line number for real-time reporting. Copied from pl_line_data.
+// Arc geometry of an arc planner block, see plan_buffer_arc(). Positions are in machine coordinates.
+typedef struct {
+    uint8_t axis_0;             // Plane axes,
+    uint8_t axis_1;
+    uint8_t axis_linear;        // and helical axis.
+    float center[2];            // Arc center, plane axis 0 and 1 coordinates (mm).
+    float radius;               // Radius at the start position (mm).
+    float radius_change;        // Radius at the target less radius at the start position (mm).
+    float start_angle;          // Angle of the start position from the center (radians).
+    float angular_travel;       // Signed angular travel, positive is counter clockwise (radians).
+    float linear_start;         // Helical axis start position (mm).
+    float linear_travel;        // Helical axis travel (mm).
+    float length;               // Path length (mm).
+    float segment_length;       // Max step segment length for the chord error to be within the arc tolerance (mm).
+    int32_t start_steps[3];     // Start position of axis 0, axis 1 and the helical axis, set by the planner (steps).
+    int32_t target_steps[3];    // Target position of axis 0, axis 1 and the helical axis, set by the planner (steps).
+} plan_arc_t;
+
+#endif
+
+typedef struct plan_block {
+    // Hot data, used by the planner passes.
+    struct plan_block *prev, *next; // Linked list pointers, DO NOT MOVE - these MUST be the first elements in the struct!
 
     // Fields used by the motion planner to manage acceleration. Some of these values may be updated
     // by the stepper module during execution of special motion cases for replanning purposes.
@@ -69,21 +122,108 @@ typedef struct plan_block {
     float acceleration;         // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
     float millimeters;          // The remaining distance for this block to be executed in (mm).
                                 // NOTE: This value may be altered by stepper algorithm during execution.
+    uint8_t generation;         // Override generation the max entry speed was computed for.
+
+    // Cold data, used when the block is loaded by the stepper or recalculated after an override change.
+
+    // Block condition data to ensure correct execution depending on states and overrides.
+    planner_cond_t condition;       // Block bitfield variable defining block run conditions. Copied from pl_line_data.
+    gc_override_flags_t overrides;  // Block bitfield variable for overrides
+    int32_t line_number;            // Block line number for real-time reporting. Copied from pl_line_data.
+#ifdef ENABLE_NVS_CHECKPOINT
+    uint32_t checkpoint;            // Checkpoint tag of the line. Copied from pl_line_data.
+#endif
 
     // Stored rate limiting data used by planner when changes occur.
+#ifdef COMPACT_PLAN_BLOCKS
+    uint16_t max_junction_speed_sqr; // Junction entry speed limit, upper half of the float, use plan_block_max_junction_speed_sqr().
+#else
     float max_junction_speed_sqr; // Junction entry speed limit based on direction vectors in (mm/min)^2
+#endif
     float rapid_rate;             // Axis-limit adjusted maximum rate for this block direction in (mm/min)
     float programmed_rate;        // Programmed rate of this block (mm/min).
+#ifdef ENABLE_JERK_ACCELERATION
+    float max_acceleration;       // Axis-limit adjusted peak acceleration in (mm/min^2), acceleration is derated from this.
+    float jerk;                   // Axis-limit adjusted jerk in (mm/min^3). Does not change.
+#endif
+#ifdef ENABLE_INPUT_SHAPING
+    uint8_t shaper_axis;          // Axis the velocity ramps are shaped for, N_AXIS if none.
+#endif
+#ifdef ENABLE_STOP_DECELERATION
+    float stop_deceleration;      // Axis-limit adjusted deceleration for forced stops in (mm/min^2), at least acceleration.
+#endif
+
 
+    // Fields used by the bresenham algorithm for tracing the line
+    // NOTE: Used by stepper algorithm to execute the block correctly. Do not alter these values.
+#ifdef COMPACT_PLAN_BLOCKS
+    plan_steps_t steps[N_AXIS];     // Step count along each axis, use plan_block_steps() for reading.
+    plan_steps_t step_event_count;  // The maximum step axis count, use plan_block_step_event_count() for reading.
+#else
+    uint32_t steps[N_AXIS];         // Step count along each axis
+    uint32_t step_event_count;      // The maximum step axis count and number of steps required to complete this block.
+#endif
+    axes_signals_t direction_bits;  // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
+
+#ifdef COMPACT_PLAN_BLOCKS
+    // Block spindle speeds used by the stepper, calculated from pl_line_data.
+    struct {
+        float rpm;
+        struct {
+            float target_rpm;
+        } css;
+    } spindle;
+
+    plan_block_extra_t *extra;    // Message and output commands, NULL if none. Use plan_block_take_message() etc.
+#else
     // Stored spindle speed data used by spindle overrides and resuming methods.
     spindle_t spindle;    // Block spindle speed. Copied from pl_line_data.
 
     char *message;                // Message to be displayed when block is executed.
     output_command_t *output_commands;
-    struct plan_block *prev, *next; // Linked list pointers, DO NOT MOVE - these MUST be the last elements in the struct!
+#endif
+
+#ifdef ENABLE_ARC_BLOCKS
+    plan_arc_t arc;               // Arc geometry, valid if condition.arc_motion is set.
+#endif
 } plan_block_t;
 
 
+#ifdef COMPACT_PLAN_BLOCKS
+
+static inline uint32_t plan_steps_get (const plan_steps_t *steps)
+{
+    return (uint32_t)steps->byte[0] | ((uint32_t)steps->byte[1] << 8) | ((uint32_t)steps->byte[2] << 16);
+}
+
+static inline void plan_steps_set (plan_steps_t *steps, uint32_t value)
+{
+    steps->byte[0] = (uint8_t)value;
+    steps->byte[1] = (uint8_t)(value >> 8);
+    steps->byte[2] = (uint8_t)(value >> 16);
+}
+
+static inline float plan_block_max_junction_speed_sqr (const plan_block_t *block)
+{
+    union {
+        float value;
+        uint32_t bits;
+    } speed_sqr = { .bits = (uint32_t)block->max_junction_speed_sqr << 16 };
+
+    return speed_sqr.value;
+}
+
+#define plan_block_steps(block, idx) plan_steps_get(&(block)->steps[idx])
+#define plan_block_step_event_count(block) plan_steps_get(&(block)->step_event_count)
+
+#else
+
+#define plan_block_steps(block, idx) ((block)->steps[idx])
+#define plan_block_step_event_count(block) ((block)->step_event_count)
+#define plan_block_max_junction_speed_sqr(block) ((block)->max_junction_speed_sqr)
+
+#endif
+
 // Planner data prototype. Must be used when passing new motions to the planner.
 typedef struct {
     float feed_rate;                // Desired feed rate for line motion. Value is ignored, if rapid motion.
@@ -91,6 +231,13 @@ typedef struct {
     planner_cond_t condition;       // Bitfield variable to indicate planner conditions. See defines above.
     gc_override_flags_t overrides;  // Block bitfield variable for overrides
     int32_t line_number;            // Desired line number to report when executing.
+#ifdef ENABLE_NVS_CHECKPOINT
+    uint32_t checkpoint;            // Checkpoint tag of the line, 0 if none.
+#endif
+#ifdef ENABLE_PATH_BLENDING
+    float path_tolerance;           // Path blending tolerance (G64 P) in mm, 0 if corners are not blended.
+#endif
+
 //    void *parameters;               // TODO: pointer to extra parameters, for canned cycles and threading?
     char *message;                  // Message to be displayed when block is executed.
     output_command_t *output_commands;
@@ -104,9 +251,19 @@ typedef struct {
                                     // i.e. arcs, canned cycles, and backlash compensation.
   float previous_unit_vec[N_AXIS];  // Unit vector of previous path line segment
   float previous_nominal_speed;     // Nominal speed of previous path line segment
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+  bool previous_travel;             // Previous path line segment is a laser off travel motion
+#endif
+  uint8_t generation;               // Incremented on motion-based override changes, used for lazy
+                                    // recalculation of block profile parameters and motions queued ahead.
+  bool replan;                      // Blocks were planned before the latest motion-based override change.
+#ifdef PLANNER_LOOKAHEAD_DISTANCE
+  float lookahead_distance;         // Path length of the blocks queued ahead of the executing block in mm.
+#endif
 } planner_t;
 
 // Initialize and reset the motion plan subsystem
+bool plan_alloc(void); // Allocate block buffer from heap, call once at startup after settings are loaded.
 void plan_reset(); // Reset all
 //void plan_reset_buffer(); // Reset buffer only.
 
@@ -115,6 +272,37 @@ void plan_reset(); // Reset all
 // rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
 bool plan_buffer_line(float *target, plan_line_data_t *pl_data);
 
+#ifdef ENABLE_ARC_BLOCKS
+// Add a new arc motion to the buffer, with the arc geometry set up for the current planner position.
+// The steps and direction bits of the block are those of the net motion to target.
+bool plan_buffer_arc (float *target, plan_line_data_t *pl_data, plan_arc_t *arc);
+#endif
+
+#ifdef ENABLE_FAR_LOOKAHEAD
+
+// Profile data of a motion queued ahead of the block buffer, see plan_lookahead_line().
+typedef struct {
+    float millimeters;          // Length of the motion in mm, 0.0f if zero-length.
+    float acceleration;         // Axis-limit adjusted acceleration in (mm/min^2).
+    float max_entry_speed_sqr;  // Maximum allowable entry speed at the junction with the previous motion in (mm/min)^2.
+    uint8_t generation;         // Planner generation the max entry speed was computed for.
+} plan_lookahead_t;
+
+// Compute the profile data of a line motion queued ahead of the block buffer.
+void plan_lookahead_line (float *target, plan_line_data_t *pl_data, plan_lookahead_t *motion, bool first);
+
+// Returns the max entry speed (sqr) of a motion queued ahead of the block buffer, given its exit speed (sqr).
+float plan_lookahead_entry_speed_sqr (plan_lookahead_t *motion, float exit_speed_sqr);
+
+// Set the max exit speed (sqr) of the last block in the buffer, used by the next replanning.
+void plan_set_exit_speed_sqr (float exit_speed_sqr);
+
+#endif
+
+// Defer replanning of blocks added by plan_buffer_line() until the batch is committed.
+void plan_batch_begin (void);
+void plan_batch_commit (void);
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 void plan_discard_current_block();
@@ -131,17 +319,47 @@ float plan_get_exec_block_exit_speed_sqr();
 // Called by main program during planner calculations and step segment buffer during initialization.
 float plan_compute_profile_nominal_speed(plan_block_t *block);
 
-// Re-calculates buffered motions profile parameters upon a motion-based override change.
+// Flags buffered motions profile parameters for recalculation upon a motion-based override change.
 void plan_update_velocity_profile_parameters();
 
+// Replans the blocks planned before the latest motion-based override change.
+void plan_replan_stale_blocks (void);
+
 // Reset the planner position vector (in steps)
 void plan_sync_position();
 
+// Plans a single axis system motion ahead of need, returns true if the block is kept ready.
+bool plan_prepare_system_motion (float *target, plan_line_data_t *pl_data);
+
+#ifdef PLANNER_HOLD_LINE
+// Queue line held back for merging or blending, if any.
+void plan_flush_held_line (void);
+#endif
+
+// Returns the message of the block and clears it, the caller takes ownership.
+char *plan_block_take_message (plan_block_t *block);
+
+// Returns the output commands of the block and clears them, the caller takes ownership.
+output_command_t *plan_block_take_output_commands (plan_block_t *block);
+
+#if defined(COMPACT_PLAN_BLOCKS) || defined(ENABLE_LASER_RASTER)
+// Returns the target of the last line queued in position, the start position of the next line.
+void plan_get_line_start (float *position);
+#endif
+
+#ifdef COMPACT_PLAN_BLOCKS
+// Returns the number of blocks a line has to be split into for the step counts to fit in compact blocks.
+uint32_t plan_line_split_count (float *position, float *target);
+#endif
+
 // Reinitialize plan with a partially completed block
 void plan_cycle_reinitialize();
 
 // Returns the number of available blocks in the planner buffer.
-uint8_t plan_get_block_buffer_available();
+uint_fast16_t plan_get_block_buffer_available();
+
+// Returns the number of blocks allocated for the block buffer.
+uint_fast16_t plan_get_block_buffer_size();
 
 // Returns the status of the block ring buffer. True, if buffer is full.
 bool plan_check_full_buffer();
@@ -149,4 +367,7 @@ bool plan_check_full_buffer();
 void plan_get_planner_mpos(float *target);
 void plan_feed_override (uint_fast8_t feed_override, uint_fast8_t rapid_override);
 
+// Change the programmed rate of all buffered jog motions
+void plan_jog_rate (float rate);
+
 #endif
@@ -26,7 +26,9 @@
 
 typedef enum {
     Probing_Off = 0,
-    Probing_Active
+    Probing_Active,
+    Probing_Queued,     // Probe motion is queued, the stepper module activates probing when it is started.
+    Probing_FailInit    // Probe was triggered or not connected when the queued probe motion was started.
 } probing_state_t;
 
 typedef union {
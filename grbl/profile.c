@@ -0,0 +1,164 @@
+/*
+  profile.c - execution time profiling of named code regions
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_PROFILING
+
+#include <string.h>
+
+#include "profile.h"
+
+typedef struct {
+    uint32_t calls;
+    uint32_t max;       // Max cycles per call
+    uint64_t cycles;    // Total cycles
+} profile_counters_t;
+
+static THREAD_LOCAL const char *region_name[PROFILE_REGIONS_MAX] = {
+    "PARSER", "PLANNER", "PREP", "REPORT", "RTSYSTEM", "MODBUS", "WEBSOCKET", "TELNET"
+};
+static const char *event_name[ProfileEvent_Events] = {
+    "RTIDLE", "RTPENDING", "ALARM", "RESET", "STOP", "REPORT", "RTCOMMAND", "STATE", "FEEDOVR", "ACCOVR"
+};
+static THREAD_LOCAL uint_fast8_t n_regions = Profile_Regions;
+static THREAD_LOCAL uint32_t (*get_time)(void) = NULL;
+static THREAD_LOCAL uint32_t reset_ms;
+static THREAD_LOCAL profile_counters_t counters[PROFILE_REGIONS_MAX];
+
+THREAD_LOCAL uint32_t profile_events[ProfileEvent_Events];
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+profile_id_t profile_add_region (const char *name)
+{
+    if(n_regions == PROFILE_REGIONS_MAX)
+        return PROFILE_NONE;
+
+    region_name[n_regions] = name;
+
+    return n_regions++;
+}
+
+uint32_t profile_start (void)
+{
+    return get_time ? get_time() : 0;
+}
+
+void profile_end (profile_id_t id, uint32_t start)
+{
+    if(id < n_regions && get_time) {
+
+        profile_counters_t *region = &counters[id];
+        uint32_t cycles = get_time() - start;
+
+        region->calls++;
+        region->cycles += cycles;
+        if(cycles > region->max)
+            region->max = cycles;
+    }
+}
+
+void profile_reset (void)
+{
+    hal.irq_disable();
+    memset(counters, 0, sizeof(counters));
+    memset(profile_events, 0, sizeof(profile_events));
+    hal.irq_enable();
+
+    reset_ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+}
+
+// Outputs [PROF:<name>,<calls>,<avg>,<max>,<total/1000>] for each region entered since the counters
+// were cleared, [PROFEV:<event>,<count>] for each event counted, [PROF:ELAPSED,<ms>], the time since the
+// counters were cleared, and [PROF:CLOCK,<Hz>], the frequency of the counter used, 0 if unknown.
+static void profile_report (void)
+{
+    uint_fast8_t idx;
+    profile_counters_t region;
+
+    for(idx = 0; idx < n_regions; idx++) {
+
+        hal.irq_disable();
+        memcpy(&region, &counters[idx], sizeof(profile_counters_t));
+        hal.irq_enable();
+
+        if(region.calls) {
+            hal.stream.write("[PROF:");
+            hal.stream.write(region_name[idx]);
+            hal.stream.write(",");
+            hal.stream.write(uitoa(region.calls));
+            hal.stream.write(",");
+            hal.stream.write(uitoa((uint32_t)(region.cycles / region.calls)));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(region.max));
+            hal.stream.write(",");
+            hal.stream.write(uitoa((uint32_t)(region.cycles / 1000)));
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+
+    for(idx = 0; idx < ProfileEvent_Events; idx++) {
+        if(profile_events[idx]) {
+            hal.stream.write("[PROFEV:");
+            hal.stream.write(event_name[idx]);
+            hal.stream.write(",");
+            hal.stream.write(uitoa(profile_events[idx]));
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+
+    hal.stream.write("[PROF:ELAPSED,");
+    hal.stream.write(uitoa(hal.get_elapsed_ticks ? hal.get_elapsed_ticks() - reset_ms : 0));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[PROF:CLOCK,");
+    hal.stream.write(uitoa(get_time == NULL ? 0 : (get_time == hal.get_elapsed_ticks ? 1000 : hal.f_cycle_count)));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+static status_code_t profile_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "PROF", 4)) {
+        if(line[5] == '\0') {
+            profile_report();
+            retval = Status_OK;
+        } else if(!strcmp(&line[5], "=0")) {
+            profile_reset();
+            retval = Status_OK;
+        }
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void profile_init (void)
+{
+    get_time = hal.get_cycle_count ? hal.get_cycle_count : hal.get_elapsed_ticks;
+
+    if(grbl.on_unknown_sys_command != profile_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = profile_command;
+    }
+
+    profile_reset();
+}
+
+#endif
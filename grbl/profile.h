@@ -0,0 +1,96 @@
+/*
+  profile.h - execution time profiling of named code regions
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+
+#include "grbl.h"
+
+#ifndef PROFILE_REGIONS_MAX
+#define PROFILE_REGIONS_MAX 16 // Total number of regions, including those added by plugins.
+#endif
+
+#define PROFILE_NONE 0xFF
+
+// Predefined regions, plugins may add more with profile_add_region().
+typedef enum {
+    Profile_Parser = 0,             // gc_execute_block() for streamed blocks
+    Profile_PlannerRecalculate,     // planner_recalculate()
+    Profile_StPrepBuffer,           // st_prep_buffer()
+    Profile_ReportRealtimeStatus,   // report_realtime_status()
+    Profile_ExecRtSystem,           // protocol_exec_rt_system(), includes status reports and segment preparation
+    Profile_ModbusPoll,             // modbus_poll()
+    Profile_WsStreamPoll,           // WsStreamPoll()
+    Profile_TCPStreamPoll,          // TCPStreamPoll()
+    Profile_Regions
+} profile_region_t;
+
+typedef uint_fast8_t profile_id_t;
+
+// Event counters, incremented by the handlers in protocol_exec_rt_system().
+typedef enum {
+    ProfileEvent_RtIdle = 0,        // protocol_exec_rt_system() calls without any realtime event pending
+    ProfileEvent_RtPending,         // protocol_exec_rt_system() calls with realtime event(s) pending
+    ProfileEvent_Alarm,             // Alarm handler
+    ProfileEvent_Reset,             // EXEC_RESET handler
+    ProfileEvent_Stop,              // EXEC_STOP handler
+    ProfileEvent_Report,            // Status, G-code, tool offset and PID report requests
+    ProfileEvent_RtCommand,         // protocol_execute_rt_commands()
+    ProfileEvent_StateMachine,      // update_state()
+    ProfileEvent_FeedOverride,      // Feed and rapid override commands
+    ProfileEvent_AccessoryOverride, // Spindle and coolant override commands
+    ProfileEvent_Events
+} profile_event_t;
+
+#ifdef ENABLE_PROFILING
+
+// Marks the start and end of a region, a region must be entered and left in the same function.
+// Regions may be nested, the time of an inner region is included in the outer.
+#define PROFILE_BEGIN(id) uint32_t profile_start_##id = profile_start()
+#define PROFILE_END(id) profile_end(id, profile_start_##id)
+#define PROFILE_COUNT(event) profile_events[event]++
+
+extern THREAD_LOCAL uint32_t profile_events[ProfileEvent_Events];
+
+// Adds a named region, returns PROFILE_NONE if there is no free slot. Regions cannot be removed.
+profile_id_t profile_add_region (const char *name);
+
+// Returns the current time in cycles from hal.get_cycle_count(), or in milliseconds if not available.
+uint32_t profile_start (void);
+
+// Adds the time since start to the region.
+void profile_end (profile_id_t id, uint32_t start);
+
+// Clears the counters, including the event counters.
+void profile_reset (void);
+
+// Adds the $PROF system command.
+void profile_init (void);
+
+#else
+
+#define PROFILE_BEGIN(id)
+#define PROFILE_END(id)
+#define PROFILE_COUNT(event)
+
+#endif
+
+#endif
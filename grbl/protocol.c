@@ -32,11 +32,19 @@
 #include "motion_control.h"
 #include "sleep.h"
 #include "protocol.h"
+#include "profile.h"
+#include "raster.h"
 
 #ifndef RT_QUEUE_SIZE
-#define RT_QUEUE_SIZE 8 // must be a power of 2
+#define RT_QUEUE_SIZE 8
 #endif
 
+#if RT_QUEUE_SIZE < 2 || RT_QUEUE_SIZE > 16
+#error "RT_QUEUE_SIZE must be in the range 2 - 16."
+#endif
+
+#define RT_QUEUE_MASK ((uint_fast16_t)((1UL << RT_QUEUE_SIZE) - 1))
+
 // Define line flags. Includes comment type tracking and line overflow detection.
 typedef union {
     uint8_t value;
@@ -57,23 +65,241 @@ typedef struct {
     bool show;
 } user_message_t;
 
+// Realtime command queue, safe for multiple producers of different interrupt priorities.
+// Producers claim a slot by atomically clearing its bit in free, then publish it by setting its bit in ready.
+// Slots are claimed and executed in slot order from head and next respectively, preserving the order for each producer.
 typedef struct {
-    volatile uint_fast8_t head;
-    volatile uint_fast8_t tail;
+    volatile uint_fast16_t free;    // Slots available, bit per slot
+    volatile uint_fast16_t ready;   // Slots claimed and ready for execution, bit per slot
+    volatile uint_fast8_t head;     // Slot to try first on next enqueue
+    uint_fast8_t next;              // Slot to try first on next execute
     on_execute_realtime_ptr fn[RT_QUEUE_SIZE];
 } realtime_queue_t;
 
-static uint_fast16_t char_counter = 0;
-static char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
-static char xcommand[LINE_BUFFER_SIZE];
-static bool keep_rt_commands = false;
-static user_message_t user_message = {NULL, 0, 0, false};
+#ifndef STREAM_READ_BLOCK_SIZE
+#define STREAM_READ_BLOCK_SIZE 64
+#endif
+
+// Input read by hal.stream.read_block(), never holds data past an end of line character.
+typedef struct {
+    uint_fast16_t idx;
+    uint_fast16_t length;
+    char data[STREAM_READ_BLOCK_SIZE];
+} read_block_t;
+
+static THREAD_LOCAL uint_fast16_t char_counter = 0;
+static THREAD_LOCAL char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
+static THREAD_LOCAL char xcommand[LINE_BUFFER_SIZE];
+static THREAD_LOCAL bool keep_rt_commands = false;
+static THREAD_LOCAL user_message_t user_message = {NULL, 0, 0, false};
 static const char *msg = "(MSG,";
-static realtime_queue_t realtime_queue = {0};
+static THREAD_LOCAL realtime_queue_t realtime_queue = { .free = RT_QUEUE_MASK };
+static THREAD_LOCAL rt_queue_stats_t rt_queue_stats = { .size = RT_QUEUE_SIZE };
+static THREAD_LOCAL read_block_t read_block = {0};
+
+#ifdef ENABLE_ACK_WINDOW
+
+// Windowed acknowledge state, see protocol_set_ack_window().
+static THREAD_LOCAL struct {
+    uint_fast16_t window;   // Max number of lines the sender may have unacknowledged, 0 when disabled
+    uint_fast16_t batch;    // Number of accepted lines acknowledged by each ok:<line>
+    uint_fast16_t pending;  // Number of accepted lines not yet acknowledged
+    uint32_t line;          // Number of lines processed since windowed mode was enabled
+    int32_t request;        // Window requested by $ACK, -1 if none
+} ack = {0, 0, 0, 0, -1};
+
+#endif
+
+#ifdef ENABLE_STREAM_COMPRESSION
+
+#define ZIP_HISTORY_SIZE 64     // Decoded characters kept for matches, must be a power of 2
+#define ZIP_WINDOW 62           // Max match distance, must be less than ZIP_HISTORY_SIZE
+#define ZIP_MIN_LENGTH 3        // Match length of match character 'a', 'z' is ZIP_MIN_LENGTH + 25
+#define ZIP_DISTANCE_CHAR '@'   // Distance 1 character, distances are encoded as '@' to '}'
+#define ZIP_ESCAPE_CHAR '`'     // Next character is a literal
+
+// Compressed input state, see protocol_set_stream_compression().
+static THREAD_LOCAL struct {
+    bool enabled;
+    bool error;                 // Invalid match in current line
+    bool escape;                // Next character is a literal
+    int8_t request;             // Mode requested by $ZIP, -1 if none
+    uint_fast8_t head;          // History write index
+    uint_fast8_t count;         // Number of characters in history, max ZIP_WINDOW
+    uint_fast8_t length;        // Remaining characters of current match
+    uint_fast8_t distance;      // Distance of current match, 0 if awaiting the distance character
+    char history[ZIP_HISTORY_SIZE];
+} zip = { .request = -1 };
+
+#endif
 
 static void protocol_exec_rt_suspend ();
 static void protocol_execute_rt_commands (void);
 
+// Returns the next character from the input stream, SERIAL_NO_DATA if none available.
+// When the stream provides read_block() input is fetched a line, or part of it, at a time
+// rather than by one call to read() per character.
+static inline int16_t stream_read_input (void)
+{
+    if(read_block.idx == read_block.length) {
+
+        if(hal.stream.read_block == NULL)
+            return hal_stream_read();
+
+        read_block.idx = 0;
+        if((read_block.length = hal.stream.read_block(read_block.data, STREAM_READ_BLOCK_SIZE)) == 0)
+            return SERIAL_NO_DATA;
+    }
+
+    return (int16_t)read_block.data[read_block.idx++];
+}
+
+#ifdef ENABLE_STREAM_COMPRESSION
+
+/* Enables compressed input when on, disables it when off. Called by the $ZIP=<0|1> system command,
+   takes effect after the status of the command line is reported.
+   Compressed input is LZ77 style, a match character 'a' to 'z' followed by a distance character '@' to '}'
+   copies 3 to 28 characters from the last ZIP_WINDOW (62) decoded characters, line ends excluded. '`' escapes
+   lowercase letters and itself, all other characters are literals. Only printable characters are used since
+   drivers filter control characters from the input stream as real-time commands. Typically long parts of a
+   line repeat the previous line with only some digits changed, and the number of bytes sent is reduced to a
+   third or less. See doc/script/gcode_zip.py for the encoder.
+*/
+void protocol_set_stream_compression (bool on)
+{
+    zip.request = on;
+}
+
+static void zip_set_mode (bool on)
+{
+    zip.enabled = on;
+    zip.error = zip.escape = false;
+    zip.head = zip.count = zip.length = zip.distance = 0;
+}
+
+static inline void zip_add (char c)
+{
+    if(c == ASCII_LF || c == ASCII_CR)
+        return;
+
+    zip.history[zip.head++ & (ZIP_HISTORY_SIZE - 1)] = c;
+    if(zip.count < ZIP_WINDOW)
+        zip.count++;
+}
+
+// Returns the next decoded character from the input stream, SERIAL_NO_DATA if none available.
+static int16_t zip_read (void)
+{
+    int16_t c;
+
+    while(zip.distance == 0) {
+
+        if((c = stream_read_input()) == SERIAL_NO_DATA)
+            return c;
+
+        if(zip.escape)
+            zip.escape = false;
+        else if(zip.length) { // Distance character of match
+            if(c >= ZIP_DISTANCE_CHAR && c - ZIP_DISTANCE_CHAR < zip.count) {
+                zip.distance = c - ZIP_DISTANCE_CHAR + 1;
+                break;
+            }
+            zip.length = 0;
+            zip.error = true; // Pass the character on as a literal, it may be the end of the line.
+        } else if(c >= 'a' && c <= 'z') {
+            zip.length = c - 'a' + ZIP_MIN_LENGTH;
+            continue;
+        } else if(c == ZIP_ESCAPE_CHAR) {
+            zip.escape = true;
+            continue;
+        }
+
+        zip_add((char)c);
+
+        return c;
+    }
+
+    c = zip.history[(zip.head - zip.distance) & (ZIP_HISTORY_SIZE - 1)];
+    zip_add((char)c);
+
+    if(--zip.length == 0)
+        zip.distance = 0;
+
+    return c;
+}
+
+#endif
+
+static inline int16_t stream_read (void)
+{
+#ifdef ENABLE_STREAM_COMPRESSION
+    if(zip.enabled)
+        return zip_read();
+#endif
+
+    return stream_read_input();
+}
+
+#ifdef ENABLE_ACK_WINDOW
+
+/* Enables windowed acknowledge mode when window > 0, disables it when 0. Called by the $ACK=<window>
+   system command, takes effect after the status of the command line is reported.
+   In windowed mode the sender may have up to window lines not acknowledged. Accepted lines are
+   acknowledged in batches by ok:<line>, where line is the number of lines processed since the mode
+   was enabled. Errors are still reported per line by error:<code> and acknowledge the line following
+   the last line acknowledged, any lines accepted before are acknowledged first.
+*/
+void protocol_set_ack_window (uint_fast16_t window)
+{
+    ack.request = window;
+}
+
+// Reports the accepted lines not yet acknowledged.
+static void ack_flush (void)
+{
+    if(ack.pending) {
+        ack.pending = 0;
+        hal.stream.write("ok:");
+        hal.stream.write(uitoa(ack.line));
+        hal.stream.write(ASCII_EOL);
+    }
+}
+
+#endif
+
+// Reports the status of a line received from the input stream.
+static void report_line_status (status_code_t status)
+{
+#ifdef ENABLE_ACK_WINDOW
+    if(ack.request >= 0) { // Window changed by this line, report status normally, then apply.
+        ack_flush();
+        grbl.report.status_message(status);
+        if((ack.window = (uint_fast16_t)ack.request)) {
+            ack.batch = max(ack.window / 2, 1);
+            ack.line = 0;
+            hal.stream.write("[ACK:");
+            hal.stream.write(uitoa(ack.window));
+            hal.stream.write("]" ASCII_EOL);
+        }
+        ack.request = -1;
+        return;
+    }
+
+    if(ack.window) {
+        if(status == Status_OK) {
+            ack.line++;
+            if(++ack.pending >= ack.batch)
+                ack_flush();
+            return;
+        }
+        ack_flush();
+        ack.line++;
+    }
+#endif
+
+    grbl.report.status_message(status);
+}
+
 // add gcode to execute not originating from normal input stream
 bool protocol_enqueue_gcode (char *gcode)
 {
@@ -129,7 +355,7 @@ bool protocol_main_loop(bool cold_start)
 #ifdef ENABLE_SAFETY_DOOR_INPUT_PIN
         // Check if the safety door is open.
         if (!settings.flags.safety_door_ignore_when_idle && hal.control.get_state().safety_door_ajar) {
-            bit_true(sys_rt_exec_state, EXEC_SAFETY_DOOR);
+            system_set_exec_state_flag(EXEC_SAFETY_DOOR);
             protocol_execute_realtime(); // Enter safety door mode. Should return as IDLE state.
         }
 #endif
@@ -141,10 +367,12 @@ bool protocol_main_loop(bool cold_start)
     if(cold_start) {
         hal.spindle.set_state((spindle_state_t){0}, 0.0f);
         hal.coolant.set_state((coolant_state_t){0});
-        if(realtime_queue.head != realtime_queue.tail)
+        if(realtime_queue.ready)
             system_set_exec_state_flag(EXEC_RT_COMMAND);  // execute any boot up commands
-    } else
+    } else {
         memset(&realtime_queue, 0, sizeof(realtime_queue_t));
+        realtime_queue.free = RT_QUEUE_MASK;
+    }
 
     // ---------------------------------------------------------------------------------
     // Primary loop! Upon a system abort, this exits back to main() to reset the system.
@@ -155,15 +383,27 @@ bool protocol_main_loop(bool cold_start)
     char eol = '\0';
     line_flags_t line_flags = {0};
     bool nocaps = false;
+#ifdef ENABLE_PACKED_BLOCKS
+    bool packed = false;
+#endif
 
     xcommand[0] = '\0';
     user_message.show = keep_rt_commands = false;
+    read_block.idx = read_block.length = 0;
+#ifdef ENABLE_ACK_WINDOW
+    ack.window = ack.pending = 0;
+    ack.request = -1;
+#endif
+#ifdef ENABLE_STREAM_COMPRESSION
+    zip_set_mode(false);
+    zip.request = -1;
+#endif
 
     while(true) {
 
         // Process one line of incoming stream data, as the data becomes available. Performs an
         // initial filtering by removing spaces and comments and capitalizing all letters.
-        while((c = hal.stream.read()) != SERIAL_NO_DATA) {
+        while((c = stream_read()) != SERIAL_NO_DATA) {
 
             if(c == ASCII_CAN) {
 
@@ -171,6 +411,9 @@ bool protocol_main_loop(bool cold_start)
                 keep_rt_commands = nocaps = user_message.show = false;
                 char_counter = line_flags.value = 0;
                 gc_state.last_error = Status_OK;
+#ifdef ENABLE_PACKED_BLOCKS
+                packed = false;
+#endif
 
                 if (sys.state == STATE_JOG) // Block all other states from invoking motion cancel.
                     system_set_exec_state_flag(EXEC_MOTION_CANCEL);
@@ -197,6 +440,10 @@ bool protocol_main_loop(bool cold_start)
                 // Direct and execute one line of formatted input, and report status of execution.
                 if (line_flags.overflow) // Report line overflow error.
                     gc_state.last_error = Status_Overflow;
+#ifdef ENABLE_STREAM_COMPRESSION
+                else if (zip.error) // Report invalid match in compressed input.
+                    gc_state.last_error = Status_StreamDecodeError;
+#endif
                 else if ((line[0] == '\0' || char_counter == 0) && !user_message.show && !line_flags.line_is_comment) // Empty or comment line. For syncing purposes.
                     gc_state.last_error = Status_OK;
                 else if (line[0] == '$') {// Grbl '$' system command
@@ -215,7 +462,9 @@ bool protocol_main_loop(bool cold_start)
                 else { // Parse and execute g-code block.
 
 #endif
+                    PROFILE_BEGIN(Profile_Parser);
                     gc_state.last_error = gc_execute_block(line, user_message.show ? user_message.message : NULL);
+                    PROFILE_END(Profile_Parser);
                 }
 
                 // Add a short delay for each block processed in Check Mode to
@@ -227,12 +476,31 @@ bool protocol_main_loop(bool cold_start)
                     hal.delay_ms(CHECK_MODE_DELAY, NULL);
 #endif
 
-                grbl.report.status_message(gc_state.last_error);
+                report_line_status(gc_state.last_error);
+
+#ifdef ENABLE_STREAM_COMPRESSION
+                zip.error = false;
+                if(zip.request >= 0) { // Mode changed by this line, apply after the status is reported.
+                    zip_set_mode(zip.request);
+                    zip.request = -1;
+                    hal.stream.write(zip.enabled ? "[ZIP:1]" ASCII_EOL : "[ZIP:0]" ASCII_EOL);
+                }
+#endif
 
                 // Reset tracking data for next line.
                 keep_rt_commands = nocaps = user_message.show = false;
                 char_counter = line_flags.value = 0;
+#ifdef ENABLE_PACKED_BLOCKS
+                packed = false;
+#endif
 
+#ifdef ENABLE_PACKED_BLOCKS
+            } else if (packed || (c == ASCII_STX && char_counter == 0)) {
+                // Packed block, keep all characters as is for validation by the parser.
+                packed = true;
+                if (!(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
+                    line[char_counter++] = c;
+#endif
             } else if (c <= (nocaps ? ' ' - 1 : ' ') || line_flags.value) {
                 // Throw away all whitepace, control characters, comment characters and overflow characters.
                 if(c >= ' ' && line_flags.comment_parentheses) {
@@ -314,9 +582,15 @@ bool protocol_main_loop(bool cold_start)
             xcommand[0] = '\0';
         }
 
+#ifdef ENABLE_ACK_WINDOW
+        // No more input available, acknowledge the lines accepted so far.
+        ack_flush();
+#endif
+
         // If there are no more characters in the input stream buffer to be processed and executed,
         // this indicates that g-code streaming has either filled the planner buffer or has
         // completed. In either case, auto-cycle start, if enabled, any queued moves.
+        plan_replan_stale_blocks(); // No new blocks are queued to trigger replanning after an override change.
         protocol_auto_cycle_start();
 
         if(!protocol_execute_realtime() && sys.abort) // Runtime command check point.
@@ -336,9 +610,26 @@ bool protocol_main_loop(bool cold_start)
 bool protocol_buffer_synchronize ()
 {
     bool ok = true;
+#ifdef ENABLE_JOB_ESTIMATE
+    if(sys.flags.estimate)
+        mc_estimate_blocks(true);
+#endif
+#ifdef ENABLE_LASER_RASTER
+    raster_end_row(); // Decelerate beyond the end of the current raster row before waiting.
+#endif
     // If system is queued, ensure cycle resumes if the auto start flag is present.
     protocol_auto_cycle_start();
-    while ((ok = protocol_execute_realtime()) && (plan_get_current_block() || sys.state == STATE_CYCLE));
+#ifdef ENABLE_PARSE_AHEAD
+    while ((ok = protocol_execute_realtime()) && (plan_get_current_block() || sys.state == STATE_CYCLE || mc_parse_ahead_pending()))
+#else
+    while ((ok = protocol_execute_realtime()) && (plan_get_current_block() || sys.state == STATE_CYCLE))
+#endif
+        plan_replan_stale_blocks(); // No new blocks are queued to trigger replanning after an override change.
+
+#ifdef GC_QUEUED_STATE
+    if(ok)
+        gc_flush_queued_state();
+#endif
 
     return ok;
 }
@@ -352,8 +643,18 @@ bool protocol_buffer_synchronize ()
 // execute calls a buffer sync, or the planner buffer is full and ready to go.
 void protocol_auto_cycle_start ()
 {
-    if (plan_get_current_block() != NULL) // Check if there are any blocks in the buffer.
+#ifdef PLANNER_HOLD_LINE
+    plan_flush_held_line(); // Queue any line held back for merging or blending.
+#endif
+
+    if (plan_get_current_block() != NULL) { // Check if there are any blocks in the buffer.
+#ifdef ENABLE_JOB_ESTIMATE
+        if(sys.flags.estimate) // Consume blocks instead.
+            mc_estimate_blocks(!plan_check_full_buffer());
+        else
+#endif
         system_set_exec_state_flag(EXEC_CYCLE_START); // If so, execute them!
+    }
 }
 
 
@@ -378,21 +679,76 @@ bool protocol_execute_realtime ()
 
       #ifdef BUFFER_NVSDATA
         if((sys.state == STATE_IDLE || sys.state == STATE_ALARM || sys.state == STATE_ESTOP) && settings_dirty.is_dirty && !gc_state.file_run)
-            nvs_buffer_sync_physical();
+            nvs_buffer_sync_deferred();
       #endif
     }
 
+#ifdef ENABLE_PARSE_AHEAD
+    if(!ABORTED)
+        mc_parse_ahead_poll(); // Move parsed motions to the planner buffer if there is room.
+#endif
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    if(!ABORTED)
+        mc_cycle_resume(); // Queue more motions of an active canned cycle if there is room in the planner buffer.
+#endif
+
+#ifdef ENABLE_VELOCITY_JOG
+    if(!ABORTED)
+        mc_jog_velocity_poll();
+#endif
+
     return !ABORTED;
 }
 
+#ifdef ENABLE_AUTO_REPORT
+
+// Requests a real-time status report when the auto report interval has elapsed or the state has changed.
+// The report is output by protocol_exec_rt_system() along with any report requested by a host in the meantime.
+static void auto_report (void)
+{
+    static THREAD_LOCAL uint32_t last_ms = 0;
+    static THREAD_LOCAL uint_fast16_t last_state = STATE_IDLE;
+
+    if(settings.auto_report_interval && hal.get_elapsed_ticks) {
+
+        uint32_t ms = hal.get_elapsed_ticks();
+
+        if(sys.state != last_state || ms - last_ms >= settings.auto_report_interval) {
+            last_ms = ms;
+            last_state = sys.state;
+            system_set_exec_state_flag(EXEC_STATUS_REPORT);
+        }
+    }
+}
+
+#endif
+
 // Executes run-time commands, when required. This function primarily operates as Grbl's state
 // machine and controls the various real-time features Grbl has to offer.
 // NOTE: Do not alter this unless you know exactly what you are doing!
 bool protocol_exec_rt_system ()
 {
+    bool pending;
     uint_fast16_t rt_exec;
 
-    if (sys_rt_exec_alarm && (rt_exec = system_clear_exec_alarm())) { // Enter only if any bit flag is true
+    PROFILE_BEGIN(Profile_ExecRtSystem);
+
+#ifdef ENABLE_AUTO_REPORT
+    auto_report();
+#endif
+
+    // The alarm and state flags and the override queues are only checked when an event has been flagged.
+    // The pending flag is cleared before they are checked, events flagged after that are handled by the next call.
+    if((pending = sys_rt_exec_pending)) {
+        sys_rt_exec_pending = false;
+        PROFILE_COUNT(ProfileEvent_RtPending);
+    } else
+        PROFILE_COUNT(ProfileEvent_RtIdle);
+
+    if (pending && sys_rt_exec_alarm && (rt_exec = system_clear_exec_alarm())) { // Enter only if any bit flag is true
+
+        PROFILE_COUNT(ProfileEvent_Alarm);
 
         // System alarm. Everything has shutdown by something that has gone severely wrong. Report
         // the source of the error to the user. If critical, Grbl disables by entering an infinite
@@ -430,11 +786,13 @@ bool protocol_exec_rt_system ()
         }
     }
 
-    if (sys_rt_exec_state && (rt_exec = system_clear_exec_states())) { // Get and clear volatile sys_rt_exec_state atomically.
+    if (pending && sys_rt_exec_state && (rt_exec = system_clear_exec_states())) { // Get and clear volatile sys_rt_exec_state atomically.
 
         // Execute system abort.
         if (rt_exec & EXEC_RESET) {
 
+            PROFILE_COUNT(ProfileEvent_Reset);
+
             // Kill spindle and coolant.
             hal.spindle.set_state((spindle_state_t){0}, 0.0f);
             hal.coolant.set_state((coolant_state_t){0});
@@ -442,11 +800,14 @@ bool protocol_exec_rt_system ()
             hal.driver_reset();
 
             sys.abort = !hal.control.get_state().e_stop;  // Only place this is set true.
+            PROFILE_END(Profile_ExecRtSystem);
             return !sys.abort; // Nothing else to do but exit.
         }
 
         if(rt_exec & EXEC_STOP) { // Experimental for now, must be verified. Do NOT move to interrupt context!
 
+            PROFILE_COUNT(ProfileEvent_Stop);
+
             sys.cancel = true;
             sys.step_control.flags = 0;
             sys.flags.feed_hold_pending = Off;
@@ -472,6 +833,9 @@ bool protocol_exec_rt_system ()
 
             gc_init(false);
             plan_reset();
+#ifdef ENABLE_PARSE_AHEAD
+            mc_parse_ahead_reset();
+#endif
 /*            if(sys.alarm_pending == Alarm_ProbeProtect) {
                 st_go_idle();
                 system_set_exec_alarm(sys.alarm_pending);
@@ -483,6 +847,11 @@ bool protocol_exec_rt_system ()
             set_state(STATE_IDLE);
         }
 
+#ifdef ENABLE_PROFILING
+        if(rt_exec & (EXEC_STATUS_REPORT|EXEC_GCODE_REPORT|EXEC_TLO_REPORT|EXEC_PID_REPORT))
+            PROFILE_COUNT(ProfileEvent_Report);
+#endif
+
         // Execute and print status to output stream
         if (rt_exec & EXEC_STATUS_REPORT)
             report_realtime_status();
@@ -497,8 +866,10 @@ bool protocol_exec_rt_system ()
         if (rt_exec & EXEC_PID_REPORT)
             report_pid_log();
 
-        if(rt_exec & EXEC_RT_COMMAND)
+        if(rt_exec & EXEC_RT_COMMAND) {
+            PROFILE_COUNT(ProfileEvent_RtCommand);
             protocol_execute_rt_commands();
+        }
 
         rt_exec &= ~(EXEC_STOP|EXEC_STATUS_REPORT|EXEC_GCODE_REPORT|EXEC_PID_REPORT|EXEC_TLO_REPORT|EXEC_RT_COMMAND); // clear requests already processed
 
@@ -510,19 +881,34 @@ bool protocol_exec_rt_system ()
         }
 
         // Let state machine handle any remaining requests
-        if(rt_exec)
+        if(rt_exec) {
+            PROFILE_COUNT(ProfileEvent_StateMachine);
             update_state(rt_exec);
+        }
     }
 
     grbl.on_execute_realtime(sys.state);
 
-    if(!sys.flags.delay_overrides) {
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+    if(!sys.flags.delay_overrides)
+        feed_override_settle();
+#endif
+
+    if(pending && !sys.flags.delay_overrides) {
 
         // Execute overrides.
 
         if((rt_exec = get_feed_override())) {
 
+            PROFILE_COUNT(ProfileEvent_FeedOverride);
+
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+            uint_fast8_t new_f_override, new_r_override;
+
+            feed_override_get_target(&new_f_override, &new_r_override);
+#else
             uint_fast8_t new_f_override = sys.override.feed_rate, new_r_override = sys.override.rapid_rate;
+#endif
 
             do {
 
@@ -563,11 +949,17 @@ bool protocol_exec_rt_system ()
 
             } while((rt_exec = get_feed_override()));
 
+#ifdef ENABLE_OVERRIDE_DEBOUNCE
+            feed_override_set_target(new_f_override, new_r_override);
+#else
             plan_feed_override(new_f_override, new_r_override);
+#endif
         }
 
         if((rt_exec = get_accessory_override())) {
 
+            PROFILE_COUNT(ProfileEvent_AccessoryOverride);
+
             bool spindle_stop = false;
             uint_fast8_t last_s_override = sys.override.spindle_rpm;
             coolant_state_t coolant_state = gc_state.modal.coolant;
@@ -644,6 +1036,8 @@ bool protocol_exec_rt_system ()
     if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP| STATE_JOG))
         st_prep_buffer();
 
+    PROFILE_END(Profile_ExecRtSystem);
+
     return !ABORTED;
 }
 
@@ -682,7 +1076,7 @@ static void protocol_exec_rt_suspend ()
 // Called from input stream interrupt handler.
 ISR_CODE bool protocol_enqueue_realtime_command (char c)
 {
-    static bool esc = false;
+    static THREAD_LOCAL bool esc = false;
 
     bool drop = false;
 
@@ -755,8 +1149,10 @@ ISR_CODE bool protocol_enqueue_realtime_command (char c)
             drop = true;
             hal.stream.cancel_read_buffer();
 #ifdef KINEMATICS_API // needed when kinematics algorithm segments long jog distances (as it blocks reading from input stream)
-            if (sys.state & STATE_JOG) // Block all other states from invoking motion cancel.
+            if (sys.state & STATE_JOG) { // Block all other states from invoking motion cancel.
+                sys.flags.jog_cancel = On;
                 system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+            }
 #endif
             break;
 
@@ -858,29 +1254,84 @@ ISR_CODE bool protocol_enqueue_realtime_command (char c)
 // foreground process, typically enqueued from an interrupt handler.
 ISR_CODE bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn)
 {
-    bool ok;
-    uint_fast8_t bptr = (realtime_queue.head + 1) & (RT_QUEUE_SIZE - 1);    // Get next head pointer
+    uint_fast8_t idx = realtime_queue.head, count = RT_QUEUE_SIZE;
+    uint_fast16_t slot, used;
 
-    if((ok = bptr != realtime_queue.tail)) {          // If not buffer full
-        realtime_queue.fn[realtime_queue.head] = fn;  // add function pointer to buffer,
-        realtime_queue.head = bptr;                   // update pointer and
-        system_set_exec_state_flag(EXEC_RT_COMMAND);  // flag it for execute
+    // Claim the first free slot from head, only one producer can clear a set bit.
+    do {
+        slot = bit(idx);
+        if((realtime_queue.free & slot) && (hal.clear_bits_atomic(&realtime_queue.free, slot) & slot))
+            break;
+        idx = idx == RT_QUEUE_SIZE - 1 ? 0 : idx + 1;
+    } while(--count);
+
+    if(count == 0) {                                    // If queue full
+        rt_queue_stats.dropped++;                       // count it and fail
+        return false;
     }
 
-    return ok;
+    realtime_queue.head = idx == RT_QUEUE_SIZE - 1 ? 0 : idx + 1;
+    realtime_queue.fn[idx] = fn;                        // add function pointer to slot,
+    hal.set_bits_atomic(&realtime_queue.ready, slot);   // publish it and
+    system_set_exec_state_flag(EXEC_RT_COMMAND);        // flag it for execute
+
+    // Track high water mark.
+    used = ~realtime_queue.free & RT_QUEUE_MASK;
+    count = 0;
+    while(used) {
+        used &= used - 1;
+        count++;
+    }
+    if(count > rt_queue_stats.high_water_mark)
+        rt_queue_stats.high_water_mark = count;
+
+    return true;
+}
+
+#ifdef ENABLE_MEMORY_REPORT
+
+// Returns RAM used by the line buffers, the block read buffer and the realtime command queue.
+uint32_t protocol_get_buffer_memory (void)
+{
+    return sizeof(line) + sizeof(xcommand) + sizeof(read_block) + sizeof(realtime_queue);
+}
+
+#endif
+
+// Returns realtime command queue statistics.
+rt_queue_stats_t *protocol_get_rt_queue_stats (void)
+{
+    return &rt_queue_stats;
+}
+
+void protocol_clear_rt_queue_stats (void)
+{
+    rt_queue_stats.high_water_mark = 0;
+    rt_queue_stats.dropped = 0;
 }
 
 // Execute enqueued functions.
+// NOTE: the slot is released before the function is called so that it may enqueue itself again.
 static void protocol_execute_rt_commands (void)
 {
-    while(realtime_queue.tail != realtime_queue.head) {
-        uint_fast8_t bptr = realtime_queue.tail;
-        on_execute_realtime_ptr call;
-        if((call = realtime_queue.fn[bptr])) {
-            realtime_queue.fn[bptr] = NULL;
+    uint_fast8_t idx;
+    uint_fast16_t ready;
+    on_execute_realtime_ptr call;
+
+    while((ready = realtime_queue.ready)) {
+
+        do {
+            idx = realtime_queue.next;
+            realtime_queue.next = idx == RT_QUEUE_SIZE - 1 ? 0 : idx + 1;
+        } while(!(ready & bit(idx)));
+
+        call = realtime_queue.fn[idx];
+        realtime_queue.fn[idx] = NULL;
+        hal.clear_bits_atomic(&realtime_queue.ready, bit(idx));
+        hal.set_bits_atomic(&realtime_queue.free, bit(idx));
+
+        if(call)
             call(sys.state);
-        }
-        realtime_queue.tail = (bptr + 1) & (RT_QUEUE_SIZE - 1);
     }
 }
 
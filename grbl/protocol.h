@@ -43,6 +43,18 @@ bool protocol_exec_rt_system();
 void protocol_execute_noop (uint_fast16_t state);
 bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn);
 
+typedef struct {
+    uint8_t size;               // Number of slots in the realtime command queue
+    uint8_t high_water_mark;    // Max number of slots in use since cleared
+    uint32_t dropped;           // Number of commands not enqueued since cleared due to the queue being full
+} rt_queue_stats_t;
+
+rt_queue_stats_t *protocol_get_rt_queue_stats (void);
+#ifdef ENABLE_MEMORY_REPORT
+uint32_t protocol_get_buffer_memory (void);
+#endif
+void protocol_clear_rt_queue_stats (void);
+
 // Executes the auto cycle feature, if enabled.
 void protocol_auto_cycle_start();
 
@@ -53,6 +65,17 @@ bool protocol_enqueue_realtime_command (char c);
 bool protocol_enqueue_gcode (char *data);
 void protocol_message (char *message);
 
+#ifdef ENABLE_ACK_WINDOW
+#ifndef ACK_WINDOW_MAX
+#define ACK_WINDOW_MAX 255 // Max number of lines not acknowledged in windowed acknowledge mode
+#endif
+void protocol_set_ack_window (uint_fast16_t window);
+#endif
+
+#ifdef ENABLE_STREAM_COMPRESSION
+void protocol_set_stream_compression (bool on);
+#endif
+
 // work in progress...
 //void set_state (uint_fast16_t state);
 
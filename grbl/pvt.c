@@ -0,0 +1,533 @@
+/*
+  pvt.c - host streamed position-velocity-time trajectories
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_PVT_STREAM
+
+#include <math.h>
+#include <string.h>
+
+#include "pvt.h"
+#include "system.h"
+#include "protocol.h"
+#include "report.h"
+#ifdef KINEMATICS_API
+#include "kinematics.h"
+#endif
+
+/* $PVT switches the input stream to binary frames, acknowledged by ok. Outside a frame realtime commands
+   are acted upon as usual and other characters are dropped. Frames are, little endian:
+
+     0x01 'K' <duration:uint32> <position:float * N_AXIS> <velocity:float * N_AXIS> <crc>
+     0x01 'E' <crc>
+
+   A knot frame holds the time in microseconds since the previous knot, the machine position in mm and the
+   velocity in mm/min of each axis. The CRC is CRC-8 (polynomial 0x07, initial value 0) of the bytes following
+   0x01. The end frame ends the stream when all knots are executed and restores normal input, reported by
+   [MSG:Info: PVT stream ended].
+
+   The trajectory starts from the current position at standstill. Each interval between knots is cubic
+   Hermite interpolated into segments of the stepper segment time, which are queued directly in the step
+   segment buffer. The planner is bypassed, so overrides, backlash and height map compensation do not apply.
+   If the knot buffer is empty during motion when PVT_UNDERFLOW_SEGMENTS segments are left to execute, or on
+   a feed hold, a frame error or a knot outside the soft limits, the motion is decelerated to a stop at the
+   axis acceleration limits and the stream is aborted with a warning message. Knots received after that are
+   dropped, the host must still send the end frame. Running out of knots at standstill is not an error,
+   motion is resumed when PVT_START_KNOTS knots are buffered again. */
+
+#ifndef ACCELERATION_TICKS_PER_SECOND
+#define ACCELERATION_TICKS_PER_SECOND 100
+#endif
+
+#define PVT_SEGMENT_TIME (1.0f / (ACCELERATION_TICKS_PER_SECOND * 60.0f)) // min
+#define PVT_KNOT_FRAME_LENGTH (1 + sizeof(uint32_t) + 2 * N_AXIS * sizeof(float) + 1) // Type, knot data and CRC.
+
+typedef enum {
+    PVT_Off = 0,
+    PVT_Streaming,
+    PVT_Stopping, // Decelerating to a stop, knots are discarded.
+    PVT_Draining, // Waiting for the queued segments to be executed.
+    PVT_Ended     // Motion completed, waiting for the end frame.
+} pvt_state_t;
+
+typedef enum {
+    PVTError_None = 0,
+    PVTError_Frame,
+    PVTError_Checksum,
+    PVTError_Overflow
+} pvt_error_t;
+
+typedef struct {
+    uint32_t duration; // us
+    float position[N_AXIS];
+    float velocity[N_AXIS];
+} pvt_knot_t;
+
+typedef struct {
+    bool active;
+    float p0[N_AXIS], v0[N_AXIS], p1[N_AXIS], v1[N_AXIS];
+    float time;         // Interval duration (min)
+    uint32_t segments;  // Number of segments the interval is split in
+    uint32_t segment;   // Number of segments queued
+} pvt_interval_t;
+
+static THREAD_LOCAL struct {
+    pvt_state_t state;
+    bool starting;             // Waiting for PVT_START_KNOTS knots before starting from standstill.
+    bool moving;               // Last queued segment ended with a non zero velocity.
+    int32_t steps[N_AXIS];     // End of the last queued segment
+    float position[N_AXIS];    // mm
+    float velocity[N_AXIS];    // mm/min
+    pvt_interval_t interval;
+#if PVT_FREE_REPORT
+    uint_fast16_t consumed;
+#endif
+} pvt = {0};
+
+static THREAD_LOCAL struct {
+    volatile uint_fast16_t head;
+    volatile uint_fast16_t tail;
+    pvt_knot_t knot[PVT_BUFFER_SIZE];
+} knots;
+
+// Frame decoder state, written by the input stream interrupt handler.
+static THREAD_LOCAL struct {
+    uint_fast8_t length;     // Number of bytes received following the start byte
+    uint_fast8_t expected;
+    bool in_frame;
+    uint8_t crc;
+    uint8_t data[PVT_KNOT_FRAME_LENGTH];
+    volatile bool end;
+    volatile bool discard;   // Set when the stream is aborted, knots are then dropped.
+    volatile pvt_error_t error;
+} rx;
+
+static THREAD_LOCAL enqueue_realtime_command_ptr enqueue_realtime_command;
+static THREAD_LOCAL on_execute_realtime_ptr on_execute_realtime;
+static THREAD_LOCAL on_realtime_report_ptr on_realtime_report;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+static inline uint_fast16_t knots_queued (void)
+{
+    uint_fast16_t head = knots.head, tail = knots.tail;
+
+    return head >= tail ? head - tail : PVT_BUFFER_SIZE + head - tail;
+}
+
+static inline uint_fast16_t knots_free (void)
+{
+    return PVT_BUFFER_SIZE - 1 - knots_queued();
+}
+
+// Returns the buffered knot time in ms.
+static uint32_t knots_time (void)
+{
+    uint64_t time = 0;
+    uint_fast16_t idx = knots.tail, head = knots.head;
+
+    while(idx != head) {
+        time += knots.knot[idx].duration;
+        idx = (idx + 1) % PVT_BUFFER_SIZE;
+    }
+
+    return (uint32_t)(time / 1000);
+}
+
+static inline uint8_t crc8 (uint8_t crc, uint8_t data)
+{
+    uint_fast8_t bits = 8;
+
+    crc ^= data;
+    do {
+        crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    } while(--bits);
+
+    return crc;
+}
+
+// Stores a received knot frame in the knot buffer.
+ISR_CODE static void knot_received (void)
+{
+    uint_fast16_t next = (knots.head + 1) % PVT_BUFFER_SIZE;
+    pvt_knot_t *knot = &knots.knot[knots.head];
+
+    if(rx.discard)
+        return;
+
+    if(next == knots.tail) {
+        rx.error = PVTError_Overflow;
+        return;
+    }
+
+    memcpy(&knot->duration, &rx.data[1], sizeof(uint32_t));
+    memcpy(knot->position, &rx.data[1 + sizeof(uint32_t)], sizeof(knot->position));
+    memcpy(knot->velocity, &rx.data[1 + sizeof(uint32_t) + sizeof(knot->position)], sizeof(knot->velocity));
+
+    if(knot->duration == 0)
+        rx.error = PVTError_Frame;
+    else
+        knots.head = next;
+}
+
+// Input stream filter while streaming, decodes frames and passes any other characters to the realtime command handler.
+ISR_CODE static bool pvt_enqueue_realtime_command (char c)
+{
+    uint8_t data = (uint8_t)c;
+
+    if(!rx.in_frame) {
+        if(data == PVT_FRAME_START && !rx.end) {
+            rx.in_frame = true;
+            rx.length = 0;
+            rx.crc = 0;
+        } else
+            enqueue_realtime_command(c);
+        return true; // Other characters are dropped.
+    }
+
+    rx.data[rx.length++] = data;
+
+    if(rx.length == 1) switch(data) {
+
+        case PVT_FRAME_KNOT:
+            rx.expected = PVT_KNOT_FRAME_LENGTH;
+            break;
+
+        case PVT_FRAME_END:
+            rx.expected = 2;
+            break;
+
+        default:
+            rx.error = PVTError_Frame;
+            rx.in_frame = false;
+            return true;
+    }
+
+    if(rx.length < rx.expected)
+        rx.crc = crc8(rx.crc, data);
+    else {
+        rx.in_frame = false;
+        if(data != rx.crc)
+            rx.error = PVTError_Checksum;
+        else if(rx.data[0] == PVT_FRAME_END)
+            rx.end = true;
+        else
+            knot_received();
+    }
+
+    return true;
+}
+
+static void set_interval (float *position, float *velocity, float time)
+{
+    pvt_interval_t *interval = &pvt.interval;
+
+    memcpy(interval->p0, pvt.position, sizeof(pvt.position));
+    memcpy(interval->v0, pvt.velocity, sizeof(pvt.velocity));
+    memcpy(interval->p1, position, sizeof(interval->p1));
+    memcpy(interval->v1, velocity, sizeof(interval->v1));
+    interval->time = time;
+    interval->segments = max((uint32_t)ceilf(time / PVT_SEGMENT_TIME - 0.001f), 1);
+    interval->segment = 0;
+    interval->active = true;
+}
+
+// Replaces the rest of the trajectory with a deceleration to a stop at the axis acceleration limits.
+static void stop (const char *reason)
+{
+    uint_fast8_t idx = N_AXIS;
+    float time = 0.0f, position[N_AXIS], velocity[N_AXIS] = {0};
+
+    rx.discard = true;
+    knots.tail = knots.head;
+    pvt.interval.active = false;
+    pvt.state = PVT_Stopping;
+
+    if(reason)
+        report_message(reason, Message_Warning);
+
+    if(!pvt.moving)
+        return;
+
+    do {
+        idx--;
+        time = max(time, fabsf(pvt.velocity[idx]) / settings.axis[idx].acceleration);
+    } while(idx);
+
+    // The velocity decreases linearly to zero, which the interpolation reproduces exactly.
+    idx = N_AXIS;
+    do {
+        idx--;
+        position[idx] = pvt.position[idx] + pvt.velocity[idx] * time * 0.5f;
+    } while(idx);
+
+    set_interval(position, velocity, time);
+}
+
+// Loads the next knot, returns false if there is none to execute.
+static bool next_interval (void)
+{
+    pvt_knot_t *knot;
+
+    if(knots.tail == knots.head) {
+
+        if(pvt.moving) {
+            if(!rx.end && st_segments_queued() > PVT_UNDERFLOW_SEGMENTS)
+                return false; // The next knot may still arrive in time.
+            stop(rx.end ? "PVT stream ended in motion" : "PVT stream aborted: knot buffer underflow");
+            return pvt.interval.active;
+        }
+
+        if(rx.end)
+            pvt.state = PVT_Draining;
+        else
+            pvt.starting = true;
+
+        return false;
+    }
+
+    if(pvt.starting && knots_queued() < PVT_START_KNOTS && !rx.end)
+        return false;
+
+    pvt.starting = false;
+    knot = &knots.knot[knots.tail];
+
+    if(settings.limits.flags.soft_enabled && !system_check_travel_limits(knot->position)) {
+        stop("PVT stream aborted: soft limit");
+        return pvt.interval.active;
+    }
+
+    set_interval(knot->position, knot->velocity, (float)knot->duration / 60000000.0f);
+
+    knots.tail = (knots.tail + 1) % PVT_BUFFER_SIZE;
+#if PVT_FREE_REPORT
+    pvt.consumed++;
+#endif
+
+    return true;
+}
+
+// Computes the position and velocity at s (0 - 1) of the interval by cubic Hermite interpolation.
+static void interpolate (pvt_interval_t *interval, float s, float *position, float *velocity)
+{
+    uint_fast8_t idx = N_AXIS;
+    float s2 = s * s, s3 = s2 * s;
+    float h00 = 2.0f * s3 - 3.0f * s2 + 1.0f, h10 = s3 - 2.0f * s2 + s, h01 = 3.0f * s2 - 2.0f * s3, h11 = s3 - s2;
+    float d00 = 6.0f * (s2 - s), d10 = 3.0f * s2 - 4.0f * s + 1.0f, d11 = 3.0f * s2 - 2.0f * s;
+
+    do {
+        idx--;
+        position[idx] = h00 * interval->p0[idx] + h01 * interval->p1[idx] + interval->time * (h10 * interval->v0[idx] + h11 * interval->v1[idx]);
+        velocity[idx] = d00 * (interval->p0[idx] - interval->p1[idx]) / interval->time + d10 * interval->v0[idx] + d11 * interval->v1[idx];
+    } while(idx);
+}
+
+// Queues segments of the trajectory until the segment buffer is full or no more knots are available.
+static void queue_segments (void)
+{
+    uint_fast8_t idx;
+    int32_t steps[N_AXIS], delta[N_AXIS];
+    float position[N_AXIS], velocity[N_AXIS], time, distance, rate_limit;
+    pvt_interval_t *interval = &pvt.interval;
+
+    while(pvt.state == PVT_Streaming || pvt.state == PVT_Stopping) {
+
+        if(!interval->active) {
+            if(pvt.state == PVT_Stopping) {
+                pvt.state = PVT_Draining;
+                break;
+            }
+            if(!next_interval())
+                break;
+        }
+
+        if(interval->segment + 1 == interval->segments) {
+            memcpy(position, interval->p1, sizeof(position));
+            memcpy(velocity, interval->v1, sizeof(velocity));
+        } else
+            interpolate(interval, (float)(interval->segment + 1) / (float)interval->segments, position, velocity);
+
+#ifdef KINEMATICS_API
+        kinematics.plan_target_to_steps(steps, position);
+#endif
+
+        time = interval->time / (float)interval->segments;
+        distance = 0.0f;
+        rate_limit = pvt.state == PVT_Stopping ? 0.0f : PVT_MAX_RATE_TOLERANCE * time;
+
+        idx = N_AXIS;
+        do {
+            idx--;
+#ifndef KINEMATICS_API
+            steps[idx] = lroundf(position[idx] * settings.axis[idx].steps_per_mm);
+#endif
+            delta[idx] = steps[idx] - pvt.steps[idx];
+            distance += (position[idx] - pvt.position[idx]) * (position[idx] - pvt.position[idx]);
+            if(rate_limit > 0.0f && fabsf(position[idx] - pvt.position[idx]) > settings.axis[idx].max_rate * rate_limit)
+                rate_limit = -1.0f;
+        } while(idx);
+
+        if(rate_limit < 0.0f) {
+            stop("PVT stream aborted: max rate exceeded");
+            continue;
+        }
+
+        if(!st_queue_segment(delta, time, sqrtf(distance) / time))
+            break;
+
+        memcpy(pvt.steps, steps, sizeof(steps));
+        memcpy(pvt.position, position, sizeof(position));
+        memcpy(pvt.velocity, velocity, sizeof(velocity));
+
+        if(++interval->segment == interval->segments) {
+            interval->active = false;
+            pvt.moving = false;
+            idx = N_AXIS;
+            do {
+                idx--;
+                pvt.moving |= interval->v1[idx] != 0.0f;
+            } while(idx);
+        } else
+            pvt.moving = true;
+    }
+}
+
+static void pvt_execute (uint_fast16_t state)
+{
+    on_execute_realtime(state);
+
+    if(pvt.state == PVT_Off)
+        return;
+
+    if(pvt.state == PVT_Streaming) {
+        if(rx.error != PVTError_None)
+            stop(rx.error == PVTError_Checksum ? "PVT stream aborted: checksum error"
+                                               : (rx.error == PVTError_Overflow ? "PVT stream aborted: knot buffer overflow"
+                                                                                : "PVT stream aborted: invalid frame"));
+        else if(sys.step_control.execute_hold || !(state == STATE_IDLE || state == STATE_CYCLE))
+            stop("PVT stream aborted: motion stopped");
+    }
+
+    queue_segments();
+
+#if PVT_FREE_REPORT
+    if(pvt.consumed >= PVT_FREE_REPORT && pvt.state == PVT_Streaming) {
+        pvt.consumed = 0;
+        hal.stream.write("[PVT:");
+        hal.stream.write(uitoa(knots_free()));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(knots_time()));
+        hal.stream.write("]" ASCII_EOL);
+    }
+#endif
+
+    if(st_segments_queued()) {
+        if(state == STATE_IDLE)
+            system_set_exec_state_flag(EXEC_CYCLE_START);
+    } else if(pvt.state == PVT_Draining) {
+        // Synchronize the parser and planner positions to the executed position.
+        pvt.state = PVT_Ended;
+        sync_position();
+    }
+
+    // Normal input is restored on the end frame, also after an abort so that frames still in transit are not parsed.
+    if(pvt.state == PVT_Ended && rx.end) {
+        hal.stream.enqueue_realtime_command = enqueue_realtime_command;
+        pvt.state = PVT_Off;
+        report_message("PVT stream ended", Message_Info);
+    }
+}
+
+// Adds |PVT:<free>,<ms> to the real-time status report while streaming, <free> is the number of knots
+// that can be sent and <ms> the time of the knots buffered.
+static void pvt_realtime_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(pvt.state == PVT_Streaming) {
+        stream_write("|PVT:");
+        stream_write(uitoa(knots_free()));
+        stream_write(",");
+        stream_write(uitoa(knots_time()));
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+// Starts streaming from the current position, only allowed when no motion is queued.
+static status_code_t pvt_start (void)
+{
+    if(pvt.state != PVT_Off || sys.state != STATE_IDLE || plan_get_current_block() || st_segments_queued())
+        return Status_IdleError;
+
+    memset(&rx, 0, sizeof(rx));
+    knots.head = knots.tail = 0;
+
+    memcpy(pvt.steps, sys_position, sizeof(pvt.steps));
+    system_convert_array_steps_to_mpos(pvt.position, pvt.steps);
+    memset(pvt.velocity, 0, sizeof(pvt.velocity));
+    pvt.interval.active = pvt.moving = false;
+    pvt.starting = true;
+#if PVT_FREE_REPORT
+    pvt.consumed = 0;
+#endif
+
+    enqueue_realtime_command = hal.stream.enqueue_realtime_command;
+    hal.stream.enqueue_realtime_command = pvt_enqueue_realtime_command;
+    pvt.state = PVT_Streaming;
+
+    return Status_OK;
+}
+
+static status_code_t pvt_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "PVT", 3) && line[4] == '\0')
+        retval = pvt_start();
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void pvt_reset (void)
+{
+    if(pvt.state != PVT_Off) {
+        hal.stream.enqueue_realtime_command = enqueue_realtime_command;
+        pvt.state = PVT_Off;
+    }
+}
+
+void pvt_init (void)
+{
+    if(grbl.on_execute_realtime != pvt_execute) {
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = pvt_execute;
+    }
+
+    if(grbl.on_realtime_report != pvt_realtime_report) {
+        on_realtime_report = grbl.on_realtime_report;
+        grbl.on_realtime_report = pvt_realtime_report;
+    }
+
+    if(grbl.on_unknown_sys_command != pvt_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = pvt_command;
+    }
+}
+
+#endif
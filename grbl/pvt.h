@@ -0,0 +1,60 @@
+/*
+  pvt.h - host streamed position-velocity-time trajectories
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PVT_H_
+#define _PVT_H_
+
+#include "hal.h"
+
+#ifndef PVT_BUFFER_SIZE
+#define PVT_BUFFER_SIZE 64 // Number of knots buffered.
+#endif
+
+// Number of knots to be buffered before motion is started from standstill, unless the end of the stream is received.
+#ifndef PVT_START_KNOTS
+#define PVT_START_KNOTS 8
+#endif
+
+// Number of segments left to execute when the motion is stopped if the knot buffer has run empty, the stop is then
+// appended to the queued segments. Segments are at most 1 / ACCELERATION_TICKS_PER_SECOND seconds long.
+#ifndef PVT_UNDERFLOW_SEGMENTS
+#define PVT_UNDERFLOW_SEGMENTS 2
+#endif
+
+// Outputs [PVT:<free>,<ms>] each time this number of knots has been consumed, 0 to disable.
+#ifndef PVT_FREE_REPORT
+#define PVT_FREE_REPORT 0
+#endif
+
+// Max factor by which the speed of an axis may exceed its max rate before the stream is aborted.
+#ifndef PVT_MAX_RATE_TOLERANCE
+#define PVT_MAX_RATE_TOLERANCE 1.1f
+#endif
+
+#define PVT_FRAME_START 0x01 // SOH
+#define PVT_FRAME_KNOT  'K'
+#define PVT_FRAME_END   'E'
+
+// Adds the $PVT system command.
+void pvt_init (void);
+
+// Ends any active stream, called on soft reset.
+void pvt_reset (void);
+
+#endif
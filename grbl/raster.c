@@ -0,0 +1,227 @@
+/*
+  raster.c - laser raster overscan, acceleration and deceleration runways around image rows
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_LASER_RASTER
+
+#include <math.h>
+#include <string.h>
+
+#include "raster.h"
+#include "system.h"
+#include "motion_control.h"
+
+/* A row is a sequence of laser mode feed motions along X or Y only, in the same direction and each starting
+   where the previous ended. It is started by a motion with the laser on, segments with the laser off (white
+   pixels) continue it. When a row is started the head is moved, with the laser off, to a runway distance
+   before the row start and accelerated to the row feed rate over the runway. When the row is ended the head
+   is decelerated over a runway beyond the row end, again with the laser off. */
+typedef struct {
+    bool active;
+    uint_fast8_t axis;
+    float dir;
+    float feed_rate;
+    float end[N_AXIS];
+    plan_line_data_t pl_data;   // Copy of the planner data of the row with the laser off, for the deceleration runway.
+} raster_row_t;
+
+typedef struct {
+    uint_fast8_t n, idx;
+    float target[3][N_AXIS];    // Runway start, row start and row end.
+    float rpm;
+    char *message;
+    output_command_t *output_commands;
+} raster_line_t;
+
+static THREAD_LOCAL bool enabled = false, busy = false;
+static THREAD_LOCAL raster_row_t row = {0};
+static THREAD_LOCAL raster_line_t line;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+// Returns the distance needed to accelerate the row axis to the feed rate.
+static float runway_length (uint_fast8_t axis, float feed_rate)
+{
+    feed_rate = min(feed_rate * (float)max(sys.override.feed_rate, DEFAULT_FEED_OVERRIDE) / 100.0f, settings.axis[axis].max_rate);
+
+    return feed_rate * feed_rate * RASTER_RUNWAY_MARGIN / (2.0f * settings.axis[axis].acceleration);
+}
+
+// Returns the X or Y axis moved by the line if no other axes are moved, N_AXIS otherwise.
+static uint_fast8_t row_axis (float *target, float *start)
+{
+    uint_fast8_t idx = N_AXIS, axis = N_AXIS;
+
+    do {
+        idx--;
+        if(fabsf(target[idx] - start[idx]) > RASTER_POSITION_TOLERANCE) {
+            if(axis != N_AXIS || !(idx == X_AXIS || idx == Y_AXIS))
+                return N_AXIS;
+            axis = idx;
+        }
+    } while(idx);
+
+    return axis;
+}
+
+static void runway_point (float *point, float *from, float distance)
+{
+    memcpy(point, from, sizeof(float) * N_AXIS);
+    point[row.axis] += row.dir * distance;
+
+    if(settings.limits.flags.soft_enabled)
+        system_apply_jog_limits(point);
+}
+
+bool raster_segment_line (float *target, plan_line_data_t *pl_data, float *start, bool init)
+{
+    if(!init) {
+
+        if(line.idx == line.n) {
+            pl_data->spindle.rpm = line.rpm;
+            pl_data->message = line.message;
+            pl_data->output_commands = line.output_commands;
+            busy = false;
+            return false;
+        }
+
+        memcpy(target, line.target[line.idx], sizeof(float) * N_AXIS);
+
+        if(++line.idx == line.n) { // The line itself, with the laser as programmed.
+            pl_data->spindle.rpm = line.rpm;
+            pl_data->message = line.message;
+            pl_data->output_commands = line.output_commands;
+        }
+
+        return true;
+    }
+
+    if(!enabled || busy || pl_data->condition.system_motion)
+        return false;
+
+    if(pl_data->condition.jog_motion) {
+        row.active = false;
+        return false;
+    }
+
+    uint_fast8_t axis = N_AXIS;
+    bool feed = settings.mode == Mode_Laser && pl_data->condition.spindle.on &&
+                 !(pl_data->condition.rapid_motion || pl_data->condition.inverse_time || pl_data->condition.is_rpm_pos_adjusted);
+
+    if(feed)
+        axis = row_axis(target, start);
+
+    // Continue the row if the line is the next segment of it.
+    if(row.active && axis == row.axis && (target[axis] - start[axis]) * row.dir > 0.0f &&
+        fabsf(start[X_AXIS] - row.end[X_AXIS]) <= RASTER_POSITION_TOLERANCE &&
+         fabsf(start[Y_AXIS] - row.end[Y_AXIS]) <= RASTER_POSITION_TOLERANCE) {
+        memcpy(row.end, target, sizeof(row.end));
+        row.feed_rate = max(row.feed_rate, pl_data->feed_rate);
+        return false;
+    }
+
+    raster_end_row();
+
+    if(axis == N_AXIS || pl_data->spindle.rpm <= 0.0f)
+        return false;
+
+    row.active = true;
+    row.axis = axis;
+    row.dir = target[axis] > start[axis] ? 1.0f : -1.0f;
+    row.feed_rate = pl_data->feed_rate;
+    memcpy(row.end, target, sizeof(row.end));
+    memcpy(&row.pl_data, pl_data, sizeof(plan_line_data_t));
+    row.pl_data.spindle.rpm = 0.0f;
+    row.pl_data.message = NULL;
+    row.pl_data.output_commands = NULL;
+
+    // Move to the runway start and accelerate to the row start with the laser off, the runway
+    // keeps the coordinates of the target for the axes other than the row axis.
+    memcpy(line.target[1], target, sizeof(float) * N_AXIS);
+    line.target[1][axis] = start[axis];
+    runway_point(line.target[0], line.target[1], -runway_length(axis, pl_data->feed_rate));
+    memcpy(line.target[2], target, sizeof(float) * N_AXIS);
+    line.n = 3;
+    line.idx = 0;
+
+    line.rpm = pl_data->spindle.rpm;
+    line.message = pl_data->message;
+    line.output_commands = pl_data->output_commands;
+    pl_data->spindle.rpm = 0.0f;
+    pl_data->message = NULL;
+    pl_data->output_commands = NULL;
+    busy = true;
+
+    return true;
+}
+
+void raster_end_row (void)
+{
+    if(row.active && !busy) {
+
+        float target[N_AXIS];
+
+        row.active = false;
+        runway_point(target, row.end, runway_length(row.axis, row.feed_rate));
+        mc_line(target, &row.pl_data);
+    }
+}
+
+void raster_reset (void)
+{
+    row.active = busy = false;
+}
+
+// Outputs [LRASTER:<enabled>].
+static void raster_report (void)
+{
+    hal.stream.write(enabled ? "[LRASTER:1]" ASCII_EOL : "[LRASTER:0]" ASCII_EOL);
+}
+
+static status_code_t raster_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "LRASTER", 7)) {
+
+        retval = Status_OK;
+
+        if(line[8] == '\0')
+            raster_report();
+        else if(!strcmp(&line[8], "=1"))
+            enabled = true;
+        else if(!strcmp(&line[8], "=0")) {
+            raster_end_row();
+            enabled = false;
+        } else
+            retval = Status_InvalidStatement;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void raster_init (void)
+{
+    if(grbl.on_unknown_sys_command != raster_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = raster_command;
+    }
+}
+
+#endif
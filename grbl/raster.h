@@ -0,0 +1,51 @@
+/*
+  raster.h - laser raster overscan, acceleration and deceleration runways around image rows
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RASTER_H_
+#define _RASTER_H_
+
+#include "planner.h"
+
+// Factor applied to the distance needed to accelerate to the row feed rate, leaves a margin for
+// the feed rate override being increased while a row is executing.
+#ifndef RASTER_RUNWAY_MARGIN
+#define RASTER_RUNWAY_MARGIN 1.2f
+#endif
+
+// Max distance in mm between the end of a row segment and the start of the next for the row to continue,
+// and max motion in mm of the axes other than the row axis.
+#ifndef RASTER_POSITION_TOLERANCE
+#define RASTER_POSITION_TOLERANCE 0.01f
+#endif
+
+// Adds the runways to the line from start to target where a row is started or ended.
+// Call with init set before outputting segments, returns true if runways are added.
+// Then call with init cleared until it returns false, the next segment end point is returned in target.
+bool raster_segment_line (float *target, plan_line_data_t *pl_data, float *start, bool init);
+
+// Queues the deceleration runway of the current row, called before the planner buffer is synchronized.
+void raster_end_row (void);
+
+// Adds the $LRASTER system command.
+void raster_init (void);
+
+// Discards the current row, called on soft reset.
+void raster_reset (void);
+
+#endif
@@ -29,11 +29,14 @@
 */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "hal.h"
 #include "report.h"
 #include "nvs_buffer.h"
+#include "protocol.h"
+#include "profile.h"
 
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 #include <stdio.h>
@@ -51,6 +54,12 @@
 #ifndef REPORT_WCO_REFRESH_IDLE_COUNT
 #define REPORT_WCO_REFRESH_IDLE_COUNT 10        // (2-255) Must be less than or equal to the busy count
 #endif
+#ifndef REPORT_COMPACT_KEYFRAME_COUNT
+#define REPORT_COMPACT_KEYFRAME_COUNT 20        // (1-255)
+#endif
+#ifndef REPORT_SETTINGS_YIELD_COUNT
+#define REPORT_SETTINGS_YIELD_COUNT 4           // (0-255) 0 to disable
+#endif
 
 // Compile-time sanity check of defines
 
@@ -67,19 +76,159 @@
   #error "Override refresh must be greater than zero."
 #endif
 
-static char buf[(STRLEN_COORDVALUE + 1) * N_AXIS];
-static char *(*get_axis_values)(float *axis_values);
-static char *(*get_axis_value)(float value);
-static char *(*get_rate_value)(float value);
-static uint8_t override_counter = 0; // Tracks when to add override data to status reports.
-static uint8_t wco_counter = 0;      // Tracks when to add work coordinate offset data to status reports.
-alarm_code_t current_alarm = Alarm_None;
+static THREAD_LOCAL char buf[(STRLEN_COORDVALUE + 1) * N_AXIS];
+static THREAD_LOCAL char *(*get_axis_values)(float *axis_values);
+static THREAD_LOCAL char *(*append_axis_values)(char *s, float *axis_values);
+static THREAD_LOCAL char *(*get_axis_value)(float value);
+static THREAD_LOCAL char *(*get_rate_value)(float value);
+static THREAD_LOCAL uint8_t override_counter = 0; // Tracks when to add override data to status reports.
+static THREAD_LOCAL uint8_t wco_counter = 0;      // Tracks when to add work coordinate offset data to status reports.
+static THREAD_LOCAL struct {
+    bool active;                     // Yield to the realtime command handler between setting lines.
+    bool aborted;                    // Reset issued while yielding, suppress the rest of the listing.
+    uint_fast8_t lines;              // Setting lines output since last yield.
+} settings_yield = {0};
+static THREAD_LOCAL uint8_t keyframe_counter = 0; // Tracks when to output a full compact status report.
+THREAD_LOCAL alarm_code_t current_alarm = Alarm_None;
+
+static THREAD_LOCAL stream_block_tx_buffer_t status_buf = {0}; // Real-time status report being assembled.
 
 static const report_t report_fns = {
     .status_message = report_status_message,
     .feedback_message = report_feedback_message
 };
 
+#ifdef ENABLE_REPORT_CACHE
+
+#ifndef REPORT_CACHE_GCODE_MODES_SIZE
+#define REPORT_CACHE_GCODE_MODES_SIZE 128
+#endif
+#ifndef REPORT_CACHE_BUILD_INFO_SIZE
+#define REPORT_CACHE_BUILD_INFO_SIZE 192
+#endif
+#ifndef REPORT_CACHE_COORD_DATA_SIZE
+#define REPORT_CACHE_COORD_DATA_SIZE (N_CoordinateSystems * (STRLEN_COORDVALUE + 1) * (N_AXIS + 1))
+#endif
+
+// Rendered report output, the buffer is allocated on first use.
+typedef struct {
+    bool valid;
+    uint16_t length;
+    const uint16_t size;
+    char *data;
+} report_cache_t;
+
+// Parser state reported by $G, the cached output is invalidated when it changes.
+typedef struct {
+    gc_modal_t modal;
+    cc_retract_mode_t retract_mode;
+    gc_override_flags_t override_ctrl;
+    axes_signals_t g51;
+    bool g92_active;
+    bool tool_change;
+    uint32_t tool;
+    float feed_rate;
+    float rpm;
+} gcode_modes_key_t;
+
+static THREAD_LOCAL report_cache_t report_cache[ReportCache_All] = {
+    [ReportCache_GCodeModes] = { .size = REPORT_CACHE_GCODE_MODES_SIZE },
+    [ReportCache_BuildInfo]  = { .size = REPORT_CACHE_BUILD_INFO_SIZE },
+    [ReportCache_CoordData]  = { .size = REPORT_CACHE_COORD_DATA_SIZE }
+};
+static THREAD_LOCAL gcode_modes_key_t gcode_modes_key;
+
+// Output being captured to a cache, see report_cached().
+static THREAD_LOCAL struct {
+    report_cache_t *cache;
+    stream_write_ptr write;
+    bool overflow;
+} capture = {0};
+
+// Passes a string written by a report function on to the stream and appends it to the cache being filled.
+static void capture_write (const char *s)
+{
+    size_t length = strlen(s);
+
+    if(!capture.overflow && !(capture.overflow = capture.cache->length + length > capture.cache->size)) {
+        memcpy(&capture.cache->data[capture.cache->length], s, length);
+        capture.cache->length += length;
+    }
+
+    capture.write(s);
+}
+
+// Invalidates a cached report, all reports if id is ReportCache_All.
+void report_cache_invalidate (report_cache_id_t id)
+{
+    if(id == ReportCache_All) {
+        for(id = (report_cache_id_t)0; id < ReportCache_All; id++)
+            report_cache[id].valid = false;
+    } else
+        report_cache[id].valid = false;
+}
+
+// Returns true if the build info report is cached, then the build info line does not have to be read.
+bool report_build_info_cached (void)
+{
+    return report_cache[ReportCache_BuildInfo].valid;
+}
+
+// Returns RAM allocated for cached reports.
+uint32_t report_cache_get_memory (void)
+{
+    uint32_t size = sizeof(report_cache) + sizeof(gcode_modes_key);
+    report_cache_id_t id;
+
+    for(id = (report_cache_id_t)0; id < ReportCache_All; id++) {
+        if(report_cache[id].data)
+            size += report_cache[id].size + 1;
+    }
+
+    return size;
+}
+
+#endif
+
+// Outputs a report rendered by render(), from the cache if available and valid.
+// Returns the value returned by render(), true if output from the cache.
+static bool report_cached (report_cache_id_t id, bool (*render)(void *data), void *data)
+{
+#ifdef ENABLE_REPORT_CACHE
+
+    bool ok;
+    report_cache_t *cache = &report_cache[id];
+
+    if(cache->valid) {
+        hal.stream.write(cache->data);
+        return true;
+    }
+
+    if(cache->data == NULL && (cache->data = malloc(cache->size + 1)) == NULL)
+        return render(data);
+
+    capture.cache = cache;
+    capture.write = hal.stream.write;
+    capture.overflow = false;
+    cache->length = 0;
+    hal.stream.write = capture_write;
+
+    ok = render(data);
+
+    hal.stream.write = capture.write;
+    capture.cache = NULL;
+    cache->data[cache->length] = '\0';
+    cache->valid = ok && !capture.overflow;
+
+    return ok;
+
+#else
+
+    return render(data);
+
+#endif
+}
+
 // Append a number of strings to the static buffer
 // NOTE: do NOT use for several int/float conversions as these share the same underlying buffer!
 static char *appendbuf (int argc, ...)
@@ -102,6 +251,90 @@ static char *appendbuf (int argc, ...)
     return buf;
 }
 
+// Writes the part of the real-time status report assembled so far to all streams.
+static void status_flush (void)
+{
+    if(status_buf.length) {
+        *status_buf.s = '\0';
+        hal.stream.write_all(status_buf.data);
+        status_buf.length = 0;
+        status_buf.s = status_buf.data;
+    }
+}
+
+// Appends a string to the real-time status report, the report is written to the streams by status_flush()
+// in one go rather than fragment by fragment. If the report does not fit in the buffer it is written in parts.
+static void status_write (const char *s)
+{
+    uint_fast16_t length = (uint_fast16_t)strlen(s);
+
+    if(status_buf.s == NULL) {
+        status_buf.s = status_buf.data;
+        status_buf.max_length = sizeof(status_buf.data) - 1; // Leave room for terminator.
+    }
+
+    if(status_buf.length + length > status_buf.max_length)
+        status_flush();
+
+    if(length > status_buf.max_length)
+        hal.stream.write_all(s);
+    else {
+        memcpy(status_buf.s, s, length);
+        status_buf.s += length;
+        status_buf.length += length;
+    }
+}
+
+// Fields of compact status reports that are only output when changed.
+typedef enum {
+    ReportField_Position = 0,
+    ReportField_BufferState,
+    ReportField_LineNumber,
+    ReportField_FeedSpeed,
+    ReportField_PinState,
+    ReportField_Count
+} report_field_t;
+
+static THREAD_LOCAL uint32_t report_field_hash[ReportField_Count]; // FNV-1a hashes of the fields last output in compact status reports.
+
+// Appends a field to the real-time status report. If delta is true the field is skipped if it has not changed
+// since it was last output, the keyframes of compact reports are output with delta false.
+static void status_write_field (report_field_t field, const char *s, bool delta)
+{
+    if(settings.status_report.compact) {
+
+        const char *c = s;
+        uint32_t hash = 2166136261UL;
+
+        while(*c)
+            hash = (hash ^ (uint8_t)*c++) * 16777619UL;
+
+        if(delta && hash == report_field_hash[field])
+            return;
+
+        report_field_hash[field] = hash;
+    }
+
+    status_write(s);
+}
+
+// Appends axis values to the real-time status report, the values are formatted directly into the report buffer.
+static void status_write_axis_values (float *axis_values)
+{
+    if(status_buf.s == NULL) {
+        status_buf.s = status_buf.data;
+        status_buf.max_length = sizeof(status_buf.data) - 1; // Leave room for terminator.
+    }
+
+    if(status_buf.length + sizeof(buf) > status_buf.max_length)
+        status_flush();
+
+    char *s = append_axis_values(status_buf.s, axis_values);
+
+    status_buf.length += s - status_buf.s;
+    status_buf.s = s;
+}
+
 static char *map_coord_system (coord_system_id_t id)
 {
     uint8_t g5x = id + 54;
@@ -115,41 +348,59 @@ static char *map_coord_system (coord_system_id_t id)
     return buf;
 }
 
-// Convert axis position values to null terminated string (mm).
-static char *get_axis_values_mm (float *axis_values)
+// Convert axis position values to comma separated string (mm) written to s.
+// NOTE: returns pointer to null terminator!
+static char *append_axis_values_mm (char *s, float *axis_values)
 {
     uint_fast32_t idx;
 
-    buf[0] = '\0';
-
     for (idx = 0; idx < N_AXIS; idx++) {
         if(idx == X_AXIS && gc_state.modal.diameter_mode)
-            strcat(buf, ftoa(axis_values[idx] * 2.0f, N_DECIMAL_COORDVALUE_MM));
+            s = ftoa_append(s, axis_values[idx] * 2.0f, N_DECIMAL_COORDVALUE_MM);
         else
-            strcat(buf, ftoa(axis_values[idx], N_DECIMAL_COORDVALUE_MM));
+            s = ftoa_append(s, axis_values[idx], N_DECIMAL_COORDVALUE_MM);
         if (idx < (N_AXIS - 1))
-            strcat(buf, ",");
+            *s++ = ',';
     }
 
-    return buf;
+    *s = '\0';
+
+    return s;
 }
 
-// Convert axis position values to null terminated string (inch).
-static char *get_axis_values_inches (float *axis_values)
+// Convert axis position values to comma separated string (inch) written to s.
+// NOTE: returns pointer to null terminator!
+static char *append_axis_values_inches (char *s, float *axis_values)
 {
     uint_fast32_t idx;
 
-    buf[0] = '\0';
-
     for (idx = 0; idx < N_AXIS; idx++) {
         if(idx == X_AXIS && gc_state.modal.diameter_mode)
-            strcat(buf, ftoa(axis_values[idx] * INCH_PER_MM * 2.0f, N_DECIMAL_COORDVALUE_INCH));
+            s = ftoa_append(s, axis_values[idx] * INCH_PER_MM * 2.0f, N_DECIMAL_COORDVALUE_INCH);
         else
-            strcat(buf, ftoa(axis_values[idx] * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH));
+            s = ftoa_append(s, axis_values[idx] * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH);
         if (idx < (N_AXIS - 1))
-            strcat(buf, ",");
+            *s++ = ',';
     }
 
+    *s = '\0';
+
+    return s;
+}
+
+// Convert axis position values to null terminated string (mm).
+static char *get_axis_values_mm (float *axis_values)
+{
+    append_axis_values_mm(buf, axis_values);
+
+    return buf;
+}
+
+// Convert axis position values to null terminated string (inch).
+static char *get_axis_values_inches (float *axis_values)
+{
+    append_axis_values_inches(buf, axis_values);
+
     return buf;
 }
 
@@ -215,7 +466,11 @@ void report_init (void)
     current_alarm = Alarm_None;
     get_axis_value = settings.flags.report_inches ? get_axis_value_inches : get_axis_value_mm;
     get_axis_values = settings.flags.report_inches ? get_axis_values_inches : get_axis_values_mm;
+    append_axis_values = settings.flags.report_inches ? append_axis_values_inches : append_axis_values_mm;
     get_rate_value = settings.flags.report_inches ? get_rate_value_inch : get_rate_value_mm;
+#ifdef ENABLE_REPORT_CACHE
+    report_cache_invalidate(ReportCache_All);
+#endif
 }
 
 void report_init_fns (void)
@@ -368,7 +623,7 @@ message_code_t report_feedback_message (message_code_t message_code)
 // Welcome message
 void report_init_message (void)
 {
-    override_counter = wco_counter = 0;
+    override_counter = wco_counter = keyframe_counter = 0;
 #if COMPATIBILITY_LEVEL == 0
     hal.stream.write_all(ASCII_EOL "GrblHAL " GRBL_VERSION " ['$' for help]" ASCII_EOL);
 #else
@@ -385,44 +640,89 @@ void report_grbl_help (void)
 
 // Grbl settings print out.
 
+// Called after a setting line has been output, every REPORT_SETTINGS_YIELD_COUNT lines
+// realtime commands are executed if the listing is output by report_grbl_settings_incremental().
+// NOTE: only done at line boundaries so that realtime reports are not mixed into setting lines.
+static void setting_reported (void)
+{
+    if(settings_yield.active && ++settings_yield.lines >= REPORT_SETTINGS_YIELD_COUNT) {
+        settings_yield.lines = 0;
+        settings_yield.aborted = !protocol_execute_realtime();
+    }
+}
+
 void report_uint_setting (setting_type_t n, uint32_t val)
 {
-    hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
-    hal.stream.write(appendbuf(2, uitoa(val), ASCII_EOL));
+    if(!settings_yield.aborted) {
+        hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
+        hal.stream.write(appendbuf(2, uitoa(val), ASCII_EOL));
+        setting_reported();
+    }
 }
 
 
 void report_float_setting (setting_type_t n, float val, uint8_t n_decimal)
 {
-    hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
-    hal.stream.write(appendbuf(2, ftoa(val, n_decimal), ASCII_EOL));
+    if(!settings_yield.aborted) {
+        hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
+        hal.stream.write(appendbuf(2, ftoa(val, n_decimal), ASCII_EOL));
+        setting_reported();
+    }
 }
 
 void report_string_setting (setting_type_t n, char *val)
 {
-    hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
-    hal.stream.write(appendbuf(2, val, ASCII_EOL));
+    if(!settings_yield.aborted) {
+        hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
+        hal.stream.write(appendbuf(2, val, ASCII_EOL));
+        setting_reported();
+    }
+}
+
+static void report_setting_detail (const setting_detail_t *detail)
+{
+    if(detail->datatype == Format_Decimal)
+        report_float_setting(detail->id, setting_get_value(detail), detail->n_decimals);
+    else
+        report_uint_setting(detail->id, (uint32_t)setting_get_value(detail));
+}
+
+// Report setting having a descriptor.
+void report_setting (setting_type_t id)
+{
+    const setting_detail_t *detail = setting_get_details(id, NULL);
+
+    if(detail)
+        report_setting_detail(detail);
 }
 
 void report_grbl_settings (bool all)
 {
-    uint_fast8_t idx;
+    uint_fast16_t idx;
 
     // Print Grbl settings.
     report_float_setting(Setting_PulseMicroseconds, settings.steppers.pulse_microseconds, 1);
-    report_uint_setting(Setting_StepperIdleLockTime, settings.steppers.idle_lock_time);
+    report_setting(Setting_StepperIdleLockTime);
     report_uint_setting(Setting_StepInvertMask, settings.steppers.step_invert.mask);
     report_uint_setting(Setting_DirInvertMask, settings.steppers.dir_invert.mask);
     report_uint_setting(Setting_InvertStepperEnable, settings.steppers.enable_invert.mask);
     report_uint_setting(Setting_LimitPinsInvertMask, settings.limits.invert.mask);
     if(hal.probe.configure)
         report_uint_setting(Setting_InvertProbePin, settings.probe.invert_probe_pin);
+    if(all)
+        report_setting(Setting_PlannerBufferBlocks);
+#ifdef ENABLE_PATH_MERGING
+    report_setting(Setting_PathMergeTolerance);
+#endif
+#ifdef ENABLE_AUTO_REPORT
+    report_uint_setting(Setting_AutoReportInterval, settings.auto_report_interval);
+#endif
     if(all)
         report_uint_setting(Setting_StatusReportMask, (uint32_t)settings.status_report.mask);
     else
         report_uint_setting(Setting_StatusReportMask, settings.status_report.mask & 0x3);
-    report_float_setting(Setting_JunctionDeviation, settings.junction_deviation, N_DECIMAL_SETTINGVALUE);
-    report_float_setting(Setting_ArcTolerance, settings.arc_tolerance, N_DECIMAL_SETTINGVALUE);
+    report_setting(Setting_JunctionDeviation);
+    report_setting(Setting_ArcTolerance);
     report_uint_setting(Setting_ReportInches, settings.flags.report_inches);
 
     if(all) {
@@ -441,35 +741,35 @@ void report_grbl_settings (bool all)
                                                (settings.limits.flags.two_switches ? bit(4) : 0) |
                                                 (settings.homing.flags.manual ? bit(5) : 0));
     report_uint_setting(Setting_HomingDirMask, settings.homing.dir_mask.value);
-    report_float_setting(Setting_HomingFeedRate, settings.homing.feed_rate, N_DECIMAL_SETTINGVALUE);
-    report_float_setting(Setting_HomingSeekRate, settings.homing.seek_rate, N_DECIMAL_SETTINGVALUE);
-    report_uint_setting(Setting_HomingDebounceDelay, settings.homing.debounce_delay);
-    report_float_setting(Setting_HomingPulloff, settings.homing.pulloff, N_DECIMAL_SETTINGVALUE);
+    report_setting(Setting_HomingFeedRate);
+    report_setting(Setting_HomingSeekRate);
+    report_setting(Setting_HomingDebounceDelay);
+    report_setting(Setting_HomingPulloff);
 
     if(all) {
-        report_float_setting(Setting_G73Retract, settings.g73_retract, N_DECIMAL_SETTINGVALUE);
+        report_setting(Setting_G73Retract);
         if(hal.driver_cap.step_pulse_delay)
             report_float_setting(Setting_PulseDelayMicroseconds, settings.steppers.pulse_delay_microseconds, 1);
     }
 
-    report_float_setting(Setting_RpmMax, settings.spindle.rpm_max, N_DECIMAL_RPMVALUE);
-    report_float_setting(Setting_RpmMin, settings.spindle.rpm_min, N_DECIMAL_RPMVALUE);
+    report_setting(Setting_RpmMax);
+    report_setting(Setting_RpmMin);
     report_uint_setting(Setting_Mode, (uint32_t)settings.mode);
 
     if(all) {
 
-        report_float_setting(Setting_PWMFreq, settings.spindle.pwm_freq, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PWMOffValue, settings.spindle.pwm_off_value, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PWMMinValue, settings.spindle.pwm_min_value, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PWMMaxValue, settings.spindle.pwm_max_value, N_DECIMAL_SETTINGVALUE);
+        report_setting(Setting_PWMFreq);
+        report_setting(Setting_PWMOffValue);
+        report_setting(Setting_PWMMinValue);
+        report_setting(Setting_PWMMaxValue);
         report_uint_setting(Setting_StepperDeenergizeMask, settings.steppers.deenergize.mask);
         if(hal.driver_cap.spindle_sync || hal.driver_cap.spindle_pid)
-            report_uint_setting(Setting_SpindlePPR, settings.spindle.ppr);
+            report_setting(Setting_SpindlePPR);
 
         report_uint_setting(Setting_EnableLegacyRTCommands, settings.flags.legacy_rt_commands ? 1 : 0);
         report_uint_setting(Setting_JogSoftLimited, settings.limits.flags.jog_soft_limited);
         report_uint_setting(Setting_ParkingEnable, settings.parking.flags.value);
-        report_uint_setting(Setting_ParkingAxis, settings.parking.axis);
+        report_setting(Setting_ParkingAxis);
 
         report_uint_setting(Setting_HomingLocateCycles, settings.homing.locate_cycles);
 
@@ -481,10 +781,10 @@ void report_grbl_settings (bool all)
                 hal.driver_settings.report((setting_type_t)idx);
         }
 
-        report_float_setting(Setting_ParkingPulloutIncrement, settings.parking.pullout_increment, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_ParkingPulloutRate, settings.parking.pullout_rate, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_ParkingTarget, settings.parking.target, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_ParkingFastRate, settings.parking.rate, N_DECIMAL_SETTINGVALUE);
+        report_setting(Setting_ParkingPulloutIncrement);
+        report_setting(Setting_ParkingPulloutRate);
+        report_setting(Setting_ParkingTarget);
+        report_setting(Setting_ParkingFastRate);
         report_uint_setting(Setting_RestoreOverrides, settings.flags.restore_overrides);
         report_uint_setting(Setting_IgnoreDoorWhenIdle, settings.flags.safety_door_ignore_when_idle);
         report_uint_setting(Setting_SleepEnable, settings.flags.sleep_enable);
@@ -498,7 +798,10 @@ void report_grbl_settings (bool all)
                 report_float_setting((setting_type_t)(Setting_LinearSpindlePiece1 + idx), settings.spindle.pwm_piece[idx].rpm, N_DECIMAL_RPMVALUE);
             else {
                 sprintf(buf, "$%d=%f,%f,%f" ASCII_EOL, (setting_type_t)(Setting_LinearSpindlePiece1 + idx), settings.spindle.pwm_piece[idx].rpm, settings.spindle.pwm_piece[idx].start, settings.spindle.pwm_piece[idx].end);
-                hal.stream.write(buf);
+                if(!settings_yield.aborted) {
+                    hal.stream.write(buf);
+                    setting_reported();
+                }
             }
         }
       #endif
@@ -513,20 +816,27 @@ void report_grbl_settings (bool all)
 #ifdef SPINDLE_RPM_CONTROLLED
 
     if(hal.driver_cap.spindle_pid) {
-        report_float_setting(Setting_SpindlePGain, settings.spindle.pid.p_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleIGain, settings.spindle.pid.i_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleDGain, settings.spindle.pid.d_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleMaxError, settings.spindle.pid.max_error, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleIMaxError, settings.spindle.pid.i_max_error, N_DECIMAL_SETTINGVALUE);
+        report_setting(Setting_SpindlePGain);
+        report_setting(Setting_SpindleIGain);
+        report_setting(Setting_SpindleDGain);
+        report_setting(Setting_SpindleMaxError);
+        report_setting(Setting_SpindleIMaxError);
     }
 
 #endif
 
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    report_setting(Setting_TravelJunctionDeviation);
+#endif
+#ifdef ENABLE_ARC_FEED_COMPENSATION
+    report_setting(Setting_ArcFeedCompensation);
+#endif
+
     if(hal.driver_cap.spindle_sync) {
-        report_float_setting(Setting_PositionPGain, settings.position.pid.p_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PositionIGain, settings.position.pid.i_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PositionDGain, settings.position.pid.d_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PositionIMaxError, settings.position.pid.i_max_error, N_DECIMAL_SETTINGVALUE);
+        report_setting(Setting_PositionPGain);
+        report_setting(Setting_PositionIGain);
+        report_setting(Setting_PositionDGain);
+        report_setting(Setting_PositionIMaxError);
     }
 
     // Print axis settings
@@ -560,6 +870,29 @@ void report_grbl_settings (bool all)
                     break;
 #endif
 
+#ifdef ENABLE_JERK_ACCELERATION
+                case AxisSetting_Jerk:
+                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].jerk / (60.0f * 60.0f * 60.0f), N_DECIMAL_SETTINGVALUE);
+                    break;
+#endif
+
+#ifdef ENABLE_INPUT_SHAPING
+                case AxisSetting_ShaperFrequency:
+                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].shaper_frequency, N_DECIMAL_SETTINGVALUE);
+                    break;
+
+                case AxisSetting_ShaperDamping:
+                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].shaper_damping, N_DECIMAL_SETTINGVALUE);
+                    break;
+#endif
+
+#ifdef ENABLE_STOP_DECELERATION
+                case AxisSetting_StopDeceleration:
+                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].stop_deceleration / (60.0f * 60.0f), N_DECIMAL_SETTINGVALUE);
+                    break;
+#endif
+
+
                 default:
                     if(hal.driver_settings.axis_report)
                         hal.driver_settings.axis_report((axis_setting_type_t)set_idx, idx);
@@ -574,8 +907,12 @@ void report_grbl_settings (bool all)
         switch((setting_type_t)idx) {
 
             case Setting_SpindleAtSpeedTolerance:
+#ifdef ENABLE_SPINDLE_RPM_AT_SPEED
+                if(hal.driver_cap.spindle_at_speed || hal.spindle.get_data)
+#else
                 if(hal.driver_cap.spindle_at_speed)
-                    report_float_setting(Setting_SpindleAtSpeedTolerance, settings.spindle.at_speed_tolerance, 1);
+#endif
+                    report_setting(Setting_SpindleAtSpeedTolerance);
                 break;
 
             case Setting_ToolChangeMode:
@@ -590,12 +927,12 @@ void report_grbl_settings (bool all)
 
             case Setting_ToolChangeFeedRate:
                 if(!hal.driver_cap.atc && hal.stream.suspend_read)
-                    report_float_setting(Setting_ToolChangeFeedRate, settings.tool_change.feed_rate, 1);
+                    report_setting(Setting_ToolChangeFeedRate);
                 break;
 
             case Setting_ToolChangeSeekRate:
                 if(!hal.driver_cap.atc && hal.stream.suspend_read)
-                    report_float_setting(Setting_ToolChangeSeekRate, settings.tool_change.seek_rate, 1);
+                    report_setting(Setting_ToolChangeSeekRate);
                 break;
 
             case Settings_IoPort_InvertIn:
@@ -624,6 +961,30 @@ void report_grbl_settings (bool all)
                 break;
         }
     }
+
+    // Print settings registered by drivers and plugins
+    setting_details_t *group = settings_get_groups();
+
+    if(all) while((group = group->next)) {
+        uint_fast16_t n_setting;
+        for(n_setting = 0; n_setting < group->n_settings; n_setting++)
+            report_setting_detail(&group->settings[n_setting]);
+    }
+}
+
+// Grbl settings print out for the $$ command. Realtime commands such as status report requests,
+// feed hold and reset are executed while the listing is output, instead of being delayed until the foreground
+// has completed a listing blocked by a full transmit buffer. The listing stops if a reset is issued.
+// NOTE: the command status is reported when the listing is complete.
+void report_grbl_settings_incremental (bool all)
+{
+    settings_yield.active = REPORT_SETTINGS_YIELD_COUNT > 0;
+    settings_yield.aborted = false;
+    settings_yield.lines = 0;
+
+    report_grbl_settings(all);
+
+    settings_yield.active = settings_yield.aborted = false;
 }
 
 
@@ -664,24 +1025,16 @@ void report_tool_offsets (void)
     hal.stream.write("]" ASCII_EOL);
 }
 
-// Prints Grbl NGC parameters (coordinate offsets, probing, tool table)
-void report_ngc_parameters (void)
+// Prints the persistent coordinate system offsets (G54-G59.3, G28 and G30), returns false on a read failure.
+static bool report_coord_systems (void *data)
 {
     uint_fast8_t idx;
     float coord_data[N_AXIS];
 
-    if(gc_state.modal.scaling_active) {
-        hal.stream.write("[G51:");
-        hal.stream.write(get_axis_values(gc_get_scaling()));
-        hal.stream.write("]" ASCII_EOL);
-    }
-
     for (idx = 0; idx < N_CoordinateSystems; idx++) {
 
-        if (!(settings_read_coord_data((coord_system_id_t)idx, &coord_data))) {
-            grbl.report.status_message(Status_SettingReadFail);
-            return;
-        }
+        if (!(settings_read_coord_data((coord_system_id_t)idx, &coord_data)))
+            return false;
 
         hal.stream.write("[G");
 
@@ -704,6 +1057,27 @@ void report_ngc_parameters (void)
         hal.stream.write("]" ASCII_EOL);
     }
 
+    return true;
+}
+
+// Prints Grbl NGC parameters (coordinate offsets, probing, tool table)
+void report_ngc_parameters (void)
+{
+#ifdef N_TOOLS
+    uint_fast8_t idx;
+#endif
+
+    if(gc_state.modal.scaling_active) {
+        hal.stream.write("[G51:");
+        hal.stream.write(get_axis_values(gc_get_scaling()));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    if(!report_cached(ReportCache_CoordData, report_coord_systems, NULL)) {
+        grbl.report.status_message(Status_SettingReadFail);
+        return;
+    }
+
     // Print G92, G92.1 which are not persistent in memory
     hal.stream.write("[G92:");
     hal.stream.write(get_axis_values(gc_state.g92_coord_offset));
@@ -714,9 +1088,9 @@ void report_ngc_parameters (void)
         hal.stream.write("[T:");
         hal.stream.write(uitoa((uint32_t)idx));
         hal.stream.write("|");
-        hal.stream.write(get_axis_values(tool_table[idx].offset));
+        hal.stream.write(get_axis_values(gc_get_tool(idx)->offset));
         hal.stream.write("|");
-        hal.stream.write(get_axis_value(tool_table[idx].radius));
+        hal.stream.write(get_axis_value(gc_get_tool(idx)->radius));
         hal.stream.write("]" ASCII_EOL);
     }
 #endif
@@ -750,8 +1124,7 @@ static inline bool is_g92_active (void)
     return active;
 }
 
-// Print current gcode parser mode state
-void report_gcode_modes (void)
+static bool render_gcode_modes (void *data)
 {
     hal.stream.write("[GC:G");
     if (gc_state.modal.motion >= MotionMode_ProbeToward) {
@@ -780,6 +1153,11 @@ void report_gcode_modes (void)
 
     hal.stream.write(gc_state.modal.distance_incremental ? " G91" : " G90");
 
+#ifdef ENABLE_PATH_BLENDING
+    hal.stream.write(gc_state.modal.control == ControlMode_Continuous ? " G64" : " G61");
+#endif
+
+
     hal.stream.write(" G");
     hal.stream.write(uitoa((uint32_t)(94 - gc_state.modal.feed_mode)));
 
@@ -872,6 +1250,36 @@ void report_gcode_modes (void)
         hal.stream.write(appendbuf(2, " S", ftoa(gc_state.spindle.rpm, N_DECIMAL_RPMVALUE)));
 
     hal.stream.write("]" ASCII_EOL);
+
+    return true;
+}
+
+// Print current gcode parser mode state
+void report_gcode_modes (void)
+{
+#ifdef ENABLE_REPORT_CACHE
+
+    gcode_modes_key_t key;
+
+    memset(&key, 0, sizeof(gcode_modes_key_t)); // Clear padding for memcmp()
+    memcpy(&key.modal, &gc_state.modal, sizeof(gc_modal_t));
+    key.retract_mode = gc_state.canned.retract_mode;
+    key.override_ctrl = sys.override.control;
+    key.g51 = gc_get_g51_state();
+    key.g92_active = is_g92_active();
+    key.tool_change = gc_state.tool_change;
+    key.tool = gc_state.tool->tool;
+    key.feed_rate = gc_state.feed_rate;
+    key.rpm = gc_state.spindle.rpm;
+
+    if(memcmp(&key, &gcode_modes_key, sizeof(gcode_modes_key_t))) {
+        memcpy(&gcode_modes_key, &key, sizeof(gcode_modes_key_t));
+        report_cache_invalidate(ReportCache_GCodeModes);
+    }
+
+#endif
+
+    report_cached(ReportCache_GCodeModes, render_gcode_modes, NULL);
 }
 
 // Prints specified startup line
@@ -890,14 +1298,13 @@ void report_execute_startup_message (char *line, status_code_t status_code)
     grbl.report.status_message(status_code);
 }
 
-// Prints build info line
-void report_build_info (char *line)
+// Prints the version and compile-time build option lines.
+static bool render_build_info (void *line)
 {
-
     hal.stream.write("[VER:" GRBL_VERSION "(");
     hal.stream.write(hal.info ? hal.info : "HAL");
     hal.stream.write(")." GRBL_VERSION_BUILD ":");
-    hal.stream.write(line);
+    hal.stream.write((char *)line);
     hal.stream.write("]" ASCII_EOL);
 
     // Generate compile-time build option list
@@ -972,7 +1379,7 @@ void report_build_info (char *line)
     hal.stream.write(buf);
 
     // NOTE: Compiled values, like override increments/max/min values, may be added at some point later.
-    hal.stream.write(uitoa((uint32_t)(BLOCK_BUFFER_SIZE - 1)));
+    hal.stream.write(uitoa((uint32_t)(plan_get_block_buffer_size() - 1)));
     hal.stream.write(",");
     hal.stream.write(uitoa(hal.rx_buffer_size));
     hal.stream.write(",");
@@ -987,6 +1394,14 @@ void report_build_info (char *line)
 #endif
     hal.stream.write("]" ASCII_EOL);
 
+    return true;
+}
+
+// Prints build info line
+void report_build_info (char *line)
+{
+    report_cached(ReportCache_BuildInfo, render_build_info, line);
+
 #if COMPATIBILITY_LEVEL == 0
 
     nvs_io_t *nvs = nvs_buffer_get_physical();
@@ -1044,7 +1459,7 @@ void report_build_info (char *line)
     strcat(buf, "PID,");
 #endif
 
-    append = &buf[strlen(buf) - 1];
+    char *append = &buf[strlen(buf) - 1];
     if(*append == ',')
         *append = '\0';
 
@@ -1094,8 +1509,12 @@ void report_echo_line_received (char *line)
  // especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
 void report_realtime_status (void)
 {
-    static bool probing = false;
+    static THREAD_LOCAL bool probing = false;
+
+    PROFILE_BEGIN(Profile_ReportRealtimeStatus);
 
+    bool delta = false;               // Only output changed fields, set for compact reports that are not keyframes.
+    char field[sizeof(buf) + 8];      // Status report field being assembled.
     int32_t current_position[N_AXIS]; // Copy current state of the system position variable
     float print_position[N_AXIS];
     probe_state_t probe_state = {
@@ -1103,67 +1522,77 @@ void report_realtime_status (void)
         .triggered = Off
     };
 
-    memcpy(current_position, sys_position, sizeof(sys_position));
+    if(settings.status_report.compact) {
+        if((delta = keyframe_counter > 0 && !sys.report.all))
+            keyframe_counter--;
+        else {
+            keyframe_counter = REPORT_COMPACT_KEYFRAME_COUNT - 1;
+            sys.report.wco = settings.status_report.work_coord_offset;
+        }
+        override_counter = delta ? 1 : 0; // Overrides are refreshed by keyframes only.
+    }
+
+    system_get_position(current_position);
     system_convert_array_steps_to_mpos(print_position, current_position);
 
     if(hal.probe.get_state)
         probe_state = hal.probe.get_state();
 
     // Report current machine state and sub-states
-    hal.stream.write_all("<");
+    status_write("<");
 
     switch (gc_state.tool_change && sys.state == STATE_CYCLE ? STATE_TOOL_CHANGE : sys.state) {
 
         case STATE_IDLE:
-            hal.stream.write_all("Idle");
+            status_write("Idle");
             break;
 
         case STATE_CYCLE:
-            hal.stream.write_all("Run");
+            status_write("Run");
             if(sys_probing_state == Probing_Active && settings.status_report.run_substate)
                 probing = true;
             else if (probing)
                 probing = probe_state.triggered;
             if(sys.flags.feed_hold_pending)
-                hal.stream.write_all(":1");
+                status_write(":1");
             else if(probing)
-                hal.stream.write_all(":2");
+                status_write(":2");
             break;
 
         case STATE_HOLD:
-            hal.stream.write_all(appendbuf(2, "Hold:", uitoa((uint32_t)(sys.holding_state - 1))));
+            status_write(appendbuf(2, "Hold:", uitoa((uint32_t)(sys.holding_state - 1))));
             break;
 
         case STATE_JOG:
-            hal.stream.write_all("Jog");
+            status_write("Jog");
             break;
 
         case STATE_HOMING:
-            hal.stream.write_all("Home");
+            status_write("Home");
             break;
 
         case STATE_ESTOP:
         case STATE_ALARM:
             if(settings.status_report.alarm_substate)
-                hal.stream.write_all(appendbuf(2, "Alarm:", uitoa((uint32_t)current_alarm)));
+                status_write(appendbuf(2, "Alarm:", uitoa((uint32_t)current_alarm)));
             else
-                hal.stream.write_all("Alarm");
+                status_write("Alarm");
             break;
 
         case STATE_CHECK_MODE:
-            hal.stream.write_all("Check");
+            status_write("Check");
             break;
 
         case STATE_SAFETY_DOOR:
-            hal.stream.write_all(appendbuf(2, "Door:", uitoa((uint32_t)sys.parking_state)));
+            status_write(appendbuf(2, "Door:", uitoa((uint32_t)sys.parking_state)));
             break;
 
         case STATE_SLEEP:
-            hal.stream.write_all("Sleep");
+            status_write("Sleep");
             break;
 
         case STATE_TOOL_CHANGE:
-            hal.stream.write_all("Tool");
+            status_write("Tool");
             break;
     }
 
@@ -1172,30 +1601,54 @@ void report_realtime_status (void)
     if (!settings.status_report.machine_position || sys.report.wco) {
         for (idx = 0; idx < N_AXIS; idx++) {
             // Apply work coordinate offsets and tool length offset to current position.
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+            wco[idx] = gc_get_reported_offset(idx);
+#else
             wco[idx] = gc_get_offset(idx);
+#endif
             if (!settings.status_report.machine_position)
                 print_position[idx] -= wco[idx];
         }
     }
 
     // Report position
-    hal.stream.write_all(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
-    hal.stream.write_all(get_axis_values(print_position));
+    if(settings.status_report.compact) {
+        strcpy(field, settings.status_report.machine_position ? "|MPos:" : "|WPos:");
+        append_axis_values(&field[6], print_position);
+        status_write_field(ReportField_Position, field, delta);
+    } else {
+        status_write(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
+        status_write_axis_values(print_position);
+    }
 
     // Returns planner and output stream buffer states.
 
     if (settings.status_report.buffer_state) {
-        hal.stream.write_all("|Bf:");
-        hal.stream.write_all(uitoa((uint32_t)plan_get_block_buffer_available()));
-        hal.stream.write_all(",");
-        hal.stream.write_all(uitoa(hal.stream.get_rx_buffer_available()));
+        strcpy(field, "|Bf:");
+        strcat(field, uitoa((uint32_t)plan_get_block_buffer_available()));
+        strcat(field, ",");
+        strcat(field, uitoa(hal.stream.get_rx_buffer_available()));
+#ifdef SEGMENT_BUFFER_TIME
+        strcat(field, "|SB:");
+        strcat(field, uitoa((uint32_t)(st_get_buffered_time() * 60000.0f + 0.5f)));
+#endif
+#ifdef ENABLE_ALLOC_POOLS
+        if(gc_pool_exhausted_count()) {
+            strcat(field, "|PX:");
+            strcat(field, uitoa(gc_pool_exhausted_count()));
+        }
+#endif
+        status_write_field(ReportField_BufferState, field, delta);
     }
 
+
     if(settings.status_report.line_numbers) {
-        // Report current line number
+        // Report current line number, compact reports report 0 when there is none to signal the change.
         plan_block_t *cur_block = plan_get_current_block();
         if (cur_block != NULL && cur_block->line_number > 0)
-            hal.stream.write_all(appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)));
+            status_write_field(ReportField_LineNumber, appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)), delta);
+        else if(settings.status_report.compact)
+            status_write_field(ReportField_LineNumber, "|Ln:0", delta);
     }
 
     spindle_state_t sp_state = hal.spindle.get_state();
@@ -1203,12 +1656,17 @@ void report_realtime_status (void)
     // Report realtime feed speed
     if(settings.status_report.feed_speed) {
         if(hal.driver_cap.variable_spindle) {
-            hal.stream.write_all(appendbuf(2, "|FS:", get_rate_value(st_get_realtime_rate())));
-            hal.stream.write_all(appendbuf(2, ",", uitoa(sp_state.on ? (uint32_t)sys.spindle_rpm : 0)));
-            if(hal.spindle.get_data /* && sys.mpg_mode */)
-                hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)hal.spindle.get_data(SpindleData_RPM).rpm)));
+            strcpy(field, "|FS:");
+            strcat(field, get_rate_value(st_get_realtime_rate()));
+            strcat(field, ",");
+            strcat(field, uitoa(sp_state.on ? (uint32_t)sys.spindle_rpm : 0));
+            if(hal.spindle.get_data /* && sys.mpg_mode */) {
+                strcat(field, ",");
+                strcat(field, uitoa((uint32_t)hal.spindle.get_data(SpindleData_RPM).rpm));
+            }
+            status_write_field(ReportField_FeedSpeed, field, delta);
         } else
-            hal.stream.write_all(appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())));
+            status_write_field(ReportField_FeedSpeed, appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())), delta);
     }
 
     if(settings.status_report.pin_state) {
@@ -1216,7 +1674,8 @@ void report_realtime_status (void)
         axes_signals_t lim_pin_state = hal.limits.get_state();
         control_signals_t ctrl_pin_state = hal.control.get_state();
 
-        if (lim_pin_state.value | ctrl_pin_state.value | probe_state.triggered | !probe_state.connected | sys.flags.block_delete_enabled) {
+        // Compact reports output an empty field when no pins are active to signal the change.
+        if (lim_pin_state.value | ctrl_pin_state.value | probe_state.triggered | !probe_state.connected | sys.flags.block_delete_enabled | settings.status_report.compact) {
 
             char *append = &buf[4];
 
@@ -1248,7 +1707,7 @@ void report_realtime_status (void)
                     *append++ = 'T';
             }
             *append = '\0';
-            hal.stream.write_all(buf);
+            status_write_field(ReportField_PinState, buf, delta);
         }
     }
 
@@ -1281,19 +1740,19 @@ void report_realtime_status (void)
     if(sys.report.value || gc_state.tool_change) {
 
         if(sys.report.wco) {
-            hal.stream.write_all("|WCO:");
-            hal.stream.write_all(get_axis_values(wco));
+            status_write("|WCO:");
+            status_write_axis_values(wco);
         }
 
         if(sys.report.gwco) {
-            hal.stream.write_all("|WCS:G");
-            hal.stream.write_all(map_coord_system(gc_state.modal.coord_system.id));
+            status_write("|WCS:G");
+            status_write(map_coord_system(gc_state.modal.coord_system.id));
         }
 
         if(sys.report.overrides) {
-            hal.stream.write_all(appendbuf(2, "|Ov:", uitoa((uint32_t)sys.override.feed_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.rapid_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.spindle_rpm)));
+            status_write(appendbuf(2, "|Ov:", uitoa((uint32_t)sys.override.feed_rate)));
+            status_write(appendbuf(2, ",", uitoa((uint32_t)sys.override.rapid_rate)));
+            status_write(appendbuf(2, ",", uitoa((uint32_t)sys.override.spindle_rpm)));
         }
 
         if(sys.report.spindle || sys.report.coolant || sys.report.tool || gc_state.tool_change) {
@@ -1317,46 +1776,55 @@ void report_realtime_status (void)
                 *append++ = 'T';
 
             *append = '\0';
-            hal.stream.write_all(buf);
+            status_write(buf);
         }
 
         if(sys.report.scaling) {
             axis_signals_tostring(buf, gc_get_g51_state());
-            hal.stream.write_all("|Sc:");
-            hal.stream.write_all(buf);
+            status_write("|Sc:");
+            status_write(buf);
         }
 
         if(sys.report.mpg_mode && hal.driver_cap.mpg_mode)
-            hal.stream.write_all(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
+            status_write(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
 
         if(sys.report.homed && (sys.homing.mask || settings.homing.flags.single_axis_commands || settings.homing.flags.manual)) {
             axes_signals_t homing = {sys.homing.mask ? sys.homing.mask : AXES_BITMASK};
-            hal.stream.write_all(appendbuf(2, "|H:", (homing.mask & sys.homed.mask) == homing.mask ? "1" : "0"));
+            status_write(appendbuf(2, "|H:", (homing.mask & sys.homed.mask) == homing.mask ? "1" : "0"));
             if(settings.homing.flags.single_axis_commands)
-                hal.stream.write_all(appendbuf(2, ",", uitoa(sys.homed.mask)));
+                status_write(appendbuf(2, ",", uitoa(sys.homed.mask)));
         }
 
         if(sys.report.xmode && settings.mode == Mode_Lathe)
-            hal.stream.write_all(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
+            status_write(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
 
         if(sys.report.tool)
-            hal.stream.write_all(appendbuf(2, "|T:", uitoa(gc_state.tool->tool)));
+            status_write(appendbuf(2, "|T:", uitoa(gc_state.tool->tool)));
 
         if(sys.report.tlo_reference)
-            hal.stream.write_all(appendbuf(2, "|TLR:", uitoa(sys.tlo_reference_set.mask != 0)));
+            status_write(appendbuf(2, "|TLR:", uitoa(sys.tlo_reference_set.mask != 0)));
+    }
+
+#ifdef ENABLE_ADAPTIVE_SPLINE_SEGMENTATION
+    if(sys.spline_segments) {
+        status_write(appendbuf(2, "|BZ:", uitoa((uint32_t)sys.spline_segments)));
+        sys.spline_segments = 0;
     }
+#endif
+
 
     if(grbl.on_realtime_report)
-        grbl.on_realtime_report(hal.stream.write_all, sys.report);
+        grbl.on_realtime_report(status_write, sys.report);
 
-    hal.stream.write_all(">" ASCII_EOL);
+    status_write(">" ASCII_EOL);
+    status_flush();
 
     if(settings.status_report.parser_state) {
 
-        static uint32_t tool;
-        static float feed_rate, spindle_rpm;
-        static gc_modal_t last_state;
-        static bool g92_active;
+        static THREAD_LOCAL uint32_t tool;
+        static THREAD_LOCAL float feed_rate, spindle_rpm;
+        static THREAD_LOCAL gc_modal_t last_state;
+        static THREAD_LOCAL bool g92_active;
 
         bool is_changed = feed_rate != gc_state.feed_rate || spindle_rpm != gc_state.spindle.rpm || tool != gc_state.tool->tool;
 
@@ -1379,13 +1847,56 @@ void report_realtime_status (void)
     }
 
     sys.report.value = 0;
-    sys.report.wco = settings.status_report.work_coord_offset && wco_counter == 0; // Set to report on next request
+    sys.report.wco = settings.status_report.work_coord_offset && wco_counter == 0 && !settings.status_report.compact; // Set to report on next request
+
+    PROFILE_END(Profile_ReportRealtimeStatus);
 }
 
 
+#if defined(PID_LOG) && defined(PID_LOG_BINARY)
+
+static void report_pid_value (float value)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    char buf[9];
+    uint32_t bits;
+    uint_fast8_t idx = 8;
+
+    memcpy(&bits, &value, sizeof(uint32_t));
+
+    buf[8] = '\0';
+    do {
+        buf[--idx] = hex[bits & 0x0F];
+        bits >>= 4;
+    } while(idx);
+
+    hal.stream.write(buf);
+}
+
+#endif
+
 void report_pid_log (void)
 {
-#ifdef PID_LOG
+#if defined(PID_LOG) && defined(PID_LOG_BINARY)
+    uint_fast16_t idx = 0;
+
+    hal.stream.write("[PIDX:");
+    hal.stream.write(ftoa(sys.pid_log.setpoint, N_DECIMAL_PIDVALUE));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(sys.pid_log.t_sample, N_DECIMAL_PIDVALUE));
+    hal.stream.write(",2,"); // 2 is number of values per sample!
+    hal.stream.write(uitoa(sys.pid_log.t_exec_max));
+    hal.stream.write("|");
+
+    for(idx = 0; idx < sys.pid_log.idx; idx++) {
+        report_pid_value(sys.pid_log.target[idx]);
+        report_pid_value(sys.pid_log.actual[idx]);
+    }
+
+    hal.stream.write("]" ASCII_EOL);
+    grbl.report.status_message(Status_OK);
+#elif defined(PID_LOG)
     uint_fast16_t idx = 0;
 
     hal.stream.write("[PID:");
@@ -1409,3 +1920,149 @@ void report_pid_log (void)
     grbl.report.status_message(Status_GcodeUnsupportedCommand);
 #endif
 }
+
+#ifdef ENABLE_STEPPER_STATS
+
+static void report_cycles (const char *name, st_cycles_t *cycles)
+{
+    hal.stream.write(name);
+    hal.stream.write(uitoa(cycles->samples ? cycles->min : 0));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(cycles->samples ? (uint32_t)(cycles->total / cycles->samples) : 0));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(cycles->max));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(cycles->samples));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+#endif
+
+// Prints stepper interrupt and segment preparation execution times as min, average and max CPU cycles
+// followed by the number of samples, and the number of segment buffer underflows.
+// Prints realtime command queue size, high water mark and number of commands dropped.
+void report_rt_queue_stats (void)
+{
+    rt_queue_stats_t *stats = protocol_get_rt_queue_stats();
+
+    hal.stream.write("[RTQ:");
+    hal.stream.write(uitoa(stats->size));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->high_water_mark));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->dropped));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// Prints the number of segment buffer underruns followed by time and line number of the last logged, oldest first.
+void report_underruns (void)
+{
+    st_underruns_t copy;
+    uint_fast8_t idx, n;
+
+    hal.irq_disable();
+    memcpy(&copy, st_get_underruns(), sizeof(st_underruns_t));
+    hal.irq_enable();
+
+    hal.stream.write("[UNDERRUN:");
+    hal.stream.write(uitoa(copy.count));
+    hal.stream.write("]" ASCII_EOL);
+
+    n = copy.count < UNDERRUN_LOG_SIZE ? (uint_fast8_t)copy.count : UNDERRUN_LOG_SIZE;
+    idx = copy.count < UNDERRUN_LOG_SIZE ? 0 : copy.head;
+
+    while(n--) {
+        hal.stream.write("[UNDERRUN:");
+        hal.stream.write(uitoa(copy.log[idx].ms));
+        hal.stream.write(",");
+        hal.stream.write(uitoa((uint32_t)copy.log[idx].line_number));
+        hal.stream.write("]" ASCII_EOL);
+        idx = idx == UNDERRUN_LOG_SIZE - 1 ? 0 : idx + 1;
+    }
+}
+
+#ifdef ENABLE_MEMORY_REPORT
+
+static THREAD_LOCAL uint32_t memory_total;
+
+// Prints [MEM:<subsystem>,<bytes>], to be called by drivers and plugins subscribing to grbl.on_report_memory.
+void report_memory_usage (const char *subsystem, uint32_t bytes)
+{
+    memory_total += bytes;
+
+    hal.stream.write("[MEM:");
+    hal.stream.write(subsystem);
+    hal.stream.write(",");
+    hal.stream.write(uitoa(bytes));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// Prints RAM used by the core buffers, followed by buffers reported by drivers and plugins, as [MEM:<subsystem>,<bytes>].
+// Ends with [MEM:TOTAL,<bytes>] and [MEM:FREE,<bytes>] if the driver can tell the RAM left.
+status_code_t report_memory (void)
+{
+    memory_total = 0;
+
+    report_memory_usage("PLANNER", plan_get_block_buffer_size() * sizeof(plan_block_t));
+    report_memory_usage("STEPPER", st_get_buffer_memory());
+    report_memory_usage("PROTOCOL", protocol_get_buffer_memory());
+    report_memory_usage("PARSER", gc_get_memory());
+    report_memory_usage("SETTINGS", sizeof(settings_t));
+    report_memory_usage("SYSTEM", sizeof(system_t));
+#ifdef ENABLE_REPORT_CACHE
+    report_memory_usage("REPORT", report_cache_get_memory());
+#endif
+#ifdef BUFFER_NVSDATA
+    report_memory_usage("NVS", nvs_buffer_get_size());
+#endif
+
+    if(grbl.on_report_memory)
+        grbl.on_report_memory();
+
+    hal.stream.write("[MEM:TOTAL,");
+    hal.stream.write(uitoa(memory_total));
+    hal.stream.write("]" ASCII_EOL);
+
+    if(hal.get_free_mem) {
+        hal.stream.write("[MEM:FREE,");
+        hal.stream.write(uitoa(hal.get_free_mem()));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return Status_OK;
+}
+
+#endif
+
+status_code_t report_stepper_stats (void)
+{
+#ifdef ENABLE_STEPPER_STATS
+    st_stats_t *stats, copy;
+
+    if((stats = st_get_stats()) == NULL)
+        return Status_GcodeUnsupportedCommand;
+
+    hal.irq_disable();
+    memcpy(&copy, stats, sizeof(st_stats_t));
+    hal.irq_enable();
+
+    report_cycles("[ISR:", &copy.isr);
+    report_cycles("[PREP:", &copy.prep);
+    report_cycles("[PULSE:", &copy.pulse);
+    hal.stream.write("[SEGHOOKS:");
+    hal.stream.write(uitoa(st_get_segment_hook_count()));
+    hal.stream.write("]" ASCII_EOL);
+    hal.stream.write("[UNDERFLOW:");
+    hal.stream.write(uitoa(copy.underflows));
+    hal.stream.write("]" ASCII_EOL);
+    if(hal.f_cycle_count) {
+        hal.stream.write("[CLOCK:");
+        hal.stream.write(uitoa(hal.f_cycle_count));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return Status_OK;
+#else
+    return Status_GcodeUnsupportedCommand;
+#endif
+}
@@ -56,9 +56,11 @@ void report_grbl_help();
 
 // Prints Grbl setting(s)
 void report_grbl_settings (bool all);
+void report_grbl_settings_incremental (bool all);
 void report_uint_setting (setting_type_t n, uint32_t val);
 void report_float_setting (setting_type_t n, float val, uint8_t n_decimal);
 void report_string_setting (setting_type_t n, char *val);
+void report_setting (setting_type_t id);
 
 // Prints an echo of the pre-parsed line received right before execution.
 void report_echo_line_received (char *line);
@@ -85,7 +87,32 @@ void report_execute_startup_message (char *line, status_code_t status_code);
 // Prints build info and user info.
 void report_build_info (char *line);
 
+typedef enum {
+    ReportCache_GCodeModes = 0, // $G
+    ReportCache_BuildInfo,      // $I, VER and OPT lines
+    ReportCache_CoordData,      // $#, persistent coordinate systems
+    ReportCache_All             // NOTE: must be last
+} report_cache_id_t;
+
+#ifdef ENABLE_REPORT_CACHE
+
+// Invalidates cached report output, to be called when the data reported changes.
+void report_cache_invalidate (report_cache_id_t id);
+bool report_build_info_cached (void);
+uint32_t report_cache_get_memory (void);
+
+#endif
+
 // Prints current PID log.
 void report_pid_log (void);
 
+// Prints stepper execution time statistics.
+status_code_t report_stepper_stats (void);
+void report_rt_queue_stats (void);
+void report_underruns (void);
+#ifdef ENABLE_MEMORY_REPORT
+void report_memory_usage (const char *subsystem, uint32_t bytes);
+status_code_t report_memory (void);
+#endif
+
 #endif
@@ -0,0 +1,235 @@
+/*
+  scheduler.c - cooperative scheduler for foreground tasks of plugins
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_SCHEDULER
+
+#include <string.h>
+
+#include "scheduler.h"
+#include "system.h"
+#include "stepper.h"
+
+typedef struct {
+    const char *name;
+    on_execute_realtime_ptr fn;
+    scheduler_priority_t priority;
+    uint32_t interval;  // Min time between calls in ms, 0 for every pass
+    uint32_t budget;    // Max expected time per call, 0 for no limit
+    uint32_t last_ms;
+    uint32_t runs;
+    uint32_t max;       // Max time per call
+    uint64_t total;     // Total time
+    uint32_t overruns;  // Calls exceeding the budget
+    uint32_t misses;    // Calls later than twice the interval
+    uint32_t deferred;  // Passes a due background task was not run
+} scheduler_task_t;
+
+static THREAD_LOCAL uint_fast8_t n_tasks = 0, next_background = 0;
+static THREAD_LOCAL bool running = false;
+static THREAD_LOCAL scheduler_task_t tasks[SCHEDULER_TASKS_MAX]; // In priority order.
+static THREAD_LOCAL uint32_t (*get_time)(void) = NULL;
+static THREAD_LOCAL on_execute_realtime_ptr on_execute_realtime;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+bool scheduler_add (const char *name, on_execute_realtime_ptr fn, scheduler_priority_t priority, uint32_t interval, uint32_t budget)
+{
+    uint_fast8_t idx = n_tasks;
+
+    if(n_tasks == SCHEDULER_TASKS_MAX || fn == NULL)
+        return false;
+
+    // Insert after the last task of the same or higher priority.
+    while(idx && tasks[idx - 1].priority > priority) {
+        memcpy(&tasks[idx], &tasks[idx - 1], sizeof(scheduler_task_t));
+        idx--;
+    }
+
+    memset(&tasks[idx], 0, sizeof(scheduler_task_t));
+    tasks[idx].name = name;
+    tasks[idx].fn = fn;
+    tasks[idx].priority = priority;
+    tasks[idx].interval = interval;
+    tasks[idx].budget = budget;
+
+    n_tasks++;
+
+    return true;
+}
+
+static inline uint32_t time_now (void)
+{
+    return get_time ? get_time() : 0;
+}
+
+// Segment preparation always has priority, it is run before the tasks and after each task called.
+static inline void prep_segments (void)
+{
+    if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP | STATE_JOG))
+        st_prep_buffer();
+}
+
+static inline bool is_due (scheduler_task_t *task, uint32_t ms)
+{
+    return task->interval == 0 || hal.get_elapsed_ticks == NULL || ms - task->last_ms >= task->interval;
+}
+
+static void run_task (scheduler_task_t *task, uint_fast16_t state, uint32_t ms)
+{
+    uint32_t start = time_now(), elapsed;
+
+    if(task->interval && task->runs && ms - task->last_ms >= task->interval * 2)
+        task->misses++;
+
+    task->last_ms = ms;
+    task->fn(state);
+
+    elapsed = time_now() - start;
+
+    task->runs++;
+    task->total += elapsed;
+    if(elapsed > task->max)
+        task->max = elapsed;
+    if(task->budget && elapsed > task->budget)
+        task->overruns++;
+
+    prep_segments();
+}
+
+static void scheduler_run (uint_fast16_t state)
+{
+    prep_segments();
+
+    on_execute_realtime(state);
+
+    // Tasks are not run when reentered, e.g. from a task waiting for the planner buffer.
+    if(running || n_tasks == 0)
+        return;
+
+    running = true;
+
+    uint_fast8_t idx, first_background = n_tasks, count;
+    uint32_t ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0, pass_start = time_now();
+    bool background_run = false;
+
+    for(idx = 0; idx < n_tasks; idx++) {
+        if(tasks[idx].priority == SchedulerPriority_Background) {
+            first_background = idx;
+            break;
+        }
+        if(is_due(&tasks[idx], ms))
+            run_task(&tasks[idx], state, ms);
+    }
+
+    // Background tasks are called in turn, starting with the one after the last called.
+    if((count = n_tasks - first_background)) {
+
+        if(next_background < first_background || next_background >= n_tasks)
+            next_background = first_background;
+
+        idx = next_background;
+
+        do {
+            if(is_due(&tasks[idx], ms)) {
+                if(!background_run || (SCHEDULER_PASS_BUDGET && time_now() - pass_start < SCHEDULER_PASS_BUDGET)) {
+                    run_task(&tasks[idx], state, ms);
+                    background_run = true;
+                    next_background = idx + 1;
+                } else
+                    tasks[idx].deferred++;
+            }
+            if(++idx == n_tasks)
+                idx = first_background;
+        } while(--count);
+    }
+
+    running = false;
+}
+
+// Outputs [LOAD:<name>,<priority>,<runs>,<avg>,<max>,<overruns>,<misses>,<deferred>] for each task,
+// times are in cycle counter units or in milliseconds if the driver does not provide a cycle counter.
+static void scheduler_report (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_tasks; idx++) {
+        hal.stream.write("[LOAD:");
+        hal.stream.write(tasks[idx].name);
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].priority));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].runs));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].runs ? (uint32_t)(tasks[idx].total / tasks[idx].runs) : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].max));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].overruns));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].misses));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(tasks[idx].deferred));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+static void scheduler_reset (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_tasks; idx++) {
+        tasks[idx].runs = tasks[idx].max = tasks[idx].overruns = tasks[idx].misses = tasks[idx].deferred = 0;
+        tasks[idx].total = 0;
+    }
+}
+
+static status_code_t scheduler_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "LOAD", 4)) {
+        if(line[5] == '\0') {
+            scheduler_report();
+            retval = Status_OK;
+        } else if(!strcmp(&line[5], "=0")) {
+            scheduler_reset();
+            retval = Status_OK;
+        }
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void scheduler_init (void)
+{
+    get_time = hal.get_cycle_count ? hal.get_cycle_count : hal.get_elapsed_ticks;
+
+    if(grbl.on_execute_realtime != scheduler_run) {
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = scheduler_run;
+    }
+
+    if(grbl.on_unknown_sys_command != scheduler_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = scheduler_command;
+    }
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+  scheduler.h - cooperative scheduler for foreground tasks of plugins
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include "hal.h"
+
+#ifndef SCHEDULER_TASKS_MAX
+#define SCHEDULER_TASKS_MAX 8 // Total number of tasks that can be added.
+#endif
+
+// Time available per pass for background tasks, in cycle counter units or in milliseconds if the driver
+// does not provide hal.get_cycle_count(). One due background task is run per pass in any case, more
+// are run while within the budget. 0 to run a single background task per pass.
+#ifndef SCHEDULER_PASS_BUDGET
+#define SCHEDULER_PASS_BUDGET 0
+#endif
+
+typedef enum {
+    SchedulerPriority_High = 0, // Run on every pass when due, before the other tasks.
+    SchedulerPriority_Normal,   // Run on every pass when due.
+    SchedulerPriority_Background // Time sliced, run in turn within the pass budget.
+} scheduler_priority_t;
+
+// Adds a task, to be called with the current state when due, returns false if there is no free slot.
+// interval is the minimum time in milliseconds between calls, 0 to call it on every pass.
+// A call later than twice the interval is counted as a deadline miss.
+// budget is the maximum expected execution time per call, in the same unit as SCHEDULER_PASS_BUDGET.
+// Calls exceeding it are counted as overruns, tasks are not preempted. 0 for no limit.
+// Tasks cannot be removed.
+bool scheduler_add (const char *name, on_execute_realtime_ptr fn, scheduler_priority_t priority, uint32_t interval, uint32_t budget);
+
+// Hooks the scheduler into grbl.on_execute_realtime and adds the $LOAD system command.
+void scheduler_init (void);
+
+#endif
@@ -32,6 +32,7 @@
 #include "limits.h"
 #include "nvs_buffer.h"
 #include "tool_change.h"
+#include "motion_control.h"
 
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 #include <stdio.h>
@@ -53,7 +54,15 @@
 #define SETTINGS_RESTORE_DRIVER_PARAMETERS 1
 #endif
 
-settings_t settings;
+THREAD_LOCAL settings_t settings;
+THREAD_LOCAL derived_settings_t derived_settings;
+
+#ifdef ENABLE_COORD_DATA_CACHE
+static THREAD_LOCAL struct {
+    uint32_t valid; // One bit per coordinate system, set when loaded from or written to storage.
+    float data[N_CoordinateSystems + 1][N_AXIS];
+} coord_cache = {0};
+#endif
 
 const settings_restore_t settings_all = {
     .defaults          = SETTINGS_RESTORE_DEFAULTS,
@@ -70,6 +79,19 @@ const settings_t defaults = {
     .junction_deviation = DEFAULT_JUNCTION_DEVIATION,
     .arc_tolerance = DEFAULT_ARC_TOLERANCE,
     .g73_retract = DEFAULT_G73_RETRACT,
+    .planner_buffer_blocks = DEFAULT_PLANNER_BUFFER_BLOCKS,
+#ifdef ENABLE_PATH_MERGING
+    .path_merge_tolerance = DEFAULT_PATH_MERGE_TOLERANCE,
+#endif
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    .travel_junction_deviation = DEFAULT_TRAVEL_JUNCTION_DEVIATION,
+#endif
+#ifdef ENABLE_ARC_FEED_COMPENSATION
+    .arc_feed_compensation = DEFAULT_ARC_FEED_COMPENSATION,
+#endif
+#ifdef ENABLE_AUTO_REPORT
+    .auto_report_interval = DEFAULT_AUTO_REPORT_INTERVAL,
+#endif
 
     .flags.legacy_rt_commands = DEFAULT_LEGACY_RTCOMMANDS,
     .flags.report_inches = DEFAULT_REPORT_INCHES,
@@ -178,6 +200,24 @@ const settings_t defaults = {
     .axis[X_AXIS].acceleration = DEFAULT_X_ACCELERATION,
     .axis[Y_AXIS].acceleration = DEFAULT_Y_ACCELERATION,
     .axis[Z_AXIS].acceleration = DEFAULT_Z_ACCELERATION,
+#ifdef ENABLE_JERK_ACCELERATION
+    .axis[X_AXIS].jerk = DEFAULT_X_JERK,
+    .axis[Y_AXIS].jerk = DEFAULT_Y_JERK,
+    .axis[Z_AXIS].jerk = DEFAULT_Z_JERK,
+#endif
+#ifdef ENABLE_INPUT_SHAPING
+    .axis[X_AXIS].shaper_frequency = DEFAULT_X_SHAPER_FREQUENCY,
+    .axis[Y_AXIS].shaper_frequency = DEFAULT_Y_SHAPER_FREQUENCY,
+    .axis[Z_AXIS].shaper_frequency = DEFAULT_Z_SHAPER_FREQUENCY,
+    .axis[X_AXIS].shaper_damping = DEFAULT_X_SHAPER_DAMPING,
+    .axis[Y_AXIS].shaper_damping = DEFAULT_Y_SHAPER_DAMPING,
+    .axis[Z_AXIS].shaper_damping = DEFAULT_Z_SHAPER_DAMPING,
+#endif
+#ifdef ENABLE_STOP_DECELERATION
+    .axis[X_AXIS].stop_deceleration = DEFAULT_X_STOP_DECELERATION,
+    .axis[Y_AXIS].stop_deceleration = DEFAULT_Y_STOP_DECELERATION,
+    .axis[Z_AXIS].stop_deceleration = DEFAULT_Z_STOP_DECELERATION,
+#endif
     .axis[X_AXIS].max_travel = (-DEFAULT_X_MAX_TRAVEL),
     .axis[Y_AXIS].max_travel = (-DEFAULT_Y_MAX_TRAVEL),
     .axis[Z_AXIS].max_travel = (-DEFAULT_Z_MAX_TRAVEL),
@@ -186,6 +226,16 @@ const settings_t defaults = {
     .axis[A_AXIS].steps_per_mm = DEFAULT_A_STEPS_PER_MM,
     .axis[A_AXIS].max_rate = DEFAULT_A_MAX_RATE,
     .axis[A_AXIS].acceleration = DEFAULT_A_ACCELERATION,
+   #ifdef ENABLE_JERK_ACCELERATION
+    .axis[A_AXIS].jerk = DEFAULT_A_JERK,
+   #endif
+   #ifdef ENABLE_INPUT_SHAPING
+    .axis[A_AXIS].shaper_frequency = DEFAULT_A_SHAPER_FREQUENCY,
+    .axis[A_AXIS].shaper_damping = DEFAULT_A_SHAPER_DAMPING,
+   #endif
+   #ifdef ENABLE_STOP_DECELERATION
+    .axis[A_AXIS].stop_deceleration = DEFAULT_A_STOP_DECELERATION,
+   #endif
     .axis[A_AXIS].max_travel = (-DEFAULT_A_MAX_TRAVEL),
     .homing.cycle[3].mask = HOMING_CYCLE_3,
   #endif
@@ -193,12 +243,32 @@ const settings_t defaults = {
     .axis[B_AXIS].steps_per_mm = DEFAULT_B_STEPS_PER_MM,
     .axis[B_AXIS].max_rate = DEFAULT_B_MAX_RATE,
     .axis[B_AXIS].acceleration = DEFAULT_B_ACCELERATION,
+   #ifdef ENABLE_JERK_ACCELERATION
+    .axis[B_AXIS].jerk = DEFAULT_B_JERK,
+   #endif
+   #ifdef ENABLE_INPUT_SHAPING
+    .axis[B_AXIS].shaper_frequency = DEFAULT_B_SHAPER_FREQUENCY,
+    .axis[B_AXIS].shaper_damping = DEFAULT_B_SHAPER_DAMPING,
+   #endif
+   #ifdef ENABLE_STOP_DECELERATION
+    .axis[B_AXIS].stop_deceleration = DEFAULT_B_STOP_DECELERATION,
+   #endif
     .axis[B_AXIS].max_travel = (-DEFAULT_B_MAX_TRAVEL),
     .homing.cycle[4].mask = HOMING_CYCLE_4,
   #endif
   #ifdef C_AXIS
     .axis[C_AXIS].steps_per_mm = DEFAULT_C_STEPS_PER_MM,
     .axis[C_AXIS].acceleration = DEFAULT_C_ACCELERATION,
+   #ifdef ENABLE_JERK_ACCELERATION
+    .axis[C_AXIS].jerk = DEFAULT_C_JERK,
+   #endif
+   #ifdef ENABLE_INPUT_SHAPING
+    .axis[C_AXIS].shaper_frequency = DEFAULT_C_SHAPER_FREQUENCY,
+    .axis[C_AXIS].shaper_damping = DEFAULT_C_SHAPER_DAMPING,
+   #endif
+   #ifdef ENABLE_STOP_DECELERATION
+    .axis[C_AXIS].stop_deceleration = DEFAULT_C_STOP_DECELERATION,
+   #endif
     .axis[C_AXIS].max_rate = DEFAULT_C_MAX_RATE,
     .axis[C_AXIS].max_travel = (-DEFAULT_C_MAX_TRAVEL),
     .homing.cycle[5].mask = HOMING_CYCLE_5,
@@ -222,6 +292,10 @@ const settings_t defaults = {
 // Write build info to persistent storage
 void settings_write_build_info (char *line)
 {
+#ifdef ENABLE_REPORT_CACHE
+    report_cache_invalidate(ReportCache_BuildInfo);
+#endif
+
     if(hal.nvs.type != NVS_None)
         hal.nvs.memcpy_to_nvs(NVS_ADDR_BUILD_INFO, (uint8_t *)line, sizeof(stored_line_t), true);
 }
@@ -274,6 +348,17 @@ void settings_write_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS
     protocol_buffer_synchronize();
 #endif
 
+#ifdef ENABLE_REPORT_CACHE
+    report_cache_invalidate(ReportCache_CoordData);
+#endif
+
+#ifdef ENABLE_COORD_DATA_CACHE
+    if(hal.nvs.type != NVS_None) {
+        memcpy(coord_cache.data[id], coord_data, sizeof(coord_cache.data[0]));
+        coord_cache.valid |= bit(id);
+    }
+#endif
+
     if(hal.nvs.type != NVS_None)
         hal.nvs.memcpy_to_nvs(NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), (uint8_t *)coord_data, sizeof(coord_data_t), true);
 }
@@ -283,12 +368,25 @@ bool settings_read_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS]
 {
     assert(id <= N_CoordinateSystems);
 
+#ifdef ENABLE_COORD_DATA_CACHE
+    if(coord_cache.valid & bit(id)) {
+        memcpy(coord_data, coord_cache.data[id], sizeof(coord_cache.data[0]));
+        return true;
+    }
+#endif
+
     if (!(hal.nvs.type != NVS_None && hal.nvs.memcpy_from_nvs((uint8_t *)coord_data, NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), sizeof(coord_data_t), true) == NVS_TransferResult_OK)) {
         // Reset with default zero vector
         memset(coord_data, 0, sizeof(coord_data_t));
         settings_write_coord_data(id, coord_data);
         return false;
     }
+
+#ifdef ENABLE_COORD_DATA_CACHE
+    memcpy(coord_cache.data[id], coord_data, sizeof(coord_cache.data[0]));
+    coord_cache.valid |= bit(id);
+#endif
+
     return true;
 }
 
@@ -298,10 +396,14 @@ bool settings_write_tool_data (tool_data_t *tool_data)
 #ifdef N_TOOLS
     assert(tool_data->tool > 0 && tool_data->tool <= N_TOOLS); // NOTE: idx 0 is a non-persistent entry for tools not in tool table
 
+#ifdef TOOL_TABLE_CACHE
+    return hal.tool.table_write && hal.tool.table_write(tool_data);
+#else
     if(hal.nvs.type != NVS_None)
         hal.nvs.memcpy_to_nvs(NVS_ADDR_TOOL_TABLE + (tool_data->tool - 1) * (sizeof(tool_data_t) + NVS_CRC_BYTES), (uint8_t *)tool_data, sizeof(tool_data_t), true);
 
     return true;
+#endif
 #else
     return false;
 #endif
@@ -313,7 +415,11 @@ bool settings_read_tool_data (uint32_t tool, tool_data_t *tool_data)
 #ifdef N_TOOLS
     assert(tool > 0 && tool <= N_TOOLS); // NOTE: idx 0 is a non-persistent entry for tools not in tool table
 
+#ifdef TOOL_TABLE_CACHE
+    if (!(hal.tool.table_read && hal.tool.table_read(tool, tool_data) && tool_data->tool == tool)) {
+#else
     if (!(hal.nvs.type != NVS_None && hal.nvs.memcpy_from_nvs((uint8_t *)tool_data, NVS_ADDR_TOOL_TABLE + (tool - 1) * (sizeof(tool_data_t) + NVS_CRC_BYTES), sizeof(tool_data_t), true) == NVS_TransferResult_OK && tool_data->tool == tool)) {
+#endif
         memset(tool_data, 0, sizeof(tool_data_t));
         tool_data->tool = tool;
     }
@@ -344,6 +450,17 @@ void write_global_settings ()
 }
 
 
+void settings_derive (void)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        derived_settings.mm_per_step[idx] = 1.0f / settings.axis[idx].steps_per_mm;
+        derived_settings.inv_arc_tolerance_steps[idx] = 1.0f / max(settings.arc_tolerance * settings.axis[idx].steps_per_mm, 1.0f);
+    } while(idx);
+}
+
 // Restore Grbl global settings to defaults and write to persistent storage
 void settings_restore (settings_restore_t restore)
 {
@@ -353,6 +470,10 @@ void settings_restore (settings_restore_t restore)
     memset(empty_line, 0xFF, sizeof(stored_line_t));
     *empty_line = '\0';
 
+#ifdef ENABLE_REPORT_CACHE
+    report_cache_invalidate(ReportCache_All);
+#endif
+
     if (restore.defaults) {
         memcpy(&settings, &defaults, sizeof(settings_t));
 
@@ -364,6 +485,7 @@ void settings_restore (settings_restore_t restore)
         settings.control_disable_pullup.stop_disable &= hal.driver_cap.program_stop;
 
         write_global_settings();
+        settings_derive();
     }
 
     if (restore.parameters) {
@@ -403,6 +525,167 @@ void settings_restore (settings_restore_t restore)
     nvs_buffer_sync_physical();
 }
 
+#ifdef GRBL_REENTRANT
+
+// The address of the thread local settings is not a constant, the core descriptors point into a layout copy
+// of the settings instead and are relocated to the settings of the running thread when accessed.
+static settings_t settings_layout;
+
+#define SETTING_VALUE(member) &settings_layout.member
+
+static inline void *setting_value_ptr (const setting_detail_t *detail)
+{
+    uint8_t *value = (uint8_t *)detail->value;
+
+    return value >= (uint8_t *)&settings_layout && value < (uint8_t *)&settings_layout + sizeof(settings_t)
+            ? (uint8_t *)&settings + (value - (uint8_t *)&settings_layout)
+            : detail->value;
+}
+
+#else
+
+#define SETTING_VALUE(member) &settings.member
+#define setting_value_ptr(detail) (detail)->value
+
+#endif
+
+// Descriptors for plain numeric settings, must be sorted by id.
+static const setting_detail_t setting_detail[] = {
+    { Setting_StepperIdleLockTime, Format_Int16, SETTING_VALUE(steppers.idle_lock_time), 0.0f, 65535.0f },
+    { Setting_PlannerBufferBlocks, Format_Int16, SETTING_VALUE(planner_buffer_blocks), (float)BLOCK_BUFFER_SIZE_MIN, (float)BLOCK_BUFFER_SIZE_MAX },
+#ifdef ENABLE_PATH_MERGING
+    { Setting_PathMergeTolerance, Format_Decimal, SETTING_VALUE(path_merge_tolerance), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+#endif
+    { Setting_JunctionDeviation, Format_Decimal, SETTING_VALUE(junction_deviation), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_ArcTolerance, Format_Decimal, SETTING_VALUE(arc_tolerance), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_HomingFeedRate, Format_Decimal, SETTING_VALUE(homing.feed_rate), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_HomingSeekRate, Format_Decimal, SETTING_VALUE(homing.seek_rate), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_HomingDebounceDelay, Format_Int16, SETTING_VALUE(homing.debounce_delay), 0.0f, 65535.0f },
+    { Setting_HomingPulloff, Format_Decimal, SETTING_VALUE(homing.pulloff), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_G73Retract, Format_Decimal, SETTING_VALUE(g73_retract), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_RpmMax, Format_Decimal, SETTING_VALUE(spindle.rpm_max), 0.0f, 0.0f, N_DECIMAL_RPMVALUE },
+    { Setting_RpmMin, Format_Decimal, SETTING_VALUE(spindle.rpm_min), 0.0f, 0.0f, N_DECIMAL_RPMVALUE },
+    { Setting_PWMFreq, Format_Decimal, SETTING_VALUE(spindle.pwm_freq), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_PWMOffValue, Format_Decimal, SETTING_VALUE(spindle.pwm_off_value), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_PWMMinValue, Format_Decimal, SETTING_VALUE(spindle.pwm_min_value), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_PWMMaxValue, Format_Decimal, SETTING_VALUE(spindle.pwm_max_value), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_SpindlePPR, Format_Int16, SETTING_VALUE(spindle.ppr), 0.0f, 65535.0f },
+    { Setting_ParkingAxis, Format_Int8, SETTING_VALUE(parking.axis), 0.0f, (float)(N_AXIS - 1) },
+    { Setting_ParkingPulloutIncrement, Format_Decimal, SETTING_VALUE(parking.pullout_increment), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_ParkingPulloutRate, Format_Decimal, SETTING_VALUE(parking.pullout_rate), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_ParkingTarget, Format_Decimal, SETTING_VALUE(parking.target), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_ParkingFastRate, Format_Decimal, SETTING_VALUE(parking.rate), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+#ifdef SPINDLE_RPM_CONTROLLED
+    { Setting_SpindlePGain, Format_Decimal, SETTING_VALUE(spindle.pid.p_gain), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_SpindleIGain, Format_Decimal, SETTING_VALUE(spindle.pid.i_gain), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_SpindleDGain, Format_Decimal, SETTING_VALUE(spindle.pid.d_gain), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_SpindleMaxError, Format_Decimal, SETTING_VALUE(spindle.pid.max_error), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_SpindleIMaxError, Format_Decimal, SETTING_VALUE(spindle.pid.i_max_error), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+#endif
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    { Setting_TravelJunctionDeviation, Format_Decimal, SETTING_VALUE(travel_junction_deviation), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+#endif
+#ifdef ENABLE_ARC_FEED_COMPENSATION
+    { Setting_ArcFeedCompensation, Format_Int8, SETTING_VALUE(arc_feed_compensation), 0.0f, 2.0f },
+#endif
+    { Setting_PositionPGain, Format_Decimal, SETTING_VALUE(position.pid.p_gain), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_PositionIGain, Format_Decimal, SETTING_VALUE(position.pid.i_gain), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_PositionDGain, Format_Decimal, SETTING_VALUE(position.pid.d_gain), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_PositionIMaxError, Format_Decimal, SETTING_VALUE(position.pid.i_max_error), 0.0f, 0.0f, N_DECIMAL_SETTINGVALUE },
+    { Setting_SpindleAtSpeedTolerance, Format_Decimal, SETTING_VALUE(spindle.at_speed_tolerance), 0.0f, 0.0f, 1 },
+    { Setting_ToolChangeFeedRate, Format_Decimal, SETTING_VALUE(tool_change.feed_rate), 0.0f, 0.0f, 1 },
+    { Setting_ToolChangeSeekRate, Format_Decimal, SETTING_VALUE(tool_change.seek_rate), 0.0f, 0.0f, 1 }
+};
+
+static THREAD_LOCAL setting_details_t details = {
+    .settings = setting_detail,
+    .n_settings = sizeof(setting_detail) / sizeof(setting_detail_t)
+};
+
+// Add a group of setting descriptors, the group is searched after the core settings and previously registered groups.
+void settings_register (setting_details_t *group)
+{
+    setting_details_t *last = &details;
+
+    while(last->next)
+        last = last->next;
+
+    group->next = NULL;
+    last->next = group;
+}
+
+setting_details_t *settings_get_groups (void)
+{
+    return &details;
+}
+
+// Binary search the setting groups for the descriptor of a setting.
+const setting_detail_t *setting_get_details (setting_type_t id, setting_details_t **group)
+{
+    setting_details_t *details_group = &details;
+
+    do {
+        uint_fast16_t low = 0, high = details_group->n_settings, mid;
+
+        while(low < high) {
+            mid = (low + high) >> 1;
+            if(details_group->settings[mid].id == id) {
+                if(group)
+                    *group = details_group;
+                return &details_group->settings[mid];
+            }
+            if(details_group->settings[mid].id < id)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+    } while((details_group = details_group->next));
+
+    return NULL;
+}
+
+float setting_get_value (const setting_detail_t *detail)
+{
+    switch(detail->datatype) {
+
+        case Format_Int8:
+            return (float)*((uint8_t *)setting_value_ptr(detail));
+
+        case Format_Int16:
+            return (float)*((uint16_t *)setting_value_ptr(detail));
+
+        default:
+            return *((float *)setting_value_ptr(detail));
+    }
+}
+
+// Validate and store the value of a setting having a descriptor.
+static status_code_t store_setting_value (const setting_detail_t *detail, float value)
+{
+    if(detail->max_value > detail->min_value && (value < detail->min_value || value > detail->max_value))
+        return Status_InvalidStatement;
+
+    switch(detail->datatype) {
+
+        case Format_Int8:
+            *((uint8_t *)setting_value_ptr(detail)) = (uint8_t)truncf(value);
+            break;
+
+        case Format_Int16:
+            *((uint16_t *)setting_value_ptr(detail)) = (uint16_t)truncf(value);
+            break;
+
+        default:
+            *((float *)setting_value_ptr(detail)) = value;
+            break;
+    }
+
+    if(detail->on_changed)
+        detail->on_changed(detail->id);
+
+    return Status_OK;
+}
+
 static status_code_t store_driver_setting (setting_type_t setting, float value, char *svalue)
 {
     status_code_t status = hal.driver_settings.set ? hal.driver_settings.set(setting, value, svalue) : Status_Unhandled;
@@ -417,10 +700,26 @@ static status_code_t store_driver_setting (setting_type_t setting, float value,
 }
 
 // A helper method to set settings from command line
+// Writes the global settings to persistent storage and updates derived data and the driver.
+static void global_settings_changed (void)
+{
+    write_global_settings();
+    settings_derive();
+#ifdef ENABLE_REPORT_CACHE
+    report_cache_invalidate(ReportCache_All);
+#endif
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    mc_backlash_init();
+#endif
+    hal.settings_changed(&settings);
+}
+
 status_code_t settings_store_global_setting (setting_type_t setting, char *svalue)
 {
     uint_fast8_t set_idx = 0;
     float value;
+    setting_details_t *group;
+    const setting_detail_t *detail;
 
     // Trim leading spaces
     while(*svalue == ' ')
@@ -485,6 +784,37 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 break;
 #endif
 
+#ifdef ENABLE_JERK_ACCELERATION
+            case AxisSetting_Jerk:
+                if(value == 0.0f)
+                    return Status_InvalidStatement;
+                found = true;
+                settings.axis[axis_idx].jerk = value * 60.0f * 60.0f * 60.0f; // Convert to mm/min^3 for grbl internal use.
+                break;
+#endif
+
+#ifdef ENABLE_INPUT_SHAPING
+            case AxisSetting_ShaperFrequency:
+                found = true;
+                settings.axis[axis_idx].shaper_frequency = value; // Hz, 0 disables input shaping for the axis.
+                break;
+
+            case AxisSetting_ShaperDamping:
+                if(value >= 1.0f)
+                    return Status_InvalidStatement;
+                found = true;
+                settings.axis[axis_idx].shaper_damping = value;
+                break;
+#endif
+
+#ifdef ENABLE_STOP_DECELERATION
+            case AxisSetting_StopDeceleration:
+                found = true;
+                settings.axis[axis_idx].stop_deceleration = value * 60.0f * 60.0f; // Convert to mm/min^2 for grbl internal use.
+                break;
+#endif
+
+
             default: // for stopping compiler warning
                 break;
         }
@@ -492,6 +822,19 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
         if(!found)
             return store_driver_setting(setting, value, svalue);
 
+    } else if((detail = setting_get_details(setting, &group))) {
+        // Store settings having a descriptor
+        status_code_t status;
+
+        if((status = store_setting_value(detail, value)) != Status_OK)
+            return status;
+
+        if(group != &details) {
+            if(group->save)
+                group->save();
+            return Status_OK;
+        }
+
     } else {
         // Store non-axis Grbl settings
         uint_fast16_t int_value = (uint_fast16_t)truncf(value);
@@ -509,9 +852,13 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.steppers.pulse_delay_microseconds = value;
                 break;
 
-            case Setting_StepperIdleLockTime:
-                settings.steppers.idle_lock_time = int_value;
+#ifdef ENABLE_AUTO_REPORT
+            case Setting_AutoReportInterval:
+                if(value < 0.0f || value > 60000.0f || (int_value && int_value < 50))
+                    return Status_InvalidStatement;
+                settings.auto_report_interval = int_value;
                 break;
+#endif
 
             case Setting_StepInvertMask:
                 settings.steppers.step_invert.mask = int_value & AXES_BITMASK;
@@ -545,14 +892,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
 #endif
                 break;
 
-            case Setting_JunctionDeviation:
-                settings.junction_deviation = value;
-                break;
-
-            case Setting_ArcTolerance:
-                settings.arc_tolerance = value;
-                break;
-
             case Setting_ReportInches:
                 settings.flags.report_inches = int_value != 0;
                 report_init();
@@ -579,10 +918,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 }
                 break;
 
-            case Setting_SpindleAtSpeedTolerance:
-                settings.spindle.at_speed_tolerance = value;
-                break;
-
             case Setting_ControlPullUpDisableMask:
                 settings.control_disable_pullup.mask = int_value;
                 settings.control_disable_pullup.block_delete &= hal.driver_cap.block_delete;
@@ -666,22 +1001,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.homing.dir_mask.value = int_value & AXES_BITMASK;
                 break;
 
-            case Setting_HomingFeedRate:
-                settings.homing.feed_rate = value;
-                break;
-
-            case Setting_HomingSeekRate:
-                settings.homing.seek_rate = value;
-                break;
-
-            case Setting_HomingDebounceDelay:
-                settings.homing.debounce_delay = int_value;
-                break;
-
-            case Setting_HomingPulloff:
-                settings.homing.pulloff = value;
-                break;
-
             case Setting_EnableLegacyRTCommands:
                 settings.flags.legacy_rt_commands = value != 0;
                 break;
@@ -700,22 +1019,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 limits_set_homing_axes();
                 break;
 
-            case Setting_G73Retract:
-                settings.g73_retract = value;
-                break;
-
-            case Setting_PWMFreq:
-                settings.spindle.pwm_freq = value;
-                break;
-
-            case Setting_RpmMax:
-                settings.spindle.rpm_max = value;
-                break;
-
-            case Setting_RpmMin:
-                settings.spindle.rpm_min = value;
-                break;
-
             case Setting_Mode:
                 switch((machine_mode_t)int_value) {
 
@@ -746,46 +1049,10 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.parking.flags.value = bit_istrue(int_value, bit(0)) ? (int_value & 0x07) : 0;
                 break;
 
-            case Setting_ParkingAxis:
-                settings.parking.axis = int_value;
-                break;
-
-            case Setting_ParkingPulloutIncrement:
-                settings.parking.pullout_increment = value;
-                break;
-
-            case Setting_ParkingPulloutRate:
-                settings.parking.pullout_rate = value;
-                break;
-
-            case Setting_ParkingTarget:
-                settings.parking.target = value;
-                break;
-
-            case Setting_ParkingFastRate:
-                settings.parking.rate = value;
-                break;
-
-            case Setting_PWMOffValue:
-                settings.spindle.pwm_off_value = value;
-                break;
-
-            case Setting_PWMMinValue:
-                settings.spindle.pwm_min_value = value;
-                break;
-
-            case Setting_PWMMaxValue:
-                settings.spindle.pwm_max_value = value;
-                break;
-
             case Setting_StepperDeenergizeMask:
                 settings.steppers.deenergize.mask = int_value & AXES_BITMASK;
                 break;
 
-            case Setting_SpindlePPR:
-                settings.spindle.ppr = int_value;
-                break;
-
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 
             case Setting_LinearSpindlePiece1:
@@ -810,46 +1077,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 break;
 #endif
 
-#ifdef SPINDLE_RPM_CONTROLLED
-
-            case Setting_SpindlePGain:
-                settings.spindle.pid.p_gain = value;
-                break;
-
-            case Setting_SpindleIGain:
-                settings.spindle.pid.i_gain = value;
-                break;
-
-            case Setting_SpindleDGain:
-                settings.spindle.pid.d_gain = value;
-                break;
-
-            case Setting_SpindleMaxError:
-                settings.spindle.pid.max_error = value;
-                break;
-
-            case Setting_SpindleIMaxError:
-                settings.spindle.pid.i_max_error = value;
-                break;
-
-#endif
-
-            case Setting_PositionPGain:
-                settings.position.pid.p_gain = value;
-                break;
-
-            case Setting_PositionIGain:
-                settings.position.pid.i_gain = value;
-                break;
-
-            case Setting_PositionDGain:
-                settings.position.pid.d_gain = value;
-                break;
-
-            case Setting_PositionIMaxError:
-                settings.position.pid.i_max_error = value;
-                break;
-
             case Setting_ToolChangeMode:
                 if(!hal.driver_cap.atc && hal.stream.suspend_read && int_value <= ToolChange_Ignore) {
 #if COMPATIBILITY_LEVEL > 1
@@ -869,14 +1096,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                     return Status_InvalidStatement;
                 break;
 
-            case Setting_ToolChangeFeedRate:
-                settings.tool_change.feed_rate = value;
-                break;
-
-            case Setting_ToolChangeSeekRate:
-                settings.tool_change.seek_rate = value;
-                break;
-
             case Settings_IoPort_InvertIn:
                 settings.ioport.invert_in.mask = (uint8_t)(int_value & 0xFF);
                 break;
@@ -898,17 +1117,25 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
         }
     }
 
-    write_global_settings();
-#ifdef ENABLE_BACKLASH_COMPENSATION
-    mc_backlash_init();
-#endif
-    hal.settings_changed(&settings);
+    global_settings_changed();
 
     return Status_OK;
 }
 
+// Replaces all global settings at once, the driver is notified of the change only once.
+void settings_replace_global (settings_t *new_settings)
+{
+    if(new_settings != &settings)
+        memcpy(&settings, new_settings, sizeof(settings_t));
+
+    global_settings_changed();
+}
+
 // Initialize the config subsystem
 void settings_init() {
+#ifdef ENABLE_COORD_DATA_CACHE
+    coord_cache.valid = 0; // Reloaded on first use, storage may have been replaced.
+#endif
     if(!read_global_settings()) {
         settings_restore_t settings = settings_all;
         settings.defaults = 1; // Ensure global settings get restored
@@ -921,13 +1148,16 @@ void settings_init() {
         report_grbl_settings(false);
 #endif
     } else {
+#ifndef TOOL_TABLE_CACHE // Cached tool table entries are read on first use.
         memset(&tool_table, 0, sizeof(tool_data_t)); // First entry is for tools not in tool table
-#ifdef N_TOOLS
+  #ifdef N_TOOLS
         uint_fast8_t idx;
         for (idx = 1; idx <= N_TOOLS; idx++)
             settings_read_tool_data(idx, &tool_table[idx]);
+  #endif
 #endif
         report_init();
+        settings_derive();
 #ifdef ENABLE_BACKLASH_COMPENSATION
         mc_backlash_init();
 #endif
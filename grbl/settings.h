@@ -29,11 +29,17 @@
 
 // Version of the persistent storage data. Will be used to migrate existing data from older versions of Grbl
 // when firmware is upgraded. Always stored in byte 0 of non-volatile storage
-#define SETTINGS_VERSION 18  // NOTE: Check settings_reset() when moving to next version.
+#define SETTINGS_VERSION 19  // NOTE: Check settings_reset() when moving to next version.
 
 
 // Define axis settings numbering scheme. Starts at Setting_AxisSettingsBase, every INCREMENT, over N_SETTINGS.
-#ifdef ENABLE_BACKLASH_COMPENSATION
+#if defined(ENABLE_STOP_DECELERATION)
+#define AXIS_N_SETTINGS          11
+#elif defined(ENABLE_INPUT_SHAPING)
+#define AXIS_N_SETTINGS          10
+#elif defined(ENABLE_JERK_ACCELERATION)
+#define AXIS_N_SETTINGS          8
+#elif defined(ENABLE_BACKLASH_COMPENSATION)
 #define AXIS_N_SETTINGS          6
 #else
 #define AXIS_N_SETTINGS          4
@@ -53,6 +59,9 @@ typedef enum {
     Setting_InvertStepperEnable = 4,
     Setting_LimitPinsInvertMask = 5,
     Setting_InvertProbePin = 6,
+    Setting_PlannerBufferBlocks = 7,
+    Setting_PathMergeTolerance = 8,
+    Setting_AutoReportInterval = 9,
     Setting_StatusReportMask = 10,
     Setting_JunctionDeviation = 11,
     Setting_ArcTolerance = 12,
@@ -142,6 +151,9 @@ typedef enum {
     Setting_SpindleIMaxError = 85,
     Setting_SpindleDMaxError = 86,
 
+    Setting_TravelJunctionDeviation = 87,
+    Setting_ArcFeedCompensation = 88,
+
 // Optional settings for closed loop spindle synchronized motion
     Setting_PositionPGain = 90,
     Setting_PositionIGain = 91,
@@ -245,12 +257,16 @@ typedef enum {
     AxisSetting_MaxTravel = 3,
     AxisSetting_StepperCurrent = 4,
     AxisSetting_MicroSteps = 5,
-    AxisSetting_Backlash = 6
+    AxisSetting_Backlash = 6,
+    AxisSetting_Jerk = 7,
+    AxisSetting_ShaperFrequency = 8,
+    AxisSetting_ShaperDamping = 9,
+    AxisSetting_StopDeceleration = 10
     /*
-    AxisSetting_P_Gain = 7,
-    AxisSetting_I_Gain = 8,
-    AxisSetting_D_Gain = 9,
-    AxisSetting_I_MaxError = 10
+    AxisSetting_P_Gain = 11,
+    AxisSetting_I_Gain = 12,
+    AxisSetting_D_Gain = 13,
+    AxisSetting_I_MaxError = 14
     */
 } axis_setting_type_t;
 
@@ -314,7 +330,8 @@ typedef union {
                  parser_state       :1,
                  alarm_substate     :1,
                  run_substate       :1,
-                 unassigned         :4;
+                 compact            :1,
+                 unassigned         :3;
     };
 } reportmask_t;
 
@@ -416,8 +433,19 @@ typedef struct {
 #ifdef ENABLE_BACKLASH_COMPENSATION
     float backlash;
 #endif
+#ifdef ENABLE_JERK_ACCELERATION
+    float jerk;
+#endif
+#ifdef ENABLE_INPUT_SHAPING
+    float shaper_frequency;
+    float shaper_damping;
+#endif
+#ifdef ENABLE_STOP_DECELERATION
+    float stop_deceleration;
+#endif
 } axis_settings_t;
 
+
 typedef union {
     uint8_t value;
     struct {
@@ -486,6 +514,19 @@ typedef struct {
     float junction_deviation;
     float arc_tolerance;
     float g73_retract;
+    uint16_t planner_buffer_blocks; // Number of blocks allocated for the planner buffer, applied on next startup.
+#ifdef ENABLE_PATH_MERGING
+    float path_merge_tolerance;     // Max deviation from a straight line for merged line segments, 0 disables merging.
+#endif
+#ifdef ENABLE_LASER_TRAVEL_JUNCTIONS
+    float travel_junction_deviation; // Junction deviation between laser mode motions with the laser off.
+#endif
+#ifdef ENABLE_ARC_FEED_COMPENSATION
+    uint8_t arc_feed_compensation;  // Inner arc feed compensation, 0 disabled, 1 climb milling, 2 conventional milling.
+#endif
+#ifdef ENABLE_AUTO_REPORT
+    uint16_t auto_report_interval;  // Interval between controller driven status reports (ms), 0 disables them.
+#endif
     machine_mode_t mode;
     tool_change_settings_t tool_change;
     axis_settings_t axis[N_AXIS];
@@ -504,17 +545,58 @@ typedef struct {
     ioport_signals_t ioport;
 } settings_t;
 
-extern settings_t settings;
+extern THREAD_LOCAL settings_t settings;
+
+// Values derived from settings, recomputed by settings_derive() when settings are changed and before
+// hal.settings_changed() is called. Read these instead of recomputing them in frequently called code.
+typedef struct {
+    float mm_per_step[N_AXIS];              // Reciprocal of steps_per_mm
+    float inv_arc_tolerance_steps[N_AXIS];  // Reciprocal of the arc tolerance in steps, never less than one step
+} derived_settings_t;
+
+extern THREAD_LOCAL derived_settings_t derived_settings;
+
+typedef enum {
+    Format_Decimal = 0,
+    Format_Int8,
+    Format_Int16
+} setting_datatype_t;
+
+// Setting descriptor for plain numeric settings, used for shared validation, storing and reporting.
+// Values outside [min_value, max_value] are rejected, set both to 0.0f for no range check.
+typedef struct {
+    setting_type_t id;
+    setting_datatype_t datatype;
+    void *value;                // Pointer to float, uint8_t or uint16_t value depending on datatype.
+    float min_value;
+    float max_value;
+    uint8_t n_decimals;         // Decimals reported for Format_Decimal values.
+    void (*on_changed)(setting_type_t id); // Optional, called after the value has been changed.
+} setting_detail_t;
+
+// Group of setting descriptors, sorted by id. Groups registered by drivers and plugins are reported at the end of the $$ listing.
+typedef struct setting_details {
+    const setting_detail_t *settings;
+    uint_fast16_t n_settings;
+    void (*save)(void);         // Called after a setting has been changed, should write the settings to non-volatile storage.
+    struct setting_details *next; // Set by settings_register().
+} setting_details_t;
 
 // Initialize the configuration subsystem (load settings from persistent storage)
 void settings_init();
 
+// Recomputes derived_settings from the current settings
+void settings_derive (void);
+
 // Helper function to clear and restore persistent storage defaults
 void settings_restore(settings_restore_t restore_flags);
 
 // A helper method to set new settings from command line
 status_code_t settings_store_global_setting(setting_type_t setting, char *svalue);
 
+// Replaces all global settings, writes them to persistent storage and notifies the driver once
+void settings_replace_global (settings_t *new_settings);
+
 // Writes the protocol line variable as a startup line in persistent storage
 void settings_write_startup_line(uint8_t idx, char *line);
 
@@ -539,4 +621,16 @@ bool settings_write_tool_data (tool_data_t *tool_data);
 // Read selected tool data from persistent storage
 bool settings_read_tool_data (uint32_t tool, tool_data_t *tool_data);
 
+// Register a group of setting descriptors, handled before settings delegated to hal.driver_settings
+void settings_register (setting_details_t *details);
+
+// Get the first group of setting descriptors, the core settings, further groups are linked by the next member
+setting_details_t *settings_get_groups (void);
+
+// Get descriptor for a setting, optionally returns the group it belongs to. Returns NULL if not found
+const setting_detail_t *setting_get_details (setting_type_t id, setting_details_t **group);
+
+// Value of a setting as float
+float setting_get_value (const setting_detail_t *detail);
+
 #endif
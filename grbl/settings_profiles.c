@@ -0,0 +1,170 @@
+/*
+  settings_profiles.c - named sets of global settings for instant switching between machine configurations
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_SETTINGS_PROFILES
+
+#include <string.h>
+
+#include "settings_profiles.h"
+#include "nvs_buffer.h"
+#include "report.h"
+
+/* Each profile is a copy of the global settings stored in the NVS driver area along with its name.
+   Profiles are stored with a checksum and the settings version, profiles failing the check are free. */
+typedef struct {
+    uint8_t version;
+    char name[SETTINGS_PROFILE_NAME_LENGTH + 1];
+    settings_t settings;
+} settings_profile_t;
+
+static THREAD_LOCAL uint32_t nvs_address[SETTINGS_PROFILES];
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command;
+
+static bool profile_read (uint_fast8_t idx, settings_profile_t *profile)
+{
+    return nvs_address[idx] &&
+            hal.nvs.memcpy_from_nvs((uint8_t *)profile, nvs_address[idx], sizeof(settings_profile_t), true) == NVS_TransferResult_OK &&
+             profile->version == SETTINGS_VERSION && *profile->name != '\0';
+}
+
+// Returns the index of the profile with the given name, or the first free one if free is set, -1 if none.
+static int_fast8_t profile_find (const char *name, bool free, settings_profile_t *profile)
+{
+    uint_fast8_t idx;
+    int_fast8_t found = -1;
+
+    for(idx = 0; idx < SETTINGS_PROFILES; idx++) {
+        if(profile_read(idx, profile)) {
+            if(!strcmp(profile->name, name))
+                return (int_fast8_t)idx;
+        } else if(free && found == -1 && nvs_address[idx])
+            found = (int_fast8_t)idx;
+    }
+
+    return found;
+}
+
+static void profiles_report (void)
+{
+    uint_fast8_t idx;
+    settings_profile_t profile;
+
+    for(idx = 0; idx < SETTINGS_PROFILES; idx++) {
+        if(profile_read(idx, &profile)) {
+            hal.stream.write("[PRF:");
+            hal.stream.write(profile.name);
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+}
+
+// Replaces all global settings by the profile settings in one go.
+static status_code_t profile_load (const char *name)
+{
+    settings_profile_t profile;
+
+    if(profile_find(name, false, &profile) < 0)
+        return Status_InvalidStatement;
+
+    settings_replace_global(&profile.settings);
+
+    return Status_OK;
+}
+
+// Stores the current global settings as a new profile or by replacing the profile with the same name.
+static status_code_t profile_store (const char *name)
+{
+    int_fast8_t idx;
+    settings_profile_t profile;
+
+    if(*name == '\0' || strlen(name) > SETTINGS_PROFILE_NAME_LENGTH)
+        return Status_InvalidStatement;
+
+    if((idx = profile_find(name, true, &profile)) < 0)
+        return Status_Overflow; // No free profile
+
+    memset(&profile, 0, sizeof(settings_profile_t));
+    profile.version = SETTINGS_VERSION;
+    strcpy(profile.name, name);
+    memcpy(&profile.settings, &settings, sizeof(settings_t));
+
+    hal.nvs.memcpy_to_nvs(nvs_address[idx], (uint8_t *)&profile, sizeof(settings_profile_t), true);
+
+    return Status_OK;
+}
+
+static status_code_t profile_delete (const char *name)
+{
+    int_fast8_t idx;
+    settings_profile_t profile;
+
+    if((idx = profile_find(name, false, &profile)) < 0)
+        return Status_InvalidStatement;
+
+    *profile.name = '\0';
+    hal.nvs.memcpy_to_nvs(nvs_address[idx], (uint8_t *)&profile, sizeof(settings_profile_t), true);
+
+    return Status_OK;
+}
+
+/* $PRF lists the stored profiles as [PRF:<name>].
+   $PRF=<name> replaces the global settings with the settings of the named profile.
+   $PRFS=<name> stores the current global settings as the named profile.
+   $PRFD=<name> deletes the named profile.
+   Names are case sensitive. */
+static status_code_t profiles_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "PRF", 3)) {
+
+        if(line[4] == '\0') {
+            profiles_report();
+            retval = Status_OK;
+        } else if(!(state == STATE_IDLE || (state & (STATE_ALARM|STATE_ESTOP))))
+            retval = Status_IdleError;
+        else if(line[4] == '=')
+            retval = profile_load(&lcline[5]);
+        else if(line[4] == 'S' && line[5] == '=')
+            retval = profile_store(&lcline[6]);
+        else if(line[4] == 'D' && line[5] == '=')
+            retval = profile_delete(&lcline[6]);
+        else
+            retval = Status_InvalidStatement;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+void settings_profiles_init (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < SETTINGS_PROFILES; idx++)
+        nvs_address[idx] = nvs_alloc(sizeof(settings_profile_t));
+
+    if(nvs_address[0] && grbl.on_unknown_sys_command != profiles_command) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = profiles_command;
+    }
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+  settings_profiles.h - named sets of global settings for instant switching between machine configurations
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SETTINGS_PROFILES_H_
+#define _SETTINGS_PROFILES_H_
+
+#ifndef SETTINGS_PROFILES
+#define SETTINGS_PROFILES 2 // Number of profiles stored, each takes the size of settings_t plus some bytes of NVS.
+#endif
+
+#ifndef SETTINGS_PROFILE_NAME_LENGTH
+#define SETTINGS_PROFILE_NAME_LENGTH 15
+#endif
+
+// Allocates NVS storage for the profiles and adds the $PRF system commands.
+// NOTE: Must be called before the NVS buffer is loaded from physical storage.
+void settings_profiles_init (void);
+
+#endif
@@ -22,10 +22,23 @@
 */
 
 #include <math.h>
+#include <string.h>
 
 #include "hal.h"
 #include "protocol.h"
 #include "state_machine.h"
+#include "spindle_sync.h"
+#ifdef ENABLE_JOB_ESTIMATE
+#include "motion_control.h"
+#endif
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+static THREAD_LOCAL struct {
+    bool pending;
+    float delay;
+    uint32_t started;
+} spinup = {0};
+#endif
 
 // Set spindle speed override
 // NOTE: Unlike motion overrides, spindle overrides do not require a planner reinitialization.
@@ -56,6 +69,9 @@ bool spindle_set_state (spindle_state_t state, float rpm)
         if (!state.on) { // Halt or set spindle direction and rpm.
             sys.spindle_rpm = rpm = 0.0f;
             hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+#ifdef ENABLE_ASYNC_SPINDLE_START
+            spinup.pending = false;
+#endif
         } else {
             // NOTE: Assumes all calls to this function is when Grbl is not moving or must remain off.
             // TODO: alarm/interlock if going from CW to CCW directly in non-laser mode?
@@ -72,30 +88,165 @@ bool spindle_set_state (spindle_state_t state, float rpm)
     return !ABORTED;
 }
 
+// Returns true if the driver provides an at speed signal or, if enabled, RPM feedback.
+static inline bool at_speed_available (void)
+{
+#ifdef ENABLE_SPINDLE_RPM_AT_SPEED
+    return hal.driver_cap.spindle_at_speed || hal.spindle.get_data != NULL;
+#else
+    return hal.driver_cap.spindle_at_speed;
+#endif
+}
+
+// Returns true if the spindle is at speed. If the driver does not provide an at speed signal
+// the measured RPM is checked against the programmed RPM with the at speed tolerance (in percent).
+static bool is_at_speed (void)
+{
+#ifdef ENABLE_SPINDLE_RPM_AT_SPEED
+    if(!hal.driver_cap.spindle_at_speed)
+        return fabsf(fabsf(hal.spindle.get_data(SpindleData_RPM).rpm) - sys.spindle_rpm) <= sys.spindle_rpm * settings.spindle.at_speed_tolerance / 100.0f;
+#endif
+
+    return hal.spindle.get_state().at_speed;
+}
+
+#ifdef ENABLE_SPINDLE_RPM_AT_SPEED
+
+// Reports the time the spindle needed to come up to speed.
+static void report_spinup_time (float seconds)
+{
+    char msg[40];
+
+    strcpy(msg, "Spindle at speed in ");
+    strcat(msg, ftoa(seconds, 2));
+    strcat(msg, " s, T");
+    strcat(msg, uitoa(gc_state.tool->tool));
+    report_message(msg, Message_Plain);
+}
+
+#else
+static inline void report_spinup_time (float seconds) {}
+#endif
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+
+// Returns the time in seconds since the spin-up was started, 0 if the HAL does not provide a time base.
+static float spinup_time (void)
+{
+    return hal.get_elapsed_ticks ? (float)(hal.get_elapsed_ticks() - spinup.started) / 1000.0f : 0.0f;
+}
+
+// Records the start of a spin-up, the wait for it to complete is deferred to spindle_await_at_speed().
+static void spinup_start (spindle_state_t state, float delay)
+{
+    if((spinup.pending = state.on && settings.mode != Mode_Laser)) {
+        spinup.delay = delay;
+        spinup.started = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    }
+}
+
+// Waits for a pending spin-up to complete, either by the at speed signal or by the remaining spin-up delay
+// when the driver does not provide the signal. Raises a spindle alarm if the spindle is not at speed
+// within SPINDLE_AT_SPEED_TIMEOUT seconds from the start.
+bool spindle_await_at_speed (delaymode_t mode)
+{
+    bool at_speed = true;
+
+    if(spinup.pending) {
+
+        spinup.pending = false;
+
+        if(at_speed_available() && settings.spindle.at_speed_tolerance > 0.0f) {
+            float delay = spinup_time();
+            while(!(at_speed = is_at_speed())) {
+                if(ABORTED || (mode == DelayMode_SysSuspend && state_door_reopened()))
+                    break;
+                if(delay >= SPINDLE_AT_SPEED_TIMEOUT) {
+                    set_state(STATE_ALARM); // Ensure alarm state is active.
+                    report_alarm_message(Alarm_Spindle);
+                    break;
+                }
+                delay_sec(0.1f, mode);
+                delay = hal.get_elapsed_ticks ? spinup_time() : delay + 0.1f;
+            }
+            if(at_speed)
+                report_spinup_time(delay);
+        } else {
+            float delay = hal.get_elapsed_ticks ? spinup_time() : 0.0f;
+            if(delay < spinup.delay)
+                delay_sec(spinup.delay - delay, mode);
+        }
+    }
+
+    return at_speed && !ABORTED;
+}
+
+// G-code parser entry-point for setting spindle state. Forces a planner buffer sync and bails
+// if an abort or check-mode is active. The spin-up is overlapped with any following rapid motions,
+// the first feed motion waits for it to complete.
+bool spindle_sync (spindle_state_t state, float rpm)
+{
+    bool ok = true;
+
+    if (sys.state != STATE_CHECK_MODE) {
+        // Empty planner buffer to ensure spindle is set when programmed.
+        if((ok = protocol_buffer_synchronize()) && (ok = spindle_set_state(state, rpm)))
+            spinup_start(state, SPINDLE_SPINUP_DELAY);
+    }
+#ifdef ENABLE_JOB_ESTIMATE
+    else if(sys.flags.estimate)
+        mc_estimate_spindle(state, rpm, at_speed_available() && settings.spindle.at_speed_tolerance > 0.0f);
+#endif
+
+    return ok;
+}
+
+// Restore spindle running state with direction, enable and spindle RPM. The spin-up delay is
+// awaited by spindle_await_at_speed().
+bool spindle_restore (spindle_state_t state, float rpm)
+{
+    if(settings.mode == Mode_Laser) // When in laser mode, ignore spindle spin-up delay. Set to turn on laser when cycle starts.
+        sys.step_control.update_spindle_rpm = On;
+    else {
+        spindle_set_state(state, rpm);
+        spinup_start(state, SAFETY_DOOR_SPINDLE_DELAY);
+    }
+
+    return !ABORTED;
+}
+
+#else
+
 // G-code parser entry-point for setting spindle state. Forces a planner buffer sync and bails
 // if an abort or check-mode is active.
 bool spindle_sync (spindle_state_t state, float rpm)
 {
     bool ok = true;
-    bool at_speed = sys.state == STATE_CHECK_MODE || !state.on || !hal.driver_cap.spindle_at_speed || settings.spindle.at_speed_tolerance <= 0.0f;
+    bool at_speed = sys.state == STATE_CHECK_MODE || !state.on || !at_speed_available() || settings.spindle.at_speed_tolerance <= 0.0f;
 
     if (sys.state != STATE_CHECK_MODE) {
         // Empty planner buffer to ensure spindle is set when programmed.
         if((ok = protocol_buffer_synchronize()) && spindle_set_state(state, rpm) && !at_speed) {
             float delay = 0.0f;
-            while(!(at_speed = hal.spindle.get_state().at_speed)) {
+            while(!(at_speed = is_at_speed())) {
                 delay_sec(0.1f, DelayMode_Dwell);
                 delay += 0.1f;
                 if(ABORTED)
                     break;
-                if(delay >= SAFETY_DOOR_SPINDLE_DELAY) {
+                if(delay >= SPINDLE_AT_SPEED_TIMEOUT) {
                     set_state(STATE_ALARM); // Ensure alarm state is active.
                     report_alarm_message(Alarm_Spindle);
                     break;
                 }
             }
+            if(at_speed)
+                report_spinup_time(delay);
         }
     }
+#ifdef ENABLE_JOB_ESTIMATE
+    else if(sys.flags.estimate)
+        mc_estimate_spindle(state, rpm, at_speed_available() && settings.spindle.at_speed_tolerance > 0.0f);
+#endif
 
     return ok && at_speed;
 }
@@ -110,21 +261,23 @@ bool spindle_restore (spindle_state_t state, float rpm)
     else { // TODO: add check for current spindle state matches restore state?
         spindle_set_state(state, rpm);
         if(state.on) {
-            if((ok = !hal.driver_cap.spindle_at_speed))
+            if((ok = !at_speed_available()))
                 delay_sec(SAFETY_DOOR_SPINDLE_DELAY, DelayMode_SysSuspend);
             else if((ok == (settings.spindle.at_speed_tolerance <= 0.0f))) {
                 float delay = 0.0f;
-                while(!(ok = hal.spindle.get_state().at_speed)) {
+                while(!(ok = is_at_speed())) {
                     delay_sec(0.1f, DelayMode_SysSuspend);
                     delay += 0.1f;
                     if(ABORTED)
                         break;
-                    if(delay >= SAFETY_DOOR_SPINDLE_DELAY) {
+                    if(delay >= SPINDLE_AT_SPEED_TIMEOUT) {
                         set_state(STATE_ALARM); // Ensure alarm state is active.
                         report_alarm_message(Alarm_Spindle);
                         break;
                     }
                 }
+                if(ok)
+                    report_spinup_time(delay);
             }
         }
     }
@@ -132,6 +285,19 @@ bool spindle_restore (spindle_state_t state, float rpm)
     return ok;
 }
 
+#endif // ENABLE_ASYNC_SPINDLE_START
+
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+
+// Returns true if a spindle speed change may be queued for execution by the stepper driver,
+// not if the spindle is to be waited for until it is at the new speed.
+bool spindle_rpm_change_is_queueable (void)
+{
+    return !(at_speed_available() && settings.spindle.at_speed_tolerance > 0.0f);
+}
+
+#endif
+
 // Calculate and set programmed RPM according to override and max/min limits
 float spindle_set_rpm (float rpm, uint8_t override_pct)
 {
@@ -188,6 +354,23 @@ bool spindle_precompute_pwm_values (spindle_pwm_t *pwm_data, uint32_t clock_hz)
     }
 #endif
 
+#ifdef ENABLE_SPINDLE_PWM_LUT
+    pwm_data->lut_scale = 0.0f; // Compute the table entries without the table.
+
+    if(settings.spindle.rpm_max > settings.spindle.rpm_min) {
+
+        uint_fast16_t entry;
+        float step = (settings.spindle.rpm_max - settings.spindle.rpm_min) / (float)SPINDLE_PWM_LUT_SIZE;
+
+        pwm_data->lut[0] = invert_pwm(pwm_data, pwm_data->min_value);
+        for(entry = 1; entry <= SPINDLE_PWM_LUT_SIZE; entry++)
+            pwm_data->lut[entry] = spindle_compute_pwm_value(pwm_data, settings.spindle.rpm_min + step * (float)entry, false);
+
+        pwm_data->lut_rpm_min = settings.spindle.rpm_min;
+        pwm_data->lut_scale = 256.0f / step;
+    }
+#endif
+
     return settings.spindle.rpm_max > settings.spindle.rpm_min;
 }
 
@@ -197,6 +380,10 @@ uint_fast16_t spindle_compute_pwm_value (spindle_pwm_t *pwm_data, float rpm, boo
     uint_fast16_t pwm_value;
 
     if(rpm > settings.spindle.rpm_min) {
+      #ifdef ENABLE_SPINDLE_PWM_LUT
+        if(!pid_limit && pwm_data->lut_scale > 0.0f)
+            return spindle_lut_pwm_value(pwm_data, rpm);
+      #endif
       #ifdef ENABLE_SPINDLE_LINEARIZATION
         // Compute intermediate PWM value with linear spindle speed model via piecewise linear fit model.
         uint_fast8_t idx = pwm_data->n_pieces;
@@ -225,3 +412,41 @@ uint_fast16_t spindle_compute_pwm_value (spindle_pwm_t *pwm_data, float rpm, boo
 
     return pwm_value;
 }
+
+// Least squares fit of the encoder interrupt timestamps against the interrupt number, used for
+// velocity estimates and position extrapolation that are less affected by timestamp jitter than
+// the last interval alone. Returns false if less than two timestamps are available, else period is
+// set to the fitted timer tics between interrupts and last to the fitted timer value at the last interrupt.
+// NOTE: May be called from interrupt context, the timestamps are copied again if updated while copying.
+bool spindle_encoder_fit_edges (spindle_encoder_edges_t *edges, float *period, uint32_t *last)
+{
+    uint32_t count, t0, timestamp[SPINDLE_ENCODER_EDGES];
+    uint_fast8_t idx, n;
+
+    do {
+        count = edges->count;
+        for(idx = 0; idx < SPINDLE_ENCODER_EDGES; idx++)
+            timestamp[idx] = edges->timestamp[idx];
+    } while(count != edges->count);
+
+    if((n = count < SPINDLE_ENCODER_EDGES ? count : SPINDLE_ENCODER_EDGES) < 2)
+        return false;
+
+    float t, sum_k = 0.0f, sum_kk = 0.0f, sum_t = 0.0f, sum_kt = 0.0f, offset;
+
+    t0 = timestamp[(count - n) % SPINDLE_ENCODER_EDGES];
+
+    for(idx = 0; idx < n; idx++) {
+        t = (float)(timestamp[(count - n + idx) % SPINDLE_ENCODER_EDGES] - t0); // Unsigned difference handles timer wraparound.
+        sum_k += (float)idx;
+        sum_kk += (float)(idx * idx);
+        sum_t += t;
+        sum_kt += (float)idx * t;
+    }
+
+    *period = ((float)n * sum_kt - sum_k * sum_t) / ((float)n * sum_kk - sum_k * sum_k);
+    offset = (sum_t - *period * sum_k) / (float)n + *period * (float)(n - 1);
+    *last = t0 + (uint32_t)(offset > 0.0f ? offset : 0.0f);
+
+    return *period > 0.0f;
+}
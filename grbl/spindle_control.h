@@ -45,6 +45,12 @@ typedef struct {
     float end;
 } pwm_piece_t;
 
+#ifdef ENABLE_SPINDLE_PWM_LUT
+#ifndef SPINDLE_PWM_LUT_SIZE
+#define SPINDLE_PWM_LUT_SIZE 64 // Number of RPM intervals in the PWM lookup table.
+#endif
+#endif
+
 // Precalculated values that may be set/used by HAL driver to speed up RPM to PWM conversions if variable spindle is supported
 typedef struct {
     uint_fast16_t period;
@@ -56,8 +62,29 @@ typedef struct {
     bool always_on;
     uint_fast16_t n_pieces;
     pwm_piece_t piece[SPINDLE_NPWM_PIECES];
+#ifdef ENABLE_SPINDLE_PWM_LUT
+    float lut_rpm_min;
+    float lut_scale;                        // Table intervals per RPM in 24.8 fixed point, 0 if the table is not valid.
+    uint16_t lut[SPINDLE_PWM_LUT_SIZE + 1]; // PWM values at evenly spaced RPMs from rpm_min to rpm_max.
+#endif
 } spindle_pwm_t;
 
+#ifdef ENABLE_SPINDLE_PWM_LUT
+
+// Returns the PWM value for an RPM above rpm_min from the lookup table built by spindle_precompute_pwm_values(),
+// linearly interpolated between the table entries. RPMs above rpm_max return the rpm_max value.
+static inline uint_fast16_t spindle_lut_pwm_value (spindle_pwm_t *pwm_data, float rpm)
+{
+    uint32_t pos = (uint32_t)((rpm - pwm_data->lut_rpm_min) * pwm_data->lut_scale), idx = pos >> 8;
+
+    if(idx >= SPINDLE_PWM_LUT_SIZE)
+        return pwm_data->lut[SPINDLE_PWM_LUT_SIZE];
+
+    return (uint_fast16_t)((int32_t)pwm_data->lut[idx] + ((((int32_t)pwm_data->lut[idx + 1] - (int32_t)pwm_data->lut[idx]) * (int32_t)(pos & 0xFF)) >> 8));
+}
+
+#endif
+
 // Used when HAL driver supports spindle synchronization
 typedef struct {
     volatile uint32_t index_count;
@@ -94,6 +121,31 @@ float spindle_set_rpm (float rpm, uint8_t speed_override);
 // Restore spindle running state with direction, enable, spindle RPM and appropriate delay.
 bool spindle_restore (spindle_state_t state, float rpm);
 
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+// Returns true if a spindle speed change does not have to wait for the spindle to come up to speed.
+bool spindle_rpm_change_is_queueable (void);
+#endif
+
+// Time in seconds allowed for the spindle to reach the programmed speed when monitored, by the at speed
+// signal or RPM feedback, before a spindle alarm is raised.
+#ifndef SPINDLE_AT_SPEED_TIMEOUT
+#define SPINDLE_AT_SPEED_TIMEOUT SAFETY_DOOR_SPINDLE_DELAY
+#endif
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+
+// Time in seconds allowed for the spindle to reach the programmed speed when the driver does not
+// provide an at speed signal.
+#ifndef SPINDLE_SPINUP_DELAY
+#define SPINDLE_SPINUP_DELAY SAFETY_DOOR_SPINDLE_DELAY
+#endif
+
+// Waits for a spin-up started by spindle_sync() or spindle_restore() to complete, called before
+// motions requiring the spindle at speed are executed. Returns false on abort or spindle alarm.
+bool spindle_await_at_speed (delaymode_t mode);
+
+#endif
+
 //
 // The following functions are not called by the core, may be called by driver code.
 //
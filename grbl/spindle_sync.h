@@ -28,6 +28,10 @@
 
 #include "pid.h"
 
+#ifndef SPINDLE_ENCODER_EDGES
+#define SPINDLE_ENCODER_EDGES 8 // Number of encoder interrupt timestamps used for the velocity estimate (2 - 32).
+#endif
+
 // Free running timer log data.
 // The free running timer is used to timestamp pulse events from the encoder.
 typedef struct {
@@ -48,6 +52,15 @@ typedef struct {
     uint32_t tics_per_irq;          // Counts per interrupt generated (prescaler value)
 } spindle_encoder_counter_t;
 
+// Ring buffer of free running timer values at the last encoder pulse interrupts,
+// used for a least squares estimate of the time between interrupts.
+// The driver interrupt handler adds a timestamp by:
+// edges.timestamp[edges.count % SPINDLE_ENCODER_EDGES] = timer value; edges.count++;
+typedef struct {
+    volatile uint32_t count;                            // Number of timestamps added since reset
+    volatile uint32_t timestamp[SPINDLE_ENCODER_EDGES]; // Timer values, indexed by count modulo SPINDLE_ENCODER_EDGES
+} spindle_encoder_edges_t;
+
 typedef struct {
     uint32_t ppr;                       // Encoder pulses per revolution
     float rpm_factor;                   // Inverse of event timer tics per RPM
@@ -55,6 +68,7 @@ typedef struct {
     uint32_t maximum_tt;                // Maximum timer tics since last spindle encoder pulse before RPM = 0 is returned
     spindle_encoder_timer_t timer;      // Event timestamps
     spindle_encoder_counter_t counter;  // Encoder event counts
+    spindle_encoder_edges_t edges;      // Encoder event timestamps for velocity estimate
 } spindle_encoder_t;
 
 typedef struct {
@@ -64,6 +78,9 @@ typedef struct {
     int32_t min_cycles_per_tick;    // Minimum cycles per tick for PID loop
     uint_fast8_t segment_id;        // Used for detecing start of new segment
     pidf_t pid;                     // PID data for position
+#ifdef SPINDLE_SYNC_PID_FIXED
+    pidq_t pidq;                    // Fixed point PID data for position, in 1/256 steps
+#endif
     stepper_pulse_start_ptr stepper_pulse_start_normal; // Driver pulse function to restore after spindle sync move is completed
 #ifdef PID_LOG
     int32_t log[PID_LOG];
@@ -71,4 +88,6 @@ typedef struct {
 #endif
 } spindle_sync_t;
 
+bool spindle_encoder_fit_edges (spindle_encoder_edges_t *edges, float *period, uint32_t *last);
+
 #endif
@@ -43,11 +43,11 @@ static void state_restore (uint_fast16_t rt_exec);
 static void state_await_resumed (uint_fast16_t rt_exec);
 static void state_await_restore (uint_fast16_t rt_exec);
 
-static void (* volatile stateHandler)(uint_fast16_t rt_exec) = state_idle;
+static THREAD_LOCAL void (* volatile stateHandler)(uint_fast16_t rt_exec) = state_idle;
 
-static float restore_spindle_rpm;
-static planner_cond_t restore_condition;
-static uint_fast16_t pending_state = STATE_IDLE;
+static THREAD_LOCAL float restore_spindle_rpm;
+static THREAD_LOCAL planner_cond_t restore_condition;
+static THREAD_LOCAL uint_fast16_t pending_state = STATE_IDLE;
 
 typedef struct {
     float target[N_AXIS];
@@ -59,7 +59,41 @@ typedef struct {
 } parking_data_t;
 
 // Declare and initialize parking local variables
-static parking_data_t park;
+static THREAD_LOCAL parking_data_t park;
+
+#ifdef ENABLE_ASYNC_SPINDLE_START
+
+static THREAD_LOCAL bool coolant_pending = false;
+static THREAD_LOCAL uint32_t coolant_restored;
+
+// Restores the coolant state, the delay is awaited by state_await_restored().
+static void restore_coolant (coolant_state_t state)
+{
+    coolant_set_state(state);
+    coolant_pending = true;
+    coolant_restored = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+}
+
+// Waits for the spindle and coolant restored by state_restore_conditions() to power up.
+static void state_await_restored (void)
+{
+    if(spindle_await_at_speed(DelayMode_SysSuspend) && coolant_pending) {
+        float delay = hal.get_elapsed_ticks ? (float)(hal.get_elapsed_ticks() - coolant_restored) / 1000.0f : 0.0f;
+        if(delay < SAFETY_DOOR_COOLANT_DELAY)
+            delay_sec(SAFETY_DOOR_COOLANT_DELAY - delay, DelayMode_SysSuspend);
+    }
+    coolant_pending = false;
+}
+
+#else
+
+static inline void restore_coolant (coolant_state_t state)
+{
+    coolant_set_state(state);
+    delay_sec(SAFETY_DOOR_COOLANT_DELAY, DelayMode_SysSuspend);
+}
+
+#endif
 
 static void state_restore_conditions (planner_cond_t *condition, float rpm)
 {
@@ -70,14 +104,32 @@ static void state_restore_conditions (planner_cond_t *condition, float rpm)
         // Block if safety door re-opened during prior restore actions.
         if (gc_state.modal.coolant.value != hal.coolant.get_state().value) {
             // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by this pin.
-            coolant_set_state(condition->coolant);
-            delay_sec(SAFETY_DOOR_COOLANT_DELAY, DelayMode_SysSuspend);
+            restore_coolant(condition->coolant);
         }
 
         sys.override.spindle_stop.value = 0; // Clear spindle stop override states
     }
 }
 
+// Plans the parking retract while the hold is decelerating. The prepared block is used when the retract is
+// started if the deceleration did not move the parking axis, see plan_prepare_system_motion().
+static void prepare_retract (void)
+{
+    float target[N_AXIS], waypoint;
+
+    system_convert_array_steps_to_mpos(target, sys_position);
+    waypoint = min(target[settings.parking.axis] + settings.parking.pullout_increment, settings.parking.target);
+
+    if (bit_istrue(sys.homed.mask, bit(settings.parking.axis)) && target[settings.parking.axis] < waypoint && settings.mode != Mode_Laser && !sys.override.control.parking_disable) {
+        target[settings.parking.axis] = waypoint;
+        park.plan_data.feed_rate = settings.parking.pullout_rate;
+        park.plan_data.condition.coolant = restore_condition.coolant;
+        park.plan_data.condition.spindle = restore_condition.spindle;
+        park.plan_data.spindle.rpm = restore_spindle_rpm;
+        plan_prepare_system_motion(target, &park.plan_data);
+    }
+}
+
 bool initiate_hold (uint_fast16_t new_state)
 {
     if(settings.parking.flags.enabled) {
@@ -106,6 +158,8 @@ bool initiate_hold (uint_fast16_t new_state)
         st_update_plan_block_parameters();  // Notify stepper module to recompute for hold deceleration.
         sys.step_control.execute_hold = On; // Initiate suspend state with active flag.
         stateHandler = state_await_hold;
+        if(new_state != STATE_HOLD && settings.parking.flags.enabled && !park.restart_retract)
+            prepare_retract();
     }
 
     if(new_state == STATE_HOLD)
@@ -151,11 +205,16 @@ void set_state (uint_fast16_t new_state)
                 if(sys.state == STATE_IDLE) {
                     // Start cycle only if queued motions exist in planner buffer and the motion is not canceled.
                     plan_block_t *block;
+#ifdef ENABLE_PVT_STREAM
+                    // Streamed trajectory segments are queued directly in the segment buffer.
+                    if ((block = plan_get_current_block()) || st_segments_queued()) {
+#else
                     if ((block = plan_get_current_block())) {
+#endif
                         sys.state = new_state;
                         sys.steppers_deenergize = false;    // Cancel stepper deenergize if pending.
                         st_prep_buffer();                   // Initialize step segment buffer before beginning cycle.
-                        if(block->condition.spindle.synchronized) {
+                        if(block && block->condition.spindle.synchronized) {
 
                             if(hal.spindle.reset_data)
                                 hal.spindle.reset_data();
@@ -284,8 +343,12 @@ static void state_cycle (uint_fast16_t rt_exec)
     if ((rt_exec & EXEC_TOOL_CHANGE))
         hal.stream.suspend_read(true); // Block reading from input stream until tool change state is acknowledged
 
-    if (rt_exec & EXEC_CYCLE_COMPLETE)
+    if (rt_exec & EXEC_CYCLE_COMPLETE) {
+#ifdef GC_QUEUED_STATE
+        gc_flush_queued_state(); // Changes following the last motion.
+#endif
         set_state(gc_state.tool_change ? STATE_TOOL_CHANGE : STATE_IDLE);
+    }
 
     if (rt_exec & EXEC_MOTION_CANCEL) {
         st_update_plan_block_parameters();  // Notify stepper module to recompute for hold deceleration.
@@ -454,6 +517,10 @@ static void state_await_resume (uint_fast16_t rt_exec)
                     if (park.retracting) {
                         handler_changed = true;
                         stateHandler = state_restore;
+#ifdef ENABLE_ASYNC_SPINDLE_START
+                        // Power up spindle and coolant during the fast restore motion, awaited before the plunge.
+                        state_restore_conditions(&restore_condition, restore_spindle_rpm);
+#endif
                         // Check to ensure the motion doesn't move below pull-out position.
                         if (park.target[settings.parking.axis] <= settings.parking.target) {
                             park.target[settings.parking.axis] = park.retract_waypoint;
@@ -463,10 +530,14 @@ static void state_await_resume (uint_fast16_t rt_exec)
                         } else // tell next handler to proceed with final step immediately
                             stateHandler(EXEC_CYCLE_COMPLETE);
                     }
-                } else
+                } else {
                     // Delayed Tasks: Restart spindle and coolant, delay to power-up, then resume cycle.
                     // Block if safety door re-opened during prior restore actions.
                     state_restore_conditions(&restore_condition, restore_spindle_rpm);
+#ifdef ENABLE_ASYNC_SPINDLE_START
+                    state_await_restored();
+#endif
+                }
                 break;
 
             default:
@@ -497,7 +568,7 @@ static void state_await_resume (uint_fast16_t rt_exec)
 
 static void state_await_restore (uint_fast16_t rt_exec)
 {
-    static bool restart = false;
+    static THREAD_LOCAL bool restart = false;
 
     if(rt_exec == 0) {
 
@@ -510,10 +581,13 @@ static void state_await_restore (uint_fast16_t rt_exec)
 
         if (restore_condition.coolant.value != hal.coolant.get_state().value) {
             // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by this pin.
-            coolant_set_state(restore_condition.coolant);
-            delay_sec(SAFETY_DOOR_COOLANT_DELAY, DelayMode_SysSuspend);
+            restore_coolant(restore_condition.coolant);
         }
 
+#ifdef ENABLE_ASYNC_SPINDLE_START
+        state_await_restored();
+#endif
+
         sys.override.spindle_stop.value = 0; // Clear spindle stop override states
 
         grbl.report.feedback_message(Message_None);
@@ -620,7 +694,11 @@ static void state_restore (uint_fast16_t rt_exec)
         // Delayed Tasks: Restart spindle and coolant, delay to power-up, then resume cycle.
         // Block if safety door re-opened during prior restore actions.
         if(sys.parking_state != Parking_Cancel)
+#ifdef ENABLE_ASYNC_SPINDLE_START
+            state_await_restored(); // Restore was started with the fast restore motion.
+#else
             state_restore_conditions(&restore_condition, restore_spindle_rpm);
+#endif
 
         park.restart_retract = false;
         sys.parking_state = Parking_Resuming;
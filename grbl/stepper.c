@@ -27,6 +27,16 @@
 
 #include "hal.h"
 #include "protocol.h"
+#include "profile.h"
+#ifdef ENABLE_FLIGHT_RECORDER
+#include "flightrec.h"
+#endif
+#ifdef ENABLE_LINE_TIMING
+#include "linetime.h"
+#endif
+#ifdef ENABLE_NVS_CHECKPOINT
+#include "checkpoint.h"
+#endif
 
 //#include "debug.h"
 
@@ -38,6 +48,11 @@
 #define DT_SEGMENT (1.0f/(ACCELERATION_TICKS_PER_SECOND*60.0f)) // min/segment
 #define REQ_MM_INCREMENT_SCALAR 1.25f
 
+#ifdef SEGMENT_BUFFER_TIME
+#define DT_BUFFER (SEGMENT_BUFFER_TIME / 60000.0f) // Buffered motion time target (min)
+#define DT_SEGMENT_CRUISE max(DT_SEGMENT, DT_BUFFER / (float)(SEGMENT_BUFFER_SIZE - 1)) // Max cruising segment time (min)
+#endif
+
 typedef enum {
     Ramp_Accel,
     Ramp_Cruise,
@@ -62,16 +77,16 @@ typedef union {
 // NOTE: This data is copied from the prepped planner blocks so that the planner blocks may be
 // discarded when entirely consumed and completed by the segment buffer. Also, AMASS alters this
 // data for its own use.
-static st_block_t st_block_buffer[SEGMENT_BUFFER_SIZE - 1];
+static THREAD_LOCAL st_block_t st_block_buffer[SEGMENT_BUFFER_SIZE - 1];
 
 // Primary stepper segment ring buffer. Contains small, short line segments for the stepper
 // algorithm to execute, which are "checked-out" incrementally from the first block in the
 // planner buffer. Once "checked-out", the steps in the segments buffer cannot be modified by
 // the planner, where the remaining planner block steps still can.
-static segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
+static THREAD_LOCAL segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
 
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
-static stepper_t st;
+static THREAD_LOCAL stepper_t st;
 
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
 typedef struct {
@@ -80,30 +95,180 @@ typedef struct {
     uint32_t level_3;
 } amass_t;
 
-static amass_t amass;
+static THREAD_LOCAL amass_t amass;
+#endif
+
+#ifdef ENABLE_STEP_BURST
+#ifndef STEP_BURST_RATE
+#define STEP_BURST_RATE 40000 // Hz
+#endif
+
+static THREAD_LOCAL uint32_t step_burst_cycles; // Timer ticks per step below which burst mode is used
+#endif
+
+#if defined(ENABLE_LASER_POWER_RAMP) && !defined(SPINDLE_PWM_DIRECT)
+#undef ENABLE_LASER_POWER_RAMP
+#endif
+
+#ifdef ENABLE_LASER_POWER_RAMP
+#ifndef LASER_POWER_RAMP_STEPS
+#define LASER_POWER_RAMP_STEPS 4
+#endif
+#endif
+
+
+#ifndef MESSAGE_QUEUE_SIZE
+#define MESSAGE_QUEUE_SIZE 8 // Max number of messages queued for output, less one
+#endif
+
+// Queue of messages to be output by foreground process, single producer (stepper ISR) single consumer (foreground).
+static THREAD_LOCAL struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    char *message[MESSAGE_QUEUE_SIZE];
+} messages = {0};
+
+#ifndef STEPPER_SEGMENT_HOOKS
+#define STEPPER_SEGMENT_HOOKS 4 // Max number of segment hooks
+#endif
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+#ifndef MICROSTEP_SWITCH_RATE
+#define MICROSTEP_SWITCH_RATE 40000.0f // Max step rate (steps/s) of the most moving axis before the microstep resolution is reduced.
+#endif
+#ifndef MICROSTEP_SWITCH_HYSTERESIS
+#define MICROSTEP_SWITCH_HYSTERESIS 0.8f // Factor applied to the step rate threshold while running at reduced resolution.
+#endif
+#endif
+
+static THREAD_LOCAL struct {
+    uint_fast8_t count;
+    stepper_segment_hook_ptr hook[STEPPER_SEGMENT_HOOKS];
+} segment_hooks = {0};
+
+#ifdef ENABLE_STEPPER_STATS
+// Execution time statistics, updated only when the driver provides a cycle counter.
+static THREAD_LOCAL st_stats_t stats = { .isr.min = UINT32_MAX, .prep.min = UINT32_MAX, .pulse.min = UINT32_MAX };
+ISR_CODE static inline void stats_add (st_cycles_t *cycles, uint32_t count);
 #endif
 
-// Message to be output by foreground process
-static char *message = NULL; // TODO: do we need a queue for this?
+// Log of segment buffer underruns.
+static THREAD_LOCAL st_underruns_t underruns = {0};
+ISR_CODE static void underrun_add (void);
+
+#ifdef ENABLE_MOTION_BENCHMARK
+static THREAD_LOCAL volatile bool steps_masked = false; // Step outputs masked off, see st_mask_steps()
+#endif
+
+#ifdef ENABLE_STEP_INJECTION
+
+#ifndef STEP_INJECTION_AXIS
+#define STEP_INJECTION_AXIS Z_AXIS
+#endif
+
+// Step injection channel, steps are queued by the foreground process and output by the stepper ISR.
+static THREAD_LOCAL struct {
+    volatile int32_t pending;   // Signed number of steps to inject
+    uint32_t min_cycles;        // Min step timer cycles between injected steps
+    uint32_t cycles;            // Step timer cycles since last injected step
+    float rate;                 // Max injection rate (mm/min), 0 for axis max rate
+} injection = {0};
+
+// Updates the min step timer cycles between injected steps from the injection rate or the axis max rate.
+static void injection_update_rate (void)
+{
+    float rate = injection.rate > 0.0f ? min(injection.rate, settings.axis[STEP_INJECTION_AXIS].max_rate) : settings.axis[STEP_INJECTION_AXIS].max_rate;
+
+    injection.min_cycles = (uint32_t)ceilf((float)hal.f_step_timer * 60.0f / (rate * settings.axis[STEP_INJECTION_AXIS].steps_per_mm));
+}
+
+#endif
+
+#if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+
+// Backlash compensation by the stepper ISR, steps are output on direction reversals in addition to the block steps.
+static THREAD_LOCAL struct {
+    axes_signals_t enabled;         // Axes with backlash compensation
+    axes_signals_t dir_negative;    // Direction of the last motion of each axis
+    axes_signals_t active;          // Axes with pending steps moved by the executing block
+    uint32_t steps[N_AXIS];         // Backlash (steps)
+    uint32_t pending[N_AXIS];       // Steps left to output
+    uint32_t min_cycles[N_AXIS];    // Min step timer cycles between backlash steps, from the axis max rate
+    uint32_t cycles[N_AXIS];        // Step timer cycles since the last backlash step
+} backlash = {0};
+
+#endif
+
+// Segment preparation lock, see st_prep_buffer()
+static THREAD_LOCAL volatile uint_fast8_t prep_lock = 0;
+static THREAD_LOCAL volatile bool prep_deferred = false;
 
 // Stepper timer ticks per minute
-static float cycles_per_min;
+static THREAD_LOCAL float cycles_per_min;
 
 // Step segment ring buffer indices
-static volatile segment_t *segment_buffer_tail;
-static segment_t *segment_buffer_head, *segment_next_head;
+static THREAD_LOCAL volatile segment_t *segment_buffer_tail;
+static THREAD_LOCAL segment_t *segment_buffer_head, *segment_next_head;
+
+#ifdef ENABLE_FLIGHT_RECORDER
+// Returns the number of segments in the segment buffer, including the segment being executed.
+ISR_CODE static inline uint_fast8_t segment_buffer_count (void)
+{
+    int_fast8_t count = (segment_t *)segment_buffer_head - (segment_t *)segment_buffer_tail;
+
+    return count < 0 ? count + SEGMENT_BUFFER_SIZE : count;
+}
+#endif
 
 // Pointers for the step segment being prepped from the planner buffer. Accessed only by the
 // main program. Pointers may be planning segments or planner blocks ahead of what being executed.
-static plan_block_t *pl_block;     // Pointer to the planner block being prepped
-static st_block_t *st_prep_block;  // Pointer to the stepper block data being prepped
+static THREAD_LOCAL plan_block_t *pl_block;     // Pointer to the planner block being prepped
+static THREAD_LOCAL st_block_t *st_prep_block;  // Pointer to the stepper block data being prepped
+
+#ifdef ENABLE_JERK_ACCELERATION
+
+// Jerk limited velocity ramp data. The ramp has a symmetrical acceleration profile, starting and
+// ending at zero acceleration, and has the same duration as a constant acceleration ramp using
+// the planned block acceleration. This ensures the distance traveled is the same as planned.
+typedef struct {
+    float time;          // Time elapsed since start of ramp (min)
+    float duration;      // Ramp duration (min)
+    float jerk_time;     // Duration of the jerk phases at start and end of ramp (min)
+    float jerk;          // Jerk applied during the jerk phases (mm/min^3)
+    float acceleration;  // Peak acceleration (mm/min^2)
+    float start_speed;   // Speed at start of ramp (mm/min)
+    float delta_speed;   // Speed change over ramp (mm/min)
+} jerk_ramp_t;
+
+#elif defined(ENABLE_INPUT_SHAPING)
+
+// Input shaped velocity ramp data. The ramp is a constant acceleration ramp convolved with the input
+// shaper impulses. The duration of the constant acceleration ramp is set such that the distance
+// traveled is the same as planned.
+typedef struct {
+    float time;          // Time elapsed since start of ramp (min)
+    float ramp_time;     // Duration of the constant acceleration ramp (min)
+    float start_speed;   // Speed at start of ramp (mm/min)
+    float delta_speed;   // Speed change over ramp (mm/min)
+    bool shaped;         // False if the ramp is too short to be shaped
+} shaped_ramp_t;
+
+#endif
+
+#if defined(ENABLE_JERK_ACCELERATION) || defined(ENABLE_INPUT_SHAPING)
+#define RAMP_PROFILE // Acceleration and deceleration ramps are computed by ramp_init() and ramp_delta_speed().
+#endif
 
 // Segment preparation data struct. Contains all the necessary information to compute new segments
 // based on the current executing planner block.
 typedef struct {
     prep_flags_t recalculate;
 
-    float dt_remainder;
+#ifdef SEGMENT_PREP_FIXED_POINT
+    uint32_t dt_remainder;  // Execution time of partial step at end of previous segment (cycles)
+#else
+    float dt_remainder;     // Execution time of partial step at end of previous segment (min)
+#endif
     uint32_t steps_remaining;
     float steps_per_mm;
     float req_mm_increment;
@@ -111,7 +276,11 @@ typedef struct {
     st_block_t *last_st_block;
     uint32_t last_steps_remaining;
     float last_steps_per_mm;
+#ifdef SEGMENT_PREP_FIXED_POINT
+    uint32_t last_dt_remainder;
+#else
     float last_dt_remainder;
+#endif
 
     ramp_type_t ramp_type;  // Current segment ramp state
     float mm_complete;      // End of velocity profile from end of current planner block in (mm).
@@ -125,9 +294,37 @@ typedef struct {
     float target_feed;      //
     float inv_feedrate;     // Used by PWM laser mode to speed up segment calculations.
     float current_spindle_rpm;
+#ifdef ENABLE_STOP_DECELERATION
+    float deceleration;     // Deceleration of deceleration ramps, the stop deceleration when forced (mm/min^2)
+#endif
+#ifdef ENABLE_JERK_ACCELERATION
+    jerk_ramp_t ramp;       // Current jerk limited acceleration or deceleration ramp
+#elif defined(ENABLE_INPUT_SHAPING)
+    shaped_ramp_t ramp;     // Current input shaped acceleration or deceleration ramp
+    input_shaper_t shaper;  // Input shaper for the prepped planner block
+#endif
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    uint_fast8_t microstep_shift;           // Microstep resolution divider of the last stepper block prepped
+    uint32_t steps[N_AXIS];                 // Step counts of the stepper block being prepped, in units of 2^microstep_shift microsteps
+    int32_t microstep_carry[N_AXIS];        // Executed less planned position from rounding to coarse steps (microsteps)
+    axes_signals_t direction_bits;          // Direction bits of the stepper block being prepped, may differ from the planner block when the carry is made up
+#endif
+#ifdef ENABLE_ARC_BLOCKS
+    struct {
+        bool first;             // The first segment uses the stepper block loaded with the planner block.
+        int32_t position[3];    // End position of the last chord prepped, axis 0, axis 1 and the helical axis (steps).
+        float dt;               // Time of segments without steps, carried over to the next segment (min).
+    } arc;
+#endif
 } st_prep_t;
 
-static st_prep_t prep;
+static THREAD_LOCAL st_prep_t prep;
+
+#ifdef ENABLE_STOP_DECELERATION
+#define ramp_deceleration(block) prep.deceleration
+#else
+#define ramp_deceleration(block) (block)->acceleration
+#endif
 
 
 /*    BLOCK VELOCITY PROFILE DEFINITION
@@ -170,13 +367,16 @@ static st_prep_t prep;
 
 //
 
-// Output message in sync with motion, called by foreground process.
+// Output messages in sync with motion, called by foreground process.
 static void output_message (uint_fast16_t state)
 {
-    if(message) {
+    char *message;
+
+    while(messages.tail != messages.head) {
+        message = messages.message[messages.tail];
+        messages.tail = (messages.tail + 1) % MESSAGE_QUEUE_SIZE;
         report_message(message, Message_Plain);
-        free(message);
-        message = NULL;
+        gc_message_free(message);
     }
 }
 
@@ -197,6 +397,7 @@ void st_wake_up ()
     // Initialize stepper data to ensure first ISR call does not step and
     // cancel any pending steppers deenergize
     st.exec_block = NULL;
+    st.driver_segment = false;
     sys.steppers_deenergize = false;
 
     hal.stepper.wake_up();
@@ -221,6 +422,184 @@ ISR_CODE void st_go_idle ()
 }
 
 
+// Executes the Bresenham line algorithm for one axis without branching. The step bit is added to
+// step_outbits and the machine position is updated by the signed position delta of the block.
+// NOTE: Expanded once per axis with a constant index to avoid loop overhead in the stepper ISR.
+#define bresenham_step(idx) do { \
+    st.counter[idx] += st.steps[idx]; \
+    step = st.counter[idx] > st.step_event_count; \
+    st.counter[idx] -= st.step_event_count & -step; \
+    sys_position[idx] += st.position_delta[idx] & -(int32_t)step; \
+    step_outbits.mask |= step << idx; \
+} while(0)
+
+// Executes one step event for all axes, returns the step bits to be output.
+ISR_CODE static inline axes_signals_t bresenham_step_event (void)
+{
+    register uint32_t step;
+    register axes_signals_t step_outbits = (axes_signals_t){0};
+
+    bresenham_step(X_AXIS);
+    bresenham_step(Y_AXIS);
+    bresenham_step(Z_AXIS);
+  #ifdef A_AXIS
+    bresenham_step(A_AXIS);
+  #endif
+  #ifdef B_AXIS
+    bresenham_step(B_AXIS);
+  #endif
+  #ifdef C_AXIS
+    bresenham_step(C_AXIS);
+  #endif
+
+    // During a homing cycle, lock out and prevent desired axes from moving.
+    if (sys.state == STATE_HOMING)
+        step_outbits.value &= sys.homing_axis_lock.mask;
+
+    return step_outbits;
+}
+
+// Accounts for the step events of a segment executed by the driver, see hal.stepper.load_segment().
+// An axis steps at most once per step event so the Bresenham counters and the machine position can be
+// advanced for the whole segment at once: an axis with counter c steps (c + n * steps - 1) / step_event_count
+// times in n step events.
+ISR_CODE static void driver_segment_executed (void)
+{
+    uint64_t count;
+    uint32_t steps;
+    uint_fast8_t idx = N_AXIS;
+
+    sys_position_seq++;
+    MEMORY_BARRIER();
+
+    do {
+        idx--;
+        if((count = (uint64_t)st.counter[idx] + (uint64_t)st.step_count * st.steps[idx])) {
+            steps = (uint32_t)((count - 1) / st.step_event_count);
+            st.counter[idx] = (uint32_t)(count - (uint64_t)steps * st.step_event_count);
+            sys_position[idx] += st.position_delta[idx] * (int32_t)steps;
+        }
+    } while(idx);
+
+    MEMORY_BARRIER();
+    sys_position_seq++;
+
+    st.driver_segment = false;
+    st.step_count = 0;
+    st.exec_segment = NULL;
+
+    // Segment is complete. Advance segment tail pointer and request refill of segment buffer.
+    segment_buffer_tail = segment_buffer_tail->next;
+    if(hal.stepper.prep_request)
+        hal.stepper.prep_request();
+}
+
+#ifdef STEP_PHASE_SMOOTHING
+
+// Computes the step pulse delays for the axes to step. After a step the Bresenham counter holds the
+// distance past the ideal step time in units of 1/steps[idx] step events, the pulse is delayed by
+// the remainder of the step event so that all axes step exactly one step event after their ideal step time.
+ISR_CODE static inline void step_phase_delays (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    uint32_t phase;
+
+    do {
+        idx--;
+        if(st.step_outbits.mask & bit(idx)) {
+            phase = (uint32_t)(((uint64_t)(st.steps[idx] - st.counter[idx]) * st.exec_block->step_inv[idx]) >> 16); // 0.16 fixed point
+            st.step_delay[idx] = (uint32_t)(((uint64_t)st.exec_segment->cycles_per_tick * phase) >> 16);
+        }
+    } while(idx);
+}
+
+#endif
+
+#ifdef ENABLE_LASER_POWER_RAMP
+
+// Ramps the laser power every LASER_POWER_RAMP_STEPS step events of segments with a PWM ramp.
+ISR_CODE static inline void laser_power_ramp (uint_fast8_t steps)
+{
+    if(st.exec_segment->spindle_pwm_delta && (st.pwm_ramp_steps += steps) >= LASER_POWER_RAMP_STEPS) {
+        st.spindle_pwm += st.exec_segment->spindle_pwm_delta * (int32_t)(st.pwm_ramp_steps / LASER_POWER_RAMP_STEPS);
+        st.pwm_ramp_steps %= LASER_POWER_RAMP_STEPS;
+        hal.spindle.update_pwm((uint_fast16_t)(st.spindle_pwm >> 8));
+    }
+}
+
+#endif
+
+#ifdef ENABLE_STEP_INJECTION
+
+// Adds an injected step to the step event if due. Direction is changed as needed, this is safe
+// since the step injection axis is not moved by the the block being executed.
+ISR_CODE static inline void step_injection (void)
+{
+    if((injection.cycles += st.exec_segment->cycles_per_tick) >= injection.min_cycles) {
+
+        bool negative = injection.pending < 0;
+
+        if(negative != !!(st.dir_outbits.mask & bit(STEP_INJECTION_AXIS))) {
+            st.dir_outbits.mask ^= bit(STEP_INJECTION_AXIS);
+            st.dir_change = true;
+        }
+
+        st.step_outbits.mask |= bit(STEP_INJECTION_AXIS);
+        sys_position[STEP_INJECTION_AXIS] += negative ? -1 : 1;
+        injection.pending += negative ? 1 : -1;
+        injection.cycles = 0;
+    }
+}
+
+#endif
+
+#if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+
+// Checks the new block for direction reversals of axes with backlash compensation. The backlash of reversed
+// axes is queued for output, if the previous backlash is not yet taken up only the part output is queued.
+// NOTE: st.dir_change cannot be used alone since blocks not moving an axis may change its direction bit.
+ISR_CODE static inline void backlash_block_start (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    axes_signals_t reversed;
+
+    backlash.active.mask = 0;
+
+    do {
+        idx--;
+        if((backlash.enabled.mask & bit(idx)) && st.exec_block->steps[idx]) {
+            reversed.mask = (st.dir_outbits.mask ^ backlash.dir_negative.mask) & bit(idx);
+            if(reversed.mask) {
+                backlash.dir_negative.mask ^= reversed.mask;
+                backlash.pending[idx] = backlash.steps[idx] - backlash.pending[idx];
+                backlash.cycles[idx] = 0;
+            }
+            if(backlash.pending[idx])
+                backlash.active.mask |= bit(idx);
+        }
+    } while(idx);
+}
+
+// Adds backlash steps to the step event if due, for axes not stepped by the event. Machine position is not changed.
+ISR_CODE static inline void backlash_step (void)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        if(backlash.active.mask & bit(idx)) {
+            if((backlash.cycles[idx] += st.exec_segment->cycles_per_tick) >= backlash.min_cycles[idx] && !(st.step_outbits.mask & bit(idx))) {
+                st.step_outbits.mask |= bit(idx);
+                backlash.cycles[idx] = 0;
+                if(--backlash.pending[idx] == 0)
+                    backlash.active.mask &= ~bit(idx);
+            }
+        }
+    } while(idx);
+}
+
+#endif
+
 /* "The Stepper Driver Interrupt" - This timer interrupt is the workhorse of Grbl. Grbl employs
    the venerable Bresenham line algorithm to manage and exactly synchronize multi-axis moves.
    Unlike the popular DDA algorithm, the Bresenham algorithm is not susceptible to numerical
@@ -265,17 +644,33 @@ ISR_CODE void st_go_idle ()
    which for Grbl must be less than 33.3usec (@30kHz ISR rate). Oscilloscope measured time in
    ISR is 5usec typical and 25usec maximum, well below requirement.
    NOTE: This ISR expects at least one step to be executed per segment.
+   NOTE: Enable ENABLE_STEPPER_STATS in config.h to measure the actual execution time.
 */
+#ifdef ENABLE_STEPPER_STATS
+ISR_CODE static inline void stepper_isr (void)
+#else
 ISR_CODE void stepper_driver_interrupt_handler (void)
+#endif
 {
-#ifdef ENABLE_BACKLASH_COMPENSATION
-    static bool backlash_motion;
+    // Account for the steps of a segment executed by the driver or
+    // start a step pulse when there is a block to execute.
+    if(st.driver_segment)
+        driver_segment_executed();
+    else if(st.exec_block) {
+
+#ifdef ENABLE_MOTION_BENCHMARK
+        if(steps_masked)
+            st.step_outbits.value = 0;
 #endif
 
-    // Start a step pulse when there is a block to execute.
-    if(st.exec_block) {
-
-        hal.stepper.pulse_start(&st);
+#ifdef ENABLE_STEPPER_STATS
+        if(hal.get_cycle_count) {
+            uint32_t start = hal.get_cycle_count();
+            hal_stepper_pulse_start(&st);
+            stats_add(&stats.pulse, hal.get_cycle_count() - start);
+        } else
+#endif
+        hal_stepper_pulse_start(&st);
 
         st.new_block = st.dir_change = false;
 
@@ -291,8 +686,22 @@ ISR_CODE void stepper_driver_interrupt_handler (void)
             // Initialize new step segment and load number of steps to execute
             st.exec_segment = (segment_t *)segment_buffer_tail;
 
+#ifdef ENABLE_MICROSTEP_SWITCHING
+            // Switch the microstep resolution before the first step of a block executed at a different resolution.
+            // If the driver is busy the step output is paused until the next interrupt.
+            if(st.exec_segment->exec_block->microstep_shift != st.microstep_shift) {
+                if(!hal.stepper.set_microstep_shift(st.exec_segment->exec_block->microstep_shift)) {
+                    st.exec_segment = NULL;
+                    st.step_outbits.value = 0;
+                    st.burst_steps = 0;
+                    return;
+                }
+                st.microstep_shift = st.exec_segment->exec_block->microstep_shift;
+            }
+#endif
+
             // Initialize step segment timing per step and load number of steps to execute.
-            hal.stepper.cycles_per_tick(st.exec_segment->cycles_per_tick);
+            hal_stepper_cycles_per_tick(st.exec_segment->cycles_per_tick);
             st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
 
             // If the new segment starts a new planner block, initialize stepper variables and counters.
@@ -303,79 +712,148 @@ ISR_CODE void stepper_driver_interrupt_handler (void)
                 st.exec_block = st.exec_segment->exec_block;
                 st.step_event_count = st.exec_block->step_event_count;
                 st.new_block = true;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-                backlash_motion = st.exec_block->backlash_motion;
+
+#ifdef ENABLE_LINE_TIMING
+                linetime_block_started(st.exec_block->line_number);
+#endif
+#ifdef ENABLE_NVS_CHECKPOINT
+                checkpoint_block_started(st.exec_block->checkpoint);
 #endif
 
                 if(st.exec_block->overrides.sync)
                     sys.override.control = st.exec_block->overrides;
 
-                // Execute output commands to be syncronized with motion
-                while(st.exec_block->output_commands) {
-                    output_command_t *cmd = st.exec_block->output_commands;
-                    cmd->is_executed = true;
-                    if(cmd->is_digital)
-                        hal.port.digital_out(cmd->port, cmd->value != 0.0f);
-                    else
-                        hal.port.analog_out(cmd->port, cmd->value);
-                    st.exec_block->output_commands = cmd->next;
+#ifdef ENABLE_PROBE_QUEUING
+                // Activate probing when a queued probe motion is started, cancel the motion if the probe
+                // is already triggered or not connected.
+                if(st.exec_block->probing && sys_probing_state == Probing_Queued) {
+                    probe_state_t probe = hal_probe_get_state();
+                    if(probe.triggered || !probe.connected) {
+                        sys_probing_state = Probing_FailInit;
+                        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+                    } else
+                        sys_probing_state = Probing_Active;
                 }
+#endif
 
-                // Enqueue any message to be printed (by foreground process)
+                // Execute output commands to be syncronized with motion.
+                // The commands are freed by st_prep_buffer() when the block is reused.
+                output_command_t *cmd = st.exec_block->output_commands;
+                while(cmd) {
+                    if(!cmd->is_executed) {
+                        cmd->is_executed = true;
+                        if(cmd->is_digital)
+                            hal.port.digital_out(cmd->port, cmd->value != 0.0f);
+                        else
+                            hal.port.analog_out(cmd->port, cmd->value);
+                    }
+                    cmd = cmd->next;
+                }
+
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+                // Set queued coolant state, spindle RPM changes are output with the first segment of the block.
+                if(st.exec_block->coolant_change) {
+                    st.exec_block->coolant_change = false;
+                    hal.coolant.set_state(st.exec_block->coolant);
+                    sys.report.coolant = On;
+                }
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+                if(st.exec_block->wco_change) {
+                    st.exec_block->wco_change = false;
+                    gc_wco_change_started();
+                }
+#endif
+
+                // Enqueue any message to be printed (by foreground process).
+                // If the queue is full the message is left in the block and freed by st_prep_buffer() when the block is reused.
                 if(st.exec_block->message) {
-                    if(message == NULL) {
-                        message = st.exec_block->message;
-                        protocol_enqueue_rt_command(output_message);
-                    } else
-                        free(st.exec_block->message); //
-                    st.exec_block->message = NULL;
+                    uint_fast8_t head = messages.head, next = (head + 1) % MESSAGE_QUEUE_SIZE;
+                    if(next != messages.tail) {
+                        messages.message[head] = st.exec_block->message;
+                        messages.head = next;
+                        st.exec_block->message = NULL;
+                        if(head == messages.tail) // Queue was empty, request output.
+                            protocol_enqueue_rt_command(output_message);
+                    }
                 }
 
                 // Initialize Bresenham line and distance counters
-                st.counter_x = st.counter_y = st.counter_z
-                #ifdef A_AXIS
-                  = st.counter_a
-                #endif
-                #ifdef B_AXIS
-                  = st.counter_b
-                #endif
-                #ifdef C_AXIS
-                  = st.counter_c
-                #endif
-                  = st.step_event_count >> 1;
+                uint_fast8_t idx = N_AXIS;
+                do {
+                    st.counter[--idx] = st.step_event_count >> 1;
+                } while(idx);
+
+                memcpy(st.position_delta, st.exec_block->position_delta, sizeof(st.position_delta));
 
               #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
                 memcpy(st.steps, st.exec_block->steps, sizeof(st.steps));
               #endif
+
+              #if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+                if(backlash.enabled.mask && sys.state != STATE_HOMING)
+                    backlash_block_start();
+              #endif
             }
 
           #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
             // With AMASS enabled, adjust Bresenham axis increment counters according to AMASS level.
             st.amass_level = st.exec_segment->amass_level;
-            st.steps[X_AXIS] = st.exec_block->steps[X_AXIS] >> st.amass_level;
-            st.steps[Y_AXIS] = st.exec_block->steps[Y_AXIS] >> st.amass_level;
-            st.steps[Z_AXIS] = st.exec_block->steps[Z_AXIS] >> st.amass_level;
-           #ifdef A_AXIS
-            st.steps[A_AXIS] = st.exec_block->steps[A_AXIS] >> st.amass_level;
-           #endif
-           #ifdef B_AXIS
-            st.steps[B_AXIS] = st.exec_block->steps[B_AXIS] >> st.amass_level;
-           #endif
-           #ifdef C_AXIS
-            st.steps[C_AXIS] = st.exec_block->steps[C_AXIS] >> st.amass_level;
-           #endif
+            uint_fast8_t idx = N_AXIS;
+            do {
+                idx--;
+                st.steps[idx] = st.exec_block->steps[idx] >> st.amass_level;
+            } while(idx);
          #endif
 
             if(st.exec_segment->update_rpm) {
               #ifdef SPINDLE_PWM_DIRECT
                 hal.spindle.update_pwm(st.exec_segment->spindle_pwm);
+               #ifdef ENABLE_LASER_POWER_RAMP
+                st.spindle_pwm = (int32_t)st.exec_segment->spindle_pwm << 8;
+                st.pwm_ramp_steps = 0;
+               #endif
               #else
-                hal.spindle.update_rpm(st.exec_segment->spindle_rpm);
+                hal_spindle_update_rpm(st.exec_segment->spindle_rpm);
               #endif
             }
+
+            if(segment_hooks.count) {
+                uint_fast8_t idx = 0;
+                do {
+                    segment_hooks.hook[idx](&st);
+                } while(++idx < segment_hooks.count);
+            }
+
+          #ifdef ENABLE_FLIGHT_RECORDER
+            flightrec_log_isr(FlightRec_Exec, st.exec_segment->cycles_per_tick, st.exec_segment->n_step, st.exec_segment->amass_level,
+                               segment_buffer_count(), st.exec_block->line_number);
+          #endif
+
+            // Let the driver execute the segment if it is able to, the driver interrupts again when it is done.
+            if(hal.stepper.load_segment && st.step_count && sys.state != STATE_HOMING && sys_probing_state == Probing_Off &&
+                hal.stepper.load_segment(&st)) {
+                st.driver_segment = true;
+                st.new_block = st.dir_change = false;
+                st.step_outbits.value = 0;
+                return;
+            }
         } else {
             // Segment buffer empty. Shutdown.
             st_go_idle();
+#ifdef ENABLE_STEPPER_STATS
+#endif
+#ifdef ENABLE_MICROSTEP_SWITCHING
+            // Restore the configured resolution at standstill, if the driver is busy it is restored with the next block.
+            if(st.microstep_shift && hal.stepper.set_microstep_shift(0))
+                st.microstep_shift = 0;
+#endif
+#ifdef ENABLE_LINE_TIMING
+            linetime_motion_ended();
+#endif
+            // Log as underrun if motion was not ended by the segment preparation and there are blocks left to execute.
+            if(!sys.step_control.end_motion && (pl_block || plan_get_current_block()))
+                underrun_add();
             // Ensure pwm is set properly upon completion of rate-controlled motion.
             if (st.exec_block->dynamic_rpm && settings.mode == Mode_Laser)
                 hal.spindle.set_state((spindle_state_t){0}, 0.0f);
@@ -389,113 +867,254 @@ ISR_CODE void stepper_driver_interrupt_handler (void)
     // Check probing state.
     // Monitors probe pin state and records the system position when detected.
     // NOTE: This function must be extremely efficient as to not bog down the stepper ISR.
-    if (sys_probing_state == Probing_Active && hal.probe.get_state().triggered) {
+    if (sys_probing_state == Probing_Active && !hal.driver_cap.probe_latch && hal_probe_get_state().triggered) {
         sys_probing_state = Probing_Off;
         memcpy(sys_probe_position, sys_position, sizeof(sys_position));
-        bit_true(sys_rt_exec_state, EXEC_MOTION_CANCEL);
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
     }
 
-    register axes_signals_t step_outbits = (axes_signals_t){0};
-
     // Execute step displacement profile by Bresenham line algorithm
+    // NOTE: sys_position_seq is odd while sys_position is updated, see system_get_position().
+    sys_position_seq++;
+    MEMORY_BARRIER();
 
-    st.counter_x += st.steps[X_AXIS];
-    if (st.counter_x > st.step_event_count) {
-        step_outbits.x = On;
-        st.counter_x -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-            sys_position[X_AXIS] = sys_position[X_AXIS] + (st.dir_outbits.x ? -1 : 1);
+#ifdef ENABLE_STEP_BURST
+    // In burst mode execute up to step_burst step events, these are output back to back by the driver on the next tick.
+    if (st.exec_segment->step_burst > 1) {
+
+        st.burst_steps = 0;
+        st.step_outbits.value = 0;
+
+        while (st.step_count && st.burst_steps < st.exec_segment->step_burst) {
+            st.step_burst[st.burst_steps] = bresenham_step_event();
+            st.step_outbits.value |= st.step_burst[st.burst_steps++].value;
+            st.step_count--;
+        }
+
+        MEMORY_BARRIER();
+        sys_position_seq++;
+
+      #ifdef ENABLE_LASER_POWER_RAMP
+        laser_power_ramp(st.burst_steps);
+      #endif
+
+        if (st.step_count == 0) { // Segment is complete. Advance segment tail pointer.
+            segment_buffer_tail = segment_buffer_tail->next;
+            if(hal.stepper.prep_request)
+                hal.stepper.prep_request(); // and request refill of segment buffer.
+        }
+
+        return;
     }
 
-    st.counter_y += st.steps[Y_AXIS];
-    if (st.counter_y > st.step_event_count) {
-        step_outbits.y = On;
-        st.counter_y -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+    st.burst_steps = 0;
 #endif
-            sys_position[Y_AXIS] = sys_position[Y_AXIS] + (st.dir_outbits.y ? -1 : 1);
-    }
 
-    st.counter_z += st.steps[Z_AXIS];
-    if (st.counter_z > st.step_event_count) {
-        step_outbits.z = On;
-        st.counter_z -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+    st.step_outbits = bresenham_step_event();
+#ifdef ENABLE_STEP_INJECTION
+    if(injection.pending && st.exec_block->steps[STEP_INJECTION_AXIS] == 0 && sys.state != STATE_HOMING)
+        step_injection();
+#endif
+#if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+    if(backlash.active.mask)
+        backlash_step();
 #endif
-            sys_position[Z_AXIS] = sys_position[Z_AXIS] + (st.dir_outbits.z ? -1 : 1);
+    MEMORY_BARRIER();
+    sys_position_seq++;
+
+#ifdef STEP_PHASE_SMOOTHING
+    if(hal.driver_cap.step_phase && st.step_outbits.mask)
+        step_phase_delays();
+#endif
+
+#ifdef ENABLE_LASER_POWER_RAMP
+    laser_power_ramp(1);
+#endif
+
+    if (st.step_count == 0 || --st.step_count == 0) {
+        // Segment is complete. Advance segment tail pointer.
+        segment_buffer_tail = segment_buffer_tail->next;
+        if(hal.stepper.prep_request)
+            hal.stepper.prep_request(); // and request refill of segment buffer.
     }
+}
 
-  #ifdef A_AXIS
-      st.counter_a += st.steps[A_AXIS];
-      if (st.counter_a > st.step_event_count) {
-          step_outbits.a = On;
-          st.counter_a -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-              sys_position[A_AXIS] = sys_position[A_AXIS] + (st.dir_outbits.a ? -1 : 1);
-      }
-  #endif
+#ifdef ENABLE_STEPPER_STATS
 
-  #ifdef B_AXIS
-      st.counter_b += st.steps[B_AXIS];
-      if (st.counter_b > st.step_event_count) {
-          step_outbits.b = On;
-          st.counter_b -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-              sys_position[B_AXIS] = sys_position[B_AXIS] + (st.dir_outbits.b ? -1 : 1);
-      }
-  #endif
+ISR_CODE static inline void stats_add (st_cycles_t *cycles, uint32_t count)
+{
+    if(count < cycles->min)
+        cycles->min = count;
+    if(count > cycles->max)
+        cycles->max = count;
+    cycles->total += count;
+    cycles->samples++;
+}
 
-  #ifdef C_AXIS
-      st.counter_c += st.steps[C_AXIS];
-      if (st.counter_c > st.step_event_count) {
-          step_outbits.c = On;
-          st.counter_c -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-              sys_position[C_AXIS] = sys_position[C_AXIS] + (st.dir_outbits.c ? -1 : 1);
-      }
-  #endif
+// Stepper ISR wrapper for measuring execution time.
+ISR_CODE void stepper_driver_interrupt_handler (void)
+{
+    if(hal.get_cycle_count) {
+        uint32_t start = hal.get_cycle_count();
+        stepper_isr();
+        stats_add(&stats.isr, hal.get_cycle_count() - start);
+    } else
+        stepper_isr();
+}
+
+// Returns pointer to the execution time statistics, NULL if the driver does not provide a cycle counter.
+st_stats_t *st_get_stats (void)
+{
+    return hal.get_cycle_count ? &stats : NULL;
+}
 
-    st.step_outbits.value = step_outbits.value;
+// Clears the execution time statistics.
+void st_clear_stats (void)
+{
+    hal.irq_disable();
+    memset(&stats, 0, sizeof(st_stats_t));
+    stats.isr.min = stats.prep.min = stats.pulse.min = UINT32_MAX;
+    hal.irq_enable();
+}
 
-    // During a homing cycle, lock out and prevent desired axes from moving.
-    if (sys.state == STATE_HOMING)
-        st.step_outbits.value &= sys.homing_axis_lock.mask;
+#endif
 
-    if (st.step_count == 0 || --st.step_count == 0) {
-        // Segment is complete. Advance segment tail pointer.
-        segment_buffer_tail = segment_buffer_tail->next;
+// Probe pin edge interrupt handler, called by drivers setting hal.driver_cap.probe_latch when the probe
+// triggers. Records the system position at the trigger rather than at the next step event, so accuracy
+// does not depend on the step rate. The stepper ISR does not check the probe state for these drivers.
+// NOTE: The driver must not allow this interrupt to preempt the stepper interrupt, and should only
+//       enable it while probing, see hal.probe.configure().
+ISR_CODE void probe_interrupt_handler (void)
+{
+    if (sys_probing_state == Probing_Active) {
+        sys_probing_state = Probing_Off;
+        memcpy(sys_probe_position, sys_position, sizeof(sys_position));
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
     }
 }
 
+#ifdef UNDERRUN_MESSAGE
+
+static THREAD_LOCAL volatile bool underrun_message_pending = false;
+
+static void underrun_message (uint_fast16_t state)
+{
+    char msg[48];
+
+    strcpy(msg, "Segment buffer underrun, line ");
+    strcat(msg, uitoa((uint32_t)underruns.log[(underruns.head == 0 ? UNDERRUN_LOG_SIZE : underruns.head) - 1].line_number));
+
+    underrun_message_pending = false;
+    report_message(msg, Message_Warning);
+}
+
+#endif
+
+// Called from the stepper ISR when the segment buffer ran empty before motion was completed.
+ISR_CODE static void underrun_add (void)
+{
+    plan_block_t *block = pl_block ? pl_block : plan_get_current_block();
+
+    underruns.log[underruns.head].ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    underruns.log[underruns.head].line_number = block ? block->line_number : 0;
+    underruns.head = underruns.head == UNDERRUN_LOG_SIZE - 1 ? 0 : underruns.head + 1;
+    underruns.count++;
+
+#ifdef ENABLE_FLIGHT_RECORDER
+    flightrec_trigger(FlightRecTrigger_Underrun);
+#endif
+
+#ifdef ENABLE_STEPPER_STATS
+    stats.underflows++;
+#endif
+
+#ifdef UNDERRUN_MESSAGE
+    if(!underrun_message_pending)
+        underrun_message_pending = protocol_enqueue_rt_command(underrun_message);
+#endif
+}
+
+// Returns pointer to the segment buffer underrun log.
+st_underruns_t *st_get_underruns (void)
+{
+    return &underruns;
+}
+
+#ifdef ENABLE_MOTION_BENCHMARK
+
+// Masks off step outputs while the stepper ISR keeps executing the segments and tracking the position,
+// direction outputs are not masked. Used by the motion pipeline benchmark, see motion_bench_run().
+void st_mask_steps (bool on)
+{
+    steps_masked = on;
+}
+
+#endif
+
+// Clears the segment buffer underrun log.
+void st_clear_underruns (void)
+{
+    hal.irq_disable();
+    memset(&underruns, 0, sizeof(st_underruns_t));
+    hal.irq_enable();
+}
+
+// Adds a hook to be called by the stepper ISR once per step segment, returns false if there is no free slot.
+// NOTE: Call from the foreground process only, before or between cycles.
+bool st_add_segment_hook (stepper_segment_hook_ptr hook)
+{
+    bool ok;
+
+    if((ok = segment_hooks.count < STEPPER_SEGMENT_HOOKS))
+        segment_hooks.hook[segment_hooks.count++] = hook;
+
+    return ok;
+}
+
+uint_fast8_t st_get_segment_hook_count (void)
+{
+    return segment_hooks.count;
+}
+
 // Reset and clear stepper subsystem variables
 void st_reset ()
 {
+    uint_fast8_t idx;
+
+    st_prep_lock();
+
     if(hal.probe.configure)
         hal.probe.configure(false, false);
 
-    if(message) {
-        free(message);
-        message = NULL;
-    }
-
     // Initialize stepper driver idle state, clear step and direction port pins.
     st_go_idle();
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    if(st.microstep_shift)
+        hal.stepper.set_microstep_shift(0);
+#endif
    // hal.stepper.go_idle(true);
 
+    // Discard queued messages, messages of blocks not executed and output commands.
+    while(messages.tail != messages.head) {
+        gc_message_free(messages.message[messages.tail]);
+        messages.tail = (messages.tail + 1) % MESSAGE_QUEUE_SIZE;
+    }
+
+    for(idx = 0 ; idx <= SEGMENT_BUFFER_SIZE - 2 ; idx++) {
+        if(st_block_buffer[idx].message) {
+            gc_message_free(st_block_buffer[idx].message);
+            st_block_buffer[idx].message = NULL;
+        }
+        if(st_block_buffer[idx].output_commands) {
+            gc_output_command_free(st_block_buffer[idx].output_commands);
+            st_block_buffer[idx].output_commands = NULL;
+        }
+    }
+
     // NOTE: buffer indices starts from 1 for simpler driver coding!
 
     // Set up stepper block ringbuffer as circular linked list and add id
-    uint_fast8_t idx;
     for(idx = 0 ; idx <= SEGMENT_BUFFER_SIZE - 2 ; idx++) {
         st_block_buffer[idx].next = &st_block_buffer[idx == SEGMENT_BUFFER_SIZE - 2 ? 0 : idx + 1];
         st_block_buffer[idx].id = idx + 1;
@@ -506,6 +1125,7 @@ void st_reset ()
         segment_buffer[idx].next = &segment_buffer[idx == SEGMENT_BUFFER_SIZE - 1 ? 0 : idx + 1];
         segment_buffer[idx].id = idx + 1;
         segment_buffer[idx].amass_level = 0;
+        segment_buffer[idx].step_burst = 1;
     }
 
     st_prep_block = &st_block_buffer[0];
@@ -518,6 +1138,18 @@ void st_reset ()
     memset(&prep, 0, sizeof(st_prep_t));
     memset(&st, 0, sizeof(stepper_t));
 
+#if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+    memset(backlash.pending, 0, sizeof(backlash.pending));
+    backlash.active.mask = 0;
+#endif
+
+#ifdef ENABLE_STEP_INJECTION
+    injection.pending = 0;
+    injection.cycles = 0;
+    if(settings.axis[STEP_INJECTION_AXIS].steps_per_mm > 0.0f && settings.axis[STEP_INJECTION_AXIS].max_rate > 0.0f)
+        injection_update_rate(); // Pick up any settings changes.
+#endif
+
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
     // TODO: move to driver?
     // AMASS_LEVEL0: Normal operation. No AMASS. No upper cutoff frequency. Starts at LEVEL1 cutoff frequency.
@@ -527,9 +1159,16 @@ void st_reset ()
     amass.level_3 = hal.f_step_timer / 2000;
 #endif
 
+#ifdef ENABLE_STEP_BURST
+    step_burst_cycles = hal.f_step_timer / STEP_BURST_RATE;
+#endif
+
     cycles_per_min = (float)hal.f_step_timer * 60.0f;
+
+    st_prep_unlock();
 }
 
+
 // Called by spindle_set_state() to inform about RPM changes.
 // Used by st_prep_buffer() to determine if spindle needs update when dynamic RPM is called for.
 void st_rpm_changed (float rpm)
@@ -540,16 +1179,22 @@ void st_rpm_changed (float rpm)
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters ()
 {
+    st_prep_lock();
+
     if (pl_block != NULL) { // Ignore if at start of a new block.
         prep.recalculate.velocity_profile = On;
         pl_block->entry_speed_sqr = prep.current_speed * prep.current_speed; // Update entry speed.
         pl_block = NULL; // Flag st_prep_segment() to load and check active velocity profile.
     }
+
+    st_prep_unlock();
 }
 
 // Changes the run state of the step segment buffer to execute the special parking motion.
 void st_parking_setup_buffer()
 {
+    st_prep_lock();
+
     // Store step execution data of partially completed block, if necessary.
     if (prep.recalculate.hold_partial_block) {
         prep.last_st_block = st_prep_block;
@@ -557,31 +1202,175 @@ void st_parking_setup_buffer()
         prep.last_dt_remainder = prep.dt_remainder;
         prep.last_steps_per_mm = prep.steps_per_mm;
     }
-    // Set flags to execute a parking motion
-    prep.recalculate.parking = On;
-    prep.recalculate.velocity_profile = Off;
-    pl_block = NULL; // Always reset parking motion to reload new block.
+    // Set flags to execute a parking motion
+    prep.recalculate.parking = On;
+    prep.recalculate.velocity_profile = Off;
+    pl_block = NULL; // Always reset parking motion to reload new block.
+
+    st_prep_unlock();
+}
+
+
+// Restores the step segment buffer to the normal run state after a parking motion.
+void st_parking_restore_buffer()
+{
+    st_prep_lock();
+
+    // Restore step execution data and flags of partially completed block, if necessary.
+    if (prep.recalculate.hold_partial_block) {
+        st_prep_block = prep.last_st_block;
+        prep.steps_remaining = prep.last_steps_remaining;
+        prep.dt_remainder = prep.last_dt_remainder;
+        prep.steps_per_mm = prep.last_steps_per_mm;
+        prep.recalculate.flags = 0;
+        prep.recalculate.hold_partial_block = prep.recalculate.velocity_profile = On;
+        prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.steps_per_mm; // Recompute this value.
+    } else
+        prep.recalculate.flags = 0;
+
+    pl_block = NULL; // Set to reload next block.
+
+    st_prep_unlock();
+}
+
+#ifdef ENABLE_JERK_ACCELERATION
+
+// Sets up a jerk limited ramp from the current speed to end_speed with the average acceleration given.
+// The average acceleration is derated by the planner for a full ramp to the nominal speed, shorter ramps
+// would need a higher peak acceleration at the jerk limit. The peak is then clamped to the acceleration
+// limit of the block and the jerk raised instead, so the ramp duration and distance are retained.
+static void ramp_init (plan_block_t *block, float end_speed, float acceleration)
+{
+    float discriminant;
+
+    prep.ramp.time = 0.0f;
+    prep.ramp.start_speed = prep.current_speed;
+    prep.ramp.delta_speed = fabsf(end_speed - prep.current_speed);
+    prep.ramp.duration = prep.ramp.delta_speed / acceleration;
+
+    // Solve dv = a * (T - a / j) for the peak acceleration a.
+    discriminant = prep.ramp.duration * prep.ramp.duration - 4.0f * prep.ramp.delta_speed / block->jerk;
+
+    if(discriminant >= 0.0f) {
+        prep.ramp.acceleration = 0.5f * block->jerk * (prep.ramp.duration - sqrtf(discriminant));
+        prep.ramp.jerk = block->jerk;
+    } else {
+        // Too short ramp for reaching peak acceleration at the jerk limit, use a triangular acceleration profile.
+        prep.ramp.acceleration = 2.0f * acceleration;
+        prep.ramp.jerk = 2.0f * prep.ramp.acceleration / prep.ramp.duration;
+    }
+
+    // The peak is never more than twice the average acceleration, the time at constant acceleration
+    // is then positive and the jerk time no more than half the ramp duration.
+    // NOTE: Stop ramps with a separate deceleration limit above the acceleration limit are not clamped.
+    if(prep.ramp.acceleration > block->max_acceleration && acceleration < block->max_acceleration) {
+        prep.ramp.acceleration = block->max_acceleration;
+        prep.ramp.jerk_time = prep.ramp.duration - prep.ramp.delta_speed / block->max_acceleration;
+        prep.ramp.jerk = prep.ramp.acceleration / prep.ramp.jerk_time;
+    } else
+        prep.ramp.jerk_time = prep.ramp.acceleration / prep.ramp.jerk;
+}
+
+// Returns the magnitude of the speed change since the start of the ramp.
+static float ramp_delta_speed (float time)
+{
+    float delta_speed;
+
+    if(time >= prep.ramp.duration)
+        delta_speed = prep.ramp.delta_speed;
+    else if(time <= prep.ramp.jerk_time)
+        delta_speed = 0.5f * prep.ramp.jerk * time * time;
+    else if(time < prep.ramp.duration - prep.ramp.jerk_time)
+        delta_speed = prep.ramp.acceleration * (time - 0.5f * prep.ramp.jerk_time);
+    else {
+        time = prep.ramp.duration - time;
+        delta_speed = prep.ramp.delta_speed - 0.5f * prep.ramp.jerk * time * time;
+    }
+
+    return delta_speed;
+}
+
+#elif defined(ENABLE_INPUT_SHAPING)
+
+// Computes the input shaper for an axis from its resonance frequency and damping ratio settings.
+// Returns a single impulse shaper, i.e. no shaping, if the frequency is not set.
+void st_get_input_shaper (input_shaper_t *shaper, uint_fast8_t axis)
+{
+    shaper->impulses = 1;
+    shaper->amplitude[0] = 1.0f;
+    shaper->time[0] = shaper->delay = 0.0f;
+
+    if(axis < N_AXIS && settings.axis[axis].shaper_frequency > 0.0f) {
+
+        uint_fast8_t idx;
+        float damping = settings.axis[axis].shaper_damping;
+        float damped_ratio = sqrtf(1.0f - damping * damping);
+        float k = expf(-damping * M_PI / damped_ratio);
+        float half_period = 0.5f / (settings.axis[axis].shaper_frequency * damped_ratio * 60.0f); // Half damped period (min)
+
+      #ifdef INPUT_SHAPER_ZVD
+        shaper->amplitude[0] = 1.0f / ((1.0f + k) * (1.0f + k));
+        shaper->amplitude[1] = 2.0f * k * shaper->amplitude[0];
+        shaper->amplitude[2] = k * k * shaper->amplitude[0];
+      #else
+        shaper->amplitude[0] = 1.0f / (1.0f + k);
+        shaper->amplitude[1] = k * shaper->amplitude[0];
+      #endif
+
+        shaper->impulses = INPUT_SHAPER_IMPULSES;
+        for(idx = 0; idx < INPUT_SHAPER_IMPULSES; idx++) {
+            shaper->time[idx] = half_period * (float)idx;
+            shaper->delay -= shaper->amplitude[idx] * shaper->time[idx];
+        }
+        shaper->delay += shaper->time[INPUT_SHAPER_IMPULSES - 1];
+    }
 }
 
+// Sets up an input shaped ramp from the current speed to end_speed with the acceleration given.
+// A constant acceleration ramp of duration T travels v0 * T + dv * T / 2. The shaped ramp is delayed
+// by the shaper duration D and its acceleration centroid by the amplitude weighted mean impulse time,
+// it travels v0 * (T' + D) + dv * (T' / 2 + delay). T' is solved for so that these are equal.
+static void ramp_init (plan_block_t *block, float end_speed, float acceleration)
+{
+    float delta_speed = end_speed - prep.current_speed, ramp_time = fabsf(delta_speed) / acceleration;
+
+    prep.ramp.time = 0.0f;
+    prep.ramp.start_speed = prep.current_speed;
+    prep.ramp.delta_speed = fabsf(delta_speed);
+    prep.ramp.ramp_time = ramp_time;
+
+    if((prep.ramp.shaped = prep.shaper.impulses > 1 && ramp_time > 0.0f)) {
+        prep.ramp.ramp_time -= (prep.current_speed * prep.shaper.time[prep.shaper.impulses - 1] + delta_speed * prep.shaper.delay) /
+                                (prep.current_speed + 0.5f * delta_speed);
+        // Execute the ramp unshaped if shaping would more than double the acceleration.
+        if(!(prep.ramp.shaped = prep.ramp.ramp_time >= 0.5f * ramp_time))
+            prep.ramp.ramp_time = ramp_time;
+    }
+}
 
-// Restores the step segment buffer to the normal run state after a parking motion.
-void st_parking_restore_buffer()
+// Returns the magnitude of the speed change since the start of the ramp.
+static float ramp_delta_speed (float time)
 {
-    // Restore step execution data and flags of partially completed block, if necessary.
-    if (prep.recalculate.hold_partial_block) {
-        st_prep_block = prep.last_st_block;
-        prep.steps_remaining = prep.last_steps_remaining;
-        prep.dt_remainder = prep.last_dt_remainder;
-        prep.steps_per_mm = prep.last_steps_per_mm;
-        prep.recalculate.flags = 0;
-        prep.recalculate.hold_partial_block = prep.recalculate.velocity_profile = On;
-        prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.steps_per_mm; // Recompute this value.
-    } else
-        prep.recalculate.flags = 0;
+    if(time >= prep.ramp.ramp_time + (prep.ramp.shaped ? prep.shaper.time[prep.shaper.impulses - 1] : 0.0f))
+        return prep.ramp.delta_speed;
 
-    pl_block = NULL; // Set to reload next block.
+    if(!prep.ramp.shaped)
+        return prep.ramp.delta_speed * time / prep.ramp.ramp_time;
+
+    float ramp_time = 0.0f, impulse_time;
+    uint_fast8_t idx = prep.shaper.impulses;
+
+    do {
+        idx--;
+        if((impulse_time = time - prep.shaper.time[idx]) > 0.0f)
+            ramp_time += prep.shaper.amplitude[idx] * min(impulse_time, prep.ramp.ramp_time);
+    } while(idx);
+
+    return prep.ramp.delta_speed * ramp_time / prep.ramp.ramp_time;
 }
 
+#endif
+
 /* Prepares step segment buffer. Continuously called from main program.
 
    The segment buffer is an intermediary buffer interface between the execution of steps
@@ -594,15 +1383,256 @@ void st_parking_restore_buffer()
    longer than the time it takes the stepper algorithm to empty it before refilling it.
    Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
    NOTE: Computation units are in steps, millimeters, and minutes.
+   NOTE: If the driver provides a prep_request handler segment preparation is also run from a low
+   priority interrupt or task whenever a segment is consumed, see st_prep_buffer() below.
 */
-void st_prep_buffer()
+#ifdef ENABLE_ARC_BLOCKS
+
+/* Arc blocks are executed as a sequence of chords, one per step segment. The end point of a segment is
+   computed on the arc from the distance remaining, and each segment gets its own stepper block with the
+   Bresenham data of the chord from the end of the previous segment. The velocity profile is computed
+   along the arc as for lines, with the planner block step event count as the path resolution. */
+
+// Computes the position on the arc at mm_remaining from the end of the block, returns the number of
+// step events of the chord from the end of the previous segment.
+static uint32_t arc_segment_target (plan_block_t *block, float mm_remaining, int32_t *target)
+{
+    plan_arc_t *arc = &block->arc;
+    uint_fast8_t idx = 3;
+    uint32_t step_events = 0;
+
+    if(mm_remaining <= 0.0f)
+        memcpy(target, arc->target_steps, sizeof(arc->target_steps));
+    else {
+        float f = 1.0f - mm_remaining / arc->length;
+        float angle = arc->start_angle + arc->angular_travel * f;
+        float radius = arc->radius + arc->radius_change * f;
+        target[0] = lroundf((arc->center[0] + radius * cosf(angle)) * settings.axis[arc->axis_0].steps_per_mm);
+        target[1] = lroundf((arc->center[1] + radius * sinf(angle)) * settings.axis[arc->axis_1].steps_per_mm);
+        target[2] = lroundf((arc->linear_start + arc->linear_travel * f) * settings.axis[arc->axis_linear].steps_per_mm);
+    }
+
+    do {
+        idx--;
+        step_events = max(step_events, (uint32_t)labs(target[idx] - prep.arc.position[idx]));
+    } while(idx);
+
+    return step_events;
+}
+
+// Sets up the stepper block for the chord to target. The stepper block loaded with the planner block,
+// holding any message and output commands, is used for the first segment.
+static void arc_prep_block (plan_block_t *block, int32_t *target, uint32_t step_events)
+{
+    uint_fast8_t idx = N_AXIS, axis[3] = { block->arc.axis_0, block->arc.axis_1, block->arc.axis_linear };
+    st_block_t *st_block = st_prep_block;
+    int32_t delta;
+
+    if(prep.arc.first)
+        prep.arc.first = false;
+    else {
+        st_block = st_block->next;
+        st_block->overrides = st_prep_block->overrides;
+        st_block->steps_per_mm = st_prep_block->steps_per_mm;
+        st_block->millimeters = st_prep_block->millimeters;
+        st_block->programmed_rate = st_prep_block->programmed_rate;
+        st_block->dynamic_rpm = st_prep_block->dynamic_rpm;
+#if defined(ENABLE_FLIGHT_RECORDER) || defined(ENABLE_LINE_TIMING)
+        st_block->line_number = st_prep_block->line_number;
+#endif
+#ifdef ENABLE_NVS_CHECKPOINT
+        st_block->checkpoint = st_prep_block->checkpoint;
+#endif
+#ifdef ENABLE_MICROSTEP_SWITCHING
+        st_block->microstep_shift = st_prep_block->microstep_shift;
+#endif
+        if(st_block->output_commands) {
+            gc_output_command_free(st_block->output_commands);
+            st_block->output_commands = NULL;
+        }
+        if(st_block->message) {
+            gc_message_free(st_block->message);
+            st_block->message = NULL;
+        }
+#ifdef ENABLE_PROBE_QUEUING
+        st_block->probing = false;
+#endif
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+        st_block->coolant_change = false;
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+        st_block->wco_change = false;
+#endif
+        st_prep_block = st_block;
+    }
+
+    st_block->direction_bits.mask = 0;
+    do {
+        idx--;
+        st_block->steps[idx] = 0;
+        st_block->position_delta[idx] = 1;
+      #ifdef STEP_PHASE_SMOOTHING
+        st_block->step_inv[idx] = 0;
+      #endif
+    } while(idx);
+
+    idx = 3;
+    do {
+        idx--;
+        if((delta = target[idx] - prep.arc.position[idx]) < 0) {
+            st_block->direction_bits.mask |= bit(axis[idx]);
+            st_block->position_delta[axis[idx]] = -1;
+        }
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        st_block->steps[axis[idx]] = (uint32_t)labs(delta) << MAX_AMASS_LEVEL;
+      #else
+        st_block->steps[axis[idx]] = (uint32_t)labs(delta) << 1;
+       #ifdef STEP_PHASE_SMOOTHING
+        st_block->step_inv[axis[idx]] = delta ? (uint32_t)(0x100000000ULL / st_block->steps[axis[idx]]) : 0;
+       #endif
+      #endif
+    } while(idx);
+
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    st_block->step_event_count = step_events << MAX_AMASS_LEVEL;
+  #else
+    st_block->step_event_count = step_events << 1;
+  #endif
+
+    memcpy(prep.arc.position, target, sizeof(prep.arc.position));
+}
+
+#endif
+
+// Computes the AMASS level and step burst of the segment, returns the timer ticks per ISR tick.
+static inline uint32_t segment_step_timing (segment_t *segment, uint32_t cycles)
+{
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    // Compute step timing and multi-axis smoothing level.
+    // NOTE: AMASS overdrives the timer with each level, so only one prescalar is required.
+    if (cycles < amass.level_1)
+        segment->amass_level = 0;
+    else {
+        segment->amass_level = cycles < amass.level_2 ? 1 : (cycles < amass.level_3 ? 2 : 3);
+        cycles >>= segment->amass_level;
+        segment->n_step <<= segment->amass_level;
+    }
+  #endif
+
+  #ifdef ENABLE_STEP_BURST
+    // Compute number of step events per ISR tick if the step rate is above the burst mode threshold.
+    // NOTE: Burst mode is disabled while probing and homing as these rely on per step monitoring.
+    segment->step_burst = 1;
+    if (hal.driver_cap.step_burst && cycles < step_burst_cycles && segment->amass_level == 0 &&
+         sys_probing_state == Probing_Off && sys.state != STATE_HOMING) {
+        uint_fast8_t step_burst_max = 1 << hal.driver_cap.step_burst;
+        while (segment->step_burst < step_burst_max && cycles * segment->step_burst < step_burst_cycles)
+            segment->step_burst <<= 1;
+        cycles *= segment->step_burst;
+    }
+  #endif
+
+    return cycles;
+}
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+
+// Selects the microstep resolution divider for a planner block from the step rate at its nominal speed,
+// the smallest shift that brings the rate below MICROSTEP_SWITCH_RATE. Motions depending on single step
+// resolution, arcs, motions too short for coarse steps and blocks ending at standstill are executed at the
+// configured resolution, the latter ensures that the machine always stops at the exact planned position.
+static uint_fast8_t microstep_shift_select (plan_block_t *block, uint32_t step_event_count)
+{
+    uint_fast8_t shift = 0;
+
+    if(hal.stepper.set_microstep_shift && !(block->condition.system_motion || block->condition.backlash_motion || block->condition.probing ||
+#ifdef ENABLE_ARC_BLOCKS
+                                              block->condition.arc_motion ||
+#endif
+                                               block->condition.is_rpm_pos_adjusted) && plan_get_exec_block_exit_speed_sqr() > 0.0f) {
+
+        float rate = plan_compute_profile_nominal_speed(block) * (float)step_event_count / (block->millimeters * 60.0f);
+        float threshold = prep.microstep_shift ? MICROSTEP_SWITCH_RATE * MICROSTEP_SWITCH_HYSTERESIS : MICROSTEP_SWITCH_RATE;
+
+        while(shift < hal.stepper.microstep_shift_max && rate > threshold) {
+            shift++;
+            rate *= 0.5f;
+        }
+
+        if(step_event_count < (4UL << shift))
+            shift = 0;
+    }
+
+    return (prep.microstep_shift = shift);
+}
+
+// Computes the step counts and direction bits of a planner block in units of 2^shift microsteps into prep.steps[]
+// and prep.direction_bits and returns the step event count. The position difference from rounding to coarse steps
+// is carried over to the following blocks and made up for by the next block executed at the configured resolution.
+// Coarse steps are never taken in the opposite direction of the motion of an axis.
+// NOTE: arc blocks make up for the carry of the arc axes in the first chord instead, see st_prep_buffer().
+static uint32_t microstep_block_steps (plan_block_t *block, uint_fast8_t shift)
+{
+    bool carry = !(block->condition.backlash_motion
+#ifdef ENABLE_ARC_BLOCKS
+                    || block->condition.arc_motion
+#endif
+                   );
+    uint_fast8_t idx = N_AXIS;
+    uint32_t step_event_count = 0;
+    int32_t delta, steps, half = (1L << shift) >> 1;
+
+    prep.direction_bits = block->direction_bits;
+
+    do {
+        idx--;
+        delta = (int32_t)plan_block_steps(block, idx);
+        if(block->direction_bits.mask & bit(idx))
+            delta = -delta;
+        steps = carry ? delta - prep.microstep_carry[idx] : delta;
+        if(shift) {
+            steps = (steps >= 0 ? (steps + half) >> shift : -((-steps + half) >> shift)) << shift;
+            if(steps != 0 && (steps > 0) != (delta > 0))
+                steps = 0;
+        }
+        if(carry)
+            prep.microstep_carry[idx] += steps - delta;
+        if(steps < 0)
+            prep.direction_bits.mask |= bit(idx);
+        else if(steps > 0)
+            prep.direction_bits.mask &= ~bit(idx);
+        prep.steps[idx] = (uint32_t)labs(steps) >> shift;
+        step_event_count = max(step_event_count, prep.steps[idx]);
+    } while(idx);
+
+    return step_event_count;
+}
+
+#define prep_block_steps(block, idx) prep.steps[idx]
+
+#else
+
+#define prep_block_steps(block, idx) plan_block_steps(block, idx)
+
+#endif
+
+static void prep_buffer (void)
 {
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
     if (sys.step_control.end_motion)
         return;
 
+#ifdef SEGMENT_BUFFER_TIME
+    float buffered_time = st_get_buffered_time();
+#endif
+
     while (segment_buffer_tail != segment_next_head) { // Check if we need to fill the buffer.
 
+#ifdef SEGMENT_BUFFER_TIME
+        if (buffered_time >= DT_BUFFER) // Enough motion time is queued.
+            return;
+#endif
+
         // Determine if we need to load a new planner block or if the block needs to be recomputed.
         if (pl_block == NULL) {
 
@@ -631,38 +1661,109 @@ void st_prep_buffer()
                 st_prep_block = st_prep_block->next;
 
                 uint_fast8_t idx = N_AXIS;
+                uint32_t step_event_count = plan_block_step_event_count(pl_block);
+              #ifdef ENABLE_MICROSTEP_SWITCHING
+                st_prep_block->microstep_shift = microstep_shift_select(pl_block, step_event_count);
+                step_event_count = microstep_block_steps(pl_block, st_prep_block->microstep_shift);
+              #endif
               #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
                 do {
                     idx--;
-                    st_prep_block->steps[idx] = (pl_block->steps[idx] << 1);
+                    st_prep_block->steps[idx] = (prep_block_steps(pl_block, idx) << 1);
+                  #ifdef STEP_PHASE_SMOOTHING
+                    st_prep_block->step_inv[idx] = st_prep_block->steps[idx] ? (uint32_t)(0x100000000ULL / st_prep_block->steps[idx]) : 0;
+                  #endif
                 } while(idx);
-                st_prep_block->step_event_count = (pl_block->step_event_count << 1);
+                st_prep_block->step_event_count = (step_event_count << 1);
               #else
                 // With AMASS enabled, simply bit-shift multiply all Bresenham data by the max AMASS
                 // level, such that we never divide beyond the original data anywhere in the algorithm.
                 // If the original data is divided, we can lose a step from integer roundoff.
                 do {
                     idx--;
-                    st_prep_block->steps[idx] = pl_block->steps[idx] << MAX_AMASS_LEVEL;
+                    st_prep_block->steps[idx] = prep_block_steps(pl_block, idx) << MAX_AMASS_LEVEL;
                 } while(idx);
-                st_prep_block->step_event_count = pl_block->step_event_count << MAX_AMASS_LEVEL;
+                st_prep_block->step_event_count = step_event_count << MAX_AMASS_LEVEL;
               #endif
 
+              #ifdef ENABLE_MICROSTEP_SWITCHING
+                st_prep_block->direction_bits = prep.direction_bits;
+              #else
                 st_prep_block->direction_bits = pl_block->direction_bits;
+              #endif
                 st_prep_block->programmed_rate = pl_block->programmed_rate;
                 st_prep_block->millimeters = pl_block->millimeters;
-                st_prep_block->steps_per_mm = (float)pl_block->step_event_count / pl_block->millimeters;
-                st_prep_block->output_commands = pl_block->output_commands;
+                st_prep_block->steps_per_mm = (float)step_event_count / pl_block->millimeters;
+#if defined(ENABLE_FLIGHT_RECORDER) || defined(ENABLE_LINE_TIMING)
+                st_prep_block->line_number = pl_block->line_number;
+#endif
+#ifdef ENABLE_NVS_CHECKPOINT
+                st_prep_block->checkpoint = pl_block->checkpoint;
+#endif
+                if(st_prep_block->output_commands) // Executed when the block was last used, or discarded.
+                    gc_output_command_free(st_prep_block->output_commands);
+                st_prep_block->output_commands = plan_block_take_output_commands(pl_block); // Owned by the stepper block from now on, see plan_cleanup().
                 st_prep_block->overrides = pl_block->overrides;
-                st_prep_block->backlash_motion = pl_block->condition.backlash_motion;
-                st_prep_block->message = pl_block->message;
-                pl_block->message= NULL;
+#ifdef ENABLE_PROBE_QUEUING
+                st_prep_block->probing = pl_block->condition.probing;
+#endif
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+                st_prep_block->coolant_change = pl_block->condition.coolant_change;
+                st_prep_block->coolant = pl_block->condition.coolant;
+                if(pl_block->condition.spindle_rpm_change && pl_block->condition.spindle.on)
+                    sys.step_control.update_spindle_rpm = On;
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+                st_prep_block->wco_change = pl_block->condition.wco_change;
+#endif
+
+                // Precompute the signed machine position change per step for the stepper ISR.
+                idx = N_AXIS;
+                do {
+                    idx--;
+                  #ifdef ENABLE_MICROSTEP_SWITCHING
+                    st_prep_block->position_delta[idx] = pl_block->condition.backlash_motion ? 0 : (prep.direction_bits.mask & bit(idx) ? -(1L << st_prep_block->microstep_shift) : (1L << st_prep_block->microstep_shift));
+                  #else
+                    st_prep_block->position_delta[idx] = pl_block->condition.backlash_motion ? 0 : (pl_block->direction_bits.mask & bit(idx) ? -1 : 1);
+                  #endif
+                } while(idx);
+
+                if(st_prep_block->message) // Not output by the stepper ISR as the message queue was full.
+                    gc_message_free(st_prep_block->message);
+
+                st_prep_block->message = plan_block_take_message(pl_block);
+
+                if(grbl.on_block_started && !sys.step_control.execute_sys_motion)
+                    grbl.on_block_started(pl_block, plan_compute_profile_nominal_speed(pl_block));
+
+              #ifdef ENABLE_INPUT_SHAPING
+                st_get_input_shaper(&prep.shaper, pl_block->shaper_axis);
+              #endif
+
 
                 // Initialize segment buffer data for generating the segments.
                 prep.steps_per_mm = st_prep_block->steps_per_mm;
-                prep.steps_remaining = pl_block->step_event_count;
+                prep.steps_remaining = step_event_count;
                 prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.steps_per_mm;
-                prep.dt_remainder = prep.target_position = 0.0f; // Reset for new segment block
+                prep.dt_remainder = 0; // Reset for new segment block
+                prep.target_position = 0.0f;
+              #ifdef ENABLE_ARC_BLOCKS
+                if(pl_block->condition.arc_motion) {
+                    memcpy(prep.arc.position, pl_block->arc.start_steps, sizeof(prep.arc.position));
+                  #ifdef ENABLE_MICROSTEP_SWITCHING
+                    // Start from the executed position so that the first chord makes up for the carry.
+                    uint8_t axis[3] = { pl_block->arc.axis_0, pl_block->arc.axis_1, pl_block->arc.axis_linear };
+                    idx = 3;
+                    do {
+                        idx--;
+                        prep.arc.position[idx] += prep.microstep_carry[axis[idx]];
+                        prep.microstep_carry[axis[idx]] = 0;
+                    } while(idx);
+                  #endif
+                    prep.arc.first = true;
+                    prep.arc.dt = 0.0f;
+                }
+              #endif
 
                 if (sys.step_control.execute_hold || prep.recalculate.decel_override) {
                     // New block loaded mid-hold. Override planner block entry speed to enforce deceleration.
@@ -694,11 +1795,15 @@ void st_prep_buffer()
                 // Compute velocity profile parameters for a feed hold in-progress. This profile overrides
                 // the planner block profile, enforcing a deceleration to zero speed.
                 prep.ramp_type = Ramp_Decel;
+              #ifdef ENABLE_STOP_DECELERATION
+                prep.deceleration = pl_block->stop_deceleration;
+                inv_2_accel = 0.5f / prep.deceleration;
+              #endif
                 // Compute decelerate distance relative to end of block.
                 float decel_dist = pl_block->millimeters - inv_2_accel * pl_block->entry_speed_sqr;
                 if (decel_dist < 0.0f) {
                     // Deceleration through entire planner block. End of feed hold is not in this block.
-                    prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2.0f * pl_block->acceleration * pl_block->millimeters);
+                    prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2.0f * ramp_deceleration(pl_block) * pl_block->millimeters);
                 } else {
                     prep.mm_complete = decel_dist; // End of feed hold.
                     prep.exit_speed = 0.0f;
@@ -707,6 +1812,9 @@ void st_prep_buffer()
                 // Compute or recompute velocity profile parameters of the prepped planner block.
                 prep.ramp_type = Ramp_Accel; // Initialize as acceleration ramp.
                 prep.accelerate_until = pl_block->millimeters;
+              #ifdef ENABLE_STOP_DECELERATION
+                prep.deceleration = pl_block->acceleration;
+              #endif
 
                 float exit_speed_sqr;
                 if (sys.step_control.execute_sys_motion)
@@ -774,6 +1882,14 @@ void st_prep_buffer()
                 }
             }
 
+#ifdef RAMP_PROFILE
+            if(prep.ramp_type == Ramp_Accel)
+                ramp_init(pl_block, prep.maximum_speed, pl_block->acceleration);
+            else if(prep.ramp_type == Ramp_Decel)
+                ramp_init(pl_block, prep.exit_speed, ramp_deceleration(pl_block));
+#endif
+
+
             if(sys.state != STATE_HOMING)
                 sys.step_control.update_spindle_rpm |= (settings.mode == Mode_Laser); // Force update whenever updating block in laser mode.
         }
@@ -784,6 +1900,12 @@ void st_prep_buffer()
         // Set new segment to point to the current segment data block.
         prep_segment->exec_block = st_prep_block;
         prep_segment->update_rpm = false;
+      #ifdef ENABLE_LASER_POWER_RAMP
+        prep_segment->spindle_pwm_delta = 0;
+        float entry_speed = prep.current_speed;
+        bool ramp = false;
+        uint_fast16_t ramp_pwm = 0; // PWM value at end of ramp.
+      #endif
 
         /*------------------------------------------------------------------------------------
             Compute the average velocity of this new segment by determining the total distance
@@ -810,6 +1932,26 @@ void st_prep_buffer()
         if (minimum_mm < 0.0f)
             minimum_mm = 0.0f;
 
+      #ifdef SEGMENT_BUFFER_TIME
+        // Cruising segments may be longer, the remaining part of the segment is limited to DT_SEGMENT on a ramp change.
+        bool cruising = prep.ramp_type == Ramp_Cruise && !pl_block->condition.spindle.synchronized;
+        if (cruising)
+            dt_max = time_var = DT_SEGMENT_CRUISE;
+      #endif
+
+      #ifdef ENABLE_ARC_BLOCKS
+        // Limit the segment length on arcs for the chord error to be within the arc tolerance.
+        if (pl_block->condition.arc_motion) {
+            float speed = max(prep.current_speed, prep.target_feed);
+          #ifdef SEGMENT_BUFFER_TIME
+            cruising = false;
+            dt_max = time_var = DT_SEGMENT;
+          #endif
+            if (speed > 0.0f && pl_block->arc.segment_length < speed * dt_max)
+                dt_max = time_var = pl_block->arc.segment_length / speed;
+        }
+      #endif
+
         do {
 
             switch (prep.ramp_type) {
@@ -830,7 +1972,12 @@ void st_prep_buffer()
 
                 case Ramp_Accel:
                     // NOTE: Acceleration ramp only computes during first do-while loop.
+                  #ifdef RAMP_PROFILE
+                    prep.ramp.time += time_var;
+                    speed_var = prep.ramp.start_speed + ramp_delta_speed(prep.ramp.time) - prep.current_speed;
+                  #else
                     speed_var = pl_block->acceleration * time_var;
+                  #endif
                     mm_remaining -= time_var * (prep.current_speed + 0.5f * speed_var);
                     if (mm_remaining < prep.accelerate_until) { // End of acceleration ramp.
                         // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
@@ -838,6 +1985,10 @@ void st_prep_buffer()
                         time_var = 2.0f * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
                         prep.ramp_type = mm_remaining == prep.decelerate_after ? Ramp_Decel : Ramp_Cruise;
                         prep.current_speed = prep.maximum_speed;
+                      #ifdef RAMP_PROFILE
+                        if(prep.ramp_type == Ramp_Decel)
+                            ramp_init(pl_block, prep.exit_speed, ramp_deceleration(pl_block));
+                      #endif
                     } else // Acceleration only.
                         prep.current_speed += speed_var;
                     break;
@@ -852,13 +2003,21 @@ void st_prep_buffer()
                         time_var = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
                         mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
                         prep.ramp_type = Ramp_Decel;
+                      #ifdef RAMP_PROFILE
+                        ramp_init(pl_block, prep.exit_speed, ramp_deceleration(pl_block));
+                      #endif
                     } else // Cruising only.
                         mm_remaining = mm_var;
                     break;
 
                 default: // case Ramp_Decel:
                     // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
-                    speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
+                  #ifdef RAMP_PROFILE
+                    prep.ramp.time += time_var;
+                    speed_var = prep.current_speed - prep.ramp.start_speed + ramp_delta_speed(prep.ramp.time); // Used as delta speed (mm/min)
+                  #else
+                    speed_var = ramp_deceleration(pl_block) * time_var; // Used as delta speed (mm/min)
+                  #endif
                     if (prep.current_speed > speed_var) { // Check if at or below zero speed.
                         // Compute distance from end of segment to end of block.
                         mm_var = mm_remaining - time_var * (prep.current_speed - 0.5f * speed_var); // (mm)
@@ -876,6 +2035,13 @@ void st_prep_buffer()
 
             dt += time_var; // Add computed ramp time to total segment time.
 
+          #ifdef SEGMENT_BUFFER_TIME
+            if (cruising && prep.ramp_type != Ramp_Cruise) {
+                cruising = false;
+                dt_max = max(DT_SEGMENT, dt);
+            }
+          #endif
+
             if (dt < dt_max)
                 time_var = dt_max - dt;// **Incomplete** At ramp junction.
             else {
@@ -890,6 +2056,19 @@ void st_prep_buffer()
 
         } while (mm_remaining > prep.mm_complete); // **Complete** Exit loop. Profile complete.
 
+      #ifdef ENABLE_ARC_BLOCKS
+        int32_t arc_target[3];
+        uint32_t arc_step_events = 0;
+
+        // Carry the time of a segment without steps over to the next segment.
+        if (pl_block->condition.arc_motion &&
+             (arc_step_events = arc_segment_target(pl_block, mm_remaining, arc_target)) == 0 && mm_remaining > prep.mm_complete) {
+            prep.arc.dt += dt;
+            pl_block->millimeters = mm_remaining;
+            continue;
+        }
+      #endif
+
         /* -----------------------------------------------------------------------------------
            Compute spindle spindle speed for step segment
         */
@@ -905,7 +2084,7 @@ void st_prep_buffer()
                                        : pl_block->spindle.rpm, sys.override.spindle_rpm);
 
                 if(pl_block->condition.is_rpm_pos_adjusted) {
-                    float npos = (float)(pl_block->step_event_count - prep.steps_remaining) / (float)pl_block->step_event_count;
+                    float npos = (float)(plan_block_step_event_count(pl_block) - prep.steps_remaining) / (float)plan_block_step_event_count(pl_block);
                     rpm += (spindle_set_rpm(pl_block->spindle.css.target_rpm, sys.override.spindle_rpm) - prep.current_spindle_rpm) * npos;
                 }
             } else
@@ -915,6 +2094,15 @@ void st_prep_buffer()
               #ifdef SPINDLE_PWM_DIRECT
                 prep.current_spindle_rpm = rpm;
                 prep_segment->spindle_pwm = hal.spindle.get_pwm(rpm);
+               #ifdef ENABLE_LASER_POWER_RAMP
+                // In rate adjusted laser mode start at the power for the segment entry speed and ramp to the exit speed power.
+                if(pl_block->condition.is_rpm_rate_adjusted && !pl_block->condition.is_laser_ppi_mode &&
+                    !pl_block->condition.is_rpm_pos_adjusted && pl_block->condition.spindle.on) {
+                    ramp = true;
+                    ramp_pwm = prep_segment->spindle_pwm;
+                    prep_segment->spindle_pwm = hal.spindle.get_pwm(spindle_set_rpm(pl_block->spindle.rpm * entry_speed * prep.inv_feedrate, sys.override.spindle_rpm));
+                }
+               #endif
               #else
                 prep.current_spindle_rpm = prep_segment->spindle_rpm = rpm;
               #endif
@@ -934,7 +2122,13 @@ void st_prep_buffer()
            supported by Grbl (i.e. exceeding 10 meters axis travel at 200 step/mm).
         */
         float step_dist_remaining = prep.steps_per_mm * mm_remaining; // Convert mm_remaining to steps
+      #ifdef SEGMENT_PREP_FIXED_POINT
+        uint32_t n_steps_remaining = (uint32_t)step_dist_remaining; // Round-up current steps remaining
+        if ((float)n_steps_remaining < step_dist_remaining)
+            n_steps_remaining++;
+      #else
         uint32_t n_steps_remaining = (uint32_t)ceilf(step_dist_remaining); // Round-up current steps remaining
+      #endif
 
         prep_segment->n_step = (uint_fast16_t)(prep.steps_remaining - n_steps_remaining); // Compute number of steps to execute.
 
@@ -948,6 +2142,16 @@ void st_prep_buffer()
             return; // Segment not generated, but current step data still retained.
         }
 
+      #ifdef ENABLE_ARC_BLOCKS
+        if (pl_block->condition.arc_motion) {
+            dt += prep.arc.dt;
+            prep.arc.dt = 0.0f;
+            arc_prep_block(pl_block, arc_target, arc_step_events);
+            prep_segment->exec_block = st_prep_block;
+            prep_segment->n_step = (uint_fast16_t)arc_step_events;
+        }
+      #endif
+
         // Compute segment step rate. Since steps are integers and mm distances traveled are not,
         // the end of every segment can have a partial step of varying magnitudes that are not
         // executed, because the stepper ISR requires whole steps due to the AMASS algorithm. To
@@ -956,42 +2160,92 @@ void st_prep_buffer()
         // adjusts the whole segment rate to keep step output exact. These rate adjustments are
         // typically very small and do not adversely effect performance, but ensures that Grbl
         // outputs the exact acceleration and velocity profiles as computed by the planner.
+      #ifdef SEGMENT_PREP_FIXED_POINT
+        // Fixed point version, times are in timer cycles and steps in 24.8 fixed point.
+        uint32_t step_fraction = (uint32_t)(((float)n_steps_remaining - step_dist_remaining) * 256.0f); // Partial step at end of segment.
+        uint32_t step_count = ((uint32_t)prep_segment->n_step << 8) + step_fraction; // Steps covered by the segment time, including the partial step.
+        uint32_t segment_cycles = (uint32_t)(dt * cycles_per_min) + prep.dt_remainder; // Apply previous segment partial step execute time
+
+        if (step_count == 0) // Less than 1/256 of a step, can only happen at end of block.
+            step_count = 1;
+
+        // Compute timer ticks per step for the prepped segment, rounded up.
+        uint32_t cycles = (uint32_t)((((uint64_t)segment_cycles << 8) + step_count - 1) / step_count); // (cycles/step)
+        uint32_t dt_remainder = (uint32_t)(((uint64_t)step_fraction * cycles) >> 8); // Partial step execution time carried to next segment.
+
+      #ifdef ENABLE_ARC_BLOCKS
+        // The chord step events are evenly spread over the segment time.
+        if (pl_block->condition.arc_motion)
+            cycles = (segment_cycles + max(arc_step_events, 1) - 1) / max(arc_step_events, 1);
+      #endif
+
+      #ifdef SEGMENT_BUFFER_TIME
+        buffered_time += (prep_segment->time = (float)prep_segment->n_step * (float)cycles / cycles_per_min);
+      #endif
+      #else
         dt += prep.dt_remainder; // Apply previous segment partial step execute time
         float inv_rate = dt / ((float)prep.steps_remaining - step_dist_remaining); // Compute adjusted step rate inverse
 
+      #ifdef ENABLE_ARC_BLOCKS
+        // The chord step events are evenly spread over the segment time.
+        if (pl_block->condition.arc_motion)
+            inv_rate = dt / (float)max(arc_step_events, 1);
+      #endif
+
+      #ifdef SEGMENT_BUFFER_TIME
+        buffered_time += (prep_segment->time = (float)prep_segment->n_step * inv_rate);
+      #endif
+
         // Compute timer ticks per step for the prepped segment.
         uint32_t cycles = (uint32_t)ceilf(cycles_per_min * inv_rate); // (cycles/step)
+      #endif
 
         // Record end position of segment relative to block if spindle synchronized motion
         if((prep_segment->spindle_sync = pl_block->condition.spindle.synchronized)) {
+          #ifdef SEGMENT_PREP_FIXED_POINT
+            dt = (float)segment_cycles / cycles_per_min;
+          #endif
             prep.target_position += dt * prep.target_feed;
             prep_segment->cruising = prep.ramp_type == Ramp_Cruise;
             prep_segment->target_position = prep.target_position; //st_prep_block->millimeters - pl_block->millimeters;
         }
 
-      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-        // Compute step timing and multi-axis smoothing level.
-        // NOTE: AMASS overdrives the timer with each level, so only one prescalar is required.
-        if (cycles < amass.level_1)
-            prep_segment->amass_level = 0;
-        else {
-            prep_segment->amass_level = cycles < amass.level_2 ? 1 : (cycles < amass.level_3 ? 2 : 3);
-            cycles >>= prep_segment->amass_level;
-            prep_segment->n_step <<= prep_segment->amass_level;
+        prep_segment->cycles_per_tick = segment_step_timing(prep_segment, cycles);
+        prep_segment->current_rate = prep.current_speed;
+
+      #ifdef ENABLE_LASER_POWER_RAMP
+        if(ramp && ramp_pwm != prep_segment->spindle_pwm) {
+            uint32_t updates = prep_segment->n_step / LASER_POWER_RAMP_STEPS;
+            if(updates)
+                prep_segment->spindle_pwm_delta = (((int32_t)ramp_pwm - (int32_t)prep_segment->spindle_pwm) << 8) / (int32_t)updates;
+            else // Too few steps for ramping, set exit speed power at segment start.
+                prep_segment->spindle_pwm = ramp_pwm;
         }
       #endif
 
-        prep_segment->cycles_per_tick = cycles;
-        prep_segment->current_rate = prep.current_speed;
-
         // Segment complete! Increment segment pointers, so stepper ISR can immediately execute it.
         segment_buffer_head = segment_next_head;
         segment_next_head = segment_next_head->next;
 
+      #ifdef ENABLE_FLIGHT_RECORDER
+        flightrec_log(FlightRec_Prep, prep_segment->cycles_per_tick, prep_segment->n_step, prep_segment->amass_level,
+                       segment_buffer_count(), pl_block->line_number);
+      #endif
+
         // Update the appropriate planner and segment data.
         pl_block->millimeters = mm_remaining;
         prep.steps_remaining = n_steps_remaining;
+      #ifdef SEGMENT_PREP_FIXED_POINT
+        prep.dt_remainder = dt_remainder;
+
+      #else
         prep.dt_remainder = ((float)n_steps_remaining - step_dist_remaining) * inv_rate;
+      #endif
+      #ifdef ENABLE_ARC_BLOCKS
+        if (pl_block->condition.arc_motion)
+            prep.dt_remainder = 0; // Chords end at the arc position, there is no partial step time to carry.
+      #endif
+
 
         // Check for exit conditions and flag to load next planner block.
         if (mm_remaining <= prep.mm_complete) {
@@ -1011,6 +2265,8 @@ void st_prep_buffer()
                     sys.step_control.end_motion = On;
                     return;
                 }
+                if(grbl.on_block_prepared)
+                    grbl.on_block_prepared(pl_block);
                 pl_block = NULL; // Set pointer to indicate check and load next planner block.
                 plan_discard_current_block();
             }
@@ -1018,6 +2274,53 @@ void st_prep_buffer()
     }
 }
 
+/* Reloads step segment buffer, called from the foreground process and, if the driver provides
+   a prep_request handler, from a low priority interrupt or task triggered by the stepper ISR.
+   The prep lock serializes the two: a call made while the foreground process holds the lock is
+   deferred and then executed by the lock owner when the lock is released.
+   NOTE: Assumes the low priority context may preempt the foreground process but never the other
+   way around, so the lock needs no atomic operations.
+*/
+void st_prep_buffer (void)
+{
+    if(prep_lock) {
+        prep_deferred = true;
+        return;
+    }
+
+    PROFILE_BEGIN(Profile_StPrepBuffer);
+
+    do {
+        prep_lock = 1;
+        prep_deferred = false;
+#ifdef ENABLE_STEPPER_STATS
+        if(hal.get_cycle_count) {
+            uint32_t start = hal.get_cycle_count();
+            prep_buffer();
+            stats_add(&stats.prep, hal.get_cycle_count() - start);
+        } else
+#endif
+        prep_buffer();
+        prep_lock = 0;
+    } while(prep_deferred);
+
+    PROFILE_END(Profile_StPrepBuffer);
+}
+
+// Locks out segment preparation from the low priority context while the foreground process
+// is modifying data used by st_prep_buffer(). Locks may be nested.
+void st_prep_lock (void)
+{
+    prep_lock++;
+}
+
+// Releases the segment preparation lock, executes any segment preparation deferred while locked.
+void st_prep_unlock (void)
+{
+    if(--prep_lock == 0 && prep_deferred)
+        st_prep_buffer();
+}
+
 
 // Called by realtime status reporting to fetch the current speed being executed. This value
 // however is not exactly the current speed, but the speed computed in the last step segment
@@ -1027,3 +2330,229 @@ float st_get_realtime_rate()
 {
     return sys.state & (STATE_CYCLE|STATE_HOMING|STATE_HOLD|STATE_JOG|STATE_SAFETY_DOOR) ? prep.current_speed : 0.0f;
 }
+
+#ifdef ENABLE_PVT_STREAM
+
+/* Queues a segment moving the signed step counts in delta over time (min) at rate (mm/min), bypassing
+   the planner. Each segment gets its own stepper block with the Bresenham data of the move.
+   Returns false if the segment buffer is full or a planner block is being prepped, the caller
+   should then retry later.
+   NOTE: Called from the foreground process only, overrides are not applied.
+*/
+bool st_queue_segment (int32_t *delta, float time, float rate)
+{
+    bool ok;
+    uint_fast8_t idx = N_AXIS;
+    uint32_t step_events = 0;
+
+    st_prep_lock();
+
+    if((ok = segment_buffer_tail != segment_next_head && pl_block == NULL && plan_get_current_block() == NULL)) {
+
+        st_block_t *st_block = st_prep_block->next;
+        segment_t *segment = segment_buffer_head;
+
+        if(st_block->output_commands) {
+            gc_output_command_free(st_block->output_commands);
+            st_block->output_commands = NULL;
+        }
+        if(st_block->message) {
+            gc_message_free(st_block->message);
+            st_block->message = NULL;
+        }
+      #ifdef ENABLE_PROBE_QUEUING
+        st_block->probing = false;
+      #endif
+      #ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+        st_block->coolant_change = false;
+      #endif
+      #ifdef ENABLE_QUEUED_WCO_CHANGE
+        st_block->wco_change = false;
+      #endif
+        st_block->overrides.value = 0;
+        st_block->dynamic_rpm = false;
+        st_block->millimeters = rate * time;
+        st_block->programmed_rate = rate;
+        st_block->steps_per_mm = 1.0f;
+        st_block->direction_bits.mask = 0;
+      #if defined(ENABLE_FLIGHT_RECORDER) || defined(ENABLE_LINE_TIMING)
+        st_block->line_number = 0;
+      #endif
+      #ifdef ENABLE_NVS_CHECKPOINT
+        st_block->checkpoint = 0;
+      #endif
+      #ifdef ENABLE_MICROSTEP_SWITCHING
+        st_block->microstep_shift = 0;
+      #endif
+
+        do {
+            idx--;
+            step_events = max(step_events, (uint32_t)labs(delta[idx]));
+            st_block->position_delta[idx] = 1;
+            if(delta[idx] < 0) {
+                st_block->direction_bits.mask |= bit(idx);
+                st_block->position_delta[idx] = -1;
+            }
+          #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            st_block->steps[idx] = (uint32_t)labs(delta[idx]) << MAX_AMASS_LEVEL;
+          #else
+            st_block->steps[idx] = (uint32_t)labs(delta[idx]) << 1;
+           #ifdef STEP_PHASE_SMOOTHING
+            st_block->step_inv[idx] = delta[idx] ? (uint32_t)(0x100000000ULL / st_block->steps[idx]) : 0;
+           #endif
+          #endif
+        } while(idx);
+
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        st_block->step_event_count = step_events << MAX_AMASS_LEVEL;
+      #else
+        st_block->step_event_count = step_events << 1;
+      #endif
+
+        st_prep_block = st_block;
+
+        segment->exec_block = st_block;
+        segment->update_rpm = false;
+        segment->spindle_sync = segment->cruising = false;
+        segment->n_step = (uint_fast16_t)step_events;
+        segment->current_rate = prep.current_speed = rate;
+      #ifdef ENABLE_LASER_POWER_RAMP
+        segment->spindle_pwm_delta = 0;
+      #endif
+      #ifdef SEGMENT_BUFFER_TIME
+        segment->time = time;
+      #endif
+        // Step events are evenly spread over the segment time, a segment without steps is executed as a single tick.
+        segment->cycles_per_tick = segment_step_timing(segment, (uint32_t)ceilf(cycles_per_min * time / (float)max(step_events, 1)));
+
+        segment_buffer_head = segment_next_head;
+        segment_next_head = segment_next_head->next;
+
+      #ifdef ENABLE_FLIGHT_RECORDER
+        flightrec_log(FlightRec_Prep, segment->cycles_per_tick, segment->n_step, segment->amass_level, segment_buffer_count(), 0);
+      #endif
+    }
+
+    st_prep_unlock();
+
+    return ok;
+}
+
+// Returns the number of segments left to execute, including the segment being executed.
+uint_fast8_t st_segments_queued (void)
+{
+    int_fast8_t count = (segment_t *)segment_buffer_head - (segment_t *)segment_buffer_tail;
+
+    return count < 0 ? count + SEGMENT_BUFFER_SIZE : count;
+}
+
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+
+// Returns RAM used by the segment buffer and the segment block data buffer.
+uint32_t st_get_buffer_memory (void)
+{
+    return sizeof(segment_buffer) + sizeof(st_block_buffer);
+}
+
+#endif
+
+#ifdef SEGMENT_BUFFER_TIME
+
+// Returns the motion time queued in the segment buffer (min), including the segment being executed.
+// NOTE: The stepper ISR may advance the tail while walking the buffer, the segment data is not
+// overwritten until prepped again so the result is at most one segment off.
+float st_get_buffered_time (void)
+{
+    float time = 0.0f;
+    segment_t *segment = (segment_t *)segment_buffer_tail;
+
+    while (segment != segment_buffer_head) {
+        time += segment->time;
+        segment = segment->next;
+    }
+
+    return time;
+}
+
+#endif
+
+#ifdef ENABLE_JOB_ESTIMATE
+
+// Returns the execution time (min) of step segments prepared by st_prep_buffer(), the segments are discarded
+// without outputting any steps. Segments are consumed until the segment generator has freed a planner block,
+// or until all blocks are executed if flush is true. Blocks are thus locked into the segment buffer ahead of
+// execution, and their profiles recomputed on replanning, the same way as when the job is executed.
+// NOTE: Called by the job time estimator while the parser runs in check mode, the steppers are not running.
+float st_estimate_segments (bool flush)
+{
+    float time = 0.0f;
+    uint_fast16_t available = plan_get_block_buffer_available();
+    segment_t *segment;
+
+    do {
+        st_prep_buffer();
+        if((segment = (segment_t *)segment_buffer_tail) == segment_buffer_head)
+            break;
+#ifdef ENABLE_STEP_BURST
+        time += (float)((max(segment->n_step, 1) + segment->step_burst - 1) / segment->step_burst) * (float)segment->cycles_per_tick / cycles_per_min;
+#else
+        time += (float)max(segment->n_step, 1) * (float)segment->cycles_per_tick / cycles_per_min;
+#endif
+        segment_buffer_tail = segment->next;
+    } while(flush || plan_get_block_buffer_available() == available);
+
+    return time;
+}
+
+#endif
+
+#if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+
+// Sets the axes to compensate and the direction of their last motion, converts the backlash settings to steps.
+// Called on reset and after homing, must not be called while motion is executing.
+void st_backlash_init (axes_signals_t enabled, axes_signals_t dir_negative)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    memset(&backlash, 0, sizeof(backlash));
+
+    do {
+        idx--;
+        if((enabled.mask & bit(idx)) && settings.axis[idx].max_rate > 0.0f &&
+             (backlash.steps[idx] = (uint32_t)lroundf(settings.axis[idx].backlash * settings.axis[idx].steps_per_mm))) {
+            backlash.enabled.mask |= bit(idx);
+            backlash.min_cycles[idx] = (uint32_t)ceilf((float)hal.f_step_timer * 60.0f / (settings.axis[idx].max_rate * settings.axis[idx].steps_per_mm));
+        }
+    } while(idx);
+
+    backlash.dir_negative.mask = dir_negative.mask & backlash.enabled.mask;
+}
+
+#endif
+
+#ifdef ENABLE_STEP_INJECTION
+
+void st_inject_steps (int32_t steps)
+{
+    if(injection.min_cycles == 0)
+        injection_update_rate();
+
+    hal.irq_disable();
+    injection.pending += steps;
+    hal.irq_enable();
+}
+
+void st_set_injection_rate (float rate)
+{
+    injection.rate = rate;
+    injection_update_rate();
+}
+
+int32_t st_get_injection_pending (void)
+{
+    return injection.pending;
+}
+
+#endif
@@ -30,6 +30,9 @@
 #define SEGMENT_BUFFER_SIZE 10
 #endif
 
+#define STEP_BURST_MAX 8 // Max number of step events per ISR tick in burst mode, 2^3 (max hal.driver_cap.step_burst)
+
+
 typedef enum {
     SquaringMode_Both = 0,
     SquaringMode_A,
@@ -53,9 +56,49 @@ typedef struct st_block {
     char *message;                     // Message to be displayed when block is executed
     output_command_t *output_commands; // Output commands (linked list) to be performed when block is executed
     bool dynamic_rpm;                  // Tracks motions that require dynamic RPM adjustment
-    bool backlash_motion;
+    int32_t position_delta[N_AXIS];    // Signed machine position change per axis step, zero for backlash compensation motions
+#ifdef ENABLE_PROBE_QUEUING
+    bool probing;                      // Activates probing when the block is started
+#endif
+#ifdef ENABLE_QUEUED_SPINDLE_COOLANT
+    bool coolant_change;               // Sets the coolant state when the block is started
+    coolant_state_t coolant;
+#endif
+#ifdef ENABLE_QUEUED_WCO_CHANGE
+    bool wco_change;                   // Updates the reported work coordinate offsets when the block is started
+#endif
+#ifdef STEP_PHASE_SMOOTHING
+    uint32_t step_inv[N_AXIS];         // Reciprocal of steps, 0.32 fixed point, zero for axes not moving
+#endif
+#if defined(ENABLE_FLIGHT_RECORDER) || defined(ENABLE_LINE_TIMING)
+    int32_t line_number;               // Line number of the planner block, for the flight recorder and line timing
+#endif
+#ifdef ENABLE_NVS_CHECKPOINT
+    uint32_t checkpoint;               // Checkpoint tag of the planner block
+#endif
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    uint_fast8_t microstep_shift;      // Microstep resolution divider, steps are in units of 2^microstep_shift microsteps
+#endif
 } st_block_t;
 
+#ifdef ENABLE_INPUT_SHAPING
+
+#ifdef INPUT_SHAPER_ZVD
+#define INPUT_SHAPER_IMPULSES 3
+#else
+#define INPUT_SHAPER_IMPULSES 2
+#endif
+
+// Input shaper impulse sequence, the impulse amplitudes add up to 1.
+typedef struct {
+    uint_fast8_t impulses;                  // Number of impulses, 1 if shaping is disabled
+    float amplitude[INPUT_SHAPER_IMPULSES]; // Impulse amplitudes
+    float time[INPUT_SHAPER_IMPULSES];      // Impulse times (min)
+    float delay;                            // Shaper duration less the amplitude weighted mean impulse time (min)
+} input_shaper_t;
+
+#endif
+
 typedef struct st_segment {
     uint_fast8_t id;                // Id may be used by driver to track changes
     struct st_segment *next;        // Pointer to next element in cirular list of segments
@@ -66,6 +109,9 @@ typedef struct st_segment {
     uint_fast16_t n_step;           // Number of step events to be executed for this segment
 #ifdef SPINDLE_PWM_DIRECT
     uint_fast16_t spindle_pwm;      // Spindle PWM to be set at the start of segment execution
+#ifdef ENABLE_LASER_POWER_RAMP
+    int32_t spindle_pwm_delta;      // Spindle PWM change per LASER_POWER_RAMP_STEPS step events, 24.8 fixed point. 0 if not ramping.
+#endif
 #else
     float spindle_rpm;              // Spindle RPM to be set at the start of the segment execution
 #endif
@@ -73,35 +119,45 @@ typedef struct st_segment {
     bool spindle_sync;              // True if block is spindle synchronized
     bool cruising;                  // True when in cruising part of profile, only set for spindle synced moves
     uint_fast8_t amass_level;       // Indicates AMASS level for the ISR to execute this segment
+    uint_fast8_t step_burst;        // Number of step events to be executed per ISR tick, 1 if not in burst mode
+#ifdef SEGMENT_BUFFER_TIME
+    float time;                     // Segment execution time (min)
+#endif
 } segment_t;
 
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
 typedef struct {
     // Used by the bresenham line algorithm
-    uint32_t counter_x,        // Counter variables for the bresenham line tracer
-             counter_y,
-             counter_z
-    #ifdef A_AXIS
-           , counter_a
-    #endif
-    #ifdef B_AXIS
-          , counter_b
-    #endif
-    #ifdef C_AXIS
-          , counter_c
-    #endif
-;
+    uint32_t counter[N_AXIS];       // Counter variables for the bresenham line tracer
+    int32_t position_delta[N_AXIS]; // Signed machine position change per step, copied from the block
+
     bool new_block;                 // Set to true when a new block is started, might be used by driver for advanced functionality
     bool dir_change;                // Set to true on direction changes, might be used by driver for advanced functionality
     axes_signals_t step_outbits;    // The next stepping-bits to be output
     axes_signals_t dir_outbits;     // The next direction-bits to be output
+    uint_fast8_t burst_steps;       // Number of step events in step_burst to be output back to back, 0 if not in burst mode.
+                                    // step_outbits holds all the bits set in step_burst when in burst mode.
+    axes_signals_t step_burst[STEP_BURST_MAX]; // The next step events to be output when in burst mode
+#ifdef STEP_PHASE_SMOOTHING
+    uint32_t step_delay[N_AXIS];    // Delay from start of step event to step pulse per axis (timer cycles), set for the axes in step_outbits.
+                                    // Less than the segment cycles_per_tick, not set in burst mode.
+#endif
+
     uint32_t steps[N_AXIS];
     uint_fast8_t amass_level;       // AMASS level for this segment
 //    uint_fast16_t spindle_pwm;
     uint_fast16_t step_count;       // Steps remaining in line segment motion
+#ifdef ENABLE_LASER_POWER_RAMP
+    int32_t spindle_pwm;            // Current ramped spindle PWM value, 24.8 fixed point
+    uint_fast16_t pwm_ramp_steps;   // Step events since last PWM update
+#endif
     uint32_t step_event_count;
     st_block_t *exec_block;         // Pointer to the block data for the segment being executed
     segment_t *exec_segment;        // Pointer to the segment being executed
+    bool driver_segment;            // True when the segment being executed was loaded by hal.stepper.load_segment()
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    uint_fast8_t microstep_shift;   // Microstep resolution divider set by hal.stepper.set_microstep_shift()
+#endif
 } stepper_t;
 
 // Initialize and setup the stepper motor subsystem
@@ -128,12 +184,129 @@ void st_parking_restore_buffer();
 // Reloads step segment buffer. Called continuously by realtime execution system.
 void st_prep_buffer();
 
+// Locks out and releases segment preparation from the low priority context, if any, while modifying planner data.
+void st_prep_lock (void);
+void st_prep_unlock (void);
+
+#ifdef ENABLE_PVT_STREAM
+// Queues a segment moving delta steps per axis over time (min) at rate (mm/min), bypassing the planner.
+// Returns false if the segment buffer is full or planner blocks are being executed.
+bool st_queue_segment (int32_t *delta, float time, float rate);
+
+// Returns the number of segments left to execute.
+uint_fast8_t st_segments_queued (void);
+#endif
+
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters();
 
 // Called by realtime status reporting if realtime rate reporting is enabled in config.h.
 float st_get_realtime_rate();
 
+#if defined(ENABLE_BACKLASH_COMPENSATION) && defined(BACKLASH_COMPENSATION_ISR)
+// Sets the axes with stepper ISR backlash compensation and the current backlash direction.
+void st_backlash_init (axes_signals_t enabled, axes_signals_t dir_negative);
+#endif
+
+#ifdef ENABLE_STEP_INJECTION
+// Queues signed steps for injection on the step injection axis.
+void st_inject_steps (int32_t steps);
+// Sets max injection rate (mm/min), 0 for the axis max rate.
+void st_set_injection_rate (float rate);
+// Returns number of queued steps not yet injected.
+int32_t st_get_injection_pending (void);
+#endif
+
+// Segment hooks are called from the stepper ISR once per step segment, when the segment is loaded.
+// stepper->new_block is set when the segment is the first of a planner block.
+// Plugins needing only block or segment level information should use these instead of wrapping hal.stepper.pulse_start,
+// which adds overhead to every step.
+typedef void (*stepper_segment_hook_ptr)(stepper_t *stepper);
+
+// Adds a segment hook, returns false if there is no free slot. Hooks cannot be removed.
+bool st_add_segment_hook (stepper_segment_hook_ptr hook);
+
+// Returns the number of segment hooks added.
+uint_fast8_t st_get_segment_hook_count (void);
+
+#ifdef ENABLE_MEMORY_REPORT
+// Returns RAM used by the segment buffers.
+uint32_t st_get_buffer_memory (void);
+#endif
+
+#ifdef SEGMENT_BUFFER_TIME
+
+// Returns the motion time queued in the segment buffer (min).
+float st_get_buffered_time (void);
+#endif
+
+#ifdef ENABLE_JOB_ESTIMATE
+// Returns the execution time (min) of the segments prepared from the planner blocks, without executing them.
+float st_estimate_segments (bool flush);
+#endif
+
+#ifndef UNDERRUN_LOG_SIZE
+#define UNDERRUN_LOG_SIZE 8
+#endif
+
+// Segment buffer underrun, the segment buffer ran empty while the planner still had blocks to execute.
+typedef struct {
+    uint32_t ms;            // Time of the underrun, as returned by hal.get_elapsed_ticks()
+    int32_t line_number;    // Line number of the block being executed
+} st_underrun_t;
+
+typedef struct {
+    uint32_t count;         // Number of underruns since cleared
+    uint_fast8_t head;      // Index of the next log entry, the oldest entry when the log is full
+    st_underrun_t log[UNDERRUN_LOG_SIZE];
+} st_underruns_t;
+
+// Returns pointer to the segment buffer underrun log.
+st_underruns_t *st_get_underruns (void);
+
+// Clears the segment buffer underrun log.
+void st_clear_underruns (void);
+
+#ifdef ENABLE_MOTION_BENCHMARK
+// Masks off step outputs, the machine position is still updated.
+void st_mask_steps (bool on);
+#endif
+
+#ifdef ENABLE_STEPPER_STATS
+
+// Execution time statistics in CPU cycles, as counted by hal.get_cycle_count().
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint32_t samples;
+    uint64_t total;
+} st_cycles_t;
+
+typedef struct {
+    st_cycles_t isr;     // Stepper interrupt handler
+    st_cycles_t prep;    // Step segment preparation, st_prep_buffer()
+    st_cycles_t pulse;   // hal.stepper.pulse_start() including any plugins chained to it
+    uint32_t underflows; // Number of times the segment buffer ran empty before motion was completed
+} st_stats_t;
+
+// Returns pointer to the execution time statistics, NULL if not available.
+st_stats_t *st_get_stats (void);
+
+// Clears the execution time statistics.
+void st_clear_stats (void);
+
+#endif
+
+
+#ifdef ENABLE_INPUT_SHAPING
+// Computes the input shaper for an axis from its resonance frequency and damping ratio settings.
+void st_get_input_shaper(input_shaper_t *shaper, uint_fast8_t axis);
+#endif
+
+
 void stepper_driver_interrupt_handler (void);
 
+void probe_interrupt_handler (void);
+
 #endif
@@ -0,0 +1,94 @@
+/*
+  stream.c - input filter for stream drivers
+
+  Part of GrblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+
+#ifdef ENABLE_RX_FILTER
+
+/* Filters a character received, after real-time commands are stripped, before it is added to the input buffer.
+   Returns the character to add, uppercased, or '\0' if it is to be discarded. Whitespace, control characters and
+   the content of comments are discarded as the protocol loop would. Comment delimiters are kept so that comment
+   only lines are still responded to, and "(MSG," comments are kept complete. System and user command lines, and
+   packed blocks, are kept as is.
+   filter->value must be set to 0 when the input buffer is flushed.
+*/
+ISR_CODE char stream_rx_filter (stream_rx_filter_t *filter, char c)
+{
+    static const char msg[] = "(MSG,";
+
+    if(c == ASCII_LF || c == ASCII_CR) {
+        filter->value = 0;
+        return c;
+    }
+
+    if(filter->raw)
+        return c;
+
+#ifdef ENABLE_PACKED_BLOCKS
+    if(c == ASCII_STX && !filter->started) {
+        filter->raw = filter->started = On;
+        return c;
+    }
+#endif
+
+    if(filter->semicolon)
+        return '\0';
+
+    if(filter->comment) {
+        if(c == ')') {
+            filter->comment = Off;
+            filter->message = 0;
+        } else if(filter->message == 5)
+            c = (uint8_t)c < ' ' ? '\0' : c;
+        else if(filter->message && CAPS(c) == msg[filter->message])
+            filter->message++;
+        else {
+            filter->message = 0;
+            c = '\0';
+        }
+        return c;
+    }
+
+    if((uint8_t)c <= ' ')
+        return '\0';
+
+    switch(c) {
+
+        case '$':
+        case '[':
+            if(!filter->started)
+                filter->raw = On;
+            break;
+
+        case '(':
+            filter->comment = On;
+            filter->message = 1;
+            return c;
+
+        case ';':
+            filter->semicolon = On;
+            return c;
+    }
+
+    filter->started = On;
+
+    return CAPS(c);
+}
+
+#endif
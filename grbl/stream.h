@@ -22,6 +22,7 @@
 #ifndef _STREAM_H_
 #define _STREAM_H_
 
+#define ASCII_STX  0x02
 #define ASCII_ETX  0x03
 #define ASCII_ACK  0x06
 #define ASCII_BS   0x08
@@ -103,4 +104,19 @@ typedef struct {
     char data[BLOCK_TX_BUFFER_SIZE];
 } stream_block_tx_buffer_t;
 
+// Input filter state, see stream_rx_filter().
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t started   :1, // Character other than a comment stored for the current line
+                raw       :1, // System or user command or packed block, all characters are stored
+                comment   :1, // In () comment
+                semicolon :1, // In ; comment
+                message   :3, // Number of characters of "(MSG," matched, 5 when in a message comment
+                unassigned:1;
+    };
+} stream_rx_filter_t;
+
+char stream_rx_filter (stream_rx_filter_t *filter, char c);
+
 #endif
@@ -31,6 +31,15 @@
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
+#ifdef ENABLE_PARSER_BENCHMARK
+#include "gcode_bench.h"
+#endif
+#ifdef ENABLE_MOTION_BENCHMARK
+#include "motion_bench.h"
+#endif
+#ifdef ENABLE_IRQ_STATS
+#include "irq_stats.h"
+#endif
 
 // Pin change interrupt for pin-out commands, i.e. cycle start, feed hold, and reset. Sets
 // only the realtime command execute variable to have the main program execute these when
@@ -59,13 +68,13 @@ ISR_CODE void control_interrupt_handler (control_signals_t signals)
             }
 #endif
             if (signals.probe_triggered) {
-                if(sys_probing_state == Probing_Off && (sys.state & (STATE_CYCLE|STATE_JOG))) {
+                if(sys_probing_state != Probing_Active && (sys.state & (STATE_CYCLE|STATE_JOG))) {
                     system_set_exec_state_flag(EXEC_STOP);
                     sys.alarm_pending = Alarm_ProbeProtect;
                 } else
                     hal.probe.configure(false, false);
             } else if (signals.probe_disconnected) {
-                if(sys_probing_state == Probing_Active && sys.state == STATE_CYCLE) {
+                if(sys_probing_state != Probing_Off && sys.state == STATE_CYCLE) {
                     system_set_exec_state_flag(EXEC_FEED_HOLD);
                     sys.alarm_pending = Alarm_ProbeProtect;
                 }
@@ -94,6 +103,34 @@ void system_execute_startup (char *line)
     }
 }
 
+#ifdef ENABLE_VELOCITY_JOG
+
+// Parses $JV=<axis><velocity>[<axis><velocity>...] and sets the velocity jog target, axes not given are stopped.
+// Velocities are in mm/min or inches/min depending on the G20/G21 modal state.
+static status_code_t jog_velocity (char *line)
+{
+    float value, velocity[N_AXIS] = {0};
+    uint_fast8_t axis, char_counter = 0;
+
+    while(line[char_counter]) {
+
+        for(axis = 0; axis < N_AXIS && line[char_counter] != *axis_letter[axis]; axis++);
+
+        if(axis == N_AXIS)
+            return Status_InvalidStatement;
+
+        char_counter++;
+
+        if(!read_float(line, &char_counter, &value))
+            return Status_BadNumberFormat;
+
+        velocity[axis] = gc_state.modal.units_imperial ? value * MM_PER_INCH : value;
+    }
+
+    return mc_jog_velocity(velocity);
+}
+
+#endif
 
 // Directs and executes one line of formatted input from protocol_process. While mostly
 // incoming streaming g-code blocks, this also executes Grbl internal commands, such as
@@ -134,6 +171,10 @@ status_code_t system_execute_line (char *line)
         case 'J': // Jogging, execute only if in IDLE or JOG states.
             if (!(sys.state == STATE_IDLE || (sys.state & (STATE_JOG|STATE_TOOL_CHANGE))))
                 retval = Status_IdleError;
+#ifdef ENABLE_VELOCITY_JOG
+            else if(line[2] == 'V')
+                retval = line[3] != '=' ? Status_InvalidStatement : jog_velocity(&line[4]);
+#endif
             else
                 retval = line[2] != '=' ? Status_InvalidStatement : gc_execute_block(line, NULL); // NOTE: $J= is ignored inside g-code parser and used to detect jog motions.
             break;
@@ -146,9 +187,9 @@ status_code_t system_execute_line (char *line)
                 retval =  Status_IdleError; // Block during cycle. Takes too long to print.
             else
 #if COMPATIBILITY_LEVEL <= 1
-            report_grbl_settings(true);
+            report_grbl_settings_incremental(true);
 #else
-            report_grbl_settings(line[1] == '+');
+            report_grbl_settings_incremental(line[1] == '+');
 #endif
             break;
 
@@ -162,6 +203,17 @@ status_code_t system_execute_line (char *line)
             break;
 
         case 'B': // Toggle block delete mode
+#ifdef ENABLE_MOTION_BENCHMARK
+            if(!strncmp(line, "$BENCH", 6)) { // Run motion pipeline benchmark, see motion_bench_run()
+                uint_fast8_t counter = 7;
+                float lines = 0.0f;
+                if(line[6] == '\0' || (line[6] == '=' && read_float(line, &counter, &lines) && line[counter] == '\0' && isintf(lines) && lines >= 2.0f))
+                    retval = motion_bench_run((uint32_t)lines);
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
+#endif
             if (line[2] != '\0')
                 retval = Status_InvalidStatement;
             else {
@@ -286,7 +338,19 @@ status_code_t system_execute_line (char *line)
                 retval = Status_OK;
             break;
 
-        case 'S': // Puts Grbl to sleep [IDLE/ALARM]
+        case 'S':
+#ifdef ENABLE_STEPPER_STATS
+            if(line[2] == 'T' && line[3] == 'A' && line[4] == 'T' && line[5] == 'S') { // Print or clear stepper execution time statistics
+                if(line[6] == '\0')
+                    retval = report_stepper_stats();
+                else if(line[6] == '=' && line[7] == '0' && line[8] == '\0')
+                    st_clear_stats();
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
+#endif
+            // Puts Grbl to sleep [IDLE/ALARM]
             if(!settings.flags.sleep_enable || !(line[2] == 'L' && line[3] == 'P' && line[4] == '\0'))
                 retval = Status_InvalidStatement;
             else if(!(sys.state == STATE_IDLE || sys.state == STATE_ALARM))
@@ -331,9 +395,23 @@ status_code_t system_execute_line (char *line)
             break;
 
         case 'I': // Print or store build info. [IDLE/ALARM]
+#ifdef ENABLE_IRQ_STATS
+            if(line[2] == 'R' && line[3] == 'Q') { // Print or clear interrupt latency and execution time statistics
+                if(line[4] == '\0')
+                    retval = irq_stats_report();
+                else if(line[4] == '=' && line[5] == '0' && line[6] == '\0')
+                    irq_stats_clear();
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
+#endif
             if (!(sys.state == STATE_IDLE || (sys.state & (STATE_ALARM|STATE_ESTOP|STATE_CHECK_MODE))))
                 retval = Status_IdleError;
             else if (line[2] == '\0') {
+              #ifdef ENABLE_REPORT_CACHE
+                if(!report_build_info_cached()) // Cached report includes the build info line.
+              #endif
                 settings_read_build_info(line);
                 report_build_info(line);
             }
@@ -346,6 +424,15 @@ status_code_t system_execute_line (char *line)
             break;
 
         case 'R': // Restore defaults [IDLE/ALARM]
+            if(line[2] == 'T' && line[3] == 'Q') { // Print or clear realtime command queue statistics
+                if(line[4] == '\0')
+                    report_rt_queue_stats();
+                else if(line[4] == '=' && line[5] == '0' && line[6] == '\0')
+                    protocol_clear_rt_queue_stats();
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
             {
                 settings_restore_t restore = {0};
                 if (!(line[2] == 'S' && line[3] == 'T' && line[4] == '=' && line[6] == '\0'))
@@ -430,6 +517,54 @@ status_code_t system_execute_line (char *line)
 #endif
 
         default:
+#ifdef ENABLE_ACK_WINDOW
+            if(!strncmp(line, "$ACK=", 5)) { // Set windowed acknowledge mode, see protocol_set_ack_window()
+                uint_fast8_t counter = 5;
+                float window;
+                if(!read_float(line, &counter, &window) || line[counter] != '\0')
+                    retval = Status_BadNumberFormat;
+                else if(!isintf(window) || window < 0.0f || window > (float)ACK_WINDOW_MAX)
+                    retval = Status_InvalidStatement;
+                else
+                    protocol_set_ack_window((uint_fast16_t)window);
+                break;
+            }
+#endif
+#ifdef ENABLE_STREAM_COMPRESSION
+            if(!strncmp(line, "$ZIP=", 5)) { // Enable or disable compressed input, see protocol_set_stream_compression()
+                if(line[5] != '\0' && line[6] == '\0' && (line[5] == '0' || line[5] == '1'))
+                    protocol_set_stream_compression(line[5] == '1');
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
+#endif
+            if(!strncmp(line, "$UNDERRUN", 9)) { // Print or clear segment buffer underrun log, see st_get_underruns()
+                if(line[9] == '\0')
+                    report_underruns();
+                else if(!strcmp(&line[9], "=0"))
+                    st_clear_underruns();
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
+#ifdef ENABLE_MEMORY_REPORT
+            if(!strcmp(line, "$MEM")) { // Print RAM use by subsystem, see report_memory()
+                retval = report_memory();
+                break;
+            }
+#endif
+#ifdef ENABLE_PARSER_BENCHMARK
+            if(!strncmp(line, "$PBENCH", 7)) { // Run g-code parser benchmark, see gc_bench_run()
+                uint_fast8_t counter = 8;
+                float lines = 0.0f;
+                if(line[7] == '\0' || (line[7] == '=' && read_float(line, &counter, &lines) && line[counter] == '\0' && isintf(lines) && lines >= 1.0f))
+                    retval = gc_bench_run((uint32_t)lines);
+                else
+                    retval = Status_InvalidStatement;
+                break;
+            }
+#endif
             retval = Status_Unhandled;
 
             // Let user code have a peek at system commands before check for global setting
@@ -463,6 +598,25 @@ void system_flag_wco_change ()
     sys.report.wco = On;
 }
 
+// Copies the real-time machine position (steps) to position. The stepper ISR increments sys_position_seq
+// before and after updating sys_position, the copy is retried if the counter changed while it was made.
+// NOTE: The barriers, here and in the stepper ISR, keep the copy from being moved outside the check by
+//       the compiler or by the memory system of multi-core targets.
+void system_get_position (int32_t *position)
+{
+    uint_fast8_t idx;
+    uint32_t seq;
+    volatile int32_t *steps = sys_position;
+
+    do {
+        while((seq = sys_position_seq) & 1); // Update in progress, stepper ISR running on another core.
+        MEMORY_BARRIER();
+        for(idx = 0; idx < N_AXIS; idx++)
+            position[idx] = steps[idx];
+        MEMORY_BARRIER();
+    } while(seq != sys_position_seq);
+}
+
 // Sets machine position. Must be sent a 'step' array.
 // NOTE: If motor steps and machine position are not in the same coordinate frame, this function
 //       serves as a central place to compute the transformation.
@@ -474,15 +628,26 @@ void system_convert_array_steps_to_mpos (float *position, int32_t *steps)
     uint_fast8_t idx = N_AXIS;
     do {
         idx--;
-        position[idx] = steps[idx] / settings.axis[idx].steps_per_mm;
+        position[idx] = steps[idx] * derived_settings.mm_per_step[idx];
     } while(idx);
 #endif
 }
 
 // Checks and reports if target array exceeds machine travel limits. Returns false if check failed.
+bool system_check_travel_limits (float *target)
+{
+#ifdef KINEMATICS_API
+    if(kinematics.check_travel_limits)
+        return kinematics.check_travel_limits(target);
+#endif
+
+    return system_check_axis_limits(target);
+}
+
+// Checks and reports if target array exceeds the per axis travel limits. Returns false if check failed.
 // NOTE: max_travel is stored as negative
 // TODO: only check homed axes?
-bool system_check_travel_limits (float *target)
+bool system_check_axis_limits (float *target)
 {
     bool failed = false;
     uint_fast8_t idx = N_AXIS;
@@ -511,6 +676,13 @@ void system_apply_jog_limits (float *target)
 {
     uint_fast8_t idx = N_AXIS;
 
+#ifdef KINEMATICS_API
+    if(kinematics.apply_jog_limits) {
+        kinematics.apply_jog_limits(target, gc_state.position);
+        return;
+    }
+#endif
+
     if(sys.homed.mask) do {
         idx--;
         float pulloff = settings.limits.flags.hard_enabled && bit_istrue(sys.homing.mask, bit(idx)) ? settings.homing.pulloff : 0.0f;
@@ -169,6 +169,7 @@ typedef struct {
     uint_fast16_t idx;
     float setpoint;
     float t_sample;
+    uint32_t t_exec_max;    // Max PID execution time in CPU cycles, set by the driver if supported.
     float target[PID_LOG];
     float actual[PID_LOG];
 } pid_data_t;
@@ -206,16 +207,19 @@ typedef struct {
 } overrides_t;
 
 typedef union {
-    uint8_t value;
+    uint16_t value;
     struct {
-        uint8_t mpg_mode              :1, // MPG mode flag. Set when switched to secondary input stream. (unused for now)
+        uint16_t mpg_mode             :1, // MPG mode flag. Set when switched to secondary input stream. (unused for now)
                 probe_succeeded       :1, // Tracks if last probing cycle was successful.
                 soft_limit            :1, // Tracks soft limit errors for the state machine.
                 exit                  :1, // System exit flag. Used in combination with abort to terminate main loop.
                 block_delete_enabled  :1, // Set to true to enable block delete
                 feed_hold_pending     :1,
                 delay_overrides       :1,
-                optional_stop_disable :1; // Set to true to disable M1 (optional stop), via realtime command
+                optional_stop_disable :1, // Set to true to disable M1 (optional stop), via realtime command
+                estimate              :1, // Set when the job time estimator is active, see mc_estimate_start().
+                jog_cancel            :1, // Set when a jog is canceled, stops queuing of segmented jog motions.
+                unused                :6;
     };
 } system_flags_t;
 
@@ -242,20 +246,36 @@ typedef struct {
     hold_state_t holding_state;         // Tracks holding state
     float home_position[N_AXIS];        // Home position for homed axes
     float spindle_rpm;
+#ifdef ENABLE_ADAPTIVE_SPLINE_SEGMENTATION
+    uint16_t spline_segments;           // Number of line segments output by the last G5 spline, cleared when reported.
+#endif
 #ifdef PID_LOG
+
     pid_data_t pid_log;
 #endif
 } system_t;
 
-extern system_t sys;
+extern THREAD_LOCAL system_t sys;
 
 // NOTE: These position variables may need to be declared as volatiles, if problems arise.
-extern int32_t sys_position[N_AXIS];      // Real-time machine (aka home) position vector in steps.
-extern int32_t sys_probe_position[N_AXIS]; // Last probe position in machine coordinates and steps.
+extern THREAD_LOCAL int32_t sys_position[N_AXIS];      // Real-time machine (aka home) position vector in steps.
+extern THREAD_LOCAL int32_t sys_probe_position[N_AXIS]; // Last probe position in machine coordinates and steps.
+extern THREAD_LOCAL volatile uint32_t sys_position_seq; // Incremented by the stepper ISR before and after sys_position is updated.
+
+// Orders the sys_position accesses against the sys_position_seq updates, for the compiler and for
+// multi-core targets where the stepper ISR may run on another core than the foreground process.
+#ifndef MEMORY_BARRIER
+#if defined(__GNUC__)
+#define MEMORY_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define MEMORY_BARRIER()
+#endif
+#endif
 
-extern volatile probing_state_t sys_probing_state; // Probing state value.  Used to coordinate the probing cycle with stepper ISR.
-extern volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
-extern volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtimeate val executor bitflag variable for setting various alarms.
+extern THREAD_LOCAL volatile probing_state_t sys_probing_state; // Probing state value.  Used to coordinate the probing cycle with stepper ISR.
+extern THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
+extern THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtimeate val executor bitflag variable for setting various alarms.
+extern THREAD_LOCAL volatile bool sys_rt_exec_pending;          // Set whenever any of the above is set or an override is enqueued, see system_set_exec_pending().
 
 // Executes an internal system command, defined as a string starting with a '$'
 status_code_t system_execute_line(char *line);
@@ -271,17 +291,26 @@ void system_flag_wco_change();
 // Updates a machine 'position' array based on the 'step' array sent.
 void system_convert_array_steps_to_mpos(float *position, int32_t *steps);
 
+// Copies the real-time machine position 'step' array without tearing and without disabling interrupts.
+void system_get_position (int32_t *position);
+
 // Checks and reports if target array exceeds machine travel limits.
 bool system_check_travel_limits(float *target);
 
+// Checks and reports if target array exceeds the per axis travel limits, may be used by kinematics in joint space.
+bool system_check_axis_limits (float *target);
+
 // Checks and limit jog commands to within machine travel limits.
 void system_apply_jog_limits (float *target);
 
 // Special handlers for setting and clearing Grbl's real-time execution flags.
-#define system_set_exec_state_flag(mask) hal.set_bits_atomic(&sys_rt_exec_state, (mask))
+// NOTE: protocol_exec_rt_system() only checks the flags and the override queues when sys_rt_exec_pending is set,
+//       code setting sys_rt_exec_state or sys_rt_exec_alarm other than via these handlers must call system_set_exec_pending().
+#define system_set_exec_pending() (sys_rt_exec_pending = true)
+#define system_set_exec_state_flag(mask) (hal.set_bits_atomic(&sys_rt_exec_state, (mask)), system_set_exec_pending())
 #define system_clear_exec_state_flag(mask) hal.clear_bits_atomic(&sys_rt_exec_state, (mask))
 #define system_clear_exec_states() hal.set_value_atomic(&sys_rt_exec_state, 0)
-#define system_set_exec_alarm(code) hal.set_value_atomic(&sys_rt_exec_alarm, (uint_fast16_t)(code))
+#define system_set_exec_alarm(code) (hal.set_value_atomic(&sys_rt_exec_alarm, (uint_fast16_t)(code)), system_set_exec_pending())
 #define system_clear_exec_alarm() hal.set_value_atomic(&sys_rt_exec_alarm, 0)
 
 void control_interrupt_handler (control_signals_t signals);
@@ -37,16 +37,20 @@
 #define TOOL_CHANGE_PROBE_RETRACT_DISTANCE 2.0f
 #endif
 
-static bool block_cycle_start;
-static volatile bool execute_posted = false;
-static volatile uint32_t spin_lock = 0;
-static float tool_change_position;
-static tool_data_t current_tool = {0}, *next_tool = NULL;
-static plane_t plane;
-static coord_data_t target = {0}, previous;
-static driver_reset_ptr driver_reset = NULL;
-static enqueue_realtime_command_ptr enqueue_realtime_command = NULL;
-static control_signals_callback_ptr control_interrupt_callback = NULL;
+#ifndef TOOL_CHANGE_PROBE_CLEARANCE
+#define TOOL_CHANGE_PROBE_CLEARANCE 0.5f
+#endif
+
+static THREAD_LOCAL bool block_cycle_start;
+static THREAD_LOCAL volatile bool execute_posted = false;
+static THREAD_LOCAL volatile uint32_t spin_lock = 0;
+static THREAD_LOCAL float tool_change_position;
+static THREAD_LOCAL tool_data_t current_tool = {0}, *next_tool = NULL;
+static THREAD_LOCAL plane_t plane;
+static THREAD_LOCAL coord_data_t target = {0}, previous;
+static THREAD_LOCAL driver_reset_ptr driver_reset = NULL;
+static THREAD_LOCAL enqueue_realtime_command_ptr enqueue_realtime_command = NULL;
+static THREAD_LOCAL control_signals_callback_ptr control_interrupt_callback = NULL;
 
 // Set tool offset on successful $TPW probe, prompt for retry on failure.
 // Called via probe completed event.
@@ -170,6 +174,14 @@ static void execute_probe (uint_fast16_t state)
     coord_data_t offset;
     plan_line_data_t plan_data = {0};
     gc_parser_flags_t flags = {0};
+#ifdef ENABLE_FAST_TOOL_SETTER
+    // The latched seek probe position is accurate enough, a slow probe is only needed if not latched.
+    bool slow_probe = !hal.driver_cap.probe_latch;
+    float retract = TOOL_CHANGE_PROBE_CLEARANCE;
+#else
+    const bool slow_probe = true;
+    const float retract = TOOL_CHANGE_PROBE_RETRACT_DISTANCE;
+#endif
 
     // G59.3 contains offsets to position of TLS.
     settings_read_coord_data(CoordinateSystem_G59_3, &offset.values);
@@ -188,15 +200,15 @@ static void execute_probe (uint_fast16_t state)
         plan_data.condition.value = 0;
         target.values[plane.axis_linear] -= settings.tool_change.probing_distance;
 
-        if((ok = ok && mc_probe_cycle(target.values, &plan_data, flags) == GCProbe_Found))
+        if((ok = ok && mc_probe_cycle(target.values, &plan_data, flags) == GCProbe_Found) && slow_probe)
         {
             system_convert_array_steps_to_mpos(target.values, sys_probe_position);
 
             // Retract a bit and perform slow probe.
-            target.values[plane.axis_linear] += TOOL_CHANGE_PROBE_RETRACT_DISTANCE;
+            target.values[plane.axis_linear] += retract;
             if((ok = mc_line(target.values, &plan_data))) {
                 plan_data.feed_rate = settings.tool_change.feed_rate;
-                target.values[plane.axis_linear] -= (TOOL_CHANGE_PROBE_RETRACT_DISTANCE + 2.0f);
+                target.values[plane.axis_linear] -= (retract + 2.0f);
                 ok = mc_probe_cycle(target.values, &plan_data, flags) == GCProbe_Found;
             }
         }
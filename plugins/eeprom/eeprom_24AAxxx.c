@@ -27,6 +27,8 @@
 
 #if EEPROM_ENABLE == 2
 
+#include <string.h>
+
 #include "grbl/hal.h"
 #include "grbl/nuts_bolts.h"
 
@@ -62,7 +64,7 @@ static void putByte (uint32_t addr, uint8_t new_value)
 static nvs_transfer_result_t writeBlock (uint32_t destination, uint8_t *source, uint32_t size, bool with_checksum)
 {
     uint32_t remaining = size;
-    uint8_t *target = source;
+    uint8_t *target = source, page[EEPROM_PAGE_SIZE];
 
     while(remaining > 0) {
         i2c.address = EEPROM_I2C_ADDRESS;
@@ -74,6 +76,14 @@ static nvs_transfer_result_t writeBlock (uint32_t destination, uint8_t *source,
         target += i2c.count;
         destination += i2c.count;
 
+        // Add checksum to the last page write if it fits in the page, saves a write cycle.
+        if(remaining == 0 && with_checksum && (destination & (EEPROM_PAGE_SIZE - 1))) {
+            memcpy(page, i2c.data, i2c.count);
+            page[i2c.count++] = calc_checksum(source, size);
+            i2c.data = page;
+            with_checksum = false;
+        }
+
         i2c_nvs_transfer(&i2c, false);
     }
 
@@ -86,7 +96,8 @@ static nvs_transfer_result_t writeBlock (uint32_t destination, uint8_t *source,
 static nvs_transfer_result_t readBlock (uint8_t *destination, uint32_t source, uint32_t size, bool with_checksum)
 {
     uint32_t remaining = size;
-    uint8_t *target = destination;
+    uint32_t count;
+    uint8_t *target = destination, page[EEPROM_PAGE_SIZE + 1];
 
     while(remaining) {
         i2c.address = EEPROM_I2C_ADDRESS;
@@ -97,6 +108,15 @@ static nvs_transfer_result_t readBlock (uint8_t *destination, uint32_t source, u
         target += i2c.count;
         source += i2c.count;
 
+        // Read checksum along with the last chunk if it fits in the page buffer, saves a transfer.
+        if(remaining == 0 && with_checksum && (count = i2c.count) <= EEPROM_PAGE_SIZE) {
+            i2c.data = page;
+            i2c.count++;
+            i2c_nvs_transfer(&i2c, true);
+            memcpy(target - count, page, count);
+            return calc_checksum(destination, size) == page[count] ? NVS_TransferResult_OK : NVS_TransferResult_Failed;
+        }
+
         i2c_nvs_transfer(&i2c, true);
     }
 
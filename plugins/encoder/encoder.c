@@ -31,11 +31,13 @@
 #include "../grbl/report.h"
 #include "../grbl/protocol.h"
 #include "../grbl/nvs_buffer.h"
+#include "../grbl/motion_control.h"
 #else
 #include "grbl/grbl.h"
 #include "grbl/report.h"
 #include "grbl/protocol.h"
 #include "grbl/nvs_buffer.h"
+#include "grbl/motion_control.h"
 #endif
 
 #include <stdio.h>
@@ -43,6 +45,10 @@
 
 #define MIN(a, b) (((a) > (b)) ? (b) : (a))
 
+#ifndef ENCODER_POLL_INTERVAL
+#define ENCODER_POLL_INTERVAL 20 // ms, for encoders counted by a hardware quadrature decoder.
+#endif
+
 typedef bool (*mpg_algo_ptr)(uint_fast16_t state, axes_signals_t axes);
 
 typedef union {
@@ -88,7 +94,8 @@ static encoder_t *override_encoder = NULL; // NULL when no Encoder_Universal ava
 static axes_signals_t mpg_event = {0};
 static volatile bool mpg_spin_lock = false;
 static on_realtime_report_ptr on_realtime_report = NULL;
-static on_execute_realtime_ptr on_execute_realtime = NULL;
+static on_execute_realtime_ptr on_execute_realtime = NULL, on_execute_realtime_poll = NULL;
+static encoder_t *hw_encoder = NULL; // Encoders polled via hal.encoder.get_data(), NULL if none
 static on_report_options_ptr on_report_options;
 static driver_setting_ptrs_t driver_settings;
 static encoder_settings_t encoders[QEI_ENABLE];
@@ -151,6 +158,7 @@ serialWriteS(ASCII_EOL);
     return is_moving;
 }
 
+// Relative jog, queued directly by mc_jog_relative() rather than by formatting a $J=G91 command for the parser.
 static bool mpg_jog_relative (uint_fast16_t state, axes_signals_t axes)
 {
     static bool is_moving = false;
@@ -158,20 +166,15 @@ static bool mpg_jog_relative (uint_fast16_t state, axes_signals_t axes)
     int32_t delta;
     uint32_t velocity = 0;
     uint_fast8_t idx = 0;
-
-    strcpy(gcode, "$J=G91");
-
-//   serialWriteS(uitoa(mpg[idx].encoder->position));
-//   serialWriteS(ASCII_EOL);
+    float distance[N_AXIS] = {0};
 
     while(axes.mask) {
 
         if(axes.mask & 0x01) {
             if((delta = mpg[idx].position - npos[mpg[idx].encoder->id]) != 0) {
-                float pos_delta = (float)delta * mpg[idx].scale_factor / 100.0f;
+                distance[idx] = (float)delta * mpg[idx].scale_factor / 100.0f;
                 mpg[idx].position = npos[idx];
                 velocity = velocity == 0 ? mpg[idx].encoder->velocity : MIN(mpg[idx].encoder->velocity, velocity);
-                sprintf(append(gcode), "%s%.3f", axis_letter[idx], pos_delta);
             }
         }
 
@@ -179,27 +182,51 @@ static bool mpg_jog_relative (uint_fast16_t state, axes_signals_t axes)
         axes.mask >>= 1;
     }
 
-    if(strlen(gcode) > 6 && velocity > 0) {
-
-        sprintf(append(gcode), "F%lu", velocity);
+    if(velocity > 0) {
 
-        is_moving = grbl.protocol_enqueue_gcode(gcode);
+        is_moving = mc_jog_relative(distance, (float)velocity) == Status_OK;
 
 #ifdef UART_DEBUG
-serialWriteS(gcode);
+serialWriteS(uitoa(velocity));
 serialWriteS(" ");
 serialWriteS(uitoa(is_moving));
 serialWriteS(ASCII_EOL);
 #endif
-/*
-serialWriteS(itoa(npos[mpg[idx].encoder->id], gcode, 10));
-serialWriteS(ASCII_EOL);
-*/
     }
 
     return is_moving;
 }
 
+#ifdef ENABLE_VELOCITY_JOG
+
+// Velocity mode, the axes are moved at the encoder velocity scaled by the distance scale factor (1, 10 or 100%)
+// for as long as the encoder is turned. Stopped by the jog cancel issued on the encoder stop event.
+static bool mpg_jog_velocity (uint_fast16_t state, axes_signals_t axes)
+{
+    int32_t delta;
+    uint_fast8_t idx = 0;
+    float velocity[N_AXIS] = {0};
+
+    while(axes.mask) {
+
+        if(axes.mask & 0x01) {
+            if((delta = mpg[idx].position - npos[mpg[idx].encoder->id]) != 0) {
+                mpg[idx].position = npos[idx];
+                velocity[idx] = (float)mpg[idx].encoder->velocity * mpg[idx].scale_factor / 100.0f;
+                if(delta < 0)
+                    velocity[idx] = -velocity[idx];
+            }
+        }
+
+        idx++;
+        axes.mask >>= 1;
+    }
+
+    return mc_jog_velocity(velocity) == Status_OK;
+}
+
+#endif
+
 // End MPG encoder movement algorithms
 
 static inline void reset_override (encoder_mode_t mode)
@@ -315,7 +342,9 @@ serialWriteS(ASCII_EOL);
 
                     if(!mpg[idx].flags.moving) {
                         float target[N_AXIS];
-                        system_convert_array_steps_to_mpos(target, sys_position);
+                        int32_t position[N_AXIS];
+                        system_get_position(position);
+                        system_convert_array_steps_to_mpos(target, position);
                         mpg[idx].flags.moving = On;
                         mpg[idx].pos = target[idx] - gc_get_offset(idx);
                     }
@@ -342,6 +371,39 @@ serialWriteS(ASCII_EOL);
     on_execute_realtime(state);
 }
 
+static void encoder_event (encoder_t *encoder, int32_t position);
+
+// Raises position change events for encoders counted by a hardware quadrature decoder,
+// when the count has changed and once when the encoder has stopped.
+static void encoder_poll (uint_fast16_t state)
+{
+    static uint32_t last_poll = 0;
+
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    if(ms - last_poll >= ENCODER_POLL_INTERVAL) {
+
+        uint_fast8_t idx;
+        encoder_data_t data;
+
+        last_poll = ms;
+
+        for(idx = 0; idx < n_encoder; idx++) {
+            if(hal.encoder.get_data(idx, &data)) {
+                uint32_t velocity = (uint32_t)(data.velocity < 0 ? -data.velocity : data.velocity);
+                if(data.position != hw_encoder[idx].position || (velocity == 0 && hw_encoder[idx].velocity != 0)) {
+                    hw_encoder[idx].position = data.position;
+                    hw_encoder[idx].velocity = velocity;
+                    hw_encoder[idx].event.position_changed = On;
+                    encoder_event(&hw_encoder[idx], data.position);
+                }
+            }
+        }
+    }
+
+    on_execute_realtime_poll(state);
+}
+
 static void encoder_event (encoder_t *encoder, int32_t position)
 {
     bool update_position = false;
@@ -711,7 +773,11 @@ bool encoder_start (encoder_t *encoder)
     for(idx = 0; idx < N_AXIS; idx++) {
         mpg[idx].scale_factor = 1.0f;
 //        mpg[idx].handler = mpg_move_absolute;
+#ifdef ENABLE_VELOCITY_JOG
+        mpg[idx].handler = mpg_jog_velocity;
+#else
         mpg[idx].handler = mpg_jog_relative;
+#endif
     }
 
 #if COMPATIBILITY_LEVEL <= 1
@@ -726,6 +792,22 @@ bool encoder_start (encoder_t *encoder)
     }
 #endif
 
+    if(hal.encoder.get_data) {
+        encoder_data_t data;
+        hw_encoder = NULL;
+        for(idx = 0; idx < n_encoder; idx++) {
+            if(hal.encoder.get_data(idx, &data)) {
+                hw_encoder = encoder;
+                encoder[idx].position = data.position;
+                encoder[idx].velocity = 0;
+            }
+        }
+        if(hw_encoder && !on_execute_realtime_poll) {
+            on_execute_realtime_poll = grbl.on_execute_realtime;
+            grbl.on_execute_realtime = encoder_poll;
+        }
+    }
+
     if(has_mpg_encoder) {
         if(!on_execute_realtime) {
             on_execute_realtime = grbl.on_execute_realtime;
@@ -32,8 +32,8 @@
 typedef struct {
     uint_fast16_t ppi;
     float ppi_distance;
-    float ppi_pos;
-    float next_pos;
+    int32_t step_interval;      // Step events between pulses for the current block, 24.8 fixed point
+    int32_t next_pulse;         // Step events until next pulse, 24.8 fixed point
     uint_fast16_t pulse_length; // uS
     bool on;
 } laser_ppi_t;
@@ -57,26 +57,21 @@ spindle_update_rpm_ptr spindle_update_rpm;
 
 static void stepperWakeUp (void)
 {
-    laser.ppi_pos = laser.next_pos = 0.0f;
+    laser.next_pulse = 0;
 
     stepper_wake_up();
 }
 
+// The pulse interval is precomputed per block, the remainder is carried to the next pulse.
+// Each call is one step event, or 1/2^amass_level of one with AMASS active.
 static void stepperPulseStartPPI (stepper_t *stepper)
 {
-    static float mm_per_step;
-//    static uint_fast16_t current_pwm = 0;
+    if(stepper->new_block || laser.step_interval == 0)
+        laser.step_interval = (int32_t)(laser.ppi_distance * stepper->exec_block->steps_per_mm * 256.0f);
 
-    if(laser.on) {
-
-        if(stepper->new_block)
-            mm_per_step = 1.0f / (stepper->exec_block->steps_per_mm * (1 << stepper->amass_level));
-
-        laser.ppi_pos += mm_per_step;
-        if(laser.ppi_pos >= laser.next_pos) {
-            laser.next_pos += laser.ppi_distance;
-            hal.spindle.pulse_on(laser.pulse_length);
-        }
+    if(laser.on && (laser.next_pulse -= (256 >> stepper->amass_level)) <= 0) {
+        laser.next_pulse += laser.step_interval;
+        hal.spindle.pulse_on(laser.pulse_length);
     }
 
     stepper_pulse_start(stepper);
@@ -86,7 +81,7 @@ static void stepperPulseStartPPI (stepper_t *stepper)
 void ppiUpdatePWM (uint_fast16_t pwm)
 {
     if(!laser.on && pwm > 0)
-        laser.ppi_pos = laser.next_pos = 0.0f;
+        laser.next_pulse = 0;
 
     laser.on = pwm > 0;
 
@@ -97,7 +92,7 @@ void ppiUpdatePWM (uint_fast16_t pwm)
 void ppiUpdateRPM (float rpm)
 {
     if(!laser.on && rpm > 0.0f)
-        laser.ppi_pos = laser.next_pos = 0.0f;
+        laser.next_pulse = 0;
 
     laser.on = rpm > 0.0f;
 
@@ -111,6 +106,7 @@ bool enable_ppi (bool on)
     if(!gc_laser_ppi_enable(on ? laser.ppi : 0, laser.pulse_length)) {
 
         if(on && stepper_wake_up == NULL) {
+            laser.step_interval = 0;
             stepper_wake_up = hal.stepper.wake_up;
             hal.stepper.wake_up = stepperWakeUp;
             stepper_pulse_start = hal.stepper.pulse_start;
@@ -187,8 +183,10 @@ static void userMCodeExecute (uint_fast16_t state, parser_block_t *gc_block)
             break;
 
         case LaserPPI_Rate:
-            if((laser.ppi = (uint_fast16_t)gc_block->values.p) != 0)
+            if((laser.ppi = (uint_fast16_t)gc_block->values.p) != 0) {
                 laser.ppi_distance = 25.4f / (float)laser.ppi;
+                laser.step_interval = 0; // Recalculate on next step.
+            }
             enable_ppi(ppi_on && laser.ppi > 0 && laser.pulse_length > 0);
             break;
 
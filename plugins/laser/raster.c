@@ -0,0 +1,205 @@
+/*
+
+  raster.c - plugin for laser raster engraving from encoded pixel rows
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "driver.h"
+
+#if RASTER_ENABLE
+
+#include <string.h>
+
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "networking/base64.h"
+
+#ifndef SPINDLE_PWM_DIRECT
+#error Not supported!
+#endif
+
+#ifndef RASTER_QUEUE_ROWS
+#define RASTER_QUEUE_ROWS 4 // Number of pixel rows that can be buffered ahead of execution.
+#endif
+
+#define RASTER_ROW_MAX (((LINE_BUFFER_SIZE - 11) / 4) * 3) // Max pixels per row, limited by the input line length.
+
+typedef struct {
+    uint_fast16_t pixels;
+    uint8_t pixel[RASTER_ROW_MAX];
+} raster_row_t;
+
+typedef struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    raster_row_t row[RASTER_QUEUE_ROWS];
+} raster_queue_t;
+
+typedef struct {
+    raster_row_t *row;          // Row being output, NULL if none
+    uint_fast16_t pixel;        // Current pixel in row
+    int32_t pixel_interval;     // Step events per pixel, 24.8 fixed point
+    int32_t next_pixel;         // Step events until next pixel, 24.8 fixed point
+    uint_fast16_t pwm;          // Last PWM value set by the core
+    bool laser_on;
+} raster_t;
+
+typedef struct {
+    float rpm_min;
+    float rpm_max;
+    uint8_t override;
+    uint_fast16_t pwm[256];     // PWM values for the pixel values
+} power_lut_t;
+
+static raster_t raster = {0};
+static raster_queue_t queue = {0};
+static power_lut_t lut = {0};
+static void (*stepper_pulse_start)(stepper_t *stepper);
+static spindle_update_pwm_ptr spindle_update_pwm;
+static driver_reset_ptr driver_reset;
+static on_user_command_ptr on_user_command;
+static on_report_options_ptr on_report_options;
+
+// A row is output by the first block started with the laser on after the previous row is completed.
+// Pixels are evenly distributed over the block step events, each call is one step event or 1/2^amass_level
+// of one with AMASS active. PWM values are looked up from the power table, no floating point is used.
+static void stepperPulseStartRaster (stepper_t *stepper)
+{
+    if(stepper->new_block) {
+
+        if(raster.row) { // Row completed, restore power set by the core.
+            raster.row = NULL;
+            queue.tail = (queue.tail + 1) % RASTER_QUEUE_ROWS;
+            spindle_update_pwm(raster.pwm);
+        }
+
+        if(raster.laser_on && queue.tail != queue.head) {
+            raster.row = &queue.row[queue.tail];
+            raster.pixel = 0;
+            raster.pixel_interval = (int32_t)(((uint64_t)stepper->exec_block->step_event_count << 8) / raster.row->pixels);
+            raster.next_pixel = raster.pixel_interval;
+            spindle_update_pwm(lut.pwm[raster.row->pixel[0]]);
+        }
+
+    } else if(raster.row && (raster.next_pixel -= (256 >> stepper->amass_level)) <= 0) {
+        raster.next_pixel += raster.pixel_interval;
+        if(++raster.pixel < raster.row->pixels && raster.row->pixel[raster.pixel] != raster.row->pixel[raster.pixel - 1])
+            spindle_update_pwm(lut.pwm[raster.row->pixel[raster.pixel]]);
+    }
+
+    stepper_pulse_start(stepper);
+}
+
+// Power set by the core is overridden while a row is output.
+static void rasterUpdatePWM (uint_fast16_t pwm)
+{
+    raster.pwm = pwm;
+    raster.laser_on = pwm > 0;
+
+    if(raster.row == NULL)
+        spindle_update_pwm(pwm);
+}
+
+// Pixel value 0 is laser off, 1 - 255 is scaled to the spindle RPM range with the spindle override applied.
+static void update_lut (void)
+{
+    uint_fast16_t idx;
+
+    if(lut.rpm_min == settings.spindle.rpm_min && lut.rpm_max == settings.spindle.rpm_max && lut.override == sys.override.spindle_rpm)
+        return;
+
+    lut.rpm_min = settings.spindle.rpm_min;
+    lut.rpm_max = settings.spindle.rpm_max;
+    lut.override = sys.override.spindle_rpm;
+
+    lut.pwm[0] = hal.spindle.get_pwm(0.0f);
+    for(idx = 1; idx < 256; idx++)
+        lut.pwm[idx] = hal.spindle.get_pwm((lut.rpm_min + (lut.rpm_max - lut.rpm_min) * (float)idx / 255.0f) * 0.01f * (float)lut.override);
+}
+
+// [RASTER:<base64 encoded pixel values>] queues a row to be output by the next laser on motion.
+// Waits for room in the row queue when full.
+static status_code_t userCommand (char *line)
+{
+    if(strncmp(line, "[RASTER:", 8))
+        return on_user_command ? on_user_command(line) : Status_Unhandled;
+
+    char *data = line + 8, *end = strchr(data, ']');
+    size_t length;
+
+    if(end == NULL || (length = end - data) == 0 || (length % 4) || length / 4 * 3 > RASTER_ROW_MAX)
+        return Status_InvalidStatement;
+
+    update_lut();
+
+    uint_fast8_t head = (queue.head + 1) % RASTER_QUEUE_ROWS;
+
+    while(head == queue.tail) {
+        protocol_auto_cycle_start();     // Auto-cycle start when queue is full.
+        if(!protocol_execute_realtime()) // Check for any run-time commands
+            return Status_OK;            // Bail, if system abort.
+    }
+
+    raster_row_t *row = &queue.row[queue.head];
+
+    if((row->pixels = base64_decode((BYTE *)data, row->pixel, length)) == 0)
+        return Status_InvalidStatement;
+
+    queue.head = head;
+
+    return Status_OK;
+}
+
+static void rasterReset (void)
+{
+    raster.row = NULL;
+    queue.head = queue.tail = 0;
+
+    driver_reset();
+}
+
+static void onReportOptions (void)
+{
+    on_report_options();
+    hal.stream.write("[PLUGIN:LASER RASTER v0.01]" ASCII_EOL);
+}
+
+void raster_init (void)
+{
+    if(settings.mode == Mode_Laser) {
+
+        stepper_pulse_start = hal.stepper.pulse_start;
+        hal.stepper.pulse_start = stepperPulseStartRaster;
+
+        spindle_update_pwm = hal.spindle.update_pwm;
+        hal.spindle.update_pwm = rasterUpdatePWM;
+
+        driver_reset = hal.driver_reset;
+        hal.driver_reset = rasterReset;
+
+        on_user_command = grbl.on_user_command;
+        grbl.on_user_command = userCommand;
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = onReportOptions;
+    }
+}
+
+#endif
@@ -45,6 +45,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 
 #include "TCPStream.h"
+#include "grbl/profile.h"
+
+// Max number of read-only monitor sessions accepted when the streaming session is connected.
+// Monitor sessions get the output written by TCPStreamWriteAllS(), e.g. real-time reports, any input is discarded.
+#ifndef TELNET_MONITOR_SESSIONS
+#define TELNET_MONITOR_SESSIONS 0
+#endif
+
+#ifndef TELNET_MONITOR_TX_BUFFER_SIZE
+#define TELNET_MONITOR_TX_BUFFER_SIZE 512 // must be a power of 2
+#endif
 
 typedef enum
 {
@@ -106,6 +117,38 @@ static const sessiondata_t defaultSettings =
 
 static sessiondata_t streamSession;
 
+#if TELNET_MONITOR_SESSIONS
+
+typedef struct
+{
+    struct tcp_pcb *pcb;
+    volatile uint_fast16_t head;
+    volatile uint_fast16_t tail;
+    char data[TELNET_MONITOR_TX_BUFFER_SIZE];
+} monitor_session_t;
+
+static monitor_session_t monitors[TELNET_MONITOR_SESSIONS];
+
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+
+static on_report_memory_ptr on_report_memory = NULL;
+
+static void TCPReportMemory (void)
+{
+    report_memory_usage("TELNET", sizeof(streamSession)
+#if TELNET_MONITOR_SESSIONS
+                                   + sizeof(monitors)
+#endif
+                                   );
+
+    if(on_report_memory)
+        on_report_memory();
+}
+
+#endif
+
 void TCPStreamInit (void)
 {
     memcpy(&streamSession, &defaultSettings, sizeof(sessiondata_t));
@@ -117,6 +160,13 @@ void TCPStreamInit (void)
     }
 
     streamSession.rcvTail = streamSession.rcvHead = &streamSession.queue[0];
+
+#ifdef ENABLE_MEMORY_REPORT
+    if(grbl.on_report_memory != TCPReportMemory) {
+        on_report_memory = grbl.on_report_memory;
+        grbl.on_report_memory = TCPReportMemory;
+    }
+#endif
 }
 
 //
@@ -160,22 +210,29 @@ void TCPStreamRxCancel (void)
     streamSession.rxbuf.head = (streamSession.rxbuf.tail + 1) & (RX_BUFFER_SIZE - 1);
 }
 
-static bool streamBufferRX (char c)
+// Adds as much of the data as there is room for to the input buffer, returns the number of characters consumed.
+// NOTE: real-time commands are still checked for character by character, their handlers may flush the buffer.
+static uint_fast16_t streamBufferRXBlock (const uint8_t *data, uint_fast16_t length)
 {
     // discard input if MPG has taken over...
-    if(hal.stream.type != StreamType_MPG) {
+    if(hal.stream.type == StreamType_MPG)
+        return length;
+
+    char c;
+    uint_fast16_t count = 0, bptr;
 
-        uint_fast16_t bptr = (streamSession.rxbuf.head + 1) & (RX_BUFFER_SIZE - 1); // Get next head pointer
+    while(count < length) {
 
-        if(bptr == streamSession.rxbuf.tail)                        // If buffer full
-            streamSession.rxbuf.overflow = true;                    // flag overflow
-        else if(!hal.stream.enqueue_realtime_command(c)) {          // If not a real time command
+        if((bptr = (streamSession.rxbuf.head + 1) & (RX_BUFFER_SIZE - 1)) == streamSession.rxbuf.tail)
+            break;                                                  // Buffer full, pend rest of data until next polling
+
+        if(!hal.stream.enqueue_realtime_command(c = (char)data[count++])) { // If not a real time command
             streamSession.rxbuf.data[streamSession.rxbuf.head] = c; // add data to buffer
             streamSession.rxbuf.head = bptr;                        // and update pointer
         }
     }
 
-    return !streamSession.rxbuf.overflow;
+    return count;
 }
 
 bool TCPStreamPutC (const char c)
@@ -201,6 +258,43 @@ void TCPStreamWriteS (const char *data)
         TCPStreamPutC(c);
 }
 
+#if TELNET_MONITOR_SESSIONS
+
+// Adds the string to the monitor session output buffer, the string is dropped if it does not fit.
+// Monitor output never blocks, a slow monitor client only loses output.
+static void monitorWriteS (monitor_session_t *monitor, const char *data)
+{
+    uint_fast16_t length = strlen(data), head = monitor->head, tail = monitor->tail;
+
+    if(length > (TELNET_MONITOR_TX_BUFFER_SIZE - 1) - BUFCOUNT(head, tail, TELNET_MONITOR_TX_BUFFER_SIZE))
+        return;
+
+    while(length--) {
+        monitor->data[head] = *data++;
+        head = (head + 1) & (TELNET_MONITOR_TX_BUFFER_SIZE - 1);
+    }
+
+    monitor->head = head;
+}
+
+#endif
+
+// Writes the string to the streaming session and to all monitor sessions.
+// Drivers should use this for the write_all stream entry point.
+void TCPStreamWriteAllS (const char *data)
+{
+    TCPStreamWriteS(data);
+
+#if TELNET_MONITOR_SESSIONS
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < TELNET_MONITOR_SESSIONS; idx++) {
+        if(monitors[idx].pcb)
+            monitorWriteS(&monitors[idx], data);
+    }
+#endif
+}
+
 void TCPStreamWriteLn (const char *data)
 {
     TCPStreamWriteS(data);
@@ -222,18 +316,14 @@ uint16_t TCPStreamTxCount(void) {
     return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
 }
 
-static int16_t streamReadTXC (void)
+// Returns the number of contiguous characters from the output buffer tail, ptr is set to point to the first.
+static uint_fast16_t streamGetTXSpan (char **ptr)
 {
-    int16_t data;
-    uint_fast16_t bptr = streamSession.txbuf.tail;
-
-    if(bptr == streamSession.txbuf.head)
-        return -1; // no data available else EOF
+    uint_fast16_t head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
 
-    data = streamSession.txbuf.data[bptr++];                 // Get next character, increment tmp pointer
-    streamSession.txbuf.tail = bptr & (TX_BUFFER_SIZE - 1);  // and update pointer
+    *ptr = &streamSession.txbuf.data[tail];
 
-    return data;
+    return head >= tail ? head - tail : TX_BUFFER_SIZE - tail;
 }
 
 void TCPStreamTxFlush (void)
@@ -354,6 +444,99 @@ static err_t streamSent (void *arg, struct tcp_pcb *pcb, u16_t ui16len)
     return ERR_OK;
 }
 
+#if TELNET_MONITOR_SESSIONS
+
+static void monitorClose (monitor_session_t *monitor)
+{
+    if(monitor->pcb) {
+        tcp_arg(monitor->pcb, NULL);
+        tcp_recv(monitor->pcb, NULL);
+        tcp_err(monitor->pcb, NULL);
+        tcp_close(monitor->pcb);
+    }
+
+    monitor->pcb = NULL;
+    monitor->head = monitor->tail = 0;
+}
+
+static void monitorError (void *arg, err_t err)
+{
+    monitor_session_t *monitor = arg;
+
+    monitor->pcb = NULL; // pcb is already freed by lwIP
+    monitor->head = monitor->tail = 0;
+}
+
+// Input from monitor sessions is acknowledged and discarded.
+static err_t monitorReceive (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    if(err == ERR_OK) {
+        if(p) {
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
+        } else // Null packet received, means close connection
+            monitorClose((monitor_session_t *)arg);
+    }
+
+    return ERR_OK;
+}
+
+static err_t monitorAccept (struct tcp_pcb *pcb)
+{
+    uint_fast8_t idx = TELNET_MONITOR_SESSIONS;
+    monitor_session_t *monitor = NULL;
+
+    do {
+        if(monitors[--idx].pcb == NULL)
+            monitor = &monitors[idx];
+    } while(idx);
+
+    if(monitor == NULL)
+        return ERR_CONN; // No free monitor session, refuse connection
+
+    monitor->pcb = pcb;
+    monitor->head = monitor->tail = 0;
+
+    tcp_accepted(pcb);
+    tcp_arg(pcb, monitor);
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    tcp_recv(pcb, monitorReceive);
+    tcp_err(pcb, monitorError);
+
+    return ERR_OK;
+}
+
+// Sends pending monitor output, only called when the streaming session has no output pending
+// so the monitors do not delay or take bandwidth from it.
+static void monitorsPoll (void)
+{
+    char *data;
+    uint_fast8_t idx;
+    uint_fast16_t head, tail, length;
+    monitor_session_t *monitor;
+
+    for(idx = 0; idx < TELNET_MONITOR_SESSIONS; idx++) {
+
+        monitor = &monitors[idx];
+
+        if(monitor->pcb && (head = monitor->head) != (tail = monitor->tail) && monitor->pcb->snd_queuelen < TCP_SND_QUEUELEN) {
+
+            data = &monitor->data[tail];
+            length = head > tail ? head - tail : TELNET_MONITOR_TX_BUFFER_SIZE - tail; // Contiguous span only, rest is sent on next poll
+
+            if(length > tcp_sndbuf(monitor->pcb))
+                length = tcp_sndbuf(monitor->pcb);
+
+            if(length && tcp_write(monitor->pcb, data, (u16_t)length, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+                monitor->tail = (tail + length) & (TELNET_MONITOR_TX_BUFFER_SIZE - 1);
+                tcp_output(monitor->pcb);
+            }
+        }
+    }
+}
+
+#endif
+
 static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
 {
     sessiondata_t *session = arg;
@@ -361,7 +544,11 @@ static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
     if(session->state != TCPState_Listen) {
 
         if(!session->linkLost)
+#if TELNET_MONITOR_SESSIONS
+            return monitorAccept(pcb); // Busy, accept as monitor session if possible
+#else
             return ERR_CONN; // Busy, refuse connection
+#endif
 
         // Link was previously lost, abort current connection
 
@@ -395,6 +582,13 @@ static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
 
 void TCPStreamClose (void)
 {
+#if TELNET_MONITOR_SESSIONS
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < TELNET_MONITOR_SESSIONS; idx++)
+        monitorClose(&monitors[idx]);
+#endif
+
     if(streamSession.pcbConnect != NULL) {
         tcp_arg(streamSession.pcbConnect, NULL);
         tcp_recv(streamSession.pcbConnect, NULL);
@@ -453,10 +647,14 @@ void TCPStreamListen (uint16_t port)
 //
 void TCPStreamPoll (void)
 {
-    static uint8_t tempBuffer[PBUF_POOL_BUFSIZE];
-
-    if(streamSession.state != TCPState_Connected)
+    if(streamSession.state != TCPState_Connected) {
+#if TELNET_MONITOR_SESSIONS
+        monitorsPoll();
+#endif
         return;
+    }
+
+    PROFILE_BEGIN(Profile_TCPStreamPoll);
 
     uint8_t *payload = streamSession.pbufCurrent ? streamSession.pbufCurrent->payload : NULL;
 
@@ -478,7 +676,7 @@ void TCPStreamPoll (void)
         if(payload == NULL)
             break; // No more data to be processed...
 
-        streamBufferRX(payload[streamSession.bufferIndex++]);
+        streamSession.bufferIndex += streamBufferRXBlock(&payload[streamSession.bufferIndex], streamSession.pbufCurrent->len - streamSession.bufferIndex);
 
         if(streamSession.bufferIndex >= streamSession.pbufCurrent->len) {
             streamSession.pbufCurrent = streamSession.pbufCurrent->next;
@@ -497,32 +695,38 @@ void TCPStreamPoll (void)
 
 //    tcp_output(streamSession.pcbConnect);
 
-    int_fast16_t TXCount;
+    char *data;
+    uint_fast16_t TXCount;
 
-    // 2. Process output stream
+    // 2. Process output stream, contiguous spans of the output buffer are copied directly by tcp_write()
     if((TXCount = TCPStreamTxCount()) && tcp_sndbuf(streamSession.pcbConnect) && streamSession.pcbConnect->snd_queuelen < TCP_SND_QUEUELEN) {
 
-        uint_fast16_t idx;
+        uint_fast16_t length;
 
         if(TXCount > tcp_sndbuf(streamSession.pcbConnect))
             TXCount = tcp_sndbuf(streamSession.pcbConnect);
 
         while(TXCount && streamSession.pcbConnect->snd_queuelen < TCP_SND_QUEUELEN)
         {
-            idx = 0;
+            if((length = streamGetTXSpan(&data)) > TXCount)
+                length = TXCount;
 
-            while(TXCount && idx < sizeof(tempBuffer)) {
-                tempBuffer[idx] = (uint8_t)streamReadTXC();
-                idx++;
-                TXCount--;
-            }
+            if(tcp_write(streamSession.pcbConnect, data, (u16_t)length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+                break;
 
-            tcp_write(streamSession.pcbConnect, tempBuffer, (u16_t)idx, 1);
+            streamSession.txbuf.tail = (streamSession.txbuf.tail + length) & (TX_BUFFER_SIZE - 1);
+            TXCount -= length;
         }
 
         tcp_output(streamSession.pcbConnect);
         streamSession.lastSendTime = xTaskGetTickCount();
     }
+#if TELNET_MONITOR_SESSIONS
+    else if(TXCount == 0)
+        monitorsPoll();
+#endif
+
+    PROFILE_END(Profile_TCPStreamPoll);
 }
 
 #endif
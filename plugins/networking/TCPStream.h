@@ -47,6 +47,7 @@ void TCPStreamNotifyLinkStatus(bool bLinkStatusUp);
 int16_t TCPStreamGetC(void);
 bool TCPStreamPutC(const char data);
 void TCPStreamWriteS(const char *data);
+void TCPStreamWriteAllS(const char *data);
 void TCPStreamWriteLn(const char *data);
 void TCPStreamWrite(const char *data, unsigned int length);
 uint16_t TCPStreamTxCount(void);
@@ -51,6 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "strutils.h"
 
 #include "grbl/grbl.h"
+#include "grbl/profile.h"
 
 //#define WSDEBUG
 
@@ -59,6 +60,30 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_HTTP_HEADER_SIZE 512
 #define FRAME_NONE 0xFF
 
+// Max time output not ending with a line terminator is held back for coalescing with following output into one frame.
+#ifndef WS_TX_COALESCE_TIME
+#define WS_TX_COALESCE_TIME 5 // ms
+#endif
+#define WS_TX_COALESCE_TICKS ((WS_TX_COALESCE_TIME * configTICK_RATE_HZ + 999) / 1000)
+
+// Binary status subprotocol. A client requesting the grblHAL.status protocol is not connected to the grbl stream,
+// instead a packed status report, ws_status_t, is pushed to it in a binary frame at a fixed interval. The client
+// may change the interval by sending a binary frame containing the interval in ms as a 16-bit little endian value,
+// 0 stops the reports. Any other data received from the client is discarded.
+// Binary telemetry records published via grbl.on_telemetry are forwarded to the status client in separate frames,
+// the first byte of the frame is the channel id with bit 7 set, followed by the record.
+#ifndef WEBSOCKET_STATUS_PUSH
+#define WEBSOCKET_STATUS_PUSH 0 // Set to 1 to enable.
+#endif
+#ifndef WS_STATUS_PUSH_INTERVAL
+#define WS_STATUS_PUSH_INTERVAL 50 // ms
+#endif
+#ifndef WS_TELEMETRY_QUEUE
+#define WS_TELEMETRY_QUEUE 8 // Number of telemetry records buffered, must be a power of 2.
+#endif
+#define WS_STATUS_PROTOCOL "grblHAL.status"
+#define WS_STATUS_VERSION 1
+
 static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 static const char WS_KEY[] = "Sec-WebSocket-Key: ";
 static const char WS_PROT[] = "Sec-WebSocket-Protocol: ";
@@ -111,6 +136,45 @@ typedef struct {
     uint8_t data[13];
 } frame_header_t;
 
+#if WEBSOCKET_STATUS_PUSH
+
+// Binary status report, in native (little endian) byte order. Fields are ordered for natural alignment without padding.
+// Positions are reported in steps, the host converts to mm by dividing by steps_per_mm and subtracting wco for work position.
+typedef struct {
+    uint8_t version;                // WS_STATUS_VERSION
+    uint8_t n_axis;                 // Number of axes in the arrays below
+    uint16_t state;                 // sys.state, STATE_* bitmask
+    uint8_t substate;               // Hold or door substate, 0 for other states
+    uint8_t limits;                 // Limit inputs, bit per axis
+    uint16_t control;               // Control inputs, control_signals_t
+    uint8_t override_feed;          // Feed rate override in percent
+    uint8_t override_rapid;         // Rapids override in percent
+    uint8_t override_spindle;       // Spindle speed override in percent
+    uint8_t flags;                  // bit 0: probe triggered, 1: probe connected, 2: spindle on, 3: spindle ccw, 4: flood, 5: mist
+    int32_t line_number;            // Line number of the block executing, 0 if none
+    float feed_rate;                // Current feed rate, mm/min
+    float rpm;                      // Programmed spindle RPM, 0 when spindle is off
+    int32_t position[N_AXIS];       // Machine position in steps
+    float wco[N_AXIS];              // Work coordinate offset in mm
+    float steps_per_mm[N_AXIS];
+} ws_status_t;
+
+typedef struct {
+    uint8_t length;
+    uint8_t data[TELEMETRY_RECORD_MAX + 1];
+} ws_telemetry_t;
+
+// Written by the grbl foreground process, read by the websocket poll.
+static struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    ws_telemetry_t record[WS_TELEMETRY_QUEUE];
+} telemetry = {0};
+
+static on_telemetry_ptr on_telemetry = NULL;
+
+#endif
+
 typedef struct pbuf_entry
 {
     struct pbuf *pbuf;
@@ -139,6 +203,8 @@ typedef struct ws_sessiondata
     stream_rx_buffer_t rxbuf;
     stream_tx_buffer_t txbuf;
     TickType_t lastSendTime;
+    TickType_t txPendingTime;
+    bool txPending;
     err_t lastErr;
     uint8_t errorCount;
     uint8_t reconnectCount;
@@ -146,11 +212,19 @@ typedef struct ws_sessiondata
     uint8_t pingCount;
     char *http_request;
     uint32_t hdrsize;
+#if WEBSOCKET_STATUS_PUSH
+    bool statusPush;
+    uint16_t statusInterval;
+    TickType_t lastStatusTime;
+#endif
     void (*traffic_handler)(struct ws_sessiondata *session);
 } ws_sessiondata_t;
 
 static void WsConnectionHandler (ws_sessiondata_t *session);
 static void WsStreamHandler (ws_sessiondata_t *session);
+#if WEBSOCKET_STATUS_PUSH
+static void WsTelemetryQueue (telemetry_channel_t channel, const void *data, uint_fast8_t length);
+#endif
 
 static const ws_frame_start_t wshdr_txt = {
   .fin    = true,
@@ -183,6 +257,8 @@ static const ws_sessiondata_t defaultSettings =
     .rxbuf = {0},
     .txbuf = {0},
     .lastSendTime = 0,
+    .txPendingTime = 0,
+    .txPending = false,
     .linkLost = false,
     .connectCount = 0,
     .reconnectCount = 0,
@@ -191,11 +267,34 @@ static const ws_sessiondata_t defaultSettings =
     .lastErr = ERR_OK,
     .http_request = NULL,
     .hdrsize = MAX_HTTP_HEADER_SIZE,
+#if WEBSOCKET_STATUS_PUSH
+    .statusPush = false,
+    .statusInterval = WS_STATUS_PUSH_INTERVAL,
+    .lastStatusTime = 0,
+#endif
     .traffic_handler = WsConnectionHandler
 };
 
 static ws_sessiondata_t streamSession;
 
+#ifdef ENABLE_MEMORY_REPORT
+
+static on_report_memory_ptr on_report_memory = NULL;
+
+static void WsReportMemory (void)
+{
+    report_memory_usage("WEBSOCKET", sizeof(streamSession)
+#if WEBSOCKET_STATUS_PUSH
+                                      + sizeof(telemetry)
+#endif
+                                      );
+
+    if(on_report_memory)
+        on_report_memory();
+}
+
+#endif
+
 void WsStreamInit (void)
 {
     memcpy(&streamSession, &defaultSettings, sizeof(ws_sessiondata_t));
@@ -207,6 +306,20 @@ void WsStreamInit (void)
     }
 
     streamSession.rcvTail = streamSession.rcvHead = &streamSession.queue[0];
+
+#if WEBSOCKET_STATUS_PUSH
+    if(grbl.on_telemetry != WsTelemetryQueue) {
+        on_telemetry = grbl.on_telemetry;
+        grbl.on_telemetry = WsTelemetryQueue;
+    }
+#endif
+
+#ifdef ENABLE_MEMORY_REPORT
+    if(grbl.on_report_memory != WsReportMemory) {
+        on_report_memory = grbl.on_report_memory;
+        grbl.on_report_memory = WsReportMemory;
+    }
+#endif
 }
 
 //
@@ -268,6 +381,60 @@ bool WsStreamRxInsert (char c)
     return !streamSession.rxbuf.overflow;
 }
 
+// Unmasks and adds as much of the payload data as there is room for to the input buffer, returns the number of characters consumed.
+// Data is unmasked a 32-bit word at a time while there is room for at least four more characters in the buffer.
+// NOTE: real-time commands are still checked for character by character, their handlers may flush the buffer.
+static uint_fast16_t streamRxInsertBlock (const uint8_t *data, uint_fast16_t length, const uint8_t *mask, uint_fast16_t mask_idx)
+{
+    // discard input if MPG has taken over...
+    if(hal.stream.type == StreamType_MPG)
+        return length;
+
+    char c;
+    uint_fast8_t idx;
+    uint_fast16_t count = 0, bptr;
+    uint8_t word_mask[4];
+    union {
+        uint32_t value;
+        uint8_t bytes[4];
+    } word, mask32;
+
+    // Rotate mask to start at the first character of the data
+    for(idx = 0; idx < 4; idx++)
+        word_mask[idx] = mask[(mask_idx + idx) % 4];
+    memcpy(&mask32.value, word_mask, sizeof(uint32_t));
+
+    while(length - count >= 4 && WsStreamRxFree() >= 4) {
+
+        memcpy(&word.value, &data[count], sizeof(uint32_t));
+        word.value ^= mask32.value;
+        count += 4;
+
+        for(idx = 0; idx < 4; idx++) {
+            if(!hal.stream.enqueue_realtime_command(c = (char)word.bytes[idx])) { // If not a real time command
+                streamSession.rxbuf.data[streamSession.rxbuf.head] = c;      // add data to buffer
+                streamSession.rxbuf.head = (streamSession.rxbuf.head + 1) & (RX_BUFFER_SIZE - 1); // and update pointer
+            }
+        }
+    }
+
+    while(count < length) {
+
+        if((bptr = (streamSession.rxbuf.head + 1) & (RX_BUFFER_SIZE - 1)) == streamSession.rxbuf.tail)
+            break;                                                  // Buffer full, pend rest of data until next polling
+
+        c = (char)(data[count] ^ mask[(mask_idx + count) % 4]);
+        count++;
+
+        if(!hal.stream.enqueue_realtime_command(c)) {               // If not a real time command
+            streamSession.rxbuf.data[streamSession.rxbuf.head] = c; // add data to buffer
+            streamSession.rxbuf.head = bptr;                        // and update pointer
+        }
+    }
+
+    return count;
+}
+
 bool WsStreamPutC (const char c) {
 
     uint32_t next_head = (streamSession.txbuf.head + 1) & (TX_BUFFER_SIZE - 1);  // Get and update head pointer
@@ -312,18 +479,14 @@ uint16_t WsStreamTxCount(void) {
     return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
 }
 
-static int16_t streamReadTXC (void)
+// Returns the number of contiguous characters from the output buffer tail, ptr is set to point to the first.
+static uint_fast16_t streamGetTXSpan (char **ptr)
 {
-    int16_t data;
-    uint_fast16_t bptr = streamSession.txbuf.tail;
-
-    if(bptr == streamSession.txbuf.head)
-        return -1; // no data available else EOF
+    uint_fast16_t head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
 
-    data = streamSession.txbuf.data[bptr++];                 // Get next character, increment tmp pointer
-    streamSession.txbuf.tail = bptr & (TX_BUFFER_SIZE - 1);  // and update pointer
+    *ptr = &streamSession.txbuf.data[tail];
 
-    return data;
+    return head >= tail ? head - tail : TX_BUFFER_SIZE - tail;
 }
 
 void WsStreamTxFlush (void)
@@ -414,6 +577,13 @@ static void closeSocket (ws_sessiondata_t *session, struct tcp_pcb *pcb)
     session->state = WsState_Listen;
     session->traffic_handler = WsConnectionHandler;
 
+#if WEBSOCKET_STATUS_PUSH
+    if(session->statusPush) { // Status client was never connected to the grbl stream
+        session->statusPush = false;
+        return;
+    }
+#endif
+
     // Switch grbl I/O stream back to UART
     selectStream(StreamType_Serial);
 }
@@ -482,6 +652,10 @@ static err_t WsStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
 
     session->traffic_handler = WsConnectionHandler;
     session->pingCount = 0;
+#if WEBSOCKET_STATUS_PUSH
+    session->statusPush = false;
+    session->statusInterval = WS_STATUS_PUSH_INTERVAL;
+#endif
 
     tcp_accepted(pcb);
 
@@ -674,6 +848,15 @@ static void WsConnectionHandler (ws_sessiondata_t *session)
 
         char *keyp, *key_hdr;
 
+#if WEBSOCKET_STATUS_PUSH
+        // Check for binary status protocol request, the request is left unmodified.
+        if((key_hdr = stristr(session->http_request, WS_PROT)) && (keyp = strstr(key_hdr, "\r\n"))) {
+            *keyp = '\0';
+            session->statusPush = strstr(key_hdr, WS_STATUS_PROTOCOL) != NULL;
+            *keyp = '\r';
+        }
+#endif
+
         if((key_hdr = stristr(session->http_request, WS_KEY))) {
 
             keyp = key_hdr + sizeof(WS_KEY) - 1;
@@ -681,7 +864,7 @@ static void WsConnectionHandler (ws_sessiondata_t *session)
             if((key_hdr = strstr(keyp, "\r\n"))) {
 
                 char key[64];
-                char rsp[150];
+                char rsp[200];
 
                 *key_hdr = '\0';
 
@@ -713,6 +896,14 @@ static void WsConnectionHandler (ws_sessiondata_t *session)
                 // Upgrade...
                 if (olen) {
                     response[olen + sizeof(WS_RSP) - 1] = '\0';
+#if WEBSOCKET_STATUS_PUSH
+                    if(session->statusPush) {
+                        strcat(response, CRLF);
+                        strcat(response, WS_PROT);
+                        strcat(response, WS_STATUS_PROTOCOL);
+                        telemetry.tail = telemetry.head; // Discard records queued for a previous client.
+                    }
+#endif
                     strcat(response, CRLF CRLF);
 #ifdef WSDEBUG
     DEBUG_PRINT(response);
@@ -721,6 +912,10 @@ static void WsConnectionHandler (ws_sessiondata_t *session)
                     http_write(session->pcbConnect, response, (u16_t *)&len, 1);
                     session->traffic_handler = WsStreamHandler;
                     session->lastSendTime = xTaskGetTickCount();
+#if WEBSOCKET_STATUS_PUSH
+                    session->lastStatusTime = session->lastSendTime;
+                    if(!session->statusPush)
+#endif
                     selectStream(StreamType_WebSocket);
                 }
             }
@@ -841,6 +1036,23 @@ static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t l
                 if (fs.fin)
                     session->fragment_opcode = WsOpcode_Continuation;
 
+#if WEBSOCKET_STATUS_PUSH
+                if (session->statusPush) {
+                    // Status client, a two byte payload sets the status push interval. Other data is discarded.
+                    if((frame_done = plen >= session->header.payload_rem)) {
+                        if(session->header.payload_len == 2 && session->header.payload_rem == 2) {
+                            uint8_t *mask = (uint8_t *)&session->header.mask;
+                            session->statusInterval = (payload[0] ^ mask[0]) | ((payload[1] ^ mask[1]) << 8);
+                        }
+                        plen -= session->header.payload_rem;
+                    } else {
+                        session->header.payload_rem -= plen;
+                        plen = 0;
+                    }
+                    break;
+                }
+#endif
+
                 if (session->header.payload_rem) {
 
                     uint8_t *mask = (uint8_t *)&session->header.mask;
@@ -859,17 +1071,14 @@ static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t l
                     DEBUG_PRINT("\r\n");
 */
                     // Unmask and add data to input buffer
-                    uint_fast16_t i = session->header.rx_index;
-                    session->rxbuf.overflow = false;
-
-                    while (payload_len--) {
-                        if(!WsStreamRxInsert(*payload++ ^ mask[i % 4]))
-                            break; // If overflow pend buffering rest of data until next polling
-                        plen--;
-                        i++;
-                    }
+                    uint_fast16_t count = streamRxInsertBlock(payload, payload_len, mask, session->header.rx_index);
+
+                    // If overflow pend buffering rest of data until next polling
+                    session->rxbuf.overflow = count < payload_len;
 
-                    session->header.rx_index = i;
+                    payload += count;
+                    plen -= count;
+                    session->header.rx_index += count;
                     frame_done = (session->header.payload_rem = session->header.payload_len - session->header.rx_index) == 0;
                 }
                 break;
@@ -936,6 +1145,96 @@ static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t l
     return len - plen;
 }
 
+#if WEBSOCKET_STATUS_PUSH
+
+// Push a binary status report to the client.
+static void WsStatusPush (ws_sessiondata_t *session)
+{
+    uint_fast8_t idx;
+    ws_status_t status;
+    plan_block_t *block = plan_get_current_block();
+    spindle_state_t spindle = hal.spindle.get_state();
+    coolant_state_t coolant = hal.coolant.get_state();
+    probe_state_t probe = {
+        .connected = On,
+        .triggered = Off
+    };
+    const uint8_t header[2] = { wshdr_bin.token, sizeof(ws_status_t) };
+
+    if(hal.probe.get_state)
+        probe = hal.probe.get_state();
+
+    status.version = WS_STATUS_VERSION;
+    status.n_axis = N_AXIS;
+    status.state = (uint16_t)sys.state;
+    status.substate = sys.state == STATE_HOLD ? (uint8_t)sys.holding_state : (sys.state == STATE_SAFETY_DOOR ? (uint8_t)sys.parking_state : 0);
+    status.limits = hal.limits.get_state().value;
+    status.control = hal.control.get_state().value;
+    status.override_feed = sys.override.feed_rate;
+    status.override_rapid = sys.override.rapid_rate;
+    status.override_spindle = sys.override.spindle_rpm;
+    status.flags = probe.triggered | (probe.connected << 1) | (spindle.on << 2) | (spindle.ccw << 3) | (coolant.flood << 4) | (coolant.mist << 5);
+    status.line_number = block ? block->line_number : 0;
+    status.feed_rate = st_get_realtime_rate();
+    status.rpm = spindle.on ? sys.spindle_rpm : 0.0f;
+    system_get_position(status.position);
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        status.wco[idx] = gc_get_offset(idx);
+        status.steps_per_mm[idx] = settings.axis[idx].steps_per_mm;
+    }
+
+    if(tcp_write(session->pcbConnect, header, sizeof(header), TCP_WRITE_FLAG_COPY|TCP_WRITE_FLAG_MORE) == ERR_OK &&
+        tcp_write(session->pcbConnect, &status, sizeof(ws_status_t), TCP_WRITE_FLAG_COPY) == ERR_OK)
+        tcp_output(session->pcbConnect);
+}
+
+// Buffer a telemetry record for the status client, records are dropped if no client is connected or the buffer is full.
+static void WsTelemetryQueue (telemetry_channel_t channel, const void *data, uint_fast8_t length)
+{
+    uint_fast8_t next_head = (telemetry.head + 1) & (WS_TELEMETRY_QUEUE - 1);
+
+    if(streamSession.statusPush && streamSession.state == WsState_Connected && next_head != telemetry.tail && length <= TELEMETRY_RECORD_MAX) {
+        ws_telemetry_t *record = &telemetry.record[telemetry.head];
+        record->length = length + 1;
+        record->data[0] = 0x80 | (uint8_t)channel;
+        memcpy(&record->data[1], data, length);
+        telemetry.head = next_head;
+    }
+
+    if(on_telemetry)
+        on_telemetry(channel, data, length);
+}
+
+// Send buffered telemetry records to the client.
+static void WsTelemetryPush (ws_sessiondata_t *session)
+{
+    bool sent = false;
+
+    while(telemetry.tail != telemetry.head) {
+
+        ws_telemetry_t *record = &telemetry.record[telemetry.tail];
+        const uint8_t header[2] = { wshdr_bin.token, record->length };
+
+        if(tcp_sndbuf(session->pcbConnect) < record->length + 2 || session->pcbConnect->snd_queuelen + 2 >= TCP_SND_QUEUELEN)
+            break;
+
+        if(tcp_write(session->pcbConnect, header, sizeof(header), TCP_WRITE_FLAG_COPY|TCP_WRITE_FLAG_MORE) != ERR_OK ||
+            tcp_write(session->pcbConnect, record->data, record->length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+            break;
+
+        sent = true;
+        telemetry.tail = (telemetry.tail + 1) & (WS_TELEMETRY_QUEUE - 1);
+    }
+
+    if(sent) {
+        tcp_output(session->pcbConnect);
+        session->lastSendTime = xTaskGetTickCount();
+    }
+}
+
+#endif
+
 static void WsStreamHandler (ws_sessiondata_t *session)
 {
     static uint8_t tempBuffer[PBUF_POOL_BUFSIZE];
@@ -991,18 +1290,45 @@ static void WsStreamHandler (ws_sessiondata_t *session)
 
     uint_fast16_t TXCount;
 
-    // 2. Process output stream
-    if((TXCount = WsStreamTxCount()) && tcp_sndbuf(session->pcbConnect) > 4) {
+#if WEBSOCKET_STATUS_PUSH
+    if(session->statusPush) {
+
+        WsStreamTxFlush(); // Text output is not sent to status clients.
+
+        if(session->statusInterval && (xTaskGetTickCount() - session->lastStatusTime) >= (session->statusInterval * configTICK_RATE_HZ) / 1000 &&
+            tcp_sndbuf(session->pcbConnect) >= sizeof(ws_status_t) + 2 && session->pcbConnect->snd_queuelen + 2 < TCP_SND_QUEUELEN) {
+            WsStatusPush(session);
+            session->lastSendTime = session->lastStatusTime = xTaskGetTickCount();
+        }
+
+        WsTelemetryPush(session);
+    }
+#endif
+
+    // Hold back output not ending with a line terminator for a short time so it can be sent in one frame
+    // together with the following output, unless it fills a TCP segment.
+    if((TXCount = WsStreamTxCount()) && TXCount < tcp_mss(session->pcbConnect) - 4 &&
+         session->txbuf.data[(session->txbuf.head - 1) & (TX_BUFFER_SIZE - 1)] != '\n') {
+        if(!session->txPending) {
+            session->txPending = true;
+            session->txPendingTime = xTaskGetTickCount();
+        }
+        if(xTaskGetTickCount() - session->txPendingTime < WS_TX_COALESCE_TICKS)
+            TXCount = 0;
+    }
 
-        int16_t c;
-        uint_fast16_t idx = 0;
+    // 2. Process output stream, the frame header is followed by contiguous spans of the output buffer copied directly by tcp_write()
+    // NOTE: a frame consists of up to three writes, the header and the output buffer data before and after wrap around.
+    if(TXCount && tcp_sndbuf(session->pcbConnect) > 4 && session->pcbConnect->snd_queuelen + 3 < TCP_SND_QUEUELEN) {
+
+        session->txPending = false;
+
+        char *data;
+        uint_fast16_t idx = 0, length;
 
         if(TXCount > tcp_sndbuf(session->pcbConnect) - 4)
             TXCount = tcp_sndbuf(session->pcbConnect) - 4;
 
-        if(TXCount > sizeof(tempBuffer) - 4)
-            TXCount = sizeof(tempBuffer) - 4;
-
         tempBuffer[idx++] = session->ftype.token;
         tempBuffer[idx++] = TXCount < 126 ? TXCount : 126;
         if(TXCount >= 126) {
@@ -1010,23 +1336,30 @@ static void WsStreamHandler (ws_sessiondata_t *session)
             tempBuffer[idx++] = TXCount & 0xFF;
         }
 
-        while(TXCount) {
-            if((c = (uint8_t)streamReadTXC()) == -1)
-                break;
-            tempBuffer[idx++] = (uint8_t)c;
-            TXCount--;
-        }
-
 #ifdef WSDEBUG
     DEBUG_PRINT(uitoa(tempBuffer[1]));
     DEBUG_PRINT(" - ");
     DEBUG_PRINT(uitoa(idx));
     DEBUG_PRINT(" - ");
-    DEBUG_PRINT(uitoa(plen));
+    DEBUG_PRINT(uitoa(TXCount));
     DEBUG_PRINT("\r\n");
 #endif
 
-        tcp_write(session->pcbConnect, tempBuffer, (u16_t)idx, 1);
+        if(tcp_write(session->pcbConnect, tempBuffer, (u16_t)idx, TCP_WRITE_FLAG_COPY|TCP_WRITE_FLAG_MORE) == ERR_OK) {
+
+            while(TXCount) {
+
+                if((length = streamGetTXSpan(&data)) > TXCount)
+                    length = TXCount;
+
+                if(tcp_write(session->pcbConnect, data, (u16_t)length, TXCount > length ? TCP_WRITE_FLAG_COPY|TCP_WRITE_FLAG_MORE : TCP_WRITE_FLAG_COPY) != ERR_OK)
+                    break;
+
+                streamSession.txbuf.tail = (streamSession.txbuf.tail + length) & (TX_BUFFER_SIZE - 1);
+                TXCount -= length;
+            }
+        }
+
         tcp_output(session->pcbConnect);
 
         session->lastSendTime = xTaskGetTickCount();
@@ -1054,10 +1387,14 @@ static void WsStreamHandler (ws_sessiondata_t *session)
 //
 void WsStreamPoll (void)
 {
+    PROFILE_BEGIN(Profile_WsStreamPoll);
+
     if(streamSession.state == WsState_Connected)
         streamSession.traffic_handler(&streamSession);
     else if(streamSession.state == WsStateClosing)
         closeSocket(&streamSession, streamSession.pcbConnect);
+
+    PROFILE_END(Profile_WsStreamPoll);
 }
 
 #endif
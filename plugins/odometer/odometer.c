@@ -51,50 +51,37 @@ static bool odometer_changed = false;
 static uint32_t odometers_address, odometers_address_prv;
 static odometer_data_t odometers, odometers_prv;
 static nvs_io_t nvs;
-static stepper_pulse_start_ptr stepper_pulse_start;
+static on_block_prepared_ptr on_block_prepared;
 static on_unknown_sys_command_ptr on_unknown_sys_command;
 static on_state_change_ptr on_state_change;
 static spindle_set_state_ptr spindle_set_state_;
 static settings_changed_ptr settings_changed;
 static on_report_options_ptr on_report_options;
 
-static void stepperPulseStart (stepper_t *stepper)
+// Accumulate steps per planner block rather than per step pulse, keeps the step path free from overhead.
+// NOTE: Steps are counted when the block is queued to the segment buffer, motion aborted
+//       by a reset may thus be counted in part. System motions, e.g. homing, are not counted.
+static void onBlockPrepared (plan_block_t *block)
 {
-    odometer_changed = true;
+    uint_fast8_t idx = N_AXIS;
 
-    if(stepper->step_outbits.x)
-        steps[X_AXIS]++;
+    do {
+        idx--;
+        steps[idx] += plan_block_steps(block, idx);
+    } while(idx);
 
-    if(stepper->step_outbits.y)
-        steps[Y_AXIS]++;
-
-    if(stepper->step_outbits.z)
-        steps[Z_AXIS]++;
-
-#ifdef A_AXIS
-    if(stepper->step_outbits.a)
-        steps[A_AXIS]++;
-#endif
-
-#ifdef B_AXIS
-    if(stepper->step_outbits.b)
-        steps[B_AXIS]++;
-#endif
-
-#ifdef C_AXIS
-    if(stepper->step_outbits.b)
-        steps[C_AXIS]++;
-#endif
-
-    stepper_pulse_start(stepper);
+    if(on_block_prepared)
+        on_block_prepared(block);
 }
 
 void onStateChanged (uint_fast16_t state)
 {
     static uint32_t ms = 0;
 
-    if(state & (STATE_CYCLE|STATE_JOG|STATE_HOMING))
+    if(state & (STATE_CYCLE|STATE_JOG|STATE_HOMING)) {
         ms = hal.get_elapsed_ticks();
+        odometer_changed = true;
+    }
 
     else if(odometer_changed) {
 
@@ -148,11 +135,6 @@ static void onSettingsChanged (settings_t *settings)
         spindle_set_state_ = hal.spindle.set_state;
         hal.spindle.set_state = onSpindleSetState;
     }
-
-    if(hal.stepper.pulse_start != stepperPulseStart) {
-        stepper_pulse_start = hal.stepper.pulse_start;
-        hal.stepper.pulse_start = stepperPulseStart;
-    }
 }
 
 static void odometer_data_reset (bool backup)
@@ -217,7 +199,7 @@ static status_code_t commandExecute (uint_fast16_t state, char *line, char *lcli
 static void onReportOptions (void)
 {
     on_report_options();
-    hal.stream.write("[PLUGIN:ODOMETERS v0.02]"  ASCII_EOL);
+    hal.stream.write("[PLUGIN:ODOMETERS v0.03]"  ASCII_EOL);
 }
 
 static void odometer_warning1 (uint_fast16_t state)
@@ -261,8 +243,8 @@ void odometer_init()
         spindle_set_state_ = hal.spindle.set_state;
         hal.spindle.set_state = onSpindleSetState;
 
-        stepper_pulse_start = hal.stepper.pulse_start;
-        hal.stepper.pulse_start = stepperPulseStart;
+        on_block_prepared = grbl.on_block_prepared;
+        grbl.on_block_prepared = onBlockPrepared;
     }
 }
 
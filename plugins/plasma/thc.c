@@ -36,6 +36,10 @@
 #include "grbl/report.h"
 #include "grbl/pid.h"
 #include "grbl/nvs_buffer.h"
+#ifdef ENABLE_STEP_INJECTION
+#include "grbl/stepper.h"
+#include "grbl/gcode.h"
+#endif
 
 #include "thc.h"
 
@@ -49,6 +53,10 @@
 #define PLASMA_VOLTAGE_PORT       0
 #define PLASMA_FEED_OVERRIDE_PORT 3
 
+#ifndef THC_FILTER_SHIFT
+#define THC_FILTER_SHIFT 2 // Arc voltage low pass filter coefficient as a power of 2, used with driver ADC sampling only.
+#endif
+
 typedef union {
     uint16_t value;
     struct {
@@ -70,7 +78,7 @@ typedef union {
 static thc_signals_t thc = {0};
 static float arc_vref = 0.0f, arc_voltage = 0.0f, arc_voltage_low, arc_voltage_high, vad_threshold;
 static float fr_pgm, fr_actual, fr_thr_99, fr_thr_vad;
-static uint_fast8_t feed_override, segment_id = 0;
+static uint_fast8_t feed_override;
 static bool set_feed_override = false;
 
 static void state_idle (void);
@@ -87,17 +95,57 @@ static spindle_set_state_ptr spindle_set_state_ = NULL;
 static on_execute_realtime_ptr on_execute_realtime = NULL;
 static on_realtime_report_ptr on_realtime_report = NULL;
 static control_signals_callback_ptr control_interrupt_callback = NULL;
-static stepper_pulse_start_ptr stepper_pulse_start = NULL;
 static driver_setting_ptrs_t driver_settings;
 static settings_changed_ptr settings_changed;
 static plasma_settings_t plasma;
 static on_report_options_ptr on_report_options;
 static io_port_t port = {0};
+#ifdef ENABLE_STEP_INJECTION
+static const bool st_injection_available = true;
+#else
+static const bool st_injection_available = false;
+#endif
+static const thc_adc_t *adc = NULL;
+
+// Decimate samples collected by the driver since last call by averaging, then low pass filter the result.
+// Returns filtered sample value in 24.8 fixed point format.
+static uint32_t get_filtered_sample (void)
+{
+    static uint_fast16_t tail = 0;
+    static int32_t filtered = -1;
+
+    uint_fast16_t head = adc->get_head(), count = 0;
+    uint32_t sum = 0;
+
+    while(tail != head) {
+        sum += adc->buffer[tail];
+        tail = (tail + 1) & (adc->buffer_size - 1);
+        count++;
+    }
+
+    if(count) {
+        sum = (sum << 8) / count;
+        if(filtered < 0)
+            filtered = (int32_t)sum;
+        else
+            filtered += ((int32_t)sum - filtered) / (1 << THC_FILTER_SHIFT);
+    }
+
+    return filtered < 0 ? 0 : (uint32_t)filtered;
+}
+
+static float get_arc_voltage (void)
+{
+    return adc
+            ? (float)get_filtered_sample() * (1.0f / 256.0f) * plasma.arc_voltage_scale
+            : (float)port.wait_on_input(false, PLASMA_VOLTAGE_PORT, WaitMode_Immediate, 0.0f) * plasma.arc_voltage_scale;
+}
 
 static void pause_on_error (void)
 {
     system_set_exec_state_flag(EXEC_TOOL_CHANGE);   // Set up program pause for manual tool change
-    protocol_execute_realtime();                    // Execute...
+    if(adc == NULL)                                 // Execute, unless called from the control loop interrupt.
+        protocol_execute_realtime();                // The foreground process will pick it up in that case.
 }
 
 static void digital_out (uint8_t portnum, bool on)
@@ -141,6 +189,19 @@ static bool analog_out (uint8_t portnum, float value)
     return true;
 }
 
+// Output a single Z step for height correction.
+// With step injection enabled the step is superimposed on the motion being executed by the stepper interrupt,
+// only one step is queued at a time so that corrections are limited to the injection rate.
+static void z_step (bool negative)
+{
+#ifdef ENABLE_STEP_INJECTION
+    if(st_get_injection_pending() == 0)
+        st_inject_steps(negative ? -1 : 1);
+#else
+    hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){negative ? Z_AXIS_BIT : 0});
+#endif
+}
+
 static void set_target_voltage (float v)
 {
     arc_vref = v;
@@ -152,7 +213,7 @@ static void set_target_voltage (float v)
 
 static void state_idle (void)
 {
-    arc_voltage = (float)port.wait_on_input(false, PLASMA_VOLTAGE_PORT, WaitMode_Immediate, 0.0f) * plasma.arc_voltage_scale;
+    arc_voltage = get_arc_voltage();
 }
 
 static void state_thc_delay (void)
@@ -163,7 +224,7 @@ static void state_thc_delay (void)
             stateHandler = state_thc_adjust;
         else {
             pidf_reset(&pid);
-            set_target_voltage((float)port.wait_on_input(false, PLASMA_VOLTAGE_PORT, WaitMode_Immediate, 0.0f) * plasma.arc_voltage_scale);
+            set_target_voltage(get_arc_voltage());
             stateHandler = state_vad_lock;
             stateHandler();
         }
@@ -175,9 +236,9 @@ static void state_thc_adjust (void)
     if((thc.arc_ok = port.wait_on_input(true, PLASMA_ARC_OK_PORT, WaitMode_Immediate, 0.0f) == 1)) {
 
         if(port.wait_on_input(true, PLASMA_CUTTER_UP_PORT, WaitMode_Immediate, 0.0f))
-            hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){Z_AXIS_BIT});
+            z_step(true);
         else if(port.wait_on_input(true, PLASMA_CUTTER_DOWN_PORT, WaitMode_Immediate, 0.0f))
-            hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){0});
+            z_step(false);
 
     } else
         pause_on_error();
@@ -198,12 +259,12 @@ static void state_thc_pid (void)
 
     if((thc.arc_ok = port.wait_on_input(true, PLASMA_ARC_OK_PORT, WaitMode_Immediate, 0.0f) == 1)) {
 
-        arc_voltage = (float)port.wait_on_input(false, PLASMA_VOLTAGE_PORT, WaitMode_Immediate, 0.0f) * plasma.arc_voltage_scale;
+        arc_voltage = get_arc_voltage();
 
         if(arc_voltage >= arc_voltage_high)
-            hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){Z_AXIS_BIT});
+            z_step(true);
         else if(arc_voltage <= arc_voltage_low)
-            hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){0});
+            z_step(false);
 
     } else
         pause_on_error();
@@ -217,13 +278,19 @@ static void state_thc_pid (void)
 
 /* end THC state machine */
 
+// Called from driver timer interrupt at a fixed rate when the driver provides arc voltage sampling.
+static void thc_control_loop (void)
+{
+    stateHandler();
+}
+
 void onExecuteRealtime (uint_fast16_t state)
 {
     static uint32_t last_ms;
 
     uint32_t ms = hal.get_elapsed_ticks();
 
-    if(ms != last_ms) {
+    if(adc == NULL && ms != last_ms) {
         last_ms = ms;
         stateHandler();
     }
@@ -263,6 +330,14 @@ static void arcSetState (spindle_state_t state, float rpm)
         spindle_set_state_(state, rpm);
         thc.torch_on = thc.arc_ok = thc.enabled = Off;
         stateHandler = state_idle;
+#ifdef ENABLE_STEP_INJECTION
+        // Injected steps are not known by the planner, pick up the corrected Z position now that motion has stopped.
+        // Positions are synced by the reset handling when called on a reset.
+        if(!(sys_rt_exec_state & EXEC_RESET)) {
+            plan_sync_position();
+            gc_sync_position();
+        }
+#endif
     } else {
         uint_fast8_t retries = plasma.arc_retries;
         do {
@@ -289,7 +364,8 @@ static void arcSetState (spindle_state_t state, float rpm)
     }
 }
 
-static void stepperPulseStart (stepper_t *stepper)
+// Called by the stepper ISR once per step segment.
+static void onSegmentStart (stepper_t *stepper)
 {
     static volatile bool get_rates = false;
 
@@ -298,15 +374,9 @@ static void stepperPulseStart (stepper_t *stepper)
         fr_pgm = stepper->exec_block->programmed_rate * 0.01f * sys.override.feed_rate;
         fr_thr_99 = fr_pgm * 0.99f;
         fr_thr_vad = fr_pgm * 0.01f * (float)plasma.vad_threshold;
-        segment_id = 0;
-    }
-
-    if(stepper->exec_segment->id != segment_id) {
-        segment_id = stepper->exec_segment->id;
-        fr_actual = stepper->exec_segment->current_rate;
     }
 
-    stepper_pulse_start(stepper);
+    fr_actual = stepper->exec_segment->current_rate;
 }
 
 // Reclaim entry points that may have been changed on settings change.
@@ -318,11 +388,6 @@ static void onSettingsChanged (settings_t *settings)
         spindle_set_state_ = hal.spindle.set_state;
         hal.spindle.set_state = arcSetState;
     }
-
-    if(hal.stepper.pulse_start != stepperPulseStart) {
-        stepper_pulse_start = hal.stepper.pulse_start;
-        hal.stepper.pulse_start = stepperPulseStart;
-    }
 }
 
 // Trap cycle start commands and redirect to foreground process
@@ -591,12 +656,12 @@ static void plasma_warning (uint_fast16_t state)
 static void onReportOptions (void)
 {
     on_report_options();
-    hal.stream.write("[PLUGIN:PLASMA v0.01]" ASCII_EOL);
+    hal.stream.write("[PLUGIN:PLASMA v0.02]" ASCII_EOL);
 }
 
-bool plasma_init (void)
+bool plasma_init (const thc_adc_t *adc_in)
 {
-    if(hal.port.num_analog_in > 0 && hal.port.num_digital_in > 1 && hal.port.wait_on_input && hal.stepper.output_step) {
+    if((adc_in || hal.port.num_analog_in > 0) && hal.port.num_digital_in > 1 && hal.port.wait_on_input && (hal.stepper.output_step || st_injection_available)) {
 
         if ((hal.driver_settings.nvs_address = nvs_alloc(sizeof(plasma_settings_t)))) {
 
@@ -630,8 +695,7 @@ bool plasma_init (void)
                 driver_reset = hal.driver_reset;
                 hal.driver_reset = reset;
 
-                stepper_pulse_start = hal.stepper.pulse_start;
-                hal.stepper.pulse_start = stepperPulseStart;
+                st_add_segment_hook(onSegmentStart);
 
                 settings_changed = hal.settings_changed;
                 hal.settings_changed = onSettingsChanged;
@@ -642,6 +706,9 @@ bool plasma_init (void)
                 hal.driver_cap.spindle_at_speed = Off;
 
                 pidf_init(&pid, &plasma.pid);
+
+                if((adc = adc_in) && !adc->start(thc_control_loop))
+                    adc = NULL;
             }
         }
     }
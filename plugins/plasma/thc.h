@@ -50,6 +50,16 @@ typedef struct {
     pid_values_t pid;
 } plasma_settings_t;
 
-bool plasma_init (void);
+// Optional driver interface for continuous arc voltage sampling, e.g. by DMA into a ring buffer.
+// The driver calls the control loop from a timer interrupt at a fixed rate once started.
+typedef struct {
+    volatile uint16_t *buffer;                      // Sample ring buffer
+    uint_fast16_t buffer_size;                      // Number of samples in ring buffer, must be a power of 2
+    uint32_t control_rate;                          // Control loop rate in Hz
+    uint_fast16_t (*get_head)(void);                // Returns index of next sample to be written to the ring buffer
+    bool (*start)(void (*control_loop)(void));      // Start sampling and timer driven control loop
+} thc_adc_t;
+
+bool plasma_init (const thc_adc_t *adc);
 
 #endif
@@ -0,0 +1,123 @@
+/*
+  filebuf.c - double buffered file reader for streaming jobs from file systems
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "filebuf.h"
+
+#ifndef min
+#define min(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+static bool file_fill (file_buffer_t *fbuf, file_chunk_t *chunk, size_t offset)
+{
+    chunk->offset = offset;
+
+    if(fbuf->fill(fbuf->handle, offset, chunk->data, fbuf->size, &chunk->length))
+        return true;
+
+    chunk->length = 0;
+
+    return false;
+}
+
+// Attaches file and buffer memory, buffer must be at least 2 * size bytes.
+// Full sector sized reads allows file systems to transfer data directly to the buffer.
+void file_buffer_init (file_buffer_t *fbuf, void *handle, file_buffer_fill_ptr fill, uint8_t *buffer, size_t size)
+{
+    fbuf->handle = handle;
+    fbuf->fill = fill;
+    fbuf->size = size;
+    fbuf->chunk[0].data = buffer;
+    fbuf->chunk[1].data = buffer + size;
+
+    file_buffer_reset(fbuf, 0);
+}
+
+// Discards buffered data, next read starts at offset.
+void file_buffer_reset (file_buffer_t *fbuf, size_t offset)
+{
+    fbuf->active = 0;
+    fbuf->pos = 0;
+    fbuf->ready = false;
+    fbuf->chunk[0].length = 0;
+    fbuf->chunk[0].offset = offset;
+}
+
+// Switches to the next chunk when the active chunk is consumed, reads it now if not prefetched.
+// Returns false on EOF or read error.
+bool file_buffer_next_chunk (file_buffer_t *fbuf)
+{
+    file_chunk_t *chunk = &fbuf->chunk[fbuf->active], *next = &fbuf->chunk[fbuf->active ^ 1];
+
+    if(!fbuf->ready && !file_fill(fbuf, next, chunk->offset + chunk->length))
+        return false;
+
+    fbuf->active ^= 1;
+    fbuf->pos = 0;
+    fbuf->ready = false;
+
+    return next->length != 0;
+}
+
+// Reads the next chunk into the free buffer, to be called from the foreground process.
+void file_buffer_prefetch (file_buffer_t *fbuf)
+{
+    if(!fbuf->ready) {
+        file_chunk_t *chunk = &fbuf->chunk[fbuf->active];
+        if(chunk->length == fbuf->size || (chunk->length == 0 && fbuf->pos == 0)) // not at EOF
+            fbuf->ready = file_fill(fbuf, &fbuf->chunk[fbuf->active ^ 1], chunk->offset + chunk->length);
+    }
+}
+
+// Reads size bytes into data, returns false on EOF or read error.
+bool file_buffer_read (file_buffer_t *fbuf, void *data, size_t size)
+{
+    size_t count;
+    uint8_t *dst = (uint8_t *)data;
+
+    while(size) {
+        if(fbuf->pos == fbuf->chunk[fbuf->active].length && !file_buffer_next_chunk(fbuf))
+            return false;
+        count = min(size, fbuf->chunk[fbuf->active].length - fbuf->pos);
+        memcpy(dst, &fbuf->chunk[fbuf->active].data[fbuf->pos], count);
+        fbuf->pos += count;
+        dst += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+// Moves read position to offset, keeps buffered data if offset is within it.
+void file_buffer_seek (file_buffer_t *fbuf, size_t offset)
+{
+    file_chunk_t *chunk = &fbuf->chunk[fbuf->active], *next = &fbuf->chunk[fbuf->active ^ 1];
+
+    if(offset >= chunk->offset && offset <= chunk->offset + chunk->length)
+        fbuf->pos = offset - chunk->offset;
+    else if(fbuf->ready && offset >= next->offset && offset <= next->offset + next->length) {
+        fbuf->active ^= 1;
+        fbuf->pos = offset - next->offset;
+        fbuf->ready = false;
+    } else
+        file_buffer_reset(fbuf, offset);
+}
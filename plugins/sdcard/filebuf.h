@@ -0,0 +1,73 @@
+/*
+  filebuf.h - double buffered file reader for streaming jobs from file systems
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FILEBUF_H_
+#define _FILEBUF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Reads up to size bytes at offset into data, returns false on error.
+// The number of bytes read is returned in length, less than size at EOF.
+typedef bool (*file_buffer_fill_ptr)(void *handle, size_t offset, uint8_t *data, size_t size, size_t *length);
+
+typedef struct {
+    uint8_t *data;
+    size_t length;                  // Number of bytes in buffer
+    size_t offset;                  // File offset of first byte in buffer
+} file_chunk_t;
+
+// File data is read in chunks into two buffers, one is consumed while the next chunk is prefetched
+// into the other by the foreground process.
+typedef struct {
+    void *handle;                   // File handle, passed to fill function
+    file_buffer_fill_ptr fill;
+    size_t size;                    // Size of each of the two buffers
+    file_chunk_t chunk[2];
+    uint_fast8_t active;            // Index of chunk being consumed
+    size_t pos;                     // Read position in active chunk
+    bool ready;                     // True when the other chunk holds the data following the active chunk
+} file_buffer_t;
+
+void file_buffer_init (file_buffer_t *fbuf, void *handle, file_buffer_fill_ptr fill, uint8_t *buffer, size_t size);
+void file_buffer_reset (file_buffer_t *fbuf, size_t offset);
+void file_buffer_seek (file_buffer_t *fbuf, size_t offset);
+void file_buffer_prefetch (file_buffer_t *fbuf);
+bool file_buffer_read (file_buffer_t *fbuf, void *data, size_t size);
+bool file_buffer_next_chunk (file_buffer_t *fbuf);
+
+// Returns file offset of next byte to be read.
+static inline size_t file_buffer_tell (file_buffer_t *fbuf)
+{
+    return fbuf->chunk[fbuf->active].offset + fbuf->pos;
+}
+
+// Returns next byte from file, -1 on EOF or read error.
+static inline int16_t file_buffer_getc (file_buffer_t *fbuf)
+{
+    if(fbuf->pos == fbuf->chunk[fbuf->active].length && !file_buffer_next_chunk(fbuf))
+        return -1;
+
+    return (int16_t)fbuf->chunk[fbuf->active].data[fbuf->pos++];
+}
+
+#endif
@@ -23,6 +23,8 @@
 
 #if SDCARD_ENABLE
 
+#include "filebuf.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +36,11 @@
 #ifdef ARDUINO
   #include "../grbl/report.h"
   #include "../grbl/protocol.h"
+  #include "../grbl/state_machine.h"
+  #include "../grbl/motion_control.h"
+  #ifdef ENABLE_NVS_CHECKPOINT
+    #include "../grbl/checkpoint.h"
+  #endif
   #ifdef __IMXRT1062__
     #include "uSDFS.h"
     #define SDCARD_DEV "1:/"
@@ -42,6 +49,11 @@
 #else
   #include "grbl/report.h"
   #include "grbl/protocol.h"
+  #include "grbl/state_machine.h"
+  #include "grbl/motion_control.h"
+  #ifdef ENABLE_NVS_CHECKPOINT
+    #include "grbl/checkpoint.h"
+  #endif
 #endif
 
 #ifdef __IMXRT1062__
@@ -67,6 +79,10 @@ const char *dev = "";
 /* uses fatfs - http://www.elm-chan.org/fsw/ff/00index_e.html */
 
 #define MAX_PATHLEN 128
+
+#ifndef SDCARD_BUFFER_SIZE
+#define SDCARD_BUFFER_SIZE 1024 // Size of each of the two file read buffers, should be a multiple of the 512 byte sector size.
+#endif
 #define LCAPS(c) ((c >= 'A' && c <= 'Z') ? c | 0x20 : c)
 
 #if FF_USE_LFN
@@ -101,6 +117,10 @@ typedef struct
     size_t pos;
     uint32_t line;
     uint8_t eol;
+#ifdef ENABLE_NVS_CHECKPOINT
+    uint32_t id;            // Identifies the file for checkpoints, from its size and modification date and time.
+    size_t line_start;      // Offset of the line being read.
+#endif
 } file_t;
 
 static file_t file = {
@@ -110,6 +130,12 @@ static file_t file = {
     .pos = 0
 };
 
+// File data is read in chunks into two buffers, one is consumed while the next chunk is prefetched
+// into the other by the foreground process. Full sector reads allows FatFs to transfer sectors
+// directly to the buffer, by DMA if supported by the disk driver.
+static file_buffer_t fbuf;
+static uint8_t fbuf_data[2 * SDCARD_BUFFER_SIZE];
+
 static bool frewind = false;
 static io_stream_t active_stream;
 static driver_reset_ptr driver_reset;
@@ -117,6 +143,90 @@ static on_unknown_sys_command_ptr on_unknown_sys_command;
 static on_realtime_report_ptr on_realtime_report;
 static on_state_change_ptr state_change_requested;
 static on_program_completed_ptr on_program_completed;
+static on_execute_realtime_ptr on_execute_realtime;
+
+#ifdef ENABLE_BLOCK_REPLAY
+
+/* Replay cache: when a job is run the lines read are recorded to a .rpl file alongside the g-code file,
+   together with the parsed blocks passed to grbl.on_replayable_block. On the next run of an unchanged file
+   with unchanged settings the recorded blocks are executed by gc_replay_block() instead of being parsed
+   again. Each record holds a hash of the parser state (modes, feed rate, position and offsets) before the
+   line was executed, if it does not match the current state the text of the line is parsed as usual.
+   Changes of offsets or position by probing, coordinate system changes etc. are thus handled by
+   falling back to parsing the affected lines. */
+
+#define REPLAY_MAGIC 0x314C5052 // "RPL1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;          // Size of the g-code file.
+    uint32_t date;          // Modification date and time of the g-code file.
+    uint32_t settings;      // Hash of the settings.
+    uint16_t block_size;    // sizeof(gc_replay_block_t)
+    bool complete;          // Set when the job has been run to the end.
+} replay_header_t;
+
+typedef struct {
+    uint32_t state;         // Hash of the parser state before the line was executed.
+    uint16_t length;        // Length of line text following the record.
+    bool block;             // A parsed block follows the line text.
+} replay_record_t;
+
+typedef enum {
+    Replay_Off = 0,
+    Replay_Recording,
+    Replay_Replaying
+} replay_mode_t;
+
+typedef struct {
+    replay_mode_t mode;
+    FIL file;
+    replay_header_t header;
+    uint32_t state;         // Recording: parser state hash at start of current line.
+    uint16_t length;        // Recording: length of current line, replaying: remaining characters of current line.
+    bool block_pending;     // Recording: parsed block received for current line.
+    bool skip_block;        // Replaying: parsed block follows the current line.
+    gc_replay_block_t block;
+    char line[LINE_BUFFER_SIZE];
+    char source[MAX_PATHLEN];
+    char name[MAX_PATHLEN];
+} replay_t;
+
+static replay_t replay = {0};
+static on_replayable_block_ptr on_replayable_block;
+
+static int16_t sdcard_read (void);
+
+#endif
+
+#ifdef ENABLE_SDCARD_JOB_QUEUE
+
+#ifndef SDCARD_JOB_QUEUE_SIZE
+#define SDCARD_JOB_QUEUE_SIZE 4 // Max number of files in the job queue.
+#endif
+
+/* Job queue: a list of files run one after the other, each a number of times. When a file is completed by M2
+   or M30 the next run is started directly from the program completed event, without returning to the host
+   and without waiting for a cycle start. */
+
+typedef struct {
+    char name[MAX_PATHLEN];
+    uint16_t repeat;        // Number of runs.
+} queued_job_t;
+
+typedef struct {
+    bool running;
+    uint_fast8_t length;    // Number of files queued.
+    uint_fast8_t current;   // Index of the file running.
+    uint16_t runs;          // Number of completed runs of the file running.
+    queued_job_t job[SDCARD_JOB_QUEUE_SIZE];
+} job_queue_t;
+
+static job_queue_t queue = {0};
+
+static bool job_open (char *filename);
+
+#endif
 
 static void sdcard_end_job (void);
 static void sdcard_report (stream_write_ptr stream_write, report_tracking_flags_t report);
@@ -251,6 +361,26 @@ static FRESULT scan_dir (char *path, uint_fast8_t depth, char *buf)
     return res;
 }
 
+static bool file_fill (void *handle, size_t offset, uint8_t *data, size_t size, size_t *length)
+{
+    UINT count;
+    bool ok = (f_tell((FIL *)handle) == offset || f_lseek((FIL *)handle, offset) == FR_OK) &&
+               f_read((FIL *)handle, data, size, &count) == FR_OK;
+
+    *length = ok ? (size_t)count : 0;
+
+    return ok;
+}
+
+// Reads the next chunk into the free buffer, called from the foreground process.
+static void file_prefetch (uint_fast16_t state)
+{
+    if(file.handle)
+        file_buffer_prefetch(&fbuf);
+
+    on_execute_realtime(state);
+}
+
 static void file_close (void)
 {
     if(file.handle) {
@@ -259,6 +389,22 @@ static void file_close (void)
     }
 }
 
+#ifdef ENABLE_NVS_CHECKPOINT
+
+static uint32_t file_id (char *filename)
+{
+    FILINFO fno;
+
+#if _USE_LFN
+    fno.lfname = NULL;
+    fno.lfsize = 0;
+#endif
+
+    return f_stat(filename, &fno) == FR_OK ? ((((uint32_t)fno.fdate << 16) | fno.ftime) ^ (uint32_t)fno.fsize) : 0;
+}
+
+#endif
+
 static bool file_open (char *filename)
 {
     if(file.handle)
@@ -269,7 +415,12 @@ static bool file_open (char *filename)
         file.size = f_size(file.handle);
         file.pos = 0;
         file.line = 0;
+        file_buffer_init(&fbuf, file.handle, file_fill, fbuf_data, SDCARD_BUFFER_SIZE);
         file.eol = false;
+#ifdef ENABLE_NVS_CHECKPOINT
+        file.id = file_id(filename);
+        file.line_start = 0;
+#endif
         char *leafname = strrchr(filename, '/');
         strncpy(file.name, leafname ? leafname + 1 : filename, sizeof(file.name));
         file.name[sizeof(file.name) - 1] = '\0';
@@ -280,22 +431,476 @@ static bool file_open (char *filename)
 
 static int16_t file_read (void)
 {
-    signed char c;
-    UINT count;
+    int16_t c;
 
-    if(f_read(file.handle, &c, 1, &count) == FR_OK && count == 1)
-        file.pos = f_tell(file.handle);
-    else
-        c = -1;
+    if((c = file_buffer_getc(&fbuf)) != -1)
+        file.pos = file_buffer_tell(&fbuf);
 
     if(c == '\r' || c == '\n')
         file.eol++;
     else
         file.eol = 0;
 
-    return (int16_t)c;
+    return c;
+}
+
+#ifdef ENABLE_BLOCK_REPLAY
+
+// 32-bit FNV-1a hash.
+static uint32_t hash (uint32_t value, const void *data, size_t size)
+{
+    const uint8_t *ptr = (const uint8_t *)data;
+
+    while(size--)
+        value = (value ^ *ptr++) * 16777619UL;
+
+    return value;
+}
+
+static uint32_t replay_state_hash (void)
+{
+    uint32_t state = hash(2166136261UL, &gc_state.modal, sizeof(gc_modal_t));
+
+    state = hash(state, &gc_state.feed_rate, sizeof(gc_state.feed_rate));
+    state = hash(state, &gc_state.spindle.rpm, sizeof(gc_state.spindle.rpm));
+    state = hash(state, gc_state.position, sizeof(gc_state.position));
+    state = hash(state, gc_state.g92_coord_offset, sizeof(gc_state.g92_coord_offset));
+
+    return hash(state, gc_state.tool_length_offset, sizeof(gc_state.tool_length_offset));
+}
+
+static bool replay_write (const void *data, UINT size)
+{
+    UINT count;
+
+    return f_write(&replay.file, data, size, &count) == FR_OK && count == size;
+}
+
+static void replay_end (bool completed);
+
+// Write record for the line just executed.
+static void replay_write_record (void)
+{
+    if(replay.length || replay.block_pending) {
+
+        replay_record_t record;
+
+        memset(&record, 0, sizeof(replay_record_t));
+        record.state = replay.state;
+        record.length = replay.length;
+        record.block = replay.block_pending;
+
+        replay.length = 0;
+        replay.block_pending = false;
+
+        if(!(replay_write(&record, sizeof(replay_record_t)) && replay_write(replay.line, record.length) &&
+              (!record.block || replay_write(&replay.block, sizeof(gc_replay_block_t)))))
+            replay_end(false);
+    }
+}
+
+static void replay_record_char (char c)
+{
+    if(replay.length == 0)
+        replay.state = replay_state_hash();
+
+    if(replay.length < sizeof(replay.line))
+        replay.line[replay.length++] = c;
+    else
+        replay_end(false);
+}
+
+// Finish recording, the cache is removed unless the job was completed.
+static void replay_end (bool completed)
+{
+    if(replay.mode == Replay_Recording) {
+
+        replay.mode = Replay_Off;
+
+        if(completed) {
+            replay_write_record();
+            replay.header.complete = true;
+            completed = f_lseek(&replay.file, 0) == FR_OK && replay_write(&replay.header, sizeof(replay_header_t));
+        }
+
+        f_close(&replay.file);
+
+        if(!completed)
+            f_unlink(replay.name);
+    }
+
+    replay.mode = Replay_Off;
+    replay.length = 0;
+    replay.block_pending = replay.skip_block = false;
+}
+
+// Replay the cache if valid for the g-code file, else start recording it.
+static void replay_start (void)
+{
+    UINT count;
+    FILINFO fno;
+    replay_header_t header;
+    char *ext;
+
+#if _USE_LFN
+    fno.lfname = NULL;
+    fno.lfsize = 0;
+#endif
+
+    replay_end(false);
+
+    if(strlen(replay.source) + 4 >= sizeof(replay.name) || f_stat(replay.source, &fno) != FR_OK)
+        return;
+
+    strcpy(replay.name, replay.source);
+    if((ext = strrchr(replay.name, '.')) && !strchr(ext, '/'))
+        *ext = '\0';
+    strcat(replay.name, ".rpl");
+
+    memset(&replay.header, 0, sizeof(replay_header_t));
+    replay.header.magic = REPLAY_MAGIC;
+    replay.header.size = (uint32_t)fno.fsize;
+    replay.header.date = ((uint32_t)fno.fdate << 16) | fno.ftime;
+    replay.header.settings = hash(2166136261UL, &settings, sizeof(settings_t));
+    replay.header.block_size = sizeof(gc_replay_block_t);
+    replay.header.complete = true;
+
+    if(f_open(&replay.file, replay.name, FA_READ) == FR_OK) {
+        if(f_read(&replay.file, &header, sizeof(replay_header_t), &count) == FR_OK && count == sizeof(replay_header_t) &&
+            !memcmp(&header, &replay.header, sizeof(replay_header_t))) {
+            file_close();
+            file.handle = &replay.file;
+            file.size = f_size(file.handle);
+            file.pos = f_tell(file.handle);
+            file_buffer_init(&fbuf, file.handle, file_fill, fbuf_data, SDCARD_BUFFER_SIZE);
+            file_buffer_reset(&fbuf, file.pos);
+            replay.mode = Replay_Replaying;
+            return;
+        }
+        f_close(&replay.file);
+    }
+
+    replay.header.complete = false;
+
+    if(f_open(&replay.file, replay.name, FA_WRITE|FA_CREATE_ALWAYS) == FR_OK) {
+        if(replay_write(&replay.header, sizeof(replay_header_t)))
+            replay.mode = Replay_Recording;
+        else {
+            f_close(&replay.file);
+            f_unlink(replay.name);
+        }
+    }
+}
+
+// Read next character of line text from the cache, recorded blocks are executed if the parser state matches.
+static int16_t replay_read (void)
+{
+    replay_record_t record;
+
+    while(replay.length == 0) {
+
+        if(replay.skip_block) {
+            replay.skip_block = false;
+            file_buffer_seek(&fbuf, file_buffer_tell(&fbuf) + sizeof(gc_replay_block_t));
+        }
+
+        if(!file_buffer_read(&fbuf, &record, sizeof(replay_record_t)))
+            return -1;
+
+        if(record.block && record.state == replay_state_hash()) {
+            file_buffer_seek(&fbuf, file_buffer_tell(&fbuf) + record.length);
+            if(!file_buffer_read(&fbuf, &replay.block, sizeof(gc_replay_block_t)))
+                return -1;
+            file.pos = file_buffer_tell(&fbuf);
+            file.line++;
+            file.eol = 0;
+            gc_replay_block(&replay.block);
+            if(sys.abort || !(sys.state == STATE_IDLE || (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE))))
+                return -1;
+        } else {
+            replay.length = record.length;
+            replay.skip_block = record.block;
+        }
+    }
+
+    replay.length--;
+
+    return file_read();
+}
+
+static void replay_on_block (gc_replay_block_t *block)
+{
+    if(replay.mode == Replay_Recording && hal.stream.read == sdcard_read) {
+        memcpy(&replay.block, block, sizeof(gc_replay_block_t));
+        replay.block_pending = true;
+    }
+
+    if(on_replayable_block)
+        on_replayable_block(block);
+}
+
+#endif
+
+#ifdef ENABLE_SDCARD_INDEX
+
+/* Line index: when a job is run from the start a checkpoint is recorded to a .idx file alongside the g-code file
+   every SDCARD_INDEX_INTERVAL lines. A checkpoint holds the file offset of the next line and a snapshot of the
+   modal state after the previous line was executed. The index is flushed on every checkpoint so that it is
+   available for restarting the job after a reset or power loss. $FL<line>=<filename> seeks straight to the last
+   checkpoint at or before the line and restores the modal state by a generated block before resuming the job. */
+
+#ifndef SDCARD_INDEX_INTERVAL
+#define SDCARD_INDEX_INTERVAL 500 // Number of lines between index checkpoints.
+#endif
+
+#define INDEX_MAGIC 0x31584449 // "IDX1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;          // Size of the g-code file.
+    uint32_t date;          // Modification date and time of the g-code file.
+    uint16_t record_size;   // sizeof(index_record_t)
+} index_header_t;
+
+typedef struct {
+    uint32_t line;          // Number of lines before the checkpoint.
+    uint32_t offset;        // File offset of the first line after the checkpoint.
+    gc_modal_t modal;
+    float feed_rate;
+    float rpm;
+} index_record_t;
+
+typedef struct {
+    bool recording;
+    FIL file;
+    char name[MAX_PATHLEN];
+    char *restore;          // Next character of the modal state restore block to return, NULL if none.
+    char block[80];
+} index_t;
+
+static index_t findex = {0};
+
+// Builds the index file name and header for the g-code file, returns false if the file is not found.
+static bool index_header (char *filename, index_header_t *header)
+{
+    FILINFO fno;
+    char *ext;
+
+#if _USE_LFN
+    fno.lfname = NULL;
+    fno.lfsize = 0;
+#endif
+
+    if(strlen(filename) + 4 >= sizeof(findex.name) || f_stat(filename, &fno) != FR_OK)
+        return false;
+
+    strcpy(findex.name, filename);
+    if((ext = strrchr(findex.name, '.')) && !strchr(ext, '/'))
+        *ext = '\0';
+    strcat(findex.name, ".idx");
+
+    memset(header, 0, sizeof(index_header_t));
+    header->magic = INDEX_MAGIC;
+    header->size = (uint32_t)fno.fsize;
+    header->date = ((uint32_t)fno.fdate << 16) | fno.ftime;
+    header->record_size = sizeof(index_record_t);
+
+    return true;
+}
+
+static void index_end (void)
+{
+    if(findex.recording) {
+        findex.recording = false;
+        f_close(&findex.file);
+    }
+
+    findex.restore = NULL;
+}
+
+// Start recording the index for a job run from the start.
+static void index_start (char *filename)
+{
+    UINT count;
+    index_header_t header;
+
+    index_end();
+
+    if(index_header(filename, &header) && f_open(&findex.file, findex.name, FA_WRITE|FA_CREATE_ALWAYS) == FR_OK) {
+        if(f_write(&findex.file, &header, sizeof(index_header_t), &count) == FR_OK && count == sizeof(index_header_t))
+            findex.recording = true;
+        else
+            f_close(&findex.file);
+    }
+}
+
+// Called on every line end, writes a checkpoint every SDCARD_INDEX_INTERVAL lines.
+static void index_line (void)
+{
+    UINT count;
+    index_record_t record;
+
+    if(findex.recording && (file.line % SDCARD_INDEX_INTERVAL) == 0) {
+
+        record.line = file.line;
+        record.offset = (uint32_t)file.pos;
+        memcpy(&record.modal, &gc_state.modal, sizeof(gc_modal_t));
+        record.feed_rate = gc_state.feed_rate;
+        record.rpm = gc_state.spindle.rpm;
+
+        if(!(f_write(&findex.file, &record, sizeof(index_record_t), &count) == FR_OK && count == sizeof(index_record_t) && f_sync(&findex.file) == FR_OK))
+            index_end();
+    }
+}
+
+// Generates the block restoring the modal state recorded in the checkpoint.
+static void index_restore_block (index_record_t *record)
+{
+    char *block = findex.block;
+
+    strcpy(block, record->modal.coolant.mist && record->modal.coolant.flood ? "M7\nG" : "G"); // M7 and M8 can not be in the same block
+
+    if(record->modal.coord_system.id > CoordinateSystem_G59) {
+        strcat(block, "59.");
+        strcat(block, uitoa((uint32_t)(record->modal.coord_system.id - CoordinateSystem_G59)));
+    } else
+        strcat(block, uitoa((uint32_t)(record->modal.coord_system.id + 54)));
+
+    strcat(block, " G");
+    strcat(block, uitoa((uint32_t)(record->modal.plane_select + 17)));
+    strcat(block, record->modal.units_imperial ? " G20" : " G21");
+    strcat(block, record->modal.distance_incremental ? " G91" : " G90");
+    strcat(block, " G");
+    strcat(block, uitoa((uint32_t)(94 - record->modal.feed_mode)));
+
+    if(record->modal.motion <= MotionMode_Linear)
+        strcat(block, record->modal.motion == MotionMode_Linear ? " G1" : " G0");
+
+    if(record->feed_rate > 0.0f) {
+        strcat(block, " F");
+        strcat(block, ftoa(record->modal.units_imperial ? record->feed_rate / MM_PER_INCH : record->feed_rate, 3));
+    }
+
+    strcat(block, " S");
+    strcat(block, ftoa(record->rpm, 0));
+    strcat(block, record->modal.spindle.on ? (record->modal.spindle.ccw ? " M4" : " M3") : " M5");
+
+    if(record->modal.coolant.flood)
+        strcat(block, " M8");
+    else if(record->modal.coolant.mist)
+        strcat(block, " M7");
+    else
+        strcat(block, " M9");
+
+    strcat(block, "\n");
+
+    findex.restore = findex.block;
+}
+
+// Seeks to the last checkpoint at or before the line in the opened g-code file and sets up the modal state restore block.
+// Returns the line the job is restarted from, the job is restarted from the start if no checkpoint is found.
+static uint32_t index_seek (char *filename, uint32_t line)
+{
+    UINT count;
+    FIL ifile;
+    index_header_t header, stored;
+    index_record_t record, checkpoint = {0};
+
+    index_end();
+
+    if(index_header(filename, &header) && f_open(&ifile, findex.name, FA_READ) == FR_OK) {
+
+        if(f_read(&ifile, &stored, sizeof(index_header_t), &count) == FR_OK && count == sizeof(index_header_t) &&
+            !memcmp(&header, &stored, sizeof(index_header_t))) {
+
+            while(f_read(&ifile, &record, sizeof(index_record_t), &count) == FR_OK && count == sizeof(index_record_t) && record.line <= line)
+                memcpy(&checkpoint, &record, sizeof(index_record_t));
+        }
+
+        f_close(&ifile);
+    }
+
+    if(checkpoint.line) {
+        file_buffer_reset(&fbuf, checkpoint.offset);
+        file.pos = checkpoint.offset;
+        file.line = checkpoint.line;
+#ifdef ENABLE_NVS_CHECKPOINT
+        file.line_start = checkpoint.offset;
+#endif
+        index_restore_block(&checkpoint);
+    }
+
+    return checkpoint.line;
 }
 
+#ifdef ENABLE_NVS_CHECKPOINT
+
+// Seeks to the line executing when the power loss checkpoint was written and sets up the modal state restore block.
+// Returns false if the checkpoint is not for the opened g-code file.
+static bool index_resume (checkpoint_t *stored)
+{
+    index_record_t checkpoint;
+
+    index_end();
+
+    if(!(file.id && stored->source.id == file.id && stored->source.offset < file.size))
+        return false;
+
+    checkpoint.line = stored->source.line;
+    checkpoint.offset = stored->source.offset;
+    memcpy(&checkpoint.modal, &stored->modal, sizeof(gc_modal_t));
+    checkpoint.feed_rate = stored->feed_rate;
+    checkpoint.rpm = stored->rpm;
+
+    file_buffer_reset(&fbuf, checkpoint.offset);
+    file.pos = file.line_start = checkpoint.offset;
+    file.line = checkpoint.line;
+    index_restore_block(&checkpoint);
+
+    return true;
+}
+
+#endif
+
+// Returns the next character of the modal state restore block, -1 when done.
+static inline int16_t index_restore_read (void)
+{
+    int16_t c = -1;
+
+    if(findex.restore) {
+        if(*findex.restore)
+            c = (int16_t)*findex.restore++;
+        else
+            findex.restore = NULL;
+    }
+
+    return c;
+}
+
+#endif
+
+#ifdef ENABLE_NVS_CHECKPOINT
+
+// Provides the source of the line being parsed for power loss checkpoints, not known when replaying from the cache.
+static bool checkpoint_source (checkpoint_source_t *source)
+{
+    if(hal.stream.type != StreamType_SDCard || file.handle == NULL)
+        return false;
+
+#ifdef ENABLE_BLOCK_REPLAY
+    if(replay.mode == Replay_Replaying)
+        return false;
+#endif
+
+    source->id = file.id;
+    source->line = file.line;
+    source->offset = (uint32_t)file.line_start;
+
+    return true;
+}
+
+#endif
+
 static bool sdcard_mount (void)
 {
 #ifdef __MSP432E401Y__
@@ -338,6 +943,14 @@ static void sdcard_end_job (void)
 {
     file_close();
 
+#ifdef ENABLE_SDCARD_INDEX
+    index_end();
+#endif
+
+#ifdef ENABLE_BLOCK_REPLAY
+    replay_end(false);
+#endif
+
     if(grbl.on_realtime_report == sdcard_report)
         grbl.on_realtime_report = on_realtime_report;
 
@@ -355,19 +968,45 @@ static void sdcard_end_job (void)
     report_init_fns();
 
     frewind = false;
+#ifdef ENABLE_SDCARD_JOB_QUEUE
+    queue.running = false;
+#endif
 }
 
 static int16_t sdcard_read (void)
 {
     int16_t c = -1;
 
-    if(file.eol == 1)
+    if(file.eol == 1) {
         file.line++;
+#ifdef ENABLE_BLOCK_REPLAY
+        if(replay.mode == Replay_Recording)
+            replay_write_record();
+#endif
+#ifdef ENABLE_SDCARD_INDEX
+        index_line();
+#endif
+#ifdef ENABLE_NVS_CHECKPOINT
+        file.line_start = file.pos;
+#endif
+    }
+
+#ifdef ENABLE_SDCARD_INDEX
+    if(findex.restore && (c = index_restore_read()) != -1)
+        return c;
+#endif
 
     if(file.handle) {
 
+        // Blocks following a tool change are not parsed ahead since the tool change may alter the parser state
+        // and position, e.g. by jogging or by setting a new tool length offset. The job data following the M6
+        // is prefetched into the read buffers by file_prefetch() while paused so parsing resumes without delay.
         if(sys.state == STATE_IDLE || (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE)))
+#ifdef ENABLE_BLOCK_REPLAY
+            c = replay.mode == Replay_Replaying ? replay_read() : file_read();
+#else
             c = file_read();
+#endif
 
         if(c == -1) { // EOF or error reading or grbl problem
             file_close();
@@ -375,8 +1014,17 @@ static int16_t sdcard_read (void)
                 c = '\n';
         }
 
-    } else if(sys.state == STATE_IDLE) // TODO: end on ok count match line count?
+#ifdef ENABLE_BLOCK_REPLAY
+        if(replay.mode == Replay_Recording && c != -1 && file.eol <= 1) // Skip second character of CRLF line ends
+            replay_record_char((char)c);
+#endif
+
+    } else if(sys.state == STATE_IDLE) { // TODO: end on ok count match line count?
+#ifdef ENABLE_BLOCK_REPLAY
+        replay_end(true);
+#endif
         sdcard_end_job();
+    }
 
     return c;
 }
@@ -398,8 +1046,12 @@ static void trap_state_change_request(uint_fast16_t state)
 {
     if(state == STATE_CYCLE) {
 
-        if(hal.stream.read == await_cycle_start)
+        if(hal.stream.read == await_cycle_start) {
+#ifdef ENABLE_BLOCK_REPLAY
+            replay_start();
+#endif
             hal.stream.read = sdcard_read;
+        }
 
         if(grbl.on_state_change== trap_state_change_request) {
             grbl.on_state_change = state_change_requested;
@@ -446,12 +1098,76 @@ static void sdcard_restart_msg (uint_fast16_t state)
     report_feedback_message(Message_CycleStartToRerun);
 }
 
+#ifdef ENABLE_SDCARD_JOB_QUEUE
+
+// Opens the next run of the queue, returns false when all runs are completed or the next file cannot be opened.
+static bool queue_next (void)
+{
+    bool rewind = true;
+
+    if(++queue.runs >= queue.job[queue.current].repeat) {
+        queue.runs = 0;
+        if(++queue.current >= queue.length)
+            return false;
+        rewind = false;
+    }
+
+#ifdef ENABLE_BLOCK_REPLAY
+    rewind = false; // Reopen to run the next run from the replay cache.
+#endif
+
+    if(!rewind)
+        return job_open(queue.job[queue.current].name);
+
+    file_buffer_reset(&fbuf, 0);
+    file.pos = file.line = 0;
+    file.eol = false;
+
+    return true;
+}
+
+#endif
+
 static void sdcard_on_program_completed (program_flow_t program_flow)
 {
+#ifdef ENABLE_SDCARD_JOB_QUEUE
+    if(queue.running) {
+
+  #ifdef ENABLE_BLOCK_REPLAY
+        replay_end(true);
+  #endif
+  #ifdef ENABLE_SDCARD_INDEX
+        index_end();
+  #endif
+        if(!queue_next()) {
+            if(queue.current < queue.length)
+                report_message("Job queue stopped, file could not be opened", Message_Warning);
+            sdcard_end_job();
+        }
+
+        if(on_program_completed)
+            on_program_completed(program_flow);
+
+        return;
+    }
+#endif
+
     frewind = frewind || program_flow == ProgramFlow_CompletedM2; // || program_flow == ProgramFlow_CompletedM30;
 
+#ifdef ENABLE_BLOCK_REPLAY
+    bool replaying = replay.mode == Replay_Replaying;
+
+    replay_end(true);
+
+    if(frewind && replaying)
+        file_open(replay.source); // Reopen the g-code file, replay_start() selects the cache again on restart
+#endif
+
     if(frewind) {
-        f_lseek(file.handle, 0);
+#ifdef ENABLE_SDCARD_INDEX
+        index_end(); // The index is complete after the first run
+#endif
+        file_buffer_reset(&fbuf, 0);
         file.pos = file.line = 0;
         file.eol = false;
         hal.stream.read = await_cycle_start;
@@ -486,6 +1202,228 @@ static bool sdcard_suspend (bool suspend)
 }
 #endif
 
+// Reads the next line from the file and filters it as the protocol layer does: whitespace and comments are removed
+// and letters are uppercased. Block delete is honored. Returns false at end of file.
+// NOTE: on return block[0] is '\0' for empty lines, system and user commands are returned as is.
+static bool check_read_block (char *block, uint32_t *lines)
+{
+    int16_t c;
+    uint_fast16_t idx = 0;
+    bool comment = false, end_comment = false, nocaps = false, skip = false;
+
+    while((c = file_read()) != -1 && c != '\n') {
+
+        if(c == '(' && !nocaps && !end_comment)
+            comment = true;
+        else if(c == ')' && comment)
+            comment = false;
+        else if(c == ';' && !nocaps && !comment)
+            end_comment = true;
+        else if(!(comment || end_comment || skip || c < ' ' || (c == ' ' && !nocaps))) {
+            if(idx == 0 && c == '/')
+                skip = sys.flags.block_delete_enabled;
+            else if(idx < LINE_BUFFER_SIZE - 1) {
+                if(idx == 0 && (c == '$' || c == '['))
+                    nocaps = true;
+                block[idx++] = nocaps ? c : CAPS(c);
+            }
+        }
+    }
+
+    block[skip ? 0 : idx] = '\0';
+
+    if(c == '\n' || idx)
+        (*lines)++;
+
+    return c != -1 || idx;
+}
+
+// Checks a file by parsing it in check mode directly from the SD card, without streaming it through the
+// protocol layer and without planning any motions. Stops at the first error, the job statistics are
+// reported as [CHECK:<lines>,<blocks>,<milliseconds>,<line of first error>] followed by the status of the first error.
+// If estimate is true the job time estimator is run as well, the estimated run time in seconds is reported as
+// [ESTIMATE:<total>|T<tool>:<time>...] after the job statistics.
+// NOTE: If not already in check mode it is entered for the check and then left by a soft reset,
+//       the same way as by the $C command.
+static status_code_t sdcard_check (char *filename, bool estimate)
+{
+    char block[LINE_BUFFER_SIZE], buf[60];
+    uint32_t lines = 0, blocks = 0, error_line = 0, ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    status_code_t status = Status_OK;
+    bool check_mode = sys.state == STATE_CHECK_MODE;
+
+    if(!file_open(filename))
+        return Status_SDReadError;
+
+    if(!check_mode)
+        set_state(STATE_CHECK_MODE);
+
+#ifdef ENABLE_JOB_ESTIMATE
+    if(estimate)
+        mc_estimate_start();
+#endif
+
+    while(status == Status_OK && check_read_block(block, &lines)) {
+
+        if(block[0] == '\0' || block[0] == '$' || block[0] == '[') // Empty line, system or user command.
+            continue;
+
+        blocks++;
+
+        if((status = gc_execute_block(block, NULL)) != Status_OK)
+            error_line = lines;
+
+        // Keep realtime commands and reports alive.
+        else if(!(blocks & 0x3F) && !protocol_execute_realtime())
+            break;
+    }
+
+    file_close();
+
+    if(hal.get_elapsed_ticks)
+        ms = hal.get_elapsed_ticks() - ms;
+
+    sprintf(buf, "[CHECK:" UINT32FMT "," UINT32FMT "," UINT32FMT "," UINT32FMT "]" ASCII_EOL, lines, blocks, ms, error_line);
+    hal.stream.write(buf);
+
+#ifdef ENABLE_JOB_ESTIMATE
+    if(estimate) {
+
+        job_estimate_t *job = mc_estimate_end();
+
+        hal.stream.write("[ESTIMATE:");
+        hal.stream.write(ftoa(job->time, 1));
+        for(uint_fast8_t idx = 0; idx < job->n_tools; idx++) {
+            hal.stream.write("|T");
+            hal.stream.write(uitoa(job->tools[idx].tool));
+            hal.stream.write(":");
+            hal.stream.write(ftoa(job->tools[idx].time, 1));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    }
+#endif
+
+    if(!check_mode)
+        mc_reset(); // Leave check mode, restores the parser state.
+
+    return status;
+}
+
+// Opens a file to be run as a job and starts the replay cache and line index for it.
+static bool job_open (char *filename)
+{
+    if(!file_open(filename))
+        return false;
+
+#ifdef ENABLE_BLOCK_REPLAY
+    strncpy(replay.source, filename, sizeof(replay.source));
+    replay.source[sizeof(replay.source) - 1] = '\0';
+    replay_start();                                             // Replay or record cache
+#endif
+#ifdef ENABLE_SDCARD_INDEX
+  #ifdef ENABLE_BLOCK_REPLAY
+    if(replay.mode != Replay_Replaying)                         // Offsets are for the g-code file
+  #endif
+    index_start(filename);                                      // Record line index
+#endif
+
+    return true;
+}
+
+// Redirects input to the opened file.
+static status_code_t sdcard_job_start (void)
+{
+    gc_state.last_error = Status_OK;                            // Start with no errors
+    grbl.report.status_message(Status_OK);                      // and confirm command to originator
+    memcpy(&active_stream, &hal.stream, sizeof(io_stream_t));   // Save current stream pointers
+    hal.stream.type = StreamType_SDCard;                        // then redirect to read from SD card instead
+    hal.stream.read = sdcard_read;                              // ...
+    hal.stream.enqueue_realtime_command = drop_input_stream;    // Drop input from current stream except realtime commands
+#if M6_ENABLE
+    hal.stream.suspend_read = sdcard_suspend;                   // ...
+#else
+    hal.stream.suspend_read = NULL;                             // ...
+#endif
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = sdcard_report;                     // Add percent complete to real time report
+
+    on_program_completed = grbl.on_program_completed;
+    grbl.on_program_completed = sdcard_on_program_completed;
+
+    grbl.report.status_message = trap_status_report;             // Redirect status message reports here
+
+    return Status_OK;
+}
+
+#ifdef ENABLE_SDCARD_JOB_QUEUE
+
+// Reports the queued files as [JOB:<position>|<filename>|<runs>|<completed runs>].
+static void queue_report (char *buf)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < queue.length; idx++) {
+        sprintf(buf, "[JOB:%d|%s|%d|%d]" ASCII_EOL, (int)idx + 1, queue.job[idx].name, (int)queue.job[idx].repeat,
+                 queue.running ? (idx < queue.current ? queue.job[idx].repeat : (idx == queue.current ? queue.runs : 0)) : 0);
+        hal.stream.write(buf);
+    }
+}
+
+/* $FQ lists the queue, $FQ=<filename> adds a file to be run once and $FQ<runs>=<filename> a file to be run
+   <runs> times. $FQX clears the queue and $FQS starts running it. */
+static status_code_t queue_command (uint_fast16_t state, char *line, char *lcline)
+{
+    char *eq, *end;
+    uint32_t repeat = 1;
+    status_code_t retval = Status_OK;
+
+    if(line[3] == '\0') {
+        queue_report(line); // (re)use line buffer for reporting
+        return Status_OK;
+    }
+
+    if(!(state == STATE_IDLE || state == STATE_CHECK_MODE) || queue.running)
+        return Status_SystemGClock;
+
+    if(!strcmp(&line[3], "X"))
+        queue.length = 0;
+
+    else if(!strcmp(&line[3], "S")) {
+        if(queue.length == 0)
+            retval = Status_InvalidStatement;
+        else if(job_open(queue.job[0].name)) {
+            frewind = false;
+            queue.current = 0;
+            queue.runs = 0;
+            queue.running = true;
+            retval = sdcard_job_start();
+        } else
+            retval = Status_SDReadError;
+
+    } else if((eq = strchr(&lcline[3], '=')) == NULL)
+        retval = Status_InvalidStatement;
+
+    else {
+        if(eq != &lcline[3]) {
+            repeat = (uint32_t)strtoul(&lcline[3], &end, 10);
+            if(end != eq || repeat == 0 || repeat > UINT16_MAX)
+                return Status_InvalidStatement;
+        }
+        if(queue.length == SDCARD_JOB_QUEUE_SIZE)
+            retval = Status_Overflow;
+        else if(eq[1] == '\0' || strlen(eq + 1) >= MAX_PATHLEN)
+            retval = Status_InvalidStatement;
+        else {
+            strcpy(queue.job[queue.length].name, eq + 1);
+            queue.job[queue.length++].repeat = (uint16_t)repeat;
+        }
+    }
+
+    return retval;
+}
+
+#endif
+
 static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline)
 {
     status_code_t retval = Status_Unhandled;
@@ -525,35 +1463,91 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
             }
             break;
 
-        case '=':
-            if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+        case 'C':
+            if(line[3] != '=')
+                retval = Status_InvalidStatement;
+            else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
                 retval = Status_SystemGClock;
             else {
-                if(file_open(&lcline[3])) {
-                    gc_state.last_error = Status_OK;                            // Start with no errors
-                    grbl.report.status_message(Status_OK);                      // and confirm command to originator
-                    memcpy(&active_stream, &hal.stream, sizeof(io_stream_t));   // Save current stream pointers
-                    hal.stream.type = StreamType_SDCard;                        // then redirect to read from SD card instead
-                    hal.stream.read = sdcard_read;                              // ...
-                    hal.stream.enqueue_realtime_command = drop_input_stream;    // Drop input from current stream except realtime commands
-#if M6_ENABLE
-                    hal.stream.suspend_read = sdcard_suspend;                   // ...
-#else
-                    hal.stream.suspend_read = NULL;                             // ...
+                frewind = false;
+                retval = sdcard_check(&lcline[4], false);
+            }
+            break;
+
+#ifdef ENABLE_JOB_ESTIMATE
+        case 'E':
+            if(line[3] != '=')
+                retval = Status_InvalidStatement;
+            else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                retval = Status_SystemGClock;
+            else {
+                frewind = false;
+                retval = sdcard_check(&lcline[4], true);
+            }
+            break;
 #endif
-                    on_realtime_report = grbl.on_realtime_report;
-                    grbl.on_realtime_report = sdcard_report;                     // Add percent complete to real time report
 
-                    on_program_completed = grbl.on_program_completed;
-                    grbl.on_program_completed = sdcard_on_program_completed;
+#ifdef ENABLE_SDCARD_JOB_QUEUE
+        case 'Q':
+            retval = queue_command(state, line, lcline);
+            break;
+#endif
 
-                    grbl.report.status_message = trap_status_report;             // Redirect status message reports here
-                    retval = Status_OK;
+#ifdef ENABLE_SDCARD_INDEX
+        case 'L':
+            {
+                char *eq = strchr(&lcline[3], '='), *end;
+                uint32_t line = (uint32_t)strtoul(&lcline[3], &end, 10);
+                if(eq == NULL || end == &lcline[3] || end != eq)
+                    retval = Status_InvalidStatement;
+                else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                    retval = Status_SystemGClock;
+                else if(file_open(eq + 1)) {
+                    char buf[50];
+                    sprintf(buf, "[MSG:Restarting SD file at line " UINT32FMT "]" ASCII_EOL, index_seek(eq + 1, line));
+                    hal.stream.write(buf);
+                    frewind = false;
+                    retval = sdcard_job_start();
                 } else
                     retval = Status_SDReadError;
             }
             break;
 
+  #ifdef ENABLE_NVS_CHECKPOINT
+        case 'P':
+            if(line[3] != '=')
+                retval = Status_InvalidStatement;
+            else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                retval = Status_SystemGClock;
+            else if(file_open(&lcline[4])) {
+                checkpoint_t checkpoint;
+                if(checkpoint_get(&checkpoint) && index_resume(&checkpoint)) {
+                    char buf[50];
+                    sprintf(buf, "[MSG:Restarting SD file at line " UINT32FMT "]" ASCII_EOL, checkpoint.source.line);
+                    hal.stream.write(buf);
+                    frewind = false;
+                    retval = sdcard_job_start();
+                } else {
+                    file_close();
+                    retval = Status_SettingReadFail;
+                }
+            } else
+                retval = Status_SDReadError;
+            break;
+  #endif
+#endif
+
+        case '=':
+            if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                retval = Status_SystemGClock;
+            else {
+                if(job_open(&lcline[3]))
+                    retval = sdcard_job_start();
+                else
+                    retval = Status_SDReadError;
+            }
+            break;
+
         default:
             retval = Status_InvalidStatement;
             break;
@@ -585,6 +1579,18 @@ void sdcard_init (void)
 
     on_unknown_sys_command = grbl.on_unknown_sys_command;
     grbl.on_unknown_sys_command = sdcard_parse;
+
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = file_prefetch;
+
+#ifdef ENABLE_BLOCK_REPLAY
+    on_replayable_block = grbl.on_replayable_block;
+    grbl.on_replayable_block = replay_on_block;
+#endif
+
+#ifdef ENABLE_NVS_CHECKPOINT
+    checkpoint_set_source(checkpoint_source);
+#endif
 }
 
 FATFS *sdcard_getfs(void)
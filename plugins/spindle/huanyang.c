@@ -43,29 +43,73 @@
 #define VFD_ADDRESS 0x01
 #endif
 
+// Interval in ms between VFD telemetry (output current and temperature) reads, 0 to disable.
+// Telemetry is only read when no other requests are in progress and is added to the real time report as |VFD:<current>,<temperature>.
+#ifndef VFD_TELEMETRY_INTERVAL
+#define VFD_TELEMETRY_INTERVAL 250
+#endif
+
+// The P2A protocol reads the output current and temperature from two consecutive holding registers,
+// starting at VFD_P2A_TELEMETRY_REGISTER, in a single request. The register address depends on the VFD model,
+// telemetry is disabled for the P2A protocol if not defined.
+//#define VFD_P2A_TELEMETRY_REGISTER 0x0000
+
+#if VFD_TELEMETRY_INTERVAL > 0 && (SPINDLE_HUANYANG == 1 || defined(VFD_P2A_TELEMETRY_REGISTER))
+#define VFD_TELEMETRY 1
+#else
+#define VFD_TELEMETRY 0
+#endif
+
 typedef enum {
     VFD_Idle = 0,
     VFD_GetRPM,
     VFD_SetRPM,
     VFD_GetMaxRPM,
     VFD_GetStatus,
-    VFD_SetStatus
+    VFD_SetStatus,
+    VFD_GetCurrent,
+    VFD_GetTemperature,
+    VFD_GetTelemetry
 } vfd_response_t;
 
 static float rpm, rpm_programmed = -1.0f, rpm_low_limit = 0.0f, rpm_high_limit = 0.0f;
 static spindle_state_t vfd_state = {0};
+static bool rpm_pending = false;
+static driver_reset_ptr driver_reset;
 static on_report_options_ptr on_report_options;
 #if SPINDLE_HUANYANG == 2
 static uint32_t rpm_max = 0;
+static float rpm_requested = -1.0f;
+#endif
+#if VFD_TELEMETRY
+static struct {
+    bool valid;
+    bool pending;
+    float current;
+    float temperature;
+} telemetry = {0};
+static on_execute_realtime_ptr on_execute_realtime;
+static on_realtime_report_ptr on_realtime_report;
 #endif
 
+static void rx_request_exception (uint8_t code, void *context);
+
 static void spindleSetRPM (float rpm, bool block)
 {
-    modbus_message_t rpm_cmd;
+    modbus_message_t rpm_cmd = {0};
+
+#if SPINDLE_HUANYANG == 2
+    // Max RPM is read from the VFD at startup, the RPM is set when the reply is received.
+    if(rpm_max == 0) {
+        rpm_requested = rpm;
+        return;
+    }
+#endif
 
     if (rpm != rpm_programmed) {
 
         rpm_cmd.xx = (void *)VFD_SetRPM;
+        rpm_cmd.on_rx_exception = rx_request_exception;
         rpm_cmd.adu[0] = VFD_ADDRESS;
 
 #if SPINDLE_HUANYANG == 2
@@ -111,11 +155,15 @@ static void spindleUpdateRPM (float rpm)
 }
 
 // Start or stop spindle
+// NOTE: The requests are queued, the foreground process is not waiting for the VFD to reply.
+//       spindle_sync() waits for the spindle to reach the programmed RPM as reported by spindleGetState()
+//       while still executing realtime commands, the at speed state is updated by the replies.
 static void spindleSetState (spindle_state_t state, float rpm)
 {
-    modbus_message_t mode_cmd;
+    modbus_message_t mode_cmd = {0};
 
     mode_cmd.xx = (void *)VFD_SetStatus;
+    mode_cmd.on_rx_exception = rx_request_exception;
     mode_cmd.adu[0] = VFD_ADDRESS;
 
 #if SPINDLE_HUANYANG == 2
@@ -139,16 +187,22 @@ static void spindleSetState (spindle_state_t state, float rpm)
 
 #endif
 
-    if(modbus_send(&mode_cmd, true))
-        spindleSetRPM(rpm, true);
+    if(modbus_send(&mode_cmd, false))
+        spindleSetRPM(rpm, false);
+    else
+        rx_request_exception(0, (void *)VFD_SetStatus); // Request queue is full.
 }
 
 // Returns spindle state in a spindle_state_t variable
 static spindle_state_t spindleGetState (void)
 {
-    modbus_message_t mode_cmd;
+    modbus_message_t mode_cmd = {0};
+
+    if(rpm_pending)
+        return vfd_state; // Still waiting for the reply to the previous request.
 
     mode_cmd.xx = (void *)VFD_GetRPM;
+    mode_cmd.on_rx_exception = rx_request_exception;
     mode_cmd.adu[0] = VFD_ADDRESS;
 
 #if SPINDLE_HUANYANG == 2
@@ -175,7 +229,7 @@ static spindle_state_t spindleGetState (void)
 
 #endif
 
-    modbus_send(&mode_cmd, false);
+    rpm_pending = modbus_send(&mode_cmd, false);
 
     return vfd_state; // return previous state as we do not want to wait for the response
 }
@@ -193,11 +247,34 @@ static void rx_packet (modbus_message_t *msg)
                 rpm = (float)((msg->adu[4] << 8) | msg->adu[5]) * 60.0f / 100.0f;
 #endif
                 vfd_state.at_speed = settings.spindle.at_speed_tolerance <= 0.0f || (rpm >= rpm_low_limit && rpm <= rpm_high_limit);
+                rpm_pending = false;
                 break;
 #if SPINDLE_HUANYANG == 2
             case VFD_GetMaxRPM:
-                rpm_max = (msg->adu[4] << 8) | msg->adu[5];
+                if((rpm_max = (msg->adu[4] << 8) | msg->adu[5]) && rpm_requested >= 0.0f)
+                    spindleSetRPM(rpm_requested, false);
+                break;
+#endif
+#if VFD_TELEMETRY
+  #if SPINDLE_HUANYANG == 2
+            case VFD_GetTelemetry:
+                telemetry.current = (float)((msg->adu[3] << 8) | msg->adu[4]) / 10.0f;
+                telemetry.temperature = (float)((msg->adu[5] << 8) | msg->adu[6]);
+                telemetry.valid = true;
+                telemetry.pending = false;
+                break;
+  #else
+            case VFD_GetCurrent:
+                telemetry.current = (float)((msg->adu[4] << 8) | msg->adu[5]) / 10.0f;
+                telemetry.pending = false;
+                break;
+
+            case VFD_GetTemperature:
+                telemetry.temperature = (float)((msg->adu[4] << 8) | msg->adu[5]);
+                telemetry.valid = true;
+                telemetry.pending = false;
                 break;
+  #endif
 #endif
             default:
                 break;
@@ -211,13 +288,114 @@ static void rx_exception (uint8_t code)
     report_alarm_message(Alarm_Spindle);
 }
 
+// Failed RPM reads are ignored, the at speed state is not updated and the next read will retry.
+static void rx_request_exception (uint8_t code, void *context)
+{
+    switch((vfd_response_t)context) {
+
+        case VFD_GetRPM:
+            rpm_pending = false;
+            break;
+#if VFD_TELEMETRY
+        case VFD_GetCurrent:
+        case VFD_GetTemperature:
+        case VFD_GetTelemetry:
+            telemetry.valid = telemetry.pending = false;
+            break;
+#endif
+        default:
+            rx_exception(code);
+            break;
+    }
+}
+
+#if VFD_TELEMETRY
+
+// Queue the next telemetry read when the interval has elapsed and the bus is idle.
+// Spindle control requests are thus not delayed by telemetry reads.
+static void telemetry_poll (uint_fast16_t grbl_state)
+{
+    static uint32_t last_ms = 0;
+
+    on_execute_realtime(grbl_state);
+
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    if(telemetry.pending || ms - last_ms < VFD_TELEMETRY_INTERVAL || modbus_get_state() != ModBus_Idle)
+        return;
+
+    modbus_message_t cmd = {0};
+
+    cmd.on_rx_exception = rx_request_exception;
+    cmd.adu[0] = VFD_ADDRESS;
+
+#if SPINDLE_HUANYANG == 2
+
+    cmd.xx = (void *)VFD_GetTelemetry;
+    cmd.adu[1] = ModBus_ReadHoldingRegisters;
+    cmd.adu[2] = (VFD_P2A_TELEMETRY_REGISTER >> 8) & 0xFF;
+    cmd.adu[3] = VFD_P2A_TELEMETRY_REGISTER & 0xFF;
+    cmd.adu[4] = 0x00;
+    cmd.adu[5] = 0x02;
+    cmd.tx_length = 8;
+    cmd.rx_length = 9;
+
+#else
+
+    // The Huanyang protocol returns a single value per request, current and temperature are read in turn.
+    static bool read_temperature = false;
+
+    cmd.xx = read_temperature ? (void *)VFD_GetTemperature : (void *)VFD_GetCurrent;
+    cmd.adu[1] = ModBus_ReadInputRegisters;
+    cmd.adu[2] = 0x03;
+    cmd.adu[3] = read_temperature ? 0x07 : 0x02;
+    cmd.adu[4] = 0x00;
+    cmd.adu[5] = 0x00;
+    cmd.tx_length = 8;
+    cmd.rx_length = 8;
+
+    read_temperature = !read_temperature;
+
+#endif
+
+    if((telemetry.pending = modbus_send(&cmd, false)))
+        last_ms = ms;
+}
+
+// Add cached telemetry to the real time report, no requests are sent.
+static void onRealtimeReport (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(telemetry.valid) {
+        stream_write("|VFD:");
+        stream_write(ftoa(telemetry.current, 1));
+        stream_write(",");
+        stream_write(ftoa(telemetry.temperature, 0));
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+#endif
+
+// The ModBus request queue is emptied on a reset.
+static void huanyang_reset (void)
+{
+    rpm_pending = false;
+#if VFD_TELEMETRY
+    telemetry.pending = false;
+#endif
+
+    driver_reset();
+}
+
 static void onReportOptions (void)
 {
     on_report_options();
 #if SPINDLE_HUANYANG == 2
-    hal.stream.write("[PLUGIN:HUANYANG VFD P2A v0.01]" ASCII_EOL);
+    hal.stream.write("[PLUGIN:HUANYANG VFD P2A v0.02]" ASCII_EOL);
 #else
-    hal.stream.write("[PLUGIN:HUANYANG VFD v0.01]" ASCII_EOL);
+    hal.stream.write("[PLUGIN:HUANYANG VFD v0.02]" ASCII_EOL);
 #endif
 }
 
@@ -238,11 +416,23 @@ void huanyang_init (modbus_stream_t *stream)
     on_report_options = grbl.on_report_options;
     grbl.on_report_options = onReportOptions;
 
+    driver_reset = hal.driver_reset;
+    hal.driver_reset = huanyang_reset;
+
+#if VFD_TELEMETRY
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = telemetry_poll;
+
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = onRealtimeReport;
+#endif
+
 #if SPINDLE_HUANYANG == 2
 
-    modbus_message_t cmd;
+    modbus_message_t cmd = {0};
 
-    cmd.xx = VFD_GetMaxRPM;
+    cmd.xx = (void *)VFD_GetMaxRPM;
+    cmd.on_rx_exception = rx_request_exception;
     cmd.adu[0] = VFD_ADDRESS;
     cmd.adu[1] = ModBus_ReadHoldingRegisters;
     cmd.adu[2] = 0xB0;
@@ -252,7 +442,7 @@ void huanyang_init (modbus_stream_t *stream)
     cmd.tx_length = 8;
     cmd.rx_length = 8;
 
-    modbus_send(&cmd, true);
+    modbus_send(&cmd, false);
 
 #endif
 }
@@ -27,8 +27,12 @@
 
 #ifdef ARDUINO
 #include "../grbl/hal.h"
+#include "../grbl/profile.h"
+#include "../grbl/scheduler.h"
 #else
 #include "grbl/hal.h"
+#include "grbl/profile.h"
+#include "grbl/scheduler.h"
 #endif
 
 #include "modbus.h"
@@ -36,6 +40,9 @@
 typedef struct queue_entry {
     bool async;
     bool sent;
+    volatile bool complete;
+    modbus_state_t result;
+    uint8_t exception_code;
     modbus_message_t msg;
     struct queue_entry *next;
 } queue_entry_t;
@@ -45,10 +52,12 @@ static uint16_t rx_timeout = 0;
 static int16_t exception_code = 0;
 static queue_entry_t queue[MODBUS_QUEUE_LENGTH];
 static volatile bool spin_lock = false;
-static volatile queue_entry_t *tail, *head, *packet = NULL;
+static volatile queue_entry_t *tail, *head, *done, *packet = NULL;
 static volatile modbus_state_t state = ModBus_Idle;
 static driver_reset_ptr driver_reset;
+#ifndef ENABLE_SCHEDULER
 static on_execute_realtime_ptr on_execute_realtime;
+#endif
 static on_report_options_ptr on_report_options;
 
 // Compute the MODBUS RTU CRC
@@ -79,6 +88,25 @@ static bool valid_crc (char *buf, uint_fast16_t len)
     return buf[len - 1] == (crc >> 8) && buf[len - 2] == (crc & 0xFF);
 }
 
+static void rx_packet (modbus_message_t *msg)
+{
+    if(msg->on_rx_packet)
+        msg->on_rx_packet(msg);
+    else if(stream->on_rx_packet)
+        stream->on_rx_packet(msg);
+}
+
+// NOTE: exceptions and timeouts for non-blocking requests are only reported if the request has an exception handler.
+static void rx_exception (modbus_message_t *msg, uint8_t code, bool async)
+{
+    if(msg->on_rx_exception)
+        msg->on_rx_exception(code, msg->xx);
+    else if(!async && stream->on_rx_exception)
+        stream->on_rx_exception(code);
+}
+
+// Queue a request or, if block is true, send it and wait for the reply.
+// Returns true if a non-blocking request was queued or a blocking request was replied to.
 bool modbus_send (modbus_message_t *msg, bool block)
 {
     static queue_entry_t sync_msg = {0};
@@ -121,18 +149,17 @@ bool modbus_send (modbus_message_t *msg, bool block)
             else switch(state) {
 
                 case ModBus_Timeout:
-                    stream->on_rx_exception(0);
+                    rx_exception(&sync_msg.msg, 0, false);
                     poll = false;
                     break;
 
                 case ModBus_Exception:
-                    stream->on_rx_exception(exception_code == -1 ? 0 : (uint8_t)(exception_code & 0xFF));
+                    rx_exception(&sync_msg.msg, exception_code == -1 ? 0 : (uint8_t)(exception_code & 0xFF), false);
                     poll = false;
                     break;
 
                 case ModBus_GotReply:
-                    if(packet)
-                        stream->on_rx_packet(&((queue_entry_t *)packet)->msg);
+                    rx_packet(&sync_msg.msg);
                     poll = block = false;
                     break;
 
@@ -143,14 +170,13 @@ bool modbus_send (modbus_message_t *msg, bool block)
 
         state = ModBus_Idle;
 
-    } else if(packet != &sync_msg) {
-        if(head->next != tail) {
-            head->async = true;
-            head->sent = false;
-            memcpy((void *)&(head->msg), msg, sizeof(modbus_message_t));
-            head = head->next;
-        }
-    }
+    } else if(packet != &sync_msg && head->next != done) {
+        head->async = true;
+        head->sent = head->complete = false;
+        memcpy((void *)&(head->msg), msg, sizeof(modbus_message_t));
+        head = head->next;
+    } else
+        block = true; // Queue is full or a blocking request is in progress.
 
     return !block;
 }
@@ -160,6 +186,92 @@ modbus_state_t modbus_get_state (void)
     return state;
 }
 
+// Advance the transaction state machine. tick is true when called once every ms from modbus_poll(),
+// false when called from modbus_event(). Timeouts are only counted down on ticks.
+static void modbus_advance (bool tick)
+{
+    bool next;
+
+    if(spin_lock) // Already advancing, an event will be picked up by the next poll.
+        return;
+
+    spin_lock = true;
+
+    do {
+
+        next = false;
+
+        switch(state) {
+
+            case ModBus_Idle:
+                if(tail != head && !packet) {
+
+                    packet = tail;
+                    tail = tail->next;
+                    state = ModBus_TX;
+                    rx_timeout = stream->rx_timeout;
+
+                    if(stream->set_direction)
+                        stream->set_direction(true);
+
+                    packet->sent = true;
+                    stream->flush_rx_buffer();
+                    stream->write(((queue_entry_t *)packet)->msg.adu, ((queue_entry_t *)packet)->msg.tx_length);
+                }
+                break;
+
+            case ModBus_TX:
+                if(!stream->get_tx_buffer_count()) {
+
+                    state = ModBus_AwaitReply;
+
+                    if(stream->set_direction)
+                        stream->set_direction(false);
+                }
+                break;
+
+            case ModBus_AwaitReply:
+                if(tick && rx_timeout && --rx_timeout == 0) {
+                    if(stream->read() == (uint8_t)packet->msg.adu[0] && (stream->read() & 0x80)) {
+                        exception_code = stream->read();
+                        state = ModBus_Exception;
+                    } else
+                        state = ModBus_Timeout;
+                    if(packet->async) {
+                        packet->result = state;
+                        packet->exception_code = state == ModBus_Exception && exception_code != -1 ? (uint8_t)(exception_code & 0xFF) : 0;
+                        packet->complete = true;
+                        state = ModBus_Idle;
+                    }
+                    packet = NULL;
+                } else if(stream->get_rx_buffer_count() >= packet->msg.rx_length) {
+
+                    char *buf = ((queue_entry_t *)packet)->msg.adu;
+
+                    do {
+                        *buf++ = stream->read();
+                    } while(--packet->msg.rx_length);
+
+                    if((state = packet->async ? ModBus_Idle : ModBus_GotReply) == ModBus_Idle) {
+                        packet->result = ModBus_GotReply;
+                        packet->complete = true;
+                        // The rx idle event is raised after the 3.5 character silent interval
+                        // that ends the frame, the next request can be sent immediately.
+                        next = !tick;
+                    }
+
+                    packet = NULL;
+                }
+                break;
+
+            default:
+                break;
+        }
+    } while(next);
+
+    spin_lock = false;
+}
+
 void modbus_poll (uint_fast16_t grbl_state)
 {
     static uint32_t last_ms;
@@ -171,72 +283,46 @@ void modbus_poll (uint_fast16_t grbl_state)
     if(ms == last_ms) // check once every ms
         return;
 
-    spin_lock = true;
-
-    switch(state) {
-
-        case ModBus_Idle:
-            if(tail != head && !packet) {
-
-                packet = tail;
-                tail = tail->next;
-                state = ModBus_TX;
-                rx_timeout = stream->rx_timeout;
-
-                if(stream->set_direction)
-                    stream->set_direction(true);
+    last_ms = ms;
 
-                packet->sent = true;
-                stream->flush_rx_buffer();
-                stream->write(((queue_entry_t *)packet)->msg.adu, ((queue_entry_t *)packet)->msg.tx_length);
-            }
-            break;
+    PROFILE_BEGIN(Profile_ModbusPoll);
 
-        case ModBus_TX:
-            if(!stream->get_tx_buffer_count()) {
+    modbus_advance(true);
 
-                state = ModBus_AwaitReply;
+    PROFILE_END(Profile_ModbusPoll);
+}
 
-                if(stream->set_direction)
-                    stream->set_direction(false);
-            }
-            break;
-
-        case ModBus_AwaitReply:
-            if(rx_timeout && --rx_timeout == 0) {
-                if(packet->async)
-                    state = ModBus_Idle;
-                else if(stream->read() == 1 && (stream->read() & 0x80)) {
-                    exception_code = stream->read();
-                    state = ModBus_Exception;
-                } else
-                    state = ModBus_Timeout;
-                packet = NULL;
-                spin_lock = false;
-                return;
-            }
+// To be called by the driver from the UART interrupt handler on transmission complete and on
+// receiver idle (3.5 character silent interval) events. Advances the transaction state immediately
+// instead of on the next 1 ms poll, polling is still required for timeout handling.
+void modbus_event (void)
+{
+    modbus_advance(false);
+}
 
-            if(stream->get_rx_buffer_count() >= packet->msg.rx_length) {
+// Dispatch the completion callbacks of non-blocking requests from the foreground process.
+// Requests are sent back to back from the poll handler, the foreground process is never
+// waiting for a reply.
+static void modbus_process (uint_fast16_t grbl_state)
+{
+    queue_entry_t entry;
 
-                char *buf = ((queue_entry_t *)packet)->msg.adu;
+#ifndef ENABLE_SCHEDULER
+    on_execute_realtime(grbl_state);
+#endif
 
-                do {
-                    *buf++ = stream->read();
-                } while(--packet->msg.rx_length);
+    modbus_poll(grbl_state);
 
-                if((state = packet->async ? ModBus_Idle : ModBus_GotReply) == ModBus_Idle)
-                    stream->on_rx_packet(&((queue_entry_t *)packet)->msg);
+    while(done != tail && done->complete) {
 
-                packet = NULL;
-            }
-            break;
+        memcpy(&entry, (void *)done, sizeof(queue_entry_t));
+        done = done->next; // Free the queue entry before dispatching so the callback may queue a new request.
 
-        default:
-            break;
+        if(entry.result == ModBus_GotReply)
+            rx_packet(&entry.msg);
+        else
+            rx_exception(&entry.msg, entry.exception_code, true);
     }
-
-    last_ms = ms;
-    spin_lock = false;
 }
 
 static void modbus_reset (void)
@@ -244,7 +330,7 @@ static void modbus_reset (void)
     while(spin_lock);
 
     packet = NULL;
-    tail = head;
+    tail = done = head;
     state = ModBus_Idle;
 
     stream->flush_tx_buffer();
@@ -256,7 +342,7 @@ static void modbus_reset (void)
 static void onReportOptions (void)
 {
     on_report_options();
-    hal.stream.write("[PLUGIN:MODBUS v0.01]" ASCII_EOL);
+    hal.stream.write("[PLUGIN:MODBUS v0.02]" ASCII_EOL);
 }
 
 void modbus_init (modbus_stream_t *mstream)
@@ -270,14 +356,18 @@ void modbus_init (modbus_stream_t *mstream)
         driver_reset = hal.driver_reset;
         hal.driver_reset = modbus_reset;
 
+#ifdef ENABLE_SCHEDULER
+        scheduler_add("MODBUS", modbus_process, SchedulerPriority_High, 0, 0);
+#else
         on_execute_realtime = grbl.on_execute_realtime;
-        grbl.on_execute_realtime = modbus_poll;
+        grbl.on_execute_realtime = modbus_process;
+#endif
 
         on_report_options = grbl.on_report_options;
         grbl.on_report_options = onReportOptions;
     }
 
-    head = tail = &queue[0];
+    head = tail = done = &queue[0];
 
     for(idx = 0; idx < MODBUS_QUEUE_LENGTH; idx++)
         queue[idx].next = idx == MODBUS_QUEUE_LENGTH - 1 ? &queue[0] : &queue[idx + 1];
@@ -26,7 +26,9 @@
 
 #define MODBUS_ENABLE 1
 #define MODBUS_MAX_ADU_SIZE 10
-#define MODBUS_QUEUE_LENGTH 8
+#ifndef MODBUS_QUEUE_LENGTH
+#define MODBUS_QUEUE_LENGTH 16
+#endif
 
 typedef enum {
     ModBus_Idle,
@@ -48,11 +50,15 @@ typedef enum {
     ModBus_Diagnostics = 8
 } modbus_function_t;
 
-typedef struct {
+typedef struct modbus_message {
     uint8_t tx_length;
     uint8_t rx_length;
     void *xx;
     char adu[MODBUS_MAX_ADU_SIZE];
+    // Optional per request callbacks, called from the foreground process on completion of non-blocking requests.
+    // If on_rx_packet is NULL the stream on_rx_packet handler is called instead.
+    void (*on_rx_packet)(struct modbus_message *msg);
+    void (*on_rx_exception)(uint8_t code, void *context); // code is 0 on timeout, context is the xx member.
 } modbus_message_t;
 
 typedef struct {
@@ -72,5 +78,6 @@ typedef struct {
 void modbus_init (modbus_stream_t *stream);
 bool modbus_send (modbus_message_t *msg, bool block);
 modbus_state_t modbus_get_state (void);
+void modbus_event (void);
 
 #endif
@@ -50,14 +50,44 @@
   #endif
 #endif
 
+#ifndef TMC_TELEMETRY_MIN_INTERVAL
+#define TMC_TELEMETRY_MIN_INTERVAL 5 // ms
+#endif
+
+// Axis speed in mm/min above which axes configured for stealthChop are switched to spreadCycle, 0 to disable.
+// When enabled the chopper mode is scheduled from the planner block speeds, the switch to spreadCycle is made
+// before the block is executed and the driver TPWMTHRS register is not used.
+#ifndef TMC_STEALTHCHOP_MAX_SPEED
+#define TMC_STEALTHCHOP_MAX_SPEED 0 // mm/min
+#endif
+
+#if TMC_STEALTHCHOP_MAX_SPEED > 0
+
+// Time without a block above the speed before switching back to stealthChop, must be longer
+// than the motion queued in the segment buffer.
+#ifndef TMC_STEALTHCHOP_HOLDOFF
+#define TMC_STEALTHCHOP_HOLDOFF 100 // ms
+#endif
+
+// Run current in spreadCycle mode, percent of the configured current.
+#ifndef TMC_SPREADCYCLE_CURRENT_PCT
+#define TMC_SPREADCYCLE_CURRENT_PCT 100
+#endif
+
+#endif
+
 static bool warning = false, is_homing = false;
-static volatile uint_fast16_t diag1_poll = 0;
+static volatile uint_fast16_t stalled = 0;
 static char sbuf[65]; // string buffer for reports
 static TMC2130_t stepper[N_AXIS];
+#ifdef ENABLE_MICROSTEP_SWITCHING
+// Register access is flagged so that the stepper interrupt does not interfere with a transfer in progress.
+static volatile bool io_busy = false;
+#endif
 static axes_signals_t homing = {0}, otpw_triggered = {0};
 static limits_get_state_ptr limits_get_state = NULL;
 static stepper_pulse_start_ptr hal_stepper_pulse_start = NULL;
-static on_execute_realtime_ptr on_execute_realtime = NULL;
+static on_execute_realtime_ptr on_execute_realtime = NULL, on_execute_realtime_telemetry = NULL;
 static driver_setting_ptrs_t driver_settings;
 static on_realtime_report_ptr on_realtime_report;
 static on_report_options_ptr on_report_options;
@@ -73,8 +103,25 @@ static struct {
     uint32_t msteps;
 } report = {0};
 
+static struct {
+    uint16_t interval;
+    uint16_t sequence;
+    uint32_t last;
+} telemetry = {0};
+
 #if TRINAMIC_DEV
 static TMC2130_datagram_t *reg_ptr = NULL;
+
+#if TMC_STEALTHCHOP_MAX_SPEED > 0
+static struct {
+    axes_signals_t stealth;         // Axes configured for stealthChop
+    axes_signals_t spread;          // Axes currently switched to spreadCycle
+    volatile axes_signals_t fast;   // Axes above the speed in blocks prepared within the holdoff time
+    volatile uint32_t fast_ms;      // Time of the last block prepared with axes above the speed
+} chopper = {0};
+static on_block_started_ptr on_block_started;
+static on_execute_realtime_ptr on_execute_realtime_chopper;
+#endif
 #endif
 
 #if TRINAMIC_I2C
@@ -89,6 +136,185 @@ TMCI2C_monitor_status_dgr_t dgr_monitor = {
 
 static void write_debug_report (void);
 
+#if !TRINAMIC_I2C
+
+/* Chained register access: the enabled drivers are assumed to be daisy chained in axis order, the first
+   enabled axis nearest to the MCU. The chain acts as a single shift register so the datagram for the driver
+   at the end of the chain is shifted out first, and replies are received in the same order.
+   Each batch accesses one register in every driver by a single transfer, a read needs two transfers
+   since the reply to a read request is returned by the next transfer. */
+
+#define TMC_DATAGRAM_SIZE 5
+#define TMC_NOP_REG 0x04 // IOIN, read only and without side effects.
+
+static tmc_chain_transfer_ptr chain_transfer = NULL;
+static uint8_t chain_tx[N_AXIS * TMC_DATAGRAM_SIZE], chain_rx[N_AXIS * TMC_DATAGRAM_SIZE];
+
+void trinamic_chain_init (tmc_chain_transfer_ptr transfer)
+{
+    chain_transfer = transfer;
+}
+
+// Fills the transmit buffer with the register addresses and data, returns the number of bytes to transfer.
+static uint_fast16_t chain_pack (TMC2130_datagram_t *reg[N_AXIS], bool write)
+{
+    uint8_t *p;
+    uint32_t data;
+    uint_fast8_t idx, pos = 0, length = 0;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(bit_istrue(trinamic.driver_enable.mask, bit(idx)))
+            length++;
+    }
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(bit_istrue(trinamic.driver_enable.mask, bit(idx))) {
+            p = &chain_tx[(length - 1 - pos++) * TMC_DATAGRAM_SIZE];
+            if(reg[idx]) {
+                data = write ? reg[idx]->payload.value : 0;
+                *p++ = reg[idx]->addr.reg | (write ? 0x80 : 0);
+            } else {
+                data = 0;
+                *p++ = TMC_NOP_REG;
+            }
+            *p++ = (uint8_t)(data >> 24);
+            *p++ = (uint8_t)(data >> 16);
+            *p++ = (uint8_t)(data >> 8);
+            *p = (uint8_t)data;
+        }
+    }
+
+    return length * TMC_DATAGRAM_SIZE;
+}
+
+// Read a register from several drivers, NULL entries in reg are skipped.
+// Returns false if chained transfers are not supported by the driver.
+bool trinamic_read_batch (TMC2130_datagram_t *reg[N_AXIS], TMC2130_status_t status[N_AXIS])
+{
+    uint8_t *p;
+    uint_fast8_t idx, pos = 0;
+    uint_fast16_t length;
+
+    if(chain_transfer == NULL)
+        return false;
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    io_busy = true;
+#endif
+
+    length = chain_pack(reg, false);
+    chain_transfer(chain_tx, chain_rx, length); // Send read requests,
+    chain_transfer(chain_tx, chain_rx, length); // and get the replies.
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    io_busy = false;
+#endif
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(bit_istrue(trinamic.driver_enable.mask, bit(idx))) {
+            p = &chain_rx[length - (++pos * TMC_DATAGRAM_SIZE)];
+            if(status)
+                status[idx].value = p[0];
+            if(reg[idx])
+                reg[idx]->payload.value = ((uint32_t)p[1] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 8) | p[4];
+        }
+    }
+
+    return true;
+}
+
+// Write a register to several drivers, NULL entries in reg are skipped.
+// Returns false if chained transfers are not supported by the driver.
+bool trinamic_write_batch (TMC2130_datagram_t *reg[N_AXIS])
+{
+    if(chain_transfer == NULL)
+        return false;
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    io_busy = true;
+#endif
+
+    chain_transfer(chain_tx, chain_rx, chain_pack(reg, true));
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    io_busy = false;
+#endif
+
+    return true;
+}
+
+#endif
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+
+#ifndef TMC_MICROSTEP_SWITCH_MIN
+#define TMC_MICROSTEP_SWITCH_MIN 16 // Coarsest microstep resolution used at high step rates.
+#endif
+
+static uint_fast8_t microstep_shift = 0;
+static TMC_io_driver_t io;
+
+static TMC2130_status_t io_write_register (TMC2130_t *driver, TMC2130_datagram_t *reg)
+{
+    TMC2130_status_t status;
+
+    io_busy = true;
+    status = io.WriteRegister(driver, reg);
+    io_busy = false;
+
+    return status;
+}
+
+static TMC2130_status_t io_read_register (TMC2130_t *driver, TMC2130_datagram_t *reg)
+{
+    TMC2130_status_t status;
+
+    io_busy = true;
+    status = io.ReadRegister(driver, reg);
+    io_busy = false;
+
+    return status;
+}
+
+// Called from the stepper interrupt, divides the microstep resolution of all drivers by 2^shift.
+ISR_CODE static bool set_microstep_shift (uint_fast8_t shift)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(io_busy)
+        return false;
+
+    microstep_shift = shift;
+
+    do {
+        idx--;
+        TMC2130_SetMicrosteps(&stepper[idx], (tmc2130_microsteps_t)(trinamic.driver[idx].microsteps >> shift));
+    } while(idx);
+
+    return true;
+}
+
+// Resolution switching requires all motors to be driven by Trinamic drivers.
+static void microstep_switch_configure (void)
+{
+    uint_fast8_t idx = N_AXIS, shift = 8;
+
+    if(trinamic.driver_enable.mask == AXES_BITMASK) do {
+        uint_fast8_t axis_shift = 0;
+        idx--;
+        while((trinamic.driver[idx].microsteps >> axis_shift) > TMC_MICROSTEP_SWITCH_MIN)
+            axis_shift++;
+        shift = min(shift, axis_shift);
+    } while(idx);
+    else
+        shift = 0;
+
+    hal.stepper.microstep_shift_max = shift;
+    hal.stepper.set_microstep_shift = shift ? set_microstep_shift : NULL;
+}
+
+#endif
+
 // Wrapper for initializing physical interface (since two alternatives are provided)
 void TMC_DriverInit (TMC_io_driver_t *driver)
 {
@@ -97,6 +323,12 @@ void TMC_DriverInit (TMC_io_driver_t *driver)
 #else
     SPI_DriverInit(driver);
 #endif
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    memcpy(&io, driver, sizeof(TMC_io_driver_t));
+    driver->WriteRegister = io_write_register;
+    driver->ReadRegister = io_read_register;
+#endif
 }
 
 // Update driver settings on changes
@@ -108,9 +340,17 @@ void trinamic_configure (void)
         if(bit_istrue(trinamic.driver_enable.mask, bit(--idx))) {
             stepper[idx].r_sense = trinamic.driver[idx].r_sense;
             TMC2130_SetCurrent(&stepper[idx], trinamic.driver[idx].current, stepper[idx].hold_current_pct);
+#ifdef ENABLE_MICROSTEP_SWITCHING
+            TMC2130_SetMicrosteps(&stepper[idx], (tmc2130_microsteps_t)(trinamic.driver[idx].microsteps >> microstep_shift));
+#else
             TMC2130_SetMicrosteps(&stepper[idx], trinamic.driver[idx].microsteps);
+#endif
         }
     } while(idx);
+
+#ifdef ENABLE_MICROSTEP_SWITCHING
+    microstep_switch_configure();
+#endif
 }
 
 // Parse and set driver specific parameters
@@ -314,6 +554,118 @@ static void report_sg_params (void)
 
 #endif
 
+// Sample driver load at the set interval and publish as a binary record.
+// The status of all drivers is fetched by a single chained transfer when available.
+static void telemetry_sample (uint_fast16_t state)
+{
+    uint32_t ms;
+
+    if(telemetry.interval && grbl.on_telemetry && ((ms = hal.get_elapsed_ticks()) - telemetry.last) >= telemetry.interval) {
+
+        uint_fast8_t idx = N_AXIS;
+        tmc_telemetry_t record = {0};
+
+        telemetry.last = ms;
+
+#if !TRINAMIC_I2C
+        TMC2130_datagram_t *reg[N_AXIS];
+        do {
+            idx--;
+            reg[idx] = bit_istrue(trinamic.driver_enable.mask, bit(idx)) ? (TMC2130_datagram_t *)&stepper[idx].drv_status : NULL;
+        } while(idx);
+        bool batched = trinamic_read_batch(reg, NULL);
+        idx = N_AXIS;
+#else
+        bool batched = false;
+#endif
+
+        system_get_position(record.position);
+
+        do {
+            if(bit_istrue(trinamic.driver_enable.mask, bit(--idx))) {
+                if(!batched)
+                    TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
+                record.sg_result[idx] = stepper[idx].drv_status.reg.sg_result;
+                record.cs_actual[idx] = stepper[idx].drv_status.reg.cs_actual;
+                if(stepper[idx].drv_status.reg.stallGuard)
+                    bit_true(record.stalled, bit(idx));
+            }
+        } while(idx);
+
+        record.n_axis = N_AXIS;
+        record.sequence = telemetry.sequence++;
+        record.timestamp = ms;
+
+        grbl.on_telemetry(Telemetry_TrinamicLoad, &record, sizeof(tmc_telemetry_t));
+    }
+
+    on_execute_realtime_telemetry(state);
+}
+
+#if TMC_STEALTHCHOP_MAX_SPEED > 0
+
+// Flags the stealthChop axes moving above the speed in the block, may be called from interrupt context.
+static void onBlockStarted (plan_block_t *block, float nominal_speed)
+{
+    uint_fast8_t idx = N_AXIS;
+    axes_signals_t fast = {0};
+    float speed = nominal_speed / block->millimeters;
+
+    do {
+        idx--;
+        if(bit_istrue(chopper.stealth.mask, bit(idx)) &&
+            speed * (float)plan_block_steps(block, idx) / settings.axis[idx].steps_per_mm > (float)TMC_STEALTHCHOP_MAX_SPEED)
+            bit_true(fast.mask, bit(idx));
+    } while(idx);
+
+    if(fast.mask) {
+        chopper.fast.mask |= fast.mask;
+        chopper.fast_ms = hal.get_elapsed_ticks();
+    }
+
+    if(on_block_started)
+        on_block_started(block, nominal_speed);
+}
+
+// Switches the chopper mode of the flagged axes, spreadCycle as soon as possible and stealthChop
+// after the holdoff time, when the fast motion has been executed.
+static void chopper_update (uint_fast16_t state)
+{
+    axes_signals_t fast, changed;
+
+    if(!is_homing) {
+
+        hal.irq_disable();
+        if(chopper.fast.mask && (hal.get_elapsed_ticks() - chopper.fast_ms) >= TMC_STEALTHCHOP_HOLDOFF)
+            chopper.fast.mask = 0;
+        fast = chopper.fast;
+        hal.irq_enable();
+
+        if((changed.mask = fast.mask ^ chopper.spread.mask)) {
+
+            uint_fast8_t idx = N_AXIS;
+
+            do {
+                if(bit_istrue(changed.mask, bit(--idx))) {
+                    bool spread = bit_istrue(fast.mask, bit(idx));
+                    stepper[idx].gconf.reg.en_pwm_mode = !spread;
+                    TMC2130_WriteRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].gconf);
+#if TMC_SPREADCYCLE_CURRENT_PCT != 100
+                    TMC2130_SetCurrent(&stepper[idx], spread ? (uint16_t)((uint32_t)trinamic.driver[idx].current * TMC_SPREADCYCLE_CURRENT_PCT / 100)
+                                                             : trinamic.driver[idx].current, stepper[idx].hold_current_pct);
+#endif
+                }
+            } while(idx);
+
+            chopper.spread = fast;
+        }
+    }
+
+    on_execute_realtime_chopper(state);
+}
+
+#endif
+
 static void stepper_pulse_start (stepper_t *motors)
 {
     static uint32_t step_count = 0;
@@ -432,6 +784,14 @@ static status_code_t trinamic_MCodeValidate (parser_block_t *gc_block, uint32_t
                 report.msteps = trinamic.driver[report.sg_status_axis].microsteps;
             }
 
+            if(bit_istrue(*value_words, bit(Word_P))) {
+                if(gc_block->values.p < 0.0f || gc_block->values.p > 65535.0f)
+                    state = Status_GcodeValueOutOfRange;
+                else if((telemetry.interval = (uint16_t)gc_block->values.p) && telemetry.interval < TMC_TELEMETRY_MIN_INTERVAL)
+                    telemetry.interval = TMC_TELEMETRY_MIN_INTERVAL;
+                bit_false(*value_words, bit(Word_P));
+            }
+
             if(report.axes.mask) {
                 report.axes.mask &= trinamic.driver_enable.mask;
                 uint32_t axis = 0, mask = report.axes.mask;
@@ -543,13 +903,22 @@ static void trinamic_MCodeExecute (uint_fast16_t state, parser_block_t *gc_block
             break;
 
         case Trinamic_ReportPrewarnFlags:; // TODO: format grbl style?
-            TMC2130_status_t status;
+            TMC2130_status_t status[N_AXIS];
+#if !TRINAMIC_I2C
+            TMC2130_datagram_t *reg[N_AXIS];
+            for(idx = 0; idx < N_AXIS; idx++)
+                reg[idx] = (TMC2130_datagram_t *)&stepper[idx].drv_status;
+            bool batched = trinamic_read_batch(reg, status);
+#else
+            bool batched = false;
+#endif
             for(idx = 0; idx < N_AXIS; idx++) {
                 if(bit_istrue(trinamic.driver_enable.mask, bit(idx))) {
-                    status = TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
+                    if(!batched)
+                        status[idx] = TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
                     strcpy(sbuf, axis_letter[idx]);
                     strcat(sbuf, ":");
-                    if(status.driver_error)
+                    if(status[idx].driver_error)
                         strcat(sbuf, "E");
                     else if(stepper[idx].drv_status.reg.ot)
                         strcat(sbuf, "O");
@@ -608,24 +977,49 @@ axes_signals_t trinamic_stepper_enable (axes_signals_t enable)
 }
 #endif
 
+// Returns the homing axes flagged by stallGuard, the status of all drivers is fetched
+// by a single chained transfer when available.
+// A single homing axis is attributed without reading the driver status.
+static uint_fast16_t get_stalled_axes (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    uint_fast16_t axes = 0;
+
+    if(!(homing.mask & (homing.mask - 1)))
+        return homing.mask;
+
+#if !TRINAMIC_I2C
+    TMC2130_datagram_t *reg[N_AXIS];
+    do {
+        idx--;
+        reg[idx] = bit_istrue(homing.mask, bit(idx)) ? (TMC2130_datagram_t *)&stepper[idx].drv_status : NULL;
+    } while(idx);
+    bool batched = trinamic_read_batch(reg, NULL);
+    idx = N_AXIS;
+#else
+    bool batched = false; // TODO: read I2C bridge status register instead of polling drivers when using I2C comms
+#endif
+
+    do {
+        if(bit_istrue(homing.mask, bit(--idx))) {
+            if(!batched)
+                TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
+            if(stepper[idx].drv_status.reg.stallGuard)
+                bit_true(axes, bit(idx));
+        }
+    } while(idx);
+
+    return axes;
+}
+
 // hal.limits.get_state is redirected here when homing
+// Stalled axes are latched by the DIAG1 interrupt handler and reported once.
 static axes_signals_t trinamic_limits (void)
 {
     axes_signals_t signals = limits_get_state(); // read from switches first
 
     signals.mask &= ~homing.mask;
-
-    if(hal.clear_bits_atomic(&diag1_poll, 0)) {
-        // TODO: read I2C bridge status register instead of polling drivers when using I2C comms
-        uint_fast8_t idx = N_AXIS;
-        do {
-            if(bit_istrue(homing.mask, bit(--idx))) {
-                TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
-                if(stepper[idx].drv_status.reg.stallGuard)
-                    bit_true(signals.mask, idx);
-            }
-        } while(idx);
-    }
+    signals.mask |= hal.clear_bits_atomic(&stalled, AXES_BITMASK) & homing.mask;
 
     return signals;
 }
@@ -640,6 +1034,11 @@ void trinamic_homing (bool enable)
     is_homing = enable;
     enable = enable && homing.mask;
 
+#if TMC_STEALTHCHOP_MAX_SPEED > 0
+    chopper.spread.mask &= ~homing.mask; // stallGuard_enable() resets the chopper mode.
+    chopper.fast.mask &= ~homing.mask;
+#endif
+
     do {
         if(bit_istrue(homing.mask, bit(--idx)))
             stallGuard_enable(idx, enable);
@@ -650,7 +1049,7 @@ void trinamic_homing (bool enable)
             limits_get_state = hal.limits.get_state;
             hal.limits.get_state = trinamic_limits;
         }
-        diag1_poll = 0;
+        stalled = 0;
     } else if(limits_get_state != NULL) {
         hal.limits.get_state = limits_get_state;
         limits_get_state = NULL;
@@ -665,12 +1064,33 @@ static void write_debug_report (void)
 
     hal.stream.write("[TRINAMIC]"  ASCII_EOL);
 
+#if !TRINAMIC_I2C
+    TMC2130_datagram_t *chopconf[N_AXIS], *drv_status[N_AXIS], *pwm_scale[N_AXIS], *tstep[N_AXIS];
+
+    do {
+        idx--;
+        bool read = bit_istrue(report.axes.mask, bit(idx));
+        chopconf[idx] = read ? (TMC2130_datagram_t *)&stepper[idx].chopconf : NULL;
+        drv_status[idx] = read ? (TMC2130_datagram_t *)&stepper[idx].drv_status : NULL;
+        pwm_scale[idx] = read ? (TMC2130_datagram_t *)&stepper[idx].pwm_scale : NULL;
+        tstep[idx] = read ? (TMC2130_datagram_t *)&stepper[idx].tstep : NULL;
+    } while(idx);
+
+    bool batched = trinamic_read_batch(chopconf, NULL) && trinamic_read_batch(drv_status, NULL) &&
+                    trinamic_read_batch(pwm_scale, NULL) && trinamic_read_batch(tstep, NULL);
+    idx = N_AXIS;
+#else
+    bool batched = false;
+#endif
+
     do {
         if(bit_istrue(report.axes.mask, bit(--idx))) {
-            TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].chopconf);
-            TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
-            TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].pwm_scale);
-            TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].tstep);
+            if(!batched) {
+                TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].chopconf);
+                TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].drv_status);
+                TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].pwm_scale);
+                TMC2130_ReadRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].tstep);
+            }
             if(stepper[idx].drv_status.reg.otpw)
                 otpw_triggered.mask |= bit(idx);
         }
@@ -970,6 +1390,18 @@ bool trinamic_init (void)
 
         on_report_options = grbl.on_report_options;
         grbl.on_report_options = onReportOptions;
+
+        if(hal.get_elapsed_ticks) {
+            on_execute_realtime_telemetry = grbl.on_execute_realtime;
+            grbl.on_execute_realtime = telemetry_sample;
+#if TMC_STEALTHCHOP_MAX_SPEED > 0
+            on_execute_realtime_chopper = grbl.on_execute_realtime;
+            grbl.on_execute_realtime = chopper_update;
+
+            on_block_started = grbl.on_block_started;
+            grbl.on_block_started = onBlockStarted;
+#endif
+        }
     }
 
     return driver_settings.nvs_address != 0;
@@ -1045,16 +1477,29 @@ void trinamic_start (bool allow_mixed)
           #if TRINAMIC_I2C
             TMC2130_WriteRegister(NULL, (TMC2130_datagram_t *)&dgr_enable);
           #endif
+          #if TMC_STEALTHCHOP_MAX_SPEED > 0
+            if(stepper[idx].gconf.reg.en_pwm_mode) {
+                bit_true(chopper.stealth.mask, bit(idx));
+                stepper[idx].tpwmthrs.reg.tpwmthrs = 0; // Chopper mode is switched by chopper_update()
+                TMC2130_WriteRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].tpwmthrs);
+            } else
+                bit_false(chopper.stealth.mask, bit(idx));
+          #endif
         }
     } while(idx);
 }
 
 // Interrupt handler for DIAG1 signal(s)
+// When homing the stalled axes are locked immediately rather than waiting for the homing cycle to poll the limits.
 void trinamic_fault_handler (void)
 {
-    if(is_homing)
-        diag1_poll = 1;
-    else
+    if(is_homing) {
+        uint_fast16_t axes = get_stalled_axes();
+        hal.set_bits_atomic(&stalled, axes);
+#ifndef KINEMATICS_API
+        sys.homing_axis_lock.mask &= ~axes;
+#endif
+    } else
         hal.limits.interrupt_callback((axes_signals_t){AXES_BITMASK});
 }
 
@@ -143,9 +143,31 @@ typedef struct {
     motor_settings_t driver[N_AXIS];
 } trinamic_settings_t;
 
+// Load telemetry record, published via grbl.on_telemetry on channel Telemetry_TrinamicLoad when enabled by M122 P<interval>.
+// Native (little endian) byte order, fields are ordered for natural alignment.
+typedef struct {
+    uint8_t n_axis;             // Number of axes in the arrays below
+    uint8_t stalled;            // stallGuard flag, bit per axis
+    uint16_t sequence;          // Incremented for each record, gaps indicates dropped records
+    uint32_t timestamp;         // ms
+    int32_t position[N_AXIS];   // Machine position in steps at sample time
+    uint16_t sg_result[N_AXIS]; // stallGuard load value, 0 for disabled drivers
+    uint8_t cs_actual[N_AXIS];  // Actual motor current scale
+} tmc_telemetry_t;
+
 // Init wrapper for physical interface
 void TMC_DriverInit (TMC_io_driver_t *driver);
 
+#if !TRINAMIC_I2C
+// Optional full duplex transfer of length bytes to daisy chained drivers sharing a chip select, provided by the driver.
+// Chip select must be asserted for the whole transfer, may be implemented by DMA but must complete before returning.
+typedef void (*tmc_chain_transfer_ptr)(uint8_t *tx, uint8_t *rx, uint_fast16_t length);
+
+void trinamic_chain_init (tmc_chain_transfer_ptr transfer);
+bool trinamic_read_batch (TMC2130_datagram_t *reg[N_AXIS], TMC2130_status_t status[N_AXIS]);
+bool trinamic_write_batch (TMC2130_datagram_t *reg[N_AXIS]);
+#endif
+
 bool trinamic_init (void);
 void trinamic_start (bool allow_mixed);
 void trinamic_configure (void);
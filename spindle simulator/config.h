@@ -56,12 +56,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define INDEX_TIMERI 0
 #define INDEX_PORT   1
 #define INDEX_BIT    BIT6  // P1.6
+#define INDEX_CLK_BIT BIT0 // P1.0 - TA0CLK, to be jumpered to encoder A output (P2.1)
 
 #define INDEX_CTL timerCtl(INDEX_TIMER, INDEX_TIMERI)
 #define INDEX_CCR0 timerCcr(INDEX_TIMER, INDEX_TIMERI, 0)
 #define INDEX_CCR1 timerCcr(INDEX_TIMER, INDEX_TIMERI, 1)
 #define INDEX_CCTL0 timerCCtl(INDEX_TIMER, INDEX_TIMERI, 0)
 #define INDEX_CCTL1 timerCCtl(INDEX_TIMER, INDEX_TIMERI, 1)
+#define INDEX_TAR timerR(INDEX_TIMER, INDEX_TIMERI)
 #define INDEX_IRQH timerInt(INDEX_TIMER, INDEX_TIMERI, 0)
 
 #define INDEX_PORT_DIR  portDir(INDEX_PORT)
@@ -76,13 +78,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SPINDLE_PULSE_TIMER  A
 #define SPINDLE_PULSE_TIMERI 1
 #define SPINDLE_PULSE_PORT   2
-#define SPINDLE_PULSE_BIT    BIT1 // P2.1
+#define SPINDLE_PULSE_BIT    BIT1 // P2.1 - encoder A
+#define SPINDLE_PULSE_B_BIT  BIT4 // P2.4 - encoder B
 
 #define SPINDLE_PULSE_CTL timerCtl(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI)
 #define SPINDLE_PULSE_CCR0 timerCcr(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 0)
 #define SPINDLE_PULSE_CCR1 timerCcr(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 1)
+#define SPINDLE_PULSE_CCR2 timerCcr(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 2)
 #define SPINDLE_PULSE_CCTL0 timerCCtl(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 0)
 #define SPINDLE_PULSE_CCTL1 timerCCtl(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 1)
+#define SPINDLE_PULSE_CCTL2 timerCCtl(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 2)
+#define SPINDLE_PULSE_TAR timerR(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI)
 #define SPINDLE_PULSE_IRQH timerInt(SPINDLE_PULSE_TIMER, SPINDLE_PULSE_TIMERI, 0)
 
 #define SPINDLE_PULSE_PORT_DIR portDir(SPINDLE_PULSE_PORT)
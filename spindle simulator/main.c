@@ -3,12 +3,12 @@
 //
 // For Texas Instruments MSP430 Value Line Launchpad
 //
-// v1.1 / 2020-11-04 / Io Engineering / Terje
+// v1.2 / 2026-10-14 / Io Engineering / Terje
 //
 
 /*
 
-Copyright (c) 2019-2020, Terje Io
+Copyright (c) 2019-2026, Terje Io
 All rights reserved.
 
 Redistribution and use in source and binary forms, with or without modification,
@@ -52,8 +52,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MSG_FAIL  3U
 #define MSG_BADC  4U
 
+#define SMCLK_FREQ  16000000UL
+#define TICK_US     512UL       // WDT interval timer period, SMCLK / 8192
+#define MAX_JITTER  50          // Max period jitter in percent
+
 char const *const message[] = {
-    "\r\nSpindle Simulator 1.1\0",
+    "\r\nSpindle Simulator 1.2\0",
     "Error: missing parameters",
     "OK",
     "FAILED",
@@ -66,11 +70,20 @@ typedef struct {
     const bool report;
 } command_t;
 
+typedef struct {
+    uint16_t ccr0;
+    uint16_t div;
+} period_t;
+
 char cmdbuf[16];
-uint16_t ppr = 120, rpm = 400, max_rpm = 1000;
-uint32_t pulse_period = 0;
-bool update_rpm = true;
+uint16_t ppr = 120, rpm = 400, max_rpm = 1000, ramp = 0, jitter = 0, log_interval = 0;
 int16_t step = 0;
+int32_t rpm_out = 0;                        // Current encoder output RPM, follows target RPM at ramp rate
+uint32_t ramp_acc = 0, ramp_ticks = 0;
+period_t period = {0};
+volatile period_t next_period;
+volatile uint32_t ticks = 0, revs = 0, log_ticks = 0, log_rev = 0;
+volatile bool log_pending = false;
 
 bool manual = false, lock = false, invert = false;
 
@@ -99,6 +112,33 @@ int parseInt (char *s)
     return negative ? -res : res;
 }
 
+char *uitoa (uint32_t n)
+{
+    static char buf[11];
+
+    char *s = &buf[10];
+
+    *s = '\0';
+
+    do {
+        *--s = '0' + n % 10;
+    } while(n /= 10);
+
+    return s;
+}
+
+// xorshift pseudo random generator for period jitter
+uint16_t rand16 (void)
+{
+    static uint16_t x = 0xACE1;
+
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+
+    return x;
+}
+
 uint16_t read_adc (void)
 {
     uint16_t adc;
@@ -114,21 +154,82 @@ uint16_t read_adc (void)
     return adc;
 }
 
+// Calculates the timer period for the encoder outputs, each timer period toggles A and B once,
+// B a half period after A. The input divider is changed as needed to fit the period in 16 bits.
+// NOTE: the period is limited to 4 to 65536 SMCLK cycles / 8, the update is applied by the timer ISR.
+void setPeriod (int32_t value)
+{
+    uint16_t div = 0;
+    uint32_t cycles, edges = (uint32_t)(value < 1 ? 1 : value) * ppr;
+
+    cycles = (SMCLK_FREQ * 30UL + (edges >> 1)) / edges; // SMCLK cycles per half encoder pulse
+
+    if(jitter) {
+        uint32_t dev = cycles > 0xFFFFFFUL ? cycles / 100UL * jitter : cycles * jitter / 100UL;
+        if(dev)
+            cycles = cycles - dev + (uint32_t)rand16() % (2UL * dev + 1UL);
+    }
+
+    while(cycles > 65536UL && div < 3) {
+        cycles = (cycles + 1UL) >> 1;
+        div++;
+    }
+
+    cycles = cycles > 65536UL ? 65536UL : (cycles < 4UL ? 4UL : cycles);
+
+    if((uint16_t)(cycles - 1) != period.ccr0 || div != period.div) {
+        period.ccr0 = (uint16_t)(cycles - 1);
+        period.div = div;
+        SPINDLE_PULSE_CCTL0 &= ~CCIE;
+        next_period.ccr0 = period.ccr0;
+        next_period.div = period.div;
+        SPINDLE_PULSE_CCTL0 |= CCIE;    // Apply at end of current period
+    }
+}
+
+// Moves the encoder output RPM towards value at the RAMP rate, immediately if RAMP is 0.
 void setRPM (int value, int16_t offset)
 {
-    uint32_t new_period = ((2000000UL * 60UL) / (value + (lock ? 0 : offset)) / ppr);
+    int32_t target = (int32_t)value + (lock ? 0 : offset);
+    uint32_t now;
+
+    _DINT();
+    now = ticks;
+    _EINT();
+
+    if(ramp && target != rpm_out) {
+
+        uint32_t delta;
 
-    rpm = value;
-    pulse_period = pulse_period > (1UL << 16) ? (1UL << 16) - 1 : pulse_period;
+        ramp_acc += (uint32_t)ramp * (now - ramp_ticks) * TICK_US;
+        delta = ramp_acc / 1000000UL;
+        ramp_acc %= 1000000UL;
 
-    if((update_rpm = new_period != pulse_period))
-        pulse_period = new_period;
+        if(target > rpm_out)
+            rpm_out = target - rpm_out > delta ? rpm_out + (int32_t)delta : target;
+        else
+            rpm_out = rpm_out - target > delta ? rpm_out - (int32_t)delta : target;
+    } else {
+        rpm_out = target;
+        ramp_acc = 0;
+    }
+
+    ramp_ticks = now;
+
+    setPeriod(rpm_out);
 }
 
 bool setPPR (int value)
 {
+    if(value < 1)
+        return false;
+
     ppr = value;
-    pulse_period = step = 0;
+    step = 0;
+    period.ccr0 = 0;
+
+    INDEX_CCR0 = ppr - 1;           // Index timer counts encoder A pulses, one interrupt per revolution
+    INDEX_CTL |= TACLR;
 
     setRPM(rpm, 0);
 
@@ -142,16 +243,58 @@ bool cmdSetPPR (char *params)
 
 bool cmdSetRPM (char *params)
 {
-    setRPM(parseInt(params), 0);
+    setRPM(rpm = parseInt(params), 0);
 
     return true;
 }
 
+bool cmdSetMaxRPM (char *params)
+{
+    int value = parseInt(params);
+
+    if(value > 0)
+        max_rpm = value;
+
+    return value > 0;
+}
+
+bool cmdRamp (char *params)
+{
+    int value = parseInt(params);
+
+    if(value >= 0)
+        ramp = value;
+
+    return value >= 0;
+}
+
+bool cmdJitter (char *params)
+{
+    int value = parseInt(params);
+
+    if(value >= 0 && value <= MAX_JITTER)
+        jitter = value;
+
+    return value >= 0 && value <= MAX_JITTER;
+}
+
+bool cmdLog (char *params)
+{
+    int value = parseInt(params);
+
+    if(value >= 0)
+        log_interval = value;
+
+    return value >= 0;
+}
+
 void SpindleOn (bool on)
 {
     if(on) {
-        SPINDLE_PULSE_CTL |= MC0;       // Start timer in up mode and
-        trigOut();                      // output trigger pulse
+        if(!(SPINDLE_PULSE_CTL & MC0)) {
+            SPINDLE_PULSE_CTL |= MC0;   // Start timer in up mode and
+            trigOut();                  // output trigger pulse
+        }
     } else
         SPINDLE_PULSE_CTL &= ~MC0;      // Stop timer
 }
@@ -199,11 +342,15 @@ void exeCommand (char *cmdline)
     static const command_t commands[] = {
         "RPM:",     cmdSetRPM, true,
         "PPR:",     cmdSetPPR, true,
+        "MAXRPM:",  cmdSetMaxRPM, true,
         "SPINDLE:", cmdSpindle, true,
         "AUTO:",    cmdAuto, true,
         "LOCK:",    cmdLock, true,
         "STEP:",    cmdStep, true,
-        "INVERT:",  cmdInvert, true
+        "INVERT:",  cmdInvert, true,
+        "RAMP:",    cmdRamp, true,
+        "JITTER:",  cmdJitter, true,
+        "LOG:",     cmdLog, true
     };
 
     static const uint16_t numcmds = sizeof(commands) / sizeof(command_t);
@@ -232,12 +379,7 @@ uint16_t read_rpm (void)
 {
     uint16_t i = 64, adc = 0;
 
-    static p = 0;
-
-    p = 0;
-
     while(i--) {
-        p++;
         adc += read_adc();
         __delay_cycles(100);
     }
@@ -248,33 +390,53 @@ uint16_t read_rpm (void)
     return (uint16_t)(((uint32_t)adc * max_rpm) / 1024UL);
 }
 
+// Outputs IDX:<revolution>,<ms>,<rpm> for the index pulse captured by the index ISR.
+// NOTE: the timestamp resolution is the WDT interval, 0.512 ms.
+void logIndex (void)
+{
+    uint32_t rev, ms;
+
+    _DINT();
+    rev = log_rev;
+    ms = log_ticks * TICK_US / 1000UL;
+    log_pending = false;
+    _EINT();
+
+    serialWriteS("IDX:");
+    serialWriteS(uitoa(rev));
+    serialPutC(',');
+    serialWriteS(uitoa(ms));
+    serialPutC(',');
+    serialWriteLn(uitoa(rpm_out < 0 ? 0 : (uint32_t)rpm_out));
+}
+
 void main (void)
 {
     char c;
     uint16_t cmdptr = 0;
 
-    WDTCTL = WDTPW | WDTHOLD;	        // Stop watchdog timer
+    WDTCTL = WDT_MDLY_8;                // Set watchdog to interval timer mode, 0.512 ms tick
+    IE1 |= WDTIE;                       // and enable its interrupt
 
     DCOCTL = CALDCO_16MHZ;              // Set DCO for 16MHz using
     BCSCTL1 = CALBC1_16MHZ;             // calibration registers
 
-    INDEX_CCR0 = 40000;                 // Set inital index pulse time and
-    INDEX_CCR1 = 20000;                 // pulse width
-    INDEX_CCTL1 = OUTMOD_3;             // Set output mode to PWM,
-    INDEX_CTL = TASSEL1|ID0|ID1|TACLR;  // bind to SMCLK and clear TA
-    INDEX_PORT_SEL |= INDEX_BIT;        // Enable TA0.1 on INDEX pin
+    INDEX_CCR0 = ppr - 1;               // Set index timer to count encoder A pulses per revolution
+    INDEX_CCR1 = 0;                     // and index pulse width to one encoder pulse
+    INDEX_CCTL1 = OUTMOD_7;             // Set output mode to reset/set,
+    INDEX_CTL = TASSEL_0|MC_1|TACLR;    // bind to TA0CLK, start in up mode and clear TA
+    INDEX_PORT_SEL |= INDEX_BIT|INDEX_CLK_BIT; // Enable TA0.1 on INDEX pin and TA0CLK input
     INDEX_PORT_DIR |= INDEX_BIT;        // Set index pulse pin as output and
-    SPINDLE_PULSE_CCTL0 = CCIE;         // enable timer interrupt
-
-    SPINDLE_PULSE_CCR0 = 40000;                     // Set initial pulse time and
-    SPINDLE_PULSE_CCR1 = 20000;                     // pulse width
-    SPINDLE_PULSE_CCTL1 = OUTMOD_3;                 // Set output mode to PWM,
-    SPINDLE_PULSE_CTL = TASSEL1|ID0|ID1|TACLR;      // bind to SMCLK and clear TA
-    SPINDLE_PULSE_PORT_SEL |= SPINDLE_PULSE_BIT;    // Enable TA1.0 on pulse pin
-    SPINDLE_PULSE_PORT_DIR |= SPINDLE_PULSE_BIT;    // Set pulse pin as output and
-    INDEX_CCTL0 = CCIE;                             // enable timer interrupt
+    INDEX_CCTL0 = CCIE;                 // enable timer interrupt
 
-    setRPM(rpm, 0);
+    SPINDLE_PULSE_CCR0 = 39999;                     // Set initial period,
+    SPINDLE_PULSE_CCR1 = 39999;                     // encoder A toggle at period end and
+    SPINDLE_PULSE_CCR2 = 19999;                     // encoder B toggle at half period
+    SPINDLE_PULSE_CCTL1 = OUTMOD_4;                 // Set output modes to toggle,
+    SPINDLE_PULSE_CCTL2 = OUTMOD_4;
+    SPINDLE_PULSE_CTL = TASSEL1|TACLR;              // bind to SMCLK and clear TA
+    SPINDLE_PULSE_PORT_SEL |= SPINDLE_PULSE_BIT|SPINDLE_PULSE_B_BIT; // Enable TA1.1 and TA1.2 on pulse pins and
+    SPINDLE_PULSE_PORT_DIR |= SPINDLE_PULSE_BIT|SPINDLE_PULSE_B_BIT; // set them as outputs
 
     SPINDLE_ON_PORT_OUT |= SPINDLE_ON_BIT;
     SPINDLE_ON_PORT_REN |= SPINDLE_ON_BIT;
@@ -292,6 +454,8 @@ void main (void)
 
     _EINT();                                // Enable interrupts
 
+    setRPM(rpm, 0);
+
     serialRxFlush();
     serialWriteLn(message[MSG_ABOUT]);
 
@@ -303,6 +467,9 @@ void main (void)
         } else
             setRPM(rpm, (int16_t)(read_rpm() / 8) - 64);
 
+        if(log_pending)
+            logIndex();
+
         if(serialRxCount()) { // bytes waiting, process them
 
             c = serialRead();
@@ -329,29 +496,41 @@ void main (void)
     }
 }
 
+// Enabled only when a new period is pending, applies it at the end of the current period
+// and disables itself. Encoder outputs are toggled by the timer hardware.
 #pragma vector=SPINDLE_PULSE_IRQH
 __interrupt void TIMER_SP_ISR(void)
 {
-    static unsigned int index = 0;
+    uint16_t ccr0 = next_period.ccr0;
 
-    if(index == 0) {
-        index = ppr - 1;
-        INDEX_CTL |= MC0;   // Start index timer in up mode
-    } else {
-        index--;
-        if(update_rpm) {
-            update_rpm = false;
-            SPINDLE_PULSE_CCR0 = (uint16_t)pulse_period;
-            SPINDLE_PULSE_CCR1 = (uint16_t)pulse_period >> 1;
-
-            INDEX_CCR0 = SPINDLE_PULSE_CCR0;
-            INDEX_CCR1 = SPINDLE_PULSE_CCR1;
-        }
-    }
+    SPINDLE_PULSE_CCTL0 &= ~CCIE;
+
+    SPINDLE_PULSE_CCR0 = ccr0;
+    SPINDLE_PULSE_CCR1 = ccr0;
+    SPINDLE_PULSE_CCR2 = ccr0 >> 1;
+
+    if(((SPINDLE_PULSE_CTL >> 6) & 0x03) != next_period.div) {
+        SPINDLE_PULSE_CTL = (SPINDLE_PULSE_CTL & ~(ID0|ID1)) | (next_period.div << 6);
+        SPINDLE_PULSE_CTL |= TACLR;
+    } else if(SPINDLE_PULSE_TAR >= ccr0)    // Period shortened past the counter,
+        SPINDLE_PULSE_CTL |= TACLR;         // restart it to avoid running to 0xFFFF
 }
 
+// Called once per revolution by the index timer counting encoder A pulses.
 #pragma vector=INDEX_IRQH
 __interrupt void TIMER_INDEX_ISR(void)
 {
-    INDEX_CTL &= ~MC0;     // Stop index timer
+    revs++;
+
+    if(log_interval && !log_pending && revs % log_interval == 0) {
+        log_rev = revs;
+        log_ticks = ticks;
+        log_pending = true;
+    }
+}
+
+#pragma vector=WDT_VECTOR
+__interrupt void WDT_ISR(void)
+{
+    ticks++;
 }
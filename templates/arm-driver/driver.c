@@ -14,8 +14,31 @@
 
 #include "grbl/grbl.h"
 
+// Set to 1 to let the step pulse timer hardware output the pulses. The timer is then run in one-pulse mode
+// and its compare events trigger DMA transfers to the step port instead of interrupts, see stepperPulseStartOnePulse().
+// This removes the pulse reset interrupt and, when a step pulse delay is configured, the delayed pulse interrupt.
+#ifndef STEP_PULSE_ONE_PULSE
+#define STEP_PULSE_ONE_PULSE 0
+#endif
+
+#if STEP_PULSE_ONE_PULSE
+
+// Words transferred by DMA to the step port on the compare events of the step pulse timer.
+// NOTE: Use the format of the port bit set/reset register, writing the output register will affect other pins.
+typedef struct {
+    volatile uint32_t on;   // Transferred on the first compare event, after the step pulse delay.
+    volatile uint32_t off;  // Transferred on the second compare event, at the end of the pulse.
+    bool delayed;
+} step_pulse_t;
+
+static step_pulse_t step_pulse;
+
+#endif
+
 static bool pwmEnabled = false, IOInitDone = false;
+#if !STEP_PULSE_ONE_PULSE
 static axes_signals_t next_step_outbits;
+#endif
 static spindle_pwm_t spindle_pwm;
 static delay_t delay = { .ms = 1, .callback = NULL }; // NOTE: initial ms set to 1 for "resetting" systick timer on startup
 
@@ -31,8 +54,10 @@ static void spindle_set_speed (uint_fast16_t pwm_value);
 // Also, if a MCU specific driver library is used this might have functions to programatically attach handlers.
 
 static void stepper_driver_isr (void);
+#if !STEP_PULSE_ONE_PULSE
 static void stepper_pulse_isr (void);
 static void stepper_pulse_isr_delayed (void);
+#endif
 static void limit_isr (void);
 static void control_isr (void);
 static void systick_isr (void);
@@ -123,11 +148,15 @@ static void stepperGoIdle (bool clear_signals)
 //       in order to avoid excessive delays on completion of motions
 // NOTE: If a 16 bit timer is used it may be neccesary to adjust the timer clock frequency (prescaler)
 //       to cover the needed range. Refer to actual drivers for code examples.
+// NOTE: Implemented in driver_dispatch.h when HAL_STATIC_DISPATCH is defined.
+#ifndef HAL_STATIC_DISPATCH
 static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
     // STEPPERTIMER_LOAD(cycles_per_tick);  // Set the stepper timer timeout time.
 }
+#endif
 
+#if !STEP_PULSE_ONE_PULSE
 
 // Start a stepper pulse, no delay version
 // stepper_t struct is defined in grbl/stepper.h
@@ -160,6 +189,33 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
     }
 }
 
+#else
+
+// Start a stepper pulse, hardware timed version
+// The step pulse timer is configured for one-pulse mode with two compare channels, the first at the
+// step pulse delay and the second at the step pulse delay plus the pulse length. Each compare event
+// triggers a DMA transfer of a step_pulse word to the step port and the timer stops by itself after
+// the second event, no interrupt is raised. When no delay is configured the pulse is started here and
+// only the second compare event is used.
+// NOTE: The direction outputs are set directly and the delay covers the direction to step setup time.
+static void stepperPulseStartOnePulse (stepper_t *stepper)
+{
+    if(stepper->new_block) {
+        stepper->new_block = false;
+        set_dir_outputs(stepper->dir_outbits);
+    }
+
+    if(stepper->step_outbits.value) {
+        if(step_pulse.delayed)
+            step_pulse.on = stepper->step_outbits.value ^ settings.steppers.step_invert.mask; // Convert to set/reset register format here.
+        else
+            set_step_outputs(stepper->step_outbits);
+        // STEPPULSETIMER_START();        // Start step pulse timer, the first DMA transfer is enabled if step_pulse.delayed.
+    }
+}
+
+#endif
+
 
 // Enable/disable limit pins interrupt.
 // NOTE: the homing parameter is indended for configuring advanced
@@ -409,6 +465,14 @@ static void settings_changed (settings_t *settings)
         // Stepper pulse timeout setup.
         // When the stepper pulse is delayed either two timers or a timer that supports multiple
         // compare registers is required.
+#if STEP_PULSE_ONE_PULSE
+        // Load the first compare register with the delay and the second with the delay plus pulse length here,
+        // the timer runs in one-pulse mode and each compare event requests a DMA transfer to the step port.
+        // The word for the end of the pulse does not change between pulses and is set here.
+        step_pulse.delayed = settings->steppers.pulse_delay_microseconds > 0.0f;
+        step_pulse.off = settings->steppers.step_invert.mask; // Convert to set/reset register format here.
+        hal.stepper.pulse_start = stepperPulseStartOnePulse;
+#else
         if(settings->steppers.pulse_delay_microseconds) {
             // Configure step pulse timer(s) for delayed pulse here.
             hal.stepper.pulse_start = stepperPulseStartDelayed;
@@ -416,6 +480,7 @@ static void settings_changed (settings_t *settings)
             // Configure step pulse timer for pulse off here.
             hal.stepper.pulse_start = stepperPulseStart;
         }
+#endif
 
        /*************************
         *  Control pins config  *
@@ -453,6 +518,11 @@ static bool driver_setup (settings_t *settings)
     // Configure stepper driver timer here.
 
     // Configure step pulse timer here.
+#if STEP_PULSE_ONE_PULSE
+    // Set the step pulse timer to one-pulse mode and configure the DMA channels for the compare events here:
+    // memory to peripheral, source &step_pulse.on or &step_pulse.off, destination the step port set/reset register.
+    // Do not enable the timer interrupts.
+#endif
 
    /****************************
     *  Software debounce init  *
@@ -545,7 +615,11 @@ bool driver_init (void)
     hal.stepper.go_idle = stepperGoIdle;
     hal.stepper.enable = stepperEnable;
     hal.stepper.cycles_per_tick = stepperCyclesPerTick;
+#if STEP_PULSE_ONE_PULSE
+    hal.stepper.pulse_start = stepperPulseStartOnePulse;
+#else
     hal.stepper.pulse_start = stepperPulseStart;
+#endif
 
     hal.limits.enable = limitsEnable;
     hal.limits.get_state = limitsGetState;
@@ -628,8 +702,10 @@ static void stepper_driver_isr (void)
    added to Grbl.
 */
 // This interrupt is enabled when Grbl sets the motor port bits to execute
-// a step. This ISR resets the motor port after a short period (settings.pulse_microseconds)
+// a step. Not used when STEP_PULSE_ONE_PULSE is set, the pulse is ended by the timer hardware. This ISR resets the motor port after a short period (settings.pulse_microseconds)
 // completing one step cycle.
+#if !STEP_PULSE_ONE_PULSE
+
 static void stepper_pulse_isr (void)
 {
     // STEPPULSETIMER_STOP(); // Stop step pulse timer.
@@ -646,6 +722,8 @@ static void stepper_pulse_isr_delayed (void)
     }
 }
 
+#endif
+
 // Limit pins ISR.
 static void limit_isr (void)
 {
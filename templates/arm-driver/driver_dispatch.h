@@ -0,0 +1,32 @@
+/*
+  driver_dispatch.h - static dispatch of HAL functions called from the hot paths
+
+  Template driver code for ARM processors
+
+  Part of GrblHAL
+
+  By Terje Io, public domain
+
+*/
+
+// Included by grbl/hal.h when HAL_STATIC_DISPATCH is defined, see grbl/config.h.
+// The core calls the functions mapped here directly, assigning the corresponding hal pointers
+// has no effect. Do not map functions that are swapped at run time, such as the pulse start
+// function when a step pulse delay is configured or the stream read function that is replaced
+// during a soft reset, or that plugins need to hook.
+
+#ifndef _DRIVER_DISPATCH_H_
+#define _DRIVER_DISPATCH_H_
+
+static inline void stepperCyclesPerTick (uint32_t cycles_per_tick)
+{
+    // STEPPERTIMER_LOAD(cycles_per_tick);  // Set the stepper timer timeout time.
+}
+
+// Implemented in driver.c, may be inlined by link time optimization.
+probe_state_t probeGetState (void);
+
+#define hal_stepper_cycles_per_tick(cycles) stepperCyclesPerTick(cycles)
+#define hal_probe_get_state() probeGetState()
+
+#endif